@@ -21,8 +21,10 @@ LOCAL_SRC_FILES := \
         util/QCameraCmdThread.cpp \
         util/QCameraFlash.cpp \
         util/QCameraPerf.cpp \
+        util/QCameraPerfLockScheduler.cpp \
         util/QCameraQueue.cpp \
         util/QCameraCommon.cpp \
+        util/QCameraCapsCache.cpp \
         util/QCameraTrace.cpp \
         util/camscope_packet_type.cpp \
         QCamera2Hal.cpp \
@@ -37,6 +39,11 @@ LOCAL_SRC_FILES += \
         HAL3/QCamera3VendorTags.cpp \
         HAL3/QCamera3PostProc.cpp \
         HAL3/QCamera3CropRegionMapper.cpp \
+        HAL3/QCamera3FrameTimeline.cpp \
+        HAL3/QCamera3HFRBatch.cpp \
+        HAL3/QCamera3Flush.cpp \
+        HAL3/QCamera3RequestGate.cpp \
+        HAL3/QCamera3StreamConfig.cpp \
         HAL3/QCamera3StreamMem.cpp
 
 LOCAL_CFLAGS := -Wall -Wextra -Werror
@@ -59,9 +66,15 @@ LOCAL_SRC_FILES += \
         HAL/QCameraParameters.cpp \
         HAL/QCameraParametersIntf.cpp \
         HAL/QCameraThermalAdapter.cpp \
+        HAL/QCameraThermalGovernor.cpp \
+        HAL/QCameraPreviewCbRing.cpp \
+        util/QCameraDeferredWork.cpp \
         util/QCameraFOVControl.cpp \
+        util/QCameraFOVControlLut.cpp \
         util/QCameraHALPP.cpp \
+        util/QCameraHALPPGraph.cpp \
         util/QCameraDualFOVPP.cpp \
+        util/QCameraDualFOVFusion.cpp \
         util/QCameraExtZoomTranslator.cpp
 endif
 
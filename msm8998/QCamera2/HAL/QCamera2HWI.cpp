@@ -69,8 +69,6 @@ extern "C" {
 
 #define CAMERA_OPEN_PERF_TIME_OUT 500 // 500 milliseconds
 
-// Very long wait, just to be sure we don't deadlock
-#define CAMERA_DEFERRED_THREAD_TIMEOUT 5000000000 // 5 seconds
 #define CAMERA_DEFERRED_MAP_BUF_TIMEOUT 2000000000 // 2 seconds
 #define CAMERA_MIN_METADATA_BUFFERS 10 // Need at least 10 for ZSL snapshot
 #define CAMERA_INITIAL_MAPPABLE_PREVIEW_BUFFERS 5
@@ -82,7 +80,27 @@ extern cam_capability_t *gCamCapability[MM_CAMERA_MAX_NUM_SENSORS];
 extern pthread_mutex_t gCamLock;
 volatile uint32_t gCamHalLogLevel = 1;
 extern uint8_t gNumCameraSessions;
-uint32_t QCamera2HardwareInterface::sNextJobId = 1;
+
+const QCamera2HardwareInterface::DefWorkNode
+        QCamera2HardwareInterface::sDefWorkGraph[CMD_DEF_MAX] = {
+    {CMD_DEF_ALLOCATE_BUFF, "alloc_buff", {NULL}},
+    {CMD_DEF_PPROC_START, "pproc_start",
+            {&QCamera2HardwareInterface::mInitPProcJob}},
+    {CMD_DEF_PPROC_INIT, "pproc_init",
+            {&QCamera2HardwareInterface::mParamInitJob}},
+    {CMD_DEF_METADATA_ALLOC, "metadata_alloc", {NULL}},
+    {CMD_DEF_CREATE_JPEG_SESSION, "jpeg_session",
+            {&QCamera2HardwareInterface::mReprocJob}},
+    {CMD_DEF_PARAM_ALLOC, "param_alloc", {NULL}},
+    {CMD_DEF_PARAM_INIT, "param_init",
+            {&QCamera2HardwareInterface::mParamAllocJob}},
+    {CMD_DEF_JPEG_OPEN, "jpeg_open",
+            {&QCamera2HardwareInterface::mParamInitJob}},
+    {CMD_DEF_PPROC_SETUP, "pproc_setup",
+            {&QCamera2HardwareInterface::mJpegOpenJob,
+             &QCamera2HardwareInterface::mPProcCoreInitJob}},
+    {CMD_DEF_GENERIC, "generic", {NULL}},
+};
 
 camera_device_ops_t QCamera2HardwareInterface::mCameraOps = {
     .set_preview_window =        QCamera2HardwareInterface::set_preview_window,
@@ -1640,6 +1658,7 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
       mDumpFrmCnt(0U),
       mDumpSkipCnt(0U),
       mThermalLevel(QCAMERA_THERMAL_NO_ADJUSTMENT),
+      mThermalGovernorEnabled(false),
       mActiveAF(false),
       m_HDRSceneEnabled(false),
       mLongshotEnabled(false),
@@ -1671,6 +1690,8 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
       mJpegJob(0),
       mMetadataAllocJob(0),
       mInitPProcJob(0),
+      mJpegOpenJob(0),
+      mPProcCoreInitJob(0),
       mParamAllocJob(0),
       mParamInitJob(0),
       mOutputCount(0),
@@ -1689,6 +1710,11 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
 {
 #ifdef TARGET_TS_MAKEUP
     memset(&mFaceRect, -1, sizeof(mFaceRect));
+    // 0 uses the HW face detection result for preview beautification,
+    // N > 0 runs TS face detection on every Nth preview frame instead.
+    char tsProp[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.tsmakeup.fd_interval", tsProp, "0");
+    mTsPreviewTracker.setInterval((uint32_t)atoi(tsProp));
 #endif
     getLogLevel();
     ATRACE_CAMSCOPE_CALL(CAMSCOPE_HAL1_QCAMERA2HWI);
@@ -1719,13 +1745,18 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
 
     memset(m_BackendFileName, 0, QCAMERA_MAX_FILEPATH_LENGTH);
 
-    memset(mDefOngoingJobs, 0, sizeof(mDefOngoingJobs));
     memset(&mJpegMetadata, 0, sizeof(mJpegMetadata));
     memset(&mJpegHandle, 0, sizeof(mJpegHandle));
     memset(&mJpegMpoHandle, 0, sizeof(mJpegMpoHandle));
 
-    mDeferredWorkThread.launch(deferredWorkRoutine, this);
-    mDeferredWorkThread.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, FALSE, FALSE);
+    deferred_work_ops_t defWorkOps;
+    defWorkOps.run = runDeferredWork;
+    defWorkOps.cancel = cancelDeferredWork;
+    defWorkOps.done = deferredWorkDone;
+    defWorkOps.user = this;
+    char defWorkProp[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.defwork.threads", defWorkProp, "3");
+    mDeferredWork.launch(defWorkOps, (uint32_t)atoi(defWorkProp), "CAM_defrdWrk");
 
     pthread_mutex_init(&mGrallocLock, NULL);
     mEnqueuedBuffers = 0;
@@ -1733,6 +1764,12 @@ QCamera2HardwareInterface::QCamera2HardwareInterface(uint32_t cameraId)
     mFrameSkipEnd = 0;
     mLastPreviewFrameID = 0;
 
+    property_get("persist.camera.thermal.governor", prop, "0");
+    mThermalGovernorEnabled = (atoi(prop) > 0);
+
+    property_get("persist.camera.prevcb.ring", prop, "3");
+    mPreviewCbRing.setDepth((uint32_t)atoi(prop));
+
     //Load and read GPU library.
     lib_surface_utils = NULL;
     LINK_get_surface_pixel_alignment = NULL;
@@ -1761,8 +1798,7 @@ QCamera2HardwareInterface::~QCamera2HardwareInterface()
 {
     LOGH("E");
 
-    mDeferredWorkThread.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
-    mDeferredWorkThread.exit();
+    mDeferredWork.exit();
 
     if (mMetadataMem != NULL) {
         delete mMetadataMem;
@@ -1795,28 +1831,46 @@ QCamera2HardwareInterface::~QCamera2HardwareInterface()
 /*===========================================================================
  * FUNCTION   : deferPPInit
  *
- * DESCRIPTION: Queue postproc init task to deferred thread
+ * DESCRIPTION: Queue postproc init tasks to deferred work pool. The JPEG
+ *              client open and the postprocessor init run in parallel, a
+ *              setup job joins them.
  *
  * PARAMETERS : none
  *
- * RETURN     : uint32_t job id of pproc init job
+ * RETURN     : uint32_t job id of pproc setup job
  *              0  -- failure
  *==========================================================================*/
 uint32_t QCamera2HardwareInterface::deferPPInit()
 {
-    // init pproc
     DeferWorkArgs args;
-    DeferPProcInitArgs pprocInitArgs;
-
     memset(&args, 0, sizeof(DeferWorkArgs));
+
+    mJpegOpenJob = 0;
+    if (!mJpegClientHandle) {
+        mJpegOpenJob = queueDeferredWork(CMD_DEF_JPEG_OPEN, args);
+        if (mJpegOpenJob == 0) {
+            LOGE("Failed queueing JPEG_OPEN job");
+            return 0;
+        }
+    }
+
+    // init pproc
+    DeferPProcInitArgs pprocInitArgs;
     memset(&pprocInitArgs, 0, sizeof(DeferPProcInitArgs));
 
     pprocInitArgs.jpeg_cb = jpegEvtHandle;
     pprocInitArgs.user_data = this;
     args.pprocInitArgs = pprocInitArgs;
 
-    return queueDeferredWork(CMD_DEF_PPROC_INIT,
+    mPProcCoreInitJob = queueDeferredWork(CMD_DEF_PPROC_INIT,
             args);
+    if (mPProcCoreInitJob == 0) {
+        LOGE("Failed queueing PPROC_INIT job");
+        return 0;
+    }
+
+    memset(&args, 0, sizeof(DeferWorkArgs));
+    return queueDeferredWork(CMD_DEF_PPROC_SETUP, args);
 }
 
 /*===========================================================================
@@ -1971,8 +2025,8 @@ int QCamera2HardwareInterface::openCamera()
 
     // Init params in the background
     // 1. It's safe to queue init job, even if alloc job is not yet complete.
-    // It will be queued to the same thread, so the alloc is guaranteed to
-    // finish first.
+    // It declares a dependency on the alloc job, so the alloc is guaranteed
+    // to finish first.
     // 2. However, it is not safe to begin param init until after camera is
     // open. That is why we wait until after camera open completes to schedule
     // this task.
@@ -2278,10 +2332,14 @@ int QCamera2HardwareInterface::closeCamera()
     m_cbNotifier.exit();
 
     // stop and deinit postprocessor
+    waitDeferredWork(mInitPProcJob);
     waitDeferredWork(mReprocJob);
     // Close the JPEG session
     waitDeferredWork(mJpegJob);
     m_postprocessor.stop();
+#ifdef TARGET_TS_MAKEUP
+    mTsSnapshotTracker.reset();
+#endif
     deinitJpegHandle();
     m_postprocessor.deinit();
     mInitPProcJob = 0; // reset job id, so pproc can be reinited later
@@ -2457,6 +2515,14 @@ int QCamera2HardwareInterface::initCapabilities(uint32_t cameraId,
     ATRACE_CAMSCOPE_CALL(CAMSCOPE_HAL1_INIT_CAP);
     int rc = 0;
     uint32_t handle = 0;
+    uint64_t identity = QCameraCommon::getCameraIdentity(cameraId);
+
+    gCamCapability[cameraId] = QCameraCommon::loadCachedCapability(cameraId,
+            CAPS_CACHE_SECTION_HAL1_CAPS, identity);
+    if (gCamCapability[cameraId] != NULL) {
+        gCamCapability[cameraId]->camera_index = cameraId;
+        return NO_ERROR;
+    }
 
     rc = camera_open((uint8_t)cameraId, &cameraHandle);
     if (rc) {
@@ -2497,6 +2563,8 @@ int QCamera2HardwareInterface::initCapabilities(uint32_t cameraId,
         memcpy(gCamCapability[cameraId]->main_cam_cap, gCamCapability[cameraId],
                 sizeof(cam_capability_t));
     }
+    QCameraCommon::storeCachedCapability(cameraId, CAPS_CACHE_SECTION_HAL1_CAPS,
+            identity, gCamCapability[cameraId]);
 failed_op:
     cameraHandle->ops->close_camera(cameraHandle->camera_handle);
     cameraHandle = NULL;
@@ -3960,9 +4028,16 @@ int QCamera2HardwareInterface::stopPreview()
     stopChannel(QCAMERA_CH_TYPE_RAW);
 
     m_cbNotifier.flushPreviewNotifications();
+    preview_cb_ring_stats_t cbRingStats;
+    mPreviewCbRing.getStats(cbRingStats);
+    LOGH("Preview callback buffers: %llu allocated, %llu reused",
+            (unsigned long long)cbRingStats.allocs,
+            (unsigned long long)cbRingStats.reuses);
+    mPreviewCbRing.clear();
     //add for ts makeup
 #ifdef TARGET_TS_MAKEUP
     ts_makeup_finish();
+    mTsPreviewTracker.reset();
 #endif
     // delete all channels from preparePreview
     unpreparePreview();
@@ -4984,8 +5059,8 @@ int QCamera2HardwareInterface::takePicture()
             args.pprocArgs = pPicChannel;
 
             // No need to wait for mInitPProcJob here, because it was
-            // queued in startPreview, and will definitely be processed before
-            // mReprocJob can begin.
+            // queued in startPreview, and PPROC_START declares it as a
+            // dependency, so it is done before mReprocJob can begin.
             mReprocJob = queueDeferredWork(CMD_DEF_PPROC_START,
                     args);
             if (mReprocJob == 0) {
@@ -5142,8 +5217,8 @@ int QCamera2HardwareInterface::takePicture()
                 args.pprocArgs = m_channels[QCAMERA_CH_TYPE_CAPTURE];
 
                 // No need to wait for mInitPProcJob here, because it was
-                // queued in startPreview, and will definitely be processed before
-                // mReprocJob can begin.
+                // queued in startPreview, and PPROC_START declares it as a
+                // dependency, so it is done before mReprocJob can begin.
                 mReprocJob = queueDeferredWork(CMD_DEF_PPROC_START,
                         args);
                 if (mReprocJob == 0) {
@@ -5422,6 +5497,9 @@ int QCamera2HardwareInterface::cancelPicture()
 
     //stop post processor
     m_postprocessor.stop();
+#ifdef TARGET_TS_MAKEUP
+    mTsSnapshotTracker.reset();
+#endif
 
     unconfigureAdvancedCapture();
     LOGH("Enable display frames again");
@@ -5883,8 +5961,8 @@ int QCamera2HardwareInterface::takeLiveSnapshot_internal()
     args.pprocArgs = pChannel;
 
     // No need to wait for mInitPProcJob here, because it was
-    // queued in startPreview, and will definitely be processed before
-    // mReprocJob can begin.
+    // queued in startPreview, and PPROC_START declares it as a
+    // dependency, so it is done before mReprocJob can begin.
     mReprocJob = queueDeferredWork(CMD_DEF_PPROC_START,
             args);
     if (mReprocJob == 0) {
@@ -6060,6 +6138,9 @@ int QCamera2HardwareInterface::cancelLiveSnapshot_internal() {
     waitDeferredWork(mJpegJob);
     //stop post processor
     m_postprocessor.stop();
+#ifdef TARGET_TS_MAKEUP
+    mTsSnapshotTracker.reset();
+#endif
 
     // stop snapshot channel
     if (!mParameters.isTNRSnapshotEnabled()) {
@@ -6359,6 +6440,19 @@ int QCamera2HardwareInterface::dump(int fd)
     dprintf(fd, "StoreMetaDataInFrame: %d \n", mStoreMetaDataInFrame);
     dprintf(fd, "\n Configuration: %s", mParameters.dump().string());
     dprintf(fd, "\n State Information: %s", m_stateMachine.dump().string());
+    m_perfLockMgr.dump(fd);
+    if (mThermalGovernorEnabled) {
+        thermal_governor_stats_t stats;
+        mThermalGovernor.getStats(stats);
+        dprintf(fd, "\n Thermal governor: level %d step %u fps scale %.2f "
+                "skip %u utilization %.2f steps down %u up %u "
+                "level changes %u\n", stats.level, stats.step,
+                QCameraThermalGovernor::fpsScaleOf(stats.step),
+                QCameraThermalGovernor::skipIntervalOf(stats.step),
+                stats.utilization, stats.stepsDown, stats.stepsUp,
+                stats.levelChanges);
+    }
+    camscope_dump(CAMSCOPE_SECTION_HAL, fd);
     dprintf(fd, "\n Camera HAL information End \n");
 
     /* send UPDATE_DEBUG_LEVEL to the backend so that they can read the
@@ -6488,9 +6582,8 @@ void QCamera2HardwareInterface::camEvtHandle(uint32_t /*camera_handle*/,
                     break;
                 case CAM_EVENT_TYPE_DAEMON_DIED:
                     {
-                        Mutex::Autolock l(obj->mDefLock);
-                        obj->mDefCond.broadcast();
-                        LOGH("broadcast mDefCond signal\n");
+                        obj->mDeferredWork.wakeWaiters();
+                        LOGH("woke deferred work waiters\n");
                     }
                 default:
                     obj->processEvt(QCAMERA_SM_EVT_EVT_NOTIFY, payload);
@@ -7936,6 +8029,8 @@ int32_t QCamera2HardwareInterface::addZSLChannel()
     }
     attr.water_mark = mParameters.getZSLQueueDepth();
     attr.max_unmatched_frames = mParameters.getMaxUnmatchedFramesInQueue();
+    attr.zsl_budget_bytes = mParameters.getZSLBudgetBytes();
+    attr.zsl_select_best = mParameters.isZSLSelectBestEnabled();
     attr.user_expected_frame_id =
         mParameters.isInstantCaptureEnabled() ? (uint8_t)mParameters.getAecFrameBoundValue() : 0;
 
@@ -9385,6 +9480,35 @@ void QCamera2HardwareInterface::releaseCameraMemory(void *data,
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : returnPreviewCbBuffer
+ *
+ * DESCRIPTION: returns a preview callback buffer to the callback ring once
+ *              the data callback is done with it
+ *
+ * PARAMETERS :
+ *   @data    : buffer to be returned
+ *   @cookie  : context data
+ *   @cbStatus: callback status
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::returnPreviewCbBuffer(void *data,
+                                                      void *cookie,
+                                                      int32_t /*cbStatus*/)
+{
+    camera_memory_t *mem = ( camera_memory_t * ) data;
+    QCamera2HardwareInterface *pme = ( QCamera2HardwareInterface * ) cookie;
+    if ( NULL == mem ) {
+        return;
+    }
+    if ( NULL != pme ) {
+        pme->mPreviewCbRing.put(mem);
+    } else {
+        mem->release(mem);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : returnStreamBuffer
  *
@@ -9627,6 +9751,11 @@ int QCamera2HardwareInterface::calcThermalLevel(
         break;
     }
     if (level >= QCAMERA_THERMAL_NO_ADJUSTMENT && level <= QCAMERA_THERMAL_MAX_ADJUSTMENT) {
+        if (mThermalGovernorEnabled) {
+            // Closed loop mode: the governor step replaces the fixed table
+            calcThermalGovernorRange(minFPS, maxFPS, minVideoFps, maxVideoFps,
+                    adjustedRange, skipPattern);
+        }
         if (bRecordingHint) {
             adjustedRange.min_fps = minFPS / 1000.0f;
             adjustedRange.max_fps = maxFPS / 1000.0f;
@@ -9643,6 +9772,77 @@ int QCamera2HardwareInterface::calcThermalLevel(
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : calcThermalGovernorRange
+ *
+ * DESCRIPTION: calculate the fps range and frame skip pattern for the
+ *              current thermal governor step. The range is never lowered
+ *              below the lowest fps the sensor supports.
+ *
+ * PARAMETERS :
+ *   @minFPS     : minimum configured fps range
+ *   @maxFPS     : maximum configured fps range
+ *   @minVideoFps: minimum configured video fps range
+ *   @maxVideoFps: maximum configured video fps range
+ *   @adjustedRange : target fps range
+ *   @skipPattern : target skip pattern
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera2HardwareInterface::calcThermalGovernorRange(
+            const float minFPS,
+            const float maxFPS,
+            const float minVideoFps,
+            const float maxVideoFps,
+            cam_fps_range_t &adjustedRange,
+            enum msm_vfe_frame_skip_pattern &skipPattern)
+{
+    uint32_t step = mThermalGovernor.getStep();
+    float scale = QCameraThermalGovernor::fpsScaleOf(step);
+
+    float lowest = minFPS / 1000.0f;
+    cam_capability_t *capability = gCamCapability[mCameraId];
+    for (size_t i = 0; i < capability->fps_ranges_tbl_cnt; i++) {
+        if (capability->fps_ranges_tbl[i].min_fps < lowest) {
+            lowest = capability->fps_ranges_tbl[i].min_fps;
+        }
+    }
+    if (lowest < 1) {
+        lowest = 1;
+    }
+
+    adjustedRange.min_fps = MAX(lowest, scale * minFPS / 1000.0f);
+    adjustedRange.max_fps = MAX(lowest, scale * maxFPS / 1000.0f);
+    adjustedRange.video_min_fps = MAX(lowest, scale * minVideoFps / 1000.0f);
+    adjustedRange.video_max_fps = MAX(lowest, scale * maxVideoFps / 1000.0f);
+
+    switch (QCameraThermalGovernor::skipIntervalOf(step)) {
+    case 1:
+        skipPattern = NO_SKIP;
+        break;
+    case 2:
+        skipPattern = EVERY_2FRAME;
+        break;
+    case 3:
+        skipPattern = EVERY_3FRAME;
+        break;
+    case 4:
+        skipPattern = EVERY_4FRAME;
+        break;
+    case 5:
+        skipPattern = EVERY_5FRAME;
+        break;
+    case 6:
+        skipPattern = EVERY_6FRAME;
+        break;
+    default:
+        skipPattern = MAX_SKIP;
+        break;
+    }
+
+    LOGH("Thermal governor step %u, fps scale %.2f", step, scale);
+}
+
 /*===========================================================================
  * FUNCTION   : recalcFPSRange
  *
@@ -9717,6 +9917,15 @@ int QCamera2HardwareInterface::updateThermalLevel(void *thermal_level)
         maxVideoFPS = maxFPS;
     }
 
+    if (mThermalGovernorEnabled) {
+        nsecs_t now = systemTime();
+        mThermalGovernor.onThermalLevel(level, now);
+        if (mThermalGovernor.update(now)) {
+            LOGH("Thermal governor moved to step %u at level %d",
+                    mThermalGovernor.getStep(), level);
+        }
+    }
+
     value = mParameters.getRecordingHintValue();
     calcThermalLevel(level, minFPS, maxFPS, minVideoFPS, maxVideoFPS,
             adjustedRange, skipPattern, value );
@@ -10415,369 +10624,382 @@ bool QCamera2HardwareInterface::needFDMetadata(qcamera_ch_type_enum_t channel_ty
 }
 
 /*===========================================================================
- * FUNCTION   : deferredWorkRoutine
+ * FUNCTION   : runDeferredWork
  *
- * DESCRIPTION: data process routine that executes deferred tasks
+ * DESCRIPTION: executes a deferred task on a deferred work pool worker
  *
  * PARAMETERS :
- *   @data    : user data ptr (QCamera2HardwareInterface)
+ *   @user    : user data ptr (QCamera2HardwareInterface)
+ *   @work    : deferred work (DefWork), released here
  *
- * RETURN     : None
+ * RETURN     : int32_t type of status of the task
+ *              NO_ERROR  -- success
+ *              none-zero failure code
  *==========================================================================*/
-void *QCamera2HardwareInterface::deferredWorkRoutine(void *obj)
-{
-    int running = 1;
-    int ret;
-    uint8_t is_active = FALSE;
-    int32_t job_status = 0;
-
-    QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)obj;
-    QCameraCmdThread *cmdThread = &pme->mDeferredWorkThread;
-    cmdThread->setName("CAM_defrdWrk");
-
-    do {
-        do {
-            ret = cam_sem_wait(&cmdThread->cmd_sem);
-            if (ret != 0 && errno != EINVAL) {
-                LOGE("cam_sem_wait error (%s)",
-                         strerror(errno));
-                return NULL;
-            }
-        } while (ret != 0);
-
-        // we got notified about new cmd avail in cmd queue
-        camera_cmd_type_t cmd = cmdThread->getCmd();
-        LOGD("cmd: %d", cmd);
-        switch (cmd) {
-        case CAMERA_CMD_TYPE_START_DATA_PROC:
-            LOGH("start data proc");
-            is_active = TRUE;
-            break;
-        case CAMERA_CMD_TYPE_STOP_DATA_PROC:
-            LOGH("stop data proc");
-            is_active = FALSE;
-            // signal cmd is completed
-            cam_sem_post(&cmdThread->sync_sem);
-            break;
-        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                DefWork *dw =
-                    reinterpret_cast<DefWork *>(pme->mCmdQueue.dequeue());
-
-                if ( NULL == dw ) {
-                    LOGE("Invalid deferred work");
-                    break;
-                }
+int32_t QCamera2HardwareInterface::runDeferredWork(void *user, void *work)
+{
+    int32_t job_status = NO_ERROR;
+    QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)user;
+    DefWork *dw = reinterpret_cast<DefWork *>(work);
 
-                switch( dw->cmd ) {
-                case CMD_DEF_ALLOCATE_BUFF:
-                    {
-                        QCameraChannel * pChannel = dw->args.allocArgs.ch;
+    if ((NULL == pme) || (NULL == dw)) {
+        LOGE("Invalid deferred work");
+        delete dw;
+        return BAD_VALUE;
+    }
 
-                        if ( NULL == pChannel ) {
-                            LOGE("Invalid deferred work channel");
-                            job_status = BAD_VALUE;
-                            break;
-                        }
+    switch( dw->cmd ) {
+    case CMD_DEF_ALLOCATE_BUFF:
+        {
+            QCameraChannel * pChannel = dw->args.allocArgs.ch;
 
-                        cam_stream_type_t streamType = dw->args.allocArgs.type;
-                        LOGH("Deferred buffer allocation started for stream type: %d",
-                                 streamType);
+            if ( NULL == pChannel ) {
+                LOGE("Invalid deferred work channel");
+                job_status = BAD_VALUE;
+                break;
+            }
 
-                        uint32_t iNumOfStreams = pChannel->getNumOfStreams();
-                        QCameraStream *pStream = NULL;
-                        for ( uint32_t i = 0; i < iNumOfStreams; ++i) {
-                            pStream = pChannel->getStreamByIndex(i);
+            cam_stream_type_t streamType = dw->args.allocArgs.type;
+            LOGH("Deferred buffer allocation started for stream type: %d",
+                     streamType);
 
-                            if ( NULL == pStream ) {
-                                job_status = BAD_VALUE;
-                                break;
-                            }
+            uint32_t iNumOfStreams = pChannel->getNumOfStreams();
+            QCameraStream *pStream = NULL;
+            for ( uint32_t i = 0; i < iNumOfStreams; ++i) {
+                pStream = pChannel->getStreamByIndex(i);
 
-                            if ( pStream->isTypeOf(streamType)) {
-                                if ( pStream->allocateBuffers() ) {
-                                    LOGE("Error allocating buffers !!!");
-                                    job_status =  NO_MEMORY;
-                                    pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                            CAMERA_ERROR_UNKNOWN, 0);
-                                }
-                                break;
-                            }
-                        }
-                    }
+                if ( NULL == pStream ) {
+                    job_status = BAD_VALUE;
                     break;
-                case CMD_DEF_PPROC_START:
-                    {
-                        int32_t ret = pme->getDefJobStatus(pme->mInitPProcJob);
-                        if (ret != NO_ERROR) {
-                            job_status = ret;
-                            LOGE("PPROC Start failed");
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
-                        QCameraChannel * pChannel = dw->args.pprocArgs;
-                        assert(pChannel);
-
-                        if (pme->m_postprocessor.start(pChannel) != NO_ERROR) {
-                            LOGE("cannot start postprocessor");
-                            job_status = BAD_VALUE;
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                        }
-                    }
-                    break;
-                case CMD_DEF_METADATA_ALLOC:
-                    {
-                        int32_t ret = pme->getDefJobStatus(pme->mParamAllocJob);
-                        if (ret != NO_ERROR) {
-                            job_status = ret;
-                            LOGE("Metadata alloc failed");
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
-                        pme->mMetadataMem = new QCameraMetadataStreamMemory(
-                                QCAMERA_ION_USE_CACHE);
-
-                        if (pme->mMetadataMem == NULL) {
-                            LOGE("Unable to allocate metadata buffers");
-                            job_status = BAD_VALUE;
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                        } else {
-                            int32_t rc = pme->mMetadataMem->allocate(
-                                    dw->args.metadataAllocArgs.bufferCnt,
-                                    dw->args.metadataAllocArgs.size);
-                            if (rc < 0) {
-                                delete pme->mMetadataMem;
-                                pme->mMetadataMem = NULL;
-                            }
-                        }
-                     }
-                     break;
-                case CMD_DEF_CREATE_JPEG_SESSION:
-                    {
-                        QCameraChannel * pChannel = dw->args.pprocArgs;
-                        assert(pChannel);
-
-                        int32_t ret = pme->getDefJobStatus(pme->mReprocJob);
-                        if (ret != NO_ERROR) {
-                            job_status = ret;
-                            LOGE("Jpeg create failed");
-                            break;
-                        }
+                }
 
-                        if (pme->m_postprocessor.createJpegSession(pChannel)
-                            != NO_ERROR) {
-                            LOGE("cannot create JPEG session");
-                            job_status = UNKNOWN_ERROR;
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                        }
+                if ( pStream->isTypeOf(streamType)) {
+                    if ( pStream->allocateBuffers() ) {
+                        LOGE("Error allocating buffers !!!");
+                        job_status =  NO_MEMORY;
+                        pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                                CAMERA_ERROR_UNKNOWN, 0);
                     }
                     break;
-                case CMD_DEF_PPROC_INIT:
-                    {
-                        int32_t rc = NO_ERROR;
-
-                        jpeg_encode_callback_t jpegEvtHandle =
-                                dw->args.pprocInitArgs.jpeg_cb;
-                        void* user_data = dw->args.pprocInitArgs.user_data;
-                        QCameraPostProcessor *postProcessor =
-                                &(pme->m_postprocessor);
-                        uint32_t cameraId = pme->mCameraId;
-                        cam_capability_t *capability =
-                                gCamCapability[cameraId];
-                        cam_padding_info_t padding_info;
-                        cam_padding_info_t& cam_capability_padding_info =
-                                capability->padding_info;
-
-                        if(!pme->mJpegClientHandle) {
-                            rc = pme->initJpegHandle();
-                            if (rc != NO_ERROR) {
-                                LOGE("Error!! creating JPEG handle failed");
-                                job_status = UNKNOWN_ERROR;
-                                pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                        CAMERA_ERROR_UNKNOWN, 0);
-                                break;
-                            }
-                        }
-                        LOGH("mJpegClientHandle : %d", pme->mJpegClientHandle);
-
-                        rc = postProcessor->setJpegHandle(&pme->mJpegHandle,
-                                &pme->mJpegMpoHandle,
-                                pme->mJpegClientHandle);
-                        if (rc != 0) {
-                            LOGE("Error!! set JPEG handle failed");
-                            job_status = UNKNOWN_ERROR;
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
+                }
+            }
+        }
+        break;
+    case CMD_DEF_PPROC_START:
+        {
+            int32_t ret = pme->getDefJobStatus(pme->mInitPProcJob);
+            if (ret != NO_ERROR) {
+                job_status = ret;
+                LOGE("PPROC Start failed");
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+                break;
+            }
+            QCameraChannel * pChannel = dw->args.pprocArgs;
+            assert(pChannel);
 
-                        /* get max pic size for jpeg work buf calculation*/
-                        rc = postProcessor->init(jpegEvtHandle, user_data);
+            if (pme->m_postprocessor.start(pChannel) != NO_ERROR) {
+                LOGE("cannot start postprocessor");
+                job_status = BAD_VALUE;
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+            }
+        }
+        break;
+    case CMD_DEF_METADATA_ALLOC:
+        {
+            pme->mMetadataMem = new QCameraMetadataStreamMemory(
+                    QCAMERA_ION_USE_CACHE);
+
+            if (pme->mMetadataMem == NULL) {
+                LOGE("Unable to allocate metadata buffers");
+                job_status = BAD_VALUE;
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+            } else {
+                int32_t rc = pme->mMetadataMem->allocate(
+                        dw->args.metadataAllocArgs.bufferCnt,
+                        dw->args.metadataAllocArgs.size);
+                if (rc < 0) {
+                    delete pme->mMetadataMem;
+                    pme->mMetadataMem = NULL;
+                }
+            }
+         }
+         break;
+    case CMD_DEF_CREATE_JPEG_SESSION:
+        {
+            QCameraChannel * pChannel = dw->args.pprocArgs;
+            assert(pChannel);
 
-                        if (rc != NO_ERROR) {
-                            LOGE("cannot init postprocessor");
-                            job_status = UNKNOWN_ERROR;
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
+            int32_t ret = pme->getDefJobStatus(pme->mReprocJob);
+            if (ret != NO_ERROR) {
+                job_status = ret;
+                LOGE("Jpeg create failed");
+                break;
+            }
 
-                        // update padding info from jpeg
-                        postProcessor->getJpegPaddingReq(padding_info);
-                        if (cam_capability_padding_info.width_padding <
-                                padding_info.width_padding) {
-                            cam_capability_padding_info.width_padding =
-                                    padding_info.width_padding;
-                        }
-                        if (cam_capability_padding_info.height_padding <
-                                padding_info.height_padding) {
-                            cam_capability_padding_info.height_padding =
-                                    padding_info.height_padding;
-                        }
-                        if (cam_capability_padding_info.plane_padding !=
-                                padding_info.plane_padding) {
-                            cam_capability_padding_info.plane_padding =
-                                    mm_stream_calc_lcm(
-                                    cam_capability_padding_info.plane_padding,
-                                    padding_info.plane_padding);
-                        }
-                        if (cam_capability_padding_info.offset_info.offset_x
-                                != padding_info.offset_info.offset_x) {
-                            cam_capability_padding_info.offset_info.offset_x =
-                                    mm_stream_calc_lcm (
-                                    cam_capability_padding_info.offset_info.offset_x,
-                                    padding_info.offset_info.offset_x);
-                        }
-                        if (cam_capability_padding_info.offset_info.offset_y
-                                != padding_info.offset_info.offset_y) {
-                            cam_capability_padding_info.offset_info.offset_y =
-                            mm_stream_calc_lcm (
-                                    cam_capability_padding_info.offset_info.offset_y,
-                                    padding_info.offset_info.offset_y);
-                        }
-                    }
-                    break;
-                case CMD_DEF_PARAM_ALLOC:
-                    {
-                        int32_t rc = NO_ERROR;
-                        if (pme->isDualCamera()) {
-                            rc = pme->mParameters.allocate(MM_CAMERA_MAX_CAM_CNT);
-                        } else {
-                            rc = pme->mParameters.allocate();
-                        }
-                        // notify routine would not be initialized by this time.
-                        // So, just update error job status
-                        if (rc != NO_ERROR) {
-                            job_status = rc;
-                            LOGE("Param allocation failed");
-                            break;
-                        }
-                    }
-                    break;
-                case CMD_DEF_PARAM_INIT:
-                    {
-                        int32_t rc = pme->getDefJobStatus(pme->mParamAllocJob);
-                        if (rc != NO_ERROR) {
-                            job_status = rc;
-                            LOGE("Param init failed");
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
+            if (pme->m_postprocessor.createJpegSession(pChannel)
+                != NO_ERROR) {
+                LOGE("cannot create JPEG session");
+                job_status = UNKNOWN_ERROR;
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+            }
+        }
+        break;
+    case CMD_DEF_JPEG_OPEN:
+        {
+            if(!pme->mJpegClientHandle) {
+                int32_t rc = pme->initJpegHandle();
+                if (rc != NO_ERROR) {
+                    LOGE("Error!! creating JPEG handle failed");
+                    job_status = UNKNOWN_ERROR;
+                    pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                            CAMERA_ERROR_UNKNOWN, 0);
+                }
+            }
+        }
+        break;
+    case CMD_DEF_PPROC_INIT:
+        {
+            jpeg_encode_callback_t jpegEvtHandle =
+                    dw->args.pprocInitArgs.jpeg_cb;
+            void* user_data = dw->args.pprocInitArgs.user_data;
 
-                        uint32_t camId = pme->mCameraId;
-                        cam_capability_t * cap = gCamCapability[camId];
+            /* get max pic size for jpeg work buf calculation*/
+            int32_t rc = pme->m_postprocessor.init(jpegEvtHandle, user_data);
 
-                        if (pme->mCameraHandle == NULL) {
-                            LOGE("Camera handle is null");
-                            job_status = BAD_VALUE;
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
+            if (rc != NO_ERROR) {
+                LOGE("cannot init postprocessor");
+                job_status = UNKNOWN_ERROR;
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+            }
+        }
+        break;
+    case CMD_DEF_PPROC_SETUP:
+        {
+            int32_t rc = pme->getDefJobStatus(pme->mJpegOpenJob);
+            if (rc == NO_ERROR) {
+                rc = pme->getDefJobStatus(pme->mPProcCoreInitJob);
+            }
+            if (rc != NO_ERROR) {
+                job_status = rc;
+                LOGE("PPROC setup failed");
+                break;
+            }
 
-                        // Now PostProc need calibration data as initialization
-                        // time for jpeg_open and calibration data is a
-                        // get param for now, so params needs to be initialized
-                        // before postproc init
-                        rc = pme->mParameters.init(cap,
-                                pme->mCameraHandle,
-                                pme, pme->m_pFovControl);
-                        if (rc != 0) {
-                            job_status = UNKNOWN_ERROR;
-                            LOGE("Parameter Initialization failed");
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
+            QCameraPostProcessor *postProcessor =
+                    &(pme->m_postprocessor);
+            uint32_t cameraId = pme->mCameraId;
+            cam_capability_t *capability =
+                    gCamCapability[cameraId];
+            cam_padding_info_t padding_info;
+            cam_padding_info_t& cam_capability_padding_info =
+                    capability->padding_info;
+
+            LOGH("mJpegClientHandle : %d", pme->mJpegClientHandle);
+
+            rc = postProcessor->setJpegHandle(&pme->mJpegHandle,
+                    &pme->mJpegMpoHandle,
+                    pme->mJpegClientHandle);
+            if (rc != 0) {
+                LOGE("Error!! set JPEG handle failed");
+                job_status = UNKNOWN_ERROR;
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+                break;
+            }
 
-                        // Get related cam calibration only in
-                        // dual camera mode
-                        if ((pme->getRelatedCamSyncInfo()->sync_control ==
-                                CAM_SYNC_RELATED_SENSORS_ON) || pme->isDualCamera()){
-                            rc = pme->mParameters.getRelatedCamCalibration(
-                                &(pme->mJpegMetadata.otp_calibration_data));
-                            LOGD("Dumping Calibration Data Version Id %f rc %d",
-                                    pme->mJpegMetadata.otp_calibration_data.calibration_format_version,
-                                    rc);
-                            if (rc != 0) {
-                                job_status = UNKNOWN_ERROR;
-                                LOGE("getRelatedCamCalibration failed");
-                                pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                        CAMERA_ERROR_UNKNOWN, 0);
-                                break;
-                            }
-                            pme->m_bRelCamCalibValid = true;
-                        }
+            // update padding info from jpeg
+            postProcessor->getJpegPaddingReq(padding_info);
+            if (cam_capability_padding_info.width_padding <
+                    padding_info.width_padding) {
+                cam_capability_padding_info.width_padding =
+                        padding_info.width_padding;
+            }
+            if (cam_capability_padding_info.height_padding <
+                    padding_info.height_padding) {
+                cam_capability_padding_info.height_padding =
+                        padding_info.height_padding;
+            }
+            if (cam_capability_padding_info.plane_padding !=
+                    padding_info.plane_padding) {
+                cam_capability_padding_info.plane_padding =
+                        mm_stream_calc_lcm(
+                        cam_capability_padding_info.plane_padding,
+                        padding_info.plane_padding);
+            }
+            if (cam_capability_padding_info.offset_info.offset_x
+                    != padding_info.offset_info.offset_x) {
+                cam_capability_padding_info.offset_info.offset_x =
+                        mm_stream_calc_lcm (
+                        cam_capability_padding_info.offset_info.offset_x,
+                        padding_info.offset_info.offset_x);
+            }
+            if (cam_capability_padding_info.offset_info.offset_y
+                    != padding_info.offset_info.offset_y) {
+                cam_capability_padding_info.offset_info.offset_y =
+                mm_stream_calc_lcm (
+                        cam_capability_padding_info.offset_info.offset_y,
+                        padding_info.offset_info.offset_y);
+            }
+        }
+        break;
+    case CMD_DEF_PARAM_ALLOC:
+        {
+            int32_t rc = NO_ERROR;
+            if (pme->isDualCamera()) {
+                rc = pme->mParameters.allocate(MM_CAMERA_MAX_CAM_CNT);
+            } else {
+                rc = pme->mParameters.allocate();
+            }
+            // notify routine would not be initialized by this time.
+            // So, just update error job status
+            if (rc != NO_ERROR) {
+                job_status = rc;
+                LOGE("Param allocation failed");
+                break;
+            }
+        }
+        break;
+    case CMD_DEF_PARAM_INIT:
+        {
+            int32_t rc = pme->getDefJobStatus(pme->mParamAllocJob);
+            if (rc != NO_ERROR) {
+                job_status = rc;
+                LOGE("Param init failed");
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+                break;
+            }
 
-                        pme->mJpegMetadata.sensor_mount_angle =
-                            cap->sensor_mount_angle;
-                        pme->mJpegMetadata.default_sensor_flip = FLIP_NONE;
-
-                        pme->mParameters.setMinPpMask(
-                            cap->qcom_supported_feature_mask);
-                        pme->mExifParams.debug_params =
-                                (mm_jpeg_debug_exif_params_t *)
-                                malloc(sizeof(mm_jpeg_debug_exif_params_t));
-                        if (!pme->mExifParams.debug_params) {
-                            LOGE("Out of Memory. Allocation failed for "
-                                    "3A debug exif params");
-                            job_status = NO_MEMORY;
-                            pme->sendEvtNotify(CAMERA_MSG_ERROR,
-                                    CAMERA_ERROR_UNKNOWN, 0);
-                            break;
-                        }
-                        memset(pme->mExifParams.debug_params, 0,
-                                sizeof(mm_jpeg_debug_exif_params_t));
-                    }
-                    break;
-                case CMD_DEF_GENERIC:
-                    {
-                        BackgroundTask *bgTask = dw->args.genericArgs;
-                        job_status = bgTask->bgFunction(bgTask->bgArgs);
-                    }
+            uint32_t camId = pme->mCameraId;
+            cam_capability_t * cap = gCamCapability[camId];
+
+            if (pme->mCameraHandle == NULL) {
+                LOGE("Camera handle is null");
+                job_status = BAD_VALUE;
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+                break;
+            }
+
+            // Now PostProc need calibration data as initialization
+            // time for jpeg_open and calibration data is a
+            // get param for now, so params needs to be initialized
+            // before postproc init
+            rc = pme->mParameters.init(cap,
+                    pme->mCameraHandle,
+                    pme, pme->m_pFovControl);
+            if (rc != 0) {
+                job_status = UNKNOWN_ERROR;
+                LOGE("Parameter Initialization failed");
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+                break;
+            }
+
+            // Get related cam calibration only in
+            // dual camera mode
+            if ((pme->getRelatedCamSyncInfo()->sync_control ==
+                    CAM_SYNC_RELATED_SENSORS_ON) || pme->isDualCamera()){
+                rc = pme->mParameters.getRelatedCamCalibration(
+                    &(pme->mJpegMetadata.otp_calibration_data));
+                LOGD("Dumping Calibration Data Version Id %f rc %d",
+                        pme->mJpegMetadata.otp_calibration_data.calibration_format_version,
+                        rc);
+                if (rc != 0) {
+                    job_status = UNKNOWN_ERROR;
+                    LOGE("getRelatedCamCalibration failed");
+                    pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                            CAMERA_ERROR_UNKNOWN, 0);
                     break;
-                default:
-                    LOGE("Incorrect command : %d", dw->cmd);
                 }
-
-                pme->dequeueDeferredWork(dw, job_status);
+                pme->m_bRelCamCalibValid = true;
+            }
+
+            pme->mJpegMetadata.sensor_mount_angle =
+                cap->sensor_mount_angle;
+            pme->mJpegMetadata.default_sensor_flip = FLIP_NONE;
+
+            pme->mParameters.setMinPpMask(
+                cap->qcom_supported_feature_mask);
+            pme->mExifParams.debug_params =
+                    (mm_jpeg_debug_exif_params_t *)
+                    malloc(sizeof(mm_jpeg_debug_exif_params_t));
+            if (!pme->mExifParams.debug_params) {
+                LOGE("Out of Memory. Allocation failed for "
+                        "3A debug exif params");
+                job_status = NO_MEMORY;
+                pme->sendEvtNotify(CAMERA_MSG_ERROR,
+                        CAMERA_ERROR_UNKNOWN, 0);
+                break;
             }
-            break;
-        case CAMERA_CMD_TYPE_EXIT:
-            running = 0;
-            break;
-        default:
-            break;
+            memset(pme->mExifParams.debug_params, 0,
+                    sizeof(mm_jpeg_debug_exif_params_t));
         }
-    } while (running);
+        break;
+    case CMD_DEF_GENERIC:
+        {
+            BackgroundTask *bgTask = dw->args.genericArgs;
+            job_status = bgTask->bgFunction(bgTask->bgArgs);
+        }
+        break;
+    default:
+        LOGE("Incorrect command : %d", dw->cmd);
+        job_status = BAD_VALUE;
+    }
 
-    return NULL;
+    delete dw;
+    return job_status;
+}
+
+/*===========================================================================
+ * FUNCTION   : cancelDeferredWork
+ *
+ * DESCRIPTION: releases a deferred task that never ran because the deferred
+ *              work pool was stopped
+ *
+ * PARAMETERS :
+ *   @user    : user data ptr (QCamera2HardwareInterface)
+ *   @work    : deferred work (DefWork)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::cancelDeferredWork(void * /*user*/, void *work)
+{
+    DefWork *dw = reinterpret_cast<DefWork *>(work);
+    if (dw != NULL) {
+        LOGH("Dropping deferred work cmd = %d", dw->cmd);
+        delete dw;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : deferredWorkDone
+ *
+ * DESCRIPTION: prints the timing of a finished deferred task
+ *
+ * PARAMETERS :
+ *   @user    : user data ptr (QCamera2HardwareInterface)
+ *   @timing  : timing of the task
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera2HardwareInterface::deferredWorkDone(void *user,
+        const deferred_work_timing_t &timing)
+{
+    QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)user;
+    if (pme == NULL) {
+        return;
+    }
+    LOGH("[KPI Perf] camera %u: deferred job %s (%u) on worker %u: "
+            "wait %lld us, run %lld us, status %d",
+            pme->mCameraId, timing.name, timing.id, timing.worker,
+            (long long)ns2us(timing.startNs - timing.queuedNs),
+            (long long)ns2us(timing.endNs - timing.startNs), timing.status);
 }
 
 /*===========================================================================
@@ -10795,32 +11017,33 @@ void *QCamera2HardwareInterface::deferredWorkRoutine(void *obj)
 uint32_t QCamera2HardwareInterface::queueDeferredWork(DeferredWorkCmd cmd,
                                                       DeferWorkArgs args)
 {
-    Mutex::Autolock l(mDefLock);
-    for (int32_t i = 0; i < MAX_ONGOING_JOBS; ++i) {
-        if (mDefOngoingJobs[i].mDefJobId == 0) {
-            DefWork *dw = new DefWork(cmd, sNextJobId, args);
-            if (!dw) {
-                LOGE("out of memory.");
-                return 0;
-            }
-            if (mCmdQueue.enqueue(dw)) {
-                mDefOngoingJobs[i].mDefJobId = sNextJobId++;
-                mDefOngoingJobs[i].mDefJobStatus = 0;
-                if (sNextJobId == 0) { // handle overflow
-                    sNextJobId = 1;
-                }
-                mDeferredWorkThread.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB,
-                        FALSE,
-                        FALSE);
-                return mDefOngoingJobs[i].mDefJobId;
-            } else {
-                LOGD("Command queue not active! cmd = %d", cmd);
-                delete dw;
-                return 0;
-            }
+    if ((cmd >= CMD_DEF_MAX) || (sDefWorkGraph[cmd].cmd != cmd)) {
+        LOGE("Invalid deferred work cmd = %d", cmd);
+        return 0;
+    }
+
+    // Resolve the declared dependencies to the ids of the latest jobs
+    const DefWorkNode &node = sDefWorkGraph[cmd];
+    uint32_t deps[DEFERRED_WORK_MAX_DEPS];
+    uint32_t numDeps = 0;
+    for (uint32_t i = 0; i < DEFERRED_WORK_MAX_DEPS; i++) {
+        if (node.deps[i] != NULL) {
+            deps[numDeps++] = this->*(node.deps[i]);
         }
     }
-    return 0;
+
+    DefWork *dw = new DefWork(cmd, args);
+    if (!dw) {
+        LOGE("out of memory.");
+        return 0;
+    }
+
+    uint32_t id = mDeferredWork.queue(node.name, dw, deps, numDeps);
+    if (id == 0) {
+        LOGD("Deferred work pool not active! cmd = %d", cmd);
+        delete dw;
+    }
+    return id;
 }
 
 /*===========================================================================
@@ -10962,41 +11185,6 @@ int32_t QCamera2HardwareInterface::getJpegHandleInfo(mm_jpeg_ops_t *ops,
     }
 }
 
-/*===========================================================================
- * FUNCTION   : dequeueDeferredWork
- *
- * DESCRIPTION: function which dequeues deferred tasks
- *
- * PARAMETERS :
- *   @dw      : deferred work
- *   @jobStatus: deferred task job status
- *
- * RETURN     : int32_t type of status
- *              NO_ERROR  -- success
- *              none-zero failure code
- *==========================================================================*/
-uint32_t QCamera2HardwareInterface::dequeueDeferredWork(DefWork* dw, int32_t jobStatus)
-{
-    Mutex::Autolock l(mDefLock);
-    for (uint32_t i = 0; i < MAX_ONGOING_JOBS; i++) {
-        if (mDefOngoingJobs[i].mDefJobId == dw->id) {
-            if (jobStatus != NO_ERROR) {
-                mDefOngoingJobs[i].mDefJobStatus = jobStatus;
-                LOGH("updating job status %d for id %d",
-                         jobStatus, dw->id);
-            } else {
-                mDefOngoingJobs[i].mDefJobId = 0;
-                mDefOngoingJobs[i].mDefJobStatus = 0;
-            }
-            delete dw;
-            mDefCond.broadcast();
-            return NO_ERROR;
-        }
-    }
-
-    return UNKNOWN_ERROR;
-}
-
 /*===========================================================================
  * FUNCTION   : getDefJobStatus
  *
@@ -11006,45 +11194,14 @@ uint32_t QCamera2HardwareInterface::dequeueDeferredWork(DefWork* dw, int32_t job
  *   @job_id  : deferred task id
  *
  * RETURN     : NO_ERROR if the job success, otherwise false
- *
- * PRECONDITION : mDefLock is held by current thread
  *==========================================================================*/
 int32_t QCamera2HardwareInterface::getDefJobStatus(uint32_t &job_id)
 {
-    for (uint32_t i = 0; i < MAX_ONGOING_JOBS; i++) {
-        if (mDefOngoingJobs[i].mDefJobId == job_id) {
-            if ( NO_ERROR != mDefOngoingJobs[i].mDefJobStatus ) {
-                LOGE("job_id (%d) was failed", job_id);
-                return mDefOngoingJobs[i].mDefJobStatus;
-            }
-            else
-                return NO_ERROR;
-        }
-    }
-    return NO_ERROR;
-}
-
-
-/*===========================================================================
- * FUNCTION   : checkDeferredWork
- *
- * DESCRIPTION: checks if a deferred task is in progress
- *
- * PARAMETERS :
- *   @job_id  : deferred task id
- *
- * RETURN     : true if the task exists, otherwise false
- *
- * PRECONDITION : mDefLock is held by current thread
- *==========================================================================*/
-bool QCamera2HardwareInterface::checkDeferredWork(uint32_t &job_id)
-{
-    for (uint32_t i = 0; i < MAX_ONGOING_JOBS; i++) {
-        if (mDefOngoingJobs[i].mDefJobId == job_id) {
-            return (NO_ERROR == mDefOngoingJobs[i].mDefJobStatus);
-        }
+    int32_t rc = mDeferredWork.getStatus(job_id);
+    if (rc != NO_ERROR) {
+        LOGE("job_id (%d) was failed", job_id);
     }
-    return false;
+    return rc;
 }
 
 /*===========================================================================
@@ -11061,23 +11218,18 @@ bool QCamera2HardwareInterface::checkDeferredWork(uint32_t &job_id)
  *==========================================================================*/
 int32_t QCamera2HardwareInterface::waitDeferredWork(uint32_t &job_id)
 {
-    Mutex::Autolock l(mDefLock);
-
     if (job_id == 0) {
         LOGD("Invalid job id %d", job_id);
         return NO_ERROR;
     }
 
-    while (checkDeferredWork(job_id) == true ) {
-        mDefCond.waitRelative(mDefLock, CAMERA_DEFERRED_THREAD_TIMEOUT);
-    }
-    return getDefJobStatus(job_id);
+    return mDeferredWork.wait(job_id);
 }
 
 /*===========================================================================
  * FUNCTION   : scheduleBackgroundTask
  *
- * DESCRIPTION: Run a requested task in the deferred thread
+ * DESCRIPTION: Run a requested task on the deferred work pool
  *
  * PARAMETERS :
  *   @bgTask  : Task to perform in the background
@@ -39,6 +39,7 @@
 #include "QCameraAllocator.h"
 #include "QCameraChannel.h"
 #include "QCameraCmdThread.h"
+#include "QCameraDeferredWork.h"
 #if 0 // Temporary removing the dependency on libgui
 #include "QCameraDisplay.h"
 #endif
@@ -47,16 +48,19 @@
 #include "QCameraParametersIntf.h"
 #include "QCameraPerf.h"
 #include "QCameraPostProc.h"
+#include "QCameraPreviewCbRing.h"
 #include "QCameraQueue.h"
 #include "QCameraStream.h"
 #include "QCameraStateMachine.h"
 #include "QCameraThermalAdapter.h"
+#include "QCameraThermalGovernor.h"
 #include "QCameraFOVControl.h"
 #include "QCameraDualCamSettings.h"
 
 #ifdef TARGET_TS_MAKEUP
 #include "ts_makeup_engine.h"
 #include "ts_detectface_engine.h"
+#include "QCameraTsFaceTracker.h"
 #endif
 extern "C" {
 #include "mm_camera_interface.h"
@@ -107,7 +111,6 @@ typedef struct {
 
 #define QCAMERA_ION_USE_CACHE   true
 #define QCAMERA_ION_USE_NOCACHE false
-#define MAX_ONGOING_JOBS 25
 
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
@@ -135,7 +138,8 @@ typedef void (*jpeg_data_callback)(int32_t msg_type,
         const camera_memory_t *data, unsigned int index,
         camera_frame_metadata_t *metadata, void *user,
         uint32_t frame_idx, camera_release_callback release_cb,
-        void *release_cookie, void *release_data);
+        void *release_cookie, void *release_data,
+        const mm_jpeg_marker_index_t *marker_idx);
 
 typedef struct {
     qcamera_callback_type_m  cb_type;    // event type
@@ -150,6 +154,7 @@ typedef struct {
     void                    *cookie;     // release callback cookie
     camera_release_callback  release_cb; // release callback
     uint32_t                 frame_index;  // frame index for the buffer
+    const mm_jpeg_marker_index_t *jpeg_marker_idx; // marker index of jpeg data
 } qcamera_callback_argm_t;
 
 class QCameraCbNotifier {
@@ -376,6 +381,10 @@ private:
             cam_fps_range_t &adjustedRange,
             enum msm_vfe_frame_skip_pattern &skipPattern,
             bool bRecordingHint);
+    void calcThermalGovernorRange(const float minFPS, const float maxFPS,
+            const float minVideoFps, const float maxVideoFps,
+            cam_fps_range_t &adjustedRange,
+            enum msm_vfe_frame_skip_pattern &skipPattern);
     int updateThermalLevel(void *level);
 
     // update entris to set parameters and check if restart is needed
@@ -579,6 +588,9 @@ private:
     static void returnStreamBuffer(void *data,
                                    void *cookie,
                                    int32_t cbStatus);
+    static void returnPreviewCbBuffer(void *data,
+                                      void *cookie,
+                                      int32_t cbStatus);
     static void getLogLevel();
 
     int32_t startRAWChannel(QCameraChannel *pChannel);
@@ -663,6 +675,9 @@ private:
     uint32_t mDumpSkipCnt; // frame skip count
     mm_jpeg_exif_params_t mExifParams;
     qcamera_thermal_level_enum_t mThermalLevel;
+    // Closed loop thermal mode, persist.camera.thermal.governor
+    bool mThermalGovernorEnabled;
+    QCameraThermalGovernor mThermalGovernor;
     bool mActiveAF;
     bool m_HDRSceneEnabled;
     bool mLongshotEnabled;
@@ -708,6 +723,8 @@ private:
         CMD_DEF_CREATE_JPEG_SESSION,
         CMD_DEF_PARAM_ALLOC,
         CMD_DEF_PARAM_INIT,
+        CMD_DEF_JPEG_OPEN,
+        CMD_DEF_PPROC_SETUP,
         CMD_DEF_GENERIC,
         CMD_DEF_MAX
     };
@@ -735,50 +752,44 @@ private:
         BackgroundTask *genericArgs;
     } DeferWorkArgs;
 
-    typedef struct {
-        uint32_t mDefJobId;
-
-        //Job status is needed to check job was successful or failed
-        //Error code when job was not sucessful and there is error
-        //0 when is initialized.
-        //for sucessfull job, do not need to maintain job status
-        int32_t mDefJobStatus;
-    } DefOngoingJob;
-
-    DefOngoingJob mDefOngoingJobs[MAX_ONGOING_JOBS];
-
     struct DefWork
     {
         DefWork(DeferredWorkCmd cmd_,
-                 uint32_t id_,
                  DeferWorkArgs args_)
             : cmd(cmd_),
-              id(id_),
               args(args_){};
 
         DeferredWorkCmd cmd;
-        uint32_t id;
         DeferWorkArgs args;
     };
 
-    QCameraCmdThread      mDeferredWorkThread;
-    QCameraQueue          mCmdQueue;
+    // Declared dependencies of each deferred command. A job starts only
+    // after the jobs whose ids are held in the listed members are done.
+    typedef struct {
+        DeferredWorkCmd cmd;
+        const char *name;
+        uint32_t QCamera2HardwareInterface::*deps[DEFERRED_WORK_MAX_DEPS];
+    } DefWorkNode;
+    static const DefWorkNode sDefWorkGraph[CMD_DEF_MAX];
 
-    Mutex                 mDefLock;
-    Condition             mDefCond;
+    QCameraDeferredWork   mDeferredWork;
 
     uint32_t queueDeferredWork(DeferredWorkCmd cmd,
                                DeferWorkArgs args);
-    uint32_t dequeueDeferredWork(DefWork* dw, int32_t jobStatus);
     int32_t waitDeferredWork(uint32_t &job_id);
-    static void *deferredWorkRoutine(void *obj);
-    bool checkDeferredWork(uint32_t &job_id);
+    int32_t executeDeferredWork(DefWork *dw);
+    static int32_t runDeferredWork(void *user, void *work);
+    static void cancelDeferredWork(void *user, void *work);
+    static void deferredWorkDone(void *user,
+            const deferred_work_timing_t &timing);
     int32_t getDefJobStatus(uint32_t &job_id);
 
     uint32_t mReprocJob;
     uint32_t mJpegJob;
     uint32_t mMetadataAllocJob;
     uint32_t mInitPProcJob;
+    uint32_t mJpegOpenJob;
+    uint32_t mPProcCoreInitJob;
     uint32_t mParamAllocJob;
     uint32_t mParamInitJob;
     uint32_t mOutputCount;
@@ -799,14 +810,21 @@ private:
     TSRect mFaceRect;
     bool TsMakeupProcess_Preview(mm_camera_buf_def_t *pFrame,QCameraStream * pStream);
     bool TsMakeupProcess_Snapshot(mm_camera_buf_def_t *pFrame,QCameraStream * pStream);
-    bool TsMakeupProcess(mm_camera_buf_def_t *frame,QCameraStream * stream,TSRect& faceRect);
+    bool TsMakeupProcess(mm_camera_buf_def_t *frame,QCameraStream * stream,TSRect& faceRect,
+            QCameraTsFaceTracker &tracker);
+    void TsMakeupGetFrameData(mm_camera_buf_def_t *pFrame, QCameraStream *pStream,
+            TSMakeupDataEx &data);
+    // Preview and snapshot run on different threads, so each has its own
+    // detection context and scratch buffer.
+    QCameraTsFaceTracker mTsPreviewTracker;
+    QCameraTsFaceTracker mTsSnapshotTracker;
 #endif
     QCameraMemory *mMetadataMem;
 
-    static uint32_t sNextJobId;
-
     //Gralloc memory details
     pthread_mutex_t mGrallocLock;
+    // De-strided preview callback buffers, persist.camera.prevcb.ring
+    QCameraPreviewCbRing mPreviewCbRing;
     uint8_t mEnqueuedBuffers;
     bool mCACDoneReceived;
 
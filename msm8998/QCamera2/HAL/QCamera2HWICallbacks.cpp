@@ -498,6 +498,24 @@ void QCamera2HardwareInterface::capture_channel_cb_routine(mm_camera_super_buf_t
     LOGH("[KPI Perf]: X");
 }
 #ifdef TARGET_TS_MAKEUP
+void QCamera2HardwareInterface::TsMakeupGetFrameData(mm_camera_buf_def_t *pFrame,
+        QCameraStream *pStream, TSMakeupDataEx &data) {
+    cam_frame_len_offset_t offset;
+    memset(&offset, 0, sizeof(cam_frame_len_offset_t));
+    pStream->getFrameOffset(offset);
+
+    cam_dimension_t dim;
+    pStream->getFrameDimension(dim);
+
+    unsigned char *yBuf  = (unsigned char*)pFrame->buffer;
+    data.frameWidth  = dim.width;
+    data.frameHeight = dim.height;
+    data.yBuf  = yBuf;
+    data.uvBuf = yBuf + offset.mp[0].len;
+    data.yStride  = offset.mp[0].stride;
+    data.uvStride = offset.mp[1].stride;
+}
+
 bool QCamera2HardwareInterface::TsMakeupProcess_Preview(mm_camera_buf_def_t *pFrame,
         QCameraStream * pStream) {
     LOGD("begin");
@@ -505,8 +523,17 @@ bool QCamera2HardwareInterface::TsMakeupProcess_Preview(mm_camera_buf_def_t *pFr
     if (pStream == NULL || pFrame == NULL) {
         bRet = false;
         LOGH("pStream == NULL || pFrame == NULL");
+    } else if (mTsPreviewTracker.getInterval() > 0) {
+        int whiteLevel, cleanLevel;
+        if (mParameters.getTsMakeupInfo(whiteLevel, cleanLevel)) {
+            TSMakeupDataEx inMakeupData;
+            TSRect faceRect;
+            TsMakeupGetFrameData(pFrame, pStream, inMakeupData);
+            mTsPreviewTracker.track(&inMakeupData, faceRect);
+            bRet = TsMakeupProcess(pFrame, pStream, faceRect, mTsPreviewTracker);
+        }
     } else {
-        bRet = TsMakeupProcess(pFrame, pStream, mFaceRect);
+        bRet = TsMakeupProcess(pFrame, pStream, mFaceRect, mTsPreviewTracker);
     }
     LOGD("end bRet = %d ",bRet);
     return bRet;
@@ -520,44 +547,14 @@ bool QCamera2HardwareInterface::TsMakeupProcess_Snapshot(mm_camera_buf_def_t *pF
         bRet = false;
         LOGH("pStream == NULL || pFrame == NULL");
     } else {
-        cam_frame_len_offset_t offset;
-        memset(&offset, 0, sizeof(cam_frame_len_offset_t));
-        pStream->getFrameOffset(offset);
-
-        cam_dimension_t dim;
-        pStream->getFrameDimension(dim);
-
-        unsigned char *yBuf  = (unsigned char*)pFrame->buffer;
-        unsigned char *uvBuf = yBuf + offset.mp[0].len;
         TSMakeupDataEx inMakeupData;
-        inMakeupData.frameWidth  = dim.width;
-        inMakeupData.frameHeight = dim.height;
-        inMakeupData.yBuf  = yBuf;
-        inMakeupData.uvBuf = uvBuf;
-        inMakeupData.yStride  = offset.mp[0].stride;
-        inMakeupData.uvStride = offset.mp[1].stride;
+        TsMakeupGetFrameData(pFrame, pStream, inMakeupData);
         LOGD("detect begin");
-        TSHandle fd_handle = ts_detectface_create_context();
-        if (fd_handle != NULL) {
-            cam_format_t fmt;
-            pStream->getFormat(fmt);
-            int iret = ts_detectface_detectEx(fd_handle, &inMakeupData);
-            LOGD("ts_detectface_detect iret = %d",iret);
-            if (iret <= 0) {
-                bRet = false;
-            } else {
-                TSRect faceRect;
-                memset(&faceRect,-1,sizeof(TSRect));
-                iret = ts_detectface_get_face_info(fd_handle, 0, &faceRect, NULL,NULL,NULL);
-                LOGD("ts_detectface_get_face_info iret=%d,faceRect.left=%ld,"
-                        "faceRect.top=%ld,faceRect.right=%ld,faceRect.bottom=%ld"
-                        ,iret,faceRect.left,faceRect.top,faceRect.right,faceRect.bottom);
-                bRet = TsMakeupProcess(pFrame,pStream,faceRect);
-            }
-            ts_detectface_destroy_context(&fd_handle);
-            fd_handle = NULL;
-        } else {
-            LOGH("fd_handle == NULL");
+        TSRect faceRect;
+        if (mTsSnapshotTracker.detect(&inMakeupData, faceRect)) {
+            LOGD("faceRect.left=%ld,faceRect.top=%ld,faceRect.right=%ld,faceRect.bottom=%ld",
+                    faceRect.left,faceRect.top,faceRect.right,faceRect.bottom);
+            bRet = TsMakeupProcess(pFrame, pStream, faceRect, mTsSnapshotTracker);
         }
         LOGD("detect end");
     }
@@ -566,7 +563,7 @@ bool QCamera2HardwareInterface::TsMakeupProcess_Snapshot(mm_camera_buf_def_t *pF
 }
 
 bool QCamera2HardwareInterface::TsMakeupProcess(mm_camera_buf_def_t *pFrame,
-        QCameraStream * pStream,TSRect& faceRect) {
+        QCameraStream * pStream,TSRect& faceRect, QCameraTsFaceTracker &tracker) {
     bool bRet = false;
     LOGD("begin");
     if (pStream == NULL || pFrame == NULL) {
@@ -587,7 +584,7 @@ bool QCamera2HardwareInterface::TsMakeupProcess(mm_camera_buf_def_t *pFrame,
         tempOriBuf = (unsigned char*)pFrame->buffer;
         unsigned char *yBuf = tempOriBuf;
         unsigned char *uvBuf = tempOriBuf + offset.mp[0].len;
-        unsigned char *tmpBuf = new unsigned char[offset.frame_len];
+        unsigned char *tmpBuf = tracker.getScratch(offset.frame_len);
         if (tmpBuf == NULL) {
             LOGH("tmpBuf == NULL ");
             return false;
@@ -613,10 +610,6 @@ bool QCamera2HardwareInterface::TsMakeupProcess(mm_camera_buf_def_t *pFrame,
         memcpy((unsigned char*)pFrame->buffer, tmpBuf, offset.frame_len);
         QCameraMemory *memory = (QCameraMemory *)pFrame->mem_info;
         memory->cleanCache(pFrame->buf_idx);
-        if (tmpBuf != NULL) {
-            delete[] tmpBuf;
-            tmpBuf = NULL;
-        }
     }
     LOGD("end bRet = %d ",bRet);
     return bRet;
@@ -806,6 +799,7 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
     QCamera2HardwareInterface *pme = (QCamera2HardwareInterface *)userdata;
     QCameraGrallocMemory *memory = (QCameraGrallocMemory *)super_frame->bufs[0]->mem_info;
     uint8_t dequeueCnt = 0;
+    nsecs_t frameStart = systemTime();
 
     if (pme == NULL) {
         LOGE("Invalid hardware object");
@@ -951,6 +945,15 @@ void QCamera2HardwareInterface::preview_stream_cb_routine(mm_camera_super_buf_t
         }
     }
 
+    // Feed the preview processing cost to the thermal governor. A step it
+    // finds due is taken on the state machine thread like a thermal event.
+    if (pme->mThermalGovernorEnabled && !discardFrame &&
+            pme->mThermalGovernor.onFrame(systemTime() - frameStart,
+            frameStart)) {
+        pme->processAPI(QCAMERA_SM_EVT_THERMAL_NOTIFY,
+                (void *)&pme->mThermalLevel);
+    }
+
     free(super_frame);
     LOGH("[KPI Perf] : END");
     return;
@@ -1063,8 +1066,9 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
             }
         } else {
             data = memory->getMemory(idx, false);
-            dataToApp = mGetMemory(-1, previewBufSize, 1, mCallbackCookie);
-            if (!dataToApp || !dataToApp->data) {
+            dataToApp = mPreviewCbRing.get(previewFmt, previewBufSize,
+                    mGetMemory, mCallbackCookie);
+            if (!dataToApp) {
                 LOGE("mGetMemory failed.\n");
                 return NO_MEMORY;
             }
@@ -1099,8 +1103,9 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
         previewBufSizeFromCallback = 0;
         LOGW("Invalid preview format. Buffer content cannot be processed size = %d",
                 previewBufSize);
-        dataToApp = mGetMemory(-1, previewBufSize, 1, mCallbackCookie);
-        if (!dataToApp || !dataToApp->data) {
+        dataToApp = mPreviewCbRing.get(previewFmt, previewBufSize,
+                mGetMemory, mCallbackCookie);
+        if (!dataToApp) {
             LOGE("mGetMemory failed.\n");
             return NO_MEMORY;
         }
@@ -1120,7 +1125,7 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
         cbArg.release_cb = releaseCameraMemory;
     } else if (dataToApp) {
         cbArg.user_data = dataToApp;
-        cbArg.release_cb = releaseCameraMemory;
+        cbArg.release_cb = returnPreviewCbBuffer;
     }
     cbArg.cookie = this;
     rc = m_cbNotifier.notifyCallback(cbArg);
@@ -1129,7 +1134,7 @@ int32_t QCamera2HardwareInterface::sendPreviewCallback(QCameraStream *stream,
         if (previewMem) {
             previewMem->release(previewMem);
         } else if (dataToApp) {
-            dataToApp->release(dataToApp);
+            mPreviewCbRing.put(dataToApp);
         }
     }
 
@@ -3465,7 +3470,8 @@ void * QCameraCbNotifier::cbNotifyRoutine(void * data)
                                                 cb->index, cb->metadata,
                                                 pme->mJpegCallbackCookie,
                                                 cb->frame_index, cb->release_cb,
-                                                cb->cookie, cb->user_data);
+                                                cb->cookie, cb->user_data,
+                                                cb->jpeg_marker_idx);
                                         // incase of non-null Jpeg cb we transfer
                                         // ownership of buffer to muxer. hence
                                         // release_cb should not be called
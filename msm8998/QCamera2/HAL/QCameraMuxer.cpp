@@ -2298,35 +2298,18 @@ void QCameraMuxer::composeMpo(cam_compose_jpeg_info_t* main_Jpeg,
 
     pthread_mutex_lock(&m_JpegLock);
 
-    m_pRelCamMpoJpeg = mGetMemoryCb(-1, main_Jpeg->buffer->size +
-            aux_Jpeg->buffer->size, 1, m_pMpoCallbackCookie);
-    if (NULL == m_pRelCamMpoJpeg) {
-        LOGE("getMemory for mpo, ret = NO_MEMORY");
-        gMuxer->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
-        pthread_mutex_unlock(&m_JpegLock);
-        return;
-    }
-
     // fill all structures to send for composition
     mm_jpeg_mpo_info_t mpo_compose_info;
+    memset(&mpo_compose_info, 0, sizeof(mpo_compose_info));
     mpo_compose_info.num_of_images = 2;
     mpo_compose_info.primary_image.buf_filled_len = main_Jpeg->buffer->size;
     mpo_compose_info.primary_image.buf_vaddr =
             (uint8_t*)(main_Jpeg->buffer->data);
+    mpo_compose_info.primary_image.marker_idx = main_Jpeg->marker_idx;
     mpo_compose_info.aux_images[0].buf_filled_len = aux_Jpeg->buffer->size;
     mpo_compose_info.aux_images[0].buf_vaddr =
             (uint8_t*)(aux_Jpeg->buffer->data);
-    mpo_compose_info.output_buff.buf_vaddr =
-            (uint8_t*)m_pRelCamMpoJpeg->data;
-    mpo_compose_info.output_buff.buf_filled_len = 0;
-    mpo_compose_info.output_buff_size = main_Jpeg->buffer->size +
-            aux_Jpeg->buffer->size;
-
-    LOGD("MPO buffer size %d\n"
-            "expected size %d, mpo_compose_info.output_buff_size %d",
-             m_pRelCamMpoJpeg->size,
-            main_Jpeg->buffer->size + aux_Jpeg->buffer->size,
-            mpo_compose_info.output_buff_size);
+    mpo_compose_info.aux_images[0].marker_idx = aux_Jpeg->marker_idx;
 
     LOGD("MPO primary buffer filled lengths\n"
             "mpo_compose_info.primary_image.buf_filled_len %d\n"
@@ -2376,7 +2359,8 @@ void QCameraMuxer::composeMpo(cam_compose_jpeg_info_t* main_Jpeg,
         }
     }
 
-    int32_t rc = mJpegMpoOps.compose_mpo(&mpo_compose_info);
+    // lay out the MPO over the Jpeg buffers, only the MP header is copied
+    int32_t rc = mJpegMpoOps.compose_mpo_sg(&mpo_compose_info, &m_MpoSg);
     LOGD("Compose mpo returned %d", rc);
 
     if(rc != NO_ERROR) {
@@ -2386,6 +2370,29 @@ void QCameraMuxer::composeMpo(cam_compose_jpeg_info_t* main_Jpeg,
         return;
     }
 
+    // data callback needs the MPO in a single buffer
+    m_pRelCamMpoJpeg = mGetMemoryCb(-1, m_MpoSg.total_len, 1,
+            m_pMpoCallbackCookie);
+    if (NULL == m_pRelCamMpoJpeg) {
+        LOGE("getMemory for mpo, ret = NO_MEMORY");
+        gMuxer->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
+        pthread_mutex_unlock(&m_JpegLock);
+        return;
+    }
+    LOGD("MPO buffer size %d expected size %zu",
+            m_pRelCamMpoJpeg->size, m_MpoSg.total_len);
+
+    rc = mJpegMpoOps.flatten_mpo_sg(&m_MpoSg,
+            (uint8_t*)m_pRelCamMpoJpeg->data, m_pRelCamMpoJpeg->size);
+    if(rc != NO_ERROR) {
+        LOGE("Flatten Mpo failed, ret = %d", rc);
+        gMuxer->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
+        m_pRelCamMpoJpeg->release(m_pRelCamMpoJpeg);
+        m_pRelCamMpoJpeg = NULL;
+        pthread_mutex_unlock(&m_JpegLock);
+        return;
+    }
+
     if(m_bDumpImages) {
         char buf_mpo[QCAMERA_MAX_FILEPATH_LENGTH];
         memset(buf_mpo, 0, sizeof(buf_mpo));
@@ -2644,6 +2651,7 @@ void* QCameraMuxer::composeMpoRoutine(__unused void *data)
  *   @release_cb : callback function for releasing the data memory
  *   @release_cookie : cookie for the release callback function
  *   @release_data :pointer indicating what needs to be released
+ *   @marker_idx : marker index of the jpeg, may be NULL
  *
  * RETURN : none
  *==========================================================================*/
@@ -2651,7 +2659,8 @@ void QCameraMuxer::jpeg_data_callback(int32_t msg_type,
            const camera_memory_t *data, unsigned int index,
            camera_frame_metadata_t *metadata, void *user,
            uint32_t frame_idx, camera_release_callback release_cb,
-           void *release_cookie, void *release_data)
+           void *release_cookie, void *release_data,
+           const mm_jpeg_marker_index_t *marker_idx)
 {
     LOGH("E");
     CHECK_MUXER();
@@ -2661,7 +2670,7 @@ void QCameraMuxer::jpeg_data_callback(int32_t msg_type,
                  data, data->size, data->data, frame_idx);
         int rc = gMuxer->storeJpeg(((qcamera_physical_descriptor_t*)(user))->type,
                 msg_type, data, index, metadata, user, frame_idx, release_cb,
-                release_cookie, release_data);
+                release_cookie, release_data, marker_idx);
         if(rc != NO_ERROR) {
             gMuxer->sendEvtNotify(CAMERA_MSG_ERROR, UNKNOWN_ERROR, 0);
         }
@@ -2688,6 +2697,7 @@ void QCameraMuxer::jpeg_data_callback(int32_t msg_type,
  *   @release_cb : callback function for releasing the data memory
  *   @release_cookie : cookie for the release callback function
  *   @release_data :pointer indicating what needs to be released
+ *   @marker_idx : marker index of the jpeg, may be NULL
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -2697,7 +2707,7 @@ int32_t QCameraMuxer::storeJpeg(cam_sync_type_t cam_type,
         int32_t msg_type, const camera_memory_t *data, unsigned int index,
         camera_frame_metadata_t *metadata, void *user,uint32_t frame_idx,
         camera_release_callback release_cb, void *release_cookie,
-        void *release_data)
+        void *release_data, const mm_jpeg_marker_index_t *marker_idx)
 {
     LOGH("E jpeg received: data %p size %d data ptr %p frameIdx %d",
              data, data->size, data->data, frame_idx);
@@ -2739,6 +2749,9 @@ int32_t QCameraMuxer::storeJpeg(cam_sync_type_t cam_type,
     pJpegFrame->release_cb = release_cb;
     pJpegFrame->release_cookie = release_cookie;
     pJpegFrame->release_data = release_data;
+    if (marker_idx != NULL) {
+        pJpegFrame->marker_idx = *marker_idx;
+    }
     if(cam_type == CAM_TYPE_MAIN) {
         if (m_MainJpegQ.enqueue((void *)pJpegFrame)) {
             LOGD("Main FrameIdx %d", pJpegFrame->frame_idx);
@@ -125,6 +125,9 @@ typedef struct {
     void *release_cookie;
     // release data info for what needs to be released
     void *release_data;
+    // marker index of the Jpeg as filled by the encoder, lets MPO
+    // composition find the MP header without parsing the image
+    mm_jpeg_marker_index_t marker_idx;
 }cam_compose_jpeg_info_t;
 
 /* Class@ QCameraMuxer
@@ -195,7 +198,8 @@ public:
             const camera_memory_t *data, unsigned int index,
             camera_frame_metadata_t *metadata, void *user,
             uint32_t frame_idx, camera_release_callback release_cb,
-            void *release_cookie, void *release_data);
+            void *release_cookie, void *release_data,
+            const mm_jpeg_marker_index_t *marker_idx);
     // add notify error msgs to the notifer queue of the primary related cam instance
     static int32_t sendEvtNotify(int32_t msg_type, int32_t ext1, int32_t ext2);
     // function to compose all JPEG images from all physical related camera instances
@@ -235,6 +239,8 @@ private:
     QCameraCmdThread m_ComposeMpoTh;
     // Final Mpo Jpeg Buffer
     camera_memory_t *m_pRelCamMpoJpeg;
+    // Mpo layout over the main and aux Jpeg buffers, guarded by m_JpegLock
+    mm_jpeg_mpo_sg_t m_MpoSg;
     // Lock needed to synchronize between multiple composition requests
     pthread_mutex_t m_JpegLock;
     // this callback cookie would be used for sending Final mpo Jpeg to the framework
@@ -277,7 +283,8 @@ private:
             const camera_memory_t *data, unsigned int index,
             camera_frame_metadata_t *metadata, void *user,
             uint32_t frame_idx, camera_release_callback release_cb,
-            void *release_cookie, void *release_data);
+            void *release_cookie, void *release_data,
+            const mm_jpeg_marker_index_t *marker_idx);
 
 };// End namespace qcamera
 
@@ -47,6 +47,7 @@
 #include "QCamera2HWI.h"
 #include "QCameraParameters.h"
 #include "QCameraTrace.h"
+#include "mm_camera_zsl_ring.h"
 
 extern "C" {
 #include "mm_camera_dbg.h"
@@ -926,6 +927,8 @@ QCameraParameters::QCameraParameters()
       m_bZslMode(false),
       m_bZslMode_new(false),
       m_bForceZslMode(false),
+      m_nZslBudgetBytes(0),
+      m_bZslSelectBest(false),
       m_bRecordingHint(false),
       m_bRecordingHint_new(false),
       m_bHistogramEnabled(false),
@@ -1072,6 +1075,8 @@ QCameraParameters::QCameraParameters(const String8 &params)
     m_bZslMode(false),
     m_bZslMode_new(false),
     m_bForceZslMode(false),
+    m_nZslBudgetBytes(0),
+    m_bZslSelectBest(false),
     m_bRecordingHint(false),
     m_bRecordingHint_new(false),
     m_bHistogramEnabled(false),
@@ -4996,9 +5001,48 @@ int32_t QCameraParameters::setZslAttributes(const QCameraParameters& params)
         LOGH("queue depth: %s", prop);
     }
 
+    // A memory budget replaces the queue depth, see getZSLQueueDepth
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.zsl.budget_mb", prop, "0");
+    int budget_mb = atoi(prop);
+    m_nZslBudgetBytes = (budget_mb > 0) ? (uint64_t)budget_mb * 1024 * 1024 : 0;
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.zsl.select_best", prop, "1");
+    m_bZslSelectBest = (atoi(prop) > 0);
+    LOGH("ZSL budget %llu bytes, best frame selection %d",
+            (unsigned long long)m_nZslBudgetBytes, m_bZslSelectBest);
+
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : getZSLFrameBytes
+ *
+ * DESCRIPTION: estimate the memory held by one ZSL super buffer
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : bytes of a preview, snapshot and metadata buffer set.
+ *              0 if the snapshot size is not known yet
+ *==========================================================================*/
+uint64_t QCameraParameters::getZSLFrameBytes()
+{
+    cam_dimension_t snapshot, preview;
+
+    getStreamDimension(CAM_STREAM_TYPE_SNAPSHOT, snapshot);
+    getStreamDimension(CAM_STREAM_TYPE_PREVIEW, preview);
+    if ((snapshot.width <= 0) || (snapshot.height <= 0)) {
+        return 0;
+    }
+    if ((preview.width <= 0) || (preview.height <= 0)) {
+        memset(&preview, 0, sizeof(preview));
+    }
+    // Both image streams are YUV 4:2:0
+    return ((uint64_t)snapshot.width * (uint64_t)snapshot.height +
+            (uint64_t)preview.width * (uint64_t)preview.height) * 3 / 2 +
+            sizeof(metadata_buffer_t);
+}
+
 /*===========================================================================
  * FUNCTION   : setFlip
  *
@@ -10772,6 +10816,16 @@ uint8_t QCameraParameters::getZSLQueueDepth()
     if (qdepth < 0) {
         qdepth = 2;
     }
+    if (m_nZslBudgetBytes > 0) {
+        uint64_t frameBytes = getZSLFrameBytes();
+        if (frameBytes > 0) {
+            qdepth = (int)cam_zsl_budget_depth(m_nZslBudgetBytes, frameBytes,
+                    QCAMERA_MAX_ZSL_HISTORY_DEPTH);
+            if (m_bFrameSyncEnabled) {
+                qdepth += EXTRA_FRAME_SYNC_BUFFERS;
+            }
+        }
+    }
     if (isLowMemoryDevice()) {
         qdepth = 1;
     }
@@ -15043,6 +15097,10 @@ String8 QCameraParameters::dump()
     snprintf(s, 128, "ZSL Back Look Count %d\n", getZSLBackLookCount());
     str += s;
 
+    snprintf(s, 128, "ZSL Budget: %llu bytes, Select Best: %d\n",
+            (unsigned long long)getZSLBudgetBytes(), isZSLSelectBestEnabled());
+    str += s;
+
     snprintf(s, 128, "Max Unmatched Frames In Queue: %d\n",
         getMaxUnmatchedFramesInQueue());
     str += s;
@@ -53,6 +53,9 @@ static const char ExifUndefinedPrefix[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 
 #define CAMERA_MIN_BATCH_COUNT           4
 
+// Deepest ZSL queue a memory budget can give
+#define QCAMERA_MAX_ZSL_HISTORY_DEPTH    8
+
 #define QCAMERA_MAX_EXP_TIME_LEVEL1      100
 #define QCAMERA_MAX_EXP_TIME_LEVEL2      500
 #define QCAMERA_MAX_EXP_TIME_LEVEL3      1000
@@ -671,6 +674,8 @@ public:
     uint8_t getZSLQueueDepth();
     uint8_t getZSLBackLookCount();
     uint8_t getMaxUnmatchedFramesInQueue();
+    uint64_t getZSLBudgetBytes() {return m_nZslBudgetBytes;};
+    bool isZSLSelectBestEnabled() {return m_bZslSelectBest;};
     bool isZSLMode() {return m_bZslMode;};
     bool isRdiMode() {return m_bRdiMode;};
     bool isSecureMode() {return m_bSecureMode;};
@@ -981,6 +986,7 @@ private:
     int32_t setTemporalDenoise(const QCameraParameters&);
     int32_t setZslMode(const QCameraParameters& );
     int32_t setZslAttributes(const QCameraParameters& );
+    uint64_t getZSLFrameBytes();
     int32_t setAutoHDR(const QCameraParameters& params);
     int32_t setCameraMode(const QCameraParameters& );
     int32_t setSceneSelectionMode(const QCameraParameters& params);
@@ -1185,6 +1191,8 @@ private:
     bool m_bZslMode;                // if ZSL is enabled
     bool m_bZslMode_new;
     bool m_bForceZslMode;
+    uint64_t m_nZslBudgetBytes;     // ZSL queue memory budget, 0 for count
+    bool m_bZslSelectBest;          // send the best scored ZSL frame
     bool m_bRecordingHint;          // local copy of recording hint
     bool m_bRecordingHint_new;
     bool m_bHistogramEnabled;       // if histogram is enabled
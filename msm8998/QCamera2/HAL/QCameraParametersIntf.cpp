@@ -198,6 +198,20 @@ uint8_t QCameraParametersIntf::getZSLBackLookCount()
     return mImpl->getZSLBackLookCount();
 }
 
+uint64_t QCameraParametersIntf::getZSLBudgetBytes()
+{
+    Mutex::Autolock lock(mLock);
+    CHECK_PARAM_INTF(mImpl);
+    return mImpl->getZSLBudgetBytes();
+}
+
+bool QCameraParametersIntf::isZSLSelectBestEnabled()
+{
+    Mutex::Autolock lock(mLock);
+    CHECK_PARAM_INTF(mImpl);
+    return mImpl->isZSLSelectBestEnabled();
+}
+
 uint8_t QCameraParametersIntf::getMaxUnmatchedFramesInQueue()
 {
     Mutex::Autolock lock(mLock);
@@ -101,6 +101,8 @@ public:
     uint8_t getZSLBurstInterval();
     uint8_t getZSLQueueDepth();
     uint8_t getZSLBackLookCount();
+    uint64_t getZSLBudgetBytes();
+    bool isZSLSelectBestEnabled();
     uint8_t getMaxUnmatchedFramesInQueue();
     bool isZSLMode();
     bool isRdiMode();
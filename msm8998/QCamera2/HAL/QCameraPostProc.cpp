@@ -876,6 +876,7 @@ int32_t QCameraPostProcessor::sendEvtNotify(int32_t msg_type,
  *   @release_data : ptr to struct indicating if data need to be released
  *                   after notify
  *   @super_buf_frame_idx : super buffer frame index
+ *   @jpeg_marker_idx : marker index of jpeg data if there is any
  *
  * RETURN     : int32_t type of status
  *              NO_ERROR  -- success
@@ -886,7 +887,8 @@ int32_t QCameraPostProcessor::sendDataNotify(int32_t msg_type,
                                              uint8_t index,
                                              camera_frame_metadata_t *metadata,
                                              qcamera_release_data_t *release_data,
-                                             uint32_t super_buf_frame_idx)
+                                             uint32_t super_buf_frame_idx,
+                                             const mm_jpeg_marker_index_t *jpeg_marker_idx)
 {
     qcamera_data_argm_t *data_cb = (qcamera_data_argm_t *)malloc(sizeof(qcamera_data_argm_t));
     if (NULL == data_cb) {
@@ -901,6 +903,9 @@ int32_t QCameraPostProcessor::sendDataNotify(int32_t msg_type,
     if (release_data != NULL) {
         data_cb->release_data = *release_data;
     }
+    if (jpeg_marker_idx != NULL) {
+        data_cb->jpeg_marker_idx = *jpeg_marker_idx;
+    }
 
     qcamera_callback_argm_t cbArg;
     memset(&cbArg, 0, sizeof(qcamera_callback_argm_t));
@@ -912,6 +917,7 @@ int32_t QCameraPostProcessor::sendDataNotify(int32_t msg_type,
     cbArg.cookie = this;
     cbArg.release_cb = releaseNotifyData;
     cbArg.frame_index = super_buf_frame_idx;
+    cbArg.jpeg_marker_idx = &data_cb->jpeg_marker_idx;
     int rc = m_parent->m_cbNotifier.notifyCallback(cbArg);
     if ( NO_ERROR != rc ) {
         LOGE("Error enqueuing jpeg data into notify queue");
@@ -1342,7 +1348,8 @@ int32_t QCameraPostProcessor::processJpegEvt(qcamera_jpeg_evt_payload_t *evt)
                 0,
                 NULL,
                 &release_data,
-                frame_idx);
+                frame_idx,
+                &evt->out_data.marker_idx);
         m_parent->setOutputImageCount(m_parent->getOutputImageCount() + 1);
 
 end:
@@ -126,6 +126,7 @@ typedef struct {
     unsigned int             index;    // index of the buf in the whole buffer
     camera_frame_metadata_t *metadata; // ptr to meta data
     qcamera_release_data_t   release_data; // any data needs to be release after notify
+    mm_jpeg_marker_index_t   jpeg_marker_idx; // marker index of jpeg data
 } qcamera_data_argm_t;
 
 typedef enum {
@@ -194,7 +195,8 @@ private:
             uint8_t index,
             camera_frame_metadata_t *metadata,
             qcamera_release_data_t *release_data,
-            uint32_t super_buf_frame_idx = 0);
+            uint32_t super_buf_frame_idx = 0,
+            const mm_jpeg_marker_index_t *jpeg_marker_idx = NULL);
     int32_t sendEvtNotify(int32_t msg_type, int32_t ext1, int32_t ext2);
     qcamera_jpeg_data_t *findJpegJobByJobId(uint32_t jobId);
     mm_jpeg_color_format getColorfmtFromImgFmt(cam_format_t img_fmt);
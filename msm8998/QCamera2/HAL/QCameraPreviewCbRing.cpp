@@ -0,0 +1,276 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// System dependencies
+#include <string.h>
+
+// Camera dependencies
+#include "QCameraPreviewCbRing.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraPreviewCbRing
+ *
+ * DESCRIPTION: constructor of QCameraPreviewCbRing
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraPreviewCbRing::QCameraPreviewCbRing() :
+        mDepth(0),
+        mNext(0),
+        mGeneration(0),
+        mFormat(-1),
+        mSize(0)
+{
+    pthread_mutex_init(&mLock, NULL);
+    memset(mSlots, 0, sizeof(mSlots));
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraPreviewCbRing
+ *
+ * DESCRIPTION: destructor of QCameraPreviewCbRing
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraPreviewCbRing::~QCameraPreviewCbRing()
+{
+    clear();
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : setDepth
+ *
+ * DESCRIPTION: set the number of buffers the ring keeps. A new depth
+ *              empties the ring.
+ *
+ * PARAMETERS :
+ *   @depth : number of buffers, capped at PREVIEW_CB_RING_MAX_BUFS
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPreviewCbRing::setDepth(uint32_t depth)
+{
+    if (depth > PREVIEW_CB_RING_MAX_BUFS) {
+        depth = PREVIEW_CB_RING_MAX_BUFS;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (depth != mDepth) {
+        clearLocked();
+        mDepth = depth;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getDepth
+ *
+ * DESCRIPTION: get the number of buffers the ring keeps
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : number of buffers
+ *==========================================================================*/
+uint32_t QCameraPreviewCbRing::getDepth()
+{
+    pthread_mutex_lock(&mLock);
+    uint32_t depth = mDepth;
+    pthread_mutex_unlock(&mLock);
+    return depth;
+}
+
+/*===========================================================================
+ * FUNCTION   : get
+ *
+ * DESCRIPTION: get a buffer for a preview callback frame. The next idle
+ *              ring buffer is reused if there is one. Otherwise a buffer is
+ *              allocated and kept in an empty slot, or handed out on its own
+ *              if the ring is full of busy buffers.
+ *
+ * PARAMETERS :
+ *   @format    : preview format of the frame
+ *   @size      : buffer size
+ *   @getMemory : framework allocator
+ *   @cookie    : cookie of the framework allocator
+ *
+ * RETURN     : camera memory, NULL on failure
+ *==========================================================================*/
+camera_memory_t *QCameraPreviewCbRing::get(int32_t format, size_t size,
+        camera_request_memory getMemory, void *cookie)
+{
+    camera_memory_t *mem = NULL;
+    int32_t emptySlot = -1;
+    uint32_t generation;
+
+    pthread_mutex_lock(&mLock);
+    if ((format != mFormat) || (size != mSize)) {
+        clearLocked();
+        mFormat = format;
+        mSize = size;
+    }
+    for (uint32_t i = 0; i < mDepth; i++) {
+        uint32_t slot = (mNext + i) % mDepth;
+        if (NULL == mSlots[slot].mem) {
+            if (emptySlot < 0) {
+                emptySlot = (int32_t)slot;
+            }
+        } else if (!mSlots[slot].busy) {
+            mSlots[slot].busy = true;
+            mNext = (slot + 1) % mDepth;
+            mStats.reuses++;
+            mem = mSlots[slot].mem;
+            break;
+        }
+    }
+    generation = mGeneration;
+    pthread_mutex_unlock(&mLock);
+
+    if (NULL != mem) {
+        return mem;
+    }
+
+    // The allocation is a call into the framework, done without the lock
+    mem = getMemory(-1, size, 1, cookie);
+    if ((NULL == mem) || (NULL == mem->data)) {
+        if (NULL != mem) {
+            mem->release(mem);
+        }
+        return NULL;
+    }
+
+    pthread_mutex_lock(&mLock);
+    mStats.allocs++;
+    if ((emptySlot >= 0) && (generation == mGeneration) &&
+            (NULL == mSlots[emptySlot].mem)) {
+        mSlots[emptySlot].mem = mem;
+        mSlots[emptySlot].busy = true;
+        mNext = ((uint32_t)emptySlot + 1) % mDepth;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return mem;
+}
+
+/*===========================================================================
+ * FUNCTION   : put
+ *
+ * DESCRIPTION: return a buffer from get() once its callback is done. Ring
+ *              buffers become idle, all others are released.
+ *
+ * PARAMETERS :
+ *   @mem : buffer to be returned
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPreviewCbRing::put(camera_memory_t *mem)
+{
+    if (NULL == mem) {
+        return;
+    }
+
+    pthread_mutex_lock(&mLock);
+    for (uint32_t i = 0; i < mDepth; i++) {
+        if (mSlots[i].mem == mem) {
+            mSlots[i].busy = false;
+            pthread_mutex_unlock(&mLock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+
+    mem->release(mem);
+}
+
+/*===========================================================================
+ * FUNCTION   : clear
+ *
+ * DESCRIPTION: release the idle ring buffers and detach the busy ones, which
+ *              put() then releases
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPreviewCbRing::clear()
+{
+    pthread_mutex_lock(&mLock);
+    clearLocked();
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : clearLocked
+ *
+ * DESCRIPTION: empty the ring, mLock is held by the caller
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPreviewCbRing::clearLocked()
+{
+    for (uint32_t i = 0; i < PREVIEW_CB_RING_MAX_BUFS; i++) {
+        if ((NULL != mSlots[i].mem) && !mSlots[i].busy) {
+            mSlots[i].mem->release(mSlots[i].mem);
+        }
+        mSlots[i].mem = NULL;
+        mSlots[i].busy = false;
+    }
+    mNext = 0;
+    mGeneration++;
+    mFormat = -1;
+    mSize = 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : getStats
+ *
+ * DESCRIPTION: get the allocation and reuse counts
+ *
+ * PARAMETERS :
+ *   @stats : filled with the counts
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraPreviewCbRing::getStats(preview_cb_ring_stats_t &stats)
+{
+    pthread_mutex_lock(&mLock);
+    stats = mStats;
+    pthread_mutex_unlock(&mLock);
+}
+
+}; // namespace qcamera
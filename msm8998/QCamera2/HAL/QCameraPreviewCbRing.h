@@ -0,0 +1,102 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERAPREVIEWCBRING_H__
+#define __QCAMERAPREVIEWCBRING_H__
+
+// System dependencies
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Camera dependencies
+#include "camera.h"
+
+namespace qcamera {
+
+#define PREVIEW_CB_RING_MAX_BUFS    8
+
+typedef struct {
+    uint64_t allocs;    // buffers allocated with the framework allocator
+    uint64_t reuses;    // callbacks served from an idle ring buffer
+} preview_cb_ring_stats_t;
+
+/*
+ * QCameraPreviewCbRing keeps the de-strided preview callback buffers for
+ * reuse instead of allocating one per frame. The buffers are keyed by
+ * format and size; a change of either empties the ring.
+ *
+ * A buffer handed out by get() is busy until put(), which the HAL calls from
+ * the release callback of the data notification. That runs once data_cb has
+ * returned, the point where the HAL used to free the buffer, so a buffer is
+ * only written again by a later callback. When every ring buffer is busy,
+ * get() falls back to a buffer of its own, which put() releases.
+ *
+ * Thread safe, get() runs in the stream callback threads and put() in the
+ * callback notifier thread.
+ */
+class QCameraPreviewCbRing {
+public:
+    QCameraPreviewCbRing();
+    ~QCameraPreviewCbRing();
+
+    // Number of buffers kept, 0 allocates a new buffer for every callback.
+    void setDepth(uint32_t depth);
+    uint32_t getDepth();
+    // Buffer of 'size' bytes for a callback frame of 'format'. NULL if the
+    // allocation fails.
+    camera_memory_t *get(int32_t format, size_t size,
+            camera_request_memory getMemory, void *cookie);
+    // Callback done with a buffer from get().
+    void put(camera_memory_t *mem);
+    // Release idle buffers. Busy ones are released by put().
+    void clear();
+    void getStats(preview_cb_ring_stats_t &stats);
+
+private:
+    void clearLocked();
+
+    typedef struct {
+        camera_memory_t *mem;
+        bool busy;
+    } ring_slot_t;
+
+    pthread_mutex_t mLock;
+    ring_slot_t mSlots[PREVIEW_CB_RING_MAX_BUFS];
+    uint32_t mDepth;
+    uint32_t mNext;         // slot to try first, buffers are reused in order
+    uint32_t mGeneration;   // bumped whenever the ring is emptied
+    int32_t mFormat;
+    size_t mSize;
+    preview_cb_ring_stats_t mStats;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERAPREVIEWCBRING_H__ */
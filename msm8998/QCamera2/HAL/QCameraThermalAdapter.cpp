@@ -167,6 +167,12 @@ int QCameraThermalAdapter::thermalCallback(int level,
     return rc;
 }
 
+int QCameraThermalAdapter::injectThermalLevel(int level)
+{
+    LOGH("Simulated thermal level %d", level);
+    return thermalCallback(level, NULL, NULL);
+}
+
 qcamera_thermal_level_enum_t *QCameraThermalCallback::getThermalLevel() {
     return &mLevel;
 }
@@ -65,6 +65,9 @@ public:
 
     int init(QCameraThermalCallback *thermalCb);
     void deinit();
+    // Deliver a level as if it came from the thermal client, for driving
+    // the camera from a simulated thermal source.
+    int injectThermalLevel(int level);
 
 private:
     static char mStrCamera[];
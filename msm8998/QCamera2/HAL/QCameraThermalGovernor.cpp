@@ -0,0 +1,388 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// System dependencies
+#include <string.h>
+
+// Camera dependencies
+#include "QCameraThermalGovernor.h"
+
+namespace qcamera {
+
+// Utilization above which a warm device is throttled one extra step.
+#define THERMAL_GOV_UTIL_HIGH      0.9f
+// Highest predicted utilization at which the governor ramps up.
+#define THERMAL_GOV_UTIL_HEADROOM  0.8f
+// Weight of a new frame in the utilization average.
+#define THERMAL_GOV_UTIL_WEIGHT    0.125f
+
+static const float kFpsScale[THERMAL_GOV_MAX_STEP + 1] =
+        {1.0f, 0.95f, 0.9f, 0.85f, 0.8f, 0.7f, 0.6f, 0.5f};
+static const uint32_t kSkipInterval[THERMAL_GOV_MAX_STEP + 1] =
+        {1, 1, 2, 3, 4, 5, 6, 0};
+
+/*===========================================================================
+ * FUNCTION   : QCameraThermalGovernor constructor
+ *
+ * DESCRIPTION: Initialize the governor at full rate.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraThermalGovernor::QCameraThermalGovernor()
+{
+    pthread_mutex_init(&mLock, NULL);
+    reset();
+}
+
+/*===========================================================================
+ * FUNCTION   : QCameraThermalGovernor destructor
+ *
+ * DESCRIPTION: Release the governor lock.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCameraThermalGovernor::~QCameraThermalGovernor()
+{
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: Drop the level history and go back to full rate.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThermalGovernor::reset()
+{
+    pthread_mutex_lock(&mLock);
+    mLevel = QCAMERA_THERMAL_NO_ADJUSTMENT;
+    memset(mLastActive, 0, sizeof(mLastActive));
+    mStep = 0;
+    mLastChange = 0;
+    mLastFrame = 0;
+    mUtilization = 0.0f;
+    mUpdatePending = false;
+    mPendingSince = 0;
+    mStepsDown = 0;
+    mStepsUp = 0;
+    mLevelChanges = 0;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : onThermalLevel
+ *
+ * DESCRIPTION: Record a thermal level reported by the thermal client. Levels
+ *              above the max adjustment are treated as the max adjustment.
+ *
+ * PARAMETERS :
+ * @level     : reported thermal level
+ * @now       : time of the report
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThermalGovernor::onThermalLevel(qcamera_thermal_level_enum_t level,
+        nsecs_t now)
+{
+    if (level < QCAMERA_THERMAL_NO_ADJUSTMENT) {
+        return;
+    }
+    if (level > QCAMERA_THERMAL_MAX_ADJUSTMENT) {
+        level = QCAMERA_THERMAL_MAX_ADJUSTMENT;
+    }
+
+    pthread_mutex_lock(&mLock);
+    for (int l = QCAMERA_THERMAL_SLIGHT_ADJUSTMENT;
+            l <= QCAMERA_THERMAL_MAX_ADJUSTMENT; l++) {
+        if (mLevel >= l) {
+            mLastActive[l] = now;
+        }
+    }
+    if (level != mLevel) {
+        mLevelChanges++;
+    }
+    mLevel = level;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : onFrame
+ *
+ * DESCRIPTION: Fold the processing cost of a frame into the utilization
+ *              average, using the time since the previous frame as the
+ *              frame interval, and check whether a step is due.
+ *
+ * PARAMETERS :
+ * @cost      : time spent processing the frame
+ * @now       : time the frame processing started
+ *
+ * RETURN     : true if update() should be run, false otherwise. Only the
+ *              first frame that finds a step due returns true until update()
+ *              runs or THERMAL_GOV_REPOST_MS passes.
+ *==========================================================================*/
+bool QCameraThermalGovernor::onFrame(nsecs_t cost, nsecs_t now)
+{
+    bool post = false;
+
+    pthread_mutex_lock(&mLock);
+    if (mLastFrame > 0) {
+        nsecs_t interval = now - mLastFrame;
+        // A gap of a second or more is a pause, not a frame interval.
+        if ((interval > 0) && (interval < s2ns(1))) {
+            float u = (float)cost / (float)interval;
+            if (mUtilization == 0.0f) {
+                mUtilization = u;
+            } else {
+                mUtilization += THERMAL_GOV_UTIL_WEIGHT * (u - mUtilization);
+            }
+        }
+    }
+    mLastFrame = now;
+
+    if (!mUpdatePending ||
+            (now - mPendingSince >= ms2ns(THERMAL_GOV_REPOST_MS))) {
+        if (nextStepLocked(now) != mStep) {
+            mUpdatePending = true;
+            mPendingSince = now;
+            post = true;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return post;
+}
+
+/*===========================================================================
+ * FUNCTION   : update
+ *
+ * DESCRIPTION: Take the next step if one is due.
+ *
+ * PARAMETERS :
+ * @now       : current time
+ *
+ * RETURN     : true if the step changed, false otherwise
+ *==========================================================================*/
+bool QCameraThermalGovernor::update(nsecs_t now)
+{
+    bool changed = false;
+
+    pthread_mutex_lock(&mLock);
+    mUpdatePending = false;
+    uint32_t next = nextStepLocked(now);
+    if (next != mStep) {
+        if (next > mStep) {
+            mStepsDown++;
+        } else {
+            mStepsUp++;
+        }
+        mStep = next;
+        mLastChange = now;
+        changed = true;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return changed;
+}
+
+/*===========================================================================
+ * FUNCTION   : getStep
+ *
+ * DESCRIPTION: Current throttle step.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : step between 0 and THERMAL_GOV_MAX_STEP
+ *==========================================================================*/
+uint32_t QCameraThermalGovernor::getStep()
+{
+    pthread_mutex_lock(&mLock);
+    uint32_t step = mStep;
+    pthread_mutex_unlock(&mLock);
+    return step;
+}
+
+/*===========================================================================
+ * FUNCTION   : getStats
+ *
+ * DESCRIPTION: Snapshot of the governor state.
+ *
+ * PARAMETERS :
+ * @stats     : filled with the current state
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraThermalGovernor::getStats(thermal_governor_stats_t &stats)
+{
+    pthread_mutex_lock(&mLock);
+    stats.level = mLevel;
+    stats.step = mStep;
+    stats.utilization = mUtilization;
+    stats.stepsDown = mStepsDown;
+    stats.stepsUp = mStepsUp;
+    stats.levelChanges = mLevelChanges;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : fpsScaleOf
+ *
+ * DESCRIPTION: Fraction of the configured fps range kept at a step.
+ *
+ * PARAMETERS :
+ * @step      : throttle step
+ *
+ * RETURN     : scale between 0 and 1
+ *==========================================================================*/
+float QCameraThermalGovernor::fpsScaleOf(uint32_t step)
+{
+    if (step > THERMAL_GOV_MAX_STEP) {
+        step = THERMAL_GOV_MAX_STEP;
+    }
+    return kFpsScale[step];
+}
+
+/*===========================================================================
+ * FUNCTION   : skipIntervalOf
+ *
+ * DESCRIPTION: Frame skip interval at a step.
+ *
+ * PARAMETERS :
+ * @step      : throttle step
+ *
+ * RETURN     : 1 for no skip, n to keep every n-th frame, 0 for max skip
+ *==========================================================================*/
+uint32_t QCameraThermalGovernor::skipIntervalOf(uint32_t step)
+{
+    if (step > THERMAL_GOV_MAX_STEP) {
+        step = THERMAL_GOV_MAX_STEP;
+    }
+    return kSkipInterval[step];
+}
+
+/*===========================================================================
+ * FUNCTION   : stepOfLevel
+ *
+ * DESCRIPTION: Step a thermal level settles at. The slight and big levels
+ *              end at the 10% and 20% fps cuts of the fixed thermal table.
+ *
+ * PARAMETERS :
+ * @level     : thermal level
+ *
+ * RETURN     : throttle step
+ *==========================================================================*/
+uint32_t QCameraThermalGovernor::stepOfLevel(qcamera_thermal_level_enum_t level)
+{
+    switch (level) {
+    case QCAMERA_THERMAL_NO_ADJUSTMENT:
+        return 0;
+    case QCAMERA_THERMAL_SLIGHT_ADJUSTMENT:
+        return 2;
+    case QCAMERA_THERMAL_BIG_ADJUSTMENT:
+        return 4;
+    default:
+        return THERMAL_GOV_MAX_STEP;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : windowLevelLocked
+ *
+ * DESCRIPTION: Highest level in effect during the last THERMAL_GOV_UP_HOLD_MS.
+ *
+ * PARAMETERS :
+ * @now       : current time
+ *
+ * RETURN     : thermal level
+ *==========================================================================*/
+qcamera_thermal_level_enum_t QCameraThermalGovernor::windowLevelLocked(
+        nsecs_t now)
+{
+    for (int l = QCAMERA_THERMAL_MAX_ADJUSTMENT;
+            l > QCAMERA_THERMAL_NO_ADJUSTMENT; l--) {
+        if ((mLevel >= l) || ((mLastActive[l] > 0) &&
+                (now - mLastActive[l] < ms2ns(THERMAL_GOV_UP_HOLD_MS)))) {
+            return (qcamera_thermal_level_enum_t)l;
+        }
+    }
+    return QCAMERA_THERMAL_NO_ADJUSTMENT;
+}
+
+/*===========================================================================
+ * FUNCTION   : nextStepLocked
+ *
+ * DESCRIPTION: Step the governor moves to at 'now'. Throttling follows the
+ *              current level; ramping up follows the highest level of the
+ *              hold window, so a level that keeps flapping holds the step.
+ *
+ * PARAMETERS :
+ * @now       : current time
+ *
+ * RETURN     : next step, or the current one if no step is due
+ *==========================================================================*/
+uint32_t QCameraThermalGovernor::nextStepLocked(nsecs_t now)
+{
+    uint32_t bump = ((mLevel > QCAMERA_THERMAL_NO_ADJUSTMENT) &&
+            (mUtilization > THERMAL_GOV_UTIL_HIGH)) ? 1 : 0;
+
+    uint32_t down = stepOfLevel(mLevel) + bump;
+    if (down > THERMAL_GOV_MAX_STEP) {
+        down = THERMAL_GOV_MAX_STEP;
+    }
+    if (down > mStep) {
+        if (mLevel >= QCAMERA_THERMAL_MAX_ADJUSTMENT) {
+            return down;
+        }
+        if (now - mLastChange >= ms2ns(THERMAL_GOV_DOWN_PERIOD_MS)) {
+            return mStep + 1;
+        }
+        return mStep;
+    }
+
+    uint32_t up = stepOfLevel(windowLevelLocked(now)) + bump;
+    if ((up < mStep) &&
+            (now - mLastChange >= ms2ns(THERMAL_GOV_UP_PERIOD_MS))) {
+        // Frames cost the same at a higher rate, so the utilization grows
+        // with the fps.
+        float predicted = mUtilization *
+                fpsScaleOf(mStep - 1) / fpsScaleOf(mStep);
+        if (predicted < THERMAL_GOV_UTIL_HEADROOM) {
+            return mStep - 1;
+        }
+    }
+    return mStep;
+}
+
+}; // namespace qcamera
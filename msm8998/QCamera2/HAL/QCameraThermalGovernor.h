@@ -0,0 +1,119 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERATHERMALGOVERNOR_H__
+#define __QCAMERATHERMALGOVERNOR_H__
+
+// System dependencies
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+// Camera dependencies
+#include "QCameraThermalAdapter.h"
+
+namespace qcamera {
+
+#define THERMAL_GOV_MAX_STEP        7
+// Minimum time between two throttle steps while the level asks for more.
+#define THERMAL_GOV_DOWN_PERIOD_MS  500
+// Time the level has to stay below a step before the governor ramps back.
+#define THERMAL_GOV_UP_HOLD_MS      5000
+// Minimum time between two ramp up steps.
+#define THERMAL_GOV_UP_PERIOD_MS    2000
+// Time after which an update that was asked for but not run is asked again.
+#define THERMAL_GOV_REPOST_MS       1000
+
+typedef struct {
+    qcamera_thermal_level_enum_t level; // Last reported level.
+    uint32_t step;                      // Current throttle step.
+    float utilization;                  // Frame cost over frame interval, EWMA.
+    uint32_t stepsDown;                 // Steps taken towards more throttling.
+    uint32_t stepsUp;                   // Steps taken back towards full rate.
+    uint32_t levelChanges;              // Reported level changes.
+} thermal_governor_stats_t;
+
+/*
+ * QCameraThermalGovernor turns thermal levels into a throttle step between 0
+ * (full rate) and THERMAL_GOV_MAX_STEP, for the closed loop thermal mode.
+ * Instead of jumping to the fixed fps cut of each level it moves one step at a
+ * time: towards more throttling every THERMAL_GOV_DOWN_PERIOD_MS, except for
+ * the max level which is applied at once, and back only after no level that
+ * asks for the current step was seen for THERMAL_GOV_UP_HOLD_MS, one step per
+ * THERMAL_GOV_UP_PERIOD_MS. The measured per frame processing cost adds one
+ * step while the device is warm and frames use most of their interval, and
+ * holds off ramping up when the next step would not fit in the frame interval.
+ *
+ * The governor does not run a thread. Thermal events and frames drive it, and
+ * onFrame() tells the caller when update() should be run to take a step.
+ */
+class QCameraThermalGovernor {
+public:
+    QCameraThermalGovernor();
+    virtual ~QCameraThermalGovernor();
+
+    void reset();
+    void onThermalLevel(qcamera_thermal_level_enum_t level, nsecs_t now);
+    // Account the processing cost of a frame that started at 'now'. Returns
+    // true if update() should be run.
+    bool onFrame(nsecs_t cost, nsecs_t now);
+    // Take the next step if one is due. Returns true if the step changed.
+    bool update(nsecs_t now);
+    uint32_t getStep();
+    void getStats(thermal_governor_stats_t &stats);
+
+    // Fraction of the configured fps range kept at 'step'.
+    static float fpsScaleOf(uint32_t step);
+    // Frame skip interval at 'step': 1 for no skip, n to keep every n-th
+    // frame, 0 for the maximum skip.
+    static uint32_t skipIntervalOf(uint32_t step);
+    static uint32_t stepOfLevel(qcamera_thermal_level_enum_t level);
+
+private:
+    qcamera_thermal_level_enum_t windowLevelLocked(nsecs_t now);
+    uint32_t nextStepLocked(nsecs_t now);
+
+    qcamera_thermal_level_enum_t mLevel;
+    // Last time each level, or a higher one, was in effect.
+    nsecs_t mLastActive[QCAMERA_THERMAL_MAX_ADJUSTMENT + 1];
+    uint32_t mStep;
+    nsecs_t mLastChange;
+    nsecs_t mLastFrame;
+    float mUtilization;
+    bool mUpdatePending;
+    nsecs_t mPendingSince;
+    uint32_t mStepsDown;
+    uint32_t mStepsUp;
+    uint32_t mLevelChanges;
+    pthread_mutex_t mLock;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERATHERMALGOVERNOR_H__ */
@@ -0,0 +1,145 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_TS_FACE_TRACKER_H__
+#define __QCAMERA_TS_FACE_TRACKER_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ts_detectface_engine.h"
+
+namespace qcamera {
+
+/*
+ * QCameraTsFaceTracker keeps the TsMakeup face detection context and the
+ * beautification scratch buffer alive for a session instead of building them
+ * per frame. track() runs full face detection only every N frames and reuses
+ * the last face rectangle in between. The detector entry points can be
+ * replaced so the scheduling can be exercised without the TS libraries.
+ * Not thread safe; each user thread owns its own tracker.
+ */
+class QCameraTsFaceTracker {
+public:
+    typedef struct {
+        TSHandle (*createContext)();
+        void (*destroyContext)(TSHandle *handle);
+        int (*detect)(TSHandle handle, TSMakeupDataEx *data);
+        int (*getFaceInfo)(TSHandle handle, int index, TSRect *face,
+                TSRect *leftEye, TSRect *rightEye, TSRect *mouth);
+    } detector_ops_t;
+
+    QCameraTsFaceTracker(const detector_ops_t *ops = NULL) :
+            mHandle(NULL), mScratch(NULL), mScratchLen(0),
+            mInterval(1), mFrameCnt(0), mDetectCnt(0) {
+        if (ops != NULL) {
+            mOps = *ops;
+        } else {
+            mOps.createContext = ts_detectface_create_context;
+            mOps.destroyContext = ts_detectface_destroy_context;
+            mOps.detect = ts_detectface_detectEx;
+            mOps.getFaceInfo = ts_detectface_get_face_info;
+        }
+        memset(&mFaceRect, -1, sizeof(mFaceRect));
+    }
+
+    ~QCameraTsFaceTracker() { reset(); }
+
+    // Run full detection every 'interval' frames. 0 and 1 both detect on
+    // every frame; callers may use 0 to mean tracking is not configured.
+    void setInterval(uint32_t interval) { mInterval = interval; }
+    uint32_t getInterval() const { return mInterval; }
+
+    // Full detection on this frame. Returns true if a face was found.
+    bool detect(TSMakeupDataEx *frame, TSRect &faceRect) {
+        memset(&mFaceRect, -1, sizeof(mFaceRect));
+        if (mHandle == NULL) {
+            mHandle = mOps.createContext();
+        }
+        if ((mHandle != NULL) && (frame != NULL)) {
+            mDetectCnt++;
+            if (mOps.detect(mHandle, frame) > 0) {
+                mOps.getFaceInfo(mHandle, 0, &mFaceRect, NULL, NULL, NULL);
+            }
+        }
+        faceRect = mFaceRect;
+        return (mFaceRect.left > -1);
+    }
+
+    // Detect on every Nth frame, otherwise reuse the last face rectangle.
+    bool track(TSMakeupDataEx *frame, TSRect &faceRect) {
+        uint32_t interval = (mInterval > 0) ? mInterval : 1;
+        bool runDetect = (mFrameCnt % interval) == 0;
+        mFrameCnt++;
+        if (runDetect) {
+            return detect(frame, faceRect);
+        }
+        faceRect = mFaceRect;
+        return (mFaceRect.left > -1);
+    }
+
+    // Scratch buffer of at least len bytes, kept until reset().
+    unsigned char *getScratch(size_t len) {
+        if (len > mScratchLen) {
+            free(mScratch);
+            mScratch = (unsigned char *)malloc(len);
+            mScratchLen = (mScratch != NULL) ? len : 0;
+        }
+        return mScratch;
+    }
+
+    // Release the detection context and scratch buffer.
+    void reset() {
+        if (mHandle != NULL) {
+            mOps.destroyContext(&mHandle);
+            mHandle = NULL;
+        }
+        free(mScratch);
+        mScratch = NULL;
+        mScratchLen = 0;
+        mFrameCnt = 0;
+        memset(&mFaceRect, -1, sizeof(mFaceRect));
+    }
+
+    uint32_t getDetectCount() const { return mDetectCnt; }
+
+private:
+    detector_ops_t mOps;
+    TSHandle mHandle;
+    unsigned char *mScratch;
+    size_t mScratchLen;
+    uint32_t mInterval;
+    uint32_t mFrameCnt;
+    uint32_t mDetectCnt;
+    TSRect mFaceRect;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_TS_FACE_TRACKER_H__ */
@@ -345,6 +345,62 @@ int32_t QCamera3Channel::flush()
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : cancelInflightBufs
+ *
+ * DESCRIPTION: recall the buffers all streams of the channel have queued to
+ *              the backend, without stopping the streams
+ *
+ * PARAMETERS :
+ *   @deadline  : absolute systemTime() to give up at
+ *   @cancelled : number of buffers recalled
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Channel::cancelInflightBufs(nsecs_t deadline, uint32_t &cancelled)
+{
+    int32_t rc = NO_ERROR;
+    cancelled = 0;
+    for (uint32_t i = 0; i < m_numStreams; i++) {
+        if (mStreams[i] != NULL) {
+            uint32_t streamCancelled = 0;
+            int32_t streamRc = mStreams[i]->cancelInflight(deadline, streamCancelled);
+            if (NO_ERROR != streamRc) {
+                rc = streamRc;
+            }
+            cancelled += streamCancelled;
+        }
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : waitInflightBufs
+ *
+ * DESCRIPTION: wait until no stream of the channel has a buffer in flight
+ *
+ * PARAMETERS :
+ *   @deadline : absolute systemTime() to give up at
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- no buffer in flight
+ *              TIMED_OUT -- buffers still in flight at the deadline
+ *==========================================================================*/
+int32_t QCamera3Channel::waitInflightBufs(nsecs_t deadline)
+{
+    for (uint32_t i = 0; i < m_numStreams; i++) {
+        if (mStreams[i] != NULL) {
+            int32_t rc = mStreams[i]->waitInflight(deadline);
+            if (NO_ERROR != rc) {
+                return rc;
+            }
+        }
+    }
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : bufDone
  *
@@ -1150,7 +1206,10 @@ int32_t QCamera3ProcessingChannel::request(buffer_handle_t *buffer,
 int32_t QCamera3ProcessingChannel::initialize(__unused cam_is_type_t isType)
 {
     int32_t rc = NO_ERROR;
-    rc = mOfflineMetaMemory.allocateAll(sizeof(metadata_buffer_t));
+    // The buffers are kept when the stream is re-added to a kept channel
+    if (0 == mOfflineMetaMemory.getCnt()) {
+        rc = mOfflineMetaMemory.allocateAll(sizeof(metadata_buffer_t));
+    }
     if (rc == NO_ERROR) {
         Mutex::Autolock lock(mFreeOfflineMetaBuffersLock);
         mFreeOfflineMetaBuffersList.clear();
@@ -1263,6 +1322,109 @@ void QCamera3ProcessingChannel::unregisterBuffer(mm_camera_buf_def_t *frame)
     mMemory.unregisterBuffer(frame->buf_idx);
 }
 
+/*===========================================================================
+ * FUNCTION   : getFreeOfflineMetaBuf
+ *
+ * DESCRIPTION: take a buffer from the offline metadata pool
+ *
+ * PARAMETERS :
+ *   @frameNumber : frame number to tag the buffer with
+ *   @meta_buf    : buffer definition to be filled out
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR    -- success
+ *              WOULD_BLOCK -- no free buffer in the pool
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3ProcessingChannel::getFreeOfflineMetaBuf(uint32_t frameNumber,
+        mm_camera_buf_def_t &meta_buf)
+{
+    cam_dimension_t dim = {sizeof(metadata_buffer_t), 1};
+    cam_stream_buf_plane_info_t meta_planes;
+    int32_t rc = mm_stream_calc_offset_metadata(&dim, &mPaddingInfo, &meta_planes);
+    if (rc != 0) {
+        LOGE("Metadata stream plane info calculation failed!");
+        return rc;
+    }
+    uint32_t metaBufIdx;
+    {
+        Mutex::Autolock lock(mFreeOfflineMetaBuffersLock);
+        if (mFreeOfflineMetaBuffersList.empty()) {
+            return WOULD_BLOCK;
+        }
+
+        metaBufIdx = *(mFreeOfflineMetaBuffersList.begin());
+        mFreeOfflineMetaBuffersList.erase(mFreeOfflineMetaBuffersList.begin());
+        LOGD("erasing %d, mFreeOfflineMetaBuffersList.size %d", metaBufIdx,
+                mFreeOfflineMetaBuffersList.size());
+    }
+
+    mOfflineMetaMemory.markFrameNumber(metaBufIdx, frameNumber);
+
+    cam_frame_len_offset_t offset = meta_planes.plane_info;
+    rc = mOfflineMetaMemory.getBufDef(offset, meta_buf, metaBufIdx, true /*virtualAddr*/);
+    if (NO_ERROR != rc) {
+        Mutex::Autolock lock(mFreeOfflineMetaBuffersLock);
+        mFreeOfflineMetaBuffersList.push_back(metaBufIdx);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : unshareMetadata
+ *
+ * DESCRIPTION: copy-on-write for metadata handed to offline reprocess. If the
+ *              metadata stream buffer is also referenced by another consumer,
+ *              copy it into an offline metadata buffer, drop the reference on
+ *              the original and point the super buffer at the private copy,
+ *              so that reprocess overrides can be applied in place. A buffer
+ *              with no other consumer is left untouched.
+ *
+ * PARAMETERS :
+ *   @metadata : metadata super buffer, updated in place
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR    -- success
+ *              WOULD_BLOCK -- offline metadata pool is empty, the super
+ *                             buffer is unchanged and can be retried once
+ *                             a pool buffer is released
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3ProcessingChannel::unshareMetadata(mm_camera_super_buf_t *metadata)
+{
+    if ((NULL == m_pMetaChannel) || (NULL == metadata) ||
+            (NULL == metadata->bufs[0])) {
+        return BAD_VALUE;
+    }
+
+    QCamera3MetadataChannel *metaChannel = (QCamera3MetadataChannel *)m_pMetaChannel;
+    if (!metaChannel->isBufShared(metadata)) {
+        return NO_ERROR;
+    }
+
+    mm_camera_buf_def_t *meta_buf =
+            (mm_camera_buf_def_t *)calloc(1, sizeof(mm_camera_buf_def_t));
+    if (NULL == meta_buf) {
+        LOGE("No memory for metadata copy");
+        return NO_MEMORY;
+    }
+    // Pool copies are released by pointer in metadataBufDone, never
+    // by frame number.
+    int32_t rc = getFreeOfflineMetaBuf(UINT32_MAX, *meta_buf);
+    if (NO_ERROR != rc) {
+        free(meta_buf);
+        return rc;
+    }
+    copy_metadata_buffer((metadata_buffer_t *)meta_buf->buffer,
+            (metadata_buffer_t *)metadata->bufs[0]->buffer);
+    meta_buf->frame_idx = metadata->bufs[0]->frame_idx;
+    meta_buf->ts = metadata->bufs[0]->ts;
+
+    metaChannel->bufDone(metadata);
+    metadata->bufs[0] = meta_buf;
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : setFwkInputPPData
  *
@@ -1311,36 +1473,16 @@ int32_t QCamera3ProcessingChannel::setFwkInputPPData(qcamera_fwk_input_pp_data_t
     }
     dumpYUV(&src_frame->input_buffer, reproc_cfg->input_stream_dim,
             reproc_cfg->input_stream_plane_info.plane_info, QCAMERA_DUMP_FRM_INPUT_REPROCESS);
-    cam_dimension_t dim = {sizeof(metadata_buffer_t), 1};
-    cam_stream_buf_plane_info_t meta_planes;
-    rc = mm_stream_calc_offset_metadata(&dim, &mPaddingInfo, &meta_planes);
-    if (rc != 0) {
-        LOGE("Metadata stream plane info calculation failed!");
-        return rc;
-    }
-    uint32_t metaBufIdx;
-    {
-        Mutex::Autolock lock(mFreeOfflineMetaBuffersLock);
-        if (mFreeOfflineMetaBuffersList.empty()) {
-            LOGE("mFreeOfflineMetaBuffersList is null. Fatal");
-            return BAD_VALUE;
-        }
-
-        metaBufIdx = *(mFreeOfflineMetaBuffersList.begin());
-        mFreeOfflineMetaBuffersList.erase(mFreeOfflineMetaBuffersList.begin());
-        LOGD("erasing %d, mFreeOfflineMetaBuffersList.size %d", metaBufIdx,
-                mFreeOfflineMetaBuffersList.size());
-    }
-
-    mOfflineMetaMemory.markFrameNumber(metaBufIdx, frameNumber);
 
     mm_camera_buf_def_t meta_buf;
-    cam_frame_len_offset_t offset = meta_planes.plane_info;
-    rc = mOfflineMetaMemory.getBufDef(offset, meta_buf, metaBufIdx, true /*virtualAddr*/);
-    if (NO_ERROR != rc) {
+    rc = getFreeOfflineMetaBuf(frameNumber, meta_buf);
+    if (WOULD_BLOCK == rc) {
+        LOGE("mFreeOfflineMetaBuffersList is null. Fatal");
+        return BAD_VALUE;
+    } else if (NO_ERROR != rc) {
         return rc;
     }
-    memcpy(meta_buf.buffer, metadata, sizeof(metadata_buffer_t));
+    copy_metadata_buffer((metadata_buffer_t *)meta_buf.buffer, metadata);
     src_frame->metadata_buffer = meta_buf;
     src_frame->reproc_config = *reproc_cfg;
     src_frame->output_buffer = output_buffer;
@@ -1526,6 +1668,22 @@ int32_t QCamera3ProcessingChannel::queueReprocMetadata(mm_camera_super_buf_t *me
     return m_postprocessor.processPPMetadata(metadata);
 }
 
+/*===========================================================================
+ * FUNCTION   : releaseDroppedInput
+ *
+ * DESCRIPTION: give back the input frame of a postprocess job dropped by a
+ *              flush. Stream buffers are queued back to kernel.
+ *
+ * PARAMETERS :
+ * @frame : input frame of the dropped job
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3ProcessingChannel::releaseDroppedInput(mm_camera_super_buf_t *frame)
+{
+    bufDone(frame);
+}
+
 /*===========================================================================
  * FUNCTION : metadataBufDone
  *
@@ -1546,6 +1704,23 @@ int32_t QCamera3ProcessingChannel::metadataBufDone(mm_camera_super_buf_t *recvd_
         return BAD_VALUE;
     }
 
+    // Check if this is a private copy made by unshareMetadata
+    if ((1 == recvd_frame->num_bufs) && (NULL != recvd_frame->bufs[0])) {
+        for (uint32_t i = 0; i < mOfflineMetaMemory.getCnt(); i++) {
+            if (mOfflineMetaMemory.getPtr(i) == recvd_frame->bufs[0]->buffer) {
+                {
+                    Mutex::Autolock lock(mFreeOfflineMetaBuffersLock);
+                    mFreeOfflineMetaBuffersList.push_back(i);
+                }
+                free(recvd_frame->bufs[0]);
+                recvd_frame->bufs[0] = NULL;
+                // Reprocess jobs may be waiting for a pool buffer
+                m_postprocessor.offlineMetaBufFreed();
+                return NO_ERROR;
+            }
+        }
+    }
+
     rc = ((QCamera3MetadataChannel*)m_pMetaChannel)->bufDone(recvd_frame);
 
     return rc;
@@ -1852,8 +2027,11 @@ int32_t QCamera3ProcessingChannel::releaseOfflineMemory(uint32_t resultFrameNumb
     int32_t metaBufIndex =
             mOfflineMetaMemory.getHeapBufferIndex(resultFrameNumber);
     if (0 <= metaBufIndex) {
-        Mutex::Autolock lock(mFreeOfflineMetaBuffersLock);
-        mFreeOfflineMetaBuffersList.push_back((uint32_t)metaBufIndex);
+        {
+            Mutex::Autolock lock(mFreeOfflineMetaBuffersLock);
+            mFreeOfflineMetaBuffersList.push_back((uint32_t)metaBufIndex);
+        }
+        m_postprocessor.offlineMetaBufFreed();
     } else {
         LOGW("Could not find offline meta buffer, resultFrameNumber %d",
                 resultFrameNumber);
@@ -2229,6 +2407,112 @@ void QCamera3MetadataChannel::streamCbRoutine(
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : isOwnBuf
+ *
+ * DESCRIPTION: check whether a metadata super buffer came from this channel's
+ *              metadata stream (as opposed to externally allocated metadata)
+ *
+ * PARAMETERS :
+ * @recvd_frame : metadata super buffer
+ *
+ * RETURN     : true if the buffer belongs to the metadata stream
+ *==========================================================================*/
+bool QCamera3MetadataChannel::isOwnBuf(mm_camera_super_buf_t *recvd_frame)
+{
+    if ((NULL == recvd_frame) || (1 != recvd_frame->num_bufs) ||
+            (NULL == recvd_frame->bufs[0]) ||
+            (0 == m_numStreams) || (NULL == mStreams[0])) {
+        return false;
+    }
+
+    return (mStreams[0]->getMyHandle() == recvd_frame->bufs[0]->stream_id);
+}
+
+/*===========================================================================
+ * FUNCTION   : holdBuf
+ *
+ * DESCRIPTION: take an extra reference on a metadata buffer so that it can
+ *              be handed to more than one consumer without copying. Each
+ *              reference must be released with bufDone.
+ *
+ * PARAMETERS :
+ * @recvd_frame : metadata super buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3MetadataChannel::holdBuf(mm_camera_super_buf_t *recvd_frame)
+{
+    if (!isOwnBuf(recvd_frame)) {
+        LOGE("Invalid metadata buffer %p", recvd_frame);
+        return BAD_VALUE;
+    }
+
+    uint32_t bufIdx = recvd_frame->bufs[0]->buf_idx;
+    Mutex::Autolock lock(mBufRefLock);
+    ssize_t idx = mBufExtraRefs.indexOfKey(bufIdx);
+    if (idx >= 0) {
+        mBufExtraRefs.editValueAt(idx)++;
+    } else {
+        mBufExtraRefs.add(bufIdx, 1);
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : bufDone
+ *
+ * DESCRIPTION: release one reference on a metadata buffer. The buffer is
+ *              queued back to the stream once no extra references remain.
+ *
+ * PARAMETERS :
+ * @recvd_frame : metadata super buffer
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3MetadataChannel::bufDone(mm_camera_super_buf_t *recvd_frame)
+{
+    if (isOwnBuf(recvd_frame)) {
+        uint32_t bufIdx = recvd_frame->bufs[0]->buf_idx;
+        Mutex::Autolock lock(mBufRefLock);
+        ssize_t idx = mBufExtraRefs.indexOfKey(bufIdx);
+        if (idx >= 0) {
+            if (--mBufExtraRefs.editValueAt(idx) == 0) {
+                mBufExtraRefs.removeItemsAt(idx);
+            }
+            LOGD("Metadata buffer %d still referenced", bufIdx);
+            return NO_ERROR;
+        }
+    }
+
+    return QCamera3Channel::bufDone(recvd_frame);
+}
+
+/*===========================================================================
+ * FUNCTION   : isBufShared
+ *
+ * DESCRIPTION: check whether a metadata buffer is currently held by more
+ *              than one consumer. Consumers must not modify a shared buffer.
+ *
+ * PARAMETERS :
+ * @recvd_frame : metadata super buffer
+ *
+ * RETURN     : true if other references to the buffer exist
+ *==========================================================================*/
+bool QCamera3MetadataChannel::isBufShared(mm_camera_super_buf_t *recvd_frame)
+{
+    if (!isOwnBuf(recvd_frame)) {
+        return false;
+    }
+
+    Mutex::Autolock lock(mBufRefLock);
+    return (mBufExtraRefs.indexOfKey(recvd_frame->bufs[0]->buf_idx) >= 0);
+}
+
 QCamera3StreamMem* QCamera3MetadataChannel::getStreamBufs(uint32_t len)
 {
     int rc;
@@ -2284,6 +2568,11 @@ void QCamera3MetadataChannel::putStreamBufs()
         }
     }
 
+    {
+        Mutex::Autolock lock(mBufRefLock);
+        mBufExtraRefs.clear();
+    }
+
     mMemory->deallocate();
     delete mMemory;
     mMemory = NULL;
@@ -3440,6 +3729,12 @@ void QCamera3PicChannel::jpegEvtHandle(jpeg_job_status_t status,
             resultBuffer =
                     (buffer_handle_t *)obj->mMemory.getBufferHandle(bufIdx);
             int32_t resultFrameNumber = obj->mMemory.getFrameNumber(bufIdx);
+            QCamera3HardwareInterface* hal_obj =
+                    (QCamera3HardwareInterface*)obj->mUserData;
+            if (hal_obj != NULL) {
+                hal_obj->markFrameStage((uint32_t)resultFrameNumber,
+                        TIMELINE_STAGE_JPEG_END);
+            }
             int32_t rc = obj->mMemory.unregisterBuffer(bufIdx);
             if (NO_ERROR != rc) {
                 LOGE("Error %d unregistering stream buffer %d",
@@ -3505,8 +3800,12 @@ void QCamera3PicChannel::jpegEvtHandle(jpeg_job_status_t status,
                 int32_t metaBufIndex =
                         obj->mOfflineMetaMemory.getHeapBufferIndex((uint32_t)resultFrameNumber);
                 if (0 <= metaBufIndex) {
-                    Mutex::Autolock lock(obj->mFreeOfflineMetaBuffersLock);
-                    obj->mFreeOfflineMetaBuffersList.push_back((uint32_t)metaBufIndex);
+                    {
+                        Mutex::Autolock lock(obj->mFreeOfflineMetaBuffersLock);
+                        obj->mFreeOfflineMetaBuffersList.push_back(
+                                (uint32_t)metaBufIndex);
+                    }
+                    obj->m_postprocessor.offlineMetaBufFreed();
                 } else {
                     LOGE("could not find the input meta buf index, frame number %d",
                              resultFrameNumber);
@@ -3515,6 +3814,7 @@ void QCamera3PicChannel::jpegEvtHandle(jpeg_job_status_t status,
             obj->m_postprocessor.releaseOfflineBuffers(false);
             obj->m_postprocessor.releaseJpegJobData(job);
             free(job);
+            obj->m_postprocessor.jpegResultDone();
         }
 
         return;
@@ -3677,7 +3977,10 @@ int32_t QCamera3PicChannel::initialize(cam_is_type_t isType)
         return rc;
     }
 
-    mYuvMemory = new QCamera3StreamMem(mCamera3Stream->max_buffers);
+    // The buffers are kept when the stream is re-added to a kept channel
+    if (mYuvMemory == nullptr) {
+        mYuvMemory = new QCamera3StreamMem(mCamera3Stream->max_buffers);
+    }
     if (!mYuvMemory) {
         LOGE("unable to create YUV buffers");
         return NO_MEMORY;
@@ -3950,6 +4253,29 @@ void QCamera3PicChannel::streamCbRoutine(mm_camera_super_buf_t *super_frame,
     return;
 }
 
+/*===========================================================================
+ * FUNCTION   : releaseDroppedInput
+ *
+ * DESCRIPTION: give back the YUV frame of a postprocess job dropped by a
+ *              flush. Snapshot buffers are queued to kernel per request, so
+ *              the buffer goes back to the free list instead.
+ *
+ * PARAMETERS :
+ * @frame : input frame of the dropped job
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PicChannel::releaseDroppedInput(mm_camera_super_buf_t *frame)
+{
+    if ((NULL == frame) || (NULL == frame->bufs[0]) || (m_numStreams == 0) ||
+            (mStreams[0]->getMyHandle() != frame->bufs[0]->stream_id)) {
+        QCamera3ProcessingChannel::releaseDroppedInput(frame);
+        return;
+    }
+    Mutex::Autolock lock(mFreeBuffersLock);
+    mFreeBufferList.push_back(frame->bufs[0]->buf_idx);
+}
+
 QCamera3StreamMem* QCamera3PicChannel::getStreamBufs(uint32_t /*len*/)
 {
     return mYuvMemory;
@@ -5415,6 +5741,29 @@ QCamera3SupportChannel::~QCamera3SupportChannel()
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : isSameConfig
+ *
+ * DESCRIPTION: check whether the channel was created with the given stream
+ *              configuration, so that it can be kept across configureStreams
+ *
+ * PARAMETERS :
+ *   @streamType      : stream type
+ *   @dim             : stream dimension
+ *   @streamFormat    : stream format
+ *   @postprocessMask : post-process feature mask
+ *
+ * RETURN     : true if the configuration matches
+ *==========================================================================*/
+bool QCamera3SupportChannel::isSameConfig(cam_stream_type_t streamType,
+        const cam_dimension_t &dim, cam_format_t streamFormat,
+        cam_feature_mask_t postprocessMask) const
+{
+    return (mStreamType == streamType) && (mDim.width == dim.width) &&
+            (mDim.height == dim.height) && (mStreamFormat == streamFormat) &&
+            (mPostProcMask == postprocessMask);
+}
+
 int32_t QCamera3SupportChannel::initialize(cam_is_type_t isType)
 {
     int32_t rc;
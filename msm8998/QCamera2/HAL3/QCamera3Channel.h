@@ -31,6 +31,7 @@
 #define __QCAMERA3_CHANNEL_H__
 
 // System dependencies
+#include <utils/KeyedVector.h>
 #include <utils/List.h>
 #include <utils/Mutex.h>
 #include <utils/Vector.h>
@@ -119,6 +120,8 @@ public:
     virtual QCamera3StreamMem *getStreamBufs(uint32_t len) = 0;
     virtual void putStreamBufs() = 0;
     virtual int32_t flush();
+    int32_t cancelInflightBufs(nsecs_t deadline, uint32_t &cancelled);
+    int32_t waitInflightBufs(nsecs_t deadline);
 
     QCamera3Stream *getStreamByHandle(uint32_t streamHandle);
     uint32_t getMyHandle() const {return m_handle;};
@@ -135,9 +138,12 @@ public:
     static cam_format_t getStreamDefaultFormat(cam_stream_type_t type,
             uint32_t width, uint32_t height, bool forcePreviewUBWC, cam_is_type_t isType);
     virtual int32_t timeoutFrame(__unused uint32_t frameNumber) = 0;
+    virtual void waitForPostProcInputSpace(__unused bool reprocess) {};
+    virtual bool flushPostProcIfIdle() { return true; };
 
     void setNRMode(uint8_t nrMode) { mNRMode = nrMode; }
     uint8_t getNRMode() { return mNRMode; }
+    cam_is_type_t getIsType() const { return mIsType; }
 
     void *mUserData;
     cam_padding_info_t mPaddingInfo;
@@ -233,6 +239,7 @@ public:
 
     int32_t queueReprocMetadata(mm_camera_super_buf_t *metadata);
     virtual int32_t metadataBufDone(mm_camera_super_buf_t *recvd_frame);
+    virtual void releaseDroppedInput(mm_camera_super_buf_t *frame);
     int32_t translateStreamTypeAndFormat(camera3_stream_t *stream,
             cam_stream_type_t &streamType,
             cam_format_t &streamFormat);
@@ -246,16 +253,23 @@ public:
             metadata_buffer_t *metadata,
             buffer_handle_t *output_buffer,
             uint32_t frameNumber);
+    int32_t unshareMetadata(mm_camera_super_buf_t *metadata);
     int32_t checkStreamCbErrors(mm_camera_super_buf_t *super_frame,
             QCamera3Stream *stream);
     int32_t getStreamSize(cam_dimension_t &dim);
     virtual int32_t timeoutFrame(uint32_t frameNumber);
+    virtual void waitForPostProcInputSpace(bool reprocess)
+            { m_postprocessor.waitForInputSpace(reprocess); };
+    virtual bool flushPostProcIfIdle() { return m_postprocessor.flushIfIdle(); };
 
     QCamera3PostProcessor m_postprocessor; // post processor
     void showDebugFPS(int32_t streamType);
 
     int32_t releaseOfflineMemory(uint32_t resultFrameNumber);
 protected:
+    int32_t getFreeOfflineMetaBuf(uint32_t frameNumber,
+            mm_camera_buf_def_t &meta_buf);
+
     uint8_t mDebugFPS;
     int mFrameCount;
     int mLastFrameCount;
@@ -357,9 +371,19 @@ public:
 
     void enableDepthData(bool enable) { mDepthDataPresent = enable; }
 
+    int32_t holdBuf(mm_camera_super_buf_t *recvd_frame);
+    int32_t bufDone(mm_camera_super_buf_t *recvd_frame);
+    bool isBufShared(mm_camera_super_buf_t *recvd_frame);
+
 private:
+    bool isOwnBuf(mm_camera_super_buf_t *recvd_frame);
+
     QCamera3StreamMem *mMemory;
     bool mDepthDataPresent;
+    // Extra consumer references per metadata buffer index. The buffer is
+    // returned to the stream only when its last reference is released.
+    KeyedVector<uint32_t, uint32_t> mBufExtraRefs;
+    Mutex mBufRefLock;
 };
 
 /* QCamera3RawChannel is for opaqueu/cross-platform raw stream containing
@@ -564,6 +588,7 @@ public:
     virtual void putStreamBufs();
     virtual reprocess_type_t getReprocessType();
     virtual int32_t timeoutFrame(uint32_t frameNumber);
+    virtual void releaseDroppedInput(mm_camera_super_buf_t *frame);
 
     QCamera3Exif *getExifData(metadata_buffer_t *metadata,
             jpeg_settings_t *jpeg_settings);
@@ -720,6 +745,8 @@ public:
     virtual int32_t registerBuffer(buffer_handle_t * /*buffer*/, cam_is_type_t /*isType*/)
             { return NO_ERROR; };
     virtual int32_t timeoutFrame(__unused uint32_t frameNumber) {return NO_ERROR;};
+    bool isSameConfig(cam_stream_type_t streamType, const cam_dimension_t &dim,
+            cam_format_t streamFormat, cam_feature_mask_t postprocessMask) const;
 
     static cam_dimension_t kDim;
 private:
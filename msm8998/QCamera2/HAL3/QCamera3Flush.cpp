@@ -0,0 +1,477 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+// System dependencies
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <utils/Errors.h>
+
+// Camera dependencies
+#include "cam_cond.h"
+#include "QCamera3Flush.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCamera3InflightBufs
+ *
+ * DESCRIPTION: constructor of QCamera3InflightBufs
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3InflightBufs::QCamera3InflightBufs() :
+        mQueued(0),
+        mInCallback(0)
+{
+    pthread_mutex_init(&mLock, NULL);
+    PTHREAD_COND_INIT(&mCond);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3InflightBufs
+ *
+ * DESCRIPTION: destructor of QCamera3InflightBufs
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3InflightBufs::~QCamera3InflightBufs()
+{
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : onQueued
+ *
+ * DESCRIPTION: mark a buffer as handed to the backend
+ *
+ * PARAMETERS :
+ *   @index : stream buffer index
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3InflightBufs::onQueued(uint32_t index)
+{
+    if (index >= FLUSH_MAX_STREAM_BUFS) {
+        return;
+    }
+    pthread_mutex_lock(&mLock);
+    mQueued |= (1ULL << index);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : onReturned
+ *
+ * DESCRIPTION: move a buffer from the backend to the stream callback
+ *
+ * PARAMETERS :
+ *   @index : stream buffer index
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3InflightBufs::onReturned(uint32_t index)
+{
+    pthread_mutex_lock(&mLock);
+    if (index < FLUSH_MAX_STREAM_BUFS) {
+        mQueued &= ~(1ULL << index);
+    }
+    mInCallback++;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : onCallbackDone
+ *
+ * DESCRIPTION: the callback of a returned buffer finished
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3InflightBufs::onCallbackDone()
+{
+    pthread_mutex_lock(&mLock);
+    if (mInCallback > 0) {
+        mInCallback--;
+    }
+    signalIfDrainedLocked();
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : onDropped
+ *
+ * DESCRIPTION: forget a buffer that will not come back through a callback
+ *
+ * PARAMETERS :
+ *   @index : stream buffer index
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3InflightBufs::onDropped(uint32_t index)
+{
+    if (index >= FLUSH_MAX_STREAM_BUFS) {
+        return;
+    }
+    pthread_mutex_lock(&mLock);
+    mQueued &= ~(1ULL << index);
+    signalIfDrainedLocked();
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: forget all buffers, used once the stream is stopped
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3InflightBufs::reset()
+{
+    pthread_mutex_lock(&mLock);
+    mQueued = 0;
+    mInCallback = 0;
+    pthread_cond_broadcast(&mCond);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getQueuedMask
+ *
+ * DESCRIPTION: buffers handed to the backend and not returned yet
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : bit mask of stream buffer indices
+ *==========================================================================*/
+uint64_t QCamera3InflightBufs::getQueuedMask()
+{
+    pthread_mutex_lock(&mLock);
+    uint64_t queued = mQueued;
+    pthread_mutex_unlock(&mLock);
+    return queued;
+}
+
+/*===========================================================================
+ * FUNCTION   : getCount
+ *
+ * DESCRIPTION: number of buffers in flight, queued or in a callback
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : buffer count
+ *==========================================================================*/
+uint32_t QCamera3InflightBufs::getCount()
+{
+    pthread_mutex_lock(&mLock);
+    uint32_t count = (uint32_t)__builtin_popcountll(mQueued) + mInCallback;
+    pthread_mutex_unlock(&mLock);
+    return count;
+}
+
+/*===========================================================================
+ * FUNCTION   : waitDrained
+ *
+ * DESCRIPTION: wait until no buffer of the stream is in flight
+ *
+ * PARAMETERS :
+ *   @deadline : absolute systemTime() to give up at
+ *
+ * RETURN     : NO_ERROR  -- drained
+ *              TIMED_OUT -- buffers still in flight at the deadline
+ *==========================================================================*/
+int32_t QCamera3InflightBufs::waitDrained(nsecs_t deadline)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline / s2ns(1));
+    ts.tv_nsec = (long)(deadline % s2ns(1));
+
+    int32_t rc = NO_ERROR;
+    pthread_mutex_lock(&mLock);
+    while ((mQueued != 0) || (mInCallback != 0)) {
+        if (pthread_cond_timedwait(&mCond, &mLock, &ts) == ETIMEDOUT) {
+            if ((mQueued != 0) || (mInCallback != 0)) {
+                rc = TIMED_OUT;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : signalIfDrainedLocked
+ *
+ * DESCRIPTION: wake up waitDrained once nothing is in flight. mLock is held
+ *              by the caller.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3InflightBufs::signalIfDrainedLocked()
+{
+    if ((mQueued == 0) && (mInCallback == 0)) {
+        pthread_cond_broadcast(&mCond);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : QCamera3FlushHold
+ *
+ * DESCRIPTION: constructor of QCamera3FlushHold
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3FlushHold::QCamera3FlushHold() :
+        mHeld(false)
+{
+    PTHREAD_COND_INIT(&mCond);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3FlushHold
+ *
+ * DESCRIPTION: destructor of QCamera3FlushHold
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3FlushHold::~QCamera3FlushHold()
+{
+    pthread_cond_destroy(&mCond);
+}
+
+/*===========================================================================
+ * FUNCTION   : release
+ *
+ * DESCRIPTION: end the hold and wake up every parked request. The HAL lock
+ *              is held by the caller.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushHold::release()
+{
+    mHeld = false;
+    pthread_cond_broadcast(&mCond);
+}
+
+/*===========================================================================
+ * FUNCTION   : waitWhileHeld
+ *
+ * DESCRIPTION: park the calling request until the hold is released
+ *
+ * PARAMETERS :
+ *   @lock : HAL lock held by the caller
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushHold::waitWhileHeld(pthread_mutex_t *lock)
+{
+    while (mHeld) {
+        pthread_cond_wait(&mCond, lock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : QCamera3FlushStats
+ *
+ * DESCRIPTION: constructor of QCamera3FlushStats
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3FlushStats::QCamera3FlushStats() :
+        mStartNs(0),
+        mLastStartNs(0),
+        mLastPath(FLUSH_PATH_FULL),
+        mFrameArmed(false)
+{
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+/*===========================================================================
+ * FUNCTION   : onFlushStart
+ *
+ * DESCRIPTION: note the start of a flush
+ *
+ * PARAMETERS :
+ *   @now : systemTime() of the flush call
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushStats::onFlushStart(nsecs_t now)
+{
+    if (mStartNs == 0) {
+        mStartNs = now;
+    }
+    mFrameArmed = false;
+}
+
+/*===========================================================================
+ * FUNCTION   : onFallback
+ *
+ * DESCRIPTION: a fast flush could not complete and continues as a full
+ *              flush
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushStats::onFallback()
+{
+    mStats.fallbacks++;
+}
+
+/*===========================================================================
+ * FUNCTION   : onFlushDone
+ *
+ * DESCRIPTION: record a finished flush and start waiting for the first new
+ *              frame
+ *
+ * PARAMETERS :
+ *   @path     : flush path that completed the flush
+ *   @recalled : buffers recalled from the backend
+ *   @now      : systemTime() at completion
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushStats::onFlushDone(flush_path_t path, uint32_t recalled,
+        nsecs_t now)
+{
+    if ((path >= FLUSH_PATH_MAX) || (mStartNs == 0)) {
+        return;
+    }
+    nsecs_t elapsed = now - mStartNs;
+    mStats.count[path]++;
+    mStats.recalled += recalled;
+    mStats.lastNs[path] = elapsed;
+    mStats.totalNs[path] += elapsed;
+    if (elapsed > mStats.maxNs[path]) {
+        mStats.maxNs[path] = elapsed;
+    }
+    mLastStartNs = mStartNs;
+    mLastPath = path;
+    mStartNs = 0;
+    mFrameArmed = true;
+}
+
+/*===========================================================================
+ * FUNCTION   : onFrame
+ *
+ * DESCRIPTION: record the first new frame after a flush
+ *
+ * PARAMETERS :
+ *   @now : systemTime() the buffer came back
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushStats::onFrame(nsecs_t now)
+{
+    if (!mFrameArmed) {
+        return;
+    }
+    nsecs_t elapsed = now - mLastStartNs;
+    mStats.frames[mLastPath]++;
+    mStats.lastFrameNs[mLastPath] = elapsed;
+    mStats.totalFrameNs[mLastPath] += elapsed;
+    if (elapsed > mStats.maxFrameNs[mLastPath]) {
+        mStats.maxFrameNs[mLastPath] = elapsed;
+    }
+    mFrameArmed = false;
+}
+
+/*===========================================================================
+ * FUNCTION   : getStats
+ *
+ * DESCRIPTION: copy out the flush statistics
+ *
+ * PARAMETERS :
+ *   @stats : filled with the current values
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushStats::getStats(flush_stats_t &stats) const
+{
+    stats = mStats;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print the flush statistics
+ *
+ * PARAMETERS :
+ *   @fd : file descriptor to print to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FlushStats::dump(int fd) const
+{
+    static const char *pathNames[FLUSH_PATH_MAX] = { "fast", "full" };
+
+    dprintf(fd, "\nFlush: fallbacks %" PRIu64 ", recalled buffers %" PRIu64 "\n",
+            mStats.fallbacks, mStats.recalled);
+    dprintf(fd, "------+--------+-------------------------+-------------------------\n");
+    dprintf(fd, " Path |  Count |  Flush last/avg/max us  |  Frame last/avg/max us  \n");
+    dprintf(fd, "------+--------+-------------------------+-------------------------\n");
+    for (uint32_t p = 0; p < FLUSH_PATH_MAX; p++) {
+        nsecs_t avg = (mStats.count[p] > 0) ?
+                (nsecs_t)(mStats.totalNs[p] / (nsecs_t)mStats.count[p]) : 0;
+        nsecs_t frameAvg = (mStats.frames[p] > 0) ?
+                (nsecs_t)(mStats.totalFrameNs[p] / (nsecs_t)mStats.frames[p]) : 0;
+        dprintf(fd, " %4s | %6" PRIu64 " | %7lld %7lld %7lld | %7lld %7lld %7lld\n",
+                pathNames[p], mStats.count[p],
+                (long long)ns2us(mStats.lastNs[p]), (long long)ns2us(avg),
+                (long long)ns2us(mStats.maxNs[p]),
+                (long long)ns2us(mStats.lastFrameNs[p]), (long long)ns2us(frameAvg),
+                (long long)ns2us(mStats.maxFrameNs[p]));
+    }
+    dprintf(fd, "------+--------+-------------------------+-------------------------\n");
+}
+
+}; // namespace qcamera
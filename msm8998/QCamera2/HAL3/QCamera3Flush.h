@@ -0,0 +1,162 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3FLUSH_H__
+#define __QCAMERA3FLUSH_H__
+
+// System dependencies
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+// Buffers a stream can track, one bit each. Matches
+// CAM_MAX_NUM_BUFS_PER_STREAM.
+#define FLUSH_MAX_STREAM_BUFS     64
+
+/*
+ * QCamera3InflightBufs keeps track of the buffers of one stream that have
+ * been handed to the backend and not yet come back through the stream
+ * callback. A buffer is in flight from bufDone until the channel callback
+ * for its frame returns, including the time it waits for a late mapping or
+ * in the stream data queue. Flush recalls the queued buffers and waits here
+ * for the stream to drain, instead of stopping it.
+ *
+ * Thread safe, the updates come from the stream, map and callback threads.
+ */
+class QCamera3InflightBufs {
+public:
+    QCamera3InflightBufs();
+    ~QCamera3InflightBufs();
+
+    // Buffer accepted by the stream on its way to the backend.
+    void onQueued(uint32_t index);
+    // Buffer back from the backend, its callback is about to run.
+    void onReturned(uint32_t index);
+    // Callback for a returned buffer finished.
+    void onCallbackDone();
+    // Buffer lost on the way to the backend, no callback will follow.
+    void onDropped(uint32_t index);
+    // Stream stopped, the backend returned everything.
+    void reset();
+
+    uint64_t getQueuedMask();
+    uint32_t getCount();
+    // Wait until nothing is in flight, or the absolute systemTime() deadline.
+    // NO_ERROR when drained, TIMED_OUT otherwise.
+    int32_t waitDrained(nsecs_t deadline);
+
+private:
+    void signalIfDrainedLocked();
+
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    uint64_t mQueued;       // bit per buffer handed to the backend
+    uint32_t mInCallback;   // returned buffers whose callback is running
+};
+
+/*
+ * QCamera3FlushHold parks new capture requests while a fast flush runs with
+ * the streams on. The HAL calls it with mMutex held, and a parked request
+ * gives up mMutex while it waits. Every way out of a fast flush, including
+ * the fallbacks to a full flush, ends with release(), which wakes all parked
+ * requests.
+ */
+class QCamera3FlushHold {
+public:
+    QCamera3FlushHold();
+    ~QCamera3FlushHold();
+
+    void hold() { mHeld = true; }
+    void release();
+    bool isHeld() const { return mHeld; }
+    // Wait until the hold is released. 'lock' is the HAL lock held by the
+    // caller, it is dropped while waiting.
+    void waitWhileHeld(pthread_mutex_t *lock);
+
+private:
+    bool mHeld;
+    pthread_cond_t mCond;
+};
+
+typedef enum {
+    FLUSH_PATH_FAST,    // per stream recall, streams keep running
+    FLUSH_PATH_FULL,    // stop and restart of all channels
+    FLUSH_PATH_MAX
+} flush_path_t;
+
+typedef struct {
+    uint64_t count[FLUSH_PATH_MAX];
+    uint64_t fallbacks;             // fast flushes finished by a full flush
+    uint64_t recalled;              // buffers recalled by fast flushes
+    nsecs_t lastNs[FLUSH_PATH_MAX];
+    nsecs_t maxNs[FLUSH_PATH_MAX];
+    nsecs_t totalNs[FLUSH_PATH_MAX];
+    // Flush start to the first buffer of a request sent after the flush.
+    uint64_t frames[FLUSH_PATH_MAX];
+    nsecs_t lastFrameNs[FLUSH_PATH_MAX];
+    nsecs_t maxFrameNs[FLUSH_PATH_MAX];
+    nsecs_t totalFrameNs[FLUSH_PATH_MAX];
+} flush_stats_t;
+
+/*
+ * QCamera3FlushStats records the flush latency of each flush path and the
+ * time from a flush to the first new frame. Not thread safe, the HAL calls
+ * it with mMutex held.
+ */
+class QCamera3FlushStats {
+public:
+    QCamera3FlushStats();
+
+    // Flush entered at 'now'. A flush already in progress keeps its start,
+    // so a fast flush that falls back is timed as a whole.
+    void onFlushStart(nsecs_t now);
+    bool inFlush() const { return mStartNs != 0; }
+    void onFallback();
+    void onFlushDone(flush_path_t path, uint32_t recalled, nsecs_t now);
+    bool awaitingFrame() const { return mFrameArmed; }
+    // Buffer of a new request came back, only the first one after a flush
+    // is recorded.
+    void onFrame(nsecs_t now);
+
+    void getStats(flush_stats_t &stats) const;
+    void dump(int fd) const;
+
+private:
+    nsecs_t mStartNs;       // 0 while no flush is running
+    nsecs_t mLastStartNs;   // start of the last finished flush
+    flush_path_t mLastPath;
+    bool mFrameArmed;
+    flush_stats_t mStats;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3FLUSH_H__ */
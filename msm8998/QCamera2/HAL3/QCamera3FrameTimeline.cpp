@@ -0,0 +1,547 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#define LOG_TAG "QCamera3FrameTimeline"
+
+// System dependencies
+#include <inttypes.h>
+#include <stdio.h>
+#include "gralloc_priv.h"
+
+// Camera dependencies
+#include "QCamera3FrameTimeline.h"
+
+extern "C" {
+#include "mm_camera_dbg.h"
+}
+
+using namespace android;
+
+namespace qcamera {
+
+#define TIMELINE_INVALID_FRAME UINT32_MAX
+
+static const char *kStageNames[TIMELINE_STAGE_MAX] = {
+    "Request",
+    "Settings",
+    "Shutter",
+    "Metadata",
+    "Reprocess start",
+    "Reprocess end",
+    "JPEG start",
+    "JPEG end",
+    "Result",
+};
+
+static const char *kStreamNames[TIMELINE_STREAM_MAX] = {
+    "Preview buffer",
+    "Video buffer",
+    "Callback buffer",
+    "JPEG buffer",
+    "RAW buffer",
+    "Other buffer",
+};
+
+/*===========================================================================
+ * FUNCTION   : bucketOf
+ *
+ * DESCRIPTION: Map a latency to its histogram bucket. Values below
+ *              TIMELINE_HIST_SUB_BUCKETS get a bucket each, larger values
+ *              are split by their top bit and the next
+ *              TIMELINE_HIST_SUB_BITS bits.
+ *
+ * PARAMETERS :
+ *   @us      : latency in microseconds
+ *
+ * RETURN     : bucket index, less than TIMELINE_HIST_BUCKETS
+ *==========================================================================*/
+uint32_t LatencyHistogram::bucketOf(uint32_t us)
+{
+    if (us < TIMELINE_HIST_SUB_BUCKETS) {
+        return us;
+    }
+    uint32_t msb = 31 - (uint32_t)__builtin_clz(us);
+    uint32_t shift = msb - TIMELINE_HIST_SUB_BITS;
+    uint32_t sub = (us >> shift) & (TIMELINE_HIST_SUB_BUCKETS - 1);
+    return (shift + 1) * TIMELINE_HIST_SUB_BUCKETS + sub;
+}
+
+/*===========================================================================
+ * FUNCTION   : bucketUpperUs
+ *
+ * DESCRIPTION: Largest latency that falls in a bucket
+ *
+ * PARAMETERS :
+ *   @bucket  : bucket index
+ *
+ * RETURN     : latency in microseconds
+ *==========================================================================*/
+uint32_t LatencyHistogram::bucketUpperUs(uint32_t bucket)
+{
+    if (bucket < TIMELINE_HIST_SUB_BUCKETS) {
+        return bucket;
+    }
+    uint32_t shift = bucket / TIMELINE_HIST_SUB_BUCKETS - 1;
+    uint64_t sub = bucket % TIMELINE_HIST_SUB_BUCKETS;
+    uint64_t upper = ((TIMELINE_HIST_SUB_BUCKETS + sub + 1) << shift) - 1;
+    return (upper > UINT32_MAX) ? UINT32_MAX : (uint32_t)upper;
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: Clear all samples
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void LatencyHistogram::reset()
+{
+    for (uint32_t i = 0; i < TIMELINE_HIST_BUCKETS; i++) {
+        mBuckets[i].store(0, std::memory_order_relaxed);
+    }
+    mCount.store(0, std::memory_order_relaxed);
+    mMaxUs.store(0, std::memory_order_relaxed);
+}
+
+/*===========================================================================
+ * FUNCTION   : record
+ *
+ * DESCRIPTION: Add one sample
+ *
+ * PARAMETERS :
+ *   @ns      : latency in nanoseconds. Negative values count as zero.
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void LatencyHistogram::record(nsecs_t ns)
+{
+    uint32_t us = 0;
+    if (ns > 0) {
+        us = (ns / 1000 > UINT32_MAX) ? UINT32_MAX : (uint32_t)(ns / 1000);
+    }
+
+    mBuckets[bucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t max = mMaxUs.load(std::memory_order_relaxed);
+    while ((us > max) && !mMaxUs.compare_exchange_weak(max, us,
+            std::memory_order_relaxed)) {
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : percentile
+ *
+ * DESCRIPTION: Upper bound of the bucket holding the given percentile,
+ *              clamped to the largest recorded sample
+ *
+ * PARAMETERS :
+ *   @fraction : percentile as a fraction, e.g. 0.999 for p99.9
+ *
+ * RETURN     : latency in microseconds, 0 if there are no samples
+ *==========================================================================*/
+uint32_t LatencyHistogram::percentile(double fraction) const
+{
+    uint64_t total = 0;
+    uint32_t counts[TIMELINE_HIST_BUCKETS];
+
+    // Sum the buckets rather than using mCount so the walk is consistent
+    // with the snapshot even if samples are being added.
+    for (uint32_t i = 0; i < TIMELINE_HIST_BUCKETS; i++) {
+        counts[i] = mBuckets[i].load(std::memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(fraction * (double)total + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    uint32_t max = maxUs();
+    for (uint32_t i = 0; i < TIMELINE_HIST_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint32_t upper = bucketUpperUs(i);
+            return (upper < max) ? upper : max;
+        }
+    }
+    return max;
+}
+
+/*===========================================================================
+ * FUNCTION   : QCamera3FrameTimeline
+ *
+ * DESCRIPTION: Constructor
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3FrameTimeline::QCamera3FrameTimeline()
+        : mEnabled(true),
+          mCompleted(0),
+          mErrored(0),
+          mOverwritten(0)
+{
+    for (uint32_t i = 0; i < TIMELINE_MAX_FRAMES; i++) {
+        mSlots[i].frameNumber.store(TIMELINE_INVALID_FRAME);
+        mSlots[i].outstanding.store(0);
+        mSlots[i].errored.store(false);
+        for (uint32_t s = 0; s < TIMELINE_STAGE_MAX; s++) {
+            mSlots[i].ts[s].store(0);
+        }
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : streamTypeOf
+ *
+ * DESCRIPTION: Classify a framework stream for the per stream histograms
+ *
+ * PARAMETERS :
+ *   @stream  : framework stream
+ *
+ * RETURN     : timeline_stream_t
+ *==========================================================================*/
+timeline_stream_t QCamera3FrameTimeline::streamTypeOf(
+        const camera3_stream_t *stream)
+{
+    if (stream == NULL) {
+        return TIMELINE_STREAM_OTHER;
+    }
+
+    switch (stream->format) {
+    case HAL_PIXEL_FORMAT_BLOB:
+        return TIMELINE_STREAM_JPEG;
+    case HAL_PIXEL_FORMAT_RAW_OPAQUE:
+    case HAL_PIXEL_FORMAT_RAW10:
+    case HAL_PIXEL_FORMAT_RAW12:
+    case HAL_PIXEL_FORMAT_RAW16:
+        return TIMELINE_STREAM_RAW;
+    case HAL_PIXEL_FORMAT_YCbCr_420_888:
+        return TIMELINE_STREAM_CALLBACK;
+    case HAL_PIXEL_FORMAT_IMPLEMENTATION_DEFINED:
+        if (stream->usage & GRALLOC_USAGE_HW_VIDEO_ENCODER) {
+            return TIMELINE_STREAM_VIDEO;
+        }
+        if (stream->usage & (GRALLOC_USAGE_HW_COMPOSER |
+                GRALLOC_USAGE_HW_TEXTURE)) {
+            return TIMELINE_STREAM_PREVIEW;
+        }
+        return TIMELINE_STREAM_OTHER;
+    default:
+        return TIMELINE_STREAM_OTHER;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : slotFor
+ *
+ * DESCRIPTION: Find the table slot tracking a frame
+ *
+ * PARAMETERS :
+ *   @frameNumber : internal frame number
+ *
+ * RETURN     : slot, or NULL if the frame is not tracked (disabled, already
+ *              completed or overwritten)
+ *==========================================================================*/
+QCamera3FrameTimeline::FrameSlot *QCamera3FrameTimeline::slotFor(
+        uint32_t frameNumber)
+{
+    if (!mEnabled) {
+        return NULL;
+    }
+    FrameSlot *slot = &mSlots[frameNumber % TIMELINE_MAX_FRAMES];
+    if (slot->frameNumber.load(std::memory_order_acquire) != frameNumber) {
+        return NULL;
+    }
+    return slot;
+}
+
+/*===========================================================================
+ * FUNCTION   : begin
+ *
+ * DESCRIPTION: Start tracking a request once it has been accepted
+ *
+ * PARAMETERS :
+ *   @frameNumber : internal frame number
+ *   @requestNs   : time process_capture_request was entered
+ *   @numBuffers  : number of output buffers in the request
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::begin(uint32_t frameNumber, nsecs_t requestNs,
+        uint32_t numBuffers)
+{
+    if (!mEnabled) {
+        return;
+    }
+
+    FrameSlot *slot = &mSlots[frameNumber % TIMELINE_MAX_FRAMES];
+    // Retire the previous occupant before touching its timestamps so a late
+    // result for it can no longer find the slot.
+    uint32_t prev = slot->frameNumber.exchange(TIMELINE_INVALID_FRAME,
+            std::memory_order_acq_rel);
+    if ((prev != TIMELINE_INVALID_FRAME) &&
+            (slot->outstanding.load(std::memory_order_relaxed) > 0)) {
+        mOverwritten.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    for (uint32_t s = 0; s < TIMELINE_STAGE_MAX; s++) {
+        slot->ts[s].store(0, std::memory_order_relaxed);
+    }
+    slot->ts[TIMELINE_STAGE_REQUEST].store(requestNs, std::memory_order_relaxed);
+    slot->errored.store(false, std::memory_order_relaxed);
+    // Every output buffer plus the final metadata.
+    slot->outstanding.store((int32_t)numBuffers + 1, std::memory_order_relaxed);
+    slot->frameNumber.store(frameNumber, std::memory_order_release);
+}
+
+/*===========================================================================
+ * FUNCTION   : mark
+ *
+ * DESCRIPTION: Record the time a frame reached a stage
+ *
+ * PARAMETERS :
+ *   @frameNumber : internal frame number
+ *   @stage       : stage reached
+ *   @ns          : time of the event, 0 for now
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::mark(uint32_t frameNumber, timeline_stage_t stage,
+        nsecs_t ns)
+{
+    FrameSlot *slot = slotFor(frameNumber);
+    if ((slot == NULL) || (stage >= TIMELINE_STAGE_MAX)) {
+        return;
+    }
+    slot->ts[stage].store((ns != 0) ? ns : systemTime(),
+            std::memory_order_relaxed);
+}
+
+/*===========================================================================
+ * FUNCTION   : bufferDone
+ *
+ * DESCRIPTION: Record an output buffer being sent to the framework
+ *
+ * PARAMETERS :
+ *   @frameNumber : internal frame number
+ *   @stream      : stream the buffer belongs to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::bufferDone(uint32_t frameNumber,
+        const camera3_stream_t *stream)
+{
+    FrameSlot *slot = slotFor(frameNumber);
+    if (slot == NULL) {
+        return;
+    }
+    nsecs_t start = slot->ts[TIMELINE_STAGE_REQUEST].load(
+            std::memory_order_relaxed);
+    mStreamHist[streamTypeOf(stream)].record(systemTime() - start);
+    complete(frameNumber);
+}
+
+/*===========================================================================
+ * FUNCTION   : metadataDone
+ *
+ * DESCRIPTION: Record the final result metadata being sent to the framework
+ *
+ * PARAMETERS :
+ *   @frameNumber : internal frame number
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::metadataDone(uint32_t frameNumber)
+{
+    mark(frameNumber, TIMELINE_STAGE_METADATA);
+    complete(frameNumber);
+}
+
+/*===========================================================================
+ * FUNCTION   : error
+ *
+ * DESCRIPTION: Record an error notify for a frame. The frame is not folded
+ *              into the histograms. Request and result errors stand in for
+ *              the final metadata.
+ *
+ * PARAMETERS :
+ *   @frameNumber : internal frame number
+ *   @errorCode   : camera3_error_msg_code
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::error(uint32_t frameNumber, int errorCode)
+{
+    FrameSlot *slot = slotFor(frameNumber);
+    if (slot == NULL) {
+        return;
+    }
+    slot->errored.store(true, std::memory_order_relaxed);
+    if ((errorCode == CAMERA3_MSG_ERROR_REQUEST) ||
+            (errorCode == CAMERA3_MSG_ERROR_RESULT)) {
+        complete(frameNumber);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : complete
+ *
+ * DESCRIPTION: Count down one outstanding result of a frame and finish the
+ *              frame on the last one
+ *
+ * PARAMETERS :
+ *   @frameNumber : internal frame number
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::complete(uint32_t frameNumber)
+{
+    FrameSlot *slot = slotFor(frameNumber);
+    if (slot == NULL) {
+        return;
+    }
+    if (slot->outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        finish(slot);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : finish
+ *
+ * DESCRIPTION: Fold a completed frame into the histograms and free its slot
+ *
+ * PARAMETERS :
+ *   @slot    : slot of the frame
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::finish(FrameSlot *slot)
+{
+    nsecs_t ts[TIMELINE_STAGE_MAX];
+
+    slot->ts[TIMELINE_STAGE_RESULT].store(systemTime(),
+            std::memory_order_relaxed);
+    for (uint32_t s = 0; s < TIMELINE_STAGE_MAX; s++) {
+        ts[s] = slot->ts[s].load(std::memory_order_relaxed);
+    }
+    bool errored = slot->errored.load(std::memory_order_relaxed);
+    slot->frameNumber.store(TIMELINE_INVALID_FRAME, std::memory_order_release);
+
+    if (errored) {
+        mErrored.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    nsecs_t start = ts[TIMELINE_STAGE_REQUEST];
+    for (uint32_t s = TIMELINE_STAGE_REQUEST + 1; s < TIMELINE_STAGE_MAX; s++) {
+        if (ts[s] != 0) {
+            mStageHist[s].record(ts[s] - start);
+        }
+    }
+    if ((ts[TIMELINE_STAGE_REPROC_START] != 0) &&
+            (ts[TIMELINE_STAGE_REPROC_END] != 0)) {
+        mReprocHist.record(ts[TIMELINE_STAGE_REPROC_END] -
+                ts[TIMELINE_STAGE_REPROC_START]);
+    }
+    if ((ts[TIMELINE_STAGE_JPEG_START] != 0) &&
+            (ts[TIMELINE_STAGE_JPEG_END] != 0)) {
+        mJpegHist.record(ts[TIMELINE_STAGE_JPEG_END] -
+                ts[TIMELINE_STAGE_JPEG_START]);
+    }
+    mCompleted.fetch_add(1, std::memory_order_relaxed);
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpRow
+ *
+ * DESCRIPTION: Print one histogram as a row of the latency table
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *   @name    : row label
+ *   @hist    : histogram
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void dumpRow(int fd, const char *name, const LatencyHistogram &hist)
+{
+    dprintf(fd, " %-16s | %8" PRIu64 " | %8u | %8u | %8u | %8u | %8u\n",
+            name, hist.count(), hist.percentile(0.5), hist.percentile(0.9),
+            hist.percentile(0.99), hist.percentile(0.999), hist.maxUs());
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: Print the latency tables in dumpsys format
+ *
+ * PARAMETERS :
+ *   @fd      : file descriptor
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3FrameTimeline::dump(int fd)
+{
+    if (!mEnabled) {
+        dprintf(fd, "\nPer-frame latency timeline disabled\n");
+        return;
+    }
+
+    dprintf(fd, "\nPer-frame latency (us from process_capture_request)\n");
+    dprintf(fd, "Frames completed: %" PRIu64 ", errored: %" PRIu64
+            ", overwritten: %" PRIu64 "\n",
+            mCompleted.load(std::memory_order_relaxed),
+            mErrored.load(std::memory_order_relaxed),
+            mOverwritten.load(std::memory_order_relaxed));
+    dprintf(fd, "------------------+----------+----------+----------+----------+----------+----------\n");
+    dprintf(fd, " Stage            |    Count |      p50 |      p90 |      p99 |    p99.9 |      Max\n");
+    dprintf(fd, "------------------+----------+----------+----------+----------+----------+----------\n");
+    for (uint32_t s = TIMELINE_STAGE_REQUEST + 1; s < TIMELINE_STAGE_MAX; s++) {
+        dumpRow(fd, kStageNames[s], mStageHist[s]);
+    }
+    dprintf(fd, "------------------+----------+----------+----------+----------+----------+----------\n");
+    for (uint32_t t = 0; t < TIMELINE_STREAM_MAX; t++) {
+        dumpRow(fd, kStreamNames[t], mStreamHist[t]);
+    }
+    dprintf(fd, "------------------+----------+----------+----------+----------+----------+----------\n");
+    dprintf(fd, " Durations (us)\n");
+    dumpRow(fd, "Reprocess", mReprocHist);
+    dumpRow(fd, "JPEG encode", mJpegHist);
+    dprintf(fd, "------------------+----------+----------+----------+----------+----------+----------\n");
+}
+
+}; // namespace qcamera
@@ -0,0 +1,155 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3FRAMETIMELINE_H__
+#define __QCAMERA3FRAMETIMELINE_H__
+
+// System dependencies
+#include <atomic>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+// Camera dependencies
+#include "hardware/camera3.h"
+
+using namespace android;
+
+namespace qcamera {
+
+typedef enum {
+    TIMELINE_STAGE_REQUEST,      // process_capture_request entry
+    TIMELINE_STAGE_SETTINGS,     // request settings translated to HAL parameters
+    TIMELINE_STAGE_SHUTTER,      // shutter notify sent
+    TIMELINE_STAGE_METADATA,     // final result metadata sent
+    TIMELINE_STAGE_REPROC_START, // framework reprocess queued
+    TIMELINE_STAGE_REPROC_END,   // reprocessed frame received
+    TIMELINE_STAGE_JPEG_START,   // JPEG encode job started
+    TIMELINE_STAGE_JPEG_END,     // JPEG encode job done
+    TIMELINE_STAGE_RESULT,       // last buffer or metadata of the frame sent
+    TIMELINE_STAGE_MAX
+} timeline_stage_t;
+
+typedef enum {
+    TIMELINE_STREAM_PREVIEW,
+    TIMELINE_STREAM_VIDEO,
+    TIMELINE_STREAM_CALLBACK,
+    TIMELINE_STREAM_JPEG,
+    TIMELINE_STREAM_RAW,
+    TIMELINE_STREAM_OTHER,
+    TIMELINE_STREAM_MAX
+} timeline_stream_t;
+
+/*
+ * Log-linear latency histogram in microseconds. Each power of two is split
+ * into TIMELINE_HIST_SUB_BUCKETS buckets, so a reported percentile is within
+ * 12.5% of the recorded value. Updates are lock-free and may come from any
+ * thread; a read taken while updates are in flight may be off by a sample.
+ */
+#define TIMELINE_HIST_SUB_BITS    3
+#define TIMELINE_HIST_SUB_BUCKETS (1 << TIMELINE_HIST_SUB_BITS)
+#define TIMELINE_HIST_BUCKETS     ((32 - TIMELINE_HIST_SUB_BITS + 1) * \
+        TIMELINE_HIST_SUB_BUCKETS)
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() { reset(); }
+
+    void record(nsecs_t ns);
+    void reset();
+    uint64_t count() const { return mCount.load(std::memory_order_relaxed); }
+    uint32_t maxUs() const { return mMaxUs.load(std::memory_order_relaxed); }
+    // Value in us below which the given fraction (0..1] of the samples fall.
+    uint32_t percentile(double fraction) const;
+
+    static uint32_t bucketOf(uint32_t us);
+    static uint32_t bucketUpperUs(uint32_t bucket);
+
+private:
+    std::atomic<uint32_t> mBuckets[TIMELINE_HIST_BUCKETS];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint32_t> mMaxUs;
+};
+
+/*
+ * QCamera3FrameTimeline records when each capture request passes the stages
+ * in timeline_stage_t and folds completed frames into latency histograms per
+ * stage and per output stream type, all relative to process_capture_request
+ * entry.
+ *
+ * Frames are kept in a fixed table indexed by frame number modulo
+ * TIMELINE_MAX_FRAMES. A frame completes when all its output buffers and its
+ * final metadata have been sent. A frame whose slot is reused before it
+ * completes is counted as overwritten and not folded in. Every entry point is
+ * lock-free so it can be called from the result and post processing threads
+ * without adding to mMutex contention.
+ */
+#define TIMELINE_MAX_FRAMES 128
+
+class QCamera3FrameTimeline {
+public:
+    QCamera3FrameTimeline();
+
+    void setEnabled(bool enabled) { mEnabled = enabled; }
+    bool isEnabled() const { return mEnabled; }
+
+    void begin(uint32_t frameNumber, nsecs_t requestNs, uint32_t numBuffers);
+    void mark(uint32_t frameNumber, timeline_stage_t stage, nsecs_t ns = 0);
+    void bufferDone(uint32_t frameNumber, const camera3_stream_t *stream);
+    void metadataDone(uint32_t frameNumber);
+    void error(uint32_t frameNumber, int errorCode);
+    void dump(int fd);
+
+    static timeline_stream_t streamTypeOf(const camera3_stream_t *stream);
+
+private:
+    struct FrameSlot {
+        std::atomic<uint32_t> frameNumber;
+        std::atomic<int32_t> outstanding;
+        std::atomic<bool> errored;
+        std::atomic<nsecs_t> ts[TIMELINE_STAGE_MAX];
+    };
+
+    FrameSlot *slotFor(uint32_t frameNumber);
+    void complete(uint32_t frameNumber);
+    void finish(FrameSlot *slot);
+
+    bool mEnabled;
+    FrameSlot mSlots[TIMELINE_MAX_FRAMES];
+    LatencyHistogram mStageHist[TIMELINE_STAGE_MAX];
+    LatencyHistogram mStreamHist[TIMELINE_STREAM_MAX];
+    LatencyHistogram mReprocHist;
+    LatencyHistogram mJpegHist;
+    std::atomic<uint64_t> mCompleted;
+    std::atomic<uint64_t> mErrored;
+    std::atomic<uint64_t> mOverwritten;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3FRAMETIMELINE_H__ */
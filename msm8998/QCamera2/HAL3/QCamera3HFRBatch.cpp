@@ -0,0 +1,419 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+// System dependencies
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Camera dependencies
+#include "QCamera3HFRBatch.h"
+
+namespace qcamera {
+
+// Request interval samples are capped at this many batch windows, so one
+// long stall does not keep the target at 1 for long after it ends.
+#define HFR_BATCH_MAX_INTERVAL_WINDOWS  4
+// Automatic return latency budget, in batch windows.
+#define HFR_BATCH_LATENCY_WINDOWS       4
+// Automatic deadline, in nominal fill times of the target batch.
+#define HFR_BATCH_DEADLINE_FILLS        2
+// Both EWMAs move by 1/2^HFR_BATCH_EWMA_SHIFT of the error per sample.
+#define HFR_BATCH_EWMA_SHIFT            2
+
+/*===========================================================================
+ * FUNCTION   : QCamera3HFRBatch
+ *
+ * DESCRIPTION: constructor of QCamera3HFRBatch. Batching is disabled until
+ *              configure() is called with a batch size.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3HFRBatch::QCamera3HFRBatch() :
+        mDynamic(true),
+        mDeadlineCfg(0),
+        mLatencyBudgetCfg(0),
+        mMaxBatch(1),
+        mFps(1)
+{
+    configure(0, 0);
+}
+
+/*===========================================================================
+ * FUNCTION   : setTunables
+ *
+ * DESCRIPTION: set the dynamic mode and its limits. Takes effect with the
+ *              next batch.
+ *
+ * PARAMETERS :
+ *   @dynamic       : adapt the batch size and flush on deadline
+ *   @deadline      : open batch lifetime, 0 for automatic
+ *   @latencyBudget : return latency above which the batch shrinks, 0 for
+ *                    automatic
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::setTunables(bool dynamic, nsecs_t deadline,
+        nsecs_t latencyBudget)
+{
+    mDynamic = dynamic;
+    mDeadlineCfg = deadline;
+    mLatencyBudgetCfg = latencyBudget;
+}
+
+/*===========================================================================
+ * FUNCTION   : configure
+ *
+ * DESCRIPTION: set the configured batch size and sensor fps of the session
+ *
+ * PARAMETERS :
+ *   @maxBatch : batch size derived from the fps, 0 when not batching
+ *   @fps      : sensor fps in high speed mode
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::configure(uint32_t maxBatch, uint32_t fps)
+{
+    if (maxBatch > HFR_BATCH_MAX_FRAMES) {
+        maxBatch = HFR_BATCH_MAX_FRAMES;
+    }
+    if ((maxBatch == mMaxBatch) && (fps == mFps)) {
+        return;
+    }
+
+    mMaxBatch = maxBatch;
+    mFps = fps;
+    mFrameInterval = (fps > 0) ? (s2ns(1) / fps) : 0;
+    mTarget = maxBatch;
+    mLatencyCap = maxBatch;
+    mRequestInterval = 0;
+    mReturnLatency = 0;
+    mOpenNs = 0;
+    mLastOpenNs = 0;
+    mLastFill = 0;
+    memset(mInflight, 0, sizeof(mInflight));
+    mInflightHead = 0;
+    resetStats();
+}
+
+/*===========================================================================
+ * FUNCTION   : resetStats
+ *
+ * DESCRIPTION: clear the counters and histograms
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::resetStats()
+{
+    memset(&mStats, 0, sizeof(mStats));
+}
+
+/*===========================================================================
+ * FUNCTION   : onBatchOpen
+ *
+ * DESCRIPTION: account the first video request of a batch and pick the size
+ *              of that batch. The request interval is sampled once per
+ *              batch, as the time since the previous batch opened over the
+ *              number of requests in it, so bursts of requests from the
+ *              framework do not skew it.
+ *
+ * PARAMETERS :
+ *   @now : time the request arrived
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::onBatchOpen(nsecs_t now)
+{
+    if ((mLastOpenNs > 0) && (mLastFill > 0) && (now > mLastOpenNs)) {
+        nsecs_t sample = (now - mLastOpenNs) / mLastFill;
+        nsecs_t limit = HFR_BATCH_MAX_INTERVAL_WINDOWS * mMaxBatch * mFrameInterval;
+        if (sample > limit) {
+            sample = limit;
+        }
+        if (mRequestInterval == 0) {
+            mRequestInterval = sample;
+        } else {
+            mRequestInterval += (sample - mRequestInterval) >> HFR_BATCH_EWMA_SHIFT;
+        }
+    }
+    mLastOpenNs = now;
+    mOpenNs = now;
+    updateTarget();
+}
+
+/*===========================================================================
+ * FUNCTION   : updateTarget
+ *
+ * DESCRIPTION: size the next batch so it fills in about the time a full batch
+ *              takes at the configured fps, within the latency cap
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::updateTarget()
+{
+    uint32_t target = mMaxBatch;
+
+    if (isDynamic()) {
+        if (mRequestInterval > 0) {
+            nsecs_t window = mMaxBatch * mFrameInterval;
+            nsecs_t fit = (window + mRequestInterval / 2) / mRequestInterval;
+            target = (fit < 1) ? 1 :
+                    ((fit > (nsecs_t)mMaxBatch) ? mMaxBatch : (uint32_t)fit);
+        }
+        if (target > mLatencyCap) {
+            target = mLatencyCap;
+        }
+    }
+
+    if (target != mTarget) {
+        mStats.targetChanges++;
+        mTarget = target;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : getDeadline
+ *
+ * DESCRIPTION: time at which the open batch is to be sent even if not full
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : absolute time in ns, 0 if no batch is open or the mode is
+ *              not dynamic
+ *==========================================================================*/
+nsecs_t QCamera3HFRBatch::getDeadline() const
+{
+    if (!isDynamic() || (mOpenNs == 0)) {
+        return 0;
+    }
+
+    nsecs_t deadline = mDeadlineCfg;
+    if (deadline == 0) {
+        deadline = HFR_BATCH_DEADLINE_FILLS * mTarget * mFrameInterval;
+        if (deadline < ms2ns(1)) {
+            deadline = ms2ns(1);
+        }
+    }
+    return mOpenNs + deadline;
+}
+
+/*===========================================================================
+ * FUNCTION   : onBatchSubmit
+ *
+ * DESCRIPTION: account a batch sent to the backend
+ *
+ * PARAMETERS :
+ *   @lastFrameNumber : frame number the batch metadata will carry
+ *   @queued          : video requests in the batch
+ *   @reason          : why the batch was sent
+ *   @now             : time it was sent
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::onBatchSubmit(uint32_t lastFrameNumber, uint32_t queued,
+        hfr_batch_flush_t reason, nsecs_t now)
+{
+    mStats.batches++;
+    if (reason < HFR_BATCH_FLUSH_MAX) {
+        mStats.flushes[reason]++;
+    }
+    mStats.fill[(queued > HFR_BATCH_MAX_FRAMES) ? HFR_BATCH_MAX_FRAMES : queued]++;
+    if (mOpenNs > 0) {
+        mStats.wait[bucketOf(now - mOpenNs)]++;
+    }
+
+    mLastFill = queued;
+    mOpenNs = 0;
+
+    mInflight[mInflightHead].frameNumber = lastFrameNumber;
+    mInflight[mInflightHead].submitNs = now;
+    mInflightHead = (mInflightHead + 1) % HFR_BATCH_MAX_INFLIGHT;
+}
+
+/*===========================================================================
+ * FUNCTION   : onBatchReturn
+ *
+ * DESCRIPTION: account the metadata of a batch and move the latency cap one
+ *              step when the return latency is out of budget
+ *
+ * PARAMETERS :
+ *   @lastFrameNumber : frame number carried by the batch metadata
+ *   @now             : time the metadata arrived
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::onBatchReturn(uint32_t lastFrameNumber, nsecs_t now)
+{
+    nsecs_t submitNs = 0;
+    for (uint32_t i = 0; i < HFR_BATCH_MAX_INFLIGHT; i++) {
+        if ((mInflight[i].submitNs != 0) &&
+                (mInflight[i].frameNumber == lastFrameNumber)) {
+            submitNs = mInflight[i].submitNs;
+            mInflight[i].submitNs = 0;
+            break;
+        }
+    }
+    if ((submitNs == 0) || (now < submitNs)) {
+        return;
+    }
+
+    nsecs_t latency = now - submitNs;
+    mStats.ret[bucketOf(latency)]++;
+    if (mReturnLatency == 0) {
+        mReturnLatency = latency;
+    } else {
+        mReturnLatency += (latency - mReturnLatency) >> HFR_BATCH_EWMA_SHIFT;
+    }
+
+    if (!isDynamic()) {
+        return;
+    }
+    nsecs_t budget = mLatencyBudgetCfg;
+    if (budget == 0) {
+        budget = HFR_BATCH_LATENCY_WINDOWS * mMaxBatch * mFrameInterval;
+    }
+    if ((mReturnLatency > budget) && (mLatencyCap > 1)) {
+        mLatencyCap--;
+    } else if ((mReturnLatency < budget / 2) && (mLatencyCap < mMaxBatch)) {
+        mLatencyCap++;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : getStats
+ *
+ * DESCRIPTION: copy out the current state and histograms
+ *
+ * PARAMETERS :
+ *   @stats : output
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::getStats(hfr_batch_stats_t &stats) const
+{
+    stats = mStats;
+    stats.maxBatch = mMaxBatch;
+    stats.target = mTarget;
+    stats.latencyCap = mLatencyCap;
+    stats.requestInterval = mRequestInterval;
+    stats.returnLatency = mReturnLatency;
+    stats.deadline = 0;
+    if (isDynamic()) {
+        stats.deadline = mDeadlineCfg ? mDeadlineCfg :
+                HFR_BATCH_DEADLINE_FILLS * mTarget * mFrameInterval;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : bucketOf
+ *
+ * DESCRIPTION: histogram bucket of a duration
+ *
+ * PARAMETERS :
+ *   @ns : duration
+ *
+ * RETURN     : bucket index, below HFR_BATCH_HIST_BUCKETS
+ *==========================================================================*/
+uint32_t QCamera3HFRBatch::bucketOf(nsecs_t ns)
+{
+    nsecs_t ms = ns2ms(ns);
+    uint32_t bucket = 0;
+
+    if (ms >= 1) {
+        bucket = 1;
+        while ((ms > 1) && (bucket < HFR_BATCH_HIST_BUCKETS - 1)) {
+            ms >>= 1;
+            bucket++;
+        }
+    }
+    return bucket;
+}
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: print the batching state and histograms
+ *
+ * PARAMETERS :
+ *   @fd : file descriptor to print to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HFRBatch::dump(int fd) const
+{
+    hfr_batch_stats_t stats;
+    getStats(stats);
+
+    dprintf(fd, "\nHFR batching (%s)\n", isDynamic() ? "dynamic" : "fixed");
+    dprintf(fd, "Batch size: max %u, target %u, latency cap %u, changes %" PRIu64 "\n",
+            stats.maxBatch, stats.target, stats.latencyCap, stats.targetChanges);
+    dprintf(fd, "Request interval: %lld us, return latency: %lld us, deadline: %lld us\n",
+            (long long)ns2us(stats.requestInterval),
+            (long long)ns2us(stats.returnLatency),
+            (long long)ns2us(stats.deadline));
+    dprintf(fd, "Batches: %" PRIu64 ", full: %" PRIu64 ", on deadline: %" PRIu64 "\n",
+            stats.batches, stats.flushes[HFR_BATCH_FLUSH_FULL],
+            stats.flushes[HFR_BATCH_FLUSH_DEADLINE]);
+    if (stats.batches == 0) {
+        return;
+    }
+
+    dprintf(fd, "-------+----------\n");
+    dprintf(fd, " Fill  |  Batches \n");
+    dprintf(fd, "-------+----------\n");
+    for (uint32_t i = 1; i <= HFR_BATCH_MAX_FRAMES; i++) {
+        if (stats.fill[i] > 0) {
+            dprintf(fd, " %5u | %8" PRIu64 "\n", i, stats.fill[i]);
+        }
+    }
+    dprintf(fd, "-------+----------+----------\n");
+    dprintf(fd, " < ms  |     Wait |   Return \n");
+    dprintf(fd, "-------+----------+----------\n");
+    for (uint32_t b = 0; b < HFR_BATCH_HIST_BUCKETS; b++) {
+        if ((stats.wait[b] == 0) && (stats.ret[b] == 0)) {
+            continue;
+        }
+        if (b < HFR_BATCH_HIST_BUCKETS - 1) {
+            dprintf(fd, " %5u | %8" PRIu64 " | %8" PRIu64 "\n",
+                    1u << b, stats.wait[b], stats.ret[b]);
+        } else {
+            dprintf(fd, "  more | %8" PRIu64 " | %8" PRIu64 "\n",
+                    stats.wait[b], stats.ret[b]);
+        }
+    }
+    dprintf(fd, "-------+----------+----------\n");
+}
+
+}; // namespace qcamera
@@ -0,0 +1,138 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3HFRBATCH_H__
+#define __QCAMERA3HFRBATCH_H__
+
+// System dependencies
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+// Largest batch the stream layer can hold, see MAX_BATCH_SIZE.
+#define HFR_BATCH_MAX_FRAMES      32
+// Wait and return histograms: bucket 0 is below 1 ms, bucket n covers
+// [2^(n-1), 2^n) ms and the last one everything above.
+#define HFR_BATCH_HIST_BUCKETS    12
+// Submitted batches whose metadata has not come back yet.
+#define HFR_BATCH_MAX_INFLIGHT    32
+
+typedef enum {
+    HFR_BATCH_FLUSH_FULL,     // reached the target size
+    HFR_BATCH_FLUSH_DEADLINE, // partial batch sent on its deadline
+    HFR_BATCH_FLUSH_MAX
+} hfr_batch_flush_t;
+
+typedef struct {
+    uint32_t maxBatch;          // Configured batch size, upper bound.
+    uint32_t target;            // Batch size for the next batch.
+    uint32_t latencyCap;        // Upper bound from the return latency.
+    nsecs_t requestInterval;    // Video request interval, EWMA.
+    nsecs_t returnLatency;      // Submit to batch metadata, EWMA.
+    nsecs_t deadline;           // Open batch lifetime before a flush.
+    uint64_t batches;
+    uint64_t flushes[HFR_BATCH_FLUSH_MAX];
+    uint64_t targetChanges;
+    uint64_t fill[HFR_BATCH_MAX_FRAMES + 1]; // Batches by frames in them.
+    uint64_t wait[HFR_BATCH_HIST_BUCKETS];   // First request to submit.
+    uint64_t ret[HFR_BATCH_HIST_BUCKETS];    // Submit to batch metadata.
+} hfr_batch_stats_t;
+
+/*
+ * QCamera3HFRBatch picks the number of video requests grouped in a constrained
+ * high speed batch. The configured batch size, fps / PREVIEW_FPS_FOR_HFR, is
+ * the container size of the stream and stays the upper bound. In dynamic mode
+ * the size used for the next batch follows the video request rate, so that a
+ * batch takes about as long to fill as a full batch does at the configured
+ * fps, and is lowered one step at a time while batch metadata comes back
+ * later than the latency budget. An open batch that is not full by its
+ * deadline is sent partially filled.
+ *
+ * The size only changes when a batch opens, so every request of a batch sees
+ * the same target. Not thread safe, the HAL calls it with mMutex held.
+ */
+class QCamera3HFRBatch {
+public:
+    QCamera3HFRBatch();
+
+    // Dynamic mode, deadline and latency budget, 0 for automatic values.
+    void setTunables(bool dynamic, nsecs_t deadline, nsecs_t latencyBudget);
+    // Batch size and sensor fps of the session. Keeps the state when the
+    // values do not change, resets it otherwise. maxBatch 0 disables batching.
+    void configure(uint32_t maxBatch, uint32_t fps);
+    void resetStats();
+
+    // First video request of a batch joined at 'now'.
+    void onBatchOpen(nsecs_t now);
+    bool isFull(uint32_t queued) const { return queued >= mTarget; }
+    // Absolute time the open batch is to be flushed, 0 for none.
+    nsecs_t getDeadline() const;
+    void onBatchSubmit(uint32_t lastFrameNumber, uint32_t queued,
+            hfr_batch_flush_t reason, nsecs_t now);
+    void onBatchReturn(uint32_t lastFrameNumber, nsecs_t now);
+
+    bool isDynamic() const { return mDynamic && (mMaxBatch > 0); }
+    uint32_t getTarget() const { return mTarget; }
+    void getStats(hfr_batch_stats_t &stats) const;
+    void dump(int fd) const;
+
+    static uint32_t bucketOf(nsecs_t ns);
+
+private:
+    void updateTarget();
+
+    bool mDynamic;
+    nsecs_t mDeadlineCfg;
+    nsecs_t mLatencyBudgetCfg;
+
+    uint32_t mMaxBatch;
+    uint32_t mFps;
+    nsecs_t mFrameInterval;
+    uint32_t mTarget;
+    uint32_t mLatencyCap;
+    nsecs_t mRequestInterval;
+    nsecs_t mReturnLatency;
+
+    nsecs_t mOpenNs;            // 0 while no batch is open
+    nsecs_t mLastOpenNs;
+    uint32_t mLastFill;
+
+    struct {
+        uint32_t frameNumber;
+        nsecs_t submitNs;
+    } mInflight[HFR_BATCH_MAX_INFLIGHT];
+    uint32_t mInflightHead;
+
+    hfr_batch_stats_t mStats;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3HFRBATCH_H__ */
@@ -101,6 +101,8 @@ namespace qcamera {
 #define MISSING_REQUEST_BUF_TIMEOUT 5
 #define MISSING_HDRPLUS_REQUEST_BUF_TIMEOUT 30
 #define FLUSH_TIMEOUT 3
+// Time for recalled buffers to come back before flush stops the streams
+#define FAST_FLUSH_TIMEOUT_MS 500
 #define METADATA_MAP_SIZE(MAP) (sizeof(MAP)/sizeof(MAP[0]))
 
 #define CAM_QCOM_FEATURE_PP_SUPERSET_HAL3   ( CAM_QCOM_FEATURE_DENOISE2D |\
@@ -465,7 +467,8 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       mChannelHandle(0),
       mFirstConfiguration(true),
       mFlush(false),
-      mFlushPerf(false),
+      mFastFlushEnable(false),
+      mFastFlushTimeout(0),
       mParamHeap(NULL),
       mParameters(NULL),
       mPrevParameters(NULL),
@@ -493,6 +496,10 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
       /* DevCamDebug metadata end */
       mBatchSize(0),
       mToBeQueuedVidBufs(0),
+      mLastFrameNumberInBatch(0),
+      mBatchVideoChannel(NULL),
+      mBatchFlushTid(0),
+      mBatchFlushExit(false),
       mHFRVideoFps(DEFAULT_VIDEO_FPS),
       mOpMode(CAMERA3_STREAM_CONFIGURATION_NORMAL_MODE),
       mStreamConfig(false),
@@ -547,9 +554,9 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
     gCamCapability[cameraId]->min_num_pp_bufs = 3;
 
     PTHREAD_COND_INIT(&mBuffersCond);
+    PTHREAD_COND_INIT(&mBatchFlushCond);
 
-    PTHREAD_COND_INIT(&mRequestCond);
-    mPendingLiveRequest = 0;
+    mRequestGate.setLimits(mMinInFlightRequests, mMaxInFlightRequests);
     mCurrentRequestId = -1;
     pthread_mutex_init(&mMutex, NULL);
 
@@ -596,6 +603,13 @@ QCamera3HardwareInterface::QCamera3HardwareInterface(uint32_t cameraId,
 
     m_bForceInfinityAf = property_get_bool("persist.camera.af.infinity", 0);
     m_MobicatMask = (uint8_t)property_get_int32("persist.camera.mobicat", 0);
+    mFrameTimeline.setEnabled(property_get_bool("persist.camera.hal3.timeline", 1));
+    mHFRBatch.setTunables(property_get_bool("persist.camera.hfr.dynbatch", 1),
+            ms2ns(property_get_int32("persist.camera.hfr.batch.deadline_ms", 0)),
+            ms2ns(property_get_int32("persist.camera.hfr.batch.latency_ms", 0)));
+    mFastFlushEnable = property_get_bool("persist.camera.fast.flush", 0);
+    mFastFlushTimeout = ms2ns(property_get_int32("persist.camera.fast.flush.timeout_ms",
+            FAST_FLUSH_TIMEOUT_MS));
 
     //Load and read GPU library.
     lib_surface_utils = NULL;
@@ -680,6 +694,8 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
         }
     }
 
+    stopHfrBatchFlusher();
+
     /* We need to stop all streams before deleting any stream */
     if (mRawDumpChannel) {
         mRawDumpChannel->stop();
@@ -793,9 +809,8 @@ QCamera3HardwareInterface::~QCamera3HardwareInterface()
 
     mPerfLockMgr.releasePerfLock(PERF_LOCK_CLOSE_CAMERA);
 
-    pthread_cond_destroy(&mRequestCond);
-
     pthread_cond_destroy(&mBuffersCond);
+    pthread_cond_destroy(&mBatchFlushCond);
 
     pthread_mutex_destroy(&mMutex);
     LOGD("X");
@@ -853,6 +868,8 @@ void QCamera3HardwareInterface::camEvtHandle(uint32_t /*camera_handle*/,
             case CAM_EVENT_TYPE_DAEMON_DIED:
                 pthread_mutex_lock(&obj->mMutex);
                 obj->mState = ERROR;
+                // let a blocked process_capture_request see the error
+                obj->mRequestGate.wake();
                 pthread_mutex_unlock(&obj->mMutex);
                 LOGE("Fatal, camera daemon died");
                 break;
@@ -860,8 +877,7 @@ void QCamera3HardwareInterface::camEvtHandle(uint32_t /*camera_handle*/,
             case CAM_EVENT_TYPE_DAEMON_PULL_REQ:
                 LOGD("HAL got request pull from Daemon");
                 pthread_mutex_lock(&obj->mMutex);
-                obj->mWokenUpByDaemon = true;
-                obj->unblockRequestIfNecessary();
+                obj->mRequestGate.onDaemonPull();
                 pthread_mutex_unlock(&obj->mMutex);
                 break;
 
@@ -1151,7 +1167,7 @@ int QCamera3HardwareInterface::initialize(
     ATRACE_CAMSCOPE_CALL(CAMSCOPE_HAL3_INIT);
     int rc;
 
-    LOGI("E :mCameraId = %d mState = %d", mCameraId, mState);
+    LOGI("E :mCameraId = %d mState = %d", mCameraId, mState.load());
     pthread_mutex_lock(&mMutex);
 
     // Validate current state
@@ -1160,7 +1176,7 @@ int QCamera3HardwareInterface::initialize(
             /* valid state */
             break;
         default:
-            LOGE("Invalid state %d", mState);
+            LOGE("Invalid state %d", mState.load());
             rc = -ENODEV;
             goto err1;
     }
@@ -1778,6 +1794,7 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
 {
     ATRACE_CAMSCOPE_CALL(CAMSCOPE_HAL3_CFG_STRMS_PERF_LKD);
     int rc = 0;
+    nsecs_t configStartTs = systemTime();
 
     // Sanity check stream_list
     if (streamList == NULL) {
@@ -1801,9 +1818,24 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
         return BAD_VALUE;
     }
 
+    uint32_t prevOpMode = mOpMode;
     mOpMode = streamList->operation_mode;
     LOGD("mOpMode: %d", mOpMode);
 
+    /* An open HFR batch belongs to the old streams */
+    mToBeQueuedVidBufs = 0;
+    mBatchVideoChannel = NULL;
+
+    /* Channels of streams that appear again with the same configuration are
+     * kept, together with their backend streams and buffers. HFR channels
+     * are batched when the first request arrives, so they are not kept. */
+    char reuse_prop[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.reconfig.reuse", reuse_prop, "1");
+    bool reuseChannels = (atoi(reuse_prop) != 0) && (mMetadataChannel != NULL) &&
+            (prevOpMode != CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE) &&
+            (mOpMode != CAMERA3_STREAM_CONFIGURATION_CONSTRAINED_HIGH_SPEED_MODE);
+    uint32_t numKept = 0, numCreated = 0, numRebuilt = 0, numRemoved = 0;
+
     rc = validateUsageFlags(streamList);
     if (rc != NO_ERROR) {
         return rc;
@@ -1854,6 +1886,7 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     }
 
     pthread_mutex_lock(&mMutex);
+    nsecs_t stopDoneTs = systemTime();
 
     mPictureChannel = NULL;
 
@@ -1865,7 +1898,7 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
             /* valid state */
             break;
         default:
-            LOGE("Invalid state %d", mState);
+            LOGE("Invalid state %d", mState.load());
             pthread_mutex_unlock(&mMutex);
             return -ENODEV;
     }
@@ -2208,6 +2241,7 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
         return -EINVAL;
     }
 
+    nsecs_t validateDoneTs = systemTime();
     camera3_stream_t *zslStream = NULL; //Only use this for size and not actual handle!
     for (size_t i = 0; i < streamList->num_streams; i++) {
         camera3_stream_t *newStream = streamList->streams[i];
@@ -2223,9 +2257,13 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                 QCamera3ProcessingChannel *channel =
                     (QCamera3ProcessingChannel*)(*it)->stream->priv;
                 stream_exists = true;
+                (*it)->status = VALID;
+                if (reuseChannels) {
+                    // Decided once the new stream configuration is known
+                    continue;
+                }
                 if (channel)
                     delete channel;
-                (*it)->status = VALID;
                 (*it)->stream->priv = NULL;
                 (*it)->channel = NULL;
             }
@@ -2240,6 +2278,7 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                pthread_mutex_unlock(&mMutex);
                return rc;
             }
+            memset(stream_info, 0, sizeof(stream_info_t));
             stream_info->stream = newStream;
             stream_info->status = VALID;
             stream_info->channel = NULL;
@@ -2291,19 +2330,29 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                 mInputStreamInfo.format, mInputStreamInfo.usage);
     }
 
+    for (List<stream_info_t*>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        if ((*it)->status == INVALID) {
+            numRemoved++;
+        }
+    }
     cleanAndSortStreamInfo();
-    if (mMetadataChannel) {
+    if (mMetadataChannel && !reuseChannels) {
         delete mMetadataChannel;
         mMetadataChannel = NULL;
     }
-    if (mSupportChannel) {
-        delete mSupportChannel;
-        mSupportChannel = NULL;
-    }
 
-    if (mAnalysisChannel) {
-        delete mAnalysisChannel;
-        mAnalysisChannel = NULL;
+    // When channels are kept, the support channels are kept too if their
+    // configuration does not change. Unused ones are deleted at the end.
+    QCamera3SupportChannel *oldSupportChannel = mSupportChannel;
+    QCamera3SupportChannel *oldAnalysisChannel = mAnalysisChannel;
+    mSupportChannel = NULL;
+    mAnalysisChannel = NULL;
+    if (!reuseChannels) {
+        delete oldSupportChannel;
+        oldSupportChannel = NULL;
+        delete oldAnalysisChannel;
+        oldAnalysisChannel = NULL;
     }
 
     if (mDummyBatchChannel) {
@@ -2335,27 +2384,29 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
     bool is_goog_zoom_4k_enabled = (atoi(property_value) > 0);
 
     //Create metadata channel and initialize it
-    cam_feature_mask_t metadataFeatureMask = CAM_QCOM_FEATURE_NONE;
-    setPAAFSupport(metadataFeatureMask, CAM_STREAM_TYPE_METADATA,
-            gCamCapability[mCameraId]->color_arrangement);
-    mMetadataChannel = new QCamera3MetadataChannel(mCameraHandle->camera_handle,
-                    mChannelHandle, mCameraHandle->ops, captureResultCb,
-                    setBufferErrorStatus, &padding_info, metadataFeatureMask, this);
     if (mMetadataChannel == NULL) {
-        LOGE("failed to allocate metadata channel");
-        rc = -ENOMEM;
-        pthread_mutex_unlock(&mMutex);
-        return rc;
+        cam_feature_mask_t metadataFeatureMask = CAM_QCOM_FEATURE_NONE;
+        setPAAFSupport(metadataFeatureMask, CAM_STREAM_TYPE_METADATA,
+                gCamCapability[mCameraId]->color_arrangement);
+        mMetadataChannel = new QCamera3MetadataChannel(mCameraHandle->camera_handle,
+                        mChannelHandle, mCameraHandle->ops, captureResultCb,
+                        setBufferErrorStatus, &padding_info, metadataFeatureMask, this);
+        if (mMetadataChannel == NULL) {
+            LOGE("failed to allocate metadata channel");
+            rc = -ENOMEM;
+            pthread_mutex_unlock(&mMutex);
+            return rc;
+        }
+        rc = mMetadataChannel->initialize(IS_TYPE_NONE);
+        if (rc < 0) {
+            LOGE("metadata channel initialization failed");
+            delete mMetadataChannel;
+            mMetadataChannel = NULL;
+            pthread_mutex_unlock(&mMutex);
+            return rc;
+        }
     }
     mMetadataChannel->enableDepthData(depthPresent);
-    rc = mMetadataChannel->initialize(IS_TYPE_NONE);
-    if (rc < 0) {
-        LOGE("metadata channel initialization failed");
-        delete mMetadataChannel;
-        mMetadataChannel = NULL;
-        pthread_mutex_unlock(&mMutex);
-        return rc;
-    }
 
     cam_feature_mask_t zsl_ppmask = CAM_QCOM_FEATURE_NONE;
     bool isRawStreamRequested = false;
@@ -2581,6 +2632,54 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                 (cam_stream_type_t) mStreamConfigInfo.type[mStreamConfigInfo.num_streams],
                 gCamCapability[mCameraId]->color_arrangement);
 
+        stream_config_key_t configKey;
+        memset(&configKey, 0, sizeof(configKey));
+        configKey.stream_type = newStream->stream_type;
+        configKey.format = newStream->format;
+        configKey.width = newStream->width;
+        configKey.height = newStream->height;
+        configKey.rotation = newStream->rotation;
+        configKey.data_space = newStream->data_space;
+        configKey.op_mode = mOpMode;
+        configKey.cam_stream_type =
+                (int32_t)mStreamConfigInfo.type[mStreamConfigInfo.num_streams];
+        configKey.pp_mask = mStreamConfigInfo.postprocess_mask[mStreamConfigInfo.num_streams];
+        configKey.hw_width = mStreamConfigInfo.stream_sizes[mStreamConfigInfo.num_streams].width;
+        configKey.hw_height = mStreamConfigInfo.stream_sizes[mStreamConfigInfo.num_streams].height;
+        configKey.preview_width = previewSize.width;
+        configKey.preview_height = previewSize.height;
+        configKey.video_width = (int32_t)videoWidth;
+        configKey.video_height = (int32_t)videoHeight;
+        configKey.is_4k_video = m_bIs4KVideo;
+        configKey.is_video = m_bIsVideo;
+        configKey.is_zsl = isZsl;
+        configKey.is_eis3 = m_bEis3PropertyEnabled;
+
+        stream_info_t *streamInfo = NULL;
+        for (List<stream_info_t*>::iterator it = mStreamInfo.begin();
+                it != mStreamInfo.end(); it++) {
+            if ((*it)->stream == newStream) {
+                streamInfo = *it;
+                break;
+            }
+        }
+
+        if ((newStream->priv != NULL) && (streamInfo != NULL)) {
+            if (reuseChannels && isChannelReusable(streamInfo, newStream, configKey)) {
+                newStream->usage = streamInfo->hal_usage;
+                newStream->max_buffers = streamInfo->max_buffers;
+                restoreChannelRef(newStream);
+                numKept++;
+            } else {
+                delete (QCamera3ProcessingChannel *)newStream->priv;
+                newStream->priv = NULL;
+                streamInfo->channel = NULL;
+                numRebuilt++;
+            }
+        } else if (newStream->stream_type != CAMERA3_STREAM_INPUT) {
+            numCreated++;
+        }
+
         if (newStream->priv == NULL) {
             //New stream, construct channel
             switch (newStream->stream_type) {
@@ -2806,16 +2905,13 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                 }
             }
 
-            for (List<stream_info_t*>::iterator it=mStreamInfo.begin();
-                    it != mStreamInfo.end(); it++) {
-                if ((*it)->stream == newStream) {
-                    (*it)->channel = (QCamera3ProcessingChannel*) newStream->priv;
-                    break;
-                }
+            if (streamInfo != NULL) {
+                streamInfo->channel = (QCamera3ProcessingChannel*) newStream->priv;
+                streamInfo->config_key = configKey;
+                streamInfo->fwk_usage = stream_usage;
+                streamInfo->hal_usage = newStream->usage;
+                streamInfo->max_buffers = newStream->max_buffers;
             }
-        } else {
-            // Channel already exists for this stream
-            // Do nothing for now
         }
         padding_info = gCamCapability[mCameraId]->padding_info;
 
@@ -2829,6 +2925,8 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
         }
     }
 
+    nsecs_t channelsDoneTs = systemTime();
+
     // Let buffer dispatcher know the configured streams.
     mOutputBufferDispatcher.configureStreams(streamList);
 
@@ -2855,22 +2953,30 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
             cam_dimension_t analysisDim;
             analysisDim = mCommon.getMatchingDimension(previewSize,
                     analysisInfo.analysis_recommended_res);
-
-            mAnalysisChannel = new QCamera3SupportChannel(
-                    mCameraHandle->camera_handle,
-                    mChannelHandle,
-                    mCameraHandle->ops,
-                    &analysisInfo.analysis_padding_info,
-                    analysisFeatureMask,
-                    CAM_STREAM_TYPE_ANALYSIS,
-                    &analysisDim,
-                    (analysisInfo.analysis_format
-                    == CAM_FORMAT_Y_ONLY ? CAM_FORMAT_Y_ONLY
-                    : CAM_FORMAT_YUV_420_NV21),
-                    analysisInfo.hw_analysis_supported,
-                    gCamCapability[mCameraId]->color_arrangement,
-                    this,
-                    0); // force buffer count to 0
+            cam_format_t analysisFormat =
+                    (analysisInfo.analysis_format == CAM_FORMAT_Y_ONLY) ?
+                    CAM_FORMAT_Y_ONLY : CAM_FORMAT_YUV_420_NV21;
+
+            if ((oldAnalysisChannel != NULL) &&
+                    oldAnalysisChannel->isSameConfig(CAM_STREAM_TYPE_ANALYSIS,
+                    analysisDim, analysisFormat, analysisFeatureMask)) {
+                mAnalysisChannel = oldAnalysisChannel;
+                oldAnalysisChannel = NULL;
+            } else {
+                mAnalysisChannel = new QCamera3SupportChannel(
+                        mCameraHandle->camera_handle,
+                        mChannelHandle,
+                        mCameraHandle->ops,
+                        &analysisInfo.analysis_padding_info,
+                        analysisFeatureMask,
+                        CAM_STREAM_TYPE_ANALYSIS,
+                        &analysisDim,
+                        analysisFormat,
+                        analysisInfo.hw_analysis_supported,
+                        gCamCapability[mCameraId]->color_arrangement,
+                        this,
+                        0); // force buffer count to 0
+            }
         } else {
             LOGW("getAnalysisInfo failed, ret = %d", ret);
         }
@@ -2947,18 +3053,26 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
                 LOGW("getAnalysisInfo failed, ret = %d", ret);
             }
         }
-        mSupportChannel = new QCamera3SupportChannel(
-                mCameraHandle->camera_handle,
-                mChannelHandle,
-                mCameraHandle->ops,
-                &gCamCapability[mCameraId]->padding_info,
-                callbackFeatureMask,
-                CAM_STREAM_TYPE_CALLBACK,
-                &QCamera3SupportChannel::kDim,
-                CAM_FORMAT_YUV_420_NV21,
-                supportInfo.hw_analysis_supported,
-                gCamCapability[mCameraId]->color_arrangement,
-                this, 0);
+        if ((oldSupportChannel != NULL) &&
+                oldSupportChannel->isSameConfig(CAM_STREAM_TYPE_CALLBACK,
+                QCamera3SupportChannel::kDim, CAM_FORMAT_YUV_420_NV21,
+                callbackFeatureMask)) {
+            mSupportChannel = oldSupportChannel;
+            oldSupportChannel = NULL;
+        } else {
+            mSupportChannel = new QCamera3SupportChannel(
+                    mCameraHandle->camera_handle,
+                    mChannelHandle,
+                    mCameraHandle->ops,
+                    &gCamCapability[mCameraId]->padding_info,
+                    callbackFeatureMask,
+                    CAM_STREAM_TYPE_CALLBACK,
+                    &QCamera3SupportChannel::kDim,
+                    CAM_FORMAT_YUV_420_NV21,
+                    supportInfo.hw_analysis_supported,
+                    gCamCapability[mCameraId]->color_arrangement,
+                    this, 0);
+        }
         if (!mSupportChannel) {
             LOGE("dummy channel cannot be created");
             pthread_mutex_unlock(&mMutex);
@@ -3044,6 +3158,13 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
         mStreamConfigInfo.num_streams++;
     }
 
+    // Support channels that are no longer needed
+    delete oldSupportChannel;
+    oldSupportChannel = NULL;
+    delete oldAnalysisChannel;
+    oldAnalysisChannel = NULL;
+    nsecs_t supportDoneTs = systemTime();
+
     mStreamConfigInfo.buffer_info.min_buffers = MIN_INFLIGHT_REQUESTS;
     mStreamConfigInfo.buffer_info.max_buffers =
             m_bIs4KVideo ? 0 :
@@ -3076,9 +3197,77 @@ int QCamera3HardwareInterface::configureStreamsPerfLocked(
 
     pthread_mutex_unlock(&mMutex);
 
+    nsecs_t configEndTs = systemTime();
+    LOGH("configureStreams took %lld us: stop %lld, validate %lld, channels %lld, "
+            "support %lld, finish %lld. Streams kept %d, created %d, rebuilt %d, "
+            "removed %d",
+            (long long)ns2us(configEndTs - configStartTs),
+            (long long)ns2us(stopDoneTs - configStartTs),
+            (long long)ns2us(validateDoneTs - stopDoneTs),
+            (long long)ns2us(channelsDoneTs - validateDoneTs),
+            (long long)ns2us(supportDoneTs - channelsDoneTs),
+            (long long)ns2us(configEndTs - supportDoneTs),
+            numKept, numCreated, numRebuilt, numRemoved);
+
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : isChannelReusable
+ *
+ * DESCRIPTION: check whether the channel of a stream that appears again in
+ *              configureStreams can be kept
+ *
+ * PARAMETERS :
+ *   @streamInfo : stream info of the existing stream
+ *   @newStream  : stream as passed in the new configuration
+ *   @configKey  : inputs the channel would be created from now
+ *
+ * RETURN     : true if the channel can be kept
+ *==========================================================================*/
+bool QCamera3HardwareInterface::isChannelReusable(const stream_info_t *streamInfo,
+        const camera3_stream_t *newStream, const stream_config_key_t &configKey)
+{
+    if (streamInfo->channel == NULL) {
+        return false;
+    }
+    return isStreamConfigReusable(streamInfo->config_key, streamInfo->fwk_usage,
+            streamInfo->hal_usage, configKey, newStream->usage);
+}
+
+/*===========================================================================
+ * FUNCTION   : restoreChannelRef
+ *
+ * DESCRIPTION: point the typed channel members back at the kept channel of a
+ *              stream
+ *
+ * PARAMETERS :
+ *   @stream : stream whose channel is kept
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::restoreChannelRef(camera3_stream_t *stream)
+{
+    switch (stream->format) {
+    case HAL_PIXEL_FORMAT_BLOB:
+        if (stream->data_space == HAL_DATASPACE_DEPTH) {
+            mDepthChannel = (QCamera3DepthChannel *)stream->priv;
+        } else {
+            mPictureChannel = static_cast<QCamera3PicChannel *>(
+                    (QCamera3ProcessingChannel *)stream->priv);
+        }
+        break;
+    case HAL_PIXEL_FORMAT_RAW_OPAQUE:
+    case HAL_PIXEL_FORMAT_RAW16:
+    case HAL_PIXEL_FORMAT_RAW10:
+        mRawChannel = static_cast<QCamera3RawChannel *>(
+                (QCamera3ProcessingChannel *)stream->priv);
+        break;
+    default:
+        break;
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : validateCaptureRequest
  *
@@ -3409,6 +3598,7 @@ void QCamera3HardwareInterface::handleBatchMetadata(
             LOGE("Invalid urgent frame number received: %d. Irrecoverable error",
                 last_urgent_frame_number);
             mState = ERROR;
+            mRequestGate.wake();
             pthread_mutex_unlock(&mMutex);
             return;
         }
@@ -3427,6 +3617,7 @@ void QCamera3HardwareInterface::handleBatchMetadata(
             LOGE("Invalid frame number received: %d. Irrecoverable error",
                 last_frame_number);
             mState = ERROR;
+            mRequestGate.wake();
             pthread_mutex_unlock(&mMutex);
             return;
         }
@@ -3434,6 +3625,7 @@ void QCamera3HardwareInterface::handleBatchMetadata(
         frameNumDiff = last_frame_number + 1 -
                 first_frame_number;
         mPendingBatchMap.removeItem(last_frame_number);
+        mHFRBatch.onBatchReturn(last_frame_number, systemTime());
 
         LOGD("frm: valid: %d frm_num: %d - %d",
                  frame_number_valid,
@@ -3517,6 +3709,152 @@ void QCamera3HardwareInterface::handleBatchMetadata(
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : flushHfrBatchLocked
+ *
+ * DESCRIPTION: Send the open HFR batch to the backend before it is full. The
+ *              partial video container is queued and the settings of the
+ *              batch go out with the frame number of its last request, the
+ *              same way a full batch is sent from processCaptureRequest.
+ *              Called with mMutex held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3HardwareInterface::flushHfrBatchLocked()
+{
+    int32_t rc = NO_ERROR;
+
+    if (!mBatchSize || !mToBeQueuedVidBufs || (mBatchVideoChannel == NULL)) {
+        return NO_ERROR;
+    }
+
+    LOGH("Deadline flush of %d/%d video requests, frames %d - %d",
+            mToBeQueuedVidBufs, mHFRBatch.getTarget(),
+            mFirstFrameNumberInBatch, mLastFrameNumberInBatch);
+
+    rc = mBatchVideoChannel->queueBatchBuf();
+    if (rc != NO_ERROR) {
+        LOGE("Failed to queue partial batch %d", rc);
+    }
+
+    if (ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters,
+            CAM_INTF_META_FRAME_NUMBER, mLastFrameNumberInBatch) ||
+            ADD_SET_PARAM_ENTRY_TO_BATCH(mParameters,
+            CAM_INTF_META_STREAM_ID, mBatchedStreamsArray)) {
+        LOGE("Failed to set batch parameters");
+        rc = BAD_VALUE;
+    } else {
+        rc = mCameraHandle->ops->set_parms(mCameraHandle->camera_handle,
+                mParameters);
+        if (rc < 0) {
+            LOGE("set_parms failed");
+        }
+    }
+
+    mHFRBatch.onBatchSubmit(mLastFrameNumberInBatch, mToBeQueuedVidBufs,
+            HFR_BATCH_FLUSH_DEADLINE, systemTime());
+    mToBeQueuedVidBufs = 0;
+    mPendingBatchMap.add(mLastFrameNumberInBatch, mFirstFrameNumberInBatch);
+    memset(&mBatchedStreamsArray, 0, sizeof(cam_stream_ID_t));
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : hfrBatchFlushRoutine
+ *
+ * DESCRIPTION: Thread that sends the open HFR batch once its deadline has
+ *              passed. It sleeps on mBatchFlushCond with mMutex, so it never
+ *              runs in the middle of a capture request.
+ *
+ * PARAMETERS :
+ *   @data : QCamera3HardwareInterface object
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCamera3HardwareInterface::hfrBatchFlushRoutine(void *data)
+{
+    QCamera3HardwareInterface *hw = (QCamera3HardwareInterface *)data;
+
+    pthread_mutex_lock(&hw->mMutex);
+    while (!hw->mBatchFlushExit) {
+        nsecs_t deadline = 0;
+        // Sensor restart drops mMutex half way through a request
+        if (hw->mToBeQueuedVidBufs && (hw->mState == STARTED) &&
+                !hw->mFlush && !hw->mNeedSensorRestart) {
+            deadline = hw->mHFRBatch.getDeadline();
+        }
+        if (deadline == 0) {
+            pthread_cond_wait(&hw->mBatchFlushCond, &hw->mMutex);
+            continue;
+        }
+        if (systemTime() >= deadline) {
+            hw->flushHfrBatchLocked();
+            continue;
+        }
+        struct timespec ts;
+        ts.tv_sec = (time_t)(deadline / s2ns(1));
+        ts.tv_nsec = (long)(deadline % s2ns(1));
+        pthread_cond_timedwait(&hw->mBatchFlushCond, &hw->mMutex, &ts);
+    }
+    pthread_mutex_unlock(&hw->mMutex);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : startHfrBatchFlusherLocked
+ *
+ * DESCRIPTION: Start the HFR batch deadline thread if it is not running.
+ *              Called with mMutex held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::startHfrBatchFlusherLocked()
+{
+    if (mBatchFlushTid != 0) {
+        return;
+    }
+    mBatchFlushExit = false;
+    if (pthread_create(&mBatchFlushTid, NULL, hfrBatchFlushRoutine, this) != 0) {
+        LOGE("Failed to start HFR batch flush thread, batches wait until full");
+        mBatchFlushTid = 0;
+        return;
+    }
+    pthread_setname_np(mBatchFlushTid, "CAM_HFRBatch");
+}
+
+/*===========================================================================
+ * FUNCTION   : stopHfrBatchFlusher
+ *
+ * DESCRIPTION: Stop the HFR batch deadline thread. Must be called without
+ *              mMutex held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::stopHfrBatchFlusher()
+{
+    pthread_mutex_lock(&mMutex);
+    pthread_t tid = mBatchFlushTid;
+    mBatchFlushExit = true;
+    pthread_cond_signal(&mBatchFlushCond);
+    pthread_mutex_unlock(&mMutex);
+
+    if (tid != 0) {
+        pthread_join(tid, NULL);
+    }
+    pthread_mutex_lock(&mMutex);
+    mBatchFlushTid = 0;
+    mBatchVideoChannel = NULL;
+    pthread_mutex_unlock(&mMutex);
+}
+
 void QCamera3HardwareInterface::notifyError(uint32_t frameNumber,
         camera3_error_msg_code_t errorCode)
 {
@@ -3608,7 +3946,7 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
     bool *p_is_metabuf_queued)
 {
     ATRACE_CAMSCOPE_CALL(CAMSCOPE_HAL3_HANDLE_METADATA_LKD);
-    if ((mFlushPerf) || (ERROR == mState) || (DEINIT == mState)) {
+    if ((mFlushPerf.isHeld()) || (ERROR == mState) || (DEINIT == mState)) {
         //during flush do not send metadata from this thread
         LOGD("not sending metadata during flush or when mState is error");
         if (free_and_bufdone_meta_buf) {
@@ -3852,35 +4190,61 @@ void QCamera3HardwareInterface::handleMetadataWithLock(
                Camera framework is unaware of this timestamp and cannot change this */
             updateTimeStampInPendingBuffers(pendingRequest.frame_number, capture_time_av);
 
-            // Find channel requiring metadata, meaning internal offline postprocess
-            // is needed.
-            //TODO: for now, we don't support two streams requiring metadata at the same time.
-            // (because we are not making copies, and metadata buffer is not reference counted.
+            // Find channels requiring metadata, meaning internal offline postprocess
+            // is needed. When both a framework stream and an internal stream need
+            // it, the metadata buffer is shared by reference: each consumer gets
+            // its own super buffer wrapper and releases one reference. Consumers
+            // that modify the metadata copy it first (see unshareMetadata).
             bool internalPproc = false;
+            QCamera3ProcessingChannel *fwkMetaChannel = NULL;
+            QCamera3ProcessingChannel *internalMetaChannel = NULL;
             for (pendingBufferIterator iter = pendingRequest.buffers.begin();
                     iter != pendingRequest.buffers.end(); iter++) {
                 if (iter->need_metadata) {
-                    internalPproc = true;
-                    QCamera3ProcessingChannel *channel =
-                            (QCamera3ProcessingChannel *)iter->stream->priv;
-                    channel->queueReprocMetadata(metadata_buf);
-                    if(p_is_metabuf_queued != NULL) {
-                        *p_is_metabuf_queued = true;
-                    }
+                    fwkMetaChannel = (QCamera3ProcessingChannel *)iter->stream->priv;
                     break;
                 }
             }
             for (auto itr = pendingRequest.internalRequestList.begin();
                   itr != pendingRequest.internalRequestList.end(); itr++) {
                 if (itr->need_metadata) {
-                    internalPproc = true;
-                    QCamera3ProcessingChannel *channel =
-                            (QCamera3ProcessingChannel *)itr->stream->priv;
-                    channel->queueReprocMetadata(metadata_buf);
+                    internalMetaChannel = (QCamera3ProcessingChannel *)itr->stream->priv;
                     break;
                 }
             }
 
+            mm_camera_super_buf_t *shared_meta_buf = NULL;
+            if ((NULL != fwkMetaChannel) && (NULL != internalMetaChannel)) {
+                shared_meta_buf = (mm_camera_super_buf_t *)malloc(
+                        sizeof(mm_camera_super_buf_t));
+                if (NULL == shared_meta_buf) {
+                    LOGE("No memory to share metadata, skip internal pproc");
+                    internalMetaChannel = NULL;
+                } else if (NO_ERROR != mMetadataChannel->holdBuf(metadata_buf)) {
+                    free(shared_meta_buf);
+                    shared_meta_buf = NULL;
+                    internalMetaChannel = NULL;
+                } else {
+                    *shared_meta_buf = *metadata_buf;
+                }
+            }
+
+            if (NULL != fwkMetaChannel) {
+                internalPproc = true;
+                fwkMetaChannel->queueReprocMetadata(metadata_buf);
+                if(p_is_metabuf_queued != NULL) {
+                    *p_is_metabuf_queued = true;
+                }
+            }
+            if (NULL != internalMetaChannel) {
+                internalPproc = true;
+                internalMetaChannel->queueReprocMetadata(
+                        (NULL != shared_meta_buf) ? shared_meta_buf : metadata_buf);
+                if(p_is_metabuf_queued != NULL) {
+                    *p_is_metabuf_queued = true;
+                }
+            }
+
             saveExifParams(metadata);
 
             bool *enableZsl = nullptr;
@@ -3933,8 +4297,7 @@ done_metadata:
             i != mPendingRequestsList.end() ;i++) {
         i->pipeline_depth++;
     }
-    LOGD("mPendingLiveRequest = %d", mPendingLiveRequest);
-    unblockRequestIfNecessary();
+    LOGD("live requests in flight = %d", mRequestGate.getInFlight());
 }
 
 /*===========================================================================
@@ -4158,11 +4521,14 @@ void QCamera3HardwareInterface::handleBufferWithLock(
     if ((ERROR == mState) || (DEINIT == mState)) {
         return;
     }
-    if (mFlushPerf) {
+    if (mFlushPerf.isHeld()) {
         handleBuffersDuringFlushLock(buffer);
         return;
     }
     //not in flush
+    if (mFlushStats.awaitingFrame()) {
+        mFlushStats.onFrame(systemTime());
+    }
     // If the frame number doesn't exist in the pending request list,
     // directly send the buffer to the frameworks, and update pending buffers map
     // Otherwise, book-keep the buffer.
@@ -4291,7 +4657,7 @@ void QCamera3HardwareInterface::handlePendingResultMetadataWithLock(uint32_t fra
     } else {
         liveRequest = true;
         requestIter->partial_result_cnt = PARTIAL_RESULT_COUNT;
-        mPendingLiveRequest--;
+        mRequestGate.onRequestDone();
 
         {
             std::unique_lock<std::mutex> l(gHdrPlusClientLock);
@@ -4350,7 +4716,7 @@ void QCamera3HardwareInterface::dispatchResultMetadataWithLock(uint32_t frameNum
         } else if (iter->frame_number < frameNumber && isLiveRequest && thisLiveRequest) {
             // If the result metadata belongs to a live request, notify errors for previous pending
             // live requests.
-            mPendingLiveRequest--;
+            mRequestGate.onRequestDone();
 
             LOGE("Error: HAL missed metadata for frame number %d", iter->frame_number);
             errorResult = true;
@@ -4383,25 +4749,24 @@ void QCamera3HardwareInterface::dispatchResultMetadataWithLock(uint32_t frameNum
             }
         }
     }
-
-    unblockRequestIfNecessary();
 }
 
 /*===========================================================================
- * FUNCTION   : unblockRequestIfNecessary
+ * FUNCTION   : requestGateStopped
  *
- * DESCRIPTION: Unblock capture_request if max_buffer hasn't been reached. Note
- *              that mMutex is held when this function is called.
+ * DESCRIPTION: stop condition of the request gate. A request thread parked
+ *              in the gate gives up once the HAL is in error or closing.
  *
  * PARAMETERS :
+ *   @userdata : QCamera3HardwareInterface pointer
  *
- * RETURN     :
+ * RETURN     : true if process_capture_request must not wait any longer
  *
  *==========================================================================*/
-void QCamera3HardwareInterface::unblockRequestIfNecessary()
+bool QCamera3HardwareInterface::requestGateStopped(void *userdata)
 {
-   // Unblock process_capture_request
-   pthread_cond_signal(&mRequestCond);
+    QCamera3HardwareInterface *hw = (QCamera3HardwareInterface *)userdata;
+    return (hw->mState == ERROR) || (hw->mState == DEINIT);
 }
 
 /*===========================================================================
@@ -4616,6 +4981,16 @@ void QCamera3HardwareInterface::orchestrateResult(
                     camera3_capture_result_t *result)
 {
     uint32_t frameworkFrameNumber;
+
+    for (uint32_t i = 0; i < result->num_output_buffers; i++) {
+        mFrameTimeline.bufferDone(result->frame_number,
+                result->output_buffers[i].stream);
+    }
+    if ((result->result != NULL) &&
+            (result->partial_result == PARTIAL_RESULT_COUNT)) {
+        mFrameTimeline.metadataDone(result->frame_number);
+    }
+
     int32_t rc = _orchestrationDb.getFrameworkFrameNumber(result->frame_number,
             frameworkFrameNumber);
     if (rc != NO_ERROR) {
@@ -4659,6 +5034,13 @@ void QCamera3HardwareInterface::orchestrateNotify(camera3_notify_msg_t *notify_m
     uint32_t internalFrameNumber = notify_msg->message.shutter.frame_number;
     int32_t rc = NO_ERROR;
 
+    if (notify_msg->type == CAMERA3_MSG_SHUTTER) {
+        mFrameTimeline.mark(internalFrameNumber, TIMELINE_STAGE_SHUTTER);
+    } else if (notify_msg->type == CAMERA3_MSG_ERROR) {
+        mFrameTimeline.error(notify_msg->message.error.frame_number,
+                notify_msg->message.error.error_code);
+    }
+
     rc = _orchestrationDb.getFrameworkFrameNumber(internalFrameNumber,
                                                           frameworkFrameNumber);
 
@@ -4870,6 +5252,74 @@ status_t QCamera3HardwareInterface::fillPbStreamConfig(
     return OK;
 }
 
+/*===========================================================================
+ * FUNCTION   : waitRequestFences
+ *
+ * DESCRIPTION: wait for the acquire fences of a capture request without
+ *              consuming them. Called without mMutex so that the sync_wait
+ *              done later under the lock finds the fences already signaled.
+ *
+ * PARAMETERS :
+ *   @request : request from framework to process
+ *
+ * RETURN     : None
+ *
+ *==========================================================================*/
+void QCamera3HardwareInterface::waitRequestFences(
+        const camera3_capture_request_t *request)
+{
+    if (request == NULL) {
+        return;
+    }
+
+    if ((request->output_buffers != NULL) &&
+            (request->num_output_buffers < MAX_NUM_STREAMS)) {
+        for (size_t i = 0; i < request->num_output_buffers; i++) {
+            const camera3_stream_buffer_t& output = request->output_buffers[i];
+            if (output.acquire_fence != -1) {
+                sync_wait(output.acquire_fence, TIMEOUT_NEVER);
+            }
+        }
+    }
+
+    if ((request->input_buffer != NULL) &&
+            (request->input_buffer->acquire_fence != -1)) {
+        sync_wait(request->input_buffer->acquire_fence, TIMEOUT_NEVER);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : waitPostProcInputSpace
+ *
+ * DESCRIPTION: hold off a request while the postprocessor input queue of one
+ *              of its output channels is full. Called without mMutex so that
+ *              the channels never block in request() under the HAL lock.
+ *
+ * PARAMETERS :
+ *   @request : request from framework to process
+ *
+ * RETURN     : None
+ *
+ *==========================================================================*/
+void QCamera3HardwareInterface::waitPostProcInputSpace(
+        const camera3_capture_request_t *request)
+{
+    if ((request == NULL) || (request->output_buffers == NULL) ||
+            (request->num_output_buffers >= MAX_NUM_STREAMS)) {
+        return;
+    }
+
+    bool reprocess = (request->input_buffer != NULL);
+    for (size_t i = 0; i < request->num_output_buffers; i++) {
+        const camera3_stream_buffer_t& output = request->output_buffers[i];
+        if ((output.stream == NULL) || (output.stream->priv == NULL)) {
+            continue;
+        }
+        QCamera3Channel *channel = (QCamera3Channel *)output.stream->priv;
+        channel->waitForPostProcInputSpace(reprocess);
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : processCaptureRequest
  *
@@ -4892,6 +5342,15 @@ int QCamera3HardwareInterface::processCaptureRequest(
     bool isVidBufRequested = false;
     camera3_stream_buffer_t *pInputBuffer = NULL;
     char prop[PROPERTY_VALUE_MAX];
+    nsecs_t requestStartNs = systemTime();
+    nsecs_t settingsNs = 0;
+
+    // Wait for the acquire fences before taking mMutex so that result
+    // handling is not held off while the producer of a buffer is still
+    // writing to it. Errors are left to the checks done under the lock.
+    waitRequestFences(request);
+    // Postprocessor backpressure is applied here for the same reason.
+    waitPostProcInputSpace(request);
 
     pthread_mutex_lock(&mMutex);
 
@@ -4908,7 +5367,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
             return -ENODEV;
 
         default:
-            LOGE("Invalid state %d", mState);
+            LOGE("Invalid state %d", mState.load());
             pthread_mutex_unlock(&mMutex);
             return -ENODEV;
     }
@@ -4925,6 +5384,8 @@ int QCamera3HardwareInterface::processCaptureRequest(
     // For first capture request, send capture intent, and
     // stream on all streams
     if (mState == CONFIGURED) {
+        nsecs_t setupStartTs = systemTime();
+        nsecs_t initStartTs = setupStartTs;
         logEaselEvent("EASEL_STARTUP_LATENCY", "First request");
         // send an unconfigure to the backend so that the isp
         // resources are deallocated
@@ -5099,6 +5560,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 LOGE("setHalFpsRange failed");
             }
         }
+        mRequestGate.setLimits(mMinInFlightRequests, mMaxInFlightRequests);
         if (meta.exists(ANDROID_CONTROL_MODE)) {
             uint8_t metaMode = meta.find(ANDROID_CONTROL_MODE).data.u8[0];
             rc = extractSceneMode(meta, metaMode, mParameters);
@@ -5182,12 +5644,12 @@ int QCamera3HardwareInterface::processCaptureRequest(
         }
 
         //First initialize all streams
+        initStartTs = systemTime();
         for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
             it != mStreamInfo.end(); it++) {
             QCamera3Channel *channel = (QCamera3Channel *)(*it)->stream->priv;
+            cam_is_type_t channelIsType = IS_TYPE_NONE;
 
-            /* Initial value of NR mode is needed before stream on */
-            channel->setNRMode(nrMode);
             if ((((1U << CAM_STREAM_TYPE_VIDEO) == channel->getStreamTypeMask()) ||
                ((1U << CAM_STREAM_TYPE_PREVIEW) == channel->getStreamTypeMask())) &&
                setEis) {
@@ -5197,10 +5659,23 @@ int QCamera3HardwareInterface::processCaptureRequest(
                         break;
                     }
                 }
-                rc = channel->initialize(is_type);
-            } else {
-                rc = channel->initialize(IS_TYPE_NONE);
+                channelIsType = is_type;
             }
+
+            /* A channel kept from the previous configuration still has its
+             * backend stream and buffer mappings: the stream info unconfigure
+             * above leaves added streams in place, as it does for the kept
+             * metadata stream. Re-add the stream only if the IS type or the
+             * initial NR mode it was added with changed. */
+            if ((channel->getNumOfStreams() > 0) &&
+                    ((channel->getNRMode() != nrMode) ||
+                    (channel->getIsType() != channelIsType))) {
+                channel->destroy();
+            }
+
+            /* Initial value of NR mode is needed before stream on */
+            channel->setNRMode(nrMode);
+            rc = channel->initialize(channelIsType);
             if (NO_ERROR != rc) {
                 LOGE("Channel initialization failed %d", rc);
                 pthread_mutex_unlock(&mMutex);
@@ -5224,7 +5699,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 goto error_exit;
             }
         }
-        if (mSupportChannel) {
+        if (mSupportChannel && (mSupportChannel->getNumOfStreams() == 0)) {
             rc = mSupportChannel->initialize(IS_TYPE_NONE);
             if (rc < 0) {
                 LOGE("Support channel initialization failed");
@@ -5232,7 +5707,7 @@ int QCamera3HardwareInterface::processCaptureRequest(
                 goto error_exit;
             }
         }
-        if (mAnalysisChannel) {
+        if (mAnalysisChannel && (mAnalysisChannel->getNumOfStreams() == 0)) {
             rc = mAnalysisChannel->initialize(IS_TYPE_NONE);
             if (rc < 0) {
                 LOGE("Analysis channel initialization failed");
@@ -5335,19 +5810,23 @@ error_exit:
         mPerfLockMgr.releasePerfLock(PERF_LOCK_START_PREVIEW);
         return rc;
 no_error:
-        mWokenUpByDaemon = false;
-        mPendingLiveRequest = 0;
+        mRequestGate.reset();
         mFirstConfiguration = false;
+        nsecs_t setupEndTs = systemTime();
+        LOGH("First request stream setup took %lld us: config %lld, init %lld",
+                (long long)ns2us(setupEndTs - setupStartTs),
+                (long long)ns2us(initStartTs - setupStartTs),
+                (long long)ns2us(setupEndTs - initStartTs));
     }
 
     uint32_t frameNumber = request->frame_number;
     cam_stream_ID_t streamsArray;
 
-    if (mFlushPerf) {
-        //we cannot accept any requests during flush
-        LOGE("process_capture_request cannot proceed during flush");
-        pthread_mutex_unlock(&mMutex);
-        return NO_ERROR; //should return an error
+    // Streams stay on during a fast flush, hold the request until the
+    // pending ones have been returned.
+    if (mFlushPerf.isHeld()) {
+        LOGD("Request %d waits for flush", frameNumber);
+        mFlushPerf.waitWhileHeld(&mMutex);
     }
 
     if (meta.exists(ANDROID_REQUEST_ID)) {
@@ -5507,6 +5986,7 @@ no_error:
                 pthread_mutex_unlock(&mMutex);
                 return rc;
             }
+            settingsNs = systemTime();
 
             {
                 // If HDR+ mode is enabled, override the following modes so the necessary metadata
@@ -5688,6 +6168,11 @@ no_error:
         mOutputBufferDispatcher.expectBuffer(frameNumber, request->output_buffers[i].stream);
     }
 
+    mFrameTimeline.begin(frameNumber, requestStartNs, request->num_output_buffers);
+    if (settingsNs != 0) {
+        mFrameTimeline.mark(frameNumber, TIMELINE_STAGE_SETTINGS, settingsNs);
+    }
+
     if(mFlush) {
         LOGI("mFlush is true");
         pthread_mutex_unlock(&mMutex);
@@ -5839,8 +6324,17 @@ no_error:
 
                 if (((1U << CAM_STREAM_TYPE_VIDEO) == channel->getStreamTypeMask())
                         && mBatchSize) {
+                    if (!mToBeQueuedVidBufs) {
+                        mHFRBatch.onBatchOpen(systemTime());
+                        if (mHFRBatch.isDynamic()) {
+                            startHfrBatchFlusherLocked();
+                            pthread_cond_signal(&mBatchFlushCond);
+                        }
+                    }
                     mToBeQueuedVidBufs++;
-                    if (mToBeQueuedVidBufs == mBatchSize) {
+                    mLastFrameNumberInBatch = frameNumber;
+                    mBatchVideoChannel = channel;
+                    if (mHFRBatch.isFull(mToBeQueuedVidBufs)) {
                         channel->queueBatchBuf();
                     }
                 }
@@ -5970,14 +6464,16 @@ no_error:
              * - For every request in HFR mode during preview only case
              * - Once every batch in HFR mode during video recording
              */
+            bool batchFull = mBatchSize && isVidBufRequested &&
+                    mHFRBatch.isFull(mToBeQueuedVidBufs);
             if (!mBatchSize ||
                (mBatchSize && !isVidBufRequested) ||
-               (mBatchSize && isVidBufRequested && (mToBeQueuedVidBufs == mBatchSize))) {
+               batchFull) {
                 LOGD("set_parms  batchSz: %d IsVidBufReq: %d vidBufTobeQd: %d ",
                          mBatchSize, isVidBufRequested,
                         mToBeQueuedVidBufs);
 
-                if(mBatchSize && isVidBufRequested && (mToBeQueuedVidBufs == mBatchSize)) {
+                if (batchFull) {
                     for (uint32_t k = 0; k < streamsArray.num_streams; k++) {
                         uint32_t m = 0;
                         for (m = 0; m < mBatchedStreamsArray.num_streams; m++) {
@@ -6011,11 +6507,15 @@ no_error:
                 if (rc < 0) {
                     LOGE("set_parms failed");
                 }
+                if (batchFull) {
+                    mHFRBatch.onBatchSubmit(frameNumber, mToBeQueuedVidBufs,
+                            HFR_BATCH_FLUSH_FULL, systemTime());
+                }
                 /* reset to zero coz, the batch is queued */
                 mToBeQueuedVidBufs = 0;
                 mPendingBatchMap.add(frameNumber, mFirstFrameNumberInBatch);
                 memset(&mBatchedStreamsArray, 0, sizeof(cam_stream_ID_t));
-            } else if (mBatchSize && isVidBufRequested && (mToBeQueuedVidBufs != mBatchSize)) {
+            } else if (mBatchSize && isVidBufRequested) {
                 for (uint32_t k = 0; k < streamsArray.num_streams; k++) {
                     uint32_t m = 0;
                     for (m = 0; m < mBatchedStreamsArray.num_streams; m++) {
@@ -6032,7 +6532,7 @@ no_error:
                     }
                 }
             }
-            mPendingLiveRequest++;
+            mRequestGate.onRequestSent();
 
             // Start all streams after the first setting is sent, so that the
             // setting can be applied sooner: (0 + apply_delay)th frame.
@@ -6142,54 +6642,32 @@ no_error:
         }
     }
 
-    LOGD("mPendingLiveRequest = %d", mPendingLiveRequest);
+    LOGD("live requests in flight = %d", mRequestGate.getInFlight());
 
     mState = STARTED;
-    // Added a timed condition wait
-    struct timespec ts;
-    uint8_t isValidTimeout = 1;
-    rc = clock_gettime(CLOCK_MONOTONIC, &ts);
-    if (rc < 0) {
-      isValidTimeout = 0;
-      LOGE("Error reading the real time clock!!");
-    }
-    else {
-      // Make timeout as 5 sec for request to be honored
-      int64_t timeout = 5;
-      {
-          Mutex::Autolock lock(mHdrPlusPendingRequestsLock);
-          // If there is a pending HDR+ request, the following requests may be blocked until the
-          // HDR+ request is done. So allow a longer timeout.
-          if (mHdrPlusPendingRequests.size() > 0) {
-              timeout = MISSING_HDRPLUS_REQUEST_BUF_TIMEOUT;
-          }
-      }
-      ts.tv_sec += timeout;
-    }
-    //Block on conditional variable
-    while ((mPendingLiveRequest >= mMinInFlightRequests) && !pInputBuffer &&
-            (mState != ERROR) && (mState != DEINIT)) {
-        if (!isValidTimeout) {
-            LOGD("Blocking on conditional wait");
-            pthread_cond_wait(&mRequestCond, &mMutex);
-        }
-        else {
-            LOGD("Blocking on timed conditional wait");
-            rc = pthread_cond_timedwait(&mRequestCond, &mMutex, &ts);
-            if (rc == ETIMEDOUT) {
-                rc = -ENODEV;
-                LOGE("Unblocked on timeout!!!!");
-                break;
+    pthread_mutex_unlock(&mMutex);
+
+    // The request is queued, errors logged above do not fail it
+    rc = NO_ERROR;
+    // Reprocess requests do not count against the in flight limit
+    if (pInputBuffer == NULL) {
+        // Make timeout as 5 sec for request to be honored
+        int64_t timeout = 5;
+        {
+            Mutex::Autolock lock(mHdrPlusPendingRequestsLock);
+            // If there is a pending HDR+ request, the following requests may be blocked until the
+            // HDR+ request is done. So allow a longer timeout.
+            if (mHdrPlusPendingRequests.size() > 0) {
+                timeout = MISSING_HDRPLUS_REQUEST_BUF_TIMEOUT;
             }
         }
-        LOGD("Unblocked");
-        if (mWokenUpByDaemon) {
-            mWokenUpByDaemon = false;
-            if (mPendingLiveRequest < mMaxInFlightRequests)
-                break;
+        // Block in the request gate, results keep flowing on mMutex meanwhile
+        if (mRequestGate.waitForSpace(systemTime() + s2ns(timeout),
+                requestGateStopped, this) != NO_ERROR) {
+            rc = -ENODEV;
+            LOGE("Unblocked on timeout!!!!");
         }
     }
-    pthread_mutex_unlock(&mMutex);
 
     return rc;
 }
@@ -6310,6 +6788,27 @@ void QCamera3HardwareInterface::dump(int fd)
     }
     dprintf(fd, "-------+-----------\n");
 
+    dispatch_stats_t shutterStats = mShutterDispatcher.getStats();
+    dispatch_stats_t bufferStats = mOutputBufferDispatcher.getStats();
+    dprintf(fd, "\nIn-order dispatch head-of-line blocking\n");
+    dprintf(fd, "---------+------------+---------+------------+----------\n");
+    dprintf(fd, " Type    | Dispatched | Blocked | Total (us) | Max (us) \n");
+    dprintf(fd, "---------+------------+---------+------------+----------\n");
+    dprintf(fd, " Shutter | %10" PRIu64 " | %7" PRIu64 " | %10" PRId64 " | %8" PRId64 "\n",
+            shutterStats.dispatched, shutterStats.blocked,
+            shutterStats.totalBlockedNs / 1000, shutterStats.maxBlockedNs / 1000);
+    dprintf(fd, " Buffer  | %10" PRIu64 " | %7" PRIu64 " | %10" PRId64 " | %8" PRId64 "\n",
+            bufferStats.dispatched, bufferStats.blocked,
+            bufferStats.totalBlockedNs / 1000, bufferStats.maxBlockedNs / 1000);
+    dprintf(fd, "---------+------------+---------+------------+----------\n");
+
+    mFrameTimeline.dump(fd);
+    mHFRBatch.dump(fd);
+    mFlushStats.dump(fd);
+    mPerfLockMgr.dump(fd);
+
+    camscope_dump(CAMSCOPE_SECTION_HAL, fd);
+
     dprintf(fd, "\n Camera HAL3 information End \n");
 
     /* use dumpsys media.camera as trigger to send update debug level event */
@@ -6342,6 +6841,9 @@ int QCamera3HardwareInterface::flush(bool restartChannels, bool stopChannelImmed
     LOGD("Unblocking Process Capture Request");
     pthread_mutex_lock(&mMutex);
     mFlush = true;
+    if (restartChannels) {
+        mFlushStats.onFlushStart(systemTime());
+    }
     pthread_mutex_unlock(&mMutex);
 
     // Disable HDR+ if it's enabled;
@@ -6401,8 +6903,7 @@ int QCamera3HardwareInterface::flush(bool restartChannels, bool stopChannelImmed
     pthread_mutex_lock(&mMutex);
 
     // Unblock process_capture_request
-    mPendingLiveRequest = 0;
-    pthread_cond_signal(&mRequestCond);
+    mRequestGate.reset();
 
     rc = notifyErrorForPendingRequests();
     if (rc < 0) {
@@ -6430,6 +6931,7 @@ int QCamera3HardwareInterface::flush(bool restartChannels, bool stopChannelImmed
                 return rc;
             }
         }
+        mFlushStats.onFlushDone(FLUSH_PATH_FULL, 0, systemTime());
     }
     pthread_mutex_unlock(&mMutex);
 
@@ -6440,10 +6942,12 @@ int QCamera3HardwareInterface::flush(bool restartChannels, bool stopChannelImmed
  * FUNCTION   : flushPerf
  *
  * DESCRIPTION: This is the performance optimization version of flush that does
- *              not use stream off, rather flushes the system
- *
- * PARAMETERS :
+ *              not use stream off. The backend is flushed, every stream recalls
+ *              the buffers it has queued and waits for them to come back, then
+ *              the pending requests are returned with errors. Falls back to
+ *              flush(true) when a stream can't be drained this way.
  *
+ * PARAMETERS : None
  *
  * RETURN     : 0 : success
  *              -EINVAL: input is malformed (device is not valid)
@@ -6453,64 +6957,82 @@ int QCamera3HardwareInterface::flushPerf()
 {
     KPI_ATRACE_CAMSCOPE_CALL(CAMSCOPE_HAL3_STOP_PREVIEW);
     int32_t rc = 0;
-    struct timespec timeout;
-    bool timed_wait = false;
+    uint32_t recalled = 0;
+    Vector<QCamera3Channel *> channels;
 
     pthread_mutex_lock(&mMutex);
-    mFlushPerf = true;
+    nsecs_t startTs = systemTime();
+    mFlushStats.onFlushStart(startTs);
+
+    // Batch streams are recalled by the backend only as a whole batch, and
+    // HDR+ and linked sessions have buffers outside this HAL.
+    if (mBatchSize || mHdrPlusModeEnabled || mIsDeviceLinked) {
+        LOGH("Fast flush not supported, batch %d hdrplus %d linked %d",
+                mBatchSize, mHdrPlusModeEnabled, mIsDeviceLinked);
+        pthread_mutex_unlock(&mMutex);
+        return flush(true /* restart channels */);
+    }
+
+    mFlushPerf.hold();
     mPendingBuffersMap.numPendingBufsAtFlush =
         mPendingBuffersMap.get_num_overall_buffers();
-    LOGD("Calling flush. Wait for %d buffers to return",
+    LOGD("Calling flush with %d pending buffers",
         mPendingBuffersMap.numPendingBufsAtFlush);
 
     /* send the flush event to the backend */
     rc = mCameraHandle->ops->flush(mCameraHandle->camera_handle);
     if (rc < 0) {
-        LOGE("Error in flush: IOCTL failure");
-        mFlushPerf = false;
-        pthread_mutex_unlock(&mMutex);
-        return -ENODEV;
-    }
-
-    if (mPendingBuffersMap.numPendingBufsAtFlush == 0) {
-        LOGD("No pending buffers in HAL, return flush");
-        mFlushPerf = false;
+        LOGE("Error in flush: IOCTL failure, stopping streams");
+        mFlushPerf.release();
+        mFlushStats.onFallback();
         pthread_mutex_unlock(&mMutex);
-        return rc;
+        return flush(true /* restart channels */);
     }
 
-    /* wait on a signal that buffers were received */
-    rc = clock_gettime(CLOCK_MONOTONIC, &timeout);
-    if (rc < 0) {
-        LOGE("Error reading the real time clock, cannot use timed wait");
-    } else {
-        timeout.tv_sec += FLUSH_TIMEOUT;
-        timed_wait = true;
+    nsecs_t deadline = startTs + mFastFlushTimeout;
+    for (List<stream_info_t *>::iterator it = mStreamInfo.begin();
+            it != mStreamInfo.end(); it++) {
+        QCamera3Channel *channel = (*it)->channel;
+        if (channel) {
+            uint32_t cancelled = 0;
+            if (channel->cancelInflightBufs(deadline, cancelled) != NO_ERROR) {
+                rc = -ENODEV;
+            }
+            recalled += cancelled;
+            channels.add(channel);
+        }
     }
 
-    //Block on conditional variable
-    while (mPendingBuffersMap.numPendingBufsAtFlush != 0) {
-        LOGD("Waiting on mBuffersCond");
-        if (!timed_wait) {
-            rc = pthread_cond_wait(&mBuffersCond, &mMutex);
-            if (rc != 0) {
-                 LOGE("pthread_cond_wait failed due to rc = %s",
-                        strerror(rc));
-                 break;
-            }
-        } else {
-            rc = pthread_cond_timedwait(&mBuffersCond, &mMutex, &timeout);
-            if (rc != 0) {
-                LOGE("pthread_cond_timedwait failed due to rc = %s",
-                            strerror(rc));
-                break;
-            }
+    // Recalled buffers are returned through the channel callbacks, which
+    // need mMutex.
+    pthread_mutex_unlock(&mMutex);
+    for (size_t i = 0; (rc == 0) && (i < channels.size()); i++) {
+        if (channels[i]->waitInflightBufs(deadline) != NO_ERROR) {
+            rc = -ENODEV;
         }
     }
+    pthread_mutex_lock(&mMutex);
+
     if (rc != 0) {
-        mFlushPerf = false;
+        LOGE("Buffers not recalled in %lld ms, stopping streams",
+                (long long)ns2ms(mFastFlushTimeout));
+        mFlushPerf.release();
+        mFlushStats.onFallback();
         pthread_mutex_unlock(&mMutex);
-        return -ENODEV;
+        return flush(true /* restart channels */);
+    }
+
+    // A reprocess or jpeg job writes into its framework output buffer until
+    // it completes, so its request cannot be errored out with the streams
+    // still running.
+    for (size_t i = 0; i < channels.size(); i++) {
+        if (!channels[i]->flushPostProcIfIdle()) {
+            LOGH("Postprocess jobs in flight, stopping streams");
+            mFlushPerf.release();
+            mFlushStats.onFallback();
+            pthread_mutex_unlock(&mMutex);
+            return flush(true /* restart channels */);
+        }
     }
 
     LOGD("Received buffers, now safe to return them");
@@ -6533,20 +7055,21 @@ int QCamera3HardwareInterface::flushPerf()
     }
 
     /* notify the frameworks and send errored results */
-    rc = notifyErrorForPendingRequests();
-    if (rc < 0) {
+    int32_t err = notifyErrorForPendingRequests();
+    if (err < 0) {
         LOGE("notifyErrorForPendingRequests failed");
-        pthread_mutex_unlock(&mMutex);
-        return rc;
+        rc = err;
     }
 
     //unblock process_capture_request
-    mPendingLiveRequest = 0;
-    unblockRequestIfNecessary();
+    mRequestGate.reset();
+    mFlushPerf.release();
 
-    mFlushPerf = false;
+    nsecs_t endTs = systemTime();
+    mFlushStats.onFlushDone(FLUSH_PATH_FAST, recalled, endTs);
     pthread_mutex_unlock(&mMutex);
-    LOGD ("Flush Operation complete. rc = %d", rc);
+    LOGH("Flush complete, recalled %u buffers in %lld us, rc = %d", recalled,
+            (long long)ns2us(endTs - startTs), rc);
     return rc;
 }
 
@@ -6584,6 +7107,7 @@ int32_t QCamera3HardwareInterface::handleCameraDeviceError(bool stopChannelImmed
 
         pthread_mutex_lock(&mMutex);
         mState = DEINIT;
+        mRequestGate.wake();
         pthread_mutex_unlock(&mMutex);
     }
 
@@ -11187,6 +11711,92 @@ int QCamera3HardwareInterface::initHdrPlusClientLocked() {
     return OK;
 }
 
+/*===========================================================================
+ * FUNCTION   : loadCachedStaticInfo
+ *
+ * DESCRIPTION: restore capabilities and static metadata of a camera from the
+ *              capability cache. Either both are restored or neither.
+ *              Must be called with gCamLock held.
+ *
+ * PARAMETERS :
+ *   @cameraId  : camera Id
+ *   @identity  : camera identity from the current enumeration
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::loadCachedStaticInfo(uint32_t cameraId,
+        uint64_t identity)
+{
+    QCameraCapsCache *pCache = QCameraCommon::getCapsCache();
+    const void *pData = NULL;
+    size_t size = 0;
+    if ((pCache == NULL) || (pCache->lookup(cameraId, CAPS_CACHE_SECTION_HAL3_META,
+            identity, &pData, &size) != NO_ERROR)) {
+        return;
+    }
+
+    if ((size < sizeof(camera_metadata_t)) ||
+            (validate_camera_metadata_structure((const camera_metadata_t *)pData,
+            &size) != OK)) {
+        LOGW("Cached static metadata of camera %d is invalid", cameraId);
+        return;
+    }
+
+    cam_capability_t *pCap = QCameraCommon::loadCachedCapability(cameraId,
+            CAPS_CACHE_SECTION_HAL3_CAPS, identity);
+    if (pCap == NULL) {
+        return;
+    }
+
+    camera_metadata_t *pMeta = clone_camera_metadata((const camera_metadata_t *)pData);
+    if (pMeta == NULL) {
+        LOGE("out of memory");
+        free(pCap->main_cam_cap);
+        free(pCap->aux_cam_cap);
+        free(pCap);
+        return;
+    }
+
+    pCap->camera_index = cameraId;
+    gCamCapability[cameraId] = pCap;
+    gStaticMetadata[cameraId] = pMeta;
+    LOGH("Static info of camera %d loaded from cache", cameraId);
+}
+
+/*===========================================================================
+ * FUNCTION   : storeCachedStaticInfo
+ *
+ * DESCRIPTION: save capabilities and static metadata of a camera in the
+ *              capability cache. Capabilities are saved after
+ *              initStaticMetadata so that a cache hit restores the same
+ *              state. Must be called with gCamLock held.
+ *
+ * PARAMETERS :
+ *   @cameraId  : camera Id
+ *   @identity  : camera identity from the current enumeration
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3HardwareInterface::storeCachedStaticInfo(uint32_t cameraId,
+        uint64_t identity)
+{
+    QCameraCapsCache *pCache = QCameraCommon::getCapsCache();
+    if ((pCache == NULL) || (gCamCapability[cameraId] == NULL) ||
+            (gStaticMetadata[cameraId] == NULL)) {
+        return;
+    }
+
+    const camera_metadata_t *pMeta = gStaticMetadata[cameraId];
+    int32_t rc = pCache->store(cameraId, CAPS_CACHE_SECTION_HAL3_META, identity,
+            pMeta, get_camera_metadata_size(pMeta));
+    if (rc != NO_ERROR) {
+        LOGW("Failed to save static metadata of camera %d: %d", cameraId, rc);
+        return;
+    }
+    QCameraCommon::storeCachedCapability(cameraId, CAPS_CACHE_SECTION_HAL3_CAPS,
+            identity, gCamCapability[cameraId]);
+}
+
 /*===========================================================================
  * FUNCTION   : getCamInfo
  *
@@ -11218,6 +11828,18 @@ int QCamera3HardwareInterface::getCamInfo(uint32_t cameraId,
         }
     }
 
+    // Static metadata depends on Easel presence, so it is part of the identity.
+    bool easelPresent = (gEaselManagerClient != nullptr) &&
+            gEaselManagerClient->isEaselPresentOnDevice();
+    uint64_t identity = QCameraCommon::getCameraIdentity(cameraId);
+    identity = QCameraCapsCache::hash(&easelPresent, sizeof(easelPresent), identity);
+    bool cacheMiss = false;
+
+    if ((NULL == gCamCapability[cameraId]) && (NULL == gStaticMetadata[cameraId])) {
+        loadCachedStaticInfo(cameraId, identity);
+        cacheMiss = (NULL == gStaticMetadata[cameraId]);
+    }
+
     if (NULL == gCamCapability[cameraId]) {
         rc = initCapabilities(cameraId);
         if (rc < 0) {
@@ -11234,6 +11856,10 @@ int QCamera3HardwareInterface::getCamInfo(uint32_t cameraId,
         }
     }
 
+    if (cacheMiss) {
+        storeCachedStaticInfo(cameraId, identity);
+    }
+
     switch(gCamCapability[cameraId]->position) {
     case CAM_POSITION_BACK:
     case CAM_POSITION_BACK_AUX:
@@ -12295,6 +12921,7 @@ int32_t QCamera3HardwareInterface::setHalFpsRange(const CameraMetadata &settings
                 }
              }
             LOGD("hfrMode: %d batchSize: %d", hfrMode, mBatchSize);
+            mHFRBatch.configure(mBatchSize, (uint32_t)mHFRVideoFps);
 
          }
     } else {
@@ -13641,13 +14268,17 @@ int QCamera3HardwareInterface::flush(
             return -ENODEV;
 
         default:
-            LOGI("Flush returned during state %d", hw->mState);
+            LOGI("Flush returned during state %d", hw->mState.load());
             pthread_mutex_unlock(&hw->mMutex);
             return 0;
     }
     pthread_mutex_unlock(&hw->mMutex);
 
-    rc = hw->flush(true /* restart channels */ );
+    if (hw->mFastFlushEnable) {
+        rc = hw->flushPerf();
+    } else {
+        rc = hw->flush(true /* restart channels */ );
+    }
     LOGD("X");
     return rc;
 }
@@ -15356,6 +15987,7 @@ void QCamera3HardwareInterface::handleEaselFatalError()
 {
     pthread_mutex_lock(&mMutex);
     mState = ERROR;
+    mRequestGate.wake();
     pthread_mutex_unlock(&mMutex);
 
     handleCameraDeviceError(/*stopChannelImmediately*/true);
@@ -15804,6 +16436,9 @@ void QCamera3HardwareInterface::onFailedCaptureResult(pbcamera::CaptureResult *f
 
 
 ShutterDispatcher::ShutterDispatcher(QCamera3HardwareInterface *parent) :
+        mShutters(MAX_INFLIGHT_HFR_REQUESTS),
+        mReprocessShutters(MAX_INFLIGHT_REPROCESS_REQUESTS),
+        mStats(),
         mParent(parent) {}
 
 void ShutterDispatcher::expectShutter(uint32_t frameNumber, bool isReprocess)
@@ -15811,9 +16446,9 @@ void ShutterDispatcher::expectShutter(uint32_t frameNumber, bool isReprocess)
     std::lock_guard<std::mutex> lock(mLock);
 
     if (isReprocess) {
-        mReprocessShutters.emplace(frameNumber, Shutter());
+        mReprocessShutters.expect(frameNumber);
     } else {
-        mShutters.emplace(frameNumber, Shutter());
+        mShutters.expect(frameNumber);
     }
 }
 
@@ -15821,46 +16456,37 @@ void ShutterDispatcher::markShutterReady(uint32_t frameNumber, uint64_t timestam
 {
     std::lock_guard<std::mutex> lock(mLock);
 
-    std::map<uint32_t, Shutter> *shutters = nullptr;
+    FrameNumberRing<Shutter> *shutters = &mShutters;
+    bool ready = false;
 
     // Find the shutter entry.
-    auto shutter = mShutters.find(frameNumber);
-    if (shutter == mShutters.end()) {
-        shutter = mReprocessShutters.find(frameNumber);
-        if (shutter == mReprocessShutters.end()) {
+    Shutter *shutter = mShutters.find(frameNumber, &ready);
+    if (shutter == nullptr) {
+        shutter = mReprocessShutters.find(frameNumber, &ready);
+        if (shutter == nullptr) {
             // Shutter was already sent.
             return;
         }
         shutters = &mReprocessShutters;
-    } else {
-        shutters = &mShutters;
     }
 
-    if (shutter->second.ready) {
+    if (ready) {
         // If shutter is already ready, don't update timestamp again.
         return;
     }
 
     // Make this frame's shutter ready.
-    shutter->second.ready = true;
-    shutter->second.timestamp = timestamp;
-
-    // Iterate throught the shutters and send out shuters until the one that's not ready yet.
-    shutter = shutters->begin();
-    while (shutter != shutters->end()) {
-        if (!shutter->second.ready) {
-            // If this shutter is not ready, the following shutters can't be sent.
-            break;
-        }
+    shutter->timestamp = timestamp;
+    shutters->markReady(frameNumber);
 
+    // Send out shutters in order until the one that's not ready yet.
+    shutters->drain([this](uint32_t readyFrameNumber, Shutter &readyShutter) {
         camera3_notify_msg_t msg = {};
         msg.type = CAMERA3_MSG_SHUTTER;
-        msg.message.shutter.frame_number = shutter->first;
-        msg.message.shutter.timestamp = shutter->second.timestamp;
+        msg.message.shutter.frame_number = readyFrameNumber;
+        msg.message.shutter.timestamp = readyShutter.timestamp;
         mParent->orchestrateNotify(&msg);
-
-        shutter = shutters->erase(shutter);
-    }
+    }, mStats);
 }
 
 void ShutterDispatcher::clear(uint32_t frameNumber)
@@ -15875,24 +16501,29 @@ void ShutterDispatcher::clear()
     std::lock_guard<std::mutex> lock(mLock);
 
     // Log errors for stale shutters.
-    for (auto &shutter : mShutters) {
+    mShutters.forEach([](uint32_t frameNumber, bool ready, Shutter &shutter) {
         ALOGE("%s: stale shutter: frame number %u, ready %d, timestamp %" PRId64,
-            __FUNCTION__, shutter.first, shutter.second.ready,
-            shutter.second.timestamp);
-    }
+            __FUNCTION__, frameNumber, ready, shutter.timestamp);
+    });
 
     // Log errors for stale reprocess shutters.
-    for (auto &shutter : mReprocessShutters) {
+    mReprocessShutters.forEach([](uint32_t frameNumber, bool ready, Shutter &shutter) {
         ALOGE("%s: stale reprocess shutter: frame number %u, ready %d, timestamp %" PRId64,
-            __FUNCTION__, shutter.first, shutter.second.ready,
-            shutter.second.timestamp);
-    }
+            __FUNCTION__, frameNumber, ready, shutter.timestamp);
+    });
 
     mShutters.clear();
     mReprocessShutters.clear();
 }
 
+dispatch_stats_t ShutterDispatcher::getStats()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats;
+}
+
 OutputBufferDispatcher::OutputBufferDispatcher(QCamera3HardwareInterface *parent) :
+        mStats(),
         mParent(parent) {}
 
 status_t OutputBufferDispatcher::configureStreams(camera3_stream_configuration_t *streamList)
@@ -15904,27 +16535,43 @@ status_t OutputBufferDispatcher::configureStreams(camera3_stream_configuration_t
         return -EINVAL;
     }
 
-    // Create a "frame-number -> buffer" map for each stream.
+    // Create a "frame-number -> buffer" ring for each stream, sized for the
+    // number of buffers the stream can have in flight.
+    mStreamBuffers.reserve(streamList->num_streams);
     for (uint32_t i = 0; i < streamList->num_streams; i++) {
-        mStreamBuffers.emplace(streamList->streams[i], std::map<uint32_t, Buffer>());
+        camera3_stream_t *stream = streamList->streams[i];
+        uint32_t capacity = (stream->max_buffers > 0) ?
+                stream->max_buffers : MAX_INFLIGHT_REQUESTS;
+        mStreamBuffers.emplace_back(stream, BufferRing(capacity));
     }
 
     return OK;
 }
 
+OutputBufferDispatcher::BufferRing *OutputBufferDispatcher::findRingLocked(
+        const camera3_stream_t *stream)
+{
+    for (auto &buffers : mStreamBuffers) {
+        if (buffers.first == stream) {
+            return &buffers.second;
+        }
+    }
+    return nullptr;
+}
+
 status_t OutputBufferDispatcher::expectBuffer(uint32_t frameNumber, camera3_stream_t *stream)
 {
     std::lock_guard<std::mutex> lock(mLock);
 
-    // Find the "frame-number -> buffer" map for the stream.
-    auto buffers = mStreamBuffers.find(stream);
-    if (buffers == mStreamBuffers.end()) {
+    // Find the "frame-number -> buffer" ring for the stream.
+    BufferRing *buffers = findRingLocked(stream);
+    if (buffers == nullptr) {
         ALOGE("%s: Stream %p was not configured.", __FUNCTION__, stream);
         return -EINVAL;
     }
 
     // Create an unready buffer for this frame number.
-    buffers->second.emplace(frameNumber, Buffer());
+    buffers->expect(frameNumber);
     return OK;
 }
 
@@ -15933,41 +16580,34 @@ void OutputBufferDispatcher::markBufferReady(uint32_t frameNumber,
 {
     std::lock_guard<std::mutex> lock(mLock);
 
-    // Find the frame number -> buffer map for the stream.
-    auto buffers = mStreamBuffers.find(buffer.stream);
-    if (buffers == mStreamBuffers.end()) {
+    // Find the frame number -> buffer ring for the stream.
+    BufferRing *buffers = findRingLocked(buffer.stream);
+    if (buffers == nullptr) {
         ALOGE("%s: Cannot find pending buffers for stream %p.", __FUNCTION__, buffer.stream);
         return;
     }
 
     // Find the unready buffer this frame number and mark it ready.
-    auto pendingBuffer = buffers->second.find(frameNumber);
-    if (pendingBuffer == buffers->second.end()) {
+    camera3_stream_buffer_t *pendingBuffer = buffers->find(frameNumber);
+    if (pendingBuffer == nullptr) {
         ALOGE("%s: Cannot find the pending buffer for frame number %u.", __FUNCTION__, frameNumber);
         return;
     }
 
-    pendingBuffer->second.ready = true;
-    pendingBuffer->second.buffer = buffer;
-
-    // Iterate through the buffers and send out buffers until the one that's not ready yet.
-    pendingBuffer = buffers->second.begin();
-    while (pendingBuffer != buffers->second.end()) {
-        if (!pendingBuffer->second.ready) {
-            // If this buffer is not ready, the following buffers can't be sent.
-            break;
-        }
+    *pendingBuffer = buffer;
+    buffers->markReady(frameNumber);
 
+    // Send out buffers in order until the one that's not ready yet.
+    buffers->drain([this](uint32_t readyFrameNumber,
+            camera3_stream_buffer_t &readyBuffer) {
         camera3_capture_result_t result = {};
-        result.frame_number = pendingBuffer->first;
+        result.frame_number = readyFrameNumber;
         result.num_output_buffers = 1;
-        result.output_buffers = &pendingBuffer->second.buffer;
+        result.output_buffers = &readyBuffer;
 
         // Send out result with buffer errors.
         mParent->orchestrateResult(&result);
-
-        pendingBuffer = buffers->second.erase(pendingBuffer);
-    }
+    }, mStats);
 }
 
 void OutputBufferDispatcher::clear(bool clearConfiguredStreams)
@@ -15976,10 +16616,12 @@ void OutputBufferDispatcher::clear(bool clearConfiguredStreams)
 
     // Log errors for stale buffers.
     for (auto &buffers : mStreamBuffers) {
-        for (auto &buffer : buffers.second) {
+        camera3_stream_t *stream = buffers.first;
+        buffers.second.forEach([stream](uint32_t frameNumber, bool ready,
+                camera3_stream_buffer_t &) {
             ALOGE("%s: stale buffer: stream %p, frame number %u, ready %d",
-                __FUNCTION__, buffers.first, buffer.first, buffer.second.ready);
-        }
+                __FUNCTION__, stream, frameNumber, ready);
+        });
         buffers.second.clear();
     }
 
@@ -15988,4 +16630,10 @@ void OutputBufferDispatcher::clear(bool clearConfiguredStreams)
     }
 }
 
+dispatch_stats_t OutputBufferDispatcher::getStats()
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mStats;
+}
+
 }; //end namespace qcamera
@@ -32,17 +32,24 @@
 
 // System dependencies
 #include <CameraMetadata.h>
+#include <atomic>
 #include <map>
 #include <mutex>
 #include <pthread.h>
+#include <vector>
 #include <utils/KeyedVector.h>
 #include <utils/List.h>
 // Camera dependencies
 #include "hardware/camera3.h"
 #include "QCamera3Channel.h"
 #include "QCamera3CropRegionMapper.h"
+#include "QCamera3Flush.h"
+#include "QCamera3FrameTimeline.h"
+#include "QCamera3HFRBatch.h"
 #include "QCamera3HALHeader.h"
 #include "QCamera3Mem.h"
+#include "QCamera3RequestGate.h"
+#include "QCamera3StreamConfig.h"
 #include "QCameraPerf.h"
 #include "QCameraCommon.h"
 #include "QCamera3VendorTags.h"
@@ -109,6 +116,10 @@ typedef struct {
     int registered;
     QCamera3ProcessingChannel *channel;
     uint32_t id; // unique ID
+    stream_config_key_t config_key;
+    uint32_t fwk_usage; // usage requested by the framework
+    uint32_t hal_usage; // usage after HAL flags were added
+    uint32_t max_buffers;
 } stream_info_t;
 
 typedef struct {
@@ -161,6 +172,203 @@ private:
 
 class QCamera3HardwareInterface;
 
+/*
+ * Head-of-line blocking statistics of an in-order dispatcher. A result is
+ * blocked when it is ready but has to wait for a result of an earlier frame.
+ */
+typedef struct {
+    uint64_t dispatched;      // Results dispatched.
+    uint64_t blocked;         // Results that waited behind an earlier frame.
+    nsecs_t totalBlockedNs;   // Total time results spent blocked.
+    nsecs_t maxBlockedNs;     // Longest time a single result was blocked.
+} dispatch_stats_t;
+
+/*
+ * FrameNumberRing keeps pending entries in a fixed-capacity ring indexed by
+ * frame number offset from the oldest pending frame (head). Frame numbers
+ * without an entry are left empty and skipped as the head advances. The ring
+ * only reallocates when the span between the oldest and newest pending frame
+ * exceeds its capacity. Not thread safe; callers provide locking.
+ */
+template <typename T>
+class FrameNumberRing {
+public:
+    FrameNumberRing(uint32_t capacity = 0) : mHead(0), mTail(0), mCount(0) {
+        reset(capacity);
+    }
+
+    // Drop all entries and resize the ring to hold at least capacity frames.
+    void reset(uint32_t capacity) {
+        uint32_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mSlots.assign(size, Slot());
+        mHead = mTail = 0;
+        mCount = 0;
+    }
+
+    // Add an unready entry for a frame number. Returns false if it exists.
+    bool expect(uint32_t frameNumber) {
+        if (mCount == 0) {
+            mHead = mTail = frameNumber;
+        }
+        uint32_t head = ((int32_t)(frameNumber - mHead) < 0) ? frameNumber : mHead;
+        uint32_t tail = ((int32_t)(frameNumber - mTail) >= 0) ? frameNumber + 1 : mTail;
+        if ((tail - head) > mSlots.size()) {
+            grow(tail - head);
+        }
+        // Slots outside the pending window are always empty.
+        Slot &slot = mSlots[frameNumber & (mSlots.size() - 1)];
+        if (slot.state != EMPTY) {
+            return false;
+        }
+        mHead = head;
+        mTail = tail;
+        slot = Slot();
+        slot.state = PENDING;
+        mCount++;
+        return true;
+    }
+
+    // Return the pending entry for a frame number, or nullptr.
+    T *find(uint32_t frameNumber, bool *ready = nullptr) {
+        Slot *slot = findSlot(frameNumber);
+        if (slot == nullptr) {
+            return nullptr;
+        }
+        if (ready != nullptr) {
+            *ready = (slot->state == READY);
+        }
+        return &slot->value;
+    }
+
+    // Mark the entry of a frame number ready to be dispatched.
+    bool markReady(uint32_t frameNumber) {
+        Slot *slot = findSlot(frameNumber);
+        if ((slot == nullptr) || (slot->state == READY)) {
+            return false;
+        }
+        slot->state = READY;
+        slot->readyTs = systemTime();
+        return true;
+    }
+
+    // Remove the entry of a frame number without dispatching it.
+    void erase(uint32_t frameNumber) {
+        Slot *slot = findSlot(frameNumber);
+        if (slot != nullptr) {
+            *slot = Slot();
+            mCount--;
+            advance();
+        }
+    }
+
+    // Dispatch ready entries in frame number order until the first unready
+    // one. The first entry dispatched is the one that unblocked the head; any
+    // entries behind it were ready earlier and count as blocked.
+    template <typename F>
+    void drain(F dispatch, dispatch_stats_t &stats) {
+        bool unblocking = true;
+        advance();
+        while (mCount > 0) {
+            Slot &slot = mSlots[mHead & (mSlots.size() - 1)];
+            if (slot.state != READY) {
+                break;
+            }
+            stats.dispatched++;
+            if (!unblocking) {
+                nsecs_t blockedNs = systemTime() - slot.readyTs;
+                stats.blocked++;
+                stats.totalBlockedNs += blockedNs;
+                if (blockedNs > stats.maxBlockedNs) {
+                    stats.maxBlockedNs = blockedNs;
+                }
+            }
+            unblocking = false;
+            dispatch(mHead, slot.value);
+            slot = Slot();
+            mCount--;
+            mHead++;
+            advance();
+        }
+    }
+
+    // Visit all pending entries in frame number order.
+    template <typename F>
+    void forEach(F visit) {
+        for (uint32_t frameNumber = mHead; mCount > 0 && frameNumber != mTail;
+                frameNumber++) {
+            Slot &slot = mSlots[frameNumber & (mSlots.size() - 1)];
+            if (slot.state != EMPTY) {
+                visit(frameNumber, slot.state == READY, slot.value);
+            }
+        }
+    }
+
+    // Drop all entries, keeping the capacity.
+    void clear() {
+        for (auto &slot : mSlots) {
+            slot = Slot();
+        }
+        mHead = mTail = 0;
+        mCount = 0;
+    }
+
+    uint32_t size() const { return mCount; }
+
+private:
+    enum State { EMPTY, PENDING, READY };
+    struct Slot {
+        State state;
+        nsecs_t readyTs;
+        T value;
+        Slot() : state(EMPTY), readyTs(0), value() {};
+    };
+
+    bool inWindow(uint32_t frameNumber) const {
+        return (mCount > 0) && ((frameNumber - mHead) < (mTail - mHead));
+    }
+
+    Slot *findSlot(uint32_t frameNumber) {
+        if (!inWindow(frameNumber)) {
+            return nullptr;
+        }
+        Slot &slot = mSlots[frameNumber & (mSlots.size() - 1)];
+        return (slot.state == EMPTY) ? nullptr : &slot;
+    }
+
+    // Skip empty slots at the head.
+    void advance() {
+        if (mCount == 0) {
+            mHead = mTail;
+            return;
+        }
+        while (mSlots[mHead & (mSlots.size() - 1)].state == EMPTY) {
+            mHead++;
+        }
+    }
+
+    void grow(uint32_t span) {
+        size_t size = mSlots.size();
+        while (size < span) {
+            size <<= 1;
+        }
+        std::vector<Slot> slots(size);
+        for (uint32_t frameNumber = mHead; mCount > 0 && frameNumber != mTail;
+                frameNumber++) {
+            slots[frameNumber & (size - 1)] =
+                    mSlots[frameNumber & (mSlots.size() - 1)];
+        }
+        mSlots.swap(slots);
+    }
+
+    std::vector<Slot> mSlots;
+    uint32_t mHead;   // Oldest frame number that may have an entry.
+    uint32_t mTail;   // One past the newest frame number with an entry.
+    uint32_t mCount;  // Number of non-empty slots.
+};
+
 /*
  * ShutterDispatcher class dispatches shutter callbacks in order of the frame
  * number. It will dispatch a shutter callback only after all shutter callbacks
@@ -179,19 +387,21 @@ public:
     void clear(uint32_t frameNumber);
     // Discard all pending shutters.
     void clear();
+    // Get head-of-line blocking statistics.
+    dispatch_stats_t getStats();
 
 private:
     struct Shutter {
-        bool ready; // If the shutter is ready.
         uint64_t timestamp; // Timestamp of the shutter.
-        Shutter() : ready(false), timestamp(0) {};
+        Shutter() : timestamp(0) {};
     };
 
     std::mutex mLock;
 
-    // frame number -> shutter map. Protected by mLock.
-    std::map<uint32_t, Shutter> mShutters;
-    std::map<uint32_t, Shutter> mReprocessShutters;
+    // frame number -> shutter rings. Protected by mLock.
+    FrameNumberRing<Shutter> mShutters;
+    FrameNumberRing<Shutter> mReprocessShutters;
+    dispatch_stats_t mStats;
 
     QCamera3HardwareInterface *mParent;
 };
@@ -215,18 +425,19 @@ public:
     // Discard all pending buffers. If clearConfiguredStreams is true, discard configured streams
     // as well.
     void clear(bool clearConfiguredStreams = true);
+    // Get head-of-line blocking statistics.
+    dispatch_stats_t getStats();
 
 private:
-    struct Buffer {
-        bool ready; // If the buffer is ready.
-        camera3_stream_buffer_t buffer;
-        Buffer() : ready(false), buffer({}) {};
-    };
+    typedef FrameNumberRing<camera3_stream_buffer_t> BufferRing;
+
+    BufferRing *findRingLocked(const camera3_stream_t *stream);
 
     std::mutex mLock;
 
-    // A two-level map: stream -> (frame number -> buffer). Protected by mLock.
-    std::map<camera3_stream_t*, std::map<uint32_t, Buffer>> mStreamBuffers;
+    // stream -> (frame number -> buffer) rings. Protected by mLock.
+    std::vector<std::pair<camera3_stream_t*, BufferRing>> mStreamBuffers;
+    dispatch_stats_t mStats;
 
     QCamera3HardwareInterface *mParent;
 };
@@ -271,6 +482,8 @@ public:
             uint32_t cam_handle);
     static int initCapabilities(uint32_t cameraId);
     static int initStaticMetadata(uint32_t cameraId);
+    static void loadCachedStaticInfo(uint32_t cameraId, uint64_t identity);
+    static void storeCachedStaticInfo(uint32_t cameraId, uint64_t identity);
     static int initHdrPlusClientLocked();
     static void makeTable(cam_dimension_t *dimTable, size_t size,
             size_t max_size, int32_t *sizeTable);
@@ -352,6 +565,10 @@ public:
     void setBufferErrorStatus(QCamera3Channel*, uint32_t frameNumber,
             camera3_buffer_status_t err);
     bool is60HzZone();
+    // Record a post processing stage in the per-frame latency timeline.
+    void markFrameStage(uint32_t frameNumber, timeline_stage_t stage) {
+        mFrameTimeline.mark(frameNumber, stage);
+    }
 
     // Get dual camera related info
     bool isDeviceLinked() {return mIsDeviceLinked;}
@@ -425,6 +642,10 @@ private:
             bool lastUrgentMetadataInBatch,
             bool lastMetadataInBatch,
             bool *p_is_metabuf_queued);
+    int32_t flushHfrBatchLocked();
+    void startHfrBatchFlusherLocked();
+    void stopHfrBatchFlusher();
+    static void *hfrBatchFlushRoutine(void *data);
     void handleBatchMetadata(mm_camera_super_buf_t *metadata_buf,
             bool free_and_bufdone_meta_buf);
     void handleBufferWithLock(camera3_stream_buffer_t *buffer,
@@ -442,13 +663,19 @@ private:
     void handleDepthDataLocked(const cam_depth_data_t &depthData,
             uint32_t frameNumber, uint8_t valid);
     void notifyErrorFoPendingDepthData(QCamera3DepthChannel *depthCh);
-    void unblockRequestIfNecessary();
+    static bool requestGateStopped(void *userdata);
+    void waitRequestFences(const camera3_capture_request_t *request);
+    void waitPostProcInputSpace(const camera3_capture_request_t *request);
     void dumpMetadataToFile(tuning_params_t &meta, uint32_t &dumpFrameCount,
             bool enabled, const char *type, uint32_t frameNumber);
     static void getLogLevel();
     static int32_t getPDStatIndex(cam_capability_t *caps);
 
     void cleanAndSortStreamInfo();
+    bool isChannelReusable(const stream_info_t *streamInfo,
+            const camera3_stream_t *newStream,
+            const stream_config_key_t &configKey);
+    void restoreChannelRef(camera3_stream_t *stream);
     void extractJpegMetadata(CameraMetadata& jpegMetadata,
             const camera3_capture_request_t *request);
 
@@ -536,7 +763,12 @@ private:
      //First request yet to be processed after configureStreams
     bool mFirstConfiguration;
     bool mFlush;
-    bool mFlushPerf;
+    // Held while a fast flush runs, new requests wait for it
+    QCamera3FlushHold mFlushPerf;
+    // Flush by recalling in-flight buffers instead of stopping the streams
+    bool mFastFlushEnable;
+    nsecs_t mFastFlushTimeout;
+    QCamera3FlushStats mFlushStats;
     bool mEnableRawDump;
     bool mForceHdrSnapshot;
     QCamera3HeapMemory *mParamHeap;
@@ -630,14 +862,15 @@ private:
     cam_stream_ID_t mBatchedStreamsArray;
 
     PendingBuffersMap mPendingBuffersMap;
-    pthread_cond_t mRequestCond;
-    uint32_t mPendingLiveRequest;
-    bool mWokenUpByDaemon;
+    // process_capture_request waits here for in-flight requests to drain
+    // without holding mMutex
+    QCamera3RequestGate mRequestGate;
     int32_t mCurrentRequestId;
     cam_stream_size_info_t mStreamConfigInfo;
 
     ShutterDispatcher mShutterDispatcher;
     OutputBufferDispatcher mOutputBufferDispatcher;
+    QCamera3FrameTimeline mFrameTimeline;
 
     //mutex for serialized access to camera3_device_ops_t functions
     pthread_mutex_t mMutex;
@@ -669,6 +902,14 @@ private:
     uint8_t mBatchSize;
     // Used only in batch mode
     uint8_t mToBeQueuedVidBufs;
+    // Batch size used at runtime, up to mBatchSize, and its histograms
+    QCamera3HFRBatch mHFRBatch;
+    uint32_t mLastFrameNumberInBatch;
+    QCamera3Channel *mBatchVideoChannel;
+    // Sends partial batches on their deadline. Waits on mMutex.
+    pthread_t mBatchFlushTid;
+    pthread_cond_t mBatchFlushCond;
+    bool mBatchFlushExit;
     // Fixed video fps
     float mHFRVideoFps;
 public:
@@ -774,7 +1015,8 @@ private:
                             bool lastMetadataInBatch,
                             const bool *enableZsl);
 
-    State mState;
+    // Written with mMutex held, read lock-free by the request gate
+    std::atomic<State> mState;
     //Dual camera related params
     bool mIsDeviceLinked;
     bool mIsMainCamera;
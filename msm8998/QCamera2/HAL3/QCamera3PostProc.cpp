@@ -45,6 +45,7 @@
 extern "C" {
 #include "mm_camera_dbg.h"
 }
+#include "cam_cond.h"
 
 #define ENABLE_MODEL_INFO_EXIF
 
@@ -60,6 +61,11 @@ static const char ExifUndefinedPrefix[] =
 #define EXIF_ASCII_PREFIX_SIZE           8   //(sizeof(ExifAsciiPrefix))
 #define FOCAL_LENGTH_DECIMAL_PRECISION   1000
 
+// Default bound of the queues between postprocessor stages
+#define PP_STAGE_QUEUE_DEPTH_DEFAULT     "8"
+// Max time an input producer is held off by a full input queue
+#define PP_INPUT_WAIT_TIMEOUT_MS         200
+
 /*===========================================================================
  * FUNCTION   : QCamera3PostProcessor
  *
@@ -84,11 +90,24 @@ QCamera3PostProcessor::QCamera3PostProcessor(QCamera3ProcessingChannel* ch_ctrl)
       m_inputJpegQ(releaseJpegData, this),
       m_ongoingJpegQ(releaseJpegData, this),
       m_inputMetaQ(releaseMetadata, this),
-      m_jpegSettingsQ(NULL, this)
+      m_jpegSettingsQ(NULL, this),
+      m_reprocInputQ(releaseReprocInputData, this)
 {
+    char prop[PROPERTY_VALUE_MAX];
+
     memset(&mJpegHandle, 0, sizeof(mJpegHandle));
     memset(&mJpegMetadata, 0, sizeof(mJpegMetadata));
+    memset(mStageStats, 0, sizeof(mStageStats));
+    mJpegResultsPending = 0;
     pthread_mutex_init(&mReprocJobLock, NULL);
+    pthread_mutex_init(&mInputSpaceLock, NULL);
+    PTHREAD_COND_INIT(&mInputSpaceCond);
+    pthread_mutex_init(&mStageStatsLock, NULL);
+
+    // 0 or negative removes the bound between stages
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.pproc.qdepth", prop, PP_STAGE_QUEUE_DEPTH_DEFAULT);
+    mStageQueueDepth = atoi(prop);
 }
 
 /*===========================================================================
@@ -102,6 +121,9 @@ QCamera3PostProcessor::QCamera3PostProcessor(QCamera3ProcessingChannel* ch_ctrl)
  *==========================================================================*/
 QCamera3PostProcessor::~QCamera3PostProcessor()
 {
+    pthread_mutex_destroy(&mStageStatsLock);
+    pthread_cond_destroy(&mInputSpaceCond);
+    pthread_mutex_destroy(&mInputSpaceLock);
     pthread_mutex_destroy(&mReprocJobLock);
 }
 
@@ -121,7 +143,9 @@ int32_t QCamera3PostProcessor::init(QCamera3StreamMem *memory)
 {
     ATRACE_CAMSCOPE_CALL(CAMSCOPE_HAL3_PPROC_INIT);
     mOutputMem = memory;
-    m_dataProcTh.launch(dataProcessRoutine, this);
+    m_jpegTh.launch(jpegRoutine, this);
+    m_reprocTh.launch(reprocessRoutine, this);
+    m_pairingTh.launch(pairingRoutine, this);
 
     return NO_ERROR;
 }
@@ -140,7 +164,9 @@ int32_t QCamera3PostProcessor::init(QCamera3StreamMem *memory)
 int32_t QCamera3PostProcessor::deinit()
 {
     int rc = NO_ERROR;
-    m_dataProcTh.exit();
+    m_pairingTh.exit();
+    m_reprocTh.exit();
+    m_jpegTh.exit();
 
     if (m_pReprocChannel != NULL) {
         m_pReprocChannel->stop();
@@ -213,8 +239,8 @@ int32_t QCamera3PostProcessor::initJpeg(jpeg_encode_callback_t jpeg_cb,
 /*===========================================================================
  * FUNCTION   : start
  *
- * DESCRIPTION: start postprocessor. Data process thread and data notify thread
- *              will be launched.
+ * DESCRIPTION: start postprocessor. Pairing, reprocess and jpeg stage threads
+ *              will be started.
  *
  * PARAMETERS :
  *   @config        : reprocess configuration
@@ -257,7 +283,11 @@ int32_t QCamera3PostProcessor::start(const reprocess_config_t &config)
             }
         }
     }
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, TRUE, FALSE);
+    // start downstream stages first so that upstream never feeds an
+    // inactive queue
+    m_jpegTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, TRUE, FALSE);
+    m_reprocTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, TRUE, FALSE);
+    m_pairingTh.sendCmd(CAMERA_CMD_TYPE_START_DATA_PROC, TRUE, FALSE);
 
     return rc;
 }
@@ -265,7 +295,8 @@ int32_t QCamera3PostProcessor::start(const reprocess_config_t &config)
 /*===========================================================================
  * FUNCTION   : flush
  *
- * DESCRIPTION: stop ongoing postprocess and jpeg jobs
+ * DESCRIPTION: drop queued postprocess inputs and stop ongoing jpeg jobs.
+ *              The stage threads keep running.
  *
  * PARAMETERS : None
  *
@@ -277,6 +308,8 @@ int32_t QCamera3PostProcessor::start(const reprocess_config_t &config)
 int32_t QCamera3PostProcessor::flush()
 {
     int32_t rc = NO_ERROR;
+    flushInputQueues();
+
     qcamera_hal3_jpeg_data_t *jpeg_job =
             (qcamera_hal3_jpeg_data_t *)m_ongoingJpegQ.dequeue();
     while (jpeg_job != NULL) {
@@ -290,10 +323,147 @@ int32_t QCamera3PostProcessor::flush()
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : flushInputQueues
+ *
+ * DESCRIPTION: drop the jobs no stage has picked up yet, upstream first so
+ *              nothing new is handed down while the later queues are emptied.
+ *              Input frames go back to the channel that produced them.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::flushInputQueues()
+{
+    pthread_mutex_lock(&mReprocJobLock);
+    uint32_t dropped = dropInputsLocked();
+    pthread_mutex_unlock(&mReprocJobLock);
+
+    qcamera_hal3_pp_data_t *pp_job =
+            (qcamera_hal3_pp_data_t *)m_reprocInputQ.dequeue();
+    while (pp_job != NULL) {
+        if ((pp_job->pp_buffer != NULL) && (pp_job->pp_buffer->input != NULL)) {
+            m_parent->releaseDroppedInput(pp_job->pp_buffer->input);
+            free(pp_job->pp_buffer->input);
+            pp_job->pp_buffer->input = NULL;
+        }
+        releaseReprocInputData(pp_job, this);
+        free(pp_job);
+        dropped++;
+        pp_job = (qcamera_hal3_pp_data_t *)m_reprocInputQ.dequeue();
+    }
+    m_inputJpegQ.flush();
+    signalInputSpace();
+
+    LOGH("Dropped %u queued postprocess inputs", dropped);
+}
+
+/*===========================================================================
+ * FUNCTION   : dropInputsLocked
+ *
+ * DESCRIPTION: drop the inputs waiting to be paired. Caller holds
+ *              mReprocJobLock.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : number of input frames dropped
+ *==========================================================================*/
+uint32_t QCamera3PostProcessor::dropInputsLocked()
+{
+    uint32_t dropped = 0;
+
+    qcamera_hal3_pp_buffer_t *pp_buf =
+            (qcamera_hal3_pp_buffer_t *)m_inputPPQ.dequeue();
+    while (pp_buf != NULL) {
+        if (pp_buf->input != NULL) {
+            m_parent->releaseDroppedInput(pp_buf->input);
+            free(pp_buf->input);
+        }
+        free(pp_buf);
+        dropped++;
+        pp_buf = (qcamera_hal3_pp_buffer_t *)m_inputPPQ.dequeue();
+    }
+    m_inputFWKPPQ.flush();
+    m_inputMetaQ.flush();
+    m_jpegSettingsQ.flush();
+
+    return dropped;
+}
+
+/*===========================================================================
+ * FUNCTION   : flushIfIdle
+ *
+ * DESCRIPTION: drop the inputs waiting to be paired, but only if no job has
+ *              been handed to reprocess or jpeg yet. Such a job writes into
+ *              its framework output buffer until it completes, so the request
+ *              cannot be errored out while the streams keep running.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true  -- inputs dropped, nothing in flight
+ *              false -- a reprocess or jpeg job is in flight, nothing dropped
+ *==========================================================================*/
+bool QCamera3PostProcessor::flushIfIdle()
+{
+    pthread_mutex_lock(&mReprocJobLock);
+    if (!m_reprocInputQ.isEmpty() || !m_ongoingPPQ.isEmpty() ||
+            !m_inputJpegQ.isEmpty() || !m_ongoingJpegQ.isEmpty() ||
+            (mJpegResultsPending > 0)) {
+        LOGH("Jobs in flight: reprocess %d/%d, jpeg %d/%d, results %u",
+                m_reprocInputQ.getCurrentSize(), m_ongoingPPQ.getCurrentSize(),
+                m_inputJpegQ.getCurrentSize(), m_ongoingJpegQ.getCurrentSize(),
+                mJpegResultsPending);
+        pthread_mutex_unlock(&mReprocJobLock);
+        return false;
+    }
+    uint32_t dropped = dropInputsLocked();
+    pthread_mutex_unlock(&mReprocJobLock);
+    signalInputSpace();
+
+    LOGH("Dropped %u queued postprocess inputs", dropped);
+    return true;
+}
+
+/*===========================================================================
+ * FUNCTION   : jpegResultDone
+ *
+ * DESCRIPTION: the result of a jpeg job taken by findJpegJobByJobId has been
+ *              returned to the framework
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::jpegResultDone()
+{
+    pthread_mutex_lock(&mReprocJobLock);
+    if (mJpegResultsPending > 0) {
+        mJpegResultsPending--;
+    }
+    pthread_mutex_unlock(&mReprocJobLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : offlineMetaBufFreed
+ *
+ * DESCRIPTION: a buffer was returned to the offline metadata pool, let the
+ *              reprocess stage retry a job that is waiting for one
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::offlineMetaBufFreed()
+{
+    m_reprocTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+}
+
 /*===========================================================================
  * FUNCTION   : stop
  *
- * DESCRIPTION: stop postprocessor. Data process and notify thread will be stopped.
+ * DESCRIPTION: stop postprocessor. Stage threads will be stopped from upstream
+ *              to downstream.
  *
  * PARAMETERS : None
  *
@@ -305,7 +475,10 @@ int32_t QCamera3PostProcessor::flush()
  *==========================================================================*/
 int32_t QCamera3PostProcessor::stop()
 {
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
+    m_pairingTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
+    m_reprocTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
+    m_jpegTh.sendCmd(CAMERA_CMD_TYPE_STOP_DATA_PROC, TRUE, TRUE);
+    dumpStageStats();
 
     if (m_pReprocChannel != NULL) {
         m_pReprocChannel->stop();
@@ -568,9 +741,6 @@ int32_t QCamera3PostProcessor::processData(mm_camera_super_buf_t *input,
         buffer_handle_t *output, uint32_t frameNumber)
 {
     LOGD("E");
-    pthread_mutex_lock(&mReprocJobLock);
-
-    // enqueue to post proc input queue
     qcamera_hal3_pp_buffer_t *pp_buffer = (qcamera_hal3_pp_buffer_t *)malloc(
             sizeof(qcamera_hal3_pp_buffer_t));
     if (NULL == pp_buffer) {
@@ -581,10 +751,14 @@ int32_t QCamera3PostProcessor::processData(mm_camera_super_buf_t *input,
     pp_buffer->input = input;
     pp_buffer->output = output;
     pp_buffer->frameNumber = frameNumber;
+
+    pthread_mutex_lock(&mReprocJobLock);
+    // enqueue to post proc input queue
+    pp_buffer->queued_ts = systemTime();
     m_inputPPQ.enqueue((void *)pp_buffer);
     if (!(m_inputMetaQ.isEmpty())) {
         LOGD("meta queue is not empty, do next job");
-        m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        m_pairingTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     } else
         LOGD("metadata queue is empty");
     pthread_mutex_unlock(&mReprocJobLock);
@@ -655,11 +829,14 @@ int32_t QCamera3PostProcessor::processData(qcamera_fwk_input_pp_data_t *frame)
 {
     if (needsReprocess(frame)) {
         ATRACE_ASYNC_BEGIN("Camera:Reprocess", frame->frameNumber);
+        QCamera3HardwareInterface* hal_obj =
+                (QCamera3HardwareInterface*)m_parent->mUserData;
+        hal_obj->markFrameStage(frame->frameNumber, TIMELINE_STAGE_REPROC_START);
         LOGH("scheduling framework reprocess");
         pthread_mutex_lock(&mReprocJobLock);
         // enqueu to post proc input queue
         m_inputFWKPPQ.enqueue((void *)frame);
-        m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        m_pairingTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
         pthread_mutex_unlock(&mReprocJobLock);
     } else {
         jpeg_settings_t *jpeg_settings = (jpeg_settings_t *)m_jpegSettingsQ.dequeue();
@@ -682,10 +859,11 @@ int32_t QCamera3PostProcessor::processData(qcamera_fwk_input_pp_data_t *frame)
         jpeg_job->jpeg_settings = jpeg_settings;
         jpeg_job->metadata =
                 (metadata_buffer_t *) frame->metadata_buffer.buffer;
+        jpeg_job->queued_ts = systemTime();
 
         // enqueu to jpeg input queue
         m_inputJpegQ.enqueue((void *)jpeg_job);
-        m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        m_jpegTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     }
 
     return NO_ERROR;
@@ -712,7 +890,7 @@ int32_t QCamera3PostProcessor::processPPMetadata(mm_camera_super_buf_t *reproc_m
     m_inputMetaQ.enqueue((void *)reproc_meta);
     if (!(m_inputPPQ.isEmpty())) {
        LOGD("pp queue is not empty, do next job");
-       m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+       m_pairingTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     } else {
        LOGD("pp queue is empty, not calling do next job");
     }
@@ -759,12 +937,17 @@ int32_t QCamera3PostProcessor::processJpegSettingData(
  *==========================================================================*/
 int32_t QCamera3PostProcessor::processPPData(mm_camera_super_buf_t *frame)
 {
+    // the job moves from the ongoing to the jpeg queue under the input queue
+    // lock, see flushIfIdle()
+    pthread_mutex_lock(&mReprocJobLock);
     qcamera_hal3_pp_data_t *job = (qcamera_hal3_pp_data_t *)m_ongoingPPQ.dequeue();
     if (job == NULL || ((NULL == job->src_frame) && (NULL == job->fwk_src_frame))) {
+        pthread_mutex_unlock(&mReprocJobLock);
         LOGE("Cannot find reprocess job");
         return BAD_VALUE;
     }
     if (job->jpeg_settings == NULL) {
+        pthread_mutex_unlock(&mReprocJobLock);
         LOGE("Cannot find jpeg settings");
         return BAD_VALUE;
     }
@@ -772,6 +955,7 @@ int32_t QCamera3PostProcessor::processPPData(mm_camera_super_buf_t *frame)
     qcamera_hal3_jpeg_data_t *jpeg_job =
         (qcamera_hal3_jpeg_data_t *)malloc(sizeof(qcamera_hal3_jpeg_data_t));
     if (jpeg_job == NULL) {
+        pthread_mutex_unlock(&mReprocJobLock);
         LOGE("No memory for jpeg job");
         return NO_MEMORY;
     }
@@ -784,21 +968,27 @@ int32_t QCamera3PostProcessor::processPPData(mm_camera_super_buf_t *frame)
         jpeg_job->metadata = job->metadata;
     } else {
         ATRACE_ASYNC_END("Camera:Reprocess", job->fwk_src_frame->frameNumber);
+        QCamera3HardwareInterface* hal_obj =
+                (QCamera3HardwareInterface*)m_parent->mUserData;
+        hal_obj->markFrameStage(job->fwk_src_frame->frameNumber,
+                TIMELINE_STAGE_REPROC_END);
         jpeg_job->metadata =
                 (metadata_buffer_t *) job->fwk_src_frame->metadata_buffer.buffer;
         jpeg_job->fwk_src_buffer = job->fwk_src_frame;
     }
     jpeg_job->src_metadata = job->src_metadata;
     jpeg_job->jpeg_settings = job->jpeg_settings;
+    jpeg_job->queued_ts = systemTime();
 
     // free pp job buf
     free(job);
 
     // enqueu reprocessed frame to jpeg input queue
     m_inputJpegQ.enqueue((void *)jpeg_job);
+    pthread_mutex_unlock(&mReprocJobLock);
 
-    // wait up data proc thread
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    // wake up jpeg stage thread
+    m_jpegTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
 
     return NO_ERROR;
 }
@@ -851,7 +1041,13 @@ qcamera_hal3_jpeg_data_t *QCamera3PostProcessor::findJpegJobByJobId(uint32_t job
     }
 
     // currely only one jpeg job ongoing, so simply dequeue the head
+    pthread_mutex_lock(&mReprocJobLock);
     job = (qcamera_hal3_jpeg_data_t *)m_ongoingJpegQ.dequeue();
+    if (NULL != job) {
+        // the result is not returned yet, see jpegResultDone()
+        mJpegResultsPending++;
+    }
+    pthread_mutex_unlock(&mReprocJobLock);
     return job;
 }
 
@@ -944,6 +1140,49 @@ void QCamera3PostProcessor::releaseOngoingPPData(void *data, void *user_data)
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : releaseReprocInputData
+ *
+ * DESCRIPTION: callback function to release paired job that is not yet sent
+ *              to reprocess
+ *
+ * PARAMETERS :
+ *   @data      : ptr to paired postprocess job
+ *   @user_data : user data ptr (QCamera3Reprocessor)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::releaseReprocInputData(void *data, void *user_data)
+{
+    QCamera3PostProcessor *pme = (QCamera3PostProcessor *)user_data;
+    qcamera_hal3_pp_data_t *pp_job = (qcamera_hal3_pp_data_t *)data;
+    if ((NULL == pme) || (NULL == pp_job)) {
+        return;
+    }
+
+    if (NULL != pp_job->pp_buffer) {
+        if (pp_job->pp_buffer->input) {
+            pme->releaseSuperBuf(pp_job->pp_buffer->input);
+            free(pp_job->pp_buffer->input);
+        }
+        free(pp_job->pp_buffer);
+        pp_job->pp_buffer = NULL;
+    }
+    if (NULL != pp_job->src_metadata) {
+        pme->m_parent->metadataBufDone(pp_job->src_metadata);
+        free(pp_job->src_metadata);
+        pp_job->src_metadata = NULL;
+    }
+    if (NULL != pp_job->fwk_src_frame) {
+        free(pp_job->fwk_src_frame);
+        pp_job->fwk_src_frame = NULL;
+    }
+    if (NULL != pp_job->jpeg_settings) {
+        free(pp_job->jpeg_settings);
+        pp_job->jpeg_settings = NULL;
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : releaseSuperBuf
  *
@@ -1046,7 +1285,7 @@ void QCamera3PostProcessor::releaseJpegJobData(qcamera_hal3_jpeg_data_t *job)
         }
     }
     /* Additional trigger to process any pending jobs in the input queue */
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    m_jpegTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     LOGD("X");
 }
 
@@ -1085,8 +1324,8 @@ void QCamera3PostProcessor::releasePPJobData(qcamera_hal3_pp_data_t *pp_job)
         }
     }
 
-    /* Additional trigger to process any pending jobs in the input queue */
-    m_dataProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    /* Ongoing reprocess slot is free, let reprocess stage submit more */
+    m_reprocTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     LOGD("X");
 }
 
@@ -1553,6 +1792,8 @@ int32_t QCamera3PostProcessor::encodeFWKData(qcamera_hal3_jpeg_data_t *jpeg_job_
     if (ret == NO_ERROR) {
         // remember job info
         jpeg_job_data->jobId = jobId;
+        hal_obj->markFrameStage(recvd_frame->frameNumber,
+                TIMELINE_STAGE_JPEG_START);
     }
 
     LOGD("X");
@@ -1979,6 +2220,10 @@ int32_t QCamera3PostProcessor::encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_dat
     if (ret == NO_ERROR) {
         // remember job info
         jpeg_job_data->jobId = jobId;
+        if (mOutputMem != NULL) {
+            hal_obj->markFrameStage((uint32_t)mOutputMem->getFrameNumber(
+                    jpeg_settings->out_buf_index), TIMELINE_STAGE_JPEG_START);
+        }
     }
 
     LOGD("X");
@@ -1986,28 +2231,488 @@ int32_t QCamera3PostProcessor::encodeData(qcamera_hal3_jpeg_data_t *jpeg_job_dat
 }
 
 /*===========================================================================
- * FUNCTION   : dataProcessRoutine
+ * FUNCTION   : waitForInputSpace
+ *
+ * DESCRIPTION: hold off an input producer while the given input queue is at
+ *              the stage queue depth. The wait is bounded so that a producer
+ *              is never stalled for more than PP_INPUT_WAIT_TIMEOUT_MS.
+ *
+ * PARAMETERS :
+ *   @queue   : input queue the producer is about to enqueue to
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::waitForInputSpace(QCameraQueue &queue)
+{
+    if (mStageQueueDepth <= 0) {
+        return;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += PP_INPUT_WAIT_TIMEOUT_MS / 1000;
+    ts.tv_nsec += (PP_INPUT_WAIT_TIMEOUT_MS % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&mInputSpaceLock);
+    if (queue.getCurrentSize() >= mStageQueueDepth) {
+        pthread_mutex_lock(&mStageStatsLock);
+        mStageStats[QCAMERA3_PP_STAGE_PAIRING].stalls++;
+        pthread_mutex_unlock(&mStageStatsLock);
+    }
+    while (queue.getCurrentSize() >= mStageQueueDepth) {
+        if (ETIMEDOUT == pthread_cond_timedwait(&mInputSpaceCond,
+                &mInputSpaceLock, &ts)) {
+            LOGW("Input queue still full (%d), enqueue anyway",
+                    queue.getCurrentSize());
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mInputSpaceLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : waitForInputSpace
  *
- * DESCRIPTION: data process routine that handles input data either from input
- *              Jpeg Queue to do jpeg encoding, or from input PP Queue to do
- *              reprocess.
+ * DESCRIPTION: backpressure hook for the request gate. Must be called without
+ *              any HAL lock held, before the request is handed to the channel.
+ *              processData itself never blocks.
+ *
+ * PARAMETERS :
+ *   @fwkInput : true if the request carries a framework input (reprocess)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::waitForInputSpace(bool fwkInput)
+{
+    waitForInputSpace(fwkInput ? m_inputFWKPPQ : m_inputPPQ);
+}
+
+/*===========================================================================
+ * FUNCTION   : signalInputSpace
+ *
+ * DESCRIPTION: wake up producers waiting in waitForInputSpace
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::signalInputSpace()
+{
+    pthread_mutex_lock(&mInputSpaceLock);
+    pthread_cond_broadcast(&mInputSpaceCond);
+    pthread_mutex_unlock(&mInputSpaceLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : updateStageStats
+ *
+ * DESCRIPTION: account one job handled by a stage
+ *
+ * PARAMETERS :
+ *   @stage     : stage that handled the job
+ *   @queued_ts : time the job was queued to the stage, 0 if unknown
+ *   @start_ts  : time the stage started handling the job
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::updateStageStats(qcamera_hal3_pp_stage_t stage,
+        nsecs_t queued_ts, nsecs_t start_ts)
+{
+    nsecs_t now = systemTime();
+    nsecs_t wait = (queued_ts > 0) ? (start_ts - queued_ts) : 0;
+    nsecs_t service = now - start_ts;
+
+    pthread_mutex_lock(&mStageStatsLock);
+    qcamera_hal3_pp_stage_stats_t *stats = &mStageStats[stage];
+    stats->jobs++;
+    stats->totalWaitNs += wait;
+    stats->totalServiceNs += service;
+    if (wait > stats->maxWaitNs) {
+        stats->maxWaitNs = wait;
+    }
+    if (service > stats->maxServiceNs) {
+        stats->maxServiceNs = service;
+    }
+    pthread_mutex_unlock(&mStageStatsLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getStageStats
+ *
+ * DESCRIPTION: get a snapshot of the counters of one stage
+ *
+ * PARAMETERS :
+ *   @stage   : stage to query
+ *   @stats   : ptr to be filled with stage counters
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::getStageStats(qcamera_hal3_pp_stage_t stage,
+        qcamera_hal3_pp_stage_stats_t *stats)
+{
+    if ((NULL == stats) || (stage >= QCAMERA3_PP_STAGE_MAX)) {
+        return;
+    }
+    pthread_mutex_lock(&mStageStatsLock);
+    *stats = mStageStats[stage];
+    pthread_mutex_unlock(&mStageStatsLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : dumpStageStats
+ *
+ * DESCRIPTION: log the per stage counters collected since last dump
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::dumpStageStats()
+{
+    static const char *stageNames[QCAMERA3_PP_STAGE_MAX] =
+            {"pairing", "reprocess", "jpeg"};
+
+    pthread_mutex_lock(&mStageStatsLock);
+    for (int i = 0; i < QCAMERA3_PP_STAGE_MAX; i++) {
+        qcamera_hal3_pp_stage_stats_t *stats = &mStageStats[i];
+        if (stats->jobs == 0) {
+            continue;
+        }
+        LOGH("stage %s: jobs %u stalls %u wait avg %lld max %lld us, "
+                "service avg %lld max %lld us", stageNames[i],
+                stats->jobs, stats->stalls,
+                (long long)(stats->totalWaitNs / stats->jobs / 1000),
+                (long long)(stats->maxWaitNs / 1000),
+                (long long)(stats->totalServiceNs / stats->jobs / 1000),
+                (long long)(stats->maxServiceNs / 1000));
+    }
+    memset(mStageStats, 0, sizeof(mStageStats));
+    pthread_mutex_unlock(&mStageStatsLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : pairInputs
+ *
+ * DESCRIPTION: pair framework reprocess inputs and internal input frames with
+ *              their metadata and jpeg settings, and hand paired jobs to the
+ *              reprocess stage. Stops when the reprocess input queue is full.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::pairInputs()
+{
+    bool paired = false;
+
+    while ((mStageQueueDepth <= 0) ||
+            (m_reprocInputQ.getCurrentSize() < mStageQueueDepth)) {
+        nsecs_t start_ts = systemTime();
+        nsecs_t queued_ts = 0;
+        qcamera_hal3_pp_data_t *pp_job = NULL;
+
+        pthread_mutex_lock(&mReprocJobLock);
+        if (!m_inputFWKPPQ.isEmpty()) {
+            qcamera_fwk_input_pp_data_t *fwk_frame =
+                    (qcamera_fwk_input_pp_data_t *) m_inputFWKPPQ.dequeue();
+            jpeg_settings_t *jpeg_settings =
+                    (jpeg_settings_t *)m_jpegSettingsQ.dequeue();
+            pp_job = (qcamera_hal3_pp_data_t *)malloc(sizeof(qcamera_hal3_pp_data_t));
+            if (NULL == pp_job) {
+                pthread_mutex_unlock(&mReprocJobLock);
+                LOGE("no mem for qcamera_hal3_pp_data_t");
+                if (NULL != fwk_frame) {
+                    free(fwk_frame);
+                }
+                if (NULL != jpeg_settings) {
+                    free(jpeg_settings);
+                }
+                continue;
+            }
+            memset(pp_job, 0, sizeof(qcamera_hal3_pp_data_t));
+            pp_job->fwk_src_frame = fwk_frame;
+            pp_job->jpeg_settings = jpeg_settings;
+        } else if (!m_inputPPQ.isEmpty() && !m_inputMetaQ.isEmpty()) {
+            qcamera_hal3_pp_buffer_t *pp_buffer =
+                    (qcamera_hal3_pp_buffer_t *)m_inputPPQ.dequeue();
+            mm_camera_super_buf_t *meta_buffer =
+                    (mm_camera_super_buf_t *)m_inputMetaQ.dequeue();
+            jpeg_settings_t *jpeg_settings =
+                    (jpeg_settings_t *)m_jpegSettingsQ.dequeue();
+            pp_job = (qcamera_hal3_pp_data_t *)malloc(sizeof(qcamera_hal3_pp_data_t));
+            if (NULL != pp_job) {
+                memset(pp_job, 0, sizeof(qcamera_hal3_pp_data_t));
+                pp_job->pp_buffer = pp_buffer;
+                pp_job->src_metadata = meta_buffer;
+                pp_job->jpeg_settings = jpeg_settings;
+            }
+            if ((NULL == pp_job) || (NULL == pp_buffer) || (NULL == meta_buffer)) {
+                pthread_mutex_unlock(&mReprocJobLock);
+                LOGE("failed to pair pp job %p, buffer %p, metadata %p",
+                        pp_job, pp_buffer, meta_buffer);
+                if (NULL != pp_job) {
+                    releaseReprocInputData(pp_job, this);
+                    free(pp_job);
+                } else {
+                    qcamera_hal3_pp_data_t tmp_job;
+                    memset(&tmp_job, 0, sizeof(tmp_job));
+                    tmp_job.pp_buffer = pp_buffer;
+                    tmp_job.src_metadata = meta_buffer;
+                    tmp_job.jpeg_settings = jpeg_settings;
+                    releaseReprocInputData(&tmp_job, this);
+                }
+                continue;
+            }
+            if (meta_buffer->bufs[0] != NULL) {
+                pp_job->metadata = (metadata_buffer_t *)meta_buffer->bufs[0]->buffer;
+            }
+            queued_ts = pp_buffer->queued_ts;
+        } else {
+            pthread_mutex_unlock(&mReprocJobLock);
+            break;
+        }
+
+        // Hand the job over with the input queues still locked, so that
+        // flushIfIdle() sees it either as an input or as in flight.
+        pp_job->queued_ts = systemTime();
+        bool enqueued = m_reprocInputQ.enqueue((void *)pp_job);
+        pthread_mutex_unlock(&mReprocJobLock);
+        if (!enqueued) {
+            LOGE("reprocess stage is not active, dropping job");
+            releaseReprocInputData(pp_job, this);
+            free(pp_job);
+        }
+        updateStageStats(QCAMERA3_PP_STAGE_PAIRING, queued_ts, start_ts);
+        paired = true;
+    }
+
+    if (paired) {
+        signalInputSpace();
+        m_reprocTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    } else if ((mStageQueueDepth > 0) &&
+            (m_reprocInputQ.getCurrentSize() >= mStageQueueDepth)) {
+        pthread_mutex_lock(&mStageStatsLock);
+        mStageStats[QCAMERA3_PP_STAGE_REPROCESS].stalls++;
+        pthread_mutex_unlock(&mStageStatsLock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : submitReprocess
+ *
+ * DESCRIPTION: send paired jobs to offline reprocess. Holds off while the
+ *              number of reprocess jobs in flight plus jobs waiting for jpeg
+ *              reaches the stage queue depth.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::submitReprocess()
+{
+    int32_t ret = NO_ERROR;
+    bool submitted = false;
+
+    while (!m_reprocInputQ.isEmpty()) {
+        if ((mStageQueueDepth > 0) &&
+                ((m_inputJpegQ.getCurrentSize() + m_ongoingPPQ.getCurrentSize())
+                >= mStageQueueDepth)) {
+            LOGD("jpeg stage is behind, hold off reprocess");
+            pthread_mutex_lock(&mStageStatsLock);
+            mStageStats[QCAMERA3_PP_STAGE_JPEG].stalls++;
+            pthread_mutex_unlock(&mStageStatsLock);
+            break;
+        }
+
+        // Move the job to the ongoing queue under the same lock as the input
+        // queues, so flushIfIdle() never misses a job between the two.
+        pthread_mutex_lock(&mReprocJobLock);
+        qcamera_hal3_pp_data_t *pp_job =
+                (qcamera_hal3_pp_data_t *)m_reprocInputQ.peek();
+        if (NULL == pp_job) {
+            pthread_mutex_unlock(&mReprocJobLock);
+            break;
+        }
+        // Reprocess overrides are written into the metadata buffer, so take
+        // a private copy if another consumer still reads it. Without a free
+        // offline metadata buffer the job stays queued until one is released.
+        int32_t unshareRc = NO_ERROR;
+        if ((NULL == pp_job->fwk_src_frame) && (m_pReprocChannel != NULL)) {
+            unshareRc = m_parent->unshareMetadata(pp_job->src_metadata);
+            if (WOULD_BLOCK == unshareRc) {
+                pthread_mutex_unlock(&mReprocJobLock);
+                LOGD("offline metadata pool is empty, hold off reprocess");
+                pthread_mutex_lock(&mStageStatsLock);
+                mStageStats[QCAMERA3_PP_STAGE_REPROCESS].stalls++;
+                pthread_mutex_unlock(&mStageStatsLock);
+                break;
+            }
+        }
+        m_reprocInputQ.dequeue();
+        qcamera_hal3_pp_buffer_t *pp_buffer = pp_job->pp_buffer;
+        if (NULL == pp_job->fwk_src_frame) {
+            pp_job->pp_buffer = NULL;
+            pp_job->src_frame = pp_buffer->input;
+            m_ongoingPPQ.enqueue((void *)pp_job);
+        } else if (m_pReprocChannel != NULL) {
+            // add into ongoing PP job Q
+            m_ongoingPPQ.enqueue((void *)pp_job);
+        }
+        pthread_mutex_unlock(&mReprocJobLock);
+        submitted = true;
+        nsecs_t start_ts = systemTime();
+        nsecs_t queued_ts = pp_job->queued_ts;
+
+        if (NULL != pp_job->fwk_src_frame) {
+            qcamera_fwk_input_pp_data_t *fwk_frame = pp_job->fwk_src_frame;
+            if (m_pReprocChannel != NULL) {
+                if (NO_ERROR != m_pReprocChannel->overrideFwkMetadata(fwk_frame)) {
+                    LOGE("Failed to extract output crop");
+                }
+                ret = m_pReprocChannel->doReprocessOffline(fwk_frame);
+                if (NO_ERROR != ret) {
+                    // remove from ongoing PP job Q
+                    m_ongoingPPQ.dequeue(false);
+                }
+            } else {
+                LOGE("Reprocess channel is NULL");
+                ret = -1;
+            }
+
+            if (0 != ret) {
+                releaseReprocInputData(pp_job, this);
+                free(pp_job);
+            }
+        } else {
+            mm_camera_super_buf_t *meta_buffer = pp_job->src_metadata;
+
+            if ((m_pReprocChannel != NULL) && (NO_ERROR != unshareRc)) {
+                // The metadata is still shared, it must not be overridden
+                LOGE("Failed to copy shared metadata, dropping reprocess");
+                m_ongoingPPQ.dequeue(false);
+                ret = unshareRc;
+            } else if (m_pReprocChannel != NULL) {
+                pp_job->metadata = (metadata_buffer_t *)meta_buffer->bufs[0]->buffer;
+                mm_camera_buf_def_t *meta_buffer_arg = NULL;
+                meta_buffer_arg = meta_buffer->bufs[0];
+                qcamera_fwk_input_pp_data_t fwk_frame;
+                memset(&fwk_frame, 0, sizeof(qcamera_fwk_input_pp_data_t));
+                fwk_frame.frameNumber = pp_buffer->frameNumber;
+                ret = m_pReprocChannel->overrideMetadata(
+                        pp_buffer, meta_buffer_arg,
+                        pp_job->jpeg_settings,
+                        fwk_frame);
+                if (NO_ERROR == ret) {
+                    // add into ongoing PP job Q
+                    mPerfLockMgr.acquirePerfLock(PERF_LOCK_OFFLINE_REPROC);
+                    ret = m_pReprocChannel->doReprocessOffline(
+                            &fwk_frame, true);
+                    mPerfLockMgr.releasePerfLock(PERF_LOCK_OFFLINE_REPROC);
+                }
+                if (NO_ERROR != ret) {
+                    // remove from ongoing PP job Q
+                    m_ongoingPPQ.dequeue(false);
+                }
+            } else {
+                LOGE("No reprocess. Calling processPPData directly");
+                ret = processPPData(pp_buffer->input);
+            }
+
+            if (0 != ret) {
+                pp_job->src_frame = NULL;
+                pp_job->pp_buffer = pp_buffer;
+                releaseReprocInputData(pp_job, this);
+                free(pp_job);
+            } else {
+                free(pp_buffer);
+            }
+        }
+        updateStageStats(QCAMERA3_PP_STAGE_REPROCESS, queued_ts, start_ts);
+    }
+
+    if (submitted) {
+        // reprocess input queue has room again
+        m_pairingTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : submitJpeg
+ *
+ * DESCRIPTION: send the next jpeg job for encoding if no encoding is ongoing
+ *
+ * PARAMETERS :
+ *   @needNewSess : whether a new jpeg session is needed
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3PostProcessor::submitJpeg(uint8_t &needNewSess)
+{
+    int32_t ret = NO_ERROR;
+
+    // check if there is any ongoing jpeg jobs
+    if (!m_ongoingJpegQ.isEmpty()) {
+        return;
+    }
+
+    LOGD("ongoing jpeg queue is empty so doing the jpeg job");
+    // no ongoing jpeg job, we are fine to send jpeg encoding job
+    pthread_mutex_lock(&mReprocJobLock);
+    qcamera_hal3_jpeg_data_t *jpeg_job =
+            (qcamera_hal3_jpeg_data_t *)m_inputJpegQ.dequeue();
+    if (NULL == jpeg_job) {
+        pthread_mutex_unlock(&mReprocJobLock);
+        return;
+    }
+    nsecs_t start_ts = systemTime();
+    nsecs_t queued_ts = jpeg_job->queued_ts;
+
+    // add into ongoing jpeg job Q
+    m_ongoingJpegQ.enqueue((void *)jpeg_job);
+    pthread_mutex_unlock(&mReprocJobLock);
+
+    if (jpeg_job->fwk_frame) {
+        ret = encodeFWKData(jpeg_job, needNewSess);
+    } else {
+        ret = encodeData(jpeg_job, needNewSess);
+    }
+    if (NO_ERROR != ret) {
+        // dequeue the last one
+        m_ongoingJpegQ.dequeue(false);
+
+        releaseJpegJobData(jpeg_job);
+        free(jpeg_job);
+    }
+    updateStageStats(QCAMERA3_PP_STAGE_JPEG, queued_ts, start_ts);
+
+    // jpeg input queue has room again
+    m_reprocTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+}
+
+/*===========================================================================
+ * FUNCTION   : pairingRoutine
+ *
+ * DESCRIPTION: pairing stage routine that matches input frames with their
+ *              metadata and jpeg settings.
  *
  * PARAMETERS :
  *   @data    : user data ptr (QCamera3PostProcessor)
  *
  * RETURN     : None
  *==========================================================================*/
-void *QCamera3PostProcessor::dataProcessRoutine(void *data)
+void *QCamera3PostProcessor::pairingRoutine(void *data)
 {
     int running = 1;
     int ret;
     uint8_t is_active = FALSE;
-    uint8_t needNewSess = TRUE;
-    mm_camera_super_buf_t *meta_buffer = NULL;
     LOGD("E");
     QCamera3PostProcessor *pme = (QCamera3PostProcessor *)data;
-    QCameraCmdThread *cmdThread = &pme->m_dataProcTh;
-    cmdThread->setName("cam_data_proc");
+    QCameraCmdThread *cmdThread = &pme->m_pairingTh;
+    cmdThread->setName("cam_pp_pair");
 
     do {
         do {
@@ -2023,21 +2728,185 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
         camera_cmd_type_t cmd = cmdThread->getCmd();
         switch (cmd) {
         case CAMERA_CMD_TYPE_START_DATA_PROC:
-            LOGH("start data proc");
+            LOGH("start pairing stage");
             is_active = TRUE;
-            needNewSess = TRUE;
-
-            pme->m_ongoingPPQ.init();
-            pme->m_inputJpegQ.init();
             pme->m_inputPPQ.init();
             pme->m_inputFWKPPQ.init();
             pme->m_inputMetaQ.init();
             cam_sem_post(&cmdThread->sync_sem);
+            break;
+        case CAMERA_CMD_TYPE_STOP_DATA_PROC:
+            LOGH("stop pairing stage");
+            is_active = FALSE;
+            // flush input Postproc Queue
+            pme->m_inputPPQ.flush();
+            // flush framework input Postproc Queue
+            pme->m_inputFWKPPQ.flush();
+            pme->m_inputMetaQ.flush();
+            pme->signalInputSpace();
+            // signal cmd is completed
+            cam_sem_post(&cmdThread->sync_sem);
+            break;
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            LOGH("Do next job, active is %d", is_active);
+            if (is_active == TRUE) {
+                pme->pairInputs();
+            } else {
+                // not active, simply return buf and do no op
+                qcamera_hal3_pp_buffer_t* pp_buf =
+                        (qcamera_hal3_pp_buffer_t *)pme->m_inputPPQ.dequeue();
+                if (NULL != pp_buf) {
+                    if (pp_buf->input) {
+                        pme->releaseSuperBuf(pp_buf->input);
+                        free(pp_buf->input);
+                        pp_buf->input = NULL;
+                    }
+                    free(pp_buf);
+                }
+                mm_camera_super_buf_t *metadata =
+                        (mm_camera_super_buf_t *)pme->m_inputMetaQ.dequeue();
+                if (metadata != NULL) {
+                    pme->m_parent->metadataBufDone(metadata);
+                    free(metadata);
+                }
+                qcamera_fwk_input_pp_data_t *fwk_frame =
+                        (qcamera_fwk_input_pp_data_t *) pme->m_inputFWKPPQ.dequeue();
+                if (NULL != fwk_frame) {
+                    free(fwk_frame);
+                }
+            }
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+    LOGD("X");
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : reprocessRoutine
+ *
+ * DESCRIPTION: reprocess stage routine that sends paired jobs to the offline
+ *              reprocess channel.
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCamera3PostProcessor)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCamera3PostProcessor::reprocessRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    uint8_t is_active = FALSE;
+    LOGD("E");
+    QCamera3PostProcessor *pme = (QCamera3PostProcessor *)data;
+    QCameraCmdThread *cmdThread = &pme->m_reprocTh;
+    cmdThread->setName("cam_pp_reproc");
+
+    do {
+        do {
+            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            if (ret != 0 && errno != EINVAL) {
+                LOGE("cam_sem_wait error (%s)",
+                            strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        // we got notified about new cmd avail in cmd queue
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_START_DATA_PROC:
+            LOGH("start reprocess stage");
+            is_active = TRUE;
+            pme->m_ongoingPPQ.init();
+            pme->m_reprocInputQ.init();
+            cam_sem_post(&cmdThread->sync_sem);
+            break;
+        case CAMERA_CMD_TYPE_STOP_DATA_PROC:
+            LOGH("stop reprocess stage");
+            is_active = FALSE;
+            pme->m_reprocInputQ.flush();
+            // flush ongoing postproc Queue
+            pme->m_ongoingPPQ.flush();
+            // signal cmd is completed
+            cam_sem_post(&cmdThread->sync_sem);
+            break;
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            LOGH("Do next job, active is %d", is_active);
+            if (is_active == TRUE) {
+                pme->submitReprocess();
+            } else {
+                // not active, simply return buf and do no op
+                qcamera_hal3_pp_data_t *pp_job =
+                        (qcamera_hal3_pp_data_t *)pme->m_reprocInputQ.dequeue();
+                if (NULL != pp_job) {
+                    releaseReprocInputData(pp_job, pme);
+                    free(pp_job);
+                }
+            }
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+    LOGD("X");
+    return NULL;
+}
 
+/*===========================================================================
+ * FUNCTION   : jpegRoutine
+ *
+ * DESCRIPTION: jpeg stage routine that sends jobs from input Jpeg Queue to
+ *              jpeg encoding, one at a time.
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr (QCamera3PostProcessor)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void *QCamera3PostProcessor::jpegRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    uint8_t is_active = FALSE;
+    uint8_t needNewSess = TRUE;
+    LOGD("E");
+    QCamera3PostProcessor *pme = (QCamera3PostProcessor *)data;
+    QCameraCmdThread *cmdThread = &pme->m_jpegTh;
+    cmdThread->setName("cam_pp_jpeg");
+
+    do {
+        do {
+            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            if (ret != 0 && errno != EINVAL) {
+                LOGE("cam_sem_wait error (%s)",
+                            strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        // we got notified about new cmd avail in cmd queue
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_START_DATA_PROC:
+            LOGH("start jpeg stage");
+            is_active = TRUE;
+            needNewSess = TRUE;
+            pme->m_inputJpegQ.init();
+            cam_sem_post(&cmdThread->sync_sem);
             break;
         case CAMERA_CMD_TYPE_STOP_DATA_PROC:
             {
-                LOGH("stop data proc");
+                LOGH("stop jpeg stage");
                 is_active = FALSE;
 
                 // cancel all ongoing jpeg jobs
@@ -2060,215 +2929,26 @@ void *QCamera3PostProcessor::dataProcessRoutine(void *data)
 
                 needNewSess = TRUE;
 
-                // flush ongoing postproc Queue
-                pme->m_ongoingPPQ.flush();
-
                 // flush input jpeg Queue
                 pme->m_inputJpegQ.flush();
 
-                // flush input Postproc Queue
-                pme->m_inputPPQ.flush();
-
-                // flush framework input Postproc Queue
-                pme->m_inputFWKPPQ.flush();
-
-                pme->m_inputMetaQ.flush();
-
                 // signal cmd is completed
                 cam_sem_post(&cmdThread->sync_sem);
             }
             break;
         case CAMERA_CMD_TYPE_DO_NEXT_JOB:
-            {
-                LOGH("Do next job, active is %d", is_active);
-                /* needNewSess is set to TRUE as postproc is not re-STARTed
-                 * anymore for every captureRequest */
-                needNewSess = TRUE;
-                if (is_active == TRUE) {
-                    // check if there is any ongoing jpeg jobs
-                    if (pme->m_ongoingJpegQ.isEmpty()) {
-                        LOGD("ongoing jpeg queue is empty so doing the jpeg job");
-                        // no ongoing jpeg job, we are fine to send jpeg encoding job
-                        qcamera_hal3_jpeg_data_t *jpeg_job =
-                            (qcamera_hal3_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
-
-                        if (NULL != jpeg_job) {
-                            // add into ongoing jpeg job Q
-                            pme->m_ongoingJpegQ.enqueue((void *)jpeg_job);
-
-                            if (jpeg_job->fwk_frame) {
-                                ret = pme->encodeFWKData(jpeg_job, needNewSess);
-                            } else {
-                                ret = pme->encodeData(jpeg_job, needNewSess);
-                            }
-                            if (NO_ERROR != ret) {
-                                // dequeue the last one
-                                pme->m_ongoingJpegQ.dequeue(false);
-
-                                pme->releaseJpegJobData(jpeg_job);
-                                free(jpeg_job);
-                            }
-                        }
-                    }
-
-                    // check if there are any framework pp jobs
-                    if (!pme->m_inputFWKPPQ.isEmpty()) {
-                        qcamera_fwk_input_pp_data_t *fwk_frame =
-                                (qcamera_fwk_input_pp_data_t *) pme->m_inputFWKPPQ.dequeue();
-                        if (NULL != fwk_frame) {
-                            qcamera_hal3_pp_data_t *pp_job =
-                                    (qcamera_hal3_pp_data_t *)malloc(sizeof(qcamera_hal3_pp_data_t));
-                            jpeg_settings_t *jpeg_settings =
-                                    (jpeg_settings_t *)pme->m_jpegSettingsQ.dequeue();
-                            if (pp_job != NULL) {
-                                memset(pp_job, 0, sizeof(qcamera_hal3_pp_data_t));
-                                pp_job->jpeg_settings = jpeg_settings;
-                                if (pme->m_pReprocChannel != NULL) {
-                                    if (NO_ERROR != pme->m_pReprocChannel->overrideFwkMetadata(fwk_frame)) {
-                                        LOGE("Failed to extract output crop");
-                                    }
-                                    // add into ongoing PP job Q
-                                    pp_job->fwk_src_frame = fwk_frame;
-                                    pme->m_ongoingPPQ.enqueue((void *)pp_job);
-                                    ret = pme->m_pReprocChannel->doReprocessOffline(fwk_frame);
-                                    if (NO_ERROR != ret) {
-                                        // remove from ongoing PP job Q
-                                        pme->m_ongoingPPQ.dequeue(false);
-                                    }
-                                } else {
-                                    LOGE("Reprocess channel is NULL");
-                                    ret = -1;
-                                }
-                            } else {
-                                LOGE("no mem for qcamera_hal3_pp_data_t");
-                                ret = -1;
-                            }
-
-                            if (0 != ret) {
-                                // free pp_job
-                                if (pp_job != NULL) {
-                                    free(pp_job);
-                                }
-                                // free frame
-                                if (fwk_frame != NULL) {
-                                    free(fwk_frame);
-                                }
-                            }
-                        }
-                    }
-
-                    LOGH("dequeuing pp frame");
-                    pthread_mutex_lock(&pme->mReprocJobLock);
-                    if(!pme->m_inputPPQ.isEmpty() && !pme->m_inputMetaQ.isEmpty()) {
-                        qcamera_hal3_pp_buffer_t *pp_buffer =
-                            (qcamera_hal3_pp_buffer_t *)pme->m_inputPPQ.dequeue();
-                        meta_buffer =
-                            (mm_camera_super_buf_t *)pme->m_inputMetaQ.dequeue();
-                        jpeg_settings_t *jpeg_settings =
-                           (jpeg_settings_t *)pme->m_jpegSettingsQ.dequeue();
-                        pthread_mutex_unlock(&pme->mReprocJobLock);
-                        qcamera_hal3_pp_data_t *pp_job =
-                            (qcamera_hal3_pp_data_t *)malloc(sizeof(qcamera_hal3_pp_data_t));
-                        if (pp_job == NULL) {
-                            LOGE("no mem for qcamera_hal3_pp_data_t");
-                            ret = -1;
-                        } else if (meta_buffer == NULL) {
-                            LOGE("failed to dequeue from m_inputMetaQ");
-                            ret = -1;
-                        } else if (pp_buffer == NULL) {
-                            LOGE("failed to dequeue from m_inputPPQ");
-                            ret = -1;
-                        } else if (pp_buffer != NULL){
-                            memset(pp_job, 0, sizeof(qcamera_hal3_pp_data_t));
-                            pp_job->src_frame = pp_buffer->input;
-                            pp_job->src_metadata = meta_buffer;
-                            if (meta_buffer->bufs[0] != NULL) {
-                                pp_job->metadata = (metadata_buffer_t *)
-                                        meta_buffer->bufs[0]->buffer;
-                            }
-                            pp_job->jpeg_settings = jpeg_settings;
-                            pme->m_ongoingPPQ.enqueue((void *)pp_job);
-                            if (pme->m_pReprocChannel != NULL) {
-                                mm_camera_buf_def_t *meta_buffer_arg = NULL;
-                                meta_buffer_arg = meta_buffer->bufs[0];
-                                qcamera_fwk_input_pp_data_t fwk_frame;
-                                memset(&fwk_frame, 0, sizeof(qcamera_fwk_input_pp_data_t));
-                                fwk_frame.frameNumber = pp_buffer->frameNumber;
-                                ret = pme->m_pReprocChannel->overrideMetadata(
-                                        pp_buffer, meta_buffer_arg,
-                                        pp_job->jpeg_settings,
-                                        fwk_frame);
-                                if (NO_ERROR == ret) {
-                                    // add into ongoing PP job Q
-                                    pme->mPerfLockMgr.acquirePerfLock(PERF_LOCK_OFFLINE_REPROC);
-                                    ret = pme->m_pReprocChannel->doReprocessOffline(
-                                            &fwk_frame, true);
-                                    pme->mPerfLockMgr.releasePerfLock(PERF_LOCK_OFFLINE_REPROC);
-                                    if (NO_ERROR != ret) {
-                                        // remove from ongoing PP job Q
-                                        pme->m_ongoingPPQ.dequeue(false);
-                                    }
-                                }
-                            } else {
-                                LOGE("No reprocess. Calling processPPData directly");
-                                ret = pme->processPPData(pp_buffer->input);
-                            }
-                        }
-
-                        if (0 != ret) {
-                            // free pp_job
-                            if (pp_job != NULL) {
-                                free(pp_job);
-                            }
-                            // free frame
-                            if (pp_buffer != NULL) {
-                                if (pp_buffer->input) {
-                                    pme->releaseSuperBuf(pp_buffer->input);
-                                    free(pp_buffer->input);
-                                }
-                                free(pp_buffer);
-                            }
-                            //free metadata
-                            if (NULL != meta_buffer) {
-                                pme->m_parent->metadataBufDone(meta_buffer);
-                                free(meta_buffer);
-                            }
-                        } else {
-                            if (pp_buffer != NULL) {
-                                free(pp_buffer);
-                            }
-                        }
-                    } else {
-                        pthread_mutex_unlock(&pme->mReprocJobLock);
-                    }
-                } else {
-                    // not active, simply return buf and do no op
-                    qcamera_hal3_jpeg_data_t *jpeg_job =
-                        (qcamera_hal3_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
-                    if (NULL != jpeg_job) {
-                        free(jpeg_job);
-                    }
-
-                    qcamera_hal3_pp_buffer_t* pp_buf =
-                            (qcamera_hal3_pp_buffer_t *)pme->m_inputPPQ.dequeue();
-                    if (NULL != pp_buf) {
-                        if (pp_buf->input) {
-                            pme->releaseSuperBuf(pp_buf->input);
-                            free(pp_buf->input);
-                            pp_buf->input = NULL;
-                        }
-                        free(pp_buf);
-                    }
-                    mm_camera_super_buf_t *metadata = (mm_camera_super_buf_t *)pme->m_inputMetaQ.dequeue();
-                    if (metadata != NULL) {
-                        pme->m_parent->metadataBufDone(metadata);
-                        free(metadata);
-                    }
-                    qcamera_fwk_input_pp_data_t *fwk_frame =
-                            (qcamera_fwk_input_pp_data_t *) pme->m_inputFWKPPQ.dequeue();
-                    if (NULL != fwk_frame) {
-                        free(fwk_frame);
-                    }
+            LOGH("Do next job, active is %d", is_active);
+            /* needNewSess is set to TRUE as postproc is not re-STARTed
+             * anymore for every captureRequest */
+            needNewSess = TRUE;
+            if (is_active == TRUE) {
+                pme->submitJpeg(needNewSess);
+            } else {
+                // not active, simply return buf and do no op
+                qcamera_hal3_jpeg_data_t *jpeg_job =
+                    (qcamera_hal3_jpeg_data_t *)pme->m_inputJpegQ.dequeue();
+                if (NULL != jpeg_job) {
+                    free(jpeg_job);
                 }
             }
             break;
@@ -30,6 +30,9 @@
 #ifndef __QCamera3_POSTPROC_H__
 #define __QCamera3_POSTPROC_H__
 
+// System dependencies
+#include <utils/Timers.h>
+
 // Camera dependencies
 #include "hardware/camera3.h"
 #include "QCamera3HALHeader.h"
@@ -70,8 +73,16 @@ typedef struct {
     metadata_buffer_t *metadata;
     mm_camera_super_buf_t *src_metadata;
     jpeg_settings_t *jpeg_settings;
+    nsecs_t queued_ts;               // time the job entered the jpeg stage
 } qcamera_hal3_jpeg_data_t;
 
+typedef struct {
+    mm_camera_super_buf_t *input;
+    buffer_handle_t *output;
+    uint32_t frameNumber;
+    nsecs_t queued_ts;               // time the buffer entered the pairing stage
+} qcamera_hal3_pp_buffer_t;
+
 typedef struct {
     uint32_t jobId;                  // job ID
     mm_camera_super_buf_t *src_frame;// source frame (need to be returned back to kernel after done)
@@ -79,13 +90,26 @@ typedef struct {
     metadata_buffer_t *metadata;
     jpeg_settings_t *jpeg_settings;
     mm_camera_super_buf_t *src_metadata;
+    qcamera_hal3_pp_buffer_t *pp_buffer; // paired input, consumed by reprocess stage
+    nsecs_t queued_ts;               // time the job entered the reprocess stage
 } qcamera_hal3_pp_data_t;
 
+// Stages of the postprocessor pipeline, each runs on its own thread
+typedef enum {
+    QCAMERA3_PP_STAGE_PAIRING,       // pair input frames with metadata/jpeg settings
+    QCAMERA3_PP_STAGE_REPROCESS,     // submit offline reprocess
+    QCAMERA3_PP_STAGE_JPEG,          // submit jpeg encoding
+    QCAMERA3_PP_STAGE_MAX
+} qcamera_hal3_pp_stage_t;
+
 typedef struct {
-    mm_camera_super_buf_t *input;
-    buffer_handle_t *output;
-    uint32_t frameNumber;
-} qcamera_hal3_pp_buffer_t;
+    uint32_t jobs;                   // jobs handled by the stage
+    uint32_t stalls;                 // times the stage held off for a full downstream queue
+    nsecs_t totalWaitNs;             // time jobs spent queued in front of the stage
+    nsecs_t maxWaitNs;
+    nsecs_t totalServiceNs;          // time spent submitting jobs
+    nsecs_t maxServiceNs;
+} qcamera_hal3_pp_stage_stats_t;
 
 #define MAX_HAL3_EXIF_TABLE_ENTRIES 23
 class QCamera3Exif
@@ -132,6 +156,12 @@ public:
     void releaseJpegJobData(qcamera_hal3_jpeg_data_t *job);
     int32_t releaseOfflineBuffers(bool all);
     void releasePPJobData(qcamera_hal3_pp_data_t *job);
+    void getStageStats(qcamera_hal3_pp_stage_t stage,
+            qcamera_hal3_pp_stage_stats_t *stats);
+    void waitForInputSpace(bool fwkInput);
+    bool flushIfIdle();
+    void jpegResultDone();
+    void offlineMetaBufFreed();
 
 private:
     int32_t sendEvtNotify(int32_t msg_type, int32_t ext1, int32_t ext2);
@@ -157,8 +187,21 @@ private:
     static void releasePPInputData(void *data, void *user_data);
     static void releaseMetadata(void *data, void *user_data);
     static void releaseOngoingPPData(void *data, void *user_data);
-
-    static void *dataProcessRoutine(void *data);
+    static void releaseReprocInputData(void *data, void *user_data);
+
+    static void *pairingRoutine(void *data);
+    static void *reprocessRoutine(void *data);
+    static void *jpegRoutine(void *data);
+    void pairInputs();
+    void submitReprocess();
+    void submitJpeg(uint8_t &needNewSess);
+    void waitForInputSpace(QCameraQueue &queue);
+    void signalInputSpace();
+    void flushInputQueues();
+    uint32_t dropInputsLocked();
+    void updateStageStats(qcamera_hal3_pp_stage_t stage, nsecs_t queued_ts,
+            nsecs_t start_ts);
+    void dumpStageStats();
 
     bool needsReprocess(qcamera_fwk_input_pp_data_t *frame);
 
@@ -183,10 +226,25 @@ private:
     QCameraQueue m_inputRawQ;           // input raw job queue
     QCameraQueue m_inputMetaQ;          // input meta queue
     QCameraQueue m_jpegSettingsQ;       // input jpeg setting queue
-    QCameraCmdThread m_dataProcTh;      // thread for data processing
+    QCameraQueue m_reprocInputQ;        // paired jobs waiting for reprocess
+    QCameraCmdThread m_pairingTh;       // thread pairing inputs with metadata
+    QCameraCmdThread m_reprocTh;        // thread submitting reprocess jobs
+    QCameraCmdThread m_jpegTh;          // thread submitting jpeg jobs
 
     QCameraPerfLockMgr mPerfLockMgr;
+    // guards the input queues and every hand-off between the later queues
     pthread_mutex_t mReprocJobLock;
+    // jpeg jobs taken off m_ongoingJpegQ whose result is not returned yet
+    uint32_t mJpegResultsPending;
+
+    // bound of every inter-stage queue, the request gate holds off new
+    // requests (up to PP_INPUT_WAIT_TIMEOUT_MS) while the input queue is full
+    int32_t mStageQueueDepth;
+    pthread_mutex_t mInputSpaceLock;
+    pthread_cond_t mInputSpaceCond;
+
+    pthread_mutex_t mStageStatsLock;
+    qcamera_hal3_pp_stage_stats_t mStageStats[QCAMERA3_PP_STAGE_MAX];
 };
 
 }; // namespace qcamera
@@ -0,0 +1,237 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+// System dependencies
+#include <errno.h>
+#include <utils/Errors.h>
+
+// Camera dependencies
+#include "cam_cond.h"
+#include "QCamera3RequestGate.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCamera3RequestGate
+ *
+ * DESCRIPTION: constructor of QCamera3RequestGate
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3RequestGate::QCamera3RequestGate() :
+        mInFlight(0),
+        mParked(0),
+        mDaemonPull(false),
+        mMinInFlight(1),
+        mMaxInFlight(1)
+{
+    pthread_mutex_init(&mLock, NULL);
+    PTHREAD_COND_INIT(&mCond);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCamera3RequestGate
+ *
+ * DESCRIPTION: destructor of QCamera3RequestGate
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+QCamera3RequestGate::~QCamera3RequestGate()
+{
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : setLimits
+ *
+ * DESCRIPTION: set the number of in flight requests to park at
+ *
+ * PARAMETERS :
+ *   @minInFlight : requests in flight to park at
+ *   @maxInFlight : requests in flight to park at after a daemon pull
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RequestGate::setLimits(uint32_t minInFlight, uint32_t maxInFlight)
+{
+    mMinInFlight = minInFlight;
+    mMaxInFlight = maxInFlight;
+}
+
+/*===========================================================================
+ * FUNCTION   : onRequestSent
+ *
+ * DESCRIPTION: count a live request sent to the backend
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RequestGate::onRequestSent()
+{
+    mInFlight++;
+}
+
+/*===========================================================================
+ * FUNCTION   : onRequestDone
+ *
+ * DESCRIPTION: count a live request back from the backend and wake the
+ *              request thread if it is parked. A result that arrives after
+ *              reset() does not take the count below zero.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RequestGate::onRequestDone()
+{
+    uint32_t cnt = mInFlight.load();
+    while ((cnt > 0) && !mInFlight.compare_exchange_weak(cnt, cnt - 1)) {
+    }
+    wakeIfParked();
+}
+
+/*===========================================================================
+ * FUNCTION   : reset
+ *
+ * DESCRIPTION: forget all requests in flight and the pending daemon pull
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RequestGate::reset()
+{
+    mInFlight = 0;
+    mDaemonPull = false;
+    wakeIfParked();
+}
+
+/*===========================================================================
+ * FUNCTION   : onDaemonPull
+ *
+ * DESCRIPTION: let the parked request thread go on once fewer than the
+ *              maximum requests are in flight
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RequestGate::onDaemonPull()
+{
+    mDaemonPull = true;
+    wakeIfParked();
+}
+
+/*===========================================================================
+ * FUNCTION   : wake
+ *
+ * DESCRIPTION: wake the parked request thread to re-check its stop
+ *              condition
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RequestGate::wake()
+{
+    wakeIfParked();
+}
+
+/*===========================================================================
+ * FUNCTION   : wakeIfParked
+ *
+ * DESCRIPTION: signal the request thread if it is inside waitForSpace. The
+ *              state it waits on is updated before this is called, so a
+ *              waiter that is not counted in mParked yet will see it.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCamera3RequestGate::wakeIfParked()
+{
+    if (mParked.load() != 0) {
+        pthread_mutex_lock(&mLock);
+        pthread_cond_broadcast(&mCond);
+        pthread_mutex_unlock(&mLock);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : waitForSpace
+ *
+ * DESCRIPTION: park the request thread while too many live requests are in
+ *              flight
+ *
+ * PARAMETERS :
+ *   @deadline : absolute systemTime() to give up at, 0 for none
+ *   @stop     : returns true when the waiter must give up, may be NULL
+ *   @cookie   : passed to stop
+ *
+ * RETURN     : NO_ERROR  -- room for a request, or stopped
+ *              TIMED_OUT -- still full at the deadline
+ *==========================================================================*/
+int32_t QCamera3RequestGate::waitForSpace(nsecs_t deadline, stop_fn_t stop,
+        void *cookie)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)(deadline / s2ns(1));
+    ts.tv_nsec = (long)(deadline % s2ns(1));
+
+    int32_t rc = NO_ERROR;
+    pthread_mutex_lock(&mLock);
+    mParked++;
+    while ((mInFlight >= mMinInFlight) &&
+            ((stop == NULL) || !stop(cookie))) {
+        if (deadline == 0) {
+            pthread_cond_wait(&mCond, &mLock);
+        } else if (pthread_cond_timedwait(&mCond, &mLock, &ts) == ETIMEDOUT) {
+            if (mInFlight >= mMinInFlight) {
+                rc = TIMED_OUT;
+            }
+            break;
+        }
+        if (mDaemonPull.exchange(false) && (mInFlight < mMaxInFlight)) {
+            break;
+        }
+    }
+    mParked--;
+    pthread_mutex_unlock(&mLock);
+    return rc;
+}
+
+}; // namespace qcamera
@@ -0,0 +1,100 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+#ifndef __QCAMERA3REQUESTGATE_H__
+#define __QCAMERA3REQUESTGATE_H__
+
+// System dependencies
+#include <atomic>
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+/*
+ * QCamera3RequestGate throttles process_capture_request on the number of
+ * live requests in flight. The request thread sends a request and then
+ * parks here, without mMutex, until the result path brings the count back
+ * under the limit.
+ *
+ * The count is handed between the two paths through atomics. The result
+ * path only takes the gate lock to wake a parked request thread, so in
+ * steady streaming, where the request thread rarely parks, a result costs
+ * no lock beyond the one it already holds. The waiter announces itself
+ * before it checks the count and the result path checks for a waiter after
+ * it updates the count, so one of the two always sees the other.
+ *
+ * Thread safe. One request thread waits at a time.
+ */
+class QCamera3RequestGate {
+public:
+    // Returns true when the waiter must give up, e.g. the HAL is in error.
+    typedef bool (*stop_fn_t)(void *cookie);
+
+    QCamera3RequestGate();
+    ~QCamera3RequestGate();
+
+    // Park while minInFlight or more requests are in flight. After a daemon
+    // pull, up to maxInFlight are allowed.
+    void setLimits(uint32_t minInFlight, uint32_t maxInFlight);
+    // Live request sent to the backend.
+    void onRequestSent();
+    // Result or error of a live request came back.
+    void onRequestDone();
+    // Nothing is in flight any more, e.g. after a flush.
+    void reset();
+    // The daemon asks for more requests than the minimum.
+    void onDaemonPull();
+    // Wake the request thread to re-check its stop condition.
+    void wake();
+
+    uint32_t getInFlight() const { return mInFlight.load(); }
+
+    // Wait for room for the next request. deadline is an absolute
+    // systemTime(), 0 to wait without one.
+    // NO_ERROR when there is room or stop() returned true, TIMED_OUT
+    // otherwise.
+    int32_t waitForSpace(nsecs_t deadline, stop_fn_t stop, void *cookie);
+
+private:
+    void wakeIfParked();
+
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;
+    std::atomic<uint32_t> mInFlight;
+    std::atomic<uint32_t> mParked;      // request threads inside waitForSpace
+    std::atomic<bool> mDaemonPull;
+    std::atomic<uint32_t> mMinInFlight;
+    std::atomic<uint32_t> mMaxInFlight;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3REQUESTGATE_H__ */
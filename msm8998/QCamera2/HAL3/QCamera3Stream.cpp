@@ -33,6 +33,7 @@
 #include "QCamera3HWI.h"
 #include "QCamera3Stream.h"
 #include <cutils/properties.h>
+#include "QCameraBufferMaps.h"
 #include "QCameraTrace.h"
 
 extern "C" {
@@ -290,6 +291,9 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
         mDataCB(NULL),
         mUserData(NULL),
         mDataQ(releaseFrameData, this),
+        mMapThActive(false),
+        mAsyncMapEnable(true),
+        mBufMapState(NULL),
         mStreamInfoBuf(NULL),
         mStreamBufs(NULL),
         mBufDefs(NULL),
@@ -316,6 +320,11 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
     if (nullptr != channel) {
         mNRMode = channel->getNRMode();
     }
+
+    char prop[PROPERTY_VALUE_MAX];
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.async.map", prop, "1");
+    mAsyncMapEnable = (atoi(prop) > 0);
 }
 
 /*===========================================================================
@@ -329,6 +338,11 @@ QCamera3Stream::QCamera3Stream(uint32_t camHandle,
  *==========================================================================*/
 QCamera3Stream::~QCamera3Stream()
 {
+    mMapTh.exit();
+    if (mBufMapState != NULL) {
+        free(mBufMapState);
+        mBufMapState = NULL;
+    }
     if (mStreamInfoBuf != NULL) {
         int rc = mCamOps->unmap_stream_buf(mCamHandle,
                     mChannelHandle, mHandle, CAM_MAPPING_BUF_TYPE_STREAM_INFO, 0, -1);
@@ -530,6 +544,7 @@ int32_t QCamera3Stream::start()
 
     mDataQ.init();
     mTimeoutFrameQ.clear();
+    mInflight.reset();
     if (mBatchSize)
         mFreeBatchBufQ.init();
     rc = mProcTh.launch(dataProcRoutine, this);
@@ -551,6 +566,7 @@ int32_t QCamera3Stream::stop()
 {
     int32_t rc = 0;
     rc = mProcTh.exit();
+    mInflight.reset();
     return rc;
 }
 
@@ -595,12 +611,18 @@ int32_t QCamera3Stream::processDataNotify(mm_camera_super_buf_t *frame)
 {
     LOGD("E\n");
     int32_t rc;
+    if (!mBatchSize) {
+        mInflight.onReturned(frame->bufs[0]->buf_idx);
+    }
     if (mDataQ.enqueue((void *)frame)) {
         rc = mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
     } else {
         LOGD("Stream thread is not active, no ops here");
         bufDone(frame->bufs[0]->buf_idx);
         free(frame);
+        if (!mBatchSize) {
+            mInflight.onCallbackDone();
+        }
         rc = NO_ERROR;
     }
     LOGD("X\n");
@@ -709,6 +731,9 @@ void *QCamera3Stream::dataProcRoutine(void *data)
                         // no data cb routine, return buf here
                         pme->bufDone(frame->bufs[0]->buf_idx);
                     }
+                    if (!pme->mBatchSize) {
+                        pme->mInflight.onCallbackDone();
+                    }
                 }
             }
             break;
@@ -772,6 +797,36 @@ int32_t QCamera3Stream::bufDoneLocked(uint32_t index)
         return INVALID_OPERATION;
     }
 
+    // Late registered buffers get mapped on mMapTh so the caller does not
+    // wait for the backend round trip. Anything returned after a pending
+    // buffer has to follow it to keep the kernel queue in request order.
+    if (mMapThActive && (mBufMapState != NULL) &&
+            ((NULL == mBufDefs[index].mem_info) || !mPendingMapQ.empty())) {
+        if (NULL == mBufDefs[index].mem_info) {
+            if (BUF_MAP_PENDING == mBufMapState[index]) {
+                LOGE("Buffer %d already waiting for mapping", index);
+                return INVALID_OPERATION;
+            }
+            mBufMapState[index] = BUF_MAP_PENDING;
+            mBufDefs[index].flags &= ~V4L2_BUF_FLAG_ERROR;
+        }
+        mPendingMapQ.push_back(index);
+        mInflight.onQueued(index);
+        rc = mMapTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+        if (NO_ERROR == rc) {
+            return rc;
+        }
+        LOGE("Failed to schedule mapping of buffer %d, rc = %d", index, rc);
+        mInflight.onDropped(index);
+        mPendingMapQ.erase(--mPendingMapQ.end());
+        if (NULL == mBufDefs[index].mem_info) {
+            mBufMapState[index] = BUF_MAP_NONE;
+        }
+        if (!mPendingMapQ.empty()) {
+            return rc;
+        }
+    }
+
     if( NULL == mBufDefs[index].mem_info) {
         if (NULL == mMemOps) {
             LOGE("Camera operations not initialized");
@@ -798,12 +853,43 @@ int32_t QCamera3Stream::bufDoneLocked(uint32_t index)
                 mMemOps->unmap_ops(index, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF, mMemOps->userdata);
                 return rc;
             }
+            if (mBufMapState != NULL) {
+                mBufMapState[index] = BUF_MAP_DONE;
+            }
         } else {
             LOGE("Failed to retrieve buffer size (bad index)");
             return INVALID_OPERATION;
         }
     }
 
+    // Marked before the backend has it, the frame may come back right away
+    if (!mBatchSize) {
+        mInflight.onQueued(index);
+    }
+    rc = queueBufLocked(index);
+    if ((NO_ERROR != rc) && !mBatchSize) {
+        mInflight.onDropped(index);
+    }
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : queueBufLocked
+ *
+ * DESCRIPTION: queue an already mapped stream buffer to kernel, or to the
+ *              current batch container, while holding the lock
+ *
+ * PARAMETERS :
+ *   @index   : index of buffer to be queued
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Stream::queueBufLocked(uint32_t index)
+{
+    int32_t rc = NO_ERROR;
+
     if (UNLIKELY(mBatchSize)) {
         rc = aggregateBufToBatch(mBufDefs[index]);
     } else {
@@ -819,6 +905,212 @@ int32_t QCamera3Stream::bufDoneLocked(uint32_t index)
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mapProcRoutine
+ *
+ * DESCRIPTION: function to map late registered buffers in the map thread
+ *
+ * PARAMETERS :
+ *   @data    : user data ptr
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void *QCamera3Stream::mapProcRoutine(void *data)
+{
+    int running = 1;
+    int ret;
+    QCamera3Stream *pme = (QCamera3Stream *)data;
+    QCameraCmdThread *cmdThread = &pme->mMapTh;
+
+    cmdThread->setName("CAM_StrmMap");
+
+    LOGD("E");
+    do {
+        do {
+            ret = cam_sem_wait(&cmdThread->cmd_sem);
+            if (ret != 0 && errno != EINVAL) {
+                LOGE("cam_sem_wait error (%s)",
+                       strerror(errno));
+                return NULL;
+            }
+        } while (ret != 0);
+
+        camera_cmd_type_t cmd = cmdThread->getCmd();
+        switch (cmd) {
+        case CAMERA_CMD_TYPE_DO_NEXT_JOB:
+            pme->processPendingMap();
+            break;
+        case CAMERA_CMD_TYPE_EXIT:
+            LOGH("Exit");
+            pme->flushPendingMap();
+            running = 0;
+            break;
+        default:
+            break;
+        }
+    } while (running);
+    LOGD("X");
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : processPendingMap
+ *
+ * DESCRIPTION: map the buffer at the head of the pending queue if needed and
+ *              queue it to kernel. The entry stays at the head while the
+ *              backend maps it, so later bufDone calls line up behind it.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::processPendingMap()
+{
+    int32_t rc = NO_ERROR;
+    uint32_t index;
+    bool needMap = false;
+    bool mapFailed = false;
+    int fd = -1;
+    ssize_t bufSize = BAD_INDEX;
+    void *buffer = NULL;
+    nsecs_t startTs = 0;
+
+    {
+        Mutex::Autolock lock(mLock);
+        if (mPendingMapQ.empty() || (mStreamBufs == NULL) ||
+                (mBufDefs == NULL) || (mBufMapState == NULL)) {
+            return;
+        }
+        index = *mPendingMapQ.begin();
+        if (BUF_MAP_PENDING == mBufMapState[index]) {
+            needMap = true;
+            fd = mStreamBufs->getFd(index);
+            bufSize = mStreamBufs->getSize(index);
+            buffer = (mMapStreamBuffers ? mStreamBufs->getPtr(index) : NULL);
+        }
+    }
+
+    if (needMap) {
+        startTs = systemTime();
+        if ((NULL == mMemOps) || (BAD_INDEX == bufSize)) {
+            LOGE("Cannot map buffer %d, ops %p size %zd",
+                    index, mMemOps, bufSize);
+            rc = INVALID_OPERATION;
+        } else {
+            rc = mMemOps->map_ops(index, -1, fd, (size_t)bufSize, buffer,
+                    CAM_MAPPING_BUF_TYPE_STREAM_BUF, mMemOps->userdata);
+        }
+    }
+
+    {
+        Mutex::Autolock lock(mLock);
+        mPendingMapQ.erase(mPendingMapQ.begin());
+        if (needMap) {
+            if (rc < 0) {
+                LOGE("Failed to map camera buffer %d", index);
+            } else {
+                rc = mStreamBufs->getBufDef(mFrameLenOffset, mBufDefs[index],
+                        index, mMapStreamBuffers);
+                if (NO_ERROR != rc) {
+                    LOGE("Couldn't find camera buffer definition");
+                    mMemOps->unmap_ops(index, -1,
+                            CAM_MAPPING_BUF_TYPE_STREAM_BUF, mMemOps->userdata);
+                }
+            }
+            mBufMapState[index] = (rc < 0) ? BUF_MAP_FAILED : BUF_MAP_DONE;
+            mapFailed = (rc < 0);
+            LOGD("Mapped streamBufIdx: %d in %lld us, rc %d", index,
+                    (long long)ns2us(systemTime() - startTs), rc);
+        }
+        if (!mapFailed) {
+            rc = queueBufLocked(index);
+            if (NO_ERROR != rc) {
+                LOGE("Failed to queue buffer %d, rc = %d", index, rc);
+                mInflight.onDropped(index);
+            }
+        }
+        mMapCond.broadcast();
+    }
+
+    if (mapFailed) {
+        notifyMapError(index);
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : flushPendingMap
+ *
+ * DESCRIPTION: drop buffers still waiting on the map thread. Used on exit,
+ *              after the stream has stopped consuming buffers.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::flushPendingMap()
+{
+    Mutex::Autolock lock(mLock);
+    for (auto itr = mPendingMapQ.begin(); itr != mPendingMapQ.end(); itr++) {
+        if ((mBufMapState != NULL) &&
+                (BUF_MAP_PENDING == mBufMapState[*itr])) {
+            mBufMapState[*itr] = BUF_MAP_NONE;
+        }
+        mInflight.onDropped(*itr);
+    }
+    if (!mPendingMapQ.empty()) {
+        LOGH("Dropped %zu buffers waiting for mapping", mPendingMapQ.size());
+    }
+    mPendingMapQ.clear();
+    mMapCond.broadcast();
+}
+
+/*===========================================================================
+ * FUNCTION   : notifyMapError
+ *
+ * DESCRIPTION: return a buffer whose late mapping failed to the channel as
+ *              an error frame, the same way a dropped frame is reported
+ *
+ * PARAMETERS :
+ *   @index   : index of buffer that failed mapping
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void QCamera3Stream::notifyMapError(uint32_t index)
+{
+    mm_camera_super_buf_t *frame =
+        (mm_camera_super_buf_t *)calloc(1, sizeof(mm_camera_super_buf_t));
+    if (frame == NULL) {
+        LOGE("No mem for mm_camera_super_buf_t");
+        return;
+    }
+
+    {
+        Mutex::Autolock lock(mLock);
+        if (mBufDefs == NULL) {
+            free(frame);
+            return;
+        }
+        mBufDefs[index].stream_id = mHandle;
+        mBufDefs[index].stream_type = getMyType();
+        mBufDefs[index].buf_type = CAM_STREAM_BUF_TYPE_MPLANE;
+        mBufDefs[index].buf_idx = index;
+        mBufDefs[index].flags |= V4L2_BUF_FLAG_ERROR;
+        frame->camera_handle = mCamHandle;
+        frame->ch_id = mChannelHandle;
+        frame->num_bufs = 1;
+        frame->bufs[0] = &mBufDefs[index];
+    }
+
+    mInflight.onReturned(index);
+    if (mDataQ.enqueue((void *)frame)) {
+        mProcTh.sendCmd(CAMERA_CMD_TYPE_DO_NEXT_JOB, FALSE, FALSE);
+    } else {
+        LOGE("Stream thread is not active, buffer %d not returned", index);
+        free(frame);
+        mInflight.onCallbackDone();
+    }
+}
+
 /*===========================================================================
  * FUNCTION   : cancelBuffer
  *
@@ -859,6 +1151,87 @@ int32_t QCamera3Stream::cancelBuffer(uint32_t index)
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : cancelInflight
+ *
+ * DESCRIPTION: recall every buffer this stream has queued to the backend.
+ *              The buffers come back through the stream callback as error
+ *              frames, the stream keeps running and its buffers stay mapped.
+ *
+ * PARAMETERS :
+ *   @deadline  : absolute systemTime() to give up waiting for late mappings
+ *   @cancelled : number of buffers recalled
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCamera3Stream::cancelInflight(nsecs_t deadline, uint32_t &cancelled)
+{
+    cancelled = 0;
+    if (UNLIKELY(mBatchSize)) {
+        // The backend cannot recall buffers of a batch container
+        return INVALID_OPERATION;
+    }
+
+    Mutex::Autolock lock(mLock);
+    if ((mStreamBufs == NULL) || (mBufDefs == NULL)) {
+        return NO_ERROR;
+    }
+
+    // Buffers behind a late mapping reach the backend after it, let them
+    // get there so they are recalled with the rest.
+    while (!mPendingMapQ.empty()) {
+        nsecs_t now = systemTime();
+        if (now >= deadline) {
+            LOGE("Stream type %d: %zu buffers still waiting for mapping",
+                    getMyType(), mPendingMapQ.size());
+            return TIMED_OUT;
+        }
+        mMapCond.waitRelative(mLock, deadline - now);
+    }
+
+    uint64_t queued = mInflight.getQueuedMask();
+    for (uint32_t i = 0; (i < mNumBufs) && (queued != 0); i++) {
+        if (!(queued & (1ULL << i))) {
+            continue;
+        }
+        queued &= ~(1ULL << i);
+        if (mCamOps->cancel_buffer(mCamHandle, mChannelHandle, mHandle, i) < 0) {
+            // Already on its way back, the callback accounts for it
+            LOGD("Buffer %d of stream type %d not recalled", i, getMyType());
+        } else {
+            cancelled++;
+        }
+    }
+    LOGD("Recalled %u buffers of stream type %d", cancelled, getMyType());
+
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : waitInflight
+ *
+ * DESCRIPTION: wait until every buffer given to this stream came back through
+ *              the stream callback
+ *
+ * PARAMETERS :
+ *   @deadline : absolute systemTime() to give up at
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- no buffer in flight
+ *              TIMED_OUT -- buffers still in flight at the deadline
+ *==========================================================================*/
+int32_t QCamera3Stream::waitInflight(nsecs_t deadline)
+{
+    int32_t rc = mInflight.waitDrained(deadline);
+    if (NO_ERROR != rc) {
+        LOGE("Stream type %d: %u buffers still in flight", getMyType(),
+                mInflight.getCount());
+    }
+    return rc;
+}
+
 /*===========================================================================
  * FUNCTION   : bufRelease
  *
@@ -880,6 +1253,17 @@ int32_t QCamera3Stream::bufRelease(int32_t index)
         return BAD_INDEX;
     }
 
+    if (mBufMapState != NULL) {
+        while (BUF_MAP_PENDING == mBufMapState[index]) {
+            mMapCond.wait(mLock);
+        }
+        if (BUF_MAP_FAILED == mBufMapState[index]) {
+            // Already reported as an error frame, nothing registered
+            mBufMapState[index] = BUF_MAP_NONE;
+            return NO_ERROR;
+        }
+    }
+
     if (NULL != mBufDefs[index].mem_info) {
         if (NULL == mMemOps) {
             LOGE("Camera operations not initialized");
@@ -894,6 +1278,9 @@ int32_t QCamera3Stream::bufRelease(int32_t index)
         }
 
         mBufDefs[index].mem_info = NULL;
+        if (mBufMapState != NULL) {
+            mBufMapState[index] = BUF_MAP_NONE;
+        }
     } else {
         LOGE("Buffer at index %d not registered");
         return BAD_INDEX;
@@ -947,32 +1334,9 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
         return NO_MEMORY;
     }
 
-    for (uint32_t i = 0; i < mNumBufs; i++) {
-        if (mStreamBufs->valid(i)) {
-            ssize_t bufSize = mStreamBufs->getSize(i);
-            if (BAD_INDEX != bufSize) {
-                void* buffer = (mMapStreamBuffers ?
-                        mStreamBufs->getPtr(i) : NULL);
-                rc = ops_tbl->map_ops(i, -1, mStreamBufs->getFd(i),
-                        (size_t)bufSize, buffer,
-                        CAM_MAPPING_BUF_TYPE_STREAM_BUF,
-                        ops_tbl->userdata);
-                if (rc < 0) {
-                    LOGE("map_stream_buf failed: %d", rc);
-                    for (uint32_t j = 0; j < i; j++) {
-                        if (mStreamBufs->valid(j)) {
-                            ops_tbl->unmap_ops(j, -1,
-                                    CAM_MAPPING_BUF_TYPE_STREAM_BUF,
-                                    ops_tbl->userdata);
-                        }
-                    }
-                    return INVALID_OPERATION;
-                }
-            } else {
-                LOGE("Failed to retrieve buffer size (bad index)");
-                return INVALID_OPERATION;
-            }
-        }
+    rc = mapStreamBufsLocked(ops_tbl);
+    if (NO_ERROR != rc) {
+        return rc;
     }
 
     //regFlags array is allocated by us, but consumed and freed by mm-camera-interface
@@ -1025,12 +1389,129 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
         return INVALID_OPERATION;
     }
 
+    mBufMapState = (uint8_t *)malloc(sizeof(uint8_t) * mNumBufs);
+    if (mBufMapState != NULL) {
+        for (uint32_t i = 0; i < mNumBufs; i++) {
+            mBufMapState[i] = mStreamBufs->valid(i) ? BUF_MAP_DONE : BUF_MAP_NONE;
+        }
+        mPendingMapQ.clear();
+        // Batch containers are flushed from the request thread through
+        // queueBatchBuf, so batched streams keep aggregating inline.
+        if (mAsyncMapEnable && !mBatchSize) {
+            mMapThActive = (NO_ERROR == mMapTh.launch(mapProcRoutine, this));
+        }
+    } else {
+        LOGW("No memory for map state, late buffers are mapped inline");
+    }
+
     *num_bufs = mNumBufs;
     *initial_reg_flag = regFlags;
     *bufs = mBufDefs;
     return NO_ERROR;
 }
 
+/*===========================================================================
+ * FUNCTION   : mapStreamBufsLocked
+ *
+ * DESCRIPTION: register all valid stream buffers with the backend. Buffers
+ *              go out in bundled messages of up to CAM_MAX_NUM_BUFS_PER_STREAM
+ *              entries; one map_ops call per buffer is only used when the
+ *              interface has no bundled op.
+ *
+ * PARAMETERS :
+ *   @ops_tbl    : ptr to buf mapping/unmapping ops
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, nothing is left mapped
+ *==========================================================================*/
+int32_t QCamera3Stream::mapStreamBufsLocked(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
+{
+    int32_t rc = NO_ERROR;
+    uint32_t numMapped = 0; // buffers below this index reached the backend
+    uint32_t numQueued = 0;
+    uint32_t numMsgs = 0;
+    bool bundled = (NULL != ops_tbl->bundled_map_ops);
+    QCameraBufferMaps bufferMaps;
+    cam_buf_map_type_list bufMapList;
+    nsecs_t startTs = systemTime();
+
+    for (uint32_t i = 0; i < mNumBufs; i++) {
+        if (!mStreamBufs->valid(i)) {
+            continue;
+        }
+        ssize_t bufSize = mStreamBufs->getSize(i);
+        if (BAD_INDEX == bufSize) {
+            LOGE("Failed to retrieve buffer size (bad index)");
+            rc = INVALID_OPERATION;
+            break;
+        }
+        void* buffer = (mMapStreamBuffers ? mStreamBufs->getPtr(i) : NULL);
+
+        if (!bundled) {
+            rc = ops_tbl->map_ops(i, -1, mStreamBufs->getFd(i),
+                    (size_t)bufSize, buffer,
+                    CAM_MAPPING_BUF_TYPE_STREAM_BUF,
+                    ops_tbl->userdata);
+            numMsgs++;
+            if (rc < 0) {
+                break;
+            }
+            numMapped = i + 1;
+            continue;
+        }
+
+        if (numQueued == CAM_MAX_NUM_BUFS_PER_STREAM) {
+            rc = bufferMaps.getCamBufMapList(bufMapList);
+            if (rc == NO_ERROR) {
+                rc = ops_tbl->bundled_map_ops(&bufMapList, ops_tbl->userdata);
+            }
+            numMsgs++;
+            if (rc < 0) {
+                break;
+            }
+            numMapped = i;
+            numQueued = 0;
+            bufferMaps = QCameraBufferMaps();
+        }
+
+        rc = bufferMaps.enqueue(CAM_MAPPING_BUF_TYPE_STREAM_BUF,
+                0 /*stream id*/, i /*buf index*/, -1 /*plane index*/,
+                0 /*cookie*/, mStreamBufs->getFd(i), (size_t)bufSize,
+                buffer);
+        if (rc != NO_ERROR) {
+            LOGE("Failed to queue buffer %d for mapping", i);
+            rc = BAD_INDEX;
+            break;
+        }
+        numQueued++;
+    }
+
+    if ((rc == NO_ERROR) && (numQueued > 0)) {
+        rc = bufferMaps.getCamBufMapList(bufMapList);
+        if (rc == NO_ERROR) {
+            rc = ops_tbl->bundled_map_ops(&bufMapList, ops_tbl->userdata);
+        }
+        numMsgs++;
+    }
+
+    if (rc < 0) {
+        LOGE("map_stream_buf failed: %d", rc);
+        for (uint32_t j = 0; j < numMapped; j++) {
+            if (mStreamBufs->valid(j)) {
+                ops_tbl->unmap_ops(j, -1, CAM_MAPPING_BUF_TYPE_STREAM_BUF,
+                        ops_tbl->userdata);
+            }
+        }
+        return INVALID_OPERATION;
+    }
+
+    LOGH("stream type %d: mapped %d buffers with %u messages in %lld us",
+            getMyType(), mNumBufs, numMsgs,
+            (long long)ns2us(systemTime() - startTs));
+    return NO_ERROR;
+}
+
 /*===========================================================================
  * FUNCTION   : putBufs
  *
@@ -1046,6 +1527,11 @@ int32_t QCamera3Stream::getBufs(cam_frame_len_offset_t *offset,
 int32_t QCamera3Stream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
 {
     int rc = NO_ERROR;
+
+    // The map thread takes mLock itself, stop it before tearing down
+    mMapTh.exit();
+    mMapThActive = false;
+
     Mutex::Autolock lock(mLock);
 
     for (uint32_t i = 0; i < mNumBufs; i++) {
@@ -1058,6 +1544,10 @@ int32_t QCamera3Stream::putBufs(mm_camera_map_unmap_ops_tbl_t *ops_tbl)
     }
     mBufDefs = NULL; // mBufDefs just keep a ptr to the buffer
                      // mm-camera-interface own the buffer, so no need to free
+    if (mBufMapState != NULL) {
+        free(mBufMapState);
+        mBufMapState = NULL;
+    }
     memset(&mFrameLenOffset, 0, sizeof(mFrameLenOffset));
 
     if (mStreamBufs == NULL) {
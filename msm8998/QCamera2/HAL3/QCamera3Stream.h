@@ -31,9 +31,11 @@
 #define __QCAMERA3_STREAM_H__
 
 // System dependencies
+#include <utils/Condition.h>
 #include <utils/Mutex.h>
 
 // Camera dependencies
+#include "QCamera3Flush.h"
 #include "QCamera3Mem.h"
 #include "QCamera3StreamMem.h"
 #include "QCameraCmdThread.h"
@@ -83,6 +85,7 @@ public:
 
     static void dataNotifyCB(mm_camera_super_buf_t *recvd_frame, void *userdata);
     static void *dataProcRoutine(void *data);
+    static void *mapProcRoutine(void *data);
     uint32_t getMyHandle() const {return mHandle;}
     cam_stream_type_t getMyType() const;
     int32_t getFrameOffset(cam_frame_len_offset_t &offset);
@@ -99,6 +102,8 @@ public:
 
     static void releaseFrameData(void *data, void *user_data);
     int32_t timeoutFrame(int32_t bufIdx);
+    int32_t cancelInflight(nsecs_t deadline, uint32_t &cancelled);
+    int32_t waitInflight(nsecs_t deadline);
 
 private:
     uint32_t mCamHandle;
@@ -118,6 +123,21 @@ private:
     Mutex mTimeoutFrameQLock;
 
     QCameraCmdThread mProcTh; // thread for dataCB
+    QCamera3InflightBufs mInflight; // buffers between bufDone and dataCB
+
+    typedef enum {
+        BUF_MAP_NONE,    // not registered with the backend
+        BUF_MAP_PENDING, // waiting on mMapTh
+        BUF_MAP_DONE,    // registered, mBufDefs entry valid
+        BUF_MAP_FAILED,  // late mapping failed, returned as error frame
+    } buf_map_state_t;
+
+    QCameraCmdThread mMapTh; // thread for late buffer mapping
+    bool mMapThActive;
+    bool mAsyncMapEnable;
+    uint8_t *mBufMapState; // per buffer buf_map_state_t, guarded by mLock
+    List<uint32_t> mPendingMapQ; // bufDone order behind a pending map
+    Condition mMapCond; // signalled on every mPendingMapQ completion
 
     QCamera3HeapMemory *mStreamInfoBuf;
     QCamera3StreamMem *mStreamBufs;
@@ -174,6 +194,11 @@ private:
     int32_t aggregateStartingBufs(const uint8_t *initial_reg_flag);
     int32_t handleBatchBuffer(mm_camera_super_buf_t *superBuf);
     int32_t bufDoneLocked(uint32_t index);
+    int32_t queueBufLocked(uint32_t index);
+    int32_t mapStreamBufsLocked(mm_camera_map_unmap_ops_tbl_t *ops_tbl);
+    void processPendingMap();
+    void flushPendingMap();
+    void notifyMapError(uint32_t index);
 
     static const char* mStreamNames[CAM_STREAM_TYPE_MAX];
     void flushFreeBatchBufQ();
@@ -0,0 +1,97 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+// Camera dependencies
+#include "QCamera3StreamConfig.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : isSameStreamConfig
+ *
+ * DESCRIPTION: compare two stream configuration keys field by field
+ *
+ * PARAMETERS :
+ *   @a : first key
+ *   @b : second key
+ *
+ * RETURN     : true if every field matches
+ *==========================================================================*/
+bool isSameStreamConfig(const stream_config_key_t &a,
+        const stream_config_key_t &b)
+{
+    return (a.stream_type == b.stream_type) &&
+            (a.format == b.format) &&
+            (a.width == b.width) &&
+            (a.height == b.height) &&
+            (a.rotation == b.rotation) &&
+            (a.data_space == b.data_space) &&
+            (a.op_mode == b.op_mode) &&
+            (a.cam_stream_type == b.cam_stream_type) &&
+            (a.pp_mask == b.pp_mask) &&
+            (a.hw_width == b.hw_width) &&
+            (a.hw_height == b.hw_height) &&
+            (a.preview_width == b.preview_width) &&
+            (a.preview_height == b.preview_height) &&
+            (a.video_width == b.video_width) &&
+            (a.video_height == b.video_height) &&
+            (a.is_4k_video == b.is_4k_video) &&
+            (a.is_video == b.is_video) &&
+            (a.is_zsl == b.is_zsl) &&
+            (a.is_eis3 == b.is_eis3);
+}
+
+/*===========================================================================
+ * FUNCTION   : isStreamConfigReusable
+ *
+ * DESCRIPTION: decide whether the channel of a stream that appears again in
+ *              configureStreams can be kept
+ *
+ * PARAMETERS :
+ *   @prevKey      : inputs the existing channel was created from
+ *   @prevFwkUsage : usage the framework asked for last time
+ *   @prevHalUsage : usage after the HAL added its flags last time
+ *   @newKey       : inputs the channel would be created from now
+ *   @newUsage     : usage the framework passes now
+ *
+ * RETURN     : true if the channel can be kept
+ *==========================================================================*/
+bool isStreamConfigReusable(const stream_config_key_t &prevKey,
+        uint32_t prevFwkUsage, uint32_t prevHalUsage,
+        const stream_config_key_t &newKey, uint32_t newUsage)
+{
+    // The framework either resets usage or hands back what the HAL set.
+    if ((newUsage != prevFwkUsage) && (newUsage != prevHalUsage)) {
+        return false;
+    }
+    return isSameStreamConfig(prevKey, newKey);
+}
+
+}; // namespace qcamera
@@ -0,0 +1,71 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+*
+* Redistribution and use in source and binary forms, with or without
+* modification, are permitted provided that the following conditions are
+* met:
+*     * Redistributions of source code must retain the above copyright
+*       notice, this list of conditions and the following disclaimer.
+*     * Redistributions in binary form must reproduce the above
+*       copyright notice, this list of conditions and the following
+*       disclaimer in the documentation and/or other materials provided
+*       with the distribution.
+*     * Neither the name of The Linux Foundation nor the names of its
+*       contributors may be used to endorse or promote products derived
+*       from this software without specific prior written permission.
+*
+* THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+* WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+* ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+* BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+* CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+* SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+* WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+* OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+* IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*
+*/
+
+
+#ifndef __QCAMERA3STREAMCONFIG_H__
+#define __QCAMERA3STREAMCONFIG_H__
+
+// System dependencies
+#include <stdint.h>
+
+namespace qcamera {
+
+// Inputs a stream channel is created from. configureStreams keeps the
+// channel of a stream that appears again only if these are unchanged.
+typedef struct {
+    int32_t stream_type;
+    int32_t format;
+    uint32_t width;
+    uint32_t height;
+    int32_t rotation;
+    int32_t data_space;
+    uint32_t op_mode;
+    int32_t cam_stream_type;      // backend stream type
+    uint64_t pp_mask;             // post-processing feature mask
+    int32_t hw_width;             // size the backend stream is configured with
+    int32_t hw_height;
+    int32_t preview_width;
+    int32_t preview_height;
+    int32_t video_width;
+    int32_t video_height;
+    uint8_t is_4k_video;
+    uint8_t is_video;
+    uint8_t is_zsl;
+    uint8_t is_eis3;
+} stream_config_key_t;
+
+bool isSameStreamConfig(const stream_config_key_t &a,
+        const stream_config_key_t &b);
+bool isStreamConfigReusable(const stream_config_key_t &prevKey,
+        uint32_t prevFwkUsage, uint32_t prevHalUsage,
+        const stream_config_key_t &newKey, uint32_t newUsage);
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA3STREAMCONFIG_H__ */
@@ -1309,6 +1309,56 @@ static inline void clear_metadata_buffer(metadata_buffer_t *meta)
     }
 }
 
+#define COPY_META_BLOCK_IF_VALID(DST, SRC, VALID, BLOCK) \
+    do { \
+        (DST)->VALID = (SRC)->VALID; \
+        if ((SRC)->VALID) { \
+            memcpy(&(DST)->BLOCK, &(SRC)->BLOCK, sizeof((SRC)->BLOCK)); \
+        } \
+    } while (0)
+
+/* Update this inline function along with clear_metadata_buffer() when a
+ * new is_xxx_valid is added to or removed from metadata_buffer_t.
+ * Copies the flag table and parameter data, but only those optional blocks
+ * (tuning, mobicat, stats debug, depth) whose valid flag is set in src. */
+static inline void copy_metadata_buffer(metadata_buffer_t *dst,
+        const metadata_buffer_t *src)
+{
+    if (dst && src && (dst != src)) {
+      memcpy(dst->is_valid, src->is_valid, CAM_INTF_PARM_MAX);
+      memcpy(&dst->data, &src->data, sizeof(src->data));
+      COPY_META_BLOCK_IF_VALID(dst, src, is_tuning_params_valid,
+              tuning_params);
+      if (!src->is_tuning_params_valid) {
+          dst->tuning_params.tuning_sensor_data_size =
+                  src->tuning_params.tuning_sensor_data_size;
+          dst->tuning_params.tuning_vfe_data_size =
+                  src->tuning_params.tuning_vfe_data_size;
+          dst->tuning_params.tuning_mod1_stats_data_size =
+                  src->tuning_params.tuning_mod1_stats_data_size;
+      }
+      COPY_META_BLOCK_IF_VALID(dst, src, is_mobicat_aec_params_valid,
+              mobicat_aec_params);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_ae_params_valid,
+              statsdebug_ae_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_awb_params_valid,
+              statsdebug_awb_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_af_params_valid,
+              statsdebug_af_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_asd_params_valid,
+              statsdebug_asd_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_stats_params_valid,
+              statsdebug_stats_buffer_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_bestats_params_valid,
+              statsdebug_bestats_buffer_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_bhist_params_valid,
+              statsdebug_bhist_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_statsdebug_3a_tuning_params_valid,
+              statsdebug_3a_tuning_data);
+      COPY_META_BLOCK_IF_VALID(dst, src, is_depth_data_valid, depth_data);
+    }
+}
+
 #ifdef  __cplusplus
 }
 #endif
@@ -391,6 +391,12 @@ typedef enum {
 *    @priority : save matched priority frames only
 *    @user_expected_frame_id : Number of frames, camera interface
 *                     will wait for getting the instant capture frame.
+*    @zsl_budget_bytes : bytes the matched super bufs may hold in
+*                     the queue. 0 to bound the queue by water_mark
+*                     only. Only valid for burst mode
+*    @zsl_select_best : on a single frame request, send the best scored
+*                     super buf within look_back first. Only valid for
+*                     burst mode
 **/
 typedef struct {
     mm_camera_super_buf_notify_mode_t notify_mode;
@@ -401,6 +407,8 @@ typedef struct {
     uint8_t enable_frame_sync;
     mm_camera_super_buf_priority_t priority;
     uint8_t user_expected_frame_id;
+    uint64_t zsl_budget_bytes;
+    uint8_t zsl_select_best;
 } mm_camera_channel_attr_t;
 
 /** mm_camera_cb_req_type: Callback request type**/
@@ -42,6 +42,9 @@
 #define QUANT_SIZE 64
 #define QTABLE_MAX 2
 #define MM_JPEG_MAX_MPO_IMAGES 2
+#define MM_JPEG_MAX_APP_MARKERS 16
+#define MM_JPEG_MPO_MAX_SG_ENTRIES (3 + MM_JPEG_MAX_MPO_IMAGES - 1)
+#define MM_JPEG_MPO_MAX_MP_HDR_SIZE 2048
 
 /* bit mask for buffer usage*/
 #define MM_JPEG_HAS_READ_BUF CPU_HAS_READ
@@ -108,10 +111,27 @@ typedef struct {
   uint32_t index; /* index used to identify the buffers */
 } mm_jpeg_buf_t;
 
+/* Marker layout of an encoded jpeg bitstream. Filled by the encoder
+ * from the stream header so that consumers like the MPO composer do not
+ * need to scan the image. All offsets are from the start of the image. */
+typedef struct {
+  /* set if the index below describes the image */
+  uint8_t valid;
+  /* offset of the length field of each APPn segment, 0 if not present */
+  uint32_t app_offset[MM_JPEG_MAX_APP_MARKERS];
+  /* value of the length field of each APPn segment */
+  uint16_t app_size[MM_JPEG_MAX_APP_MARKERS];
+  /* offset of the SOS marker */
+  uint32_t sos_offset;
+  /* offset of the EOI marker */
+  uint32_t eoi_offset;
+} mm_jpeg_marker_index_t;
+
 typedef struct {
   uint8_t *buf_vaddr;        /* ptr to buf */
   int fd;                    /* fd of buf */
   size_t buf_filled_len;   /* used for output image. filled by the client */
+  mm_jpeg_marker_index_t marker_idx; /* marker index. filled by the encoder */
 } mm_jpeg_output_t;
 
 typedef enum {
@@ -369,6 +389,21 @@ typedef struct {
   size_t output_buff_size;
 } mm_jpeg_mpo_info_t;
 
+typedef struct {
+  const uint8_t *buf_vaddr;  /* ptr to the data of this entry */
+  size_t len;                /* length of this entry */
+} mm_jpeg_sg_entry_t;
+
+/* MPO laid out as a scatter-gather list over the source jpeg buffers.
+ * Only the MP index (APP2) segment of the primary image is copied, into
+ * mp_hdr, since it has to be patched with the sizes and offsets. */
+typedef struct {
+  mm_jpeg_sg_entry_t entries[MM_JPEG_MPO_MAX_SG_ENTRIES];
+  uint32_t num_entries;
+  size_t total_len;
+  uint8_t mp_hdr[MM_JPEG_MPO_MAX_MP_HDR_SIZE];
+} mm_jpeg_mpo_sg_t;
+
 typedef struct {
   /* config a job -- async call */
   int (*start_job)(mm_jpeg_job_t* job, uint32_t* job_id);
@@ -415,6 +450,13 @@ typedef struct {
   /* Compose MPO*/
   int (*compose_mpo)(mm_jpeg_mpo_info_t *mpo_info);
 
+  /* Compose MPO as scatter-gather list without copying the images */
+  int (*compose_mpo_sg)(mm_jpeg_mpo_info_t *mpo_info, mm_jpeg_mpo_sg_t *sg);
+
+  /* Copy scatter-gather MPO into a contiguous buffer */
+  int (*flatten_mpo_sg)(mm_jpeg_mpo_sg_t *sg, uint8_t *out_buf,
+    size_t out_buf_size);
+
 } mm_jpeg_mpo_ops_t;
 
 /* open a jpeg client -- sync call
@@ -38,6 +38,7 @@
 #include "cam_semaphore.h"
 #include "mm_camera_interface.h"
 #include "mm_camera_shim.h"
+#include "mm_camera_zsl_ring.h"
 
 /**********************************************************************************
 * Data structure declarations
@@ -425,6 +426,8 @@ typedef struct {
     uint32_t frame_idx;
     /* unmatched meta idx needed in case of low priority queue */
     uint32_t unmatched_meta_idx;
+    /* quality from the metadata, used for best frame selection */
+    cam_zsl_quality_t quality;
 } mm_channel_queue_node_t;
 
 typedef struct {
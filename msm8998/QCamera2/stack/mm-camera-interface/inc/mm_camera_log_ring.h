@@ -0,0 +1,156 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __MM_CAMERA_LOG_RING_H__
+#define __MM_CAMERA_LOG_RING_H__
+
+// System dependencies
+#include <pthread.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Set of per thread single producer / single consumer rings of fixed size
+ * slots. Only the owner thread moves a ring's head and only the set's one
+ * consumer moves its tail, so queueing takes no lock and no system call. A
+ * thread gets its ring on first use; when it exits the ring is orphaned and
+ * the consumer frees it once drained, keeping its counters. */
+typedef struct cam_thread_ring cam_thread_ring_t;
+
+typedef struct {
+  uint32_t           slot_size;
+  uint32_t           slots;      /* per ring, must be a power of two */
+  pthread_mutex_t    lock;       /* guards the ring list */
+  int                key_valid;
+  pthread_key_t      key;
+  cam_thread_ring_t *rings;
+  uint32_t           threads;
+  uint64_t           retired_written;
+  uint64_t           retired_dropped;
+} cam_thread_ring_set_t;
+
+#define CAM_THREAD_RING_SET_INITIALIZER(slot_size, slots) \
+  { (slot_size), (slots), PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL, 0, 0, 0 }
+
+typedef struct {
+  uint64_t written;  /* slots committed by all threads */
+  uint64_t dropped;  /* slots lost because a thread's ring was full */
+  uint32_t threads;  /* threads currently owning a ring */
+} cam_thread_ring_stats_t;
+
+/* Producer side, calling thread only. reserve returns NULL if the ring is
+ * full, counting a drop. commit returns 1 when the ring just got half full
+ * and the consumer should be woken. */
+cam_thread_ring_t *cam_thread_ring_get(cam_thread_ring_set_t *set);
+int32_t cam_thread_ring_tid(const cam_thread_ring_t *ring);
+void *cam_thread_ring_reserve(cam_thread_ring_t *ring);
+int cam_thread_ring_commit(cam_thread_ring_t *ring);
+
+/* Consumer side. peek returns the oldest committed slot or NULL and consume
+ * releases it. reap frees the drained rings of exited threads, so it must
+ * not run concurrently with a walk of the list. */
+cam_thread_ring_t *cam_thread_ring_first(cam_thread_ring_set_t *set);
+cam_thread_ring_t *cam_thread_ring_next(const cam_thread_ring_t *ring);
+void *cam_thread_ring_peek(cam_thread_ring_t *ring);
+void cam_thread_ring_consume(cam_thread_ring_t *ring);
+void cam_thread_ring_reap(cam_thread_ring_set_t *set);
+
+void cam_thread_ring_get_stats(cam_thread_ring_set_t *set,
+    cam_thread_ring_stats_t *stats);
+
+/* Records buffered per logging thread, must be a power of two */
+#define CAM_LOG_RING_SLOTS      128
+/* Raw argument words kept per record, '*' width/precision take one each */
+#define CAM_LOG_RING_MAX_ARGS   12
+/* Bytes per record for copies of %s arguments */
+#define CAM_LOG_RING_STR_BYTES  192
+
+/* One log call as captured by the calling thread. Nothing is formatted
+ * until the drainer picks the record up. fmt and func must be string
+ * literals; %s arguments are copied into str. fmt is NULL for records the
+ * drainer generates itself (drop notices). */
+typedef struct {
+  uint64_t    ts_ns;       /* CLOCK_REALTIME at the log call */
+  const char *fmt;
+  const char *func;
+  int32_t     line;
+  int32_t     tid;
+  uint8_t     module;
+  uint8_t     level;
+  uint8_t     nargs;
+  uint8_t     preformatted; /* str holds the formatted message */
+  uint16_t    str_len;
+  uint64_t    args[CAM_LOG_RING_MAX_ARGS];
+  char        str[CAM_LOG_RING_STR_BYTES];
+} cam_log_rec_t;
+
+/* Called on the drainer thread for every record, oldest first */
+typedef void (*cam_log_sink_t)(const cam_log_rec_t *rec, const char *msg,
+    void *user_data);
+
+typedef struct {
+  uint64_t written;  /* records queued by all threads */
+  uint64_t dropped;  /* records lost because a thread's ring was full */
+  uint64_t drained;  /* records handed to the sink */
+  uint32_t threads;  /* threads currently owning a ring */
+} cam_log_ring_stats_t;
+
+/* Start the drainer. Returns 0 on success. */
+int cam_log_ring_start(cam_log_sink_t sink, void *user_data);
+
+/* Drain what is queued and stop the drainer. Later writes return -1 until
+ * the ring is started again. */
+void cam_log_ring_stop(void);
+
+int cam_log_ring_is_active(void);
+
+/* Capture one log call. Returns 0 if queued, 1 if dropped because this
+ * thread's ring is full and -1 if the drainer is not running, in which case
+ * the caller should log synchronously. */
+int cam_log_ring_write(uint8_t module, uint8_t level, const char *func,
+    int32_t line, const char *fmt, va_list args);
+
+/* Block until every record queued before the call has been drained */
+void cam_log_ring_flush(void);
+
+void cam_log_ring_get_stats(cam_log_ring_stats_t *stats);
+
+/* Render the message of a record, without the module/level/func prefix */
+void cam_log_ring_format(const cam_log_rec_t *rec, char *dst, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MM_CAMERA_LOG_RING_H__ */
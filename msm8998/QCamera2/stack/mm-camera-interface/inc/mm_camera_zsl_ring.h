@@ -0,0 +1,87 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef __MM_CAMERA_ZSL_RING_H__
+#define __MM_CAMERA_ZSL_RING_H__
+
+// System dependencies
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Superbufs compared by one selection at most */
+#define CAM_ZSL_MAX_WINDOW      32
+
+/* Score weights, a settled exposure outweighs everything else */
+#define CAM_ZSL_W_AEC           400
+#define CAM_ZSL_W_FOCUSED       300
+#define CAM_ZSL_W_FOCUS_UNKNOWN 150
+#define CAM_ZSL_W_FOCUS_FAILED  100
+#define CAM_ZSL_W_SHARPNESS     200
+#define CAM_ZSL_W_STILLNESS     200
+
+typedef enum {
+  CAM_ZSL_FOCUS_UNKNOWN,   /* no AF state, fixed focus or AF off */
+  CAM_ZSL_FOCUS_SCANNING,  /* lens moving */
+  CAM_ZSL_FOCUS_FOCUSED,
+  CAM_ZSL_FOCUS_FAILED,    /* lens settled out of focus */
+} cam_zsl_focus_t;
+
+/* Cheap quality estimate of a queued superbuf, taken from its metadata */
+typedef struct {
+  uint8_t valid;        /* metadata seen for the frame */
+  uint8_t aec_settled;  /* AEC converged or locked */
+  uint8_t focus;        /* cam_zsl_focus_t */
+  float   sharpness;    /* AF focus value, larger is sharper, 0 if unknown */
+  float   motion;       /* motion times exposure, larger is blurrier */
+} cam_zsl_quality_t;
+
+/* Score of one frame. Sharpness and motion are scaled by the largest values
+ * of the window the frame is compared in; 0 leaves them out. Frames without
+ * metadata score 0, any other frame at least 1. */
+uint32_t cam_zsl_score(const cam_zsl_quality_t *q, float max_sharpness,
+    float max_motion);
+
+/* Index of the best frame of a window ordered oldest first. Ties go to the
+ * oldest frame, the one picked by position alone. -1 if count is 0. */
+int32_t cam_zsl_select(const cam_zsl_quality_t *q, uint32_t count);
+
+/* Number of superbufs of frame_bytes that fit in budget_bytes, at least 1
+ * and at most max_depth. */
+uint32_t cam_zsl_budget_depth(uint64_t budget_bytes, uint64_t frame_bytes,
+    uint32_t max_depth);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MM_CAMERA_ZSL_RING_H__ */
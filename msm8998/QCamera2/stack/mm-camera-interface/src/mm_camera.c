@@ -50,6 +50,7 @@
 #include "mm_camera.h"
 #include "mm_camera_muxer.h"
 #include "cam_cond.h"
+#include "mm_camera_log_ring.h"
 
 #define SET_PARM_BIT32(parm, parm_arr) \
     (parm_arr[parm/32] |= (1<<(parm%32)))
@@ -2663,47 +2664,51 @@ static void cam_vsnprintf(char* pdst, unsigned int size,
   }
 }
 
-/** mm_camera_debug_log
- *    @module: origin or log message
- *    @level:  logging level
- *    @func:   caller function name
- *    @line:   caller line number
- *    @fmt:    log message formatting string
- *    @...:    variable argument list
+/** mm_camera_debug_output
+ *    @module:  origin or log message
+ *    @level:   logging level
+ *    @func:    caller function name
+ *    @line:    caller line number
+ *    @str:     formatted log message
+ *    @tv:      time of the log call
+ *    @tid:     calling thread
+ *    @queued:  message went through the async log ring
  *
- *  Generig logger method.
+ *  Writes a formatted message to logcat and the debug log file. Messages
+ *  from the async log ring are written by the drainer thread, so they carry
+ *  the id of the thread that logged them.
  *
  *  Return: N/A
  **/
-void mm_camera_debug_log(const cam_modules_t module,
+static void mm_camera_debug_output(const cam_modules_t module,
                    const cam_global_debug_level_t level,
-                   const char *func, const int line, const char *fmt, ...) {
-  char    str_buffer[CDBG_MAX_STR_LEN];
-  va_list args;
+                   const char *func, const int line, const char *str,
+                   struct timeval *tv, int tid, int queued) {
+  char tid_str[16] = {0};
 
-  va_start(args, fmt);
-  cam_vsnprintf(str_buffer, CDBG_MAX_STR_LEN, fmt, args);
-  va_end(args);
+  if (queued) {
+    snprintf(tid_str, sizeof(tid_str), "[%d] ", tid);
+  }
 
   switch (level) {
   case CAM_GLBL_DBG_WARN:
-    ALOGW("%s%s %s: %d: %s", cam_loginfo[module].name,
-      cam_dbg_level_to_str[level], func, line, str_buffer);
+    ALOGW("%s%s %s: %d: %s%s", cam_loginfo[module].name,
+      cam_dbg_level_to_str[level], func, line, tid_str, str);
     break;
   case CAM_GLBL_DBG_ERR:
-    ALOGE("%s%s %s: %d: %s", cam_loginfo[module].name,
-      cam_dbg_level_to_str[level], func, line, str_buffer);
+    ALOGE("%s%s %s: %d: %s%s", cam_loginfo[module].name,
+      cam_dbg_level_to_str[level], func, line, tid_str, str);
     break;
   case CAM_GLBL_DBG_INFO:
-    ALOGI("%s%s %s: %d: %s", cam_loginfo[module].name,
-      cam_dbg_level_to_str[level], func, line, str_buffer);
+    ALOGI("%s%s %s: %d: %s%s", cam_loginfo[module].name,
+      cam_dbg_level_to_str[level], func, line, tid_str, str);
     break;
   case CAM_GLBL_DBG_HIGH:
   case CAM_GLBL_DBG_DEBUG:
   case CAM_GLBL_DBG_LOW:
   default:
-    ALOGD("%s%s %s: %d: %s", cam_loginfo[module].name,
-      cam_dbg_level_to_str[level], func, line, str_buffer);
+    ALOGD("%s%s %s: %d: %s%s", cam_loginfo[module].name,
+      cam_dbg_level_to_str[level], func, line, tid_str, str);
   }
 
 
@@ -2711,25 +2716,87 @@ void mm_camera_debug_log(const cam_modules_t module,
     char new_str_buffer[CDBG_MAX_STR_LEN];
     pthread_mutex_lock(&dbg_log_mutex);
 
-    struct timeval tv;
-    struct timezone tz;
-    gettimeofday(&tv, &tz);
-
     struct tm *now;
-    now = gmtime((time_t *)&tv.tv_sec);
+    now = gmtime((time_t *)&tv->tv_sec);
     if (now != NULL) {
         snprintf(new_str_buffer, CDBG_MAX_STR_LEN,
                   "%2d %02d:%02d:%02d.%03ld %d:%d Camera%s%s %d: %s: %s", now->tm_mday,
-                  now->tm_hour, now->tm_min, now->tm_sec, tv.tv_usec, getpid(),gettid(),
+                  now->tm_hour, now->tm_min, now->tm_sec, tv->tv_usec, getpid(), tid,
                   cam_dbg_level_to_str[level], cam_loginfo[module].name,
-                  line, func, str_buffer);
+                  line, func, str);
         fprintf(cam_log_fd, "%s", new_str_buffer);
     } else {
-        LOGE("Invalid gmtime");
+        ALOGE("Invalid gmtime");
     }
     pthread_mutex_unlock(&dbg_log_mutex);
   }
+}
 
+/** mm_camera_debug_sink
+ *    @rec:       record captured by the logging thread
+ *    @msg:       formatted log message
+ *    @user_data: unused
+ *
+ *  Output function of the async log ring, runs on its drainer thread.
+ *
+ *  Return: N/A
+ **/
+static void mm_camera_debug_sink(const cam_log_rec_t *rec, const char *msg,
+                   void *user_data __unused) {
+  struct timeval tv;
+  cam_modules_t module = CAM_NO_MODULE;
+  cam_global_debug_level_t level = CAM_GLBL_DBG_WARN;
+
+  /* records without a format are drop notices from the ring itself */
+  if (rec->fmt != NULL) {
+    if (rec->module < CAM_LAST_MODULE) {
+      module = (cam_modules_t)rec->module;
+    }
+    level = (rec->level <= CAM_GLBL_DBG_INFO) ?
+        (cam_global_debug_level_t)rec->level : CAM_GLBL_DBG_INFO;
+  }
+
+  tv.tv_sec = (time_t)(rec->ts_ns / 1000000000ULL);
+  tv.tv_usec = (suseconds_t)((rec->ts_ns % 1000000000ULL) / 1000);
+  mm_camera_debug_output(module, level, rec->func, rec->line, msg, &tv,
+      rec->tid, 1);
+}
+
+/** mm_camera_debug_log
+ *    @module: origin or log message
+ *    @level:  logging level
+ *    @func:   caller function name
+ *    @line:   caller line number
+ *    @fmt:    log message formatting string
+ *    @...:    variable argument list
+ *
+ *  Generig logger method. With persist.camera.debug.async set the raw
+ *  arguments are queued on the calling thread's log ring and formatted and
+ *  written out by the drainer, so verbose logging stays off the frame path.
+ *
+ *  Return: N/A
+ **/
+void mm_camera_debug_log(const cam_modules_t module,
+                   const cam_global_debug_level_t level,
+                   const char *func, const int line, const char *fmt, ...) {
+  char    str_buffer[CDBG_MAX_STR_LEN];
+  va_list args;
+  struct timeval tv;
+  struct timezone tz;
+
+  va_start(args, fmt);
+  if (cam_log_ring_write((uint8_t)module, (uint8_t)level, func, line, fmt,
+      args) >= 0) {
+    /* queued, or dropped and counted by the ring */
+    va_end(args);
+    return;
+  }
+  cam_vsnprintf(str_buffer, CDBG_MAX_STR_LEN, fmt, args);
+  va_end(args);
+
+  gettimeofday(&tv, &tz);
+  mm_camera_debug_output(module, level, func, line, str_buffer, &tv,
+      gettid(), 0);
 }
 
  /** mm_camera_set_dbg_log_properties
@@ -2789,6 +2856,14 @@ void mm_camera_set_dbg_log_properties(void) {
     property_get("persist.camera.debug.assert", property_value, "0");
     cam_soft_assert = atoi(property_value);
 
+    /* queue log calls and format them on a drainer thread */
+    property_get("persist.camera.debug.async", property_value, "0");
+    if (atoi(property_value) && !cam_log_ring_is_active()) {
+      if (cam_log_ring_start(mm_camera_debug_sink, NULL) != 0) {
+        ALOGE("Failed to start async debug logging");
+      }
+    }
+
     /* open default log file according to property setting */
     if (cam_log_fd == NULL) {
       property_get("persist.camera.debug.logfile", property_value, "0");
@@ -2824,6 +2899,8 @@ void mm_camera_set_dbg_log_properties(void) {
    **/
   void mm_camera_debug_close(void) {
 
+    cam_log_ring_stop();
+
     if (cam_log_fd != NULL) {
       fclose(cam_log_fd);
       cam_log_fd = NULL;
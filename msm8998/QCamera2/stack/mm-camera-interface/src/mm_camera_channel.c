@@ -3052,6 +3052,170 @@ end:
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_get_quality
+ *
+ * DESCRIPTION: estimate the quality of a frame from its metadata buffer, for
+ *              picking the best super buf on a request
+ *
+ * PARAMETERS :
+ *   @buf_info: metadata buffer from stream
+ *   @quality : quality to be filled
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_get_quality(mm_camera_buf_info_t *buf_info,
+        cam_zsl_quality_t *quality)
+{
+    const metadata_buffer_t *metadata;
+    int64_t exposure_ns = 0;
+    float motion = 0.0f;
+
+    memset(quality, 0, sizeof(cam_zsl_quality_t));
+    metadata = (const metadata_buffer_t *)buf_info->buf->buffer;
+    if (NULL == metadata) {
+        return;
+    }
+    quality->valid = TRUE;
+    /* without AEC or AF state there is nothing to wait for */
+    quality->aec_settled = TRUE;
+    quality->focus = CAM_ZSL_FOCUS_UNKNOWN;
+
+    IF_META_AVAILABLE(const uint32_t, p_ae_state,
+            CAM_INTF_META_AEC_STATE, metadata) {
+        quality->aec_settled = (*p_ae_state == CAM_AE_STATE_CONVERGED) ||
+                (*p_ae_state == CAM_AE_STATE_LOCKED) ||
+                (*p_ae_state == CAM_AE_STATE_FLASH_REQUIRED);
+    }
+    IF_META_AVAILABLE(const uint32_t, p_af_state,
+            CAM_INTF_META_AF_STATE, metadata) {
+        switch (*p_af_state) {
+        case CAM_AF_STATE_PASSIVE_FOCUSED:
+        case CAM_AF_STATE_FOCUSED_LOCKED:
+            quality->focus = CAM_ZSL_FOCUS_FOCUSED;
+            break;
+        case CAM_AF_STATE_PASSIVE_SCAN:
+        case CAM_AF_STATE_ACTIVE_SCAN:
+            quality->focus = CAM_ZSL_FOCUS_SCANNING;
+            break;
+        case CAM_AF_STATE_NOT_FOCUSED_LOCKED:
+        case CAM_AF_STATE_PASSIVE_UNFOCUSED:
+            quality->focus = CAM_ZSL_FOCUS_FAILED;
+            break;
+        default:
+            break;
+        }
+    }
+    IF_META_AVAILABLE(const float, p_focus_value,
+            CAM_INTF_META_FOCUS_VALUE, metadata) {
+        quality->sharpness = *p_focus_value;
+    }
+    IF_META_AVAILABLE(const float, p_motion_dx,
+            CAM_INTF_META_DEV_CAM_AEC_CAMERA_MOTION_DX, metadata) {
+        motion += (*p_motion_dx < 0.0f) ? -*p_motion_dx : *p_motion_dx;
+    }
+    IF_META_AVAILABLE(const float, p_motion_dy,
+            CAM_INTF_META_DEV_CAM_AEC_CAMERA_MOTION_DY, metadata) {
+        motion += (*p_motion_dy < 0.0f) ? -*p_motion_dy : *p_motion_dy;
+    }
+    IF_META_AVAILABLE(const float, p_subject_motion,
+            CAM_INTF_META_DEV_CAM_AEC_SUBJECT_MOTION, metadata) {
+        motion += *p_subject_motion;
+    }
+    IF_META_AVAILABLE(const int64_t, p_exposure_ns,
+            CAM_INTF_META_SENSOR_EXPOSURE_TIME, metadata) {
+        exposure_ns = *p_exposure_ns;
+    }
+    /* blur grows with the distance moved while the shutter is open */
+    if (exposure_ns > 0) {
+        motion *= (float)exposure_ns / 1000000.0f;
+    }
+    quality->motion = motion;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_matched_bytes
+ *
+ * DESCRIPTION: bytes held by the matched super bufs of the queue. Caller
+ *              holds the queue lock.
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *
+ * RETURN     : bytes held
+ *==========================================================================*/
+static uint64_t mm_channel_superbuf_matched_bytes(mm_channel_queue_t *queue)
+{
+    struct cam_list *head = &queue->que.head.list;
+    struct cam_list *pos = head->next;
+    uint64_t bytes = 0;
+    uint8_t i;
+
+    while (pos != head) {
+        cam_node_t *node = member_of(pos, cam_node_t, list);
+        mm_channel_queue_node_t *super_buf = (mm_channel_queue_node_t *)node->data;
+        if ((NULL != super_buf) && super_buf->matched) {
+            for (i = 0; i < super_buf->num_of_bufs; i++) {
+                if (NULL != super_buf->super_buf[i].buf) {
+                    bytes += super_buf->super_buf[i].buf->frame_len;
+                }
+            }
+        }
+        pos = pos->next;
+    }
+    return bytes;
+}
+
+/*===========================================================================
+ * FUNCTION   : mm_channel_superbuf_select_best
+ *
+ * DESCRIPTION: move the best scored matched super buf to the head of the
+ *              queue, so it is the next one dequeued. Caller holds the queue
+ *              lock.
+ *
+ * PARAMETERS :
+ *   @queue   : superbuf queue
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void mm_channel_superbuf_select_best(mm_channel_queue_t *queue)
+{
+    cam_zsl_quality_t quality[CAM_ZSL_MAX_WINDOW];
+    struct cam_list *nodes[CAM_ZSL_MAX_WINDOW];
+    struct cam_list *head = &queue->que.head.list;
+    struct cam_list *pos = head->next;
+    mm_channel_queue_node_t *first = NULL, *best_buf;
+    uint32_t count = 0;
+    int32_t best;
+
+    while ((pos != head) && (count < CAM_ZSL_MAX_WINDOW)) {
+        cam_node_t *node = member_of(pos, cam_node_t, list);
+        mm_channel_queue_node_t *super_buf = (mm_channel_queue_node_t *)node->data;
+        if ((NULL != super_buf) && super_buf->matched) {
+            if (NULL == first) {
+                first = super_buf;
+            }
+            quality[count] = super_buf->quality;
+            nodes[count] = pos;
+            count++;
+        }
+        pos = pos->next;
+    }
+
+    best = cam_zsl_select(quality, count);
+    if ((best <= 0) || (nodes[best] == head->next)) {
+        return;
+    }
+    best_buf = (mm_channel_queue_node_t *)
+            member_of(nodes[best], cam_node_t, list)->data;
+    cam_list_del_node(nodes[best]);
+    cam_list_insert_before_node(nodes[best], head->next);
+    LOGH("Picked frame %d (AEC %d focus %d) over frame %d (AEC %d focus %d)",
+            best_buf->frame_idx, best_buf->quality.aec_settled,
+            best_buf->quality.focus, first->frame_idx,
+            first->quality.aec_settled, first->quality.focus);
+}
+
 /*===========================================================================
  * FUNCTION   : mm_channel_superbuf_comp_and_enqueue
  *
@@ -3077,6 +3241,8 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
     mm_channel_queue_node_t* super_buf = NULL;
     uint8_t buf_s_idx, i, found_super_buf, unmatched_bundles;
     struct cam_list *last_buf, *insert_before_buf, *last_buf_ptr;
+    cam_zsl_quality_t quality;
+    uint8_t is_meta;
 
     LOGD("E");
 
@@ -3110,6 +3276,12 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
         return 0;
     }
 
+    memset(&quality, 0, sizeof(cam_zsl_quality_t));
+    is_meta = (buf_info->buf->stream_type == CAM_STREAM_TYPE_METADATA);
+    if (is_meta && queue->attr.zsl_select_best) {
+        mm_channel_superbuf_get_quality(buf_info, &quality);
+    }
+
     /* comp */
     pthread_mutex_lock(&queue->que.lock);
     head = &queue->que.head.list;
@@ -3184,6 +3356,9 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
 
         /*Insert incoming buffer to super buffer*/
         super_buf->super_buf[buf_s_idx] = *buf_info;
+        if (is_meta && queue->attr.zsl_select_best) {
+            super_buf->quality = quality;
+        }
 
         /* check if superbuf is all matched */
         super_buf->matched = 1;
@@ -3304,6 +3479,9 @@ int32_t mm_channel_superbuf_comp_and_enqueue(
                 new_buf->num_of_bufs = queue->num_streams;
                 new_buf->super_buf[buf_s_idx] = *buf_info;
                 new_buf->frame_idx = buf_info->frame_idx;
+                if (is_meta && queue->attr.zsl_select_best) {
+                    new_buf->quality = quality;
+                }
 
                 if ((ch_obj->diverted_frame_id == buf_info->frame_idx)
                         || (buf_info->frame_idx == queue->good_frame_id)) {
@@ -3523,6 +3701,25 @@ int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t* my_obj,
             free(super_buf);
         }
     }
+    /* keep the matched bufs within the memory budget, but never drop the
+     * last one. A pending request takes its frames as they match, and may
+     * have put the best one first. */
+    if ((queue->attr.zsl_budget_bytes > 0) && (my_obj->pending_cnt == 0)) {
+        uint64_t bytes = mm_channel_superbuf_matched_bytes(queue);
+        while ((bytes > queue->attr.zsl_budget_bytes) && (queue->match_cnt > 1)) {
+            super_buf = mm_channel_superbuf_dequeue_internal(queue, TRUE, my_obj);
+            if (NULL == super_buf) {
+                break;
+            }
+            for (i=0; i<super_buf->num_of_bufs; i++) {
+                if (NULL != super_buf->super_buf[i].buf) {
+                    bytes -= super_buf->super_buf[i].buf->frame_len;
+                    mm_channel_qbuf(my_obj, super_buf->super_buf[i].buf);
+                }
+            }
+            free(super_buf);
+        }
+    }
     pthread_mutex_unlock(&queue->que.lock);
     LOGD("after match_cnt=%d, water_mark=%d",
           queue->match_cnt, queue->attr.water_mark);
@@ -3535,6 +3732,8 @@ int32_t mm_channel_superbuf_bufdone_overflow(mm_channel_t* my_obj,
  *
  * DESCRIPTION: depends on the lookback configuration of the channel attribute,
  *              unwanted superbufs will be removed from the superbuf queue.
+ *              With zsl_select_best the best scored superbuf left is sent
+ *              first.
  *
  * PARAMETERS :
  *   @my_obj  : channel object
@@ -3567,6 +3766,19 @@ int32_t mm_channel_superbuf_skip(mm_channel_t* my_obj,
             free(super_buf);
         }
     }
+    /* Only single frame captures pick the best looking frame. Bursts must
+     * keep their frames in capture order, and frames asked for by id, flash,
+     * bracketing and frame sync captures need their own frames */
+    if (queue->attr.zsl_select_best && (my_obj->pending_cnt == 1)
+            && (my_obj->frame_req_cnt == 0)
+            && (!my_obj->isConfigCapture)
+            && (!my_obj->needLEDFlash)
+            && (!my_obj->isFlashBracketingEnabled)
+            && (!my_obj->isZoom1xFrameRequested)
+            && (MM_CHANNEL_BRACKETING_STATE_OFF == my_obj->bracketingState)
+            && (!queue->attr.enable_frame_sync)) {
+        mm_channel_superbuf_select_best(queue);
+    }
     pthread_mutex_unlock(&queue->que.lock);
 
     return rc;
@@ -0,0 +1,873 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// System dependencies
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+// Camera dependencies
+#include "mm_camera_log_ring.h"
+
+#define CAM_LOG_RING_IDLE_WAIT_MS  10
+#define CAM_LOG_NULL_STR           UINT64_MAX
+
+struct cam_thread_ring {
+  struct cam_thread_ring *next;
+  cam_thread_ring_set_t  *set;
+  int32_t                 tid;
+  int                     orphaned;  /* owner thread has exited */
+  uint32_t                tail;
+  char                    pad[64];
+  uint32_t                head;
+  uint32_t                dropped;
+  uint64_t                data[];
+};
+
+typedef enum {
+  CAM_LOG_ARG_NONE,
+  CAM_LOG_ARG_INT,
+  CAM_LOG_ARG_LONG,
+  CAM_LOG_ARG_LLONG,
+  CAM_LOG_ARG_DOUBLE,
+  CAM_LOG_ARG_LDOUBLE,
+  CAM_LOG_ARG_PTR,
+  CAM_LOG_ARG_STR,
+} cam_log_arg_t;
+
+/* One printf conversion, parsed from the character after '%' */
+typedef struct {
+  const char   *flags;      /* start of flags/width/precision text */
+  const char   *conv;       /* conversion character */
+  const char   *end;        /* first character after the conversion */
+  cam_log_arg_t type;
+  int           width_star;
+  int           prec_star;
+  int           prec;       /* literal precision, -1 if none */
+  int           hh;         /* h or hh length modifier */
+} cam_log_spec_t;
+
+static cam_thread_ring_set_t g_log_rings =
+    CAM_THREAD_RING_SET_INITIALIZER(sizeof(cam_log_rec_t), CAM_LOG_RING_SLOTS);
+static pthread_mutex_t g_ring_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  g_ring_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  g_flush_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t       g_drainer;
+static cam_log_sink_t  g_sink = NULL;
+static void           *g_sink_data = NULL;
+static int             g_active = 0;
+static int             g_stop = 0;
+static uint32_t        g_flush_req = 0;
+static uint32_t        g_flush_done = 0;
+static uint64_t        g_drained = 0;
+static uint64_t        g_reported_drops = 0;
+
+/*===========================================================================
+ * FUNCTION   : cam_thread_ring_exit
+ *
+ * DESCRIPTION: TLS destructor. Hands the ring of an exiting thread over to
+ *              the consumer, which frees it once it is empty.
+ *
+ * PARAMETERS :
+ *   @data    : ring of the exiting thread
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void cam_thread_ring_exit(void *data)
+{
+  cam_thread_ring_t *ring = (cam_thread_ring_t *)data;
+
+  __atomic_store_n(&ring->orphaned, 1, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_thread_ring_get
+ *
+ * DESCRIPTION: Returns the ring of the calling thread, registering one on
+ *              the first call of the thread.
+ *
+ * PARAMETERS :
+ *   @set     : ring set
+ *
+ * RETURN     : ring of the calling thread, NULL on failure
+ *==========================================================================*/
+cam_thread_ring_t *cam_thread_ring_get(cam_thread_ring_set_t *set)
+{
+  cam_thread_ring_t *ring;
+
+  if (!__atomic_load_n(&set->key_valid, __ATOMIC_ACQUIRE)) {
+    pthread_mutex_lock(&set->lock);
+    if (!set->key_valid &&
+        (pthread_key_create(&set->key, cam_thread_ring_exit) == 0)) {
+      __atomic_store_n(&set->key_valid, 1, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&set->lock);
+    if (!set->key_valid) {
+      return NULL;
+    }
+  }
+  ring = (cam_thread_ring_t *)pthread_getspecific(set->key);
+  if (ring != NULL) {
+    return ring;
+  }
+
+  ring = (cam_thread_ring_t *)calloc(1, sizeof(cam_thread_ring_t) +
+      (size_t)set->slot_size * set->slots);
+  if (ring == NULL) {
+    return NULL;
+  }
+  ring->set = set;
+  ring->tid = (int32_t)syscall(SYS_gettid);
+  pthread_setspecific(set->key, ring);
+
+  pthread_mutex_lock(&set->lock);
+  ring->next = set->rings;
+  __atomic_store_n(&set->rings, ring, __ATOMIC_RELEASE);
+  set->threads++;
+  pthread_mutex_unlock(&set->lock);
+  return ring;
+}
+
+int32_t cam_thread_ring_tid(const cam_thread_ring_t *ring)
+{
+  return ring->tid;
+}
+
+static inline void *cam_thread_ring_slot(cam_thread_ring_t *ring,
+    uint32_t index)
+{
+  return (char *)ring->data +
+      (size_t)(index & (ring->set->slots - 1)) * ring->set->slot_size;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_thread_ring_reserve
+ *
+ * DESCRIPTION: Returns the next free slot of the calling thread's ring. The
+ *              slot stays invisible to the consumer until committed.
+ *
+ * PARAMETERS :
+ *   @ring    : ring of the calling thread
+ *
+ * RETURN     : free slot, NULL if the ring is full
+ *==========================================================================*/
+void *cam_thread_ring_reserve(cam_thread_ring_t *ring)
+{
+  uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if ((ring->head - tail) >= ring->set->slots) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    return NULL;
+  }
+  return cam_thread_ring_slot(ring, ring->head);
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_thread_ring_commit
+ *
+ * DESCRIPTION: Publishes the slot returned by the last reserve.
+ *
+ * PARAMETERS :
+ *   @ring    : ring of the calling thread
+ *
+ * RETURN     : 1 if the ring just got half full, 0 otherwise
+ *==========================================================================*/
+int cam_thread_ring_commit(cam_thread_ring_t *ring)
+{
+  uint32_t head = ring->head + 1;
+
+  __atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+  /* The consumer polls; only kick it early when a ring is filling up */
+  return (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE)) ==
+      (ring->set->slots / 2);
+}
+
+cam_thread_ring_t *cam_thread_ring_first(cam_thread_ring_set_t *set)
+{
+  return __atomic_load_n(&set->rings, __ATOMIC_ACQUIRE);
+}
+
+cam_thread_ring_t *cam_thread_ring_next(const cam_thread_ring_t *ring)
+{
+  return __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+}
+
+void *cam_thread_ring_peek(cam_thread_ring_t *ring)
+{
+  if (ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return cam_thread_ring_slot(ring, ring->tail);
+}
+
+void cam_thread_ring_consume(cam_thread_ring_t *ring)
+{
+  __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_thread_ring_reap
+ *
+ * DESCRIPTION: Frees the drained rings of exited threads. Caller must be the
+ *              consumer or run after it has stopped.
+ *
+ * PARAMETERS :
+ *   @set     : ring set
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_thread_ring_reap(cam_thread_ring_set_t *set)
+{
+  cam_thread_ring_t **link = &set->rings;
+
+  pthread_mutex_lock(&set->lock);
+  while (*link != NULL) {
+    cam_thread_ring_t *ring = *link;
+    if (__atomic_load_n(&ring->orphaned, __ATOMIC_ACQUIRE) &&
+        (ring->tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE))) {
+      __atomic_store_n(link, ring->next, __ATOMIC_RELEASE);
+      set->retired_written += ring->head;
+      set->retired_dropped +=
+          __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+      set->threads--;
+      free(ring);
+    } else {
+      link = &ring->next;
+    }
+  }
+  pthread_mutex_unlock(&set->lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_thread_ring_get_stats
+ *
+ * DESCRIPTION: Returns the queueing counters of all threads of a set.
+ *
+ * PARAMETERS :
+ *   @set     : ring set
+ *   @stats   : counters, filled on return
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_thread_ring_get_stats(cam_thread_ring_set_t *set,
+    cam_thread_ring_stats_t *stats)
+{
+  cam_thread_ring_t *ring;
+
+  pthread_mutex_lock(&set->lock);
+  stats->written = set->retired_written;
+  stats->dropped = set->retired_dropped;
+  for (ring = set->rings; ring != NULL; ring = ring->next) {
+    stats->written += __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    stats->dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+  }
+  stats->threads = set->threads;
+  pthread_mutex_unlock(&set->lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_parse_spec
+ *
+ * DESCRIPTION: Parses one printf conversion. Used both to capture the raw
+ *              arguments and to render them later, so both sides agree on
+ *              how many argument words a format consumes.
+ *
+ * PARAMETERS :
+ *   @p       : character following the '%'
+ *   @spec    : parsed conversion
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void cam_log_parse_spec(const char *p, cam_log_spec_t *spec)
+{
+  int length = 0;  /* 1: l, 2: ll */
+
+  memset(spec, 0, sizeof(*spec));
+  spec->flags = p;
+  spec->prec = -1;
+
+  while ((*p != '\0') && (strchr("-+ #0'", *p) != NULL)) {
+    p++;
+  }
+  if (*p == '*') {
+    spec->width_star = 1;
+    p++;
+  } else {
+    while ((*p >= '0') && (*p <= '9')) {
+      p++;
+    }
+  }
+  if (*p == '.') {
+    p++;
+    if (*p == '*') {
+      spec->prec_star = 1;
+      p++;
+    } else {
+      spec->prec = 0;
+      while ((*p >= '0') && (*p <= '9')) {
+        spec->prec = spec->prec * 10 + (*p - '0');
+        p++;
+      }
+    }
+  }
+
+  for (;; p++) {
+    if (*p == 'h') {
+      spec->hh = 1;
+    } else if ((*p == 'l') || (*p == 'z') || (*p == 't')) {
+      length++;
+    } else if ((*p == 'L') || (*p == 'q') || (*p == 'j')) {
+      length = 2;
+    } else {
+      break;
+    }
+  }
+
+  spec->conv = p;
+  switch (*p) {
+  case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+    spec->type = (length == 0) ? CAM_LOG_ARG_INT :
+        ((length == 1) ? CAM_LOG_ARG_LONG : CAM_LOG_ARG_LLONG);
+    break;
+  case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+  case 'a': case 'A':
+    spec->type = (length == 2) ? CAM_LOG_ARG_LDOUBLE : CAM_LOG_ARG_DOUBLE;
+    break;
+  case 's':
+    spec->type = CAM_LOG_ARG_STR;
+    break;
+  case 'p':
+  case 'n':
+    spec->type = CAM_LOG_ARG_PTR;
+    break;
+  default:
+    /* "%%", unknown conversions and a trailing '%' take no argument */
+    spec->type = CAM_LOG_ARG_NONE;
+    break;
+  }
+  spec->end = (*p != '\0') ? p + 1 : p;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_capture
+ *
+ * DESCRIPTION: Copies the raw arguments of a log call into a record. %s
+ *              arguments are copied since the caller's buffer may be gone by
+ *              the time the record is drained. Formats needing more argument
+ *              words than a record holds are formatted right away instead.
+ *
+ * PARAMETERS :
+ *   @rec     : record to fill
+ *   @fmt     : log message formatting string
+ *   @args    : variable argument list
+ *
+ * RETURN     : none
+ *==========================================================================*/
+static void cam_log_capture(cam_log_rec_t *rec, const char *fmt, va_list args)
+{
+  cam_log_spec_t spec;
+  const char *p = fmt;
+  uint32_t n = 0;
+  uint32_t str_len = 0;
+  va_list ap;
+
+  va_copy(ap, args);
+  while ((p = strchr(p, '%')) != NULL) {
+    cam_log_parse_spec(p + 1, &spec);
+    p = spec.end;
+    if ((n + (uint32_t)spec.width_star + (uint32_t)spec.prec_star +
+        (spec.type != CAM_LOG_ARG_NONE ? 1 : 0)) > CAM_LOG_RING_MAX_ARGS) {
+      vsnprintf(rec->str, CAM_LOG_RING_STR_BYTES, fmt, args);
+      rec->preformatted = 1;
+      n = 0;
+      str_len = 0;
+      break;
+    }
+
+    if (spec.width_star) {
+      rec->args[n++] = (uint64_t)(int64_t)va_arg(ap, int);
+    }
+    if (spec.prec_star) {
+      spec.prec = va_arg(ap, int);
+      rec->args[n++] = (uint64_t)(int64_t)spec.prec;
+    }
+
+    switch (spec.type) {
+    case CAM_LOG_ARG_INT:
+      rec->args[n++] = (uint64_t)(int64_t)va_arg(ap, int);
+      break;
+    case CAM_LOG_ARG_LONG:
+      rec->args[n++] = (uint64_t)(int64_t)va_arg(ap, long);
+      break;
+    case CAM_LOG_ARG_LLONG:
+      rec->args[n++] = (uint64_t)va_arg(ap, long long);
+      break;
+    case CAM_LOG_ARG_DOUBLE:
+    case CAM_LOG_ARG_LDOUBLE: {
+      double d = (spec.type == CAM_LOG_ARG_DOUBLE) ?
+          va_arg(ap, double) : (double)va_arg(ap, long double);
+      memcpy(&rec->args[n++], &d, sizeof(d));
+      break;
+    }
+    case CAM_LOG_ARG_PTR:
+      rec->args[n++] = (uint64_t)(uintptr_t)va_arg(ap, void *);
+      break;
+    case CAM_LOG_ARG_STR: {
+      const char *s = va_arg(ap, const char *);
+      /* the last byte is never handed out and stays NUL, strings that
+       * no longer fit print as empty */
+      size_t avail = CAM_LOG_RING_STR_BYTES - 1 - str_len;
+      size_t len;
+      if (s == NULL) {
+        rec->args[n++] = CAM_LOG_NULL_STR;
+        break;
+      }
+      if (avail == 0) {
+        rec->args[n++] = CAM_LOG_RING_STR_BYTES - 1;
+        break;
+      }
+      len = avail - 1;
+      if ((spec.prec >= 0) && ((size_t)spec.prec < len)) {
+        len = (size_t)spec.prec;
+      }
+      len = strnlen(s, len);
+      memcpy(&rec->str[str_len], s, len);
+      rec->str[str_len + len] = '\0';
+      rec->args[n++] = str_len;
+      str_len += (uint32_t)len + 1;
+      break;
+    }
+    case CAM_LOG_ARG_NONE:
+    default:
+      break;
+    }
+  }
+  va_end(ap);
+
+  rec->nargs = (uint8_t)n;
+  rec->str_len = (uint16_t)str_len;
+  rec->str[CAM_LOG_RING_STR_BYTES - 1] = '\0';
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_ring_write
+ *
+ * DESCRIPTION: Queues one log call on the calling thread's ring.
+ *
+ * PARAMETERS :
+ *   @module  : origin of the log message
+ *   @level   : logging level
+ *   @func    : caller function name
+ *   @line    : caller line number
+ *   @fmt     : log message formatting string
+ *   @args    : variable argument list
+ *
+ * RETURN     : 0  -- queued
+ *              1  -- dropped, the ring is full
+ *              -1 -- drainer not running
+ *==========================================================================*/
+int cam_log_ring_write(uint8_t module, uint8_t level, const char *func,
+    int32_t line, const char *fmt, va_list args)
+{
+  cam_thread_ring_t *ring;
+  cam_log_rec_t *rec;
+  struct timespec ts;
+
+  if (!__atomic_load_n(&g_active, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+  ring = cam_thread_ring_get(&g_log_rings);
+  if (ring == NULL) {
+    return -1;
+  }
+  rec = (cam_log_rec_t *)cam_thread_ring_reserve(ring);
+  if (rec == NULL) {
+    return 1;
+  }
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+  rec->fmt = fmt;
+  rec->func = func;
+  rec->line = line;
+  rec->tid = cam_thread_ring_tid(ring);
+  rec->module = module;
+  rec->level = level;
+  rec->preformatted = 0;
+  cam_log_capture(rec, fmt, args);
+  if (cam_thread_ring_commit(ring)) {
+    pthread_cond_signal(&g_ring_cond);
+  }
+  return 0;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_ring_format
+ *
+ * DESCRIPTION: Renders the message of a captured record.
+ *
+ * PARAMETERS :
+ *   @rec     : captured record
+ *   @dst     : destination buffer
+ *   @size    : size of destination buffer
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_log_ring_format(const cam_log_rec_t *rec, char *dst, size_t size)
+{
+  cam_log_spec_t spec;
+  const char *p;
+  size_t pos = 0;
+  uint32_t n = 0;
+
+  if (size == 0) {
+    return;
+  }
+  dst[0] = '\0';
+  if ((rec->fmt == NULL) || rec->preformatted) {
+    snprintf(dst, size, "%s", rec->str);
+    return;
+  }
+
+  p = rec->fmt;
+  while ((*p != '\0') && (pos < size - 1)) {
+    char conv_fmt[64];
+    size_t len = 0;
+    const char *q;
+    int written = 0;
+
+    if (*p != '%') {
+      dst[pos++] = *p++;
+      continue;
+    }
+
+    cam_log_parse_spec(p + 1, &spec);
+    if (spec.type == CAM_LOG_ARG_NONE) {
+      if (*spec.conv == '%') {
+        dst[pos++] = '%';
+      } else {
+        /* unknown conversion, print it as it was written */
+        for (q = p; (q < spec.end) && (pos < size - 1); q++) {
+          dst[pos++] = *q;
+        }
+      }
+      p = spec.end;
+      continue;
+    }
+
+    /* rebuild the conversion with '*' resolved and a normalized length */
+    conv_fmt[len++] = '%';
+    for (q = spec.flags; (q < spec.conv) && (len < sizeof(conv_fmt) - 24);
+        q++) {
+      if (*q == '*') {
+        len += (size_t)snprintf(&conv_fmt[len], sizeof(conv_fmt) - len, "%d",
+            (n < rec->nargs) ? (int)rec->args[n] : 0);
+        n++;
+      } else if (strchr("hlLqjzt", *q) == NULL) {
+        conv_fmt[len++] = *q;
+      }
+    }
+    if (spec.hh && (spec.type == CAM_LOG_ARG_INT)) {
+      /* keep h/hh, they change how the promoted int is printed */
+      for (q = spec.flags; q < spec.conv; q++) {
+        if (*q == 'h') {
+          conv_fmt[len++] = 'h';
+        }
+      }
+    } else if (spec.type == CAM_LOG_ARG_LONG) {
+      conv_fmt[len++] = 'l';
+    } else if (spec.type == CAM_LOG_ARG_LLONG) {
+      conv_fmt[len++] = 'l';
+      conv_fmt[len++] = 'l';
+    }
+    conv_fmt[len++] = *spec.conv;
+    conv_fmt[len] = '\0';
+    p = spec.end;
+
+    if (n >= rec->nargs) {
+      break;
+    }
+
+    switch (spec.type) {
+    case CAM_LOG_ARG_INT:
+      written = snprintf(&dst[pos], size - pos, conv_fmt, (int)rec->args[n]);
+      break;
+    case CAM_LOG_ARG_LONG:
+      written = snprintf(&dst[pos], size - pos, conv_fmt, (long)rec->args[n]);
+      break;
+    case CAM_LOG_ARG_LLONG:
+      written = snprintf(&dst[pos], size - pos, conv_fmt,
+          (long long)rec->args[n]);
+      break;
+    case CAM_LOG_ARG_DOUBLE:
+    case CAM_LOG_ARG_LDOUBLE: {
+      double d;
+      memcpy(&d, &rec->args[n], sizeof(d));
+      written = snprintf(&dst[pos], size - pos, conv_fmt, d);
+      break;
+    }
+    case CAM_LOG_ARG_PTR:
+      if (*spec.conv == 'p') {
+        written = snprintf(&dst[pos], size - pos, conv_fmt,
+            (void *)(uintptr_t)rec->args[n]);
+      }
+      break;
+    case CAM_LOG_ARG_STR:
+      written = snprintf(&dst[pos], size - pos, conv_fmt,
+          (rec->args[n] == CAM_LOG_NULL_STR) ? "(null)" :
+          &rec->str[rec->args[n]]);
+      break;
+    case CAM_LOG_ARG_NONE:
+    default:
+      break;
+    }
+    n++;
+    if (written > 0) {
+      pos += (size_t)written;
+      if (pos > size - 1) {
+        pos = size - 1;
+      }
+    }
+  }
+  dst[pos] = '\0';
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_ring_drain
+ *
+ * DESCRIPTION: Hands every queued record to the sink, merging the per
+ *              thread rings in timestamp order. Runs on the drainer only.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : number of records drained
+ *==========================================================================*/
+static uint32_t cam_log_ring_drain(void)
+{
+  char msg[1024];
+  uint32_t count = 0;
+  cam_thread_ring_stats_t stats;
+  cam_thread_ring_t *ring;
+
+  for (;;) {
+    cam_thread_ring_t *best = NULL;
+    cam_log_rec_t *best_rec = NULL;
+
+    for (ring = cam_thread_ring_first(&g_log_rings); ring != NULL;
+        ring = cam_thread_ring_next(ring)) {
+      cam_log_rec_t *rec = (cam_log_rec_t *)cam_thread_ring_peek(ring);
+      if ((rec != NULL) &&
+          ((best_rec == NULL) || (rec->ts_ns < best_rec->ts_ns))) {
+        best = ring;
+        best_rec = rec;
+      }
+    }
+    if (best == NULL) {
+      break;
+    }
+
+    cam_log_ring_format(best_rec, msg, sizeof(msg));
+    g_sink(best_rec, msg, g_sink_data);
+    cam_thread_ring_consume(best);
+    __atomic_fetch_add(&g_drained, 1, __ATOMIC_RELAXED);
+    count++;
+  }
+
+  /* report drops once the backlog is gone, so the notice is not lost too */
+  cam_thread_ring_get_stats(&g_log_rings, &stats);
+  if (stats.dropped > g_reported_drops) {
+    cam_log_rec_t notice;
+    struct timespec ts;
+
+    memset(&notice, 0, sizeof(notice));
+    clock_gettime(CLOCK_REALTIME, &ts);
+    notice.ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL +
+        (uint64_t)ts.tv_nsec;
+    notice.func = __func__;
+    notice.line = __LINE__;
+    notice.tid = (int32_t)syscall(SYS_gettid);
+    snprintf(notice.str, sizeof(notice.str),
+        "%llu log records dropped, ring full",
+        (unsigned long long)(stats.dropped - g_reported_drops));
+    g_reported_drops = stats.dropped;
+    g_sink(&notice, notice.str, g_sink_data);
+  }
+  return count;
+}
+
+static void *cam_log_ring_drainer(void *data __unused)
+{
+  prctl(PR_SET_NAME, (unsigned long)"CAM_LogDrain", 0, 0, 0);
+
+  for (;;) {
+    uint32_t flush_req, count;
+    int stop;
+
+    pthread_mutex_lock(&g_ring_lock);
+    flush_req = g_flush_req;
+    stop = g_stop;
+    pthread_mutex_unlock(&g_ring_lock);
+
+    count = cam_log_ring_drain();
+    cam_thread_ring_reap(&g_log_rings);
+
+    pthread_mutex_lock(&g_ring_lock);
+    g_flush_done = flush_req;
+    pthread_cond_broadcast(&g_flush_cond);
+    if (stop) {
+      pthread_mutex_unlock(&g_ring_lock);
+      break;
+    }
+    if ((count == 0) && !g_stop && (g_flush_req == flush_req)) {
+      struct timespec ts;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_nsec += CAM_LOG_RING_IDLE_WAIT_MS * 1000000L;
+      if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait(&g_ring_cond, &g_ring_lock, &ts);
+    }
+    pthread_mutex_unlock(&g_ring_lock);
+  }
+  return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_ring_start
+ *
+ * DESCRIPTION: Starts the drainer thread. From now on log calls are queued
+ *              and formatted/output on the drainer.
+ *
+ * PARAMETERS :
+ *   @sink      : output function called for every record
+ *   @user_data : passed to the sink
+ *
+ * RETURN     : 0  -- success
+ *              -1 -- failure or already running
+ *==========================================================================*/
+int cam_log_ring_start(cam_log_sink_t sink, void *user_data)
+{
+  int rc = -1;
+
+  if (sink == NULL) {
+    return -1;
+  }
+  pthread_mutex_lock(&g_ring_lock);
+  if (!g_active) {
+    g_sink = sink;
+    g_sink_data = user_data;
+    g_stop = 0;
+    if (pthread_create(&g_drainer, NULL, cam_log_ring_drainer, NULL) == 0) {
+      __atomic_store_n(&g_active, 1, __ATOMIC_RELEASE);
+      rc = 0;
+    }
+  }
+  pthread_mutex_unlock(&g_ring_lock);
+  return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_ring_stop
+ *
+ * DESCRIPTION: Stops queueing, drains what is queued and joins the drainer.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_log_ring_stop(void)
+{
+  pthread_mutex_lock(&g_ring_lock);
+  if (!g_active) {
+    pthread_mutex_unlock(&g_ring_lock);
+    return;
+  }
+  __atomic_store_n(&g_active, 0, __ATOMIC_RELEASE);
+  g_stop = 1;
+  pthread_cond_signal(&g_ring_cond);
+  pthread_mutex_unlock(&g_ring_lock);
+
+  pthread_join(g_drainer, NULL);
+}
+
+int cam_log_ring_is_active(void)
+{
+  return __atomic_load_n(&g_active, __ATOMIC_ACQUIRE);
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_ring_flush
+ *
+ * DESCRIPTION: Waits until the drainer has emptied every ring at least once
+ *              after this call.
+ *
+ * PARAMETERS : none
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_log_ring_flush(void)
+{
+  uint32_t seq;
+
+  pthread_mutex_lock(&g_ring_lock);
+  seq = ++g_flush_req;
+  pthread_cond_signal(&g_ring_cond);
+  while (g_active && ((int32_t)(g_flush_done - seq) < 0)) {
+    pthread_cond_wait(&g_flush_cond, &g_ring_lock);
+  }
+  pthread_mutex_unlock(&g_ring_lock);
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_log_ring_get_stats
+ *
+ * DESCRIPTION: Returns the queueing counters of all threads.
+ *
+ * PARAMETERS :
+ *   @stats   : counters, filled on return
+ *
+ * RETURN     : none
+ *==========================================================================*/
+void cam_log_ring_get_stats(cam_log_ring_stats_t *stats)
+{
+  cam_thread_ring_stats_t ring_stats;
+
+  cam_thread_ring_get_stats(&g_log_rings, &ring_stats);
+  stats->written = ring_stats.written;
+  stats->dropped = ring_stats.dropped;
+  stats->drained = __atomic_load_n(&g_drained, __ATOMIC_RELAXED);
+  stats->threads = ring_stats.threads;
+}
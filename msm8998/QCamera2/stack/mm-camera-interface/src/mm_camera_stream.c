@@ -2249,11 +2249,17 @@ int32_t mm_stream_map_bufs(mm_stream_t * my_obj,
             == CAM_STREAMING_MODE_BATCH)))) {
         pthread_mutex_lock(&my_obj->buf_lock);
         for (i = 0; i < numbufs; i++) {
-           if (ret < 0) {
-               my_obj->buf_status[i].map_status = -1;
-           } else {
-               my_obj->buf_status[i].map_status = 1;
-           }
+            /* the list may be sparse, status is kept per frame index */
+            uint32_t frame_idx = buf_map_list->buf_maps[i].frame_idx;
+            if (frame_idx >= CAM_MAX_NUM_BUFS_PER_STREAM) {
+                LOGE("Invalid frame index %d in map list", frame_idx);
+                continue;
+            }
+            if (ret < 0) {
+                my_obj->buf_status[frame_idx].map_status = -1;
+            } else {
+                my_obj->buf_status[frame_idx].map_status = 1;
+            }
         }
 
         if (mm_stream_need_wait_for_mapping(my_obj) == 0) {
@@ -0,0 +1,160 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+// System dependencies
+#include <stddef.h>
+
+// Camera dependencies
+#include "mm_camera_zsl_ring.h"
+
+/*===========================================================================
+ * FUNCTION   : cam_zsl_score
+ *
+ * DESCRIPTION: Scores the quality of one queued frame.
+ *
+ * PARAMETERS :
+ *   @q             : frame quality
+ *   @max_sharpness : largest sharpness of the compared frames
+ *   @max_motion    : largest motion of the compared frames
+ *
+ * RETURN     : score, higher is better
+ *==========================================================================*/
+uint32_t cam_zsl_score(const cam_zsl_quality_t *q, float max_sharpness,
+    float max_motion)
+{
+  uint32_t score = 0;
+
+  if ((q == NULL) || !q->valid) {
+    return 0;
+  }
+  /* any frame with metadata beats one without */
+  score = 1;
+  if (q->aec_settled) {
+    score += CAM_ZSL_W_AEC;
+  }
+  switch (q->focus) {
+  case CAM_ZSL_FOCUS_FOCUSED:
+    score += CAM_ZSL_W_FOCUSED;
+    break;
+  case CAM_ZSL_FOCUS_UNKNOWN:
+    score += CAM_ZSL_W_FOCUS_UNKNOWN;
+    break;
+  case CAM_ZSL_FOCUS_FAILED:
+    score += CAM_ZSL_W_FOCUS_FAILED;
+    break;
+  default:
+    break;
+  }
+  if ((max_sharpness > 0.0f) && (q->sharpness > 0.0f)) {
+    float s = q->sharpness / max_sharpness;
+    score += (uint32_t)(CAM_ZSL_W_SHARPNESS * (s > 1.0f ? 1.0f : s));
+  }
+  if (max_motion > 0.0f) {
+    float m = q->motion / max_motion;
+    if (m < 0.0f) {
+      m = 0.0f;
+    }
+    score += (uint32_t)(CAM_ZSL_W_STILLNESS * (m > 1.0f ? 0.0f : 1.0f - m));
+  } else {
+    score += CAM_ZSL_W_STILLNESS;
+  }
+  return score;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_zsl_select
+ *
+ * DESCRIPTION: Picks the best scored frame of a window.
+ *
+ * PARAMETERS :
+ *   @q       : frame qualities, oldest first
+ *   @count   : number of frames, up to CAM_ZSL_MAX_WINDOW are compared
+ *
+ * RETURN     : index of the best frame, -1 if count is 0
+ *==========================================================================*/
+int32_t cam_zsl_select(const cam_zsl_quality_t *q, uint32_t count)
+{
+  float max_sharpness = 0.0f, max_motion = 0.0f;
+  uint32_t best_score = 0, i;
+  int32_t best = -1;
+
+  if ((q == NULL) || (count == 0)) {
+    return -1;
+  }
+  if (count > CAM_ZSL_MAX_WINDOW) {
+    count = CAM_ZSL_MAX_WINDOW;
+  }
+  for (i = 0; i < count; i++) {
+    if (!q[i].valid) {
+      continue;
+    }
+    if (q[i].sharpness > max_sharpness) {
+      max_sharpness = q[i].sharpness;
+    }
+    if (q[i].motion > max_motion) {
+      max_motion = q[i].motion;
+    }
+  }
+  for (i = 0; i < count; i++) {
+    uint32_t score = cam_zsl_score(&q[i], max_sharpness, max_motion);
+    if ((best < 0) || (score > best_score)) {
+      best = (int32_t)i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+/*===========================================================================
+ * FUNCTION   : cam_zsl_budget_depth
+ *
+ * DESCRIPTION: Converts a ZSL memory budget into a queue depth.
+ *
+ * PARAMETERS :
+ *   @budget_bytes : bytes the queue may hold
+ *   @frame_bytes  : bytes of one superbuf
+ *   @max_depth    : largest depth allowed
+ *
+ * RETURN     : queue depth, between 1 and max_depth
+ *==========================================================================*/
+uint32_t cam_zsl_budget_depth(uint64_t budget_bytes, uint64_t frame_bytes,
+    uint32_t max_depth)
+{
+  uint64_t depth;
+
+  if (frame_bytes == 0) {
+    return max_depth > 0 ? max_depth : 1;
+  }
+  depth = budget_bytes / frame_bytes;
+  if (depth > max_depth) {
+    depth = max_depth;
+  }
+  return depth > 0 ? (uint32_t)depth : 1;
+}
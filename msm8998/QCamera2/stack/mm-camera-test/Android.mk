@@ -204,4 +204,342 @@ LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_NATIVE_TEST)
 
+# Build cam_prevcb_ring_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_prevcb_ring_tests.cpp \
+        ../../HAL/QCameraPreviewCbRing.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../HAL \
+        hardware/libhardware/include/hardware
+
+LOCAL_HEADER_LIBRARIES := libhardware_headers media_plugin_headers
+
+LOCAL_SHARED_LIBRARIES := libcutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_prevcb_ring_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_log_ring_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_log_ring_tests.cpp \
+        ../mm-camera-interface/src/mm_camera_log_ring.c
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../mm-camera-interface/inc
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_log_ring_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_zsl_ring_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_zsl_ring_tests.cpp \
+        ../mm-camera-interface/src/mm_camera_zsl_ring.c
+
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/../mm-camera-interface/inc
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_zsl_ring_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_perf_lock_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_perf_lock_tests.cpp \
+        ../../util/QCameraPerfLockScheduler.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../util \
+        $(LOCAL_PATH)/../common
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_perf_lock_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_thermal_governor_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_thermal_governor_tests.cpp \
+        ../../HAL/QCameraThermalGovernor.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../HAL
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_thermal_governor_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_fov_lut_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_fov_lut_tests.cpp \
+        ../../util/QCameraFOVControlLut.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../util
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_fov_lut_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_dual_fov_fusion_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_dual_fov_fusion_tests.cpp \
+        ../../util/QCameraDualFOVFusion.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../util
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_dual_fov_fusion_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_halpp_graph_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_halpp_graph_tests.cpp \
+        ../../util/QCameraHALPPGraph.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../util
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_halpp_graph_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_deferred_work_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_deferred_work_tests.cpp \
+        ../../util/QCameraDeferredWork.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../util
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_deferred_work_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_caps_cache_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_caps_cache_tests.cpp \
+        ../../util/QCameraCapsCache.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../util
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_caps_cache_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_hfr_batch_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_hfr_batch_tests.cpp \
+        ../../HAL3/QCamera3HFRBatch.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../HAL3
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_hfr_batch_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_flush_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_flush_tests.cpp \
+        ../../HAL3/QCamera3Flush.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../HAL3 \
+        $(LOCAL_PATH)/../common
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_flush_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_stream_config_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_stream_config_tests.cpp \
+        ../../HAL3/QCamera3StreamConfig.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../HAL3
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_stream_config_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_usb_color_convert_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_usb_color_convert_tests.cpp \
+        ../../../usbcamcore/src/QCameraUsbColorConvert.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../../usbcamcore/inc
+
+LOCAL_SHARED_LIBRARIES := liblog libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_usb_color_convert_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_mjpeg_sw_decode_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_mjpeg_sw_decode_tests.cpp \
+        ../../../usbcamcore/src/QCameraMjpegSwDecode.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../../usbcamcore/inc \
+        external/libjpeg-turbo
+
+LOCAL_SHARED_LIBRARIES := liblog libutils libjpeg
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_mjpeg_sw_decode_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_ts_face_tracker_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := src/cam_ts_face_tracker_tests.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../HAL \
+        $(LOCAL_PATH)/../../HAL/tsMakeuplib/include
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_ts_face_tracker_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_request_gate_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_request_gate_tests.cpp \
+        ../../HAL3/QCamera3RequestGate.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../HAL3 \
+        $(LOCAL_PATH)/../common
+
+LOCAL_SHARED_LIBRARIES := libutils
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror
+
+LOCAL_MODULE := cam_request_gate_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
+# Build cam_camscope_tests
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+        src/cam_camscope_tests.cpp \
+        ../../util/QCameraTrace.cpp
+
+LOCAL_C_INCLUDES += \
+        $(LOCAL_PATH)/../../util \
+        $(LOCAL_PATH)/../common \
+        $(LOCAL_PATH)/../mm-camera-interface/inc
+
+LOCAL_CFLAGS := -Wall -Wextra -Werror -DQCAMERA_REDEFINE_LOG
+
+LOCAL_SHARED_LIBRARIES := libcutils libutils liblog libmmcamera_interface
+
+LOCAL_MODULE := cam_camscope_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_NATIVE_TEST)
+
 LOCAL_PATH := $(OLD_LOCAL_PATH)
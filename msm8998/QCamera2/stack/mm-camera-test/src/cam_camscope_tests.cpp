@@ -0,0 +1,113 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_camscope_tests"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "QCameraTrace.h"
+
+#define CAMSCOPE_TEST_FILE "/data/misc/camera/camscope_jpeg.bin"
+#define CAMSCOPE_TEST_THREADS 4
+#define CAMSCOPE_TEST_PACKETS 5000
+
+static void storeTiming(int32_t thread, uint32_t frame) {
+    camscope_timing packet;
+    memset(&packet, 0, sizeof(packet));
+    packet.sw_base.base.packet_type = CAMSCOPE_SYNC_BEGIN;
+    packet.sw_base.base.size = sizeof(packet);
+    packet.sw_base.thread_id = thread;
+    packet.frame_id = frame;
+    camscope_store_packet(CAMSCOPE_SECTION_JPEG, &packet, sizeof(packet),
+            camscope_overhead_begin());
+}
+
+// Test that packets from threads that come and go reach the file whole and
+// in the order each thread stored them, and that every packet is either
+// written or counted as dropped.
+TEST(cam_camscope_tests, packets_intact) {
+    unlink(CAMSCOPE_TEST_FILE);
+    camscope_init(CAMSCOPE_SECTION_JPEG);
+    camscope_stats_t stats;
+    camscope_get_stats(CAMSCOPE_SECTION_JPEG, &stats);
+    ASSERT_TRUE(stats.active) << "cannot write " CAMSCOPE_TEST_FILE;
+    ASSERT_EQ(0u, stats.flight_sec);
+
+    // Too large for a slot, ignored without counting
+    char big[sizeof(camscope_in_out_timing) + 1];
+    memset(big, 0, sizeof(big));
+    camscope_store_packet(CAMSCOPE_SECTION_JPEG, big, sizeof(big), 0);
+
+    for (int round = 0; round < 2; round++) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < CAMSCOPE_TEST_THREADS; t++) {
+            int32_t id = round * CAMSCOPE_TEST_THREADS + t;
+            threads.push_back(std::thread([id] {
+                for (uint32_t i = 0; i < CAMSCOPE_TEST_PACKETS; i++) {
+                    storeTiming(id, i);
+                }
+            }));
+        }
+        for (auto &th : threads) {
+            th.join();
+        }
+    }
+    camscope_destroy(CAMSCOPE_SECTION_JPEG);
+    camscope_get_stats(CAMSCOPE_SECTION_JPEG, &stats);
+    EXPECT_FALSE(stats.active);
+    EXPECT_EQ(2u * CAMSCOPE_TEST_THREADS * CAMSCOPE_TEST_PACKETS,
+            stats.events + stats.dropped);
+    EXPECT_GT(stats.events, 0u);
+    EXPECT_EQ(stats.events * sizeof(camscope_timing), stats.bytes_out);
+
+    FILE *fp = fopen(CAMSCOPE_TEST_FILE, "rb");
+    ASSERT_NE(nullptr, fp);
+    std::vector<int64_t> last(2 * CAMSCOPE_TEST_THREADS, -1);
+    camscope_timing packet;
+    uint64_t count = 0;
+    while (fread(&packet, sizeof(packet), 1, fp) == 1) {
+        ASSERT_EQ((uint32_t)CAMSCOPE_SYNC_BEGIN,
+                packet.sw_base.base.packet_type);
+        ASSERT_EQ(sizeof(packet), packet.sw_base.base.size);
+        ASSERT_LT((uint32_t)packet.sw_base.thread_id, last.size());
+        ASSERT_GT((int64_t)packet.frame_id, last[packet.sw_base.thread_id]);
+        last[packet.sw_base.thread_id] = packet.frame_id;
+        count++;
+    }
+    EXPECT_TRUE(feof(fp));
+    fclose(fp);
+    EXPECT_EQ(stats.events, count);
+    unlink(CAMSCOPE_TEST_FILE);
+}
+
+// Test that nothing is stored while camscope is off.
+TEST(cam_camscope_tests, inactive) {
+    camscope_stats_t before, after;
+    camscope_get_stats(CAMSCOPE_SECTION_JPEG, &before);
+    storeTiming(0, 0);
+    camscope_get_stats(CAMSCOPE_SECTION_JPEG, &after);
+    EXPECT_FALSE(after.active);
+    EXPECT_EQ(before.events, after.events);
+    EXPECT_EQ(before.dropped, after.dropped);
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_caps_cache_tests"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+
+#include "QCameraCapsCache.h"
+
+using namespace android;
+using namespace qcamera;
+
+#define FAKE_NUM_CAMERAS 3
+#define FAKE_CAPS_SIZE   (64 * 1024)
+#define FAKE_META_SIZE   (12 * 1024 + 5)
+
+enum {
+    SECTION_CAPS = 1,
+    SECTION_META = 2
+};
+
+// Fake backend standing in for the capability query and the static
+// metadata build. Counts how often it is asked.
+struct fake_backend {
+    uint32_t queries;
+    uint64_t sensorIdentity[FAKE_NUM_CAMERAS];
+
+    fake_backend() : queries(0) {
+        for (uint32_t i = 0; i < FAKE_NUM_CAMERAS; i++) {
+            sensorIdentity[i] = 0x1000 + i;
+        }
+    }
+
+    std::vector<uint8_t> query(uint32_t cameraId, uint32_t section) {
+        queries++;
+        size_t size = (section == SECTION_CAPS) ? FAKE_CAPS_SIZE :
+                FAKE_META_SIZE;
+        std::vector<uint8_t> blob(size);
+        for (size_t i = 0; i < size; i++) {
+            blob[i] = (uint8_t)(i * 7 + cameraId * 13 + section);
+        }
+        return blob;
+    }
+};
+
+// Enumerate all cameras the way the HAL does on provider start: use the
+// cache when it has the blob, otherwise ask the backend and store it.
+static void enumerate(QCameraCapsCache &cache, fake_backend &backend)
+{
+    for (uint32_t id = 0; id < FAKE_NUM_CAMERAS; id++) {
+        for (uint32_t section = SECTION_CAPS; section <= SECTION_META;
+                section++) {
+            std::vector<uint8_t> expected = backend.query(id, section);
+            backend.queries--;
+
+            const void *pData = NULL;
+            size_t size = 0;
+            if (cache.lookup(id, section, backend.sensorIdentity[id], &pData,
+                    &size) == NO_ERROR) {
+                ASSERT_EQ(expected.size(), size);
+                ASSERT_EQ(0, memcmp(expected.data(), pData, size));
+                ASSERT_EQ(0u, (uintptr_t)pData & 7);
+                continue;
+            }
+            std::vector<uint8_t> blob = backend.query(id, section);
+            ASSERT_EQ(NO_ERROR, cache.store(id, section,
+                    backend.sensorIdentity[id], blob.data(), blob.size()));
+        }
+    }
+}
+
+class cam_caps_cache_tests : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        const char *dir = (access("/data/local/tmp", W_OK) == 0) ?
+                "/data/local/tmp" : "/tmp";
+        snprintf(mPath, sizeof(mPath), "%s/cam_caps_cache_test_%d.bin", dir,
+                (int)getpid());
+        unlink(mPath);
+    }
+
+    virtual void TearDown() {
+        unlink(mPath);
+    }
+
+    void corrupt(off_t offset) {
+        int fd = open(mPath, O_RDWR);
+        ASSERT_GE(fd, 0);
+        uint8_t byte = 0;
+        ASSERT_EQ(1, pread(fd, &byte, 1, offset));
+        byte ^= 0x5A;
+        ASSERT_EQ(1, pwrite(fd, &byte, 1, offset));
+        close(fd);
+    }
+
+    char mPath[64];
+};
+
+// Test that the second start is served from the cache without the backend.
+TEST_F(cam_caps_cache_tests, cold_then_warm) {
+    fake_backend backend;
+    {
+        QCameraCapsCache cache;
+        ASSERT_EQ(NAME_NOT_FOUND, cache.open(mPath, 42));
+        enumerate(cache, backend);
+    }
+    ASSERT_EQ(2u * FAKE_NUM_CAMERAS, backend.queries);
+
+    backend.queries = 0;
+    QCameraCapsCache cache;
+    ASSERT_EQ(NO_ERROR, cache.open(mPath, 42));
+    ASSERT_TRUE(cache.isValid());
+    enumerate(cache, backend);
+    ASSERT_EQ(0u, backend.queries);
+}
+
+// Test that another software or configuration key ignores the file.
+TEST_F(cam_caps_cache_tests, key_mismatch) {
+    fake_backend backend;
+    {
+        QCameraCapsCache cache;
+        cache.open(mPath, 42);
+        enumerate(cache, backend);
+    }
+
+    backend.queries = 0;
+    QCameraCapsCache cache;
+    ASSERT_EQ(NAME_NOT_FOUND, cache.open(mPath, 43));
+    enumerate(cache, backend);
+    ASSERT_EQ(2u * FAKE_NUM_CAMERAS, backend.queries);
+}
+
+// Test that a changed sensor only refreshes the blobs of that camera.
+TEST_F(cam_caps_cache_tests, sensor_change) {
+    fake_backend backend;
+    {
+        QCameraCapsCache cache;
+        cache.open(mPath, 42);
+        enumerate(cache, backend);
+    }
+
+    backend.queries = 0;
+    backend.sensorIdentity[1] = 0x2001;
+    {
+        QCameraCapsCache cache;
+        ASSERT_EQ(NO_ERROR, cache.open(mPath, 42));
+        enumerate(cache, backend);
+    }
+    ASSERT_EQ(2u, backend.queries);
+
+    backend.queries = 0;
+    QCameraCapsCache cache;
+    ASSERT_EQ(NO_ERROR, cache.open(mPath, 42));
+    enumerate(cache, backend);
+    ASSERT_EQ(0u, backend.queries);
+}
+
+// Test that corrupted or truncated files are rejected.
+TEST_F(cam_caps_cache_tests, corruption) {
+    fake_backend backend;
+    {
+        QCameraCapsCache cache;
+        cache.open(mPath, 42);
+        enumerate(cache, backend);
+    }
+
+    corrupt(FAKE_CAPS_SIZE + 100);
+    {
+        QCameraCapsCache cache;
+        ASSERT_EQ(NAME_NOT_FOUND, cache.open(mPath, 42));
+        enumerate(cache, backend);
+    }
+
+    // The rewrite made the file valid again
+    QCameraCapsCache valid;
+    ASSERT_EQ(NO_ERROR, valid.open(mPath, 42));
+    valid.close();
+
+    ASSERT_EQ(0, truncate(mPath, FAKE_CAPS_SIZE));
+    QCameraCapsCache cache;
+    ASSERT_EQ(NAME_NOT_FOUND, cache.open(mPath, 42));
+    ASSERT_FALSE(cache.isValid());
+
+    ASSERT_EQ(0, truncate(mPath, 8));
+    ASSERT_EQ(NAME_NOT_FOUND, cache.open(mPath, 42));
+}
+
+// Test that a file others can write, or a symlink, is not trusted.
+TEST_F(cam_caps_cache_tests, untrusted_file) {
+    fake_backend backend;
+    {
+        QCameraCapsCache cache;
+        cache.open(mPath, 42);
+        enumerate(cache, backend);
+    }
+
+    struct stat st;
+    ASSERT_EQ(0, stat(mPath, &st));
+    ASSERT_EQ(0u, st.st_mode & (S_IRWXG | S_IRWXO));
+
+    ASSERT_EQ(0, chmod(mPath, 0666));
+    {
+        QCameraCapsCache cache;
+        ASSERT_EQ(NAME_NOT_FOUND, cache.open(mPath, 42));
+    }
+    ASSERT_EQ(0, chmod(mPath, 0600));
+
+    char linkPath[sizeof(mPath) + 5];
+    snprintf(linkPath, sizeof(linkPath), "%s.lnk", mPath);
+    unlink(linkPath);
+    ASSERT_EQ(0, symlink(mPath, linkPath));
+    {
+        QCameraCapsCache cache;
+        ASSERT_EQ(NAME_NOT_FOUND, cache.open(linkPath, 42));
+    }
+    unlink(linkPath);
+
+    QCameraCapsCache cache;
+    ASSERT_EQ(NO_ERROR, cache.open(mPath, 42));
+}
+
+// Test that blobs handed out stay valid while other entries are stored, and
+// report the cost of a warm start.
+TEST_F(cam_caps_cache_tests, stable_blobs) {
+    fake_backend backend;
+    {
+        QCameraCapsCache cache;
+        cache.open(mPath, 42);
+        enumerate(cache, backend);
+    }
+
+    QCameraCapsCache cache;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    ASSERT_EQ(NO_ERROR, cache.open(mPath, 42));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    printf("warm open with %u cameras: %.3f ms\n", FAKE_NUM_CAMERAS,
+            ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e6);
+
+    const void *pCaps = NULL;
+    size_t size = 0;
+    ASSERT_EQ(NO_ERROR, cache.lookup(0, SECTION_CAPS, 0x1000, &pCaps, &size));
+    std::vector<uint8_t> copy((const uint8_t *)pCaps,
+            (const uint8_t *)pCaps + size);
+
+    std::vector<uint8_t> blob = backend.query(2, SECTION_META);
+    blob[0] ^= 0xFF;
+    ASSERT_EQ(NO_ERROR, cache.store(2, SECTION_META, 0x1002, blob.data(),
+            blob.size()));
+    ASSERT_EQ(0, memcmp(copy.data(), pCaps, size));
+
+    const void *pMeta = NULL;
+    ASSERT_EQ(NO_ERROR, cache.lookup(2, SECTION_META, 0x1002, &pMeta, &size));
+    ASSERT_EQ(blob.size(), size);
+    ASSERT_EQ(0, memcmp(blob.data(), pMeta, size));
+    ASSERT_EQ(NAME_NOT_FOUND, cache.lookup(3, SECTION_META, 0x1003, &pMeta,
+            &size));
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_deferred_work_tests"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+
+#include "QCameraDeferredWork.h"
+
+using namespace android;
+using namespace qcamera;
+
+// Stub job: sleeps, optionally waits on a gate, and returns a fixed status.
+struct stub_work {
+    uint32_t tag;
+    useconds_t sleepUs;
+    int32_t status;
+    volatile bool *pGate;
+};
+
+// Stub backend recording what the pool did with the jobs.
+struct stub_backend {
+    pthread_mutex_t lock;
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> cancelled;
+    std::vector<deferred_work_timing_t> timings;
+    uint32_t running;
+    uint32_t maxRunning;
+
+    stub_backend() : running(0), maxRunning(0) {
+        pthread_mutex_init(&lock, NULL);
+    }
+
+    ~stub_backend() {
+        pthread_mutex_destroy(&lock);
+    }
+};
+
+static int32_t stub_run(void *user, void *work)
+{
+    stub_backend *backend = (stub_backend *)user;
+    stub_work *w = (stub_work *)work;
+
+    pthread_mutex_lock(&backend->lock);
+    backend->running++;
+    if (backend->running > backend->maxRunning) {
+        backend->maxRunning = backend->running;
+    }
+    pthread_mutex_unlock(&backend->lock);
+
+    while ((w->pGate != NULL) && !*w->pGate) {
+        usleep(1000);
+    }
+    if (w->sleepUs > 0) {
+        usleep(w->sleepUs);
+    }
+
+    pthread_mutex_lock(&backend->lock);
+    backend->running--;
+    backend->order.push_back(w->tag);
+    pthread_mutex_unlock(&backend->lock);
+    return w->status;
+}
+
+static void stub_cancel(void *user, void *work)
+{
+    stub_backend *backend = (stub_backend *)user;
+    pthread_mutex_lock(&backend->lock);
+    backend->cancelled.push_back(((stub_work *)work)->tag);
+    pthread_mutex_unlock(&backend->lock);
+}
+
+static void stub_done(void *user, const deferred_work_timing_t &timing)
+{
+    stub_backend *backend = (stub_backend *)user;
+    pthread_mutex_lock(&backend->lock);
+    backend->timings.push_back(timing);
+    pthread_mutex_unlock(&backend->lock);
+}
+
+static void launch(QCameraDeferredWork &pool, stub_backend &backend,
+        uint32_t numThreads)
+{
+    deferred_work_ops_t ops;
+    ops.run = stub_run;
+    ops.cancel = stub_cancel;
+    ops.done = stub_done;
+    ops.user = &backend;
+    ASSERT_EQ(NO_ERROR, pool.launch(ops, numThreads, "CAM_dwTest"));
+}
+
+static size_t index_of(const std::vector<uint32_t> &v, uint32_t tag)
+{
+    for (size_t i = 0; i < v.size(); i++) {
+        if (v[i] == tag) {
+            return i;
+        }
+    }
+    return v.size();
+}
+
+// Test the camera open graph: params alloc then init, metadata alloc on its
+// own, JPEG open and pproc init in parallel, joined by pproc setup.
+TEST(cam_deferred_work_tests, open_graph) {
+    enum { PARAM_ALLOC, METADATA_ALLOC, PARAM_INIT, JPEG_OPEN, PPROC_INIT,
+            PPROC_SETUP, NUM_JOBS };
+    QCameraDeferredWork pool;
+    stub_backend backend;
+    launch(pool, backend, 3);
+
+    stub_work work[NUM_JOBS];
+    for (uint32_t i = 0; i < NUM_JOBS; i++) {
+        work[i].tag = i;
+        work[i].sleepUs = 20000;
+        work[i].status = NO_ERROR;
+        work[i].pGate = NULL;
+    }
+
+    uint32_t paramAlloc = pool.queue("param_alloc", &work[PARAM_ALLOC], NULL, 0);
+    uint32_t metaAlloc = pool.queue("metadata_alloc", &work[METADATA_ALLOC],
+            NULL, 0);
+    uint32_t paramInit = pool.queue("param_init", &work[PARAM_INIT],
+            &paramAlloc, 1);
+    uint32_t jpegOpen = pool.queue("jpeg_open", &work[JPEG_OPEN], &paramInit, 1);
+    uint32_t pprocInit = pool.queue("pproc_init", &work[PPROC_INIT],
+            &paramInit, 1);
+    uint32_t setupDeps[] = {jpegOpen, pprocInit};
+    uint32_t pprocSetup = pool.queue("pproc_setup", &work[PPROC_SETUP],
+            setupDeps, 2);
+    ASSERT_NE(0u, metaAlloc);
+    ASSERT_NE(0u, pprocSetup);
+
+    ASSERT_EQ(NO_ERROR, pool.wait(pprocSetup));
+    ASSERT_EQ(NO_ERROR, pool.wait(metaAlloc));
+
+    pthread_mutex_lock(&backend.lock);
+    std::vector<uint32_t> order = backend.order;
+    uint32_t maxRunning = backend.maxRunning;
+    pthread_mutex_unlock(&backend.lock);
+
+    ASSERT_EQ((size_t)NUM_JOBS, order.size());
+    ASSERT_LT(index_of(order, PARAM_ALLOC), index_of(order, PARAM_INIT));
+    ASSERT_LT(index_of(order, PARAM_INIT), index_of(order, JPEG_OPEN));
+    ASSERT_LT(index_of(order, PARAM_INIT), index_of(order, PPROC_INIT));
+    ASSERT_LT(index_of(order, JPEG_OPEN), index_of(order, PPROC_SETUP));
+    ASSERT_LT(index_of(order, PPROC_INIT), index_of(order, PPROC_SETUP));
+    ASSERT_GE(maxRunning, 2u);
+    pool.exit();
+}
+
+// Test that independent jobs overlap and finish in about the time of one.
+TEST(cam_deferred_work_tests, parallel_jobs) {
+    const uint32_t jobs = 3;
+    const useconds_t jobUs = 50000;
+    QCameraDeferredWork pool;
+    stub_backend backend;
+    launch(pool, backend, jobs);
+
+    stub_work work[jobs];
+    uint32_t ids[jobs];
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    nsecs_t start = (nsecs_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+    for (uint32_t i = 0; i < jobs; i++) {
+        work[i].tag = i;
+        work[i].sleepUs = jobUs;
+        work[i].status = NO_ERROR;
+        work[i].pGate = NULL;
+        ids[i] = pool.queue("sleep", &work[i], NULL, 0);
+        ASSERT_NE(0u, ids[i]);
+    }
+    for (uint32_t i = 0; i < jobs; i++) {
+        ASSERT_EQ(NO_ERROR, pool.wait(ids[i]));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    nsecs_t elapsed = (nsecs_t)t.tv_sec * 1000000000LL + t.tv_nsec - start;
+
+    printf("%u jobs of %u ms: %.1f ms\n", jobs, jobUs / 1000, elapsed / 1e6);
+    ASSERT_LT(elapsed, (nsecs_t)jobs * jobUs * 1000 * 2 / 3);
+    pool.exit();
+}
+
+// Test that a failed job keeps its status, still releases its dependents,
+// and that successful jobs are forgotten once done.
+TEST(cam_deferred_work_tests, failure_status) {
+    QCameraDeferredWork pool;
+    stub_backend backend;
+    launch(pool, backend, 2);
+
+    stub_work fail = {0, 0, NO_MEMORY, NULL};
+    stub_work next = {1, 0, NO_ERROR, NULL};
+    uint32_t failId = pool.queue("fail", &fail, NULL, 0);
+    uint32_t nextId = pool.queue("next", &next, &failId, 1);
+
+    ASSERT_EQ(NO_ERROR, pool.wait(nextId));
+    ASSERT_EQ(NO_MEMORY, pool.wait(failId));
+    ASSERT_EQ(NO_MEMORY, pool.getStatus(failId));
+    ASSERT_EQ(NO_ERROR, pool.getStatus(nextId));
+    ASSERT_FALSE(pool.isPending(nextId));
+    // Unknown ids are treated as done
+    ASSERT_EQ(NO_ERROR, pool.wait(0xFFFFu));
+    pool.exit();
+}
+
+// Test that waiting on a job does not wait for unrelated, older jobs.
+TEST(cam_deferred_work_tests, targeted_wait) {
+    volatile bool gate = false;
+    QCameraDeferredWork pool;
+    stub_backend backend;
+    launch(pool, backend, 2);
+
+    stub_work blocked = {0, 0, NO_ERROR, &gate};
+    stub_work quick = {1, 0, NO_ERROR, NULL};
+    uint32_t blockedId = pool.queue("blocked", &blocked, NULL, 0);
+    uint32_t quickId = pool.queue("quick", &quick, NULL, 0);
+
+    ASSERT_EQ(NO_ERROR, pool.wait(quickId));
+    ASSERT_TRUE(pool.isPending(blockedId));
+
+    gate = true;
+    ASSERT_EQ(NO_ERROR, pool.wait(blockedId));
+    pool.exit();
+}
+
+static void *exit_pool(void *data)
+{
+    ((QCameraDeferredWork *)data)->exit();
+    return NULL;
+}
+
+// Test that exit lets the running job finish and cancels pending ones.
+TEST(cam_deferred_work_tests, exit_cancels_pending) {
+    volatile bool gate = false;
+    QCameraDeferredWork pool;
+    stub_backend backend;
+    launch(pool, backend, 1);
+
+    stub_work running = {0, 0, NO_ERROR, &gate};
+    stub_work pending = {1, 0, NO_ERROR, NULL};
+    uint32_t runningId = pool.queue("running", &running, NULL, 0);
+    uint32_t pendingId = pool.queue("pending", &pending, &runningId, 1);
+    for (bool started = false; !started; usleep(1000)) {
+        pthread_mutex_lock(&backend.lock);
+        started = (backend.running > 0);
+        pthread_mutex_unlock(&backend.lock);
+    }
+
+    pthread_t exitThread;
+    ASSERT_EQ(0, pthread_create(&exitThread, NULL, exit_pool, &pool));
+    usleep(20000);
+    gate = true;
+    pthread_join(exitThread, NULL);
+
+    ASSERT_EQ(1u, backend.order.size());
+    ASSERT_EQ(1u, backend.cancelled.size());
+    ASSERT_EQ(1u, backend.cancelled[0]);
+    ASSERT_EQ(DEAD_OBJECT, pool.wait(pendingId));
+    ASSERT_EQ(0u, pool.queue("late", &pending, NULL, 0));
+}
+
+// Test the per-job timing reported to the backend and kept in the history.
+TEST(cam_deferred_work_tests, timing) {
+    QCameraDeferredWork pool;
+    stub_backend backend;
+    launch(pool, backend, 2);
+
+    stub_work first = {0, 10000, NO_ERROR, NULL};
+    stub_work second = {1, 10000, BAD_VALUE, NULL};
+    uint32_t firstId = pool.queue("first", &first, NULL, 0);
+    uint32_t secondId = pool.queue("second", &second, &firstId, 1);
+    pool.wait(secondId);
+    pool.exit();
+
+    deferred_work_timing_t history[DEFERRED_WORK_HISTORY];
+    uint32_t count = pool.getHistory(history, DEFERRED_WORK_HISTORY);
+    ASSERT_EQ(2u, count);
+    ASSERT_EQ(2u, backend.timings.size());
+    ASSERT_EQ(firstId, history[0].id);
+    ASSERT_STREQ("second", history[1].name);
+    ASSERT_EQ(BAD_VALUE, history[1].status);
+    for (uint32_t i = 0; i < count; i++) {
+        printf("%s: wait %.1f ms, run %.1f ms\n", history[i].name,
+                (history[i].startNs - history[i].queuedNs) / 1e6,
+                (history[i].endNs - history[i].startNs) / 1e6);
+        ASSERT_GE(history[i].startNs, history[i].queuedNs);
+        ASSERT_GE(history[i].endNs - history[i].startNs, 10000000LL);
+    }
+    // The dependent job starts only after the first one ended
+    ASSERT_GE(history[1].startNs, history[0].endNs);
+}
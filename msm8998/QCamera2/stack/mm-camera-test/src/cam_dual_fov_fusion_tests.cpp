@@ -0,0 +1,203 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_dual_fov_fusion_tests"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+
+#include "QCameraDualFOVFusion.h"
+
+using namespace android;
+using namespace qcamera;
+
+// Synthetic semi-planar frame with padded stride and scanline.
+struct yuv_frame {
+    fusion_frame_t layout;
+    std::vector<uint8_t> data;
+
+    yuv_frame(uint32_t w, uint32_t h) {
+        layout.width = w;
+        layout.height = h;
+        layout.stride = (w + 63) & ~63U;
+        layout.scanline = (h + 31) & ~31U;
+        data.resize((size_t)layout.stride * layout.scanline * 3 / 2);
+    }
+
+    uint8_t *luma(uint32_t x, uint32_t y) {
+        return &data[(size_t)y * layout.stride + x];
+    }
+
+    uint8_t *chroma(uint32_t x, uint32_t y) {
+        return &data[(size_t)layout.stride * layout.scanline +
+                (size_t)y * layout.stride + 2 * x];
+    }
+
+    void pattern(uint32_t seed) {
+        for (uint32_t y = 0; y < layout.height; y++) {
+            for (uint32_t x = 0; x < layout.width; x++) {
+                *luma(x, y) = (uint8_t)((x * 7 + y * 13 + seed) & 0xFF);
+            }
+        }
+        for (uint32_t y = 0; y < layout.height / 2; y++) {
+            for (uint32_t x = 0; x < layout.width / 2; x++) {
+                chroma(x, y)[0] = (uint8_t)((x * 3 + y + seed) & 0xFF);
+                chroma(x, y)[1] = (uint8_t)((x + y * 5 + seed) & 0xFF);
+            }
+        }
+    }
+
+    void fill(uint8_t value) {
+        memset(data.data(), value, data.size());
+    }
+
+    // Compare the visible pixels of both planes.
+    bool sameAs(yuv_frame &other) {
+        for (uint32_t y = 0; y < layout.height; y++) {
+            if (memcmp(luma(0, y), other.luma(0, y), layout.width) != 0) {
+                return false;
+            }
+        }
+        for (uint32_t y = 0; y < layout.height / 2; y++) {
+            if (memcmp(chroma(0, y), other.chroma(0, y), layout.width) != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+static fusion_params_t make_params(uint32_t feather, uint32_t weight)
+{
+    fusion_params_t params;
+    params.fovRatio = 0.5f;
+    params.shiftX = 6;
+    params.shiftY = -4;
+    params.featherPx = feather;
+    params.teleWeight = weight;
+    return params;
+}
+
+// Test that a zero tele weight reproduces the wide frame.
+TEST(cam_dual_fov_fusion_tests, zero_weight_copies_wide) {
+    yuv_frame wide(640, 480), tele(640, 480), out(640, 480);
+    wide.pattern(1);
+    tele.pattern(77);
+    out.fill(0);
+
+    QCameraDualFOVFusion fusion(4);
+    ASSERT_EQ(NO_ERROR, fusion.process(wide.data.data(), wide.layout,
+            tele.data.data(), tele.layout, make_params(16, 0),
+            out.data.data()));
+    ASSERT_TRUE(out.sameAs(wide));
+}
+
+// Test that a full tele weight without feathering puts the tele frame in the
+// shifted center region and leaves the rest of the wide frame alone.
+TEST(cam_dual_fov_fusion_tests, region_placement) {
+    yuv_frame wide(640, 480), tele(320, 240), out(640, 480);
+    wide.pattern(1);
+    tele.fill(200);
+    out.fill(0);
+
+    QCameraDualFOVFusion fusion(4);
+    ASSERT_EQ(NO_ERROR, fusion.process(wide.data.data(), wide.layout,
+            tele.data.data(), tele.layout, make_params(0, 256),
+            out.data.data()));
+
+    // Region is 320x240 at (160 + 6, 120 - 4).
+    for (uint32_t y = 0; y < 480; y++) {
+        for (uint32_t x = 0; x < 640; x++) {
+            bool inside = (x >= 166) && (x < 486) && (y >= 116) && (y < 356);
+            uint8_t expected = inside ? 200 : *wide.luma(x, y);
+            ASSERT_EQ(expected, *out.luma(x, y)) << x << "," << y;
+        }
+    }
+    for (uint32_t y = 0; y < 240; y++) {
+        for (uint32_t x = 0; x < 320; x++) {
+            bool inside = (x >= 83) && (x < 243) && (y >= 58) && (y < 178);
+            ASSERT_EQ(inside ? 200 : wide.chroma(x, y)[0], out.chroma(x, y)[0]);
+            ASSERT_EQ(inside ? 200 : wide.chroma(x, y)[1], out.chroma(x, y)[1]);
+        }
+    }
+}
+
+// Test that the output does not depend on the thread count and that in
+// place output matches a separate output buffer.
+TEST(cam_dual_fov_fusion_tests, threads_and_in_place) {
+    yuv_frame wide(1000, 750), tele(1000, 750);
+    yuv_frame single(1000, 750), parallel(1000, 750);
+    wide.pattern(3);
+    tele.pattern(91);
+    fusion_params_t params = make_params(24, 192);
+
+    QCameraDualFOVFusion one(1);
+    QCameraDualFOVFusion many(FUSION_MAX_THREADS);
+    for (int i = 0; i < 3; i++) {
+        single.fill(0);
+        parallel.fill(0);
+        ASSERT_EQ(NO_ERROR, one.process(wide.data.data(), wide.layout,
+                tele.data.data(), tele.layout, params, single.data.data()));
+        ASSERT_EQ(NO_ERROR, many.process(wide.data.data(), wide.layout,
+                tele.data.data(), tele.layout, params, parallel.data.data()));
+        ASSERT_TRUE(single.sameAs(parallel));
+    }
+
+    ASSERT_EQ(NO_ERROR, many.process(wide.data.data(), wide.layout,
+            tele.data.data(), tele.layout, params, wide.data.data()));
+    ASSERT_TRUE(wide.sameAs(single));
+}
+
+// Test that invalid frames and parameters are rejected.
+TEST(cam_dual_fov_fusion_tests, bad_input) {
+    yuv_frame wide(64, 64), tele(64, 64);
+    QCameraDualFOVFusion fusion(2);
+    fusion_params_t params = make_params(4, 256);
+
+    ASSERT_EQ(BAD_VALUE, fusion.process(NULL, wide.layout,
+            tele.data.data(), tele.layout, params, wide.data.data()));
+    params.fovRatio = 1.5f;
+    ASSERT_EQ(BAD_VALUE, fusion.process(wide.data.data(), wide.layout,
+            tele.data.data(), tele.layout, params, wide.data.data()));
+    params = make_params(4, 300);
+    ASSERT_EQ(BAD_VALUE, fusion.process(wide.data.data(), wide.layout,
+            tele.data.data(), tele.layout, params, wide.data.data()));
+}
+
+// Report the per tile and per frame cost on a 12MP pair.
+TEST(cam_dual_fov_fusion_tests, frame_cost) {
+    yuv_frame wide(4000, 3000), tele(4000, 3000), out(4000, 3000);
+    wide.pattern(5);
+    tele.pattern(9);
+    fusion_params_t params = make_params(32, 224);
+
+    uint32_t counts[] = {1, 2, 4, FUSION_MAX_THREADS};
+    for (uint32_t n : counts) {
+        QCameraDualFOVFusion fusion(n);
+        ASSERT_EQ(NO_ERROR, fusion.process(wide.data.data(), wide.layout,
+                tele.data.data(), tele.layout, params, out.data.data()));
+        fusion_stats_t stats;
+        fusion.getStats(stats);
+        printf("%u threads: frame %.2f ms, %u tiles, tile avg %.1f us, "
+                "max %.1f us\n", stats.threads, stats.frameNs / 1e6,
+                stats.tiles, stats.tileAvgNs / 1e3, stats.tileMaxNs / 1e3);
+    }
+}
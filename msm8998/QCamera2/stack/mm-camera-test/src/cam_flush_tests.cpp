@@ -0,0 +1,372 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_flush_tests"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+
+#include "QCamera3Flush.h"
+
+using namespace android;
+using namespace qcamera;
+
+#define SENSOR_FPS      30
+#define FRAME_NS        (s2ns(1) / SENSOR_FPS)
+#define CALLBACK_NS     us2ns(200)
+#define INFLIGHT_BUFS   4
+
+// Fake sensor behind one stream. It fills the buffers queued to it in order,
+// one per frame interval, and hands a recalled buffer back right away as an
+// error frame. The callback thread stands in for the stream thread and runs
+// the ledger hooks around a short channel callback.
+struct fake_sensor {
+    QCamera3InflightBufs ledger;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<uint32_t> queued;                    // owned by the sensor
+    std::deque<std::pair<uint32_t, bool> > done;    // index, error
+    bool exiting;
+    nsecs_t firstGoodNs;                            // first good frame after arm()
+    bool armed;
+    std::thread sensorTh;
+    std::thread cbTh;
+
+    fake_sensor() : exiting(false), firstGoodNs(0), armed(false) {
+        sensorTh = std::thread(&fake_sensor::sensorLoop, this);
+        cbTh = std::thread(&fake_sensor::callbackLoop, this);
+    }
+
+    ~fake_sensor() {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            exiting = true;
+        }
+        cond.notify_all();
+        sensorTh.join();
+        cbTh.join();
+    }
+
+    void qbuf(uint32_t index) {
+        ledger.onQueued(index);
+        std::lock_guard<std::mutex> l(lock);
+        queued.push_back(index);
+    }
+
+    // Backend side of cancel_buffer.
+    void cancel(uint32_t index) {
+        {
+            std::lock_guard<std::mutex> l(lock);
+            for (auto it = queued.begin(); it != queued.end(); it++) {
+                if (*it == index) {
+                    queued.erase(it);
+                    done.push_back(std::make_pair(index, true));
+                    break;
+                }
+            }
+        }
+        cond.notify_all();
+    }
+
+    // Recall everything the ledger says is queued, as the fast flush does.
+    uint32_t cancelInflight() {
+        uint64_t mask = ledger.getQueuedMask();
+        uint32_t cancelled = 0;
+        for (uint32_t i = 0; i < FLUSH_MAX_STREAM_BUFS; i++) {
+            if (mask & (1ULL << i)) {
+                cancel(i);
+                cancelled++;
+            }
+        }
+        return cancelled;
+    }
+
+    void arm() {
+        std::lock_guard<std::mutex> l(lock);
+        armed = true;
+        firstGoodNs = 0;
+    }
+
+    nsecs_t waitFirstGood(nsecs_t timeout) {
+        std::unique_lock<std::mutex> l(lock);
+        cond.wait_for(l, std::chrono::nanoseconds(timeout),
+                [this] { return firstGoodNs != 0; });
+        return firstGoodNs;
+    }
+
+    void sensorLoop() {
+        std::unique_lock<std::mutex> l(lock);
+        while (!exiting) {
+            cond.wait_for(l, std::chrono::nanoseconds(FRAME_NS));
+            if (!exiting && !queued.empty()) {
+                done.push_back(std::make_pair(queued.front(), false));
+                queued.pop_front();
+                cond.notify_all();
+            }
+        }
+    }
+
+    void callbackLoop() {
+        std::unique_lock<std::mutex> l(lock);
+        while (true) {
+            cond.wait(l, [this] { return exiting || !done.empty(); });
+            if (exiting) {
+                break;
+            }
+            std::pair<uint32_t, bool> frame = done.front();
+            done.pop_front();
+            l.unlock();
+
+            ledger.onReturned(frame.first);
+            std::this_thread::sleep_for(std::chrono::nanoseconds(CALLBACK_NS));
+            nsecs_t now = systemTime();
+            ledger.onCallbackDone();
+
+            l.lock();
+            if (armed && !frame.second && (firstGoodNs == 0)) {
+                firstGoodNs = now;
+                armed = false;
+                cond.notify_all();
+            }
+        }
+    }
+};
+
+TEST(cam_flush, ledger_counts) {
+    QCamera3InflightBufs ledger;
+
+    ledger.onQueued(0);
+    ledger.onQueued(3);
+    ledger.onQueued(FLUSH_MAX_STREAM_BUFS);
+    EXPECT_EQ(0x9u, ledger.getQueuedMask());
+    EXPECT_EQ(2u, ledger.getCount());
+
+    // Out of the backend but still in the callback.
+    ledger.onReturned(0);
+    EXPECT_EQ(0x8u, ledger.getQueuedMask());
+    EXPECT_EQ(2u, ledger.getCount());
+    ledger.onCallbackDone();
+    EXPECT_EQ(1u, ledger.getCount());
+
+    ledger.onDropped(3);
+    EXPECT_EQ(0u, ledger.getCount());
+    EXPECT_EQ(NO_ERROR, ledger.waitDrained(systemTime()));
+}
+
+TEST(cam_flush, wait_times_out) {
+    QCamera3InflightBufs ledger;
+
+    ledger.onQueued(5);
+    nsecs_t start = systemTime();
+    EXPECT_EQ(TIMED_OUT, ledger.waitDrained(start + ms2ns(20)));
+    EXPECT_GE(systemTime() - start, ms2ns(20));
+
+    ledger.reset();
+    EXPECT_EQ(0u, ledger.getCount());
+    EXPECT_EQ(NO_ERROR, ledger.waitDrained(systemTime()));
+}
+
+TEST(cam_flush, wait_wakes_on_drain) {
+    QCamera3InflightBufs ledger;
+
+    ledger.onQueued(1);
+    ledger.onReturned(1);
+    std::thread cb([&ledger] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        ledger.onCallbackDone();
+    });
+    nsecs_t start = systemTime();
+    EXPECT_EQ(NO_ERROR, ledger.waitDrained(start + s2ns(1)));
+    EXPECT_LT(systemTime() - start, ms2ns(500));
+    cb.join();
+}
+
+TEST(cam_flush, stats) {
+    QCamera3FlushStats stats;
+    flush_stats_t s;
+
+    // A fast flush falling back is timed from its own start.
+    stats.onFlushStart(ms2ns(100));
+    stats.onFlushStart(ms2ns(150));
+    EXPECT_TRUE(stats.inFlush());
+    stats.onFallback();
+    stats.onFlushDone(FLUSH_PATH_FULL, 0, ms2ns(400));
+    EXPECT_FALSE(stats.inFlush());
+    EXPECT_TRUE(stats.awaitingFrame());
+    stats.onFrame(ms2ns(500));
+    stats.onFrame(ms2ns(600));
+    EXPECT_FALSE(stats.awaitingFrame());
+
+    stats.onFlushStart(ms2ns(1000));
+    stats.onFlushDone(FLUSH_PATH_FAST, 3, ms2ns(1002));
+    stats.onFrame(ms2ns(1030));
+
+    stats.getStats(s);
+    EXPECT_EQ(1u, s.count[FLUSH_PATH_FULL]);
+    EXPECT_EQ(1u, s.count[FLUSH_PATH_FAST]);
+    EXPECT_EQ(1u, s.fallbacks);
+    EXPECT_EQ(3u, s.recalled);
+    EXPECT_EQ(ms2ns(300), s.lastNs[FLUSH_PATH_FULL]);
+    EXPECT_EQ(ms2ns(2), s.lastNs[FLUSH_PATH_FAST]);
+    EXPECT_EQ(1u, s.frames[FLUSH_PATH_FULL]);
+    EXPECT_EQ(ms2ns(400), s.lastFrameNs[FLUSH_PATH_FULL]);
+    EXPECT_EQ(ms2ns(30), s.lastFrameNs[FLUSH_PATH_FAST]);
+
+    // Without a flush there is nothing to time.
+    stats.onFrame(ms2ns(2000));
+    stats.onFlushDone(FLUSH_PATH_FAST, 1, ms2ns(2000));
+    stats.getStats(s);
+    EXPECT_EQ(1u, s.frames[FLUSH_PATH_FAST]);
+    EXPECT_EQ(1u, s.count[FLUSH_PATH_FAST]);
+}
+
+// Flush to first new frame against the fake sensor: recalling the queued
+// buffers against waiting for the sensor to fill all of them, which is what
+// a flush without cancel has to do.
+TEST(cam_flush, flush_to_first_frame) {
+    nsecs_t drainNs[2], firstNs[2];
+
+    for (int recall = 0; recall < 2; recall++) {
+        fake_sensor sensor;
+        for (uint32_t i = 0; i < INFLIGHT_BUFS; i++) {
+            sensor.qbuf(i);
+        }
+
+        nsecs_t start = systemTime();
+        uint32_t cancelled = recall ? sensor.cancelInflight() : 0;
+        ASSERT_EQ(NO_ERROR, sensor.ledger.waitDrained(start + s2ns(2)));
+        drainNs[recall] = systemTime() - start;
+        if (recall) {
+            EXPECT_EQ((uint32_t)INFLIGHT_BUFS, cancelled);
+        }
+
+        // First request after the flush.
+        sensor.arm();
+        sensor.qbuf(INFLIGHT_BUFS);
+        nsecs_t firstGood = sensor.waitFirstGood(s2ns(1));
+        ASSERT_NE(0, firstGood);
+        firstNs[recall] = firstGood - start;
+    }
+
+    printf("flush with %d buffers in flight at %d fps:\n", INFLIGHT_BUFS, SENSOR_FPS);
+    printf("  wait for sensor: drain %lld us, first frame %lld us\n",
+            (long long)ns2us(drainNs[0]), (long long)ns2us(firstNs[0]));
+    printf("  recall buffers:  drain %lld us, first frame %lld us\n",
+            (long long)ns2us(drainNs[1]), (long long)ns2us(firstNs[1]));
+
+    EXPECT_GE(drainNs[0], (INFLIGHT_BUFS - 1) * FRAME_NS);
+    EXPECT_LT(drainNs[1], FRAME_NS);
+    EXPECT_LT(firstNs[1], firstNs[0]);
+}
+
+typedef enum {
+    FAST_FLUSH_OK,
+    FAST_FLUSH_RECALL_TIMEOUT,  // a buffer never comes back
+    FAST_FLUSH_POSTPROC_BUSY,   // a reprocess job is still running
+} fast_flush_outcome_t;
+
+// flushPerf() around the hold as the HAL runs it. halLock stands in for
+// mMutex, which the flush drops while it waits for the recalled buffers.
+struct fake_flush_hal {
+    pthread_mutex_t halLock;
+    QCamera3FlushHold hold;
+    QCamera3InflightBufs ledger;
+    std::atomic<bool> parked;
+    std::atomic<bool> served;
+    uint32_t fullFlushes;
+
+    fake_flush_hal() : parked(false), served(false), fullFlushes(0) {
+        pthread_mutex_init(&halLock, NULL);
+    }
+    ~fake_flush_hal() { pthread_mutex_destroy(&halLock); }
+
+    void request() {
+        pthread_mutex_lock(&halLock);
+        if (hold.isHeld()) {
+            parked = true;
+            hold.waitWhileHeld(&halLock);
+        }
+        served = true;
+        pthread_mutex_unlock(&halLock);
+    }
+
+    void fullFlush() {
+        pthread_mutex_lock(&halLock);
+        fullFlushes++;
+        ledger.reset();
+        pthread_mutex_unlock(&halLock);
+    }
+
+    void fastFlush(fast_flush_outcome_t outcome) {
+        pthread_mutex_lock(&halLock);
+        hold.hold();
+        ledger.onQueued(0);
+        if (outcome != FAST_FLUSH_RECALL_TIMEOUT) {
+            ledger.onDropped(0);
+        }
+        pthread_mutex_unlock(&halLock);
+
+        // A request comes in while the buffers are being recalled.
+        std::thread req(&fake_flush_hal::request, this);
+        while (!parked) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        int32_t rc = ledger.waitDrained(systemTime() + ms2ns(10));
+
+        pthread_mutex_lock(&halLock);
+        if ((rc != NO_ERROR) || (outcome == FAST_FLUSH_POSTPROC_BUSY)) {
+            hold.release();
+            pthread_mutex_unlock(&halLock);
+            fullFlush();
+        } else {
+            hold.release();
+            pthread_mutex_unlock(&halLock);
+        }
+        req.join();
+    }
+};
+
+// Test that a request parked by a fast flush goes on however the flush ends,
+// including the fallbacks to a full flush.
+TEST(cam_flush, hold_released_on_fallback) {
+    const fast_flush_outcome_t outcomes[] = {
+        FAST_FLUSH_OK, FAST_FLUSH_RECALL_TIMEOUT, FAST_FLUSH_POSTPROC_BUSY
+    };
+    for (fast_flush_outcome_t outcome : outcomes) {
+        fake_flush_hal hal;
+        std::thread flush(&fake_flush_hal::fastFlush, &hal, outcome);
+        nsecs_t deadline = systemTime() + s2ns(2);
+        while (!hal.served && (systemTime() < deadline)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        ASSERT_TRUE(hal.served.load()) << "request stuck, outcome " << outcome;
+        flush.join();
+        EXPECT_TRUE(hal.parked.load());
+        EXPECT_FALSE(hal.hold.isHeld());
+        EXPECT_EQ((outcome == FAST_FLUSH_OK) ? 0u : 1u, hal.fullFlushes);
+    }
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_fov_lut_tests"
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <gtest/gtest.h>
+
+#include "QCameraFOVControlLut.h"
+
+using namespace qcamera;
+
+#define ZOOM_TABLE_MAX 91
+
+// The per call arithmetic of QCameraFOVControl the tables replace.
+struct fov_reference {
+    const uint32_t *table;
+    uint32_t count;
+    float cutOverFactor;
+    float cropRatio;
+
+    uint32_t findZoomValue(uint32_t zoomRatio) const {
+        uint32_t zoom = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (zoomRatio <= table[i]) {
+                zoom = i;
+                break;
+            }
+        }
+        return zoom;
+    }
+
+    uint32_t readjustZoomForTele(uint32_t zoomWide) const {
+        uint32_t zoomRatioWide = table[zoomWide];
+        uint32_t zoomRatioTele = zoomRatioWide / cutOverFactor;
+        return findZoomValue(zoomRatioTele);
+    }
+
+    uint32_t readjustZoomForWide(uint32_t zoomTele) const {
+        uint32_t zoomRatioTele = table[zoomTele];
+        uint32_t zoomRatioWide = zoomRatioTele * cutOverFactor;
+        return findZoomValue(zoomRatioWide);
+    }
+
+    float userZoom(uint32_t zoomWide) const {
+        return table[zoomWide] / (float)table[0];
+    }
+
+    float fovRatioTele(uint32_t zoomWide, uint32_t zoomTele) const {
+        float zw = table[zoomWide];
+        float zt = table[zoomTele];
+        return (zt / zw) * cropRatio;
+    }
+
+    int32_t shiftTele(uint32_t zoomWide, int32_t shift) const {
+        float zoom = table[zoomWide] / (float)table[0];
+        return (cropRatio / zoom) * shift;
+    }
+};
+
+// Zoom ratio table in the capability format: ratio x 100, 1x to maxZoom.
+static uint32_t make_table(uint32_t *table, uint32_t count, float maxZoom,
+        bool geometric) {
+    for (uint32_t i = 0; i < count; i++) {
+        float t = (float)i / (count - 1);
+        table[i] = geometric ? (uint32_t)(100 * powf(maxZoom, t)) :
+                (uint32_t)(100 + t * (maxZoom - 1) * 100);
+    }
+    return count;
+}
+
+static void compare(const uint32_t *table, uint32_t count, float cutOverFactor,
+        float cropRatio) {
+    fov_reference ref = {table, count, cutOverFactor, cropRatio};
+    QCameraFOVControlLut lut;
+    lut.build(table, count, cutOverFactor, cropRatio);
+
+    for (uint32_t z = 0; z < count; z++) {
+        ASSERT_TRUE(lut.isValid(z));
+        const fov_zoom_lut_entry_t &e = lut.at(z);
+        ASSERT_EQ(ref.readjustZoomForTele(z), e.zoomTele) << "zoom " << z;
+        ASSERT_EQ(ref.readjustZoomForWide(z), e.zoomWide) << "zoom " << z;
+        ASSERT_EQ(ref.userZoom(z), e.userZoom) << "zoom " << z;
+        ASSERT_EQ(ref.fovRatioTele(z, e.zoomTele), e.fovRatioTele) << "zoom " << z;
+        for (int32_t shift = -64; shift <= 64; shift += 7) {
+            ASSERT_EQ(ref.shiftTele(z, shift), (int32_t)(e.shiftScaleTele * shift))
+                    << "zoom " << z << " shift " << shift;
+        }
+    }
+    ASSERT_FALSE(lut.isValid(count));
+}
+
+// Test that every table entry matches the per call arithmetic exactly.
+TEST(cam_fov_lut_tests, matches_arithmetic) {
+    uint32_t table[ZOOM_TABLE_MAX];
+    const float factors[] = {1.6f, 1.95f, 2.0f, 2.37f};
+    const float crops[] = {0.5f, 0.83f, 1.0f};
+
+    for (int geometric = 0; geometric < 2; geometric++) {
+        for (uint32_t count = 2; count <= ZOOM_TABLE_MAX; count += 11) {
+            make_table(table, count, 8.0f, geometric);
+            for (float f : factors) {
+                for (float c : crops) {
+                    compare(table, count, f, c);
+                }
+            }
+        }
+    }
+}
+
+// Test that a table with no usable ratios builds nothing.
+TEST(cam_fov_lut_tests, invalid_table) {
+    uint32_t table[4] = {0, 100, 200, 300};
+    QCameraFOVControlLut lut;
+    lut.build(table, 4, 2.0f, 0.5f);
+    ASSERT_FALSE(lut.isValid(0));
+    lut.build(NULL, 4, 2.0f, 0.5f);
+    ASSERT_FALSE(lut.isValid(0));
+}
+
+// Report the per lookup cost against the arithmetic.
+TEST(cam_fov_lut_tests, lookup_cost) {
+    uint32_t table[ZOOM_TABLE_MAX];
+    make_table(table, ZOOM_TABLE_MAX, 8.0f, true);
+    fov_reference ref = {table, ZOOM_TABLE_MAX, 2.0f, 0.5f};
+    QCameraFOVControlLut lut;
+    lut.build(table, ZOOM_TABLE_MAX, 2.0f, 0.5f);
+
+    const int iterations = 200;
+    volatile uint32_t sink = 0;
+    struct timespec t0, t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < iterations; i++) {
+        for (uint32_t z = 0; z < ZOOM_TABLE_MAX; z++) {
+            sink = sink + ref.readjustZoomForTele(z);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (int i = 0; i < iterations; i++) {
+        for (uint32_t z = 0; z < ZOOM_TABLE_MAX; z++) {
+            sink = sink + lut.at(z).zoomTele;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    double n = (double)iterations * ZOOM_TABLE_MAX;
+    printf("tele zoom: arithmetic %.1f ns, table %.1f ns per lookup\n",
+            ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / n,
+            ((t2.tv_sec - t1.tv_sec) * 1e9 + (t2.tv_nsec - t1.tv_nsec)) / n);
+}
@@ -0,0 +1,276 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_halpp_graph_tests"
+
+#include <pthread.h>
+#include <unistd.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+
+#include "QCameraHALPPGraph.h"
+
+using namespace android;
+using namespace qcamera;
+
+// Stub job recording the stages it went through.
+struct stub_job {
+    uint32_t id;
+    std::vector<uint32_t> trace;
+};
+
+// Stub stage: records itself, sleeps, and optionally fails odd jobs or
+// waits on a gate.
+struct stub_stage {
+    uint32_t id;
+    useconds_t sleepUs;
+    bool failOdd;
+    volatile bool *pGate;
+};
+
+// Collects the jobs released by the graph.
+struct job_sink {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    std::vector<stub_job *> done;
+    std::vector<stub_job *> dropped;
+
+    job_sink() {
+        pthread_mutex_init(&lock, NULL);
+        pthread_cond_init(&cond, NULL);
+    }
+
+    ~job_sink() {
+        for (size_t i = 0; i < done.size(); i++) {
+            delete done[i];
+        }
+        for (size_t i = 0; i < dropped.size(); i++) {
+            delete dropped[i];
+        }
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&lock);
+    }
+
+    void waitFor(size_t count) {
+        pthread_mutex_lock(&lock);
+        while (done.size() + dropped.size() < count) {
+            pthread_cond_wait(&cond, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+    }
+};
+
+static int32_t stub_stage_func(void *pJob, void *pUserData)
+{
+    stub_job *job = (stub_job *)pJob;
+    stub_stage *stage = (stub_stage *)pUserData;
+    while ((stage->pGate != NULL) && !*stage->pGate) {
+        usleep(1000);
+    }
+    if (stage->sleepUs > 0) {
+        usleep(stage->sleepUs);
+    }
+    job->trace.push_back(stage->id);
+    return (stage->failOdd && (job->id & 1)) ? UNKNOWN_ERROR : NO_ERROR;
+}
+
+static void stub_release(void *pJob, bool done, void *pUserData)
+{
+    job_sink *sink = (job_sink *)pUserData;
+    pthread_mutex_lock(&sink->lock);
+    if (done) {
+        sink->done.push_back((stub_job *)pJob);
+    } else {
+        sink->dropped.push_back((stub_job *)pJob);
+    }
+    pthread_cond_broadcast(&sink->cond);
+    pthread_mutex_unlock(&sink->lock);
+}
+
+static nsecs_t now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (nsecs_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// Build a chain of 'count' stages.
+static void make_chain(QCameraHALPPGraph &graph, job_sink &sink,
+        stub_stage *stages, uint32_t count, uint32_t depth)
+{
+    ASSERT_EQ(NO_ERROR, graph.init(stub_release, &sink));
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t id;
+        stages[i].id = i;
+        ASSERT_EQ(NO_ERROR, graph.addStage("stub", stub_stage_func,
+                &stages[i], depth, &id));
+        ASSERT_EQ(i, id);
+        if (i > 0) {
+            ASSERT_EQ(NO_ERROR, graph.link(i - 1, i));
+        }
+    }
+}
+
+// Test that jobs go through every stage of a chain, in submit order.
+TEST(cam_halpp_graph_tests, chain_order) {
+    QCameraHALPPGraph graph;
+    job_sink sink;
+    stub_stage stages[3] = {{0, 0, false, NULL}, {0, 500, false, NULL},
+            {0, 0, false, NULL}};
+    make_chain(graph, sink, stages, 3, 2);
+    ASSERT_EQ(NO_ERROR, graph.start());
+
+    for (uint32_t i = 0; i < 20; i++) {
+        stub_job *job = new stub_job;
+        job->id = i;
+        ASSERT_EQ(NO_ERROR, graph.submit(0, job, true));
+    }
+    sink.waitFor(20);
+
+    ASSERT_EQ(20u, sink.done.size());
+    for (uint32_t i = 0; i < 20; i++) {
+        ASSERT_EQ(i, sink.done[i]->id);
+        ASSERT_EQ(3u, sink.done[i]->trace.size());
+        for (uint32_t s = 0; s < 3; s++) {
+            ASSERT_EQ(s, sink.done[i]->trace[s]);
+        }
+    }
+    graph.stop();
+}
+
+// Test that a burst through three equal stages takes about a third of the
+// serial time, and report the stage counters.
+TEST(cam_halpp_graph_tests, burst_pipelining) {
+    const uint32_t jobs = 12;
+    const useconds_t stageUs = 10000;
+    QCameraHALPPGraph graph;
+    job_sink sink;
+    stub_stage stages[3] = {{0, stageUs, false, NULL},
+            {0, stageUs, false, NULL}, {0, stageUs, false, NULL}};
+    make_chain(graph, sink, stages, 3, 2);
+    ASSERT_EQ(NO_ERROR, graph.start());
+
+    nsecs_t start = now_ns();
+    for (uint32_t i = 0; i < jobs; i++) {
+        stub_job *job = new stub_job;
+        job->id = i;
+        ASSERT_EQ(NO_ERROR, graph.submit(0, job, true));
+    }
+    sink.waitFor(jobs);
+    nsecs_t elapsed = now_ns() - start;
+    nsecs_t serial = (nsecs_t)jobs * 3 * stageUs * 1000;
+
+    printf("burst of %u: %.1f ms, serial %.1f ms\n", jobs, elapsed / 1e6,
+            serial / 1e6);
+    for (uint32_t i = 0; i < graph.getNumStages(); i++) {
+        hal_pp_stage_stats_t stats;
+        graph.getStageStats(i, stats);
+        printf("stage %u: %llu jobs, busy %.1f ms, blocked %.1f ms, "
+                "max depth %u\n", i, (unsigned long long)stats.jobs,
+                stats.busyNs / 1e6, stats.blockedNs / 1e6, stats.maxDepth);
+        ASSERT_EQ(jobs, stats.jobs);
+        ASSERT_LE(stats.maxDepth, 2u);
+    }
+    ASSERT_LT(elapsed, serial * 2 / 3);
+    graph.stop();
+}
+
+// Test that a full first stage holds back a submitter that does not wait.
+TEST(cam_halpp_graph_tests, backpressure) {
+    volatile bool gate = false;
+    QCameraHALPPGraph graph;
+    job_sink sink;
+    stub_stage stages[2] = {{0, 0, false, &gate}, {0, 0, false, NULL}};
+    make_chain(graph, sink, stages, 2, 2);
+    ASSERT_EQ(NO_ERROR, graph.start());
+
+    uint32_t accepted = 0;
+    int32_t rc = NO_ERROR;
+    while (accepted < 10) {
+        stub_job *job = new stub_job;
+        job->id = accepted;
+        rc = graph.submit(0, job, false);
+        if (rc != NO_ERROR) {
+            delete job;
+            break;
+        }
+        accepted++;
+        usleep(2000);
+    }
+    ASSERT_EQ(WOULD_BLOCK, rc);
+    // Queue depth plus the job held by the gated stage
+    ASSERT_EQ(3u, accepted);
+
+    gate = true;
+    sink.waitFor(accepted);
+    ASSERT_EQ(accepted, (uint32_t)sink.done.size());
+    graph.stop();
+}
+
+// Test that failed and flushed jobs are released as dropped.
+TEST(cam_halpp_graph_tests, drop_and_flush) {
+    volatile bool gate = false;
+    QCameraHALPPGraph graph;
+    job_sink sink;
+    stub_stage stages[2] = {{0, 0, true, NULL}, {0, 0, false, &gate}};
+    make_chain(graph, sink, stages, 2, 8);
+    ASSERT_EQ(NO_ERROR, graph.start());
+
+    // Even jobs reach the gated stage, odd ones fail in the first stage.
+    for (uint32_t i = 0; i < 8; i++) {
+        stub_job *job = new stub_job;
+        job->id = i;
+        ASSERT_EQ(NO_ERROR, graph.submit(0, job, true));
+    }
+    sink.waitFor(4);
+    ASSERT_EQ(4u, sink.dropped.size());
+
+    // Let the job held by the gate complete while the flush waits for it.
+    gate = true;
+    graph.flush();
+    sink.waitFor(8);
+    ASSERT_GE(sink.done.size(), 1u);
+    ASSERT_EQ(8u, sink.done.size() + sink.dropped.size());
+    for (size_t i = 0; i < sink.done.size(); i++) {
+        ASSERT_EQ(0u, sink.done[i]->id & 1);
+    }
+    graph.stop();
+}
+
+// Test that links closing a loop and changes while running are refused.
+TEST(cam_halpp_graph_tests, link_rules) {
+    QCameraHALPPGraph graph;
+    job_sink sink;
+    stub_stage stages[3] = {{0, 0, false, NULL}, {0, 0, false, NULL},
+            {0, 0, false, NULL}};
+    make_chain(graph, sink, stages, 3, 1);
+
+    ASSERT_EQ(BAD_VALUE, graph.link(2, 0));
+    ASSERT_EQ(BAD_VALUE, graph.link(1, 1));
+    ASSERT_EQ(BAD_VALUE, graph.link(0, 3));
+    stub_job idle;
+    ASSERT_EQ(NO_INIT, graph.submit(0, &idle, true));
+
+    ASSERT_EQ(NO_ERROR, graph.start());
+    uint32_t id;
+    ASSERT_EQ(INVALID_OPERATION, graph.addStage("late", stub_stage_func,
+            &stages[0], 1, &id));
+    ASSERT_EQ(INVALID_OPERATION, graph.link(0, 2));
+    graph.stop();
+}
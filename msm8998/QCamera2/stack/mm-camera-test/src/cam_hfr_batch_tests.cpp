@@ -0,0 +1,163 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_hfr_batch_tests"
+
+#include <stdio.h>
+
+#include <gtest/gtest.h>
+
+#include "QCamera3HFRBatch.h"
+
+using namespace qcamera;
+
+#define HFR_FPS     240
+#define FRAME_NS    (s2ns(1) / HFR_FPS)
+
+// Simulated high speed session. Requests come in bursts the way the
+// framework sends them, batches are submitted when full or on their
+// deadline, and metadata returns a fixed latency after submission. Time is
+// simulated, so nothing sleeps.
+struct hfr_sim {
+    QCamera3HFRBatch batch;
+    nsecs_t now;
+    uint32_t queued;
+    uint32_t frameNumber;
+    nsecs_t returnLatency;
+
+    hfr_sim(uint32_t maxBatch) : now(s2ns(1)), queued(0), frameNumber(0),
+            returnLatency(ms2ns(60)) {
+        batch.configure(maxBatch, HFR_FPS);
+    }
+
+    void submit(hfr_batch_flush_t reason) {
+        batch.onBatchSubmit(frameNumber, queued, reason, now);
+        batch.onBatchReturn(frameNumber, now + returnLatency);
+        queued = 0;
+    }
+
+    // One video request at 'now'.
+    void request() {
+        if (queued == 0) {
+            batch.onBatchOpen(now);
+        }
+        queued++;
+        frameNumber++;
+        if (batch.isFull(queued)) {
+            submit(HFR_BATCH_FLUSH_FULL);
+        }
+    }
+
+    // Advance time, flushing the open batch if its deadline passes.
+    void advance(nsecs_t ns) {
+        nsecs_t end = now + ns;
+        nsecs_t deadline = batch.getDeadline();
+        if ((queued > 0) && (deadline > 0) && (deadline <= end)) {
+            now = deadline;
+            submit(HFR_BATCH_FLUSH_DEADLINE);
+        }
+        now = end;
+    }
+
+    // 'count' requests spaced by 'interval', in bursts of 'burst'.
+    void run(uint32_t count, nsecs_t interval, uint32_t burst) {
+        for (uint32_t i = 0; i < count; i += burst) {
+            for (uint32_t j = 0; j < burst; j++) {
+                request();
+                advance(us2ns(50));
+            }
+            advance(interval * burst - us2ns(50) * burst);
+        }
+    }
+};
+
+// Test that bursty requests at the configured rate keep full batches.
+TEST(cam_hfr_batch_tests, full_rate_keeps_max) {
+    hfr_sim sim(8);
+    sim.run(800, FRAME_NS, 8);
+
+    hfr_batch_stats_t stats;
+    sim.batch.getStats(stats);
+    ASSERT_EQ(8u, sim.batch.getTarget());
+    ASSERT_EQ(100u, stats.batches);
+    ASSERT_EQ(100u, stats.fill[8]);
+    ASSERT_EQ(0u, stats.flushes[HFR_BATCH_FLUSH_DEADLINE]);
+}
+
+// Test that the batch shrinks at a lower request rate and grows back.
+TEST(cam_hfr_batch_tests, follows_request_rate) {
+    hfr_sim sim(8);
+    sim.run(400, FRAME_NS * 4, 2);
+    ASSERT_EQ(2u, sim.batch.getTarget());
+
+    sim.run(800, FRAME_NS, 8);
+    ASSERT_EQ(8u, sim.batch.getTarget());
+}
+
+// Test that a stalled app gets its partial batch sent on the deadline.
+TEST(cam_hfr_batch_tests, deadline_flush) {
+    hfr_sim sim(8);
+    sim.run(80, FRAME_NS, 8);
+    sim.request();
+    sim.request();
+    sim.request();
+    nsecs_t deadline = sim.batch.getDeadline();
+    ASSERT_GT(deadline, sim.now);
+    sim.advance(ms2ns(500));
+
+    hfr_batch_stats_t stats;
+    sim.batch.getStats(stats);
+    ASSERT_EQ(1u, stats.flushes[HFR_BATCH_FLUSH_DEADLINE]);
+    ASSERT_EQ(1u, stats.fill[3]);
+    ASSERT_EQ(0u, sim.queued);
+    ASSERT_EQ(0, sim.batch.getDeadline());
+}
+
+// Test that a return latency over budget caps the batch size.
+TEST(cam_hfr_batch_tests, latency_cap) {
+    hfr_sim sim(8);
+    sim.returnLatency = ms2ns(400);
+    sim.run(400, FRAME_NS, 8);
+    ASSERT_EQ(1u, sim.batch.getTarget());
+
+    sim.returnLatency = ms2ns(20);
+    sim.run(800, FRAME_NS, 8);
+    ASSERT_EQ(8u, sim.batch.getTarget());
+}
+
+// Test that fixed mode keeps the configured size and never flushes early.
+TEST(cam_hfr_batch_tests, fixed_mode) {
+    hfr_sim sim(4);
+    sim.batch.setTunables(false, 0, 0);
+    sim.run(100, FRAME_NS * 8, 1);
+    ASSERT_EQ(4u, sim.batch.getTarget());
+    ASSERT_EQ(0, sim.batch.getDeadline());
+
+    hfr_batch_stats_t stats;
+    sim.batch.getStats(stats);
+    ASSERT_EQ(25u, stats.fill[4]);
+}
+
+// Test the histogram buckets.
+TEST(cam_hfr_batch_tests, buckets) {
+    ASSERT_EQ(0u, QCamera3HFRBatch::bucketOf(us2ns(999)));
+    ASSERT_EQ(1u, QCamera3HFRBatch::bucketOf(ms2ns(1)));
+    ASSERT_EQ(2u, QCamera3HFRBatch::bucketOf(ms2ns(3)));
+    ASSERT_EQ(3u, QCamera3HFRBatch::bucketOf(ms2ns(4)));
+    ASSERT_EQ((uint32_t)HFR_BATCH_HIST_BUCKETS - 1,
+            QCamera3HFRBatch::bucketOf(s2ns(100)));
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_log_ring_tests"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mm_camera_log_ring.h"
+
+#define NS_PER_S 1000000000
+#define BENCH_CALLS 100000
+#define BENCH_THREADS 4
+// Records a thread logs before it lets the drainer catch up, well below
+// the ring size so the benchmark times the enqueue path and not drops
+#define BENCH_BURST (CAM_LOG_RING_SLOTS / 2)
+
+static inline int64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+struct sink_state {
+    pthread_mutex_t lock;
+    std::vector<std::string> msgs;
+    uint64_t notices;
+    int64_t delay_ns;
+};
+
+static void sink(const cam_log_rec_t *rec, const char *msg, void *user_data) {
+    sink_state *state = (sink_state *)user_data;
+    int64_t delay_ns = __atomic_load_n(&state->delay_ns, __ATOMIC_RELAXED);
+    if (delay_ns > 0) {
+        timespec ts = {0, (long)delay_ns};
+        nanosleep(&ts, NULL);
+    }
+    pthread_mutex_lock(&state->lock);
+    if (rec->fmt == NULL) {
+        state->notices++;
+    } else {
+        state->msgs.push_back(msg);
+    }
+    pthread_mutex_unlock(&state->lock);
+}
+
+static void init_sink(sink_state& state) {
+    pthread_mutex_init(&state.lock, NULL);
+    state.notices = 0;
+    state.delay_ns = 0;
+}
+
+static int log_call(const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    int rc = cam_log_ring_write(1, 3, __func__, __LINE__, fmt, args);
+    va_end(args);
+    return rc;
+}
+
+static std::string sync_format(const char *fmt, ...) {
+    char buf[1024];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+    return buf;
+}
+
+// Test that records render the same text vsnprintf would have.
+TEST(cam_log_ring_tests, format_matches_vsnprintf) {
+    sink_state state;
+    init_sink(state);
+    ASSERT_EQ(0, cam_log_ring_start(sink, &state));
+
+    char name[16] = "preview";
+    const char *none = NULL;
+    std::vector<std::string> expect;
+#define CHECK_FMT(fmt, ...) \
+    do { \
+        ASSERT_EQ(0, log_call(fmt, __VA_ARGS__)); \
+        expect.push_back(sync_format(fmt, __VA_ARGS__)); \
+    } while (0)
+
+    CHECK_FMT("E camera_idx = %d rc %u\n", -3, 7u);
+    CHECK_FMT("stream %s dim %dx%d fmt 0x%x", name, 1920, 1080, 0x11);
+    CHECK_FMT("%lld %llu %ld %zu %hhx %hd", -5LL, 9ULL, -7L, (size_t)42,
+            0x1ff, 70000);
+    CHECK_FMT("%5.2f|%-8s|%08.3e|%g %%", 3.14159, "ab", 1234.5, 0.25);
+    CHECK_FMT("%*d|%-*.*s|%.3s", 6, 42, 10, 2, "abcdef", "xyzzy");
+    CHECK_FMT("ptr %p null %s char %c", (void *)&state, none, 'Q');
+    CHECK_FMT("done %d%%", 100);
+#undef CHECK_FMT
+
+    // More argument words than a record holds falls back to preformatting.
+    ASSERT_EQ(0, log_call("%d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+            1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14));
+    expect.push_back("1 2 3 4 5 6 7 8 9 10 11 12 13 14");
+
+    // %s arguments are copied, the caller's buffer may change right after.
+    ASSERT_EQ(0, log_call("name %s", name));
+    expect.push_back("name preview");
+    strcpy(name, "clobbered");
+
+    cam_log_ring_flush();
+    cam_log_ring_stop();
+    ASSERT_EQ(expect.size(), state.msgs.size());
+    for (size_t i = 0; i < expect.size(); i++) {
+        EXPECT_EQ(expect[i], state.msgs[i]);
+    }
+    EXPECT_EQ(-1, log_call("inactive %d", 1));
+}
+
+// Test that a stalled drainer drops records instead of blocking callers,
+// and that the drops are counted and reported.
+TEST(cam_log_ring_tests, drops_when_full) {
+    sink_state state;
+    init_sink(state);
+    state.delay_ns = 1000000;
+    cam_log_ring_stats_t before, after;
+    cam_log_ring_get_stats(&before);
+    ASSERT_EQ(0, cam_log_ring_start(sink, &state));
+
+    int queued = 0, dropped = 0;
+    for (int i = 0; i < CAM_LOG_RING_SLOTS * 4; i++) {
+        int rc = log_call("burst %d", i);
+        ASSERT_GE(rc, 0);
+        if (rc == 0) {
+            queued++;
+        } else {
+            dropped++;
+        }
+    }
+    __atomic_store_n(&state.delay_ns, 0, __ATOMIC_RELAXED);
+    cam_log_ring_flush();
+    cam_log_ring_stop();
+    cam_log_ring_get_stats(&after);
+
+    EXPECT_GT(dropped, 0);
+    EXPECT_EQ((uint64_t)dropped, after.dropped - before.dropped);
+    EXPECT_EQ((uint64_t)queued, after.written - before.written);
+    EXPECT_EQ((size_t)queued, state.msgs.size());
+    EXPECT_GE(state.notices, 1u);
+}
+
+static void *bench_thread(void *data) {
+    int64_t *ns = (int64_t *)data;
+    *ns = 0;
+    for (int i = 0; i < BENCH_CALLS; i += BENCH_BURST) {
+        int64_t start = now_ns();
+        for (int j = i; (j < i + BENCH_BURST) && (j < BENCH_CALLS); j++) {
+            log_call("frame %d buf %p ts %lld name %s", j, data,
+                    (long long)j * 33333, "CAM_StrmAppData");
+        }
+        *ns += now_ns() - start;
+        cam_log_ring_flush();
+    }
+    return NULL;
+}
+
+// Report the cost of a log call on the calling thread, formatted in place
+// versus queued on the ring. Threads log in bursts the ring can hold and
+// wait for the drainer in between, outside the timed part.
+TEST(cam_log_ring_tests, log_call_benchmark) {
+    char buf[1024];
+    int64_t start = now_ns();
+    for (int i = 0; i < BENCH_CALLS; i++) {
+        snprintf(buf, sizeof(buf), "frame %d buf %p ts %lld name %s", i,
+                (void *)buf, (long long)i * 33333, "CAM_StrmAppData");
+    }
+    int64_t format_ns = now_ns() - start;
+
+    sink_state state;
+    init_sink(state);
+    cam_log_ring_stats_t before, after;
+    cam_log_ring_get_stats(&before);
+    ASSERT_EQ(0, cam_log_ring_start(sink, &state));
+
+    pthread_t threads[BENCH_THREADS];
+    int64_t thread_ns[BENCH_THREADS];
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        pthread_create(&threads[i], NULL, bench_thread, &thread_ns[i]);
+    }
+    int64_t ring_ns = 0;
+    for (int i = 0; i < BENCH_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        ring_ns += thread_ns[i];
+    }
+    cam_log_ring_flush();
+    cam_log_ring_stop();
+    cam_log_ring_get_stats(&after);
+
+    uint64_t written = after.written - before.written;
+    uint64_t dropped = after.dropped - before.dropped;
+    EXPECT_EQ((uint64_t)BENCH_CALLS * BENCH_THREADS, written + dropped);
+    EXPECT_EQ(written, (uint64_t)state.msgs.size());
+    EXPECT_EQ(0u, dropped);
+
+    printf("vsnprintf  %6.1f ns/call\n", (double)format_ns / BENCH_CALLS);
+    printf("ring       %6.1f ns/call, %d threads, %llu queued, "
+            "%llu dropped (%.2f%%)\n",
+            (double)ring_ns / ((int64_t)BENCH_CALLS * BENCH_THREADS),
+            BENCH_THREADS, (unsigned long long)written,
+            (unsigned long long)dropped,
+            100.0 * dropped / ((uint64_t)BENCH_CALLS * BENCH_THREADS));
+}
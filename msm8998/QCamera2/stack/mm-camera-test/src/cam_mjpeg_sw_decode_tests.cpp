@@ -0,0 +1,238 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_mjpeg_sw_decode_tests"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+extern "C" {
+#include <jpeglib.h>
+}
+
+#include "QCameraMjpegDecode.h"
+#include "QCameraMjpegSwDecode.h"
+
+#define CORRUPT_ITERATIONS 300
+
+// Smooth gradients with some detail, so blocks carry AC coefficients.
+static void makeImage(std::vector<uint8_t>& yuv, int w, int h) {
+    yuv.resize((size_t)w * h * 3);
+    for (int y = 0; y < h; y++) {
+        for (int x = 0; x < w; x++) {
+            uint8_t *p = &yuv[((size_t)y * w + x) * 3];
+            p[0] = (uint8_t)((x * 255 / w + ((x ^ y) & 31)) & 0xFF);
+            p[1] = (uint8_t)(64 + y * 128 / h);
+            p[2] = (uint8_t)(192 - x * 128 / w);
+        }
+    }
+}
+
+// Encodes a YCbCr image with the reference library, as a UVC camera would.
+static std::vector<uint8_t> encode(const std::vector<uint8_t>& yuv, int w,
+        int h, int hSamp, int vSamp, int restartMcus, int quality) {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    unsigned char *out = NULL;
+    unsigned long outLen = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &out, &outLen);
+    cinfo.image_width = w;
+    cinfo.image_height = h;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_YCbCr;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_colorspace(&cinfo, JCS_YCbCr);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    cinfo.comp_info[0].h_samp_factor = hSamp;
+    cinfo.comp_info[0].v_samp_factor = vSamp;
+    cinfo.restart_in_rows = 0;
+    cinfo.restart_interval = restartMcus;
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = (JSAMPROW)&yuv[(size_t)cinfo.next_scanline * w * 3];
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> jpeg(out, out + outLen);
+    free(out);
+    return jpeg;
+}
+
+// Decodes with the reference library's islow IDCT into component planes.
+static void referenceDecode(const std::vector<uint8_t>& jpeg,
+        std::vector<uint8_t> planes[3], int widths[3], int heights[3]) {
+    jpeg_decompress_struct dinfo;
+    jpeg_error_mgr jerr;
+
+    dinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&dinfo);
+    jpeg_mem_src(&dinfo, (unsigned char *)jpeg.data(), jpeg.size());
+    jpeg_read_header(&dinfo, TRUE);
+    dinfo.raw_data_out = TRUE;
+    dinfo.do_fancy_upsampling = FALSE;
+    dinfo.dct_method = JDCT_ISLOW;
+    jpeg_start_decompress(&dinfo);
+
+    int rowsPerPass = dinfo.max_v_samp_factor * DCTSIZE;
+    for (int c = 0; c < 3; c++) {
+        jpeg_component_info *ci = &dinfo.comp_info[c];
+        widths[c] = ci->width_in_blocks * DCTSIZE;
+        heights[c] = (int)(((dinfo.output_height + rowsPerPass - 1) /
+                rowsPerPass) * ci->v_samp_factor * DCTSIZE);
+        planes[c].assign((size_t)widths[c] * heights[c], 0);
+    }
+    while (dinfo.output_scanline < dinfo.output_height) {
+        JSAMPROW rows[3][2 * DCTSIZE];
+        JSAMPARRAY arrays[3];
+        for (int c = 0; c < 3; c++) {
+            int compRows = dinfo.comp_info[c].v_samp_factor * DCTSIZE;
+            int first = (int)dinfo.output_scanline / dinfo.max_v_samp_factor *
+                    dinfo.comp_info[c].v_samp_factor;
+            for (int r = 0; r < compRows; r++) {
+                rows[c][r] = &planes[c][(size_t)(first + r) * widths[c]];
+            }
+            arrays[c] = rows[c];
+        }
+        jpeg_read_raw_data(&dinfo, arrays, rowsPerPass);
+    }
+    jpeg_finish_decompress(&dinfo);
+    jpeg_destroy_decompress(&dinfo);
+}
+
+static void checkBitExact(int w, int h, int hSamp, int vSamp, int restart,
+        int quality, int threads) {
+    std::vector<uint8_t> yuv;
+    makeImage(yuv, w, h);
+    std::vector<uint8_t> jpeg = encode(yuv, w, h, hSamp, vSamp, restart,
+            quality);
+
+    std::vector<uint8_t> ref[3];
+    int rw[3], rh[3];
+    referenceDecode(jpeg, ref, rw, rh);
+
+    void *dec = NULL;
+    ASSERT_EQ(MJPEGD_NO_ERROR, mjpegSwDecoderInit(&dec, threads));
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    std::vector<uint8_t> outY((size_t)w * h), outVU((size_t)cw * 2 * ch);
+    ASSERT_EQ(MJPEGD_NO_ERROR, mjpegSwDecode(dec, jpeg.data(),
+            (int)jpeg.size(), outY.data(), w, outVU.data(), cw * 2, 1));
+    mjpegSwDecoderDestroy(dec);
+
+    for (int y = 0; y < h; y++) {
+        ASSERT_EQ(0, memcmp(&outY[(size_t)y * w], &ref[0][(size_t)y * rw[0]],
+                w)) << "luma row " << y;
+    }
+    for (int y = 0; y < ch; y++) {
+        for (int x = 0; x < cw; x++) {
+            int v[2];
+            for (int c = 1; c <= 2; c++) {
+                const uint8_t *p = ref[c].data();
+                int s = rw[c];
+                if (vSamp == 2) {
+                    v[c - 1] = p[y * s + x];
+                } else if (hSamp == 2) {
+                    v[c - 1] = (p[2 * y * s + x] + p[(2 * y + 1) * s + x] + 1) >> 1;
+                } else {
+                    v[c - 1] = (p[2 * y * s + 2 * x] + p[2 * y * s + 2 * x + 1] +
+                            p[(2 * y + 1) * s + 2 * x] +
+                            p[(2 * y + 1) * s + 2 * x + 1] + 2) >> 2;
+                }
+            }
+            ASSERT_EQ(v[1], outVU[(size_t)y * cw * 2 + x * 2]) << x << "," << y;
+            ASSERT_EQ(v[0], outVU[(size_t)y * cw * 2 + x * 2 + 1]) << x << "," << y;
+        }
+    }
+}
+
+// Test that decoded frames match the reference islow decoder bit for bit.
+TEST(cam_mjpeg_sw_decode_tests, bit_exact) {
+    checkBitExact(640, 480, 2, 1, 0, 90, 1);
+    checkBitExact(640, 480, 2, 1, 4, 90, 4);
+    checkBitExact(320, 240, 2, 2, 2, 75, 3);
+    checkBitExact(176, 144, 1, 1, 1, 100, 2);
+    checkBitExact(1280, 720, 2, 1, 40, 95, 4);
+}
+
+// Test that corrupt streams decode without crashing. Run under UBSan to
+// catch integer overflow in the IDCT.
+TEST(cam_mjpeg_sw_decode_tests, corrupt_stream) {
+    std::vector<uint8_t> yuv;
+    makeImage(yuv, 320, 240);
+    std::vector<uint8_t> jpeg = encode(yuv, 320, 240, 2, 1, 4, 100);
+
+    void *dec = NULL;
+    ASSERT_EQ(MJPEGD_NO_ERROR, mjpegSwDecoderInit(&dec, 2));
+    std::vector<uint8_t> outY(320 * 240), outVU(320 * 120);
+
+    // Maximum 16-bit quantizers make every dequantized coefficient huge.
+    // The table goes after the stream's own tables, so it is the one used.
+    const uint8_t dqt[] = {0xFF, 0xDB, 0x00, 0x83, 0x10};
+    std::vector<uint8_t> bigQ;
+    size_t sof = 0;
+    for (size_t i = 2; i + 1 < jpeg.size(); i++) {
+        if ((jpeg[i] == 0xFF) && (jpeg[i + 1] == 0xC0)) {
+            sof = i;
+            break;
+        }
+    }
+    ASSERT_NE(0u, sof);
+    bigQ.assign(jpeg.begin(), jpeg.begin() + sof);
+    bigQ.insert(bigQ.end(), dqt, dqt + sizeof(dqt));
+    bigQ.insert(bigQ.end(), 128, 0xFF);
+    bigQ.insert(bigQ.end(), jpeg.begin() + sof, jpeg.end());
+    mjpegSwDecode(dec, bigQ.data(), (int)bigQ.size(), outY.data(), 0,
+            outVU.data(), 0, 1);
+
+    // Random byte damage in the entropy coded data
+    size_t sos = 0;
+    for (size_t i = 2; i + 1 < jpeg.size(); i++) {
+        if ((jpeg[i] == 0xFF) && (jpeg[i + 1] == 0xDA)) {
+            sos = i + 2 + ((jpeg[i + 2] << 8) | jpeg[i + 3]);
+            break;
+        }
+    }
+    ASSERT_NE(0u, sos);
+    srand(1);
+    for (int n = 0; n < CORRUPT_ITERATIONS; n++) {
+        std::vector<uint8_t> bad = (n & 1) ? bigQ : jpeg;
+        size_t start = (n & 1) ? sos + sizeof(dqt) + 128 : sos;
+        for (int k = 0; k < 8; k++) {
+            size_t pos = start + (size_t)rand() % (bad.size() - start - 2);
+            bad[pos] = (uint8_t)rand();
+        }
+        int rc = mjpegSwDecode(dec, bad.data(), (int)bad.size(), outY.data(),
+                0, outVU.data(), 0, 1);
+        ASSERT_TRUE((rc == MJPEGD_NO_ERROR) || (rc == MJPEGD_ERROR) ||
+                (rc == MJPEGD_UNSUPPORTED)) << rc;
+    }
+
+    // Truncated streams
+    for (size_t len = jpeg.size(); len > sos; len -= 97) {
+        mjpegSwDecode(dec, jpeg.data(), (int)len, outY.data(), 0,
+                outVU.data(), 0, 1);
+    }
+    mjpegSwDecoderDestroy(dec);
+}
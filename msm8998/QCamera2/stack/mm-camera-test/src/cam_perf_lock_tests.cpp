@@ -0,0 +1,176 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_perf_lock_tests"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "QCameraPerfLockScheduler.h"
+
+using namespace qcamera;
+
+#define HOLD_OFF_MS 50
+
+// Stands in for the perf daemon: counts calls and takes 'delay_us' per call.
+struct stub_backend {
+    int acquires;
+    int releases;
+    int32_t last_handle;
+    int32_t extended_handle;
+    uint32_t delay_us;
+};
+
+static int32_t stub_acquire(void *user, uint32_t /*type*/, int32_t handle,
+        uint32_t /*timeoutMs*/) {
+    stub_backend *b = (stub_backend *)user;
+    usleep(__atomic_load_n(&b->delay_us, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&b->acquires, 1, __ATOMIC_RELAXED);
+    if (handle > 0) {
+        __atomic_store_n(&b->extended_handle, handle, __ATOMIC_RELAXED);
+        return handle;
+    }
+    return __atomic_add_fetch(&b->last_handle, 1, __ATOMIC_RELAXED);
+}
+
+static int32_t stub_release(void *user, uint32_t /*type*/, int32_t /*handle*/) {
+    stub_backend *b = (stub_backend *)user;
+    usleep(__atomic_load_n(&b->delay_us, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&b->releases, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static perf_lock_backend_t make_backend(stub_backend *b) {
+    perf_lock_backend_t backend;
+    backend.acquire = stub_acquire;
+    backend.release = stub_release;
+    backend.user = b;
+    return backend;
+}
+
+static int count(int *v) {
+    return __atomic_load_n(v, __ATOMIC_RELAXED);
+}
+
+// Test that overlapping requests share one backend lock.
+TEST(cam_perf_lock_tests, coalesce) {
+    stub_backend b = {};
+    QCameraPerfLockScheduler sched(make_backend(&b), 2, HOLD_OFF_MS);
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(sched.acquire(0, 1000, false));
+    }
+    sched.sync();
+    ASSERT_EQ(1, count(&b.acquires));
+
+    for (int i = 0; i < 5; i++) {
+        ASSERT_TRUE(sched.release(0));
+    }
+    ASSERT_FALSE(sched.release(0));
+    usleep(HOLD_OFF_MS * 3 * 1000);
+    sched.sync();
+    ASSERT_EQ(1, count(&b.releases));
+
+    perf_lock_stats_t stats;
+    ASSERT_TRUE(sched.getStats(0, stats));
+    ASSERT_EQ(5u, stats.requests);
+    ASSERT_EQ(4u, stats.coalesced);
+    ASSERT_FALSE(stats.held);
+    ASSERT_GT(stats.heldNs, 0);
+}
+
+// Test that a request inside the hold-off reuses the lock instead of
+// releasing and re-acquiring it.
+TEST(cam_perf_lock_tests, hold_off) {
+    stub_backend b = {};
+    QCameraPerfLockScheduler sched(make_backend(&b), 2, HOLD_OFF_MS);
+
+    for (int i = 0; i < 10; i++) {
+        sched.acquire(1, 1000, false);
+        sched.sync();
+        sched.release(1);
+    }
+    sched.sync();
+    ASSERT_EQ(1, count(&b.acquires));
+    ASSERT_EQ(0, count(&b.releases));
+
+    usleep(HOLD_OFF_MS * 3 * 1000);
+    sched.sync();
+    ASSERT_EQ(1, count(&b.releases));
+
+    perf_lock_stats_t stats;
+    sched.getStats(1, stats);
+    ASSERT_EQ(9u, stats.heldOff);
+}
+
+// Test that a held lock is re-acquired only when it is short of the requested
+// timeout, and that a lock past its timeout is dropped with its references.
+TEST(cam_perf_lock_tests, extend_and_expire) {
+    stub_backend b = {};
+    QCameraPerfLockScheduler sched(make_backend(&b), 1, HOLD_OFF_MS);
+
+    sched.acquire(0, 100, true);
+    sched.sync();
+    sched.acquire(0, 50, true);
+    sched.sync();
+    ASSERT_EQ(1, count(&b.acquires));
+
+    sched.acquire(0, 300, true);
+    sched.sync();
+    ASSERT_EQ(2, count(&b.acquires));
+    ASSERT_EQ(1, b.extended_handle);
+
+    usleep(350 * 1000);
+    perf_lock_stats_t stats;
+    sched.getStats(0, stats);
+    ASSERT_FALSE(stats.held);
+    ASSERT_FALSE(sched.release(0));
+    ASSERT_EQ(0, count(&b.releases));
+}
+
+// Report how long callers wait with a slow backend.
+TEST(cam_perf_lock_tests, caller_latency) {
+    stub_backend b = {};
+    b.delay_us = 2000;
+    QCameraPerfLockScheduler sched(make_backend(&b), 1, HOLD_OFF_MS);
+
+    const int iterations = 50;
+    nsecs_t worst = 0;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < iterations; i++) {
+        nsecs_t call = systemTime();
+        sched.acquire(0, 1000, true);
+        sched.release(0);
+        nsecs_t d = systemTime() - call;
+        if (d > worst) {
+            worst = d;
+        }
+        usleep(1000);
+    }
+    nsecs_t total = systemTime() - start;
+    sched.sync();
+
+    perf_lock_stats_t stats;
+    sched.getStats(0, stats);
+    printf("%d acquire/release pairs in %.1f ms: backend calls %d, "
+            "caller max %.1f us, saved %.1f ms\n", iterations,
+            (double)total / 1000000, count(&b.acquires) + count(&b.releases),
+            (double)worst / 1000, (double)stats.savedNs / 1000000);
+    ASSERT_LT(count(&b.acquires), iterations);
+}
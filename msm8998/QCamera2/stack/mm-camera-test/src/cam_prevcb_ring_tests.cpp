@@ -0,0 +1,253 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_prevcb_ring_tests"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "QCameraPreviewCbRing.h"
+
+using namespace qcamera;
+
+#define NS_PER_S 1000000000
+
+// 1080p NV21 preview with typical venus padding.
+#define WIDTH       1920
+#define HEIGHT      1080
+#define STRIDE      2048
+#define SCANLINE    1088
+#define FRAME_SIZE  (WIDTH * HEIGHT * 3 / 2)
+#define BENCH_ITERATIONS 300
+
+#define FMT_NV21    1
+#define FMT_YV12    2
+
+typedef struct {
+    uint32_t allocs;
+    uint32_t releases;
+} fake_allocator_t;
+
+typedef struct {
+    camera_memory_t mem;
+    fake_allocator_t *allocator;
+} fake_memory_t;
+
+static void fake_release(camera_memory_t *mem) {
+    fake_memory_t *fake = (fake_memory_t *)mem;
+    fake->allocator->releases++;
+    munmap(mem->data, mem->size);
+    delete fake;
+}
+
+// Maps fresh pages like the ashmem heap behind the framework allocator.
+static camera_memory_t *fake_get_memory(int /*fd*/, size_t size,
+        unsigned int /*num_bufs*/, void *user) {
+    fake_memory_t *fake = new fake_memory_t();
+    fake->allocator = (fake_allocator_t *)user;
+    fake->mem.data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    fake->mem.size = size;
+    fake->mem.handle = NULL;
+    fake->mem.release = fake_release;
+    fake->allocator->allocs++;
+    return &fake->mem;
+}
+
+static inline int64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+// De-stride a NV21 frame the way the preview callback does.
+static void destride_frame(uint8_t *dst, const uint8_t *src) {
+    const uint8_t *src_uv = src + STRIDE * SCANLINE;
+    uint8_t *dst_uv = dst + WIDTH * HEIGHT;
+    for (size_t i = 0; i < HEIGHT; i++) {
+        memcpy(dst + i * WIDTH, src + i * STRIDE, WIDTH);
+    }
+    for (size_t i = 0; i < HEIGHT / 2; i++) {
+        memcpy(dst_uv + i * WIDTH, src_uv + i * STRIDE, WIDTH);
+    }
+}
+
+static void bench(const char *name, uint32_t depth) {
+    std::vector<uint8_t> src(STRIDE * SCANLINE * 3 / 2, 0x5a);
+    fake_allocator_t allocator = { 0, 0 };
+    QCameraPreviewCbRing ring;
+    ring.setDepth(depth);
+
+    int64_t worst = 0;
+    int64_t start = now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        int64_t frame_start = now_ns();
+        camera_memory_t *mem = ring.get(FMT_NV21, FRAME_SIZE,
+                fake_get_memory, &allocator);
+        ASSERT_NE(nullptr, mem);
+        destride_frame((uint8_t *)mem->data, src.data());
+        ring.put(mem);
+        int64_t frame_ns = now_ns() - frame_start;
+        if (frame_ns > worst) {
+            worst = frame_ns;
+        }
+    }
+    int64_t total = now_ns() - start;
+
+    double bytes = (double)FRAME_SIZE * BENCH_ITERATIONS;
+    printf("%-10s %8.1f MB/s, avg %6.1f us/frame, max %6.1f us/frame, "
+            "%u allocations\n",
+            name, bytes * NS_PER_S / total / (1024 * 1024),
+            (double)total / BENCH_ITERATIONS / 1000, (double)worst / 1000,
+            allocator.allocs);
+}
+
+// Test that a returned buffer is reused instead of allocating a new one.
+TEST(cam_prevcb_ring_tests, reuse_returned) {
+    fake_allocator_t allocator = { 0, 0 };
+    {
+        QCameraPreviewCbRing ring;
+        ring.setDepth(3);
+        for (int i = 0; i < 30; i++) {
+            camera_memory_t *mem = ring.get(FMT_NV21, FRAME_SIZE,
+                    fake_get_memory, &allocator);
+            ASSERT_NE(nullptr, mem);
+            ring.put(mem);
+        }
+        preview_cb_ring_stats_t stats;
+        ring.getStats(stats);
+        EXPECT_EQ(1u, stats.allocs);
+        EXPECT_EQ(29u, stats.reuses);
+        EXPECT_EQ(0u, allocator.releases);
+    }
+    EXPECT_EQ(1u, allocator.allocs);
+    EXPECT_EQ(1u, allocator.releases);
+}
+
+// Test that callbacks queued behind each other get their own buffers, and
+// that the buffers are then reused in ring order.
+TEST(cam_prevcb_ring_tests, reuse_in_order) {
+    fake_allocator_t allocator = { 0, 0 };
+    QCameraPreviewCbRing ring;
+    ring.setDepth(3);
+
+    camera_memory_t *bufs[3];
+    for (int i = 0; i < 3; i++) {
+        bufs[i] = ring.get(FMT_NV21, FRAME_SIZE, fake_get_memory, &allocator);
+        ASSERT_NE(nullptr, bufs[i]);
+    }
+    for (int i = 0; i < 3; i++) {
+        ring.put(bufs[i]);
+    }
+    for (int round = 0; round < 3; round++) {
+        for (int i = 0; i < 3; i++) {
+            camera_memory_t *mem = ring.get(FMT_NV21, FRAME_SIZE,
+                    fake_get_memory, &allocator);
+            EXPECT_EQ(bufs[i], mem);
+        }
+        for (int i = 0; i < 3; i++) {
+            ring.put(bufs[i]);
+        }
+    }
+    EXPECT_EQ(3u, allocator.allocs);
+    EXPECT_EQ(0u, allocator.releases);
+}
+
+// Test that a buffer is not handed out again before it is returned, and
+// that the extra buffer used while the ring is busy is released on return.
+TEST(cam_prevcb_ring_tests, busy_buffer_not_reused) {
+    fake_allocator_t allocator = { 0, 0 };
+    QCameraPreviewCbRing ring;
+    ring.setDepth(2);
+
+    camera_memory_t *a = ring.get(FMT_NV21, FRAME_SIZE, fake_get_memory, &allocator);
+    camera_memory_t *b = ring.get(FMT_NV21, FRAME_SIZE, fake_get_memory, &allocator);
+    camera_memory_t *c = ring.get(FMT_NV21, FRAME_SIZE, fake_get_memory, &allocator);
+    ASSERT_NE(nullptr, a);
+    ASSERT_NE(nullptr, b);
+    ASSERT_NE(nullptr, c);
+    EXPECT_NE(a, b);
+    EXPECT_NE(a, c);
+    EXPECT_NE(b, c);
+
+    ring.put(c);
+    EXPECT_EQ(1u, allocator.releases);
+
+    ring.put(b);
+    EXPECT_EQ(b, ring.get(FMT_NV21, FRAME_SIZE, fake_get_memory, &allocator));
+    EXPECT_EQ(3u, allocator.allocs);
+
+    ring.put(a);
+    ring.put(b);
+    ring.clear();
+    EXPECT_EQ(3u, allocator.releases);
+}
+
+// Test that a new format or size empties the ring, and that a buffer busy
+// at that point is released when it comes back.
+TEST(cam_prevcb_ring_tests, key_change_empties_ring) {
+    fake_allocator_t allocator = { 0, 0 };
+    QCameraPreviewCbRing ring;
+    ring.setDepth(2);
+
+    camera_memory_t *idle = ring.get(FMT_NV21, FRAME_SIZE, fake_get_memory, &allocator);
+    camera_memory_t *busy = ring.get(FMT_NV21, FRAME_SIZE, fake_get_memory, &allocator);
+    ring.put(idle);
+
+    camera_memory_t *yv12 = ring.get(FMT_YV12, FRAME_SIZE, fake_get_memory, &allocator);
+    ASSERT_NE(nullptr, yv12);
+    EXPECT_EQ(1u, allocator.releases);
+    ring.put(busy);
+    EXPECT_EQ(2u, allocator.releases);
+
+    ring.put(yv12);
+    camera_memory_t *small = ring.get(FMT_YV12, FRAME_SIZE / 4,
+            fake_get_memory, &allocator);
+    ASSERT_NE(nullptr, small);
+    EXPECT_EQ(FRAME_SIZE / 4, small->size);
+    EXPECT_EQ(3u, allocator.releases);
+    ring.put(small);
+    ring.clear();
+    EXPECT_EQ(allocator.allocs, allocator.releases);
+}
+
+// Test that depth 0 allocates and releases a buffer per callback.
+TEST(cam_prevcb_ring_tests, depth_zero) {
+    fake_allocator_t allocator = { 0, 0 };
+    QCameraPreviewCbRing ring;
+    for (int i = 0; i < 5; i++) {
+        camera_memory_t *mem = ring.get(FMT_NV21, FRAME_SIZE,
+                fake_get_memory, &allocator);
+        ASSERT_NE(nullptr, mem);
+        ring.put(mem);
+    }
+    EXPECT_EQ(5u, allocator.allocs);
+    EXPECT_EQ(5u, allocator.releases);
+}
+
+// Report throughput and per-frame latency of the preview callback path,
+// allocation plus de-stride copy, with and without the ring.
+TEST(cam_prevcb_ring_tests, callback_benchmark) {
+    bench("per-frame", 0);
+    bench("ring", 3);
+}
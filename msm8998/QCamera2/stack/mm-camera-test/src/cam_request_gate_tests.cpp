@@ -0,0 +1,332 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_request_gate_tests"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <gtest/gtest.h>
+#include <utils/Errors.h>
+
+#include "QCamera3RequestGate.h"
+
+using namespace android;
+using namespace qcamera;
+
+#define MIN_INFLIGHT        4
+#define MAX_INFLIGHT        6
+#define STRESS_REQUESTS     20000
+#define FRAME_US            50
+#define REQUEST_WORK_US     20
+#define RESULT_WORK_US      20
+#define FLUSH_EVERY_MS      3
+#define GATE_TIMEOUT_S      5
+
+static bool isStopped(void *cookie) {
+    return ((std::atomic<bool> *)cookie)->load();
+}
+
+// Busy work standing in for request setup or result translation.
+static void work(int us) {
+    nsecs_t end = systemTime() + us2ns(us);
+    while (systemTime() < end) {
+    }
+}
+
+// Throttle as it was before the gate: the request thread waits on the
+// condition with mMutex as its lock, so each wakeup has to win mMutex back
+// from the result path before the request call can return.
+struct legacy_gate {
+    std::condition_variable_any cond;
+    uint32_t inFlight;
+
+    legacy_gate() : inFlight(0) {}
+    // halLock held
+    void sent() { inFlight++; }
+    void done() {
+        if (inFlight > 0) {
+            inFlight--;
+        }
+        cond.notify_one();
+    }
+    void reset() {
+        inFlight = 0;
+        cond.notify_one();
+    }
+    void wake() { cond.notify_one(); }
+    int32_t wait(std::unique_lock<std::mutex> &l, std::atomic<bool> &stopped) {
+        nsecs_t deadline = systemTime() + s2ns(GATE_TIMEOUT_S);
+        while ((inFlight >= MIN_INFLIGHT) && !stopped) {
+            if (cond.wait_for(l, std::chrono::nanoseconds(
+                    deadline - systemTime())) == std::cv_status::timeout) {
+                return TIMED_OUT;
+            }
+        }
+        l.unlock();
+        return NO_ERROR;
+    }
+};
+
+// The gate under test, waiting with mMutex released.
+struct split_gate {
+    QCamera3RequestGate gate;
+
+    split_gate() { gate.setLimits(MIN_INFLIGHT, MAX_INFLIGHT); }
+    void sent() { gate.onRequestSent(); }
+    void done() { gate.onRequestDone(); }
+    void reset() { gate.reset(); }
+    void wake() { gate.wake(); }
+    int32_t wait(std::unique_lock<std::mutex> &l, std::atomic<bool> &stopped) {
+        l.unlock();
+        return gate.waitForSpace(systemTime() + s2ns(GATE_TIMEOUT_S),
+                isStopped, &stopped);
+    }
+};
+
+// Virtual pipeline around one gate. halLock stands in for mMutex. The
+// request thread sets up a request under it, the backend completes requests
+// in order one per frame, and the metadata and buffer threads handle results
+// under halLock. A flush thread drops everything in flight now and then.
+template <typename Gate>
+struct fake_pipeline {
+    Gate gate;
+    std::mutex halLock;
+    std::mutex backendLock;
+    std::condition_variable backendCond;
+    std::deque<uint32_t> backend;
+    std::deque<uint32_t> buffers;
+    std::atomic<bool> stopped;
+    std::atomic<bool> exiting;
+    std::atomic<uint32_t> results;
+    std::atomic<uint32_t> timeouts;
+
+    fake_pipeline() : stopped(false), exiting(false), results(0), timeouts(0) {}
+
+    void backendLoop() {
+        std::unique_lock<std::mutex> l(backendLock);
+        while (!exiting) {
+            if (backend.empty()) {
+                backendCond.wait_for(l, std::chrono::milliseconds(1));
+                continue;
+            }
+            uint32_t frame = backend.front();
+            backend.pop_front();
+            buffers.push_back(frame);
+            l.unlock();
+
+            work(FRAME_US);
+            {
+                std::lock_guard<std::mutex> hl(halLock);
+                work(RESULT_WORK_US);
+                gate.done();
+            }
+            results++;
+            l.lock();
+        }
+    }
+
+    void bufferLoop() {
+        while (!exiting) {
+            bool got = false;
+            {
+                std::lock_guard<std::mutex> l(backendLock);
+                if (!buffers.empty()) {
+                    buffers.pop_front();
+                    got = true;
+                }
+            }
+            if (got) {
+                std::lock_guard<std::mutex> hl(halLock);
+                work(RESULT_WORK_US / 2);
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        }
+    }
+
+    void flushLoop(bool daemonPulls) {
+        uint32_t n = 0;
+        while (!exiting) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_EVERY_MS));
+            std::lock_guard<std::mutex> hl(halLock);
+            if (daemonPulls && (n++ & 1)) {
+                pull();
+                continue;
+            }
+            std::lock_guard<std::mutex> l(backendLock);
+            backend.clear();
+            buffers.clear();
+            gate.reset();
+        }
+    }
+
+    void pull();
+
+    // Returns the requests per second the request thread sustained.
+    double run(uint32_t requests, bool flushes) {
+        std::thread backendTh(&fake_pipeline::backendLoop, this);
+        std::thread bufferTh(&fake_pipeline::bufferLoop, this);
+        std::thread flushTh;
+        if (flushes) {
+            flushTh = std::thread(&fake_pipeline::flushLoop, this, true);
+        }
+
+        nsecs_t start = systemTime();
+        for (uint32_t i = 0; i < requests; i++) {
+            std::unique_lock<std::mutex> hl(halLock);
+            work(REQUEST_WORK_US);
+            {
+                std::lock_guard<std::mutex> l(backendLock);
+                backend.push_back(i);
+            }
+            gate.sent();
+            backendCond.notify_one();
+            if (gate.wait(hl, stopped) != NO_ERROR) {
+                timeouts++;
+            }
+        }
+        nsecs_t elapsed = systemTime() - start;
+
+        exiting = true;
+        backendCond.notify_all();
+        backendTh.join();
+        bufferTh.join();
+        if (flushTh.joinable()) {
+            flushTh.join();
+        }
+        return (double)requests * s2ns(1) / elapsed;
+    }
+};
+
+template <>
+void fake_pipeline<split_gate>::pull() {
+    gate.gate.onDaemonPull();
+}
+
+template <>
+void fake_pipeline<legacy_gate>::pull() {
+    gate.wake();
+}
+
+// Test that the request thread parks at the minimum and goes on once a
+// result comes back.
+TEST(cam_request_gate, parks_at_min) {
+    QCamera3RequestGate gate;
+    gate.setLimits(2, 4);
+
+    gate.onRequestSent();
+    EXPECT_EQ(NO_ERROR, gate.waitForSpace(systemTime() + ms2ns(1), NULL, NULL));
+    gate.onRequestSent();
+    EXPECT_EQ(2u, gate.getInFlight());
+
+    std::thread result([&gate] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        gate.onRequestDone();
+    });
+    nsecs_t start = systemTime();
+    EXPECT_EQ(NO_ERROR, gate.waitForSpace(start + s2ns(1), NULL, NULL));
+    EXPECT_GE(systemTime() - start, ms2ns(4));
+    EXPECT_EQ(1u, gate.getInFlight());
+    result.join();
+}
+
+// Test that a daemon pull lets the request thread go on up to the maximum.
+TEST(cam_request_gate, daemon_pull) {
+    QCamera3RequestGate gate;
+    gate.setLimits(2, 4);
+    for (int i = 0; i < 3; i++) {
+        gate.onRequestSent();
+    }
+
+    std::thread daemon([&gate] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        gate.onDaemonPull();
+    });
+    EXPECT_EQ(NO_ERROR, gate.waitForSpace(systemTime() + s2ns(1), NULL, NULL));
+    EXPECT_EQ(3u, gate.getInFlight());
+    daemon.join();
+
+    // At the maximum a pull alone does not open the gate.
+    gate.onRequestSent();
+    gate.onDaemonPull();
+    gate.wake();
+    EXPECT_EQ(TIMED_OUT, gate.waitForSpace(systemTime() + ms2ns(20), NULL, NULL));
+}
+
+// Test the ways out of a full gate other than a result: the deadline, the
+// stop condition and a flush.
+TEST(cam_request_gate, stop_timeout_reset) {
+    QCamera3RequestGate gate;
+    std::atomic<bool> stopped(false);
+    gate.setLimits(1, 1);
+    gate.onRequestSent();
+
+    nsecs_t start = systemTime();
+    EXPECT_EQ(TIMED_OUT, gate.waitForSpace(start + ms2ns(20), isStopped, &stopped));
+    EXPECT_GE(systemTime() - start, ms2ns(20));
+
+    std::thread error([&gate, &stopped] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        stopped = true;
+        gate.wake();
+    });
+    EXPECT_EQ(NO_ERROR, gate.waitForSpace(systemTime() + s2ns(1), isStopped, &stopped));
+    error.join();
+
+    std::thread flush([&gate] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        gate.reset();
+    });
+    EXPECT_EQ(NO_ERROR, gate.waitForSpace(systemTime() + s2ns(1), NULL, NULL));
+    EXPECT_EQ(0u, gate.getInFlight());
+    flush.join();
+
+    // A late result after the flush does not wrap the count.
+    gate.onRequestDone();
+    EXPECT_EQ(0u, gate.getInFlight());
+}
+
+// Stress the gate in the virtual pipeline with flushes and daemon pulls
+// racing the results, and check that no request is lost in a wait.
+TEST(cam_request_gate, stress) {
+    fake_pipeline<split_gate> pipeline;
+    pipeline.run(STRESS_REQUESTS, true);
+    EXPECT_EQ(0u, pipeline.timeouts.load());
+    EXPECT_GT(pipeline.results.load(), 0u);
+}
+
+// Report the sustained request rate of the old throttle and the gate in the
+// same pipeline.
+TEST(cam_request_gate, benchmark) {
+    fake_pipeline<legacy_gate> legacy;
+    double legacyRate = legacy.run(STRESS_REQUESTS, false);
+    EXPECT_EQ(0u, legacy.timeouts.load());
+
+    fake_pipeline<split_gate> split;
+    double splitRate = split.run(STRESS_REQUESTS, false);
+    EXPECT_EQ(0u, split.timeouts.load());
+
+    printf("wait on mMutex     %8.0f requests/s\n", legacyRate);
+    printf("request gate       %8.0f requests/s\n", splitRate);
+}
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_stream_config_tests"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <gtest/gtest.h>
+
+#include "QCamera3StreamConfig.h"
+
+using namespace qcamera;
+
+#define FWK_USAGE   0x00000103
+#define HAL_USAGE   (FWK_USAGE | 0x00000800)
+
+// A 1080p preview stream key. The struct is filled with garbage first, so
+// the comparison must not depend on padding bytes.
+static stream_config_key_t previewKey()
+{
+    stream_config_key_t key;
+    memset(&key, 0xa5, sizeof(key));
+    key.stream_type = 0;
+    key.format = 0x22;
+    key.width = 1920;
+    key.height = 1080;
+    key.rotation = 0;
+    key.data_space = 0;
+    key.op_mode = 0;
+    key.cam_stream_type = 1;
+    key.pp_mask = 0x1000;
+    key.hw_width = 1920;
+    key.hw_height = 1080;
+    key.preview_width = 1920;
+    key.preview_height = 1080;
+    key.video_width = 0;
+    key.video_height = 0;
+    key.is_4k_video = 0;
+    key.is_video = 0;
+    key.is_zsl = 0;
+    key.is_eis3 = 0;
+    return key;
+}
+
+// Test that an identical stream is kept across configureStreams.
+TEST(cam_stream_config_tests, same_config_kept) {
+    stream_config_key_t prev = previewKey();
+    stream_config_key_t cur = previewKey();
+    EXPECT_TRUE(isSameStreamConfig(prev, cur));
+    EXPECT_TRUE(isStreamConfigReusable(prev, FWK_USAGE, HAL_USAGE, cur, FWK_USAGE));
+}
+
+// Test that padding bytes do not take part in the comparison.
+TEST(cam_stream_config_tests, ignores_padding) {
+    stream_config_key_t a = previewKey();
+    stream_config_key_t b;
+    memset(&b, 0, sizeof(b));
+    b.stream_type = a.stream_type;
+    b.format = a.format;
+    b.width = a.width;
+    b.height = a.height;
+    b.rotation = a.rotation;
+    b.data_space = a.data_space;
+    b.op_mode = a.op_mode;
+    b.cam_stream_type = a.cam_stream_type;
+    b.pp_mask = a.pp_mask;
+    b.hw_width = a.hw_width;
+    b.hw_height = a.hw_height;
+    b.preview_width = a.preview_width;
+    b.preview_height = a.preview_height;
+    b.video_width = a.video_width;
+    b.video_height = a.video_height;
+    b.is_4k_video = a.is_4k_video;
+    b.is_video = a.is_video;
+    b.is_zsl = a.is_zsl;
+    b.is_eis3 = a.is_eis3;
+    EXPECT_TRUE(isSameStreamConfig(a, b));
+}
+
+// Test that a change to any field of the key rebuilds the stream.
+TEST(cam_stream_config_tests, any_field_change_rebuilds) {
+    typedef void (*mutator_t)(stream_config_key_t &);
+    static const struct {
+        const char *name;
+        mutator_t change;
+    } kChanges[] = {
+        { "stream_type",     [](stream_config_key_t &k) { k.stream_type = 1; } },
+        { "format",          [](stream_config_key_t &k) { k.format = 0x23; } },
+        { "width",           [](stream_config_key_t &k) { k.width = 1280; } },
+        { "height",          [](stream_config_key_t &k) { k.height = 720; } },
+        { "rotation",        [](stream_config_key_t &k) { k.rotation = 1; } },
+        { "data_space",      [](stream_config_key_t &k) { k.data_space = 0x101; } },
+        { "op_mode",         [](stream_config_key_t &k) { k.op_mode = 1; } },
+        { "cam_stream_type", [](stream_config_key_t &k) { k.cam_stream_type = 2; } },
+        { "pp_mask",         [](stream_config_key_t &k) { k.pp_mask |= 0x2; } },
+        { "hw_width",        [](stream_config_key_t &k) { k.hw_width = 1440; } },
+        { "hw_height",       [](stream_config_key_t &k) { k.hw_height = 1088; } },
+        { "preview_width",   [](stream_config_key_t &k) { k.preview_width = 1280; } },
+        { "preview_height",  [](stream_config_key_t &k) { k.preview_height = 720; } },
+        { "video_width",     [](stream_config_key_t &k) { k.video_width = 3840; } },
+        { "video_height",    [](stream_config_key_t &k) { k.video_height = 2160; } },
+        { "is_4k_video",     [](stream_config_key_t &k) { k.is_4k_video = 1; } },
+        { "is_video",        [](stream_config_key_t &k) { k.is_video = 1; } },
+        { "is_zsl",          [](stream_config_key_t &k) { k.is_zsl = 1; } },
+        { "is_eis3",         [](stream_config_key_t &k) { k.is_eis3 = 1; } },
+    };
+
+    stream_config_key_t prev = previewKey();
+    for (size_t i = 0; i < sizeof(kChanges) / sizeof(kChanges[0]); i++) {
+        stream_config_key_t cur = previewKey();
+        kChanges[i].change(cur);
+        EXPECT_FALSE(isSameStreamConfig(prev, cur)) << kChanges[i].name;
+        EXPECT_FALSE(isStreamConfigReusable(prev, FWK_USAGE, HAL_USAGE, cur,
+                FWK_USAGE)) << kChanges[i].name;
+    }
+}
+
+// Test which gralloc usage flags still allow the stream to be kept.
+TEST(cam_stream_config_tests, usage_decision) {
+    stream_config_key_t key = previewKey();
+
+    // framework passes its own usage again
+    EXPECT_TRUE(isStreamConfigReusable(key, FWK_USAGE, HAL_USAGE, key, FWK_USAGE));
+    // framework hands back the usage the HAL set last time
+    EXPECT_TRUE(isStreamConfigReusable(key, FWK_USAGE, HAL_USAGE, key, HAL_USAGE));
+    // any other usage means a different consumer
+    EXPECT_FALSE(isStreamConfigReusable(key, FWK_USAGE, HAL_USAGE, key,
+            FWK_USAGE | 0x00010000));
+    EXPECT_FALSE(isStreamConfigReusable(key, FWK_USAGE, HAL_USAGE, key, 0));
+}
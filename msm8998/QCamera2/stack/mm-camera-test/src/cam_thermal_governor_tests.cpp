@@ -0,0 +1,139 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_thermal_governor_tests"
+
+#include <stdio.h>
+
+#include <gtest/gtest.h>
+
+#include "QCameraThermalGovernor.h"
+
+using namespace qcamera;
+
+#define FRAME_NS ms2ns(33)
+
+// Simulated thermal source and preview stream. Time is simulated too, so
+// the loop runs without sleeping. Levels go through onThermalLevel() and
+// due steps through update(), in the order the HAL state machine runs them.
+struct thermal_sim {
+    QCameraThermalGovernor gov;
+    nsecs_t now;
+    nsecs_t cost;
+
+    thermal_sim() : now(s2ns(1)), cost(ms2ns(10)) {}
+
+    void level(qcamera_thermal_level_enum_t l) {
+        gov.onThermalLevel(l, now);
+        gov.update(now);
+    }
+
+    // Run preview frames for 'ms', taking the steps the governor asks for.
+    void run(uint32_t ms) {
+        nsecs_t end = now + ms2ns(ms);
+        while (now < end) {
+            if (gov.onFrame(cost, now)) {
+                gov.update(now);
+            }
+            now += FRAME_NS;
+        }
+    }
+};
+
+// Test that a level is reached one step at a time and the max level at once.
+TEST(cam_thermal_governor_tests, gradual_down) {
+    thermal_sim sim;
+    sim.run(1000);
+    ASSERT_EQ(0u, sim.gov.getStep());
+
+    sim.level(QCAMERA_THERMAL_BIG_ADJUSTMENT);
+    ASSERT_EQ(1u, sim.gov.getStep());
+    sim.run(THERMAL_GOV_DOWN_PERIOD_MS + 50);
+    ASSERT_EQ(2u, sim.gov.getStep());
+    sim.run(THERMAL_GOV_DOWN_PERIOD_MS * 3);
+    ASSERT_EQ(QCameraThermalGovernor::stepOfLevel(
+            QCAMERA_THERMAL_BIG_ADJUSTMENT), sim.gov.getStep());
+
+    sim.level(QCAMERA_THERMAL_MAX_ADJUSTMENT);
+    ASSERT_EQ((uint32_t)THERMAL_GOV_MAX_STEP, sim.gov.getStep());
+    ASSERT_EQ(0u, QCameraThermalGovernor::skipIntervalOf(sim.gov.getStep()));
+}
+
+// Test that the governor waits for the hold time before ramping up and then
+// ramps one step per period.
+TEST(cam_thermal_governor_tests, hysteresis_up) {
+    thermal_sim sim;
+    sim.level(QCAMERA_THERMAL_SLIGHT_ADJUSTMENT);
+    sim.run(THERMAL_GOV_DOWN_PERIOD_MS * 4);
+    ASSERT_EQ(2u, sim.gov.getStep());
+
+    sim.level(QCAMERA_THERMAL_NO_ADJUSTMENT);
+    sim.run(THERMAL_GOV_UP_HOLD_MS - 100);
+    ASSERT_EQ(2u, sim.gov.getStep());
+    sim.run(200);
+    ASSERT_EQ(1u, sim.gov.getStep());
+    sim.run(THERMAL_GOV_UP_PERIOD_MS + 100);
+    ASSERT_EQ(0u, sim.gov.getStep());
+
+    thermal_governor_stats_t stats;
+    sim.gov.getStats(stats);
+    ASSERT_EQ(2u, stats.stepsDown);
+    ASSERT_EQ(2u, stats.stepsUp);
+}
+
+// Test that a level flapping faster than the hold time does not make the
+// step oscillate.
+TEST(cam_thermal_governor_tests, flapping_level) {
+    thermal_sim sim;
+    sim.level(QCAMERA_THERMAL_SLIGHT_ADJUSTMENT);
+    sim.run(THERMAL_GOV_DOWN_PERIOD_MS * 4);
+
+    for (int i = 0; i < 20; i++) {
+        sim.level(QCAMERA_THERMAL_NO_ADJUSTMENT);
+        sim.run(THERMAL_GOV_UP_HOLD_MS / 2);
+        sim.level(QCAMERA_THERMAL_SLIGHT_ADJUSTMENT);
+        sim.run(THERMAL_GOV_UP_HOLD_MS / 2);
+    }
+
+    thermal_governor_stats_t stats;
+    sim.gov.getStats(stats);
+    printf("40 level changes: %u steps down, %u steps up\n",
+            stats.stepsDown, stats.stepsUp);
+    ASSERT_EQ(2u, sim.gov.getStep());
+    ASSERT_EQ(0u, stats.stepsUp);
+}
+
+// Test that a high frame cost adds a step while warm and holds off ramping
+// up into a rate the frames would not fit in.
+TEST(cam_thermal_governor_tests, frame_cost) {
+    thermal_sim sim;
+    sim.cost = FRAME_NS * 95 / 100;
+    sim.run(1000);
+    ASSERT_EQ(0u, sim.gov.getStep());
+
+    sim.level(QCAMERA_THERMAL_SLIGHT_ADJUSTMENT);
+    sim.run(THERMAL_GOV_DOWN_PERIOD_MS * 4);
+    ASSERT_EQ(3u, sim.gov.getStep());
+
+    sim.level(QCAMERA_THERMAL_NO_ADJUSTMENT);
+    sim.run(THERMAL_GOV_UP_HOLD_MS + THERMAL_GOV_UP_PERIOD_MS * 4);
+    ASSERT_EQ(3u, sim.gov.getStep());
+
+    sim.cost = ms2ns(10);
+    sim.run(THERMAL_GOV_UP_PERIOD_MS * 4);
+    ASSERT_EQ(0u, sim.gov.getStep());
+}
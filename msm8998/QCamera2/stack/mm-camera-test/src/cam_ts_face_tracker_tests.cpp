@@ -0,0 +1,138 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_ts_face_tracker_tests"
+
+#include <gtest/gtest.h>
+
+#include "QCameraTsFaceTracker.h"
+
+using namespace qcamera;
+
+// The default constructor binds the TS library entry points; the tests only
+// use injected ops, so these stand in for the library at link time.
+TSHandle ts_detectface_create_context() { return NULL; }
+void ts_detectface_destroy_context(TSHandle *) {}
+int ts_detectface_detectEx(TSHandle, TSMakeupDataEx *) { return -1; }
+int ts_detectface_get_face_info(TSHandle, int, TSRect *, TSRect *, TSRect *,
+        TSRect *) { return -1; }
+
+static int gContexts;
+static int gCreates;
+static int gDestroys;
+static int gFaces;
+static char gHandle;
+
+static TSHandle fakeCreate() {
+    gContexts++;
+    gCreates++;
+    return &gHandle;
+}
+
+static void fakeDestroy(TSHandle *handle) {
+    ASSERT_EQ((TSHandle)&gHandle, *handle);
+    gContexts--;
+    gDestroys++;
+    *handle = NULL;
+}
+
+static int fakeDetect(TSHandle handle, TSMakeupDataEx *) {
+    return (handle != NULL) ? gFaces : -1;
+}
+
+static int fakeFaceInfo(TSHandle, int, TSRect *face, TSRect *, TSRect *,
+        TSRect *) {
+    face->left = 10;
+    face->top = 20;
+    face->right = 110;
+    face->bottom = 120;
+    return 0;
+}
+
+static const QCameraTsFaceTracker::detector_ops_t kOps = {
+    fakeCreate, fakeDestroy, fakeDetect, fakeFaceInfo
+};
+
+class cam_ts_face_tracker_tests : public ::testing::Test {
+protected:
+    void SetUp() override {
+        gContexts = 0;
+        gCreates = 0;
+        gDestroys = 0;
+        gFaces = 1;
+    }
+};
+
+// Test that reset() releases the context and the cached face, and that a
+// new capture after the reset starts from a fresh context.
+TEST_F(cam_ts_face_tracker_tests, reset_between_captures) {
+    QCameraTsFaceTracker tracker(&kOps);
+    TSMakeupDataEx frame;
+    TSRect face;
+
+    ASSERT_TRUE(tracker.detect(&frame, face));
+    ASSERT_EQ(10, face.left);
+    ASSERT_NE((unsigned char *)NULL, tracker.getScratch(4096));
+    ASSERT_EQ(1, gContexts);
+
+    tracker.reset();
+    ASSERT_EQ(0, gContexts);
+    ASSERT_EQ(1, gDestroys);
+
+    gFaces = 0;
+    ASSERT_FALSE(tracker.detect(&frame, face));
+    ASSERT_EQ(-1, face.left);
+    ASSERT_EQ(2, gCreates);
+    ASSERT_EQ(1, gContexts);
+}
+
+// Test that reset() drops the reused face rectangle and restarts the
+// detection schedule, so the first frame after a reset is detected.
+TEST_F(cam_ts_face_tracker_tests, reset_restarts_schedule) {
+    QCameraTsFaceTracker tracker(&kOps);
+    TSMakeupDataEx frame;
+    TSRect face;
+
+    tracker.setInterval(4);
+    ASSERT_TRUE(tracker.track(&frame, face));
+    ASSERT_TRUE(tracker.track(&frame, face));
+    ASSERT_EQ(1u, tracker.getDetectCount());
+
+    tracker.reset();
+    ASSERT_EQ(4u, tracker.getInterval());
+    gFaces = 0;
+    ASSERT_FALSE(tracker.track(&frame, face));
+    ASSERT_EQ(2u, tracker.getDetectCount());
+    ASSERT_FALSE(tracker.track(&frame, face));
+    ASSERT_EQ(2u, tracker.getDetectCount());
+}
+
+// Test that resetting twice, or destroying a reset tracker, does not
+// release the context again.
+TEST_F(cam_ts_face_tracker_tests, reset_is_idempotent) {
+    {
+        QCameraTsFaceTracker tracker(&kOps);
+        TSMakeupDataEx frame;
+        TSRect face;
+        tracker.detect(&frame, face);
+        tracker.reset();
+        tracker.reset();
+    }
+    ASSERT_EQ(1, gCreates);
+    ASSERT_EQ(1, gDestroys);
+    ASSERT_EQ(0, gContexts);
+}
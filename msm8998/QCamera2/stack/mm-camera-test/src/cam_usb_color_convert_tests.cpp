@@ -0,0 +1,166 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_usb_color_convert_tests"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "QCameraUsbColorConvert.h"
+
+#define NS_PER_S 1000000000
+#define GUARD 0xAA
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_ITERATIONS 200
+
+static inline int64_t now_ns() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * NS_PER_S + ts.tv_nsec;
+}
+
+static void fill(std::vector<uint8_t>& buf) {
+    for (size_t i = 0; i < buf.size(); i++) {
+        buf[i] = (uint8_t)(i * 131 + 7);
+    }
+}
+
+// Frame with its own Y and VU planes, surrounded by guard bytes.
+struct Frame {
+    int width, height, yStride, vuStride;
+    std::vector<uint8_t> buf;
+
+    Frame(int w, int h, int ys, int vus) :
+            width(w), height(h), yStride(ys), vuStride(vus),
+            buf(64 + ys * h + 64 + vus * ((h + 1) / 2) + 64, GUARD) {}
+    uint8_t *y() { return &buf[64]; }
+    uint8_t *vu() { return &buf[64 + yStride * height + 64]; }
+};
+
+// Byte by byte conversion the kernels must match.
+static void reference(const uint8_t *src, int srcStride, Frame& f) {
+    for (int r = 0; r < f.height; r++) {
+        const uint8_t *s = src + r * srcStride;
+        for (int c = 0; c < f.width; c++) {
+            f.y()[r * f.yStride + c] = s[c * 2];
+        }
+        if (r & 1) {
+            continue;
+        }
+        uint8_t *vu = f.vu() + (r / 2) * f.vuStride;
+        int p = 0;
+        for (; 2 * p + 1 < f.width; p++) {
+            vu[2 * p] = s[4 * p + 3];
+            vu[2 * p + 1] = s[4 * p + 1];
+        }
+        if (f.width & 1) {
+            vu[2 * p] = (p > 0) ? s[4 * p - 1] : 128;
+            if (2 * p + 1 < f.vuStride) {
+                vu[2 * p + 1] = s[4 * p + 1];
+            }
+        }
+    }
+}
+
+static int convert(void *conv, const uint8_t *src, int srcStride, Frame& f) {
+    yuyv_conv_job_t job;
+    job.src = src;
+    job.srcStride = srcStride;
+    job.dstY = f.y();
+    job.dstYStride = f.yStride;
+    job.dstVU = f.vu();
+    job.dstVUStride = f.vuStride;
+    job.width = f.width;
+    job.height = f.height;
+    return yuyvConvToNV21(conv, &job);
+}
+
+// Test that every kernel and band split matches the byte by byte conversion,
+// including odd sizes with packed strides, and that nothing is written
+// outside the planes.
+TEST(cam_usb_color_convert_tests, bit_exact) {
+    const int widths[] = {1, 2, 3, 31, 32, 33, 63, 65, 640, 1281};
+    const int heights[] = {1, 2, 3, 127, 128, 129, 257, 480};
+
+    for (int threads = 1; threads <= YUYV_CONV_MAX_THREADS; threads++) {
+        void *conv = NULL;
+        ASSERT_EQ(0, yuyvConvInit(&conv, threads));
+        for (int w : widths) {
+            for (int h : heights) {
+                for (int pad = 0; pad <= 16; pad += 16) {
+                    int srcStride = w * 2 + pad;
+                    std::vector<uint8_t> src(srcStride * h);
+                    fill(src);
+
+                    Frame ref(w, h, w + pad, w + pad);
+                    Frame out(w, h, w + pad, w + pad);
+                    reference(src.data(), srcStride, ref);
+                    ASSERT_EQ(0, convert(conv, src.data(), srcStride, out));
+                    ASSERT_EQ(0, memcmp(ref.buf.data(), out.buf.data(),
+                            ref.buf.size()))
+                            << w << "x" << h << " pad " << pad
+                            << " threads " << threads;
+                }
+            }
+        }
+        ASSERT_EQ(0, yuyvConvDestroy(conv));
+    }
+}
+
+// Test that strides smaller than the frame width are rejected.
+TEST(cam_usb_color_convert_tests, invalid_stride) {
+    std::vector<uint8_t> src(64 * 2 * 4);
+    Frame f(64, 4, 63, 64);
+    ASSERT_EQ(-1, convert(NULL, src.data(), 64 * 2, f));
+    Frame g(64, 4, 64, 64);
+    ASSERT_EQ(-1, convert(NULL, src.data(), 64 * 2 - 2, g));
+}
+
+// Report conversion throughput of a 1080p frame per thread count.
+TEST(cam_usb_color_convert_tests, benchmark) {
+    std::vector<uint8_t> src(BENCH_WIDTH * 2 * BENCH_HEIGHT);
+    fill(src);
+
+    Frame ref(BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH, BENCH_WIDTH);
+    int64_t start = now_ns();
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        reference(src.data(), BENCH_WIDTH * 2, ref);
+    }
+    int64_t total = now_ns() - start;
+    double pixels = (double)BENCH_WIDTH * BENCH_HEIGHT * BENCH_ITERATIONS;
+    printf("%-10s %8.1f Mpix/s\n", "reference", pixels * 1000 / total);
+
+    for (int threads = 1; threads <= YUYV_CONV_MAX_THREADS; threads++) {
+        void *conv = NULL;
+        ASSERT_EQ(0, yuyvConvInit(&conv, threads));
+        Frame out(BENCH_WIDTH, BENCH_HEIGHT, BENCH_WIDTH, BENCH_WIDTH);
+        start = now_ns();
+        for (int i = 0; i < BENCH_ITERATIONS; i++) {
+            ASSERT_EQ(0, convert(conv, src.data(), BENCH_WIDTH * 2, out));
+        }
+        total = now_ns() - start;
+        ASSERT_EQ(0, memcmp(ref.buf.data(), out.buf.data(), ref.buf.size()));
+        printf("%d thread%s  %8.1f Mpix/s\n", threads,
+                (threads == 1) ? " " : "s", pixels * 1000 / total);
+        ASSERT_EQ(0, yuyvConvDestroy(conv));
+    }
+}
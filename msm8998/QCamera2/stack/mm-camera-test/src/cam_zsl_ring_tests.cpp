@@ -0,0 +1,153 @@
+/*
+ * Copyright 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "cam_zsl_ring_tests"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "mm_camera_zsl_ring.h"
+
+#define SIM_FRAMES 3000
+#define SIM_LOOK_BACK 4
+#define SIM_SHUTTER_INTERVAL 7
+// Motion above this blurs the capture enough to need a retake
+#define SIM_BLUR_LIMIT 40.0f
+
+static cam_zsl_quality_t frame(uint8_t aec_settled, uint8_t focus,
+        float sharpness, float motion) {
+    cam_zsl_quality_t q;
+    q.valid = 1;
+    q.aec_settled = aec_settled;
+    q.focus = focus;
+    q.sharpness = sharpness;
+    q.motion = motion;
+    return q;
+}
+
+// Equal frames keep the position based pick.
+TEST(cam_zsl_ring_tests, ties_pick_oldest) {
+    std::vector<cam_zsl_quality_t> q(4,
+            frame(1, CAM_ZSL_FOCUS_FOCUSED, 100.0f, 5.0f));
+    EXPECT_EQ(0, cam_zsl_select(q.data(), (uint32_t)q.size()));
+    EXPECT_EQ(-1, cam_zsl_select(q.data(), 0));
+}
+
+TEST(cam_zsl_ring_tests, prefers_settled_exposure) {
+    cam_zsl_quality_t q[3] = {
+        frame(0, CAM_ZSL_FOCUS_FOCUSED, 120.0f, 0.0f),
+        frame(0, CAM_ZSL_FOCUS_FOCUSED, 120.0f, 0.0f),
+        frame(1, CAM_ZSL_FOCUS_FOCUSED, 80.0f, 0.0f),
+    };
+    EXPECT_EQ(2, cam_zsl_select(q, 3));
+}
+
+TEST(cam_zsl_ring_tests, prefers_focused_over_scanning) {
+    cam_zsl_quality_t q[3] = {
+        frame(1, CAM_ZSL_FOCUS_SCANNING, 100.0f, 0.0f),
+        frame(1, CAM_ZSL_FOCUS_FOCUSED, 100.0f, 0.0f),
+        frame(1, CAM_ZSL_FOCUS_FAILED, 100.0f, 0.0f),
+    };
+    EXPECT_EQ(1, cam_zsl_select(q, 3));
+    q[1].focus = CAM_ZSL_FOCUS_SCANNING;
+    EXPECT_EQ(2, cam_zsl_select(q, 3));
+}
+
+TEST(cam_zsl_ring_tests, prefers_sharp_and_still) {
+    cam_zsl_quality_t q[3] = {
+        frame(1, CAM_ZSL_FOCUS_FOCUSED, 50.0f, 10.0f),
+        frame(1, CAM_ZSL_FOCUS_FOCUSED, 100.0f, 10.0f),
+        frame(1, CAM_ZSL_FOCUS_FOCUSED, 100.0f, 60.0f),
+    };
+    EXPECT_EQ(1, cam_zsl_select(q, 3));
+}
+
+// A frame without metadata is never picked over one that has it.
+TEST(cam_zsl_ring_tests, missing_metadata_scores_zero) {
+    cam_zsl_quality_t q[2];
+    q[0].valid = 0;
+    q[1] = frame(0, CAM_ZSL_FOCUS_SCANNING, 0.0f, 100.0f);
+    EXPECT_EQ(0u, cam_zsl_score(&q[0], 100.0f, 100.0f));
+    EXPECT_EQ(1, cam_zsl_select(q, 2));
+}
+
+TEST(cam_zsl_ring_tests, budget_depth) {
+    const uint64_t mb = 1024 * 1024;
+    // 12 MP snapshot plus 1080p preview, YUV 4:2:0
+    const uint64_t frame_bytes = (4000ULL * 3000 + 1920ULL * 1080) * 3 / 2;
+    EXPECT_EQ(4u, cam_zsl_budget_depth(100 * mb, frame_bytes, 8));
+    EXPECT_EQ(8u, cam_zsl_budget_depth(1024 * mb, frame_bytes, 8));
+    EXPECT_EQ(1u, cam_zsl_budget_depth(1 * mb, frame_bytes, 8));
+    EXPECT_EQ(8u, cam_zsl_budget_depth(100 * mb, 0, 8));
+}
+
+// Synthetic metadata stream with hand shake bursts and AF hunting. Compare
+// the frame picked by position with the best scored one, counting captures
+// that come out blurred, out of focus or badly exposed.
+TEST(cam_zsl_ring_tests, synthetic_stream_retakes) {
+    std::vector<cam_zsl_quality_t> stream;
+    unsigned int seed = 1;
+    float shake = 0.0f;
+    int hunting = 0;
+    int exposure_change = 0;
+
+    for (int i = 0; i < SIM_FRAMES; i++) {
+        if ((rand_r(&seed) % 20) == 0) {
+            shake = 60.0f + (float)(rand_r(&seed) % 60);
+        }
+        if ((hunting == 0) && ((rand_r(&seed) % 40) == 0)) {
+            hunting = 3 + (int)(rand_r(&seed) % 4);
+        }
+        if ((exposure_change == 0) && ((rand_r(&seed) % 60) == 0)) {
+            exposure_change = 2 + (int)(rand_r(&seed) % 3);
+        }
+        float motion = shake + (float)(rand_r(&seed) % 10);
+        uint8_t focus = hunting ? CAM_ZSL_FOCUS_SCANNING : CAM_ZSL_FOCUS_FOCUSED;
+        float sharpness = (hunting ? 40.0f : 100.0f) - motion / 4.0f;
+        stream.push_back(frame(exposure_change == 0, focus, sharpness, motion));
+        shake *= 0.6f;
+        if (hunting) {
+            hunting--;
+        }
+        if (exposure_change) {
+            exposure_change--;
+        }
+    }
+
+    int captures = 0, positional_bad = 0, selected_bad = 0;
+    for (int i = SIM_LOOK_BACK; i < SIM_FRAMES; i += SIM_SHUTTER_INTERVAL) {
+        const cam_zsl_quality_t *window = &stream[i - SIM_LOOK_BACK];
+        int32_t best = cam_zsl_select(window, SIM_LOOK_BACK);
+        ASSERT_GE(best, 0);
+        const cam_zsl_quality_t &pos = window[0];
+        const cam_zsl_quality_t &sel = window[best];
+        positional_bad += !pos.aec_settled || (pos.focus != CAM_ZSL_FOCUS_FOCUSED)
+                || (pos.motion > SIM_BLUR_LIMIT);
+        selected_bad += !sel.aec_settled || (sel.focus != CAM_ZSL_FOCUS_FOCUSED)
+                || (sel.motion > SIM_BLUR_LIMIT);
+        captures++;
+    }
+
+    EXPECT_LT(selected_bad, positional_bad);
+    printf("%d captures, look back %d: retakes by position %d (%.1f%%), "
+            "by score %d (%.1f%%)\n", captures, SIM_LOOK_BACK,
+            positional_bad, 100.0 * positional_bad / captures,
+            selected_bad, 100.0 * selected_bad / captures);
+}
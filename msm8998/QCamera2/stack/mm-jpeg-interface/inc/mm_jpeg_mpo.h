@@ -39,6 +39,15 @@
 
 extern int mm_jpeg_mpo_compose(mm_jpeg_mpo_info_t *mpo_info);
 
+extern int mm_jpeg_mpo_compose_sg(mm_jpeg_mpo_info_t *mpo_info,
+    mm_jpeg_mpo_sg_t *sg);
+
+extern int mm_jpeg_mpo_flatten_sg(mm_jpeg_mpo_sg_t *sg, uint8_t *out_buf,
+    size_t out_buf_size);
+
+extern int mm_jpeg_mpo_build_marker_index(uint8_t *buffer_addr,
+    size_t buffer_size, mm_jpeg_marker_index_t *p_idx);
+
 extern int get_mpo_size(mm_jpeg_output_t jpeg_buffer[MM_JPEG_MAX_MPO_IMAGES],
     int num_of_images);
 
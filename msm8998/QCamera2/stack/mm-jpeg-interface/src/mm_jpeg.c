@@ -45,6 +45,7 @@
 #include "mm_jpeg_interface.h"
 #include "mm_jpeg.h"
 #include "mm_jpeg_inlines.h"
+#include "mm_jpeg_mpo.h"
 #ifdef LIB2D_ROTATION_ENABLE
 #include "mm_lib2d.h"
 #endif
@@ -3546,6 +3547,7 @@ OMX_ERRORTYPE mm_jpeg_fbd(OMX_HANDLETYPE hComponent,
   OMX_ERRORTYPE ret = OMX_ErrorNone;
   mm_jpeg_job_session_t *p_session = (mm_jpeg_job_session_t *) pAppData;
   mm_jpeg_output_t output_buf;
+  uint8_t *p_bitstream = NULL;
   LOGI("count %d ", p_session->fbd_count);
   LOGI("KPI Perf] : PROFILE_JPEG_FBD");
 
@@ -3569,9 +3571,21 @@ OMX_ERRORTYPE mm_jpeg_fbd(OMX_HANDLETYPE hComponent,
   if (NULL != p_session->params.jpeg_cb) {
 
     p_session->job_status = JPEG_JOB_STATUS_DONE;
+    memset(&output_buf, 0, sizeof(output_buf));
     output_buf.buf_filled_len = (uint32_t)pBuffer->nFilledLen;
     output_buf.buf_vaddr = pBuffer->pBuffer;
     output_buf.fd = -1;
+
+    /* index the markers while the header is hot so that consumers
+     * like the MPO composer need not scan the bitstream */
+    p_bitstream = pBuffer->pBuffer;
+    if (p_session->params.get_memory && p_bitstream) {
+      p_bitstream = (uint8_t *)((omx_jpeg_ouput_buf_t *)p_bitstream)->vaddr;
+    }
+    if (p_bitstream && mm_jpeg_mpo_build_marker_index(p_bitstream,
+      output_buf.buf_filled_len, &output_buf.marker_idx)) {
+      LOGW("Marker index not available for JobID %u", p_session->jobId);
+    }
     LOGH("send jpeg callback %d buf 0x%p len %u JobID %u",
       p_session->job_status, pBuffer->pBuffer,
       (unsigned int)pBuffer->nFilledLen, p_session->jobId);
@@ -306,6 +306,65 @@ static int32_t mm_jpeg_intf_compose_mpo(mm_jpeg_mpo_info_t *mpo_info)
   return rc;
 }
 
+/** mm_jpeg_intf_compose_mpo_sg:
+ *
+ *  Arguments:
+ *    @mpo_info : MPO Information
+ *    @sg : scatter-gather list to be filled
+ *
+ *  Return:
+ *       0 success, failure otherwise
+ *
+ *  Description:
+ *       Compose MPO image from jpeg images as scatter-gather list
+ *       over the jpeg buffers
+ *
+ **/
+static int32_t mm_jpeg_intf_compose_mpo_sg(mm_jpeg_mpo_info_t *mpo_info,
+  mm_jpeg_mpo_sg_t *sg)
+{
+  int32_t rc = -1;
+  if (!mpo_info || !sg) {
+    LOGE("Invalid input");
+    return rc;
+  }
+
+  if (mpo_info->num_of_images > MM_JPEG_MAX_MPO_IMAGES) {
+    LOGE("Num of images exceeds max supported images in MPO");
+    return rc;
+  }
+  rc = mm_jpeg_mpo_compose_sg(mpo_info, sg);
+
+  return rc;
+}
+
+/** mm_jpeg_intf_flatten_mpo_sg:
+ *
+ *  Arguments:
+ *    @sg : scatter-gather MPO
+ *    @out_buf : output buffer
+ *    @out_buf_size : size of the output buffer
+ *
+ *  Return:
+ *       0 success, failure otherwise
+ *
+ *  Description:
+ *       Copy scatter-gather MPO into a contiguous buffer
+ *
+ **/
+static int32_t mm_jpeg_intf_flatten_mpo_sg(mm_jpeg_mpo_sg_t *sg,
+  uint8_t *out_buf, size_t out_buf_size)
+{
+  int32_t rc = -1;
+  if (!sg || !out_buf) {
+    LOGE("Invalid input");
+    return rc;
+  }
+  rc = mm_jpeg_mpo_flatten_sg(sg, out_buf, out_buf_size);
+
+  return rc;
+}
+
 /** jpeg_open:
  *
  *  Arguments:
@@ -391,6 +450,8 @@ uint32_t jpeg_open(mm_jpeg_ops_t *ops, mm_jpeg_mpo_ops_t *mpo_ops,
     }
     if (NULL != mpo_ops) {
       mpo_ops->compose_mpo = mm_jpeg_intf_compose_mpo;
+      mpo_ops->compose_mpo_sg = mm_jpeg_intf_compose_mpo_sg;
+      mpo_ops->flatten_mpo_sg = mm_jpeg_intf_flatten_mpo_sg;
     }
   } else {
     /* failed new client */
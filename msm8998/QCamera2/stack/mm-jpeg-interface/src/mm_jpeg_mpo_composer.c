@@ -39,8 +39,13 @@
 #define M_APP0    0xe0
 #define M_APP1    0xe1
 #define M_APP2    0xe2
+#define M_APP15   0xef
 #define M_EOI     0xd9
 #define M_SOI     0xd8
+#define M_SOS     0xda
+#define M_TEM     0x01
+#define M_RST0    0xd0
+#define M_RST7    0xd7
 
 /** READ_LONG:
  *  @b: Buffer start addr
@@ -224,53 +229,178 @@ uint8_t *mm_jpeg_mpo_get_mp_header(uint8_t *app2_start_offset)
   return mp_headr_start_offset;
 }
 
-/** mm_jpeg_mpo_update_header
+/** mm_jpeg_mpo_build_marker_index
  *
  *  Arguments:
+ *    @buffer_addr: Jpeg image start addr
+ *    @buffer_size: Size of the image
+ *    @p_idx: Marker index to be filled
+ *
+ *  Return:
+ *       0 - Success
+ *      -1 - otherwise
+ *
+ *  Description:
+ *       Build the marker index of an encoded image. Only the
+ *       header segments up to SOS are walked, using their length
+ *       fields, and EOI is expected at the end of the image. The
+ *       entropy coded data is never scanned.
+ *
+ **/
+int mm_jpeg_mpo_build_marker_index(uint8_t *buffer_addr, size_t buffer_size,
+  mm_jpeg_marker_index_t *p_idx)
+{
+  uint32_t offset = 2;
+  uint16_t seg_size = 0;
+  uint8_t marker;
+
+  if (!buffer_addr || !p_idx) {
+    return -1;
+  }
+  memset(p_idx, 0, sizeof(*p_idx));
+
+  if ((buffer_size < 4) || (buffer_addr[0] != 0xFF) ||
+    (buffer_addr[1] != M_SOI)) {
+    LOGE("Invalid jpeg stream, SOI not found");
+    return -1;
+  }
+
+  while (offset + 1 < buffer_size) {
+    if (buffer_addr[offset] != 0xFF) {
+      LOGE("Marker expected at offset %u", offset);
+      return -1;
+    }
+    marker = buffer_addr[offset + 1];
+    if (marker == 0xFF) {
+      //Fill byte, markers may be preceded by any number of them
+      offset++;
+      continue;
+    }
+    offset += 2;
+    if ((marker == M_TEM) || ((marker >= M_RST0) && (marker <= M_RST7))) {
+      //Standalone markers without length field
+      continue;
+    }
+    if (marker == M_SOS) {
+      p_idx->sos_offset = offset - 2;
+      break;
+    }
+    if (offset + 1 >= buffer_size) {
+      break;
+    }
+    seg_size = READ_SHORT(buffer_addr, offset);
+    if (seg_size < 2) {
+      LOGE("Invalid segment size %d for marker %x", seg_size, marker);
+      return -1;
+    }
+    if ((marker >= M_APP0) && (marker <= M_APP15) &&
+      (p_idx->app_offset[marker - M_APP0] == 0)) {
+      p_idx->app_offset[marker - M_APP0] = offset;
+      p_idx->app_size[marker - M_APP0] = seg_size;
+    }
+    offset += seg_size;
+  }
+
+  if (p_idx->sos_offset == 0) {
+    LOGE("SOS not found");
+    return -1;
+  }
+
+  if ((buffer_addr[buffer_size - 2] == 0xFF) &&
+    (buffer_addr[buffer_size - 1] == M_EOI)) {
+    p_idx->eoi_offset = (uint32_t)(buffer_size - 2);
+  } else {
+    LOGW("EOI not at the end of the stream");
+  }
+
+  p_idx->valid = TRUE;
+  return 0;
+}
+
+/** mm_jpeg_mpo_get_app2_offset
+ *
+ *  Arguments:
+ *    @image: Jpeg image
+ *    @p_size: Size of the App2 segment, may be NULL
+ *
+ *  Return:
+ *       Offset of the App2 marker length field, 0 if not found
+ *
+ *  Description:
+ *       Gets the App2 offset from the marker index of the image,
+ *       falls back to parsing the image if it has no index.
+ *
+ **/
+static uint32_t mm_jpeg_mpo_get_app2_offset(mm_jpeg_output_t *image,
+  uint16_t *p_size)
+{
+  uint8_t *app2_start_off_addr = NULL;
+  uint32_t app2_offset = 0;
+  uint16_t app2_size = 0;
+
+  if (image->marker_idx.valid) {
+    app2_offset = image->marker_idx.app_offset[M_APP2 - M_APP0];
+    app2_size = image->marker_idx.app_size[M_APP2 - M_APP0];
+  } else {
+    app2_start_off_addr = mm_jpeg_mpo_get_app_marker(image->buf_vaddr,
+      (int)image->buf_filled_len, M_APP2);
+    if (app2_start_off_addr) {
+      app2_offset = (uint32_t)(app2_start_off_addr - image->buf_vaddr);
+      app2_size = READ_SHORT(app2_start_off_addr, 0);
+    }
+  }
+
+  if (p_size) {
+    *p_size = app2_size;
+  }
+  return app2_offset;
+}
+
+/** mm_jpeg_mpo_write_mp_index
+ *
+ *  Arguments:
+ *    @app2_addr: Addr of the App2 length field to be updated
+ *    @app2_avail: Number of writable bytes from app2_addr
+ *    @app2_offset: Offset of app2_addr in the composed MPO
  *    @mpo_info: MPO Info
  *
  *  Return:
  *       0 - Success
- *       -1 - otherwise
+ *      -1 - otherwise
  *
  *  Description:
  *      Update the MP Index IFD of the first image with info
  *      about about all other images.
  *
  **/
-int mm_jpeg_mpo_update_header(mm_jpeg_mpo_info_t *mpo_info)
+static int mm_jpeg_mpo_write_mp_index(uint8_t *app2_addr, uint32_t app2_avail,
+  uint32_t app2_offset, mm_jpeg_mpo_info_t *mpo_info)
 {
-  uint8_t *app2_start_off_addr = NULL, *mp_headr_start_off_addr = NULL;
-  uint32_t mp_index_ifd_offset = 0, current_offset = 0, mp_entry_val_offset = 0;
-  uint8_t *aux_start_addr = NULL;
+  uint8_t *mp_headr_start_off_addr = NULL;
+  uint32_t current_offset = 0, mp_entry_val_offset = 0;
+  uint32_t mp_headr_offset = 0, aux_offset = 0;
   uint8_t overflow_flag = 0;
   int i = 0, rc = -1;
   uint32_t endianess = MPO_LITTLE_ENDIAN, offset_to_nxt_ifd = 8;
   uint16_t ifd_tag_count = 0;
 
-  //Get the addr of the App Marker
-  app2_start_off_addr = mm_jpeg_mpo_get_app_marker(
-    mpo_info->output_buff.buf_vaddr, mpo_info->primary_image.buf_filled_len, M_APP2);
-  if (!app2_start_off_addr) {
-    LOGE("Cannot find App2 marker. MPO composition failed" );
-    return rc;
-  }
-  LOGD("app2_start_off_addr %p = %x",
-    app2_start_off_addr, *app2_start_off_addr);
-
   //Get the addr of the MP Headr start offset.
   //All offsets in the MP header are wrt to this addr
-  mp_headr_start_off_addr = mm_jpeg_mpo_get_mp_header(app2_start_off_addr);
+  mp_headr_start_off_addr = mm_jpeg_mpo_get_mp_header(app2_addr);
   if (!mp_headr_start_off_addr) {
     LOGE("mp headr start offset is NULL. MPO composition failed" );
     return rc;
   }
-  LOGD("mp_headr_start_off_addr %x",
-    *mp_headr_start_off_addr);
+  current_offset = (uint32_t)(mp_headr_start_off_addr - app2_addr);
+  mp_headr_offset = app2_offset + current_offset;
 
-  current_offset = mp_headr_start_off_addr - mpo_info->output_buff.buf_vaddr;
+  if (current_offset + MP_ENDIAN_BYTES +
+    MP_HEADER_OFFSET_TO_FIRST_IFD_BYTES > app2_avail) {
+    LOGE("App2 segment too small. MPO composition failed");
+    return rc;
+  }
 
-  endianess = READ_LONG(mpo_info->output_buff.buf_vaddr, current_offset);
+  endianess = READ_LONG(app2_addr, current_offset);
   LOGD("Endianess %d", endianess);
 
   //Add offset to first ifd
@@ -278,22 +408,22 @@ int mm_jpeg_mpo_update_header(mm_jpeg_mpo_info_t *mpo_info)
 
   //Read the value to get MP Index IFD.
   if (endianess == MPO_LITTLE_ENDIAN) {
-    offset_to_nxt_ifd = READ_LONG_LITTLE(mpo_info->output_buff.buf_vaddr,
-      current_offset);
+    offset_to_nxt_ifd = READ_LONG_LITTLE(app2_addr, current_offset);
   } else {
-    offset_to_nxt_ifd = READ_LONG(mpo_info->output_buff.buf_vaddr,
-      current_offset);
+    offset_to_nxt_ifd = READ_LONG(app2_addr, current_offset);
   }
   LOGD("offset_to_nxt_ifd %d", offset_to_nxt_ifd);
 
-  current_offset = ((mp_headr_start_off_addr + offset_to_nxt_ifd) -
-    mpo_info->output_buff.buf_vaddr);
-  mp_index_ifd_offset = current_offset;
-  LOGD("mp_index_ifd_offset %d",
-    mp_index_ifd_offset);
+  current_offset = (uint32_t)(mp_headr_start_off_addr - app2_addr) +
+    offset_to_nxt_ifd;
+  LOGD("mp_index_ifd_offset %d", current_offset);
+  if (current_offset + MP_INDEX_COUNT_BYTES > app2_avail) {
+    LOGE("MP index IFD out of bounds. MPO composition failed");
+    return rc;
+  }
 
   //Traverse to MP Entry value
-  ifd_tag_count = READ_SHORT(mpo_info->output_buff.buf_vaddr, current_offset);
+  ifd_tag_count = READ_SHORT(app2_addr, current_offset);
   LOGD("Tag count in MP entry %d", ifd_tag_count);
   current_offset += MP_INDEX_COUNT_BYTES;
 
@@ -303,23 +433,19 @@ int mm_jpeg_mpo_update_header(mm_jpeg_mpo_info_t *mpo_info)
   current_offset += MP_INDEX_OFFSET_OF_NEXT_IFD_BYTES;
 
   mp_entry_val_offset = current_offset;
-  LOGD("MP Entry value offset %d",
-    mp_entry_val_offset);
+  LOGD("MP Entry value offset %d", mp_entry_val_offset);
 
   //Update image size for primary image
   current_offset += MP_INDEX_ENTRY_INDIVIDUAL_IMAGE_ATTRIBUTE_BYTES;
   if (endianess == MPO_LITTLE_ENDIAN) {
-    mm_jpeg_mpo_write_long_little_endian(mpo_info->output_buff.buf_vaddr,
-      current_offset, mpo_info->output_buff_size,
-      mpo_info->primary_image.buf_filled_len, &overflow_flag);
+    mm_jpeg_mpo_write_long_little_endian(app2_addr, current_offset,
+      app2_avail, mpo_info->primary_image.buf_filled_len, &overflow_flag);
   } else {
-    mm_jpeg_mpo_write_long(mpo_info->output_buff.buf_vaddr,
-      current_offset, mpo_info->output_buff_size,
-      mpo_info->primary_image.buf_filled_len, &overflow_flag);
+    mm_jpeg_mpo_write_long(app2_addr, current_offset,
+      app2_avail, mpo_info->primary_image.buf_filled_len, &overflow_flag);
   }
 
-  aux_start_addr = mpo_info->output_buff.buf_vaddr +
-    mpo_info->primary_image.buf_filled_len;
+  aux_offset = mpo_info->primary_image.buf_filled_len;
 
   for (i = 0; i < mpo_info->num_of_images - 1; i++) {
     //Go to MP Entry val for each image
@@ -329,27 +455,23 @@ int mm_jpeg_mpo_update_header(mm_jpeg_mpo_info_t *mpo_info)
     //Update image size
     current_offset += MP_INDEX_ENTRY_INDIVIDUAL_IMAGE_ATTRIBUTE_BYTES;
     if (endianess == MPO_LITTLE_ENDIAN) {
-      mm_jpeg_mpo_write_long_little_endian(mpo_info->output_buff.buf_vaddr,
-        current_offset, mpo_info->output_buff_size,
-        mpo_info->aux_images[i].buf_filled_len, &overflow_flag);
+      mm_jpeg_mpo_write_long_little_endian(app2_addr, current_offset,
+        app2_avail, mpo_info->aux_images[i].buf_filled_len, &overflow_flag);
     } else {
-      mm_jpeg_mpo_write_long(mpo_info->output_buff.buf_vaddr,
-        current_offset, mpo_info->output_buff_size,
-        mpo_info->aux_images[i].buf_filled_len, &overflow_flag);
+      mm_jpeg_mpo_write_long(app2_addr, current_offset,
+        app2_avail, mpo_info->aux_images[i].buf_filled_len, &overflow_flag);
     }
-    LOGD("aux[start_addr %x", *aux_start_addr);
+    LOGD("aux offset %d", aux_offset);
     //Update the offset
     current_offset += MP_INDEX_ENTRY_INDIVIDUAL_IMAGE_SIZE_BYTES;
     if (endianess == MPO_LITTLE_ENDIAN) {
-      mm_jpeg_mpo_write_long_little_endian(mpo_info->output_buff.buf_vaddr,
-        current_offset, mpo_info->output_buff_size,
-        aux_start_addr - mp_headr_start_off_addr, &overflow_flag);
+      mm_jpeg_mpo_write_long_little_endian(app2_addr, current_offset,
+        app2_avail, aux_offset - mp_headr_offset, &overflow_flag);
     } else {
-      mm_jpeg_mpo_write_long(mpo_info->output_buff.buf_vaddr,
-        current_offset, mpo_info->output_buff_size,
-        aux_start_addr - mp_headr_start_off_addr, &overflow_flag);
+      mm_jpeg_mpo_write_long(app2_addr, current_offset,
+        app2_avail, aux_offset - mp_headr_offset, &overflow_flag);
     }
-    aux_start_addr += mpo_info->aux_images[i].buf_filled_len;
+    aux_offset += mpo_info->aux_images[i].buf_filled_len;
   }
   if (!overflow_flag) {
     rc = 0;
@@ -357,6 +479,38 @@ int mm_jpeg_mpo_update_header(mm_jpeg_mpo_info_t *mpo_info)
   return rc;
 }
 
+/** mm_jpeg_mpo_update_header
+ *
+ *  Arguments:
+ *    @mpo_info: MPO Info
+ *
+ *  Return:
+ *       0 - Success
+ *       -1 - otherwise
+ *
+ *  Description:
+ *      Update the MP Index IFD of the first image in the output
+ *      buffer with info about about all other images.
+ *
+ **/
+int mm_jpeg_mpo_update_header(mm_jpeg_mpo_info_t *mpo_info)
+{
+  uint32_t app2_offset = 0;
+
+  //Get the offset of the App Marker
+  app2_offset = mm_jpeg_mpo_get_app2_offset(&mpo_info->primary_image, NULL);
+  if (!app2_offset || app2_offset >= mpo_info->output_buff_size) {
+    LOGE("Cannot find App2 marker. MPO composition failed" );
+    return -1;
+  }
+  LOGD("app2_offset %d", app2_offset);
+
+  return mm_jpeg_mpo_write_mp_index(
+    mpo_info->output_buff.buf_vaddr + app2_offset,
+    (uint32_t)(mpo_info->output_buff_size - app2_offset),
+    app2_offset, mpo_info);
+}
+
 /** mm_jpeg_mpo_compose
  *
  *  Arguments:
@@ -412,3 +566,110 @@ int mm_jpeg_mpo_compose(mm_jpeg_mpo_info_t *mpo_info)
 
   return rc;
 }
+
+/** mm_jpeg_mpo_compose_sg
+ *
+ *  Arguments:
+ *    @mpo_info: MPO Info, output buffer is not used
+ *    @sg: Scatter-gather list to be filled
+ *
+ *  Return:
+ *       0 - Success
+ *      -1 - otherwise
+ *
+ *  Description:
+ *      Compose MPO image from multiple JPEG images as a
+ *      scatter-gather list referring to the source images. Only
+ *      the App2 segment of the primary image is copied and
+ *      patched, the source images are not modified.
+ *
+ **/
+int mm_jpeg_mpo_compose_sg(mm_jpeg_mpo_info_t *mpo_info, mm_jpeg_mpo_sg_t *sg)
+{
+  uint32_t app2_offset = 0, app2_len = 0;
+  uint16_t app2_size = 0;
+  int i = 0, rc = -1;
+
+  sg->num_entries = 0;
+  sg->total_len = 0;
+
+  app2_offset = mm_jpeg_mpo_get_app2_offset(&mpo_info->primary_image,
+    &app2_size);
+  app2_len = app2_size;
+  if (!app2_offset ||
+    (app2_offset + app2_len > mpo_info->primary_image.buf_filled_len)) {
+    LOGE("Cannot find App2 marker. MPO composition failed");
+    return rc;
+  }
+  if (app2_len > MM_JPEG_MPO_MAX_MP_HDR_SIZE) {
+    LOGE("App2 segment of %d bytes too large. MPO composition failed",
+      app2_len);
+    return rc;
+  }
+
+  memcpy(sg->mp_hdr, mpo_info->primary_image.buf_vaddr + app2_offset,
+    app2_len);
+  rc = mm_jpeg_mpo_write_mp_index(sg->mp_hdr, app2_len, app2_offset,
+    mpo_info);
+  if (rc) {
+    LOGE("MP index update failed");
+    return rc;
+  }
+
+  //Primary image up to and including the App2 marker
+  sg->entries[sg->num_entries].buf_vaddr = mpo_info->primary_image.buf_vaddr;
+  sg->entries[sg->num_entries++].len = app2_offset;
+  //Patched App2 segment
+  sg->entries[sg->num_entries].buf_vaddr = sg->mp_hdr;
+  sg->entries[sg->num_entries++].len = app2_len;
+  //Rest of the primary image
+  sg->entries[sg->num_entries].buf_vaddr =
+    mpo_info->primary_image.buf_vaddr + app2_offset + app2_len;
+  sg->entries[sg->num_entries++].len =
+    mpo_info->primary_image.buf_filled_len - app2_offset - app2_len;
+  sg->total_len = mpo_info->primary_image.buf_filled_len;
+
+  //Aux images as is
+  for (i = 0; i < mpo_info->num_of_images - 1; i++) {
+    sg->entries[sg->num_entries].buf_vaddr = mpo_info->aux_images[i].buf_vaddr;
+    sg->entries[sg->num_entries++].len = mpo_info->aux_images[i].buf_filled_len;
+    sg->total_len += mpo_info->aux_images[i].buf_filled_len;
+  }
+
+  return 0;
+}
+
+/** mm_jpeg_mpo_flatten_sg
+ *
+ *  Arguments:
+ *    @sg: Scatter-gather MPO
+ *    @out_buf: Output buffer
+ *    @out_buf_size: Size of the output buffer
+ *
+ *  Return:
+ *       0 - Success
+ *      -1 - otherwise
+ *
+ *  Description:
+ *      Copy the scatter-gather MPO into a contiguous buffer, for
+ *      consumers which need the MPO in a single buffer.
+ *
+ **/
+int mm_jpeg_mpo_flatten_sg(mm_jpeg_mpo_sg_t *sg, uint8_t *out_buf,
+  size_t out_buf_size)
+{
+  uint32_t i = 0;
+  size_t offset = 0;
+
+  if (sg->total_len > out_buf_size) {
+    LOGE("O/P buffer not large enough. MPO flatten failed");
+    return -1;
+  }
+
+  for (i = 0; i < sg->num_entries; i++) {
+    memcpy(out_buf + offset, sg->entries[i].buf_vaddr, sg->entries[i].len);
+    offset += sg->entries[i].len;
+  }
+
+  return 0;
+}
@@ -973,6 +973,7 @@ OMX_ERRORTYPE mm_jpegdec_fbd(OMX_HANDLETYPE hComponent,
   p_session->fbd_count++;
   if (NULL != p_session->dec_params.jpeg_cb) {
     p_session->job_status = JPEG_JOB_STATUS_DONE;
+    memset(&output_buf, 0, sizeof(output_buf));
     output_buf.buf_filled_len = (uint32_t)pBuffer->nFilledLen;
     output_buf.buf_vaddr = pBuffer->pBuffer;
     output_buf.fd = -1;
@@ -0,0 +1,513 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// System dependencies
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/Errors.h>
+
+// Camera dependencies
+#include "QCameraCapsCache.h"
+
+using namespace android;
+
+namespace qcamera {
+
+#define CAPS_CACHE_ALIGN(x) (((x) + 7) & ~((uint64_t)7))
+
+/*===========================================================================
+ * FUNCTION   : QCameraCapsCache constructor
+ *
+ * DESCRIPTION: Create an empty cache.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraCapsCache::QCameraCapsCache() :
+        mKey(0),
+        mMap(NULL),
+        mMapSize(0),
+        mValid(false),
+        mNumEntries(0)
+{
+    memset(mPath, 0, sizeof(mPath));
+    memset(mEntries, 0, sizeof(mEntries));
+    pthread_mutex_init(&mLock, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraCapsCache
+ *
+ * DESCRIPTION: Release the mapping and the stored blobs.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraCapsCache::~QCameraCapsCache()
+{
+    close();
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : open
+ *
+ * DESCRIPTION: Map the cache file and validate it against the key. An
+ *              invalid or missing file leaves an empty cache that store()
+ *              can fill. Only a regular file owned by this process and not
+ *              writable by others is used, a symlink is not followed.
+ *
+ * PARAMETERS :
+ *   @path : cache file path
+ *   @key  : fingerprint of the software and configuration
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR       -- file mapped and valid
+ *              NAME_NOT_FOUND -- no usable file, cache is empty
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraCapsCache::open(const char *path, uint64_t key)
+{
+    if ((path == NULL) || (strlen(path) + 5 > sizeof(mPath))) {
+        return BAD_VALUE;
+    }
+
+    close();
+
+    pthread_mutex_lock(&mLock);
+    strlcpy(mPath, path, sizeof(mPath));
+    mKey = key;
+
+    int32_t rc = NAME_NOT_FOUND;
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (fd >= 0) {
+        struct stat st;
+        if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) &&
+                (st.st_uid == geteuid()) &&
+                ((st.st_mode & (S_IWGRP | S_IWOTH)) == 0) &&
+                ((size_t)st.st_size >= sizeof(caps_cache_header_t))) {
+            void *pMap = mmap(NULL, (size_t)st.st_size, PROT_READ,
+                    MAP_PRIVATE, fd, 0);
+            if (pMap != MAP_FAILED) {
+                mMap = pMap;
+                mMapSize = (size_t)st.st_size;
+                if (validateLocked((const uint8_t *)pMap, mMapSize) ==
+                        NO_ERROR) {
+                    mValid = true;
+                    rc = NO_ERROR;
+                } else {
+                    munmap(mMap, mMapSize);
+                    mMap = NULL;
+                    mMapSize = 0;
+                    mNumEntries = 0;
+                }
+            }
+        }
+        ::close(fd);
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : close
+ *
+ * DESCRIPTION: Drop the mapping and every blob. Pointers returned by
+ *              lookup() are invalid afterwards.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraCapsCache::close()
+{
+    pthread_mutex_lock(&mLock);
+    for (uint32_t i = 0; i < mNumEntries; i++) {
+        if (mEntries[i].stored) {
+            free((void *)mEntries[i].pData);
+        }
+    }
+    memset(mEntries, 0, sizeof(mEntries));
+    mNumEntries = 0;
+    if (mMap != NULL) {
+        munmap(mMap, mMapSize);
+        mMap = NULL;
+        mMapSize = 0;
+    }
+    mValid = false;
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : isValid
+ *
+ * DESCRIPTION: Whether open() found a valid cache file.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : true if the file matched the key and its checksum
+ *==========================================================================*/
+bool QCameraCapsCache::isValid()
+{
+    pthread_mutex_lock(&mLock);
+    bool valid = mValid;
+    pthread_mutex_unlock(&mLock);
+    return valid;
+}
+
+/*===========================================================================
+ * FUNCTION   : lookup
+ *
+ * DESCRIPTION: Find the blob of a camera section.
+ *
+ * PARAMETERS :
+ *   @cameraId : camera id
+ *   @section  : caller defined section
+ *   @identity : identity of the sensor, must match the stored one
+ *   @ppData   : blob, valid until close()
+ *   @pSize    : blob size
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR       -- found
+ *              NAME_NOT_FOUND -- no blob for this camera and identity
+ *==========================================================================*/
+int32_t QCameraCapsCache::lookup(uint32_t cameraId, uint32_t section,
+        uint64_t identity, const void **ppData, size_t *pSize)
+{
+    if ((ppData == NULL) || (pSize == NULL)) {
+        return BAD_VALUE;
+    }
+
+    pthread_mutex_lock(&mLock);
+    int32_t rc = NAME_NOT_FOUND;
+    entry_t *pEntry = findLocked(cameraId, section);
+    if ((pEntry != NULL) && (pEntry->desc.identity == identity)) {
+        *ppData = pEntry->pData;
+        *pSize = (size_t)pEntry->desc.size;
+        rc = NO_ERROR;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : store
+ *
+ * DESCRIPTION: Add or replace the blob of a camera section and rewrite the
+ *              cache file.
+ *
+ * PARAMETERS :
+ *   @cameraId : camera id
+ *   @section  : caller defined section
+ *   @identity : identity of the sensor
+ *   @pData    : blob, copied
+ *   @size     : blob size
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, the blob is still kept in memory
+ *              when only the file write failed
+ *==========================================================================*/
+int32_t QCameraCapsCache::store(uint32_t cameraId, uint32_t section,
+        uint64_t identity, const void *pData, size_t size)
+{
+    if ((pData == NULL) || (size == 0)) {
+        return BAD_VALUE;
+    }
+
+    void *pCopy = malloc(size);
+    if (pCopy == NULL) {
+        return NO_MEMORY;
+    }
+    memcpy(pCopy, pData, size);
+
+    pthread_mutex_lock(&mLock);
+    if (mPath[0] == '\0') {
+        pthread_mutex_unlock(&mLock);
+        free(pCopy);
+        return NO_INIT;
+    }
+    entry_t *pEntry = findLocked(cameraId, section);
+    if (pEntry == NULL) {
+        if (mNumEntries >= CAPS_CACHE_MAX_ENTRIES) {
+            pthread_mutex_unlock(&mLock);
+            free(pCopy);
+            return NO_MEMORY;
+        }
+        pEntry = &mEntries[mNumEntries++];
+    } else if (pEntry->stored) {
+        free((void *)pEntry->pData);
+    }
+    pEntry->desc.cameraId = cameraId;
+    pEntry->desc.section = section;
+    pEntry->desc.identity = identity;
+    pEntry->desc.size = size;
+    pEntry->pData = pCopy;
+    pEntry->stored = true;
+
+    int32_t rc = writeLocked();
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : hash
+ *
+ * DESCRIPTION: 64 bit FNV-1a hash, for building keys and identities.
+ *
+ * PARAMETERS :
+ *   @pData : data to hash
+ *   @size  : data size
+ *   @seed  : previous hash, 0 to start
+ *
+ * RETURN     : hash value
+ *==========================================================================*/
+uint64_t QCameraCapsCache::hash(const void *pData, size_t size, uint64_t seed)
+{
+    const uint8_t *p = (const uint8_t *)pData;
+    uint64_t h = (seed == 0) ? 0xcbf29ce484222325ULL : seed;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+/*===========================================================================
+ * FUNCTION   : crc32
+ *
+ * DESCRIPTION: CRC-32 (IEEE 802.3) of a buffer.
+ *
+ * PARAMETERS :
+ *   @pData : data
+ *   @size  : data size
+ *   @crc   : previous crc, 0 to start
+ *
+ * RETURN     : crc value
+ *==========================================================================*/
+uint32_t QCameraCapsCache::crc32(const void *pData, size_t size, uint32_t crc)
+{
+    static uint32_t table[256];
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    struct TableInit {
+        static void run() {
+            for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (uint32_t k = 0; k < 8; k++) {
+                    c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+                }
+                table[i] = c;
+            }
+        }
+    };
+    pthread_once(&once, TableInit::run);
+
+    const uint8_t *p = (const uint8_t *)pData;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/*===========================================================================
+ * FUNCTION   : validateLocked
+ *
+ * DESCRIPTION: Check a mapped file and load its entry table. mLock must be
+ *              held.
+ *
+ * PARAMETERS :
+ *   @pBase : start of the mapping
+ *   @size  : size of the mapping
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- valid file
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraCapsCache::validateLocked(const uint8_t *pBase, size_t size)
+{
+    const caps_cache_header_t *pHdr = (const caps_cache_header_t *)pBase;
+    if ((pHdr->magic != CAPS_CACHE_MAGIC) ||
+            (pHdr->version != CAPS_CACHE_VERSION) ||
+            (pHdr->headerSize != sizeof(caps_cache_header_t)) ||
+            (pHdr->key != mKey) ||
+            (pHdr->fileSize != size) ||
+            (pHdr->numEntries > CAPS_CACHE_MAX_ENTRIES)) {
+        return BAD_VALUE;
+    }
+
+    size_t tableEnd = sizeof(caps_cache_header_t) +
+            pHdr->numEntries * sizeof(caps_cache_entry_t);
+    if (tableEnd > size) {
+        return BAD_VALUE;
+    }
+    if (crc32(pBase + sizeof(caps_cache_header_t),
+            size - sizeof(caps_cache_header_t), 0) != pHdr->crc) {
+        return BAD_VALUE;
+    }
+
+    const caps_cache_entry_t *pTable =
+            (const caps_cache_entry_t *)(pBase + sizeof(caps_cache_header_t));
+    for (uint32_t i = 0; i < pHdr->numEntries; i++) {
+        const caps_cache_entry_t &desc = pTable[i];
+        if ((desc.offset < tableEnd) || (desc.offset > size) ||
+                (desc.size > size - desc.offset) ||
+                (desc.offset != CAPS_CACHE_ALIGN(desc.offset))) {
+            mNumEntries = 0;
+            return BAD_VALUE;
+        }
+        mEntries[i].desc = desc;
+        mEntries[i].pData = pBase + desc.offset;
+        mEntries[i].stored = false;
+    }
+    mNumEntries = pHdr->numEntries;
+
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : findLocked
+ *
+ * DESCRIPTION: Find the entry of a camera section. mLock must be held.
+ *
+ * PARAMETERS :
+ *   @cameraId : camera id
+ *   @section  : section
+ *
+ * RETURN     : entry, NULL if none
+ *==========================================================================*/
+QCameraCapsCache::entry_t *QCameraCapsCache::findLocked(uint32_t cameraId,
+        uint32_t section)
+{
+    for (uint32_t i = 0; i < mNumEntries; i++) {
+        if ((mEntries[i].desc.cameraId == cameraId) &&
+                (mEntries[i].desc.section == section)) {
+            return &mEntries[i];
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : writeLocked
+ *
+ * DESCRIPTION: Write every entry to a temporary file and rename it over the
+ *              cache file. The temporary file is created fresh and private
+ *              to this process. mLock must be held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraCapsCache::writeLocked()
+{
+    uint64_t offset = CAPS_CACHE_ALIGN(sizeof(caps_cache_header_t) +
+            mNumEntries * sizeof(caps_cache_entry_t));
+    for (uint32_t i = 0; i < mNumEntries; i++) {
+        mEntries[i].desc.offset = offset;
+        offset = CAPS_CACHE_ALIGN(offset + mEntries[i].desc.size);
+    }
+
+    size_t fileSize = (size_t)offset;
+    uint8_t *pImage = (uint8_t *)calloc(1, fileSize);
+    if (pImage == NULL) {
+        return NO_MEMORY;
+    }
+
+    caps_cache_entry_t *pTable =
+            (caps_cache_entry_t *)(pImage + sizeof(caps_cache_header_t));
+    for (uint32_t i = 0; i < mNumEntries; i++) {
+        pTable[i] = mEntries[i].desc;
+        memcpy(pImage + mEntries[i].desc.offset, mEntries[i].pData,
+                (size_t)mEntries[i].desc.size);
+    }
+
+    caps_cache_header_t *pHdr = (caps_cache_header_t *)pImage;
+    pHdr->magic = CAPS_CACHE_MAGIC;
+    pHdr->version = CAPS_CACHE_VERSION;
+    pHdr->headerSize = sizeof(caps_cache_header_t);
+    pHdr->numEntries = mNumEntries;
+    pHdr->key = mKey;
+    pHdr->fileSize = fileSize;
+    pHdr->crc = crc32(pImage + sizeof(caps_cache_header_t),
+            fileSize - sizeof(caps_cache_header_t), 0);
+
+    char tmpPath[sizeof(mPath) + 4];
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", mPath);
+    int32_t rc = NO_ERROR;
+    unlink(tmpPath);
+    int fd = ::open(tmpPath,
+            O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, 0600);
+    if (fd < 0) {
+        rc = -errno;
+    } else {
+        size_t written = 0;
+        while (written < fileSize) {
+            ssize_t n = write(fd, pImage + written, fileSize - written);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                rc = -errno;
+                break;
+            }
+            written += (size_t)n;
+        }
+        if ((rc == NO_ERROR) && (fsync(fd) != 0)) {
+            rc = -errno;
+        }
+        ::close(fd);
+        if ((rc == NO_ERROR) && (rename(tmpPath, mPath) != 0)) {
+            rc = -errno;
+        }
+        if (rc != NO_ERROR) {
+            unlink(tmpPath);
+        }
+    }
+    free(pImage);
+
+    return rc;
+}
+
+}; // namespace qcamera
@@ -0,0 +1,113 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_CAPS_CACHE_H__
+#define __QCAMERA_CAPS_CACHE_H__
+
+// System dependencies
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace qcamera {
+
+#define CAPS_CACHE_MAGIC         0x43434351 // "QCCC"
+#define CAPS_CACHE_VERSION       1
+#define CAPS_CACHE_MAX_ENTRIES   32
+
+/* On-disk layout: a header, an entry table and 8 byte aligned blobs. The crc
+ * covers everything after the header, the key identifies the software and
+ * configuration the blobs were produced with. */
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;
+    uint32_t numEntries;
+    uint64_t key;
+    uint64_t fileSize;
+    uint32_t crc;
+    uint32_t reserved[7];
+} caps_cache_header_t;
+
+typedef struct {
+    uint32_t cameraId;
+    uint32_t section;
+    uint64_t identity;        // Identity of the sensor the blob belongs to
+    uint64_t offset;
+    uint64_t size;
+} caps_cache_entry_t;
+
+/*
+ * QCameraCapsCache keeps blobs (capabilities, static metadata) per camera and
+ * section in a versioned, checksummed file. The file is mapped and validated
+ * once at open(); a file that does not match the key, the layout or its
+ * checksum is ignored. store() rewrites the file atomically.
+ *
+ * Blobs returned by lookup() stay valid until close().
+ */
+class QCameraCapsCache {
+public:
+    QCameraCapsCache();
+    virtual ~QCameraCapsCache();
+
+    int32_t open(const char *path, uint64_t key);
+    void close();
+    bool isValid();
+    int32_t lookup(uint32_t cameraId, uint32_t section, uint64_t identity,
+            const void **ppData, size_t *pSize);
+    int32_t store(uint32_t cameraId, uint32_t section, uint64_t identity,
+            const void *pData, size_t size);
+
+    static uint64_t hash(const void *pData, size_t size, uint64_t seed);
+    static uint32_t crc32(const void *pData, size_t size, uint32_t crc);
+
+private:
+    typedef struct {
+        caps_cache_entry_t desc;
+        const void *pData;    // Points into the mapping or to mStored
+        bool stored;
+    } entry_t;
+
+    int32_t validateLocked(const uint8_t *pBase, size_t size);
+    entry_t *findLocked(uint32_t cameraId, uint32_t section);
+    int32_t writeLocked();
+
+    char mPath[256];
+    uint64_t mKey;
+    void *mMap;
+    size_t mMapSize;
+    bool mValid;
+    entry_t mEntries[CAPS_CACHE_MAX_ENTRIES];
+    uint32_t mNumEntries;
+    pthread_mutex_t mLock;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_CAPS_CACHE_H__ */
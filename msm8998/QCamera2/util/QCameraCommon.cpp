@@ -33,8 +33,14 @@
 
 // System dependencies
 #include <utils/Errors.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <hardware/camera_common.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <utils/Log.h>
 #include <math.h>
 
@@ -44,6 +50,7 @@
 
 extern "C" {
 #include "mm_camera_dbg.h"
+#include "mm_camera_interface.h"
 }
 
 using namespace android;
@@ -58,8 +65,15 @@ namespace qcamera {
 #define FALSE 0
 #endif
 
+static QCameraCapsCache *gCapsCache = NULL;
+static pthread_once_t gCapsCacheOnce = PTHREAD_ONCE_INIT;
+
 #define ASPECT_RATIO_TOLERANCE 0.01
 
+// Entries of a capability table
+#define CAPS_TBL_LEN(cap, tbl) (sizeof((cap)->tbl) / sizeof((cap)->tbl[0]))
+#define CAPS_CNT_VALID(cap, cnt, tbl) ((size_t)(cap)->cnt <= CAPS_TBL_LEN(cap, tbl))
+
 /*===========================================================================
  * FUNCTION   : QCameraCommon
  *
@@ -302,4 +316,351 @@ bool QCameraCommon::isVideoUBWCEnabled()
 #endif
 }
 
+/*===========================================================================
+ * FUNCTION   : hashCameraProperty
+ *
+ * DESCRIPTION: property_list callback folding persist.camera.* properties
+ *              into the capability cache key. The fold does not depend on
+ *              the listing order.
+ *
+ * PARAMETERS :
+ *   @key    : property name
+ *   @value  : property value
+ *   @cookie : uint64_t accumulated hash
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void hashCameraProperty(const char *key, const char *value, void *cookie)
+{
+    static const char prefix[] = "persist.camera.";
+    if (strncmp(key, prefix, sizeof(prefix) - 1) != 0) {
+        return;
+    }
+    uint64_t h = QCameraCapsCache::hash(key, strlen(key) + 1, 0);
+    h = QCameraCapsCache::hash(value, strlen(value), h);
+    *(uint64_t *)cookie += h;
+}
+
+/*===========================================================================
+ * FUNCTION   : prepareCapsCacheDir
+ *
+ * DESCRIPTION: Create the capability cache directory, private to this
+ *              process, and check that nobody else can write to it.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- directory usable
+ *              none-zero failure code
+ *==========================================================================*/
+static int32_t prepareCapsCacheDir()
+{
+    if ((mkdir(CAPS_CACHE_DIR, 0700) != 0) && (errno != EEXIST)) {
+        return -errno;
+    }
+
+    struct stat st;
+    if (lstat(CAPS_CACHE_DIR, &st) != 0) {
+        return -errno;
+    }
+    if (!S_ISDIR(st.st_mode) || (st.st_uid != geteuid()) ||
+            ((st.st_mode & (S_IRWXG | S_IRWXO)) != 0)) {
+        return PERMISSION_DENIED;
+    }
+    return NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : initCapsCache
+ *
+ * DESCRIPTION: Open the capability cache with a key covering the cache
+ *              format, the capability layout, the build, this library and
+ *              the camera properties.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+static void initCapsCache()
+{
+    char prop[PROPERTY_VALUE_MAX];
+    property_get("persist.camera.capscache", prop, "1");
+    if (atoi(prop) == 0) {
+        LOGH("Capability cache disabled");
+        return;
+    }
+
+    int32_t rc = prepareCapsCacheDir();
+    if (rc != NO_ERROR) {
+        LOGW("Capability cache disabled, %s not usable: %d", CAPS_CACHE_DIR, rc);
+        return;
+    }
+
+    uint32_t layout[2] = {CAPS_CACHE_VERSION, sizeof(cam_capability_t)};
+    uint64_t key = QCameraCapsCache::hash(layout, sizeof(layout), 0);
+
+    property_get("ro.build.fingerprint", prop, "");
+    key = QCameraCapsCache::hash(prop, strlen(prop), key);
+    property_get("ro.vendor.build.fingerprint", prop, "");
+    key = QCameraCapsCache::hash(prop, strlen(prop), key);
+
+    Dl_info libInfo;
+    struct stat st;
+    if ((dladdr((void *)initCapsCache, &libInfo) != 0) &&
+            (libInfo.dli_fname != NULL) && (stat(libInfo.dli_fname, &st) == 0)) {
+        int64_t libId[3] = {(int64_t)st.st_ino, (int64_t)st.st_size,
+                (int64_t)st.st_mtime};
+        key = QCameraCapsCache::hash(libId, sizeof(libId), key);
+    }
+
+    uint64_t propHash = 0;
+    property_list(hashCameraProperty, &propHash);
+    key = QCameraCapsCache::hash(&propHash, sizeof(propHash), key);
+
+    QCameraCapsCache *pCache = new QCameraCapsCache();
+    rc = pCache->open(CAPS_CACHE_PATH, key);
+    LOGH("Capability cache %s: %s", CAPS_CACHE_PATH,
+            (rc == NO_ERROR) ? "valid" : "rebuilding");
+    gCapsCache = pCache;
+}
+
+/*===========================================================================
+ * FUNCTION   : getCapsCache
+ *
+ * DESCRIPTION: Capability cache shared by HAL1 and HAL3, opened on first
+ *              use.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : cache, NULL if disabled
+ *==========================================================================*/
+QCameraCapsCache *QCameraCommon::getCapsCache()
+{
+    pthread_once(&gCapsCacheOnce, initCapsCache);
+    return gCapsCache;
+}
+
+/*===========================================================================
+ * FUNCTION   : getCameraIdentity
+ *
+ * DESCRIPTION: Identity of an enumerated camera, from what the sensor
+ *              probe reported for it.
+ *
+ * PARAMETERS :
+ *   @cameraId : camera id
+ *
+ * RETURN     : identity hash
+ *==========================================================================*/
+uint64_t QCameraCommon::getCameraIdentity(uint32_t cameraId)
+{
+    cam_sync_type_t camType = CAM_TYPE_MAIN;
+    struct camera_info *pInfo = get_cam_info(cameraId, &camType);
+    int32_t ident[6] = {(int32_t)cameraId, (int32_t)camType,
+            (int32_t)is_yuv_sensor(cameraId),
+            (int32_t)is_dual_camera_by_idx(cameraId), -1, -1};
+    if (pInfo != NULL) {
+        ident[4] = pInfo->facing;
+        ident[5] = pInfo->orientation;
+    }
+    return QCameraCapsCache::hash(ident, sizeof(ident), 0);
+}
+
+/*===========================================================================
+ * FUNCTION   : isCachedCapabilityValid
+ *
+ * DESCRIPTION: Check every table count of a capability read from the cache
+ *              against the size of its table.
+ *
+ * PARAMETERS :
+ *   @pCap : capability
+ *
+ * RETURN     : true if all counts are in bounds
+ *==========================================================================*/
+static bool isCachedCapabilityValid(const cam_capability_t *pCap)
+{
+    bool valid =
+        CAPS_CNT_VALID(pCap, supported_iso_modes_cnt, supported_iso_modes) &&
+        CAPS_CNT_VALID(pCap, supported_flash_modes_cnt, supported_flash_modes) &&
+        CAPS_CNT_VALID(pCap, zoom_ratio_tbl_cnt, zoom_ratio_tbl) &&
+        CAPS_CNT_VALID(pCap, supported_effects_cnt, supported_effects) &&
+        CAPS_CNT_VALID(pCap, supported_scene_modes_cnt, supported_scene_modes) &&
+        CAPS_CNT_VALID(pCap, supported_scene_modes_cnt, scene_mode_overrides) &&
+        CAPS_CNT_VALID(pCap, supported_aec_modes_cnt, supported_aec_modes) &&
+        CAPS_CNT_VALID(pCap, fps_ranges_tbl_cnt, fps_ranges_tbl) &&
+        CAPS_CNT_VALID(pCap, supported_antibandings_cnt, supported_antibandings) &&
+        CAPS_CNT_VALID(pCap, supported_white_balances_cnt,
+                supported_white_balances) &&
+        CAPS_CNT_VALID(pCap, supported_sensor_hdr_types_cnt,
+                supported_sensor_hdr_types) &&
+        CAPS_CNT_VALID(pCap, supported_focus_modes_cnt, supported_focus_modes) &&
+        CAPS_CNT_VALID(pCap, picture_sizes_tbl_cnt, picture_sizes_tbl) &&
+        CAPS_CNT_VALID(pCap, picture_sizes_tbl_cnt, picture_min_duration) &&
+        CAPS_CNT_VALID(pCap, preview_sizes_tbl_cnt, preview_sizes_tbl) &&
+        CAPS_CNT_VALID(pCap, video_sizes_tbl_cnt, video_sizes_tbl) &&
+        CAPS_CNT_VALID(pCap, livesnapshot_sizes_tbl_cnt,
+                livesnapshot_sizes_tbl) &&
+        CAPS_CNT_VALID(pCap, vhdr_livesnapshot_sizes_tbl_cnt,
+                vhdr_livesnapshot_sizes_tbl) &&
+        CAPS_CNT_VALID(pCap, hfr_tbl_cnt, hfr_tbl) &&
+        CAPS_CNT_VALID(pCap, zzhdr_sizes_tbl_cnt, zzhdr_sizes_tbl) &&
+        CAPS_CNT_VALID(pCap, supported_quadra_cfa_dim_cnt, quadra_cfa_dim) &&
+        CAPS_CNT_VALID(pCap, supported_preview_fmt_cnt, supported_preview_fmts) &&
+        CAPS_CNT_VALID(pCap, supported_picture_fmt_cnt, supported_picture_fmts) &&
+        CAPS_CNT_VALID(pCap, supported_raw_dim_cnt, raw_dim) &&
+        CAPS_CNT_VALID(pCap, supported_raw_dim_cnt, raw_min_duration) &&
+        CAPS_CNT_VALID(pCap, supported_raw_fmt_cnt, supported_raw_fmts) &&
+        CAPS_CNT_VALID(pCap, supported_focus_algos_cnt, supported_focus_algos) &&
+        CAPS_CNT_VALID(pCap, focal_lengths_count, focal_lengths) &&
+        CAPS_CNT_VALID(pCap, apertures_count, apertures) &&
+        CAPS_CNT_VALID(pCap, filter_densities_count, filter_densities) &&
+        CAPS_CNT_VALID(pCap, optical_stab_modes_count, optical_stab_modes) &&
+        CAPS_CNT_VALID(pCap, supported_flash_firing_level_cnt,
+                supported_firing_levels) &&
+        CAPS_CNT_VALID(pCap, supported_scalar_format_cnt,
+                supported_scalar_fmts) &&
+        CAPS_CNT_VALID(pCap, supported_ae_modes_cnt, supported_ae_modes) &&
+        CAPS_CNT_VALID(pCap, scale_picture_sizes_cnt, scale_picture_sizes) &&
+        CAPS_CNT_VALID(pCap, supported_test_pattern_modes_cnt,
+                supported_test_pattern_modes) &&
+        CAPS_CNT_VALID(pCap, aberration_modes_count, aberration_modes) &&
+        CAPS_CNT_VALID(pCap, supported_is_types_cnt, supported_is_types) &&
+        CAPS_CNT_VALID(pCap, supported_is_types_cnt, supported_is_type_margins) &&
+        ((size_t)pCap->optical_black_region_count * 4 <=
+                CAPS_TBL_LEN(pCap, optical_black_regions)) &&
+        CAPS_CNT_VALID(pCap, hotPixel_count, hotPixelMap) &&
+        CAPS_CNT_VALID(pCap, supported_instant_aec_modes_cnt,
+                supported_instant_aec_modes) &&
+        CAPS_CNT_VALID(pCap, meta_raw_channel_count, vc) &&
+        CAPS_CNT_VALID(pCap, meta_raw_channel_count, dt) &&
+        CAPS_CNT_VALID(pCap, meta_raw_channel_count, supported_meta_raw_fmts) &&
+        CAPS_CNT_VALID(pCap, meta_raw_channel_count, raw_meta_dim) &&
+        CAPS_CNT_VALID(pCap, supported_ir_mode_cnt, supported_ir_modes) &&
+        CAPS_CNT_VALID(pCap, supported_binning_correction_mode_cnt,
+                supported_binning_modes) &&
+        CAPS_CNT_VALID(pCap, ubifocus_af_bracketing_need.burst_count,
+                ubifocus_af_bracketing_need.focus_steps) &&
+        CAPS_CNT_VALID(pCap, refocus_af_bracketing_need.burst_count,
+                refocus_af_bracketing_need.focus_steps);
+
+    for (size_t i = 0; valid && (i < pCap->hfr_tbl_cnt); i++) {
+        valid = CAPS_CNT_VALID(pCap, hfr_tbl[i].dim_cnt, hfr_tbl[i].dim) &&
+                CAPS_CNT_VALID(pCap, hfr_tbl[i].livesnapshot_sizes_tbl_cnt,
+                hfr_tbl[i].livesnapshot_sizes_tbl);
+    }
+    return valid;
+}
+
+/*===========================================================================
+ * FUNCTION   : loadCachedCapability
+ *
+ * DESCRIPTION: Rebuild a capability structure, including the main and aux
+ *              capabilities of a dual camera, from the capability cache.
+ *
+ * PARAMETERS :
+ *   @cameraId : camera id
+ *   @section  : caps_cache_section_t of the capability
+ *   @identity : camera identity
+ *
+ * RETURN     : malloc'ed capability, NULL if not cached
+ *==========================================================================*/
+cam_capability_t *QCameraCommon::loadCachedCapability(uint32_t cameraId,
+        uint32_t section, uint64_t identity)
+{
+    QCameraCapsCache *pCache = getCapsCache();
+    const void *pData = NULL;
+    size_t size = 0;
+    if ((pCache == NULL) ||
+            (pCache->lookup(cameraId, section, identity, &pData, &size) !=
+            NO_ERROR)) {
+        return NULL;
+    }
+
+    bool dual = (is_dual_camera_by_idx(cameraId) != 0);
+    size_t count = dual ? 3 : 1;
+    if (size != count * sizeof(cam_capability_t)) {
+        LOGW("Cached capability of camera %d has size %zu", cameraId, size);
+        return NULL;
+    }
+
+    const cam_capability_t *pCached = (const cam_capability_t *)pData;
+    for (size_t i = 0; i < count; i++) {
+        if (!isCachedCapabilityValid(&pCached[i])) {
+            LOGW("Cached capability of camera %d has a table out of bounds",
+                    cameraId);
+            return NULL;
+        }
+    }
+
+    cam_capability_t *pCaps[3] = {NULL, NULL, NULL};
+    for (size_t i = 0; i < count; i++) {
+        pCaps[i] = (cam_capability_t *)malloc(sizeof(cam_capability_t));
+        if (pCaps[i] == NULL) {
+            LOGE("out of memory");
+            for (size_t j = 0; j < i; j++) {
+                free(pCaps[j]);
+            }
+            return NULL;
+        }
+        memcpy(pCaps[i], &pCached[i], sizeof(cam_capability_t));
+        pCaps[i]->main_cam_cap = NULL;
+        pCaps[i]->aux_cam_cap = NULL;
+    }
+    pCaps[0]->main_cam_cap = pCaps[1];
+    pCaps[0]->aux_cam_cap = pCaps[2];
+
+    LOGH("Capability of camera %d loaded from cache", cameraId);
+    return pCaps[0];
+}
+
+/*===========================================================================
+ * FUNCTION   : storeCachedCapability
+ *
+ * DESCRIPTION: Save a capability structure, including the main and aux
+ *              capabilities of a dual camera, in the capability cache.
+ *
+ * PARAMETERS :
+ *   @cameraId : camera id
+ *   @section  : caps_cache_section_t of the capability
+ *   @identity : camera identity
+ *   @pCap     : capability to save
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraCommon::storeCachedCapability(uint32_t cameraId, uint32_t section,
+        uint64_t identity, const cam_capability_t *pCap)
+{
+    QCameraCapsCache *pCache = getCapsCache();
+    if ((pCache == NULL) || (pCap == NULL)) {
+        return;
+    }
+
+    bool dual = (is_dual_camera_by_idx(cameraId) != 0);
+    if (dual && ((pCap->main_cam_cap == NULL) || (pCap->aux_cam_cap == NULL))) {
+        return;
+    }
+    size_t count = dual ? 3 : 1;
+    cam_capability_t *pBlob =
+            (cam_capability_t *)malloc(count * sizeof(cam_capability_t));
+    if (pBlob == NULL) {
+        LOGE("out of memory");
+        return;
+    }
+    memcpy(&pBlob[0], pCap, sizeof(cam_capability_t));
+    if (dual) {
+        memcpy(&pBlob[1], pCap->main_cam_cap, sizeof(cam_capability_t));
+        memcpy(&pBlob[2], pCap->aux_cam_cap, sizeof(cam_capability_t));
+    }
+    for (size_t i = 0; i < count; i++) {
+        pBlob[i].main_cam_cap = NULL;
+        pBlob[i].aux_cam_cap = NULL;
+    }
+
+    int32_t rc = pCache->store(cameraId, section, identity, pBlob,
+            count * sizeof(cam_capability_t));
+    if (rc != NO_ERROR) {
+        LOGW("Failed to save capability of camera %d: %d", cameraId, rc);
+    }
+    free(pBlob);
+}
+
 }; // namespace qcamera
@@ -33,12 +33,25 @@
 // Camera dependencies
 #include "cam_types.h"
 #include "cam_intf.h"
+#include "QCameraCapsCache.h"
 
 namespace qcamera {
 
 #define ALIGN(a, b) (((a) + (b)) & ~(b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
+// The capability cache lives in a directory private to the camera HAL, not
+// next to the frame dumps other processes can write.
+#define CAPS_CACHE_DIR QCAMERA_DUMP_FRM_LOCATION"hal/"
+#define CAPS_CACHE_PATH CAPS_CACHE_DIR"cam_caps_cache.bin"
+
+// Sections of the capability cache
+typedef enum {
+    CAPS_CACHE_SECTION_HAL1_CAPS = 1,
+    CAPS_CACHE_SECTION_HAL3_CAPS,
+    CAPS_CACHE_SECTION_HAL3_META
+} caps_cache_section_t;
+
 class QCameraCommon {
 public:
     QCameraCommon();
@@ -55,6 +68,13 @@ public:
             cam_dimension_t cur_dim);
     static bool isVideoUBWCEnabled();
 
+    static QCameraCapsCache *getCapsCache();
+    static uint64_t getCameraIdentity(uint32_t cameraId);
+    static cam_capability_t *loadCachedCapability(uint32_t cameraId,
+            uint32_t section, uint64_t identity);
+    static void storeCachedCapability(uint32_t cameraId, uint32_t section,
+            uint64_t identity, const cam_capability_t *pCap);
+
 private:
     cam_capability_t *m_pCapability;
 
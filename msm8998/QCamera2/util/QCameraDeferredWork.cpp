@@ -0,0 +1,483 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// System dependencies
+#include <stdio.h>
+#include <string.h>
+#include <utils/Errors.h>
+
+// Camera dependencies
+#include "QCameraDeferredWork.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraDeferredWork constructor
+ *
+ * DESCRIPTION: Create an idle pool with no workers.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraDeferredWork::QCameraDeferredWork() :
+        mNextId(1),
+        mNextSeq(0),
+        mHistoryCount(0),
+        mNumThreads(0),
+        mExit(false)
+{
+    memset(&mOps, 0, sizeof(mOps));
+    memset(mJobs, 0, sizeof(mJobs));
+    memset(mHistory, 0, sizeof(mHistory));
+    memset(mArgs, 0, sizeof(mArgs));
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    pthread_cond_init(&mDoneCond, NULL);
+}
+
+/*===========================================================================
+ * FUNCTION   : ~QCameraDeferredWork
+ *
+ * DESCRIPTION: Stop the workers and release the pool.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraDeferredWork::~QCameraDeferredWork()
+{
+    exit();
+    pthread_cond_destroy(&mDoneCond);
+    pthread_cond_destroy(&mWorkCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : launch
+ *
+ * DESCRIPTION: Start the worker threads.
+ *
+ * PARAMETERS :
+ *   @ops        : job callbacks, run is mandatory
+ *   @numThreads : number of workers, clamped to [1, DEFERRED_WORK_MAX_THREADS]
+ *   @threadName : worker thread name prefix
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraDeferredWork::launch(const deferred_work_ops_t &ops,
+        uint32_t numThreads, const char *threadName)
+{
+    if (ops.run == NULL) {
+        return BAD_VALUE;
+    }
+    if (numThreads == 0) {
+        numThreads = 1;
+    } else if (numThreads > DEFERRED_WORK_MAX_THREADS) {
+        numThreads = DEFERRED_WORK_MAX_THREADS;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (mNumThreads > 0) {
+        pthread_mutex_unlock(&mLock);
+        return INVALID_OPERATION;
+    }
+    mOps = ops;
+    mExit = false;
+    for (uint32_t i = 0; i < numThreads; i++) {
+        mArgs[i].pPool = this;
+        mArgs[i].index = i;
+        if (pthread_create(&mThreads[i], NULL, workerRoutine, &mArgs[i]) != 0) {
+            break;
+        }
+        if (threadName != NULL) {
+            // 15 characters at most; the index is a single digit since
+            // DEFERRED_WORK_MAX_THREADS is below 10
+            char name[16];
+            snprintf(name, sizeof(name), "%.14s%c", threadName,
+                    (char)('0' + i));
+            pthread_setname_np(mThreads[i], name);
+        }
+        mNumThreads++;
+    }
+    bool failed = (mNumThreads == 0);
+    pthread_mutex_unlock(&mLock);
+
+    return failed ? UNKNOWN_ERROR : NO_ERROR;
+}
+
+/*===========================================================================
+ * FUNCTION   : exit
+ *
+ * DESCRIPTION: Stop the workers. Running jobs finish, pending jobs are
+ *              handed to the cancel callback and their waiters released.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDeferredWork::exit()
+{
+    pthread_mutex_lock(&mLock);
+    uint32_t numThreads = mNumThreads;
+    mExit = true;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mLock);
+
+    for (uint32_t i = 0; i < numThreads; i++) {
+        pthread_join(mThreads[i], NULL);
+    }
+
+    pthread_mutex_lock(&mLock);
+    mNumThreads = 0;
+    for (uint32_t i = 0; i < DEFERRED_WORK_MAX_JOBS; i++) {
+        job_t &job = mJobs[i];
+        if (job.state == JOB_PENDING) {
+            if (mOps.cancel != NULL) {
+                mOps.cancel(mOps.user, job.work);
+            }
+            job.state = JOB_FAILED;
+            job.timing.status = DEAD_OBJECT;
+        }
+        job.work = NULL;
+    }
+    pthread_cond_broadcast(&mDoneCond);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : queue
+ *
+ * DESCRIPTION: Queue a job. The job runs once every listed dependency is
+ *              finished; ids of jobs already finished are accepted.
+ *
+ * PARAMETERS :
+ *   @name    : job name for timing output
+ *   @work    : opaque job payload passed to the run callback
+ *   @deps    : ids of jobs this one depends on, 0 entries are ignored
+ *   @numDeps : number of entries in deps
+ *
+ * RETURN     : id of the job, 0 if it could not be queued
+ *==========================================================================*/
+uint32_t QCameraDeferredWork::queue(const char *name, void *work,
+        const uint32_t *deps, uint32_t numDeps)
+{
+    if ((numDeps > DEFERRED_WORK_MAX_DEPS) || ((numDeps > 0) && (deps == NULL))) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if ((mNumThreads == 0) || mExit) {
+        pthread_mutex_unlock(&mLock);
+        return 0;
+    }
+
+    job_t *pJob = NULL;
+    for (uint32_t i = 0; i < DEFERRED_WORK_MAX_JOBS; i++) {
+        if (mJobs[i].state == JOB_FREE) {
+            pJob = &mJobs[i];
+            break;
+        }
+    }
+    if (pJob == NULL) {
+        pthread_mutex_unlock(&mLock);
+        return 0;
+    }
+
+    memset(pJob, 0, sizeof(*pJob));
+    pJob->state = JOB_PENDING;
+    pJob->seq = mNextSeq++;
+    pJob->work = work;
+    for (uint32_t i = 0; i < numDeps; i++) {
+        if (deps[i] != 0) {
+            pJob->deps[pJob->numDeps++] = deps[i];
+        }
+    }
+    pJob->timing.id = mNextId++;
+    if (mNextId == 0) {
+        mNextId = 1;
+    }
+    if (name != NULL) {
+        strlcpy(pJob->timing.name, name, sizeof(pJob->timing.name));
+    }
+    pJob->timing.queuedNs = systemTime();
+    uint32_t id = pJob->timing.id;
+
+    pthread_cond_signal(&mWorkCond);
+    pthread_mutex_unlock(&mLock);
+
+    return id;
+}
+
+/*===========================================================================
+ * FUNCTION   : wait
+ *
+ * DESCRIPTION: Block until a job is finished.
+ *
+ * PARAMETERS :
+ *   @id : id of the job
+ *
+ * RETURN     : status of the job, NO_ERROR for unknown ids
+ *==========================================================================*/
+int32_t QCameraDeferredWork::wait(uint32_t id)
+{
+    pthread_mutex_lock(&mLock);
+    job_t *pJob = findLocked(id);
+    while ((pJob != NULL) &&
+            ((pJob->state == JOB_PENDING) || (pJob->state == JOB_RUNNING))) {
+        pthread_cond_wait(&mDoneCond, &mLock);
+        pJob = findLocked(id);
+    }
+    int32_t rc = (pJob != NULL) ? pJob->timing.status : NO_ERROR;
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : getStatus
+ *
+ * DESCRIPTION: Status of a job without blocking.
+ *
+ * PARAMETERS :
+ *   @id : id of the job
+ *
+ * RETURN     : status of a failed job, NO_ERROR otherwise
+ *==========================================================================*/
+int32_t QCameraDeferredWork::getStatus(uint32_t id)
+{
+    pthread_mutex_lock(&mLock);
+    job_t *pJob = findLocked(id);
+    int32_t rc = ((pJob != NULL) && (pJob->state == JOB_FAILED)) ?
+            pJob->timing.status : NO_ERROR;
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : isPending
+ *
+ * DESCRIPTION: Whether a job is queued or running.
+ *
+ * PARAMETERS :
+ *   @id : id of the job
+ *
+ * RETURN     : true if the job has not finished yet
+ *==========================================================================*/
+bool QCameraDeferredWork::isPending(uint32_t id)
+{
+    pthread_mutex_lock(&mLock);
+    job_t *pJob = findLocked(id);
+    bool pending = (pJob != NULL) &&
+            ((pJob->state == JOB_PENDING) || (pJob->state == JOB_RUNNING));
+    pthread_mutex_unlock(&mLock);
+
+    return pending;
+}
+
+/*===========================================================================
+ * FUNCTION   : wakeWaiters
+ *
+ * DESCRIPTION: Wake every waiter so it re-checks its job, e.g. after an
+ *              external event changed what the jobs can do.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDeferredWork::wakeWaiters()
+{
+    pthread_mutex_lock(&mLock);
+    pthread_cond_broadcast(&mDoneCond);
+    pthread_mutex_unlock(&mLock);
+}
+
+/*===========================================================================
+ * FUNCTION   : getHistory
+ *
+ * DESCRIPTION: Copy the timing of the most recently finished jobs, oldest
+ *              first.
+ *
+ * PARAMETERS :
+ *   @timings : output array
+ *   @max     : size of the output array
+ *
+ * RETURN     : number of entries copied
+ *==========================================================================*/
+uint32_t QCameraDeferredWork::getHistory(deferred_work_timing_t *timings,
+        uint32_t max)
+{
+    if (timings == NULL) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&mLock);
+    uint32_t count = (mHistoryCount < DEFERRED_WORK_HISTORY) ?
+            mHistoryCount : DEFERRED_WORK_HISTORY;
+    if (count > max) {
+        count = max;
+    }
+    uint32_t first = mHistoryCount - count;
+    for (uint32_t i = 0; i < count; i++) {
+        timings[i] = mHistory[(first + i) % DEFERRED_WORK_HISTORY];
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return count;
+}
+
+/*===========================================================================
+ * FUNCTION   : findLocked
+ *
+ * DESCRIPTION: Find the slot holding a job. mLock must be held.
+ *
+ * PARAMETERS :
+ *   @id : id of the job
+ *
+ * RETURN     : job slot, NULL if the job is unknown or done successfully
+ *==========================================================================*/
+QCameraDeferredWork::job_t *QCameraDeferredWork::findLocked(uint32_t id)
+{
+    if (id == 0) {
+        return NULL;
+    }
+    for (uint32_t i = 0; i < DEFERRED_WORK_MAX_JOBS; i++) {
+        if ((mJobs[i].state != JOB_FREE) && (mJobs[i].timing.id == id)) {
+            return &mJobs[i];
+        }
+    }
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : nextReadyLocked
+ *
+ * DESCRIPTION: Pick the oldest pending job whose dependencies are all
+ *              finished. mLock must be held.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : job slot, NULL if nothing is ready
+ *==========================================================================*/
+QCameraDeferredWork::job_t *QCameraDeferredWork::nextReadyLocked()
+{
+    job_t *pReady = NULL;
+    for (uint32_t i = 0; i < DEFERRED_WORK_MAX_JOBS; i++) {
+        job_t &job = mJobs[i];
+        if ((job.state != JOB_PENDING) ||
+                ((pReady != NULL) && (pReady->seq < job.seq))) {
+            continue;
+        }
+        bool ready = true;
+        for (uint32_t d = 0; (d < job.numDeps) && ready; d++) {
+            job_t *pDep = findLocked(job.deps[d]);
+            ready = (pDep == NULL) || (pDep->state == JOB_FAILED);
+        }
+        if (ready) {
+            pReady = &job;
+        }
+    }
+    return pReady;
+}
+
+/*===========================================================================
+ * FUNCTION   : workerRoutine
+ *
+ * DESCRIPTION: Worker thread entry point.
+ *
+ * PARAMETERS :
+ *   @data : worker_arg_t of the worker
+ *
+ * RETURN     : NULL
+ *==========================================================================*/
+void *QCameraDeferredWork::workerRoutine(void *data)
+{
+    worker_arg_t *pArg = (worker_arg_t *)data;
+    pArg->pPool->runWorker(pArg->index);
+    return NULL;
+}
+
+/*===========================================================================
+ * FUNCTION   : runWorker
+ *
+ * DESCRIPTION: Worker loop. Runs ready jobs until the pool exits.
+ *
+ * PARAMETERS :
+ *   @index : index of the worker
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraDeferredWork::runWorker(uint32_t index)
+{
+    pthread_mutex_lock(&mLock);
+    while (!mExit) {
+        job_t *pJob = nextReadyLocked();
+        if (pJob == NULL) {
+            pthread_cond_wait(&mWorkCond, &mLock);
+            continue;
+        }
+
+        pJob->state = JOB_RUNNING;
+        pJob->timing.worker = index;
+        pJob->timing.startNs = systemTime();
+        void *work = pJob->work;
+        pJob->work = NULL;
+        pthread_mutex_unlock(&mLock);
+
+        int32_t status = mOps.run(mOps.user, work);
+
+        pthread_mutex_lock(&mLock);
+        pJob->timing.status = status;
+        pJob->timing.endNs = systemTime();
+        pJob->state = (status == NO_ERROR) ? JOB_FREE : JOB_FAILED;
+        deferred_work_timing_t timing = pJob->timing;
+        mHistory[mHistoryCount % DEFERRED_WORK_HISTORY] = timing;
+        mHistoryCount++;
+        // A finished job may unblock several dependents and waiters
+        pthread_cond_broadcast(&mWorkCond);
+        pthread_cond_broadcast(&mDoneCond);
+        pthread_mutex_unlock(&mLock);
+
+        if (mOps.done != NULL) {
+            mOps.done(mOps.user, timing);
+        }
+
+        pthread_mutex_lock(&mLock);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+}; // namespace qcamera
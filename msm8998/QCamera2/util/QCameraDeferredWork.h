@@ -0,0 +1,138 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_DEFERRED_WORK_H__
+#define __QCAMERA_DEFERRED_WORK_H__
+
+// System dependencies
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+#define DEFERRED_WORK_MAX_JOBS     32
+#define DEFERRED_WORK_MAX_DEPS     4
+#define DEFERRED_WORK_MAX_THREADS  4
+#define DEFERRED_WORK_HISTORY      16
+#define DEFERRED_WORK_NAME_LEN     24
+
+typedef struct {
+    uint32_t id;
+    char name[DEFERRED_WORK_NAME_LEN];
+    int32_t status;
+    uint32_t worker;          // Index of the worker that ran the job
+    nsecs_t queuedNs;
+    nsecs_t startNs;
+    nsecs_t endNs;
+} deferred_work_timing_t;
+
+/* Job callbacks. run() is called on a worker once all dependencies of the
+ * job are finished, whatever their status, and returns the job status.
+ * cancel() is called instead for jobs still pending at exit(). done() is
+ * optional and gets the timing of every job that ran. */
+typedef struct {
+    int32_t (*run)(void *user, void *work);
+    void (*cancel)(void *user, void *work);
+    void (*done)(void *user, const deferred_work_timing_t &timing);
+    void *user;
+} deferred_work_ops_t;
+
+/*
+ * QCameraDeferredWork runs jobs on a small worker pool. Each job declares
+ * the jobs it depends on, and starts only once they are finished, so
+ * independent jobs run in parallel while dependent ones keep their order.
+ * Ready jobs start in queueing order.
+ *
+ * A job that succeeds is forgotten as soon as it is done. A failed job keeps
+ * its status, so later waits and status checks on it report the failure.
+ * Unknown job ids are treated as finished successfully.
+ */
+class QCameraDeferredWork {
+public:
+    QCameraDeferredWork();
+    virtual ~QCameraDeferredWork();
+
+    int32_t launch(const deferred_work_ops_t &ops, uint32_t numThreads,
+            const char *threadName);
+    void exit();
+    uint32_t queue(const char *name, void *work, const uint32_t *deps,
+            uint32_t numDeps);
+    int32_t wait(uint32_t id);
+    int32_t getStatus(uint32_t id);
+    bool isPending(uint32_t id);
+    void wakeWaiters();
+    uint32_t getHistory(deferred_work_timing_t *timings, uint32_t max);
+
+private:
+    typedef enum {
+        JOB_FREE,
+        JOB_PENDING,
+        JOB_RUNNING,
+        JOB_FAILED
+    } job_state_t;
+
+    typedef struct {
+        job_state_t state;
+        uint64_t seq;
+        void *work;
+        uint32_t deps[DEFERRED_WORK_MAX_DEPS];
+        uint32_t numDeps;
+        deferred_work_timing_t timing;
+    } job_t;
+
+    typedef struct {
+        QCameraDeferredWork *pPool;
+        uint32_t index;
+    } worker_arg_t;
+
+    static void *workerRoutine(void *data);
+    void runWorker(uint32_t index);
+    job_t *findLocked(uint32_t id);
+    job_t *nextReadyLocked();
+
+    deferred_work_ops_t mOps;
+    job_t mJobs[DEFERRED_WORK_MAX_JOBS];
+    uint32_t mNextId;
+    uint64_t mNextSeq;
+    deferred_work_timing_t mHistory[DEFERRED_WORK_HISTORY];
+    uint32_t mHistoryCount;
+
+    pthread_t mThreads[DEFERRED_WORK_MAX_THREADS];
+    worker_arg_t mArgs[DEFERRED_WORK_MAX_THREADS];
+    uint32_t mNumThreads;
+    pthread_mutex_t mLock;
+    pthread_cond_t mWorkCond;
+    pthread_cond_t mDoneCond;
+    bool mExit;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_DEFERRED_WORK_H__ */
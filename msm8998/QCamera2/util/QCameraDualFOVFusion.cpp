@@ -0,0 +1,563 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// System dependencies
+#include <string.h>
+#include <utils/Errors.h>
+
+// Camera dependencies
+#include "QCameraDualFOVFusion.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraDualFOVFusion constructor
+ *
+ * DESCRIPTION: Start the worker pool. Workers that cannot be started are
+ *              left out; the calling thread always works on the frame, so
+ *              the engine still runs with no worker at all.
+ *
+ * PARAMETERS :
+ * @numThreads: threads working on a frame, caller included
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraDualFOVFusion::QCameraDualFOVFusion(uint32_t numThreads) :
+        mWide(NULL),
+        mTele(NULL),
+        mOut(NULL),
+        mChromaFeather(0),
+        mTiles(0),
+        mNextTile(0),
+        mTilesDone(0),
+        mTileNsSum(0),
+        mTileNsMax(0),
+        mNumThreads(numThreads),
+        mNumStarted(0),
+        mJobGen(0),
+        mActive(0),
+        mExit(false)
+{
+    memset(&mWideFrame, 0, sizeof(mWideFrame));
+    memset(&mTeleFrame, 0, sizeof(mTeleFrame));
+    memset(&mParams, 0, sizeof(mParams));
+    memset(&mRegion, 0, sizeof(mRegion));
+    memset(&mStats, 0, sizeof(mStats));
+
+    if (mNumThreads == 0) {
+        mNumThreads = 1;
+    } else if (mNumThreads > FUSION_MAX_THREADS) {
+        mNumThreads = FUSION_MAX_THREADS;
+    }
+
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mWorkCond, NULL);
+    pthread_cond_init(&mDoneCond, NULL);
+
+    for (uint32_t i = 0; i + 1 < mNumThreads; i++) {
+        if (pthread_create(&mThreads[mNumStarted], NULL,
+                workerRoutine, this) != 0) {
+            break;
+        }
+        pthread_setname_np(mThreads[mNumStarted], "CAM_DualFOVFuse");
+        mNumStarted++;
+    }
+    mStats.threads = mNumStarted + 1;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : QCameraDualFOVFusion destructor
+ *
+ * DESCRIPTION: Stop and join the worker pool.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraDualFOVFusion::~QCameraDualFOVFusion()
+{
+    pthread_mutex_lock(&mLock);
+    mExit = true;
+    pthread_cond_broadcast(&mWorkCond);
+    pthread_mutex_unlock(&mLock);
+
+    for (uint32_t i = 0; i < mNumStarted; i++) {
+        pthread_join(mThreads[i], NULL);
+    }
+
+    pthread_cond_destroy(&mDoneCond);
+    pthread_cond_destroy(&mWorkCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : process
+ *
+ * DESCRIPTION: Fuse one wide and tele pair. Blocks until the whole output
+ *              frame is written. The output has the wide frame layout; if
+ *              it is not the wide frame, wide pixels outside the tele region
+ *              are copied over as part of the same tiles. Frames are
+ *              processed one at a time; calls must not overlap.
+ *
+ * PARAMETERS :
+ * @pWide     : wide frame
+ * @wide      : wide frame layout
+ * @pTele     : tele frame
+ * @tele      : tele frame layout
+ * @params    : region and blend parameters
+ * @pOut      : output frame, may be pWide
+ *
+ * RETURN     : NO_ERROR  on success
+ *              BAD_VALUE for invalid frames or parameters
+ *
+ *==========================================================================*/
+int32_t QCameraDualFOVFusion::process(const uint8_t *pWide,
+        const fusion_frame_t &wide, const uint8_t *pTele,
+        const fusion_frame_t &tele, const fusion_params_t &params,
+        uint8_t *pOut)
+{
+    if ((pWide == NULL) || (pTele == NULL) || (pOut == NULL)) {
+        return BAD_VALUE;
+    }
+    if ((wide.width < 2) || (wide.height < 2) ||
+            (wide.stride < wide.width) || (wide.scanline < wide.height) ||
+            (tele.width < 2) || (tele.height < 2) ||
+            (tele.stride < tele.width) || (tele.scanline < tele.height)) {
+        return BAD_VALUE;
+    }
+    if (!(params.fovRatio > 0.0f) || (params.fovRatio > 1.0f) ||
+            (params.teleWeight > 256)) {
+        return BAD_VALUE;
+    }
+
+    nsecs_t start = systemTime();
+
+    // Region size and position are kept even so the chroma region maps
+    // onto whole luma pixel pairs.
+    uint32_t w = (uint32_t)(wide.width * params.fovRatio) & ~1U;
+    uint32_t h = (uint32_t)(wide.height * params.fovRatio) & ~1U;
+    int32_t x0 = ((int32_t)(wide.width - w) / 2 + params.shiftX) & ~1;
+    int32_t y0 = ((int32_t)(wide.height - h) / 2 + params.shiftY) & ~1;
+    x0 = (x0 < 0) ? 0 : x0;
+    y0 = (y0 < 0) ? 0 : y0;
+    if ((uint32_t)x0 + w > wide.width) {
+        x0 = (int32_t)((wide.width - w) & ~1U);
+    }
+    if ((uint32_t)y0 + h > wide.height) {
+        y0 = (int32_t)((wide.height - h) & ~1U);
+    }
+
+    pthread_mutex_lock(&mLock);
+    // A worker that woke up late for the previous frame may still be
+    // looking at the job fields.
+    while (mActive > 0) {
+        pthread_cond_wait(&mDoneCond, &mLock);
+    }
+
+    mWide = pWide;
+    mTele = pTele;
+    mOut = pOut;
+    mWideFrame = wide;
+    mTeleFrame = tele;
+    mParams = params;
+    mRegion.x0 = (uint32_t)x0;
+    mRegion.x1 = (uint32_t)x0 + w;
+    mRegion.y0 = (uint32_t)y0;
+    mRegion.y1 = (uint32_t)y0 + h;
+    if ((w >= 2) && (h >= 2)) {
+        mRegion.stepX = (uint32_t)(((uint64_t)tele.width << 16) / w);
+        mRegion.stepY = (uint32_t)(((uint64_t)tele.height << 16) / h);
+        mChromaFeather = params.featherPx / 2;
+        buildColumns(w, tele.width, mRegion.stepX, params.featherPx,
+                mLumaColAlpha, mLumaColSrc);
+        buildColumns(w / 2, tele.width / 2, mRegion.stepX, mChromaFeather,
+                mChromaColAlpha, mChromaColSrc);
+    } else {
+        // Nothing to blend, the tiles only copy the wide frame.
+        mRegion.x1 = mRegion.x0;
+        mRegion.y1 = mRegion.y0;
+    }
+
+    mTiles = (wide.height + FUSION_TILE_ROWS - 1) / FUSION_TILE_ROWS;
+    mTilesDone = 0;
+    mTileNsSum = 0;
+    mTileNsMax = 0;
+    mNextTile = 0;
+    mJobGen++;
+    if (mNumStarted > 0) {
+        pthread_cond_broadcast(&mWorkCond);
+    }
+    pthread_mutex_unlock(&mLock);
+
+    runTiles();
+
+    pthread_mutex_lock(&mLock);
+    while ((mTilesDone < mTiles) || (mActive > 0)) {
+        pthread_cond_wait(&mDoneCond, &mLock);
+    }
+    mStats.tiles = mTiles;
+    mStats.frameNs = systemTime() - start;
+    mStats.tileAvgNs = mTileNsSum / mTiles;
+    mStats.tileMaxNs = mTileNsMax;
+    pthread_mutex_unlock(&mLock);
+
+    return NO_ERROR;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : getStats
+ *
+ * DESCRIPTION: Get the timing of the last frame.
+ *
+ * PARAMETERS :
+ * @stats     : filled with the stats
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraDualFOVFusion::getStats(fusion_stats_t &stats)
+{
+    pthread_mutex_lock(&mLock);
+    stats = mStats;
+    pthread_mutex_unlock(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : workerRoutine
+ *
+ * DESCRIPTION: Worker loop. Waits for a new frame and takes tiles from it
+ *              until none is left.
+ *
+ * PARAMETERS :
+ * @data      : QCameraDualFOVFusion object
+ *
+ * RETURN     : NULL
+ *
+ *==========================================================================*/
+void *QCameraDualFOVFusion::workerRoutine(void *data)
+{
+    QCameraDualFOVFusion *pme = (QCameraDualFOVFusion *)data;
+    uint64_t seen = 0;
+
+    pthread_mutex_lock(&pme->mLock);
+    while (true) {
+        while (!pme->mExit && (pme->mJobGen == seen)) {
+            pthread_cond_wait(&pme->mWorkCond, &pme->mLock);
+        }
+        if (pme->mExit) {
+            break;
+        }
+        seen = pme->mJobGen;
+        pme->mActive++;
+        pthread_mutex_unlock(&pme->mLock);
+
+        pme->runTiles();
+
+        pthread_mutex_lock(&pme->mLock);
+        pme->mActive--;
+        if (pme->mActive == 0) {
+            pthread_cond_broadcast(&pme->mDoneCond);
+        }
+    }
+    pthread_mutex_unlock(&pme->mLock);
+
+    return NULL;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : runTiles
+ *
+ * DESCRIPTION: Take and process tiles of the current frame until none is
+ *              left. The thread finishing the last tile wakes the caller.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraDualFOVFusion::runTiles()
+{
+    uint32_t tile;
+    while ((tile = mNextTile.fetch_add(1)) < mTiles) {
+        nsecs_t start = systemTime();
+        processTile(tile);
+        int64_t ns = systemTime() - start;
+
+        mTileNsSum += ns;
+        int64_t max = mTileNsMax.load();
+        while ((ns > max) && !mTileNsMax.compare_exchange_weak(max, ns)) {
+        }
+
+        if (mTilesDone.fetch_add(1) + 1 == mTiles) {
+            pthread_mutex_lock(&mLock);
+            pthread_cond_broadcast(&mDoneCond);
+            pthread_mutex_unlock(&mLock);
+        }
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : processTile
+ *
+ * DESCRIPTION: Write one band of FUSION_TILE_ROWS luma rows and the matching
+ *              chroma rows of the output.
+ *
+ * PARAMETERS :
+ * @tile      : tile index
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraDualFOVFusion::processTile(uint32_t tile)
+{
+    uint32_t row0 = tile * FUSION_TILE_ROWS;
+    uint32_t row1 = row0 + FUSION_TILE_ROWS;
+    if (row1 > mWideFrame.height) {
+        row1 = mWideFrame.height;
+    }
+    // FUSION_TILE_ROWS is even, so only the last tile can end on an odd
+    // row; it takes the last chroma row with it.
+    uint32_t crow0 = row0 / 2;
+    uint32_t crow1 = (row1 + 1) / 2;
+
+    if (mOut != mWide) {
+        uint32_t stride = mWideFrame.stride;
+        size_t chromaOff = (size_t)stride * mWideFrame.scanline;
+        memcpy(mOut + (size_t)row0 * stride, mWide + (size_t)row0 * stride,
+                (size_t)(row1 - row0) * stride);
+        memcpy(mOut + chromaOff + (size_t)crow0 * stride,
+                mWide + chromaOff + (size_t)crow0 * stride,
+                (size_t)(crow1 - crow0) * stride);
+    }
+
+    uint32_t y0 = (row0 > mRegion.y0) ? row0 : mRegion.y0;
+    uint32_t y1 = (row1 < mRegion.y1) ? row1 : mRegion.y1;
+    if (y0 < y1) {
+        blendLuma(y0, y1);
+    }
+
+    uint32_t cy0 = (crow0 > mRegion.y0 / 2) ? crow0 : mRegion.y0 / 2;
+    uint32_t cy1 = (crow1 < mRegion.y1 / 2) ? crow1 : mRegion.y1 / 2;
+    if (cy0 < cy1) {
+        blendChroma(cy0, cy1);
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : blendLuma
+ *
+ * DESCRIPTION: Blend the resampled tele luma into region rows [row0, row1).
+ *
+ * PARAMETERS :
+ * @row0      : first wide luma row
+ * @row1      : row past the last one
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraDualFOVFusion::blendLuma(uint32_t row0, uint32_t row1)
+{
+    const uint32_t width = mRegion.x1 - mRegion.x0;
+    const uint32_t *colAlpha = mLumaColAlpha.data();
+    const uint32_t *colSrc = mLumaColSrc.data();
+
+    for (uint32_t y = row0; y < row1; y++) {
+        uint32_t ty, wy;
+        int64_t fy = (int64_t)(y - mRegion.y0) * mRegion.stepY +
+                mRegion.stepY / 2 - 0x8000;
+        fy = (fy < 0) ? 0 : fy;
+        ty = (uint32_t)(fy >> 16);
+        wy = (uint32_t)(fy >> 8) & 0xFF;
+        if (ty >= mTeleFrame.height - 1) {
+            ty = mTeleFrame.height - 1;
+            wy = 0;
+        }
+        const uint8_t *t0 = mTele + (size_t)ty * mTeleFrame.stride;
+        const uint8_t *t1 = (wy != 0) ? t0 + mTeleFrame.stride : t0;
+        const uint8_t *src = mWide + (size_t)y * mWideFrame.stride +
+                mRegion.x0;
+        uint8_t *dst = mOut + (size_t)y * mWideFrame.stride + mRegion.x0;
+
+        for (uint32_t i = 0; i < width; i++) {
+            uint32_t tx = colSrc[i] >> 8;
+            uint32_t wx = colSrc[i] & 0xFF;
+            uint32_t tx1 = tx + (wx != 0);
+            uint32_t top = t0[tx] * (256 - wx) + t0[tx1] * wx;
+            uint32_t bot = t1[tx] * (256 - wx) + t1[tx1] * wx;
+            uint32_t tv = (top * (256 - wy) + bot * wy + 0x8000) >> 16;
+            uint32_t a = alphaOf(colAlpha[i], y, mRegion.y0, mRegion.y1,
+                    mParams.featherPx);
+            dst[i] = (uint8_t)((src[i] * (256 - a) + tv * a + 128) >> 8);
+        }
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : blendChroma
+ *
+ * DESCRIPTION: Blend the resampled tele chroma into region chroma rows
+ *              [row0, row1). Cr and Cb of a pair share the same weights.
+ *
+ * PARAMETERS :
+ * @row0      : first wide chroma row
+ * @row1      : row past the last one
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraDualFOVFusion::blendChroma(uint32_t row0, uint32_t row1)
+{
+    const uint32_t width = (mRegion.x1 - mRegion.x0) / 2;
+    const uint32_t cy0 = mRegion.y0 / 2;
+    const uint32_t cy1 = mRegion.y1 / 2;
+    const uint32_t teleHeight = mTeleFrame.height / 2;
+    const uint32_t *colAlpha = mChromaColAlpha.data();
+    const uint32_t *colSrc = mChromaColSrc.data();
+    const uint8_t *tele = mTele +
+            (size_t)mTeleFrame.stride * mTeleFrame.scanline;
+    const size_t chromaOff = (size_t)mWideFrame.stride * mWideFrame.scanline;
+
+    for (uint32_t y = row0; y < row1; y++) {
+        uint32_t ty, wy;
+        int64_t fy = (int64_t)(y - cy0) * mRegion.stepY +
+                mRegion.stepY / 2 - 0x8000;
+        fy = (fy < 0) ? 0 : fy;
+        ty = (uint32_t)(fy >> 16);
+        wy = (uint32_t)(fy >> 8) & 0xFF;
+        if (ty >= teleHeight - 1) {
+            ty = teleHeight - 1;
+            wy = 0;
+        }
+        const uint8_t *t0 = tele + (size_t)ty * mTeleFrame.stride;
+        const uint8_t *t1 = (wy != 0) ? t0 + mTeleFrame.stride : t0;
+        const uint8_t *src = mWide + chromaOff +
+                (size_t)y * mWideFrame.stride + mRegion.x0;
+        uint8_t *dst = mOut + chromaOff + (size_t)y * mWideFrame.stride +
+                mRegion.x0;
+
+        for (uint32_t i = 0; i < width; i++) {
+            uint32_t tx = (colSrc[i] >> 8) * 2;
+            uint32_t wx = colSrc[i] & 0xFF;
+            uint32_t tx1 = tx + ((wx != 0) ? 2 : 0);
+            uint32_t a = alphaOf(colAlpha[i], y, cy0, cy1, mChromaFeather);
+            for (uint32_t c = 0; c < 2; c++) {
+                uint32_t top = t0[tx + c] * (256 - wx) + t0[tx1 + c] * wx;
+                uint32_t bot = t1[tx + c] * (256 - wx) + t1[tx1 + c] * wx;
+                uint32_t tv = (top * (256 - wy) + bot * wy + 0x8000) >> 16;
+                dst[2 * i + c] = (uint8_t)((src[2 * i + c] * (256 - a) +
+                        tv * a + 128) >> 8);
+            }
+        }
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : alphaOf
+ *
+ * DESCRIPTION: Tele weight of a region pixel: the lower of its column and
+ *              row border ramps, scaled by the tele weight.
+ *
+ * PARAMETERS :
+ * @colAlpha  : border alpha of the column
+ * @y         : row
+ * @y0        : first region row
+ * @y1        : row past the last region row
+ * @feather   : width of the border ramp
+ *
+ * RETURN     : weight of tele, 0 to 256
+ *
+ *==========================================================================*/
+uint32_t QCameraDualFOVFusion::alphaOf(uint32_t colAlpha, uint32_t y,
+        uint32_t y0, uint32_t y1, uint32_t feather) const
+{
+    uint32_t top = y - y0;
+    uint32_t bottom = y1 - 1 - y;
+    uint32_t dist = (top < bottom) ? top : bottom;
+    uint32_t a = (dist >= feather) ? 256 : (dist + 1) * 256 / (feather + 1);
+    if (colAlpha < a) {
+        a = colAlpha;
+    }
+    return (a * mParams.teleWeight) >> 8;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : buildColumns
+ *
+ * DESCRIPTION: Build the per-column border alpha and tele source tables of
+ *              a plane, so the inner loops do no division.
+ *
+ * PARAMETERS :
+ * @width     : region width in plane pixels
+ * @srcWidth  : tele width in plane pixels
+ * @step      : tele pixels per region pixel, 16.16
+ * @feather   : width of the border ramp
+ * @alpha     : filled with the border alpha per column
+ * @src       : filled with the tele column << 8 | bilinear weight
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraDualFOVFusion::buildColumns(uint32_t width, uint32_t srcWidth,
+        uint32_t step, uint32_t feather, std::vector<uint32_t> &alpha,
+        std::vector<uint32_t> &src)
+{
+    alpha.resize(width);
+    src.resize(width);
+    for (uint32_t i = 0; i < width; i++) {
+        uint32_t right = width - 1 - i;
+        uint32_t dist = (i < right) ? i : right;
+        alpha[i] = (dist >= feather) ? 256 : (dist + 1) * 256 / (feather + 1);
+
+        int64_t fx = (int64_t)i * step + step / 2 - 0x8000;
+        fx = (fx < 0) ? 0 : fx;
+        uint32_t tx = (uint32_t)(fx >> 16);
+        uint32_t wx = (uint32_t)(fx >> 8) & 0xFF;
+        if (tx >= srcWidth - 1) {
+            tx = srcWidth - 1;
+            wx = 0;
+        }
+        src[i] = (tx << 8) | wx;
+    }
+}
+
+}; // namespace qcamera
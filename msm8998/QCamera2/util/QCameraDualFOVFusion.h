@@ -0,0 +1,146 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_DUAL_FOV_FUSION_H__
+#define __QCAMERA_DUAL_FOV_FUSION_H__
+
+// System dependencies
+#include <atomic>
+#include <pthread.h>
+#include <stdint.h>
+#include <vector>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+#define FUSION_MAX_THREADS    8
+#define FUSION_TILE_ROWS      64
+
+// Semi-planar YUV 4:2:0 frame: luma plane followed by the interleaved chroma
+// plane at stride * scanline.
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;
+    uint32_t scanline;
+} fusion_frame_t;
+
+typedef struct {
+    float    fovRatio;    // Tele FOV over wide FOV, in (0, 1]
+    int32_t  shiftX;      // Tele region offset from the wide center, in
+    int32_t  shiftY;      // wide luma pixels
+    uint32_t featherPx;   // Width of the blend ramp at the region border
+    uint32_t teleWeight;  // Weight of tele inside the region, 0 to 256
+} fusion_params_t;
+
+typedef struct {
+    uint32_t threads;     // Threads working on a frame, caller included
+    uint32_t tiles;       // Tiles of the last frame
+    nsecs_t  frameNs;     // Time of the last frame
+    nsecs_t  tileAvgNs;   // Average tile time of the last frame
+    nsecs_t  tileMaxNs;   // Slowest tile of the last frame
+} fusion_stats_t;
+
+/*
+ * QCameraDualFOVFusion blends the tele frame into the matching region of the
+ * wide frame. The tele region is the centered wide area covering fovRatio of
+ * the wide FOV, moved by the alignment shift. Tele pixels are resampled to
+ * the region with a bilinear filter and blended over a feathered border, so
+ * the seam with the wide frame does not show.
+ *
+ * A frame is split into bands of FUSION_TILE_ROWS luma rows that a worker
+ * pool and the calling thread process in parallel. The output may be the
+ * wide frame itself, in which case only the tele region is written.
+ */
+class QCameraDualFOVFusion {
+public:
+    QCameraDualFOVFusion(uint32_t numThreads);
+    virtual ~QCameraDualFOVFusion();
+
+    int32_t process(const uint8_t *pWide, const fusion_frame_t &wide,
+            const uint8_t *pTele, const fusion_frame_t &tele,
+            const fusion_params_t &params, uint8_t *pOut);
+    void getStats(fusion_stats_t &stats);
+
+private:
+    typedef struct {
+        uint32_t x0;       // Region in wide luma pixels, [x0, x1) x [y0, y1)
+        uint32_t x1;
+        uint32_t y0;
+        uint32_t y1;
+        uint32_t stepX;    // Tele luma pixels per region pixel, 16.16
+        uint32_t stepY;
+    } region_t;
+
+    static void *workerRoutine(void *data);
+    void runTiles();
+    void processTile(uint32_t tile);
+    void blendLuma(uint32_t row0, uint32_t row1);
+    void blendChroma(uint32_t row0, uint32_t row1);
+    static void buildColumns(uint32_t width, uint32_t srcWidth, uint32_t step,
+            uint32_t feather, std::vector<uint32_t> &alpha,
+            std::vector<uint32_t> &src);
+    uint32_t alphaOf(uint32_t colAlpha, uint32_t y, uint32_t y0, uint32_t y1,
+            uint32_t feather) const;
+
+    // Job of the current frame, read-only while tiles run
+    const uint8_t *mWide;
+    const uint8_t *mTele;
+    uint8_t *mOut;
+    fusion_frame_t mWideFrame;
+    fusion_frame_t mTeleFrame;
+    fusion_params_t mParams;
+    region_t mRegion;
+    uint32_t mChromaFeather;
+    std::vector<uint32_t> mLumaColAlpha;   // Border alpha per region column
+    std::vector<uint32_t> mChromaColAlpha;
+    std::vector<uint32_t> mLumaColSrc;     // Tele column per region column,
+    std::vector<uint32_t> mChromaColSrc;   // index << 8 | bilinear weight
+    uint32_t mTiles;
+
+    std::atomic<uint32_t> mNextTile;
+    std::atomic<uint32_t> mTilesDone;
+    std::atomic<int64_t> mTileNsSum;
+    std::atomic<int64_t> mTileNsMax;
+
+    uint32_t mNumThreads;
+    pthread_t mThreads[FUSION_MAX_THREADS];
+    uint32_t mNumStarted;
+    pthread_mutex_t mLock;
+    pthread_cond_t mWorkCond;
+    pthread_cond_t mDoneCond;
+    uint64_t mJobGen;
+    uint32_t mActive;                      // Workers inside runTiles()
+    bool mExit;
+    fusion_stats_t mStats;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_DUAL_FOV_FUSION_H__ */
@@ -59,6 +59,11 @@ QCameraDualFOVPP::QCameraDualFOVPP()
 {
     m_dlHandle = NULL;
     m_pCaps = NULL;
+    m_pFusion = NULL;
+    m_fuseStage = 0;
+    m_syncStage = 0;
+    memset(&m_fusionParams, 0, sizeof(m_fusionParams));
+    m_bDumpImg = false;
 }
 
 /*===========================================================================
@@ -72,6 +77,12 @@ QCameraDualFOVPP::QCameraDualFOVPP()
  *==========================================================================*/
 QCameraDualFOVPP::~QCameraDualFOVPP()
 {
+    // The fusion stage uses m_pFusion
+    m_graph.stop();
+    if (m_pFusion != NULL) {
+        delete m_pFusion;
+        m_pFusion = NULL;
+    }
 }
 
 /*===========================================================================
@@ -102,6 +113,19 @@ int32_t QCameraDualFOVPP::init(halPPBufNotify bufNotifyCb, halPPGetOutput getOut
     /* we should load 3rd libs here, with dlopen/dlsym */
     doDualFovPPInit();
 
+    if (m_graph.getNumStages() == 0) {
+        rc = addStage("dfov_fuse", fuseStage, &m_fuseStage);
+        if (rc == NO_ERROR) {
+            rc = addStage("dfov_sync", syncStage, &m_syncStage);
+        }
+        if (rc == NO_ERROR) {
+            rc = m_graph.link(m_fuseStage, m_syncStage);
+        }
+        if (rc != NO_ERROR) {
+            LOGE("Failed to set up Dual FOV stages, rc = %d", rc);
+        }
+    }
+
     LOGD("X");
     return rc;
 }
@@ -123,6 +147,11 @@ int32_t QCameraDualFOVPP::deinit()
     LOGD("E");
 
     m_dlHandle = NULL;
+    m_graph.stop();
+    if (m_pFusion != NULL) {
+        delete m_pFusion;
+        m_pFusion = NULL;
+    }
 
     QCameraHALPP::deinit();
     LOGD("X");
@@ -343,12 +372,6 @@ int32_t QCameraDualFOVPP::process()
 {
     int32_t rc = NO_ERROR;
 
-    /* dump in/out frames */
-    char prop[PROPERTY_VALUE_MAX];
-    memset(prop, 0, sizeof(prop));
-    property_get("persist.camera.dualfov.dumpimg", prop, "0");
-    int dumpimg = atoi(prop);
-
     LOGD("E");
 
     // TODO: dequeue from m_inputQ and start process logic
@@ -435,7 +458,7 @@ int32_t QCameraDualFOVPP::process()
                 frm_offset.mp[0].stride, frm_offset.mp[0].scanline,
                 frm_offset.frame_len);
 
-        if (dumpimg) {
+        if (m_bDumpImg) {
             dumpYUVtoFile((uint8_t *)main_snapshot_buf->buffer, frm_offset,
                     main_snapshot_buf->frame_idx, "wide");
             dumpYUVtoFile((uint8_t *)aux_snapshot_buf->buffer,  frm_offset,
@@ -452,42 +475,105 @@ int32_t QCameraDualFOVPP::process()
                 inParams);
         dumpInputParams(inParams);
 
-        doDualFovPPProcess((const uint8_t *)main_snapshot_buf->buffer,
-                        (const uint8_t *)aux_snapshot_buf->buffer,
-                        inParams,
-                        (uint8_t *)output_snapshot_buf->buffer);
+        // Fusion and the cache maintenance run on the stage threads, so
+        // the next frame can be matched while this one is processed.
+        dualfov_job_t *pJob = new dualfov_job_t;
+        pJob->frameIndex = frameIndex;
+        pJob->pOutput = pOutputData;
+        pJob->pInputs[WIDE_INPUT] = pInputMainData;
+        pJob->pInputs[TELE_INPUT] = pInputAuxData;
+        pJob->numInputs = WIDE_TELE_CAMERA_NUMBER;
+        pJob->pWideBuf = main_snapshot_buf;
+        pJob->pTeleBuf = aux_snapshot_buf;
+        pJob->pOutBuf = output_snapshot_buf;
+        pJob->offset = frm_offset;
+        pJob->inParams = inParams;
 
-        if (dumpimg) {
-            dumpYUVtoFile((uint8_t *)output_snapshot_buf->buffer, frm_offset,
-                    main_snapshot_buf->frame_idx, "out");
+        // Release internal resource
+        m_frameMap.erase(frameIndex);
+        delete pFrameIndex;
+        delete pVector;
+
+        rc = submitJob(m_fuseStage, pJob);
+        if (rc != NO_ERROR) {
+            LOGE("Failed to submit frame %d, rc = %d", frameIndex, rc);
+            onJobDropped(pJob);
         }
+    }
+    LOGD("X");
+    return rc;
+}
+
+/*===========================================================================
+ * FUNCTION   : fuseStage
+ *
+ * DESCRIPTION: stage blending the tele frame of a job into its output. A
+ *              frame the fusion fails on goes on with the wide frame.
+ *
+ * PARAMETERS :
+ *   @pData     : dualfov_job_t of the frame
+ *   @pUserData : QCameraDualFOVPP object
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, the frame is dropped
+ *==========================================================================*/
+int32_t QCameraDualFOVPP::fuseStage(void *pData, void *pUserData)
+{
+    QCameraDualFOVPP *pme = (QCameraDualFOVPP *)pUserData;
+    dualfov_job_t *pJob = (dualfov_job_t *)pData;
 
-        /* clean and invalidate caches, for input and output buffers*/
-        pOutputData->snapshot_heap->cleanInvalidateCache(0);
+    if ((pJob->pWideBuf->buffer == NULL) || (pJob->pOutBuf->buffer == NULL)) {
+        // Nothing can be written to the output, drop the frame
+        LOGE("Invalid buffers for frame %d", pJob->frameIndex);
+        return BAD_VALUE;
+    }
 
-        QCameraMemory *pMem = (QCameraMemory *)main_snapshot_buf->mem_info;
-        pMem->invalidateCache(main_snapshot_buf->buf_idx);
+    int32_t rc = pme->doDualFovPPProcess((const uint8_t *)pJob->pWideBuf->buffer,
+            (const uint8_t *)pJob->pTeleBuf->buffer, pJob->inParams,
+            (uint8_t *)pJob->pOutBuf->buffer);
+    if (rc != NO_ERROR) {
+        // The output holds the wide frame, encode it without tele
+        LOGW("Dual FOV fusion failed for frame %d, rc = %d, using wide frame",
+                pJob->frameIndex, rc);
+    }
+    return NO_ERROR;
+}
 
-        pMem = (QCameraMemory *)aux_snapshot_buf->mem_info;
-        pMem->invalidateCache(aux_snapshot_buf->buf_idx);
+/*===========================================================================
+ * FUNCTION   : syncStage
+ *
+ * DESCRIPTION: stage dumping the output of a job and doing the cache
+ *              maintenance of its input and output buffers
+ *
+ * PARAMETERS :
+ *   @pData     : dualfov_job_t of the frame
+ *   @pUserData : QCameraDualFOVPP object
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraDualFOVPP::syncStage(void *pData, void *pUserData)
+{
+    QCameraDualFOVPP *pme = (QCameraDualFOVPP *)pUserData;
+    dualfov_job_t *pJob = (dualfov_job_t *)pData;
 
+    if (pme->m_bDumpImg) {
+        pme->dumpYUVtoFile((uint8_t *)pJob->pOutBuf->buffer, pJob->offset,
+                pJob->pWideBuf->frame_idx, "out");
+    }
 
-        // Calling cb function to return output_data after processed.
-        m_halPPBufNotifyCB(pOutputData, m_pQCameraPostProc);
+    /* clean and invalidate caches, for input and output buffers*/
+    pJob->pOutput->snapshot_heap->cleanInvalidateCache(0);
 
-        // also send input buffer to postproc.
-        m_halPPBufNotifyCB(pInputMainData, m_pQCameraPostProc);
-        m_halPPBufNotifyCB(pInputAuxData, m_pQCameraPostProc);
-        //releaseData(pInputMainData);
-        //releaseData(pInputAuxData);
+    QCameraMemory *pMem = (QCameraMemory *)pJob->pWideBuf->mem_info;
+    pMem->invalidateCache(pJob->pWideBuf->buf_idx);
 
-        // Release internal resource
-        m_frameMap.erase(frameIndex);
-        delete pFrameIndex;
-        delete pVector;
-    }
-    LOGD("X");
-    return rc;
+    pMem = (QCameraMemory *)pJob->pTeleBuf->mem_info;
+    pMem->invalidateCache(pJob->pTeleBuf->buf_idx);
+
+    return NO_ERROR;
 }
 
 /*===========================================================================
@@ -669,44 +755,174 @@ void QCameraDualFOVPP::getInputParams(mm_camera_buf_def_t *pMainMetaBuf,
 }
 
 
+/*===========================================================================
+ * FUNCTION   : doDualFovPPInit
+ *
+ * DESCRIPTION: Read the fusion properties and start the fusion engine. The
+ *              properties are sampled once here for the whole session.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
 int32_t QCameraDualFOVPP::doDualFovPPInit()
 {
     LOGD("E");
     int rc = NO_ERROR;
+    char prop[PROPERTY_VALUE_MAX];
+
+    /* dump in/out frames */
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dualfov.dumpimg", prop, "0");
+    m_bDumpImg = (atoi(prop) != 0);
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dualfov.threads", prop, "4");
+    int threads = atoi(prop);
+
+    // Tele FOV over wide FOV, and alignment of the tele center in the wide
+    // frame, until they come from the dual camera calibration.
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dualfov.fovratio", prop, "0.5");
+    m_fusionParams.fovRatio = atof(prop);
+    if (!(m_fusionParams.fovRatio > 0.0f) || (m_fusionParams.fovRatio > 1.0f)) {
+        LOGW("Invalid fov ratio %f, using 0.5", m_fusionParams.fovRatio);
+        m_fusionParams.fovRatio = 0.5f;
+    }
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dualfov.shiftx", prop, "0");
+    m_fusionParams.shiftX = atoi(prop);
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dualfov.shifty", prop, "0");
+    m_fusionParams.shiftY = atoi(prop);
+
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dualfov.feather", prop, "32");
+    m_fusionParams.featherPx = (uint32_t)atoi(prop);
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.dualfov.teleweight", prop, "256");
+    int teleWeight = atoi(prop);
+    if ((teleWeight < 0) || (teleWeight > 256)) {
+        LOGW("Invalid tele weight %d, clamping to [0, 256]", teleWeight);
+        teleWeight = (teleWeight < 0) ? 0 : 256;
+    }
+    m_fusionParams.teleWeight = (uint32_t)teleWeight;
+
+    if (m_pFusion == NULL) {
+        m_pFusion = new QCameraDualFOVFusion((threads > 0) ? (uint32_t)threads : 1);
+    }
+    LOGH("fusion threads %d, fov ratio %f, shift %d,%d, feather %d, weight %d",
+            threads, m_fusionParams.fovRatio, m_fusionParams.shiftX,
+            m_fusionParams.shiftY, m_fusionParams.featherPx,
+            m_fusionParams.teleWeight);
 
     LOGD("X");
     return rc;
 }
 
+/*===========================================================================
+ * FUNCTION   : doDualFovPPProcess
+ *
+ * DESCRIPTION: Fuse the tele frame into the wide frame. The tele frame is
+ *              left out if tele is not in focus. The fov ratio property is
+ *              the tele FOV at 1x zoom; the wide frame is cropped by the user
+ *              zoom, so tele covers a larger part of it as zoom goes up. If
+ *              the fusion fails, the wide frame is copied to the output.
+ *
+ * PARAMETERS :
+ *   @pWide     : wide frame
+ *   @pTele     : tele frame
+ *   @inParams  : frame sizes and per frame state
+ *   @pOut      : output frame with the wide frame layout, may be pWide
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
 int32_t QCameraDualFOVPP::doDualFovPPProcess(const uint8_t* pWide, const uint8_t* pTele,
                                                     dualfov_input_params_t inParams,
                                                     uint8_t* pOut)
 {
-    LOGW("E.");
+    LOGD("E.");
+    ATRACE_CALL();
 
-    // trace begin
+    if ((pWide == NULL) || (pOut == NULL)) {
+        LOGE("Invalid wide or output frame");
+        return BAD_VALUE;
+    }
 
-    // half image from main, and half image from tele
+    int32_t rc = NO_INIT;
+    if (m_pFusion != NULL) {
+        rc = fuseFrames(pWide, pTele, inParams, pOut);
+    } else {
+        LOGE("Fusion engine not initialized");
+    }
 
-    // Y
-    memcpy(pOut, pWide, inParams.wide.stride * inParams.wide.scanline / 2);
-    memcpy(pOut  + inParams.wide.stride * inParams.wide.scanline / 2,
-           pTele + inParams.wide.stride * inParams.wide.scanline / 2,
-           inParams.wide.stride * inParams.wide.scanline / 2);
+    if ((rc != NO_ERROR) && (pOut != pWide)) {
+        // The output is encoded either way, so give it the wide frame
+        memcpy(pOut, pWide, inParams.wide.frame_len);
+    }
 
-    // UV
-    uint32_t uv_offset = inParams.wide.stride * inParams.wide.scanline;
-    memcpy(pOut  + uv_offset,
-           pWide + uv_offset,
-           inParams.wide.stride * (inParams.wide.scanline / 2) / 2);
-    memcpy(pOut  + uv_offset + inParams.wide.stride * (inParams.wide.scanline / 2) / 2,
-           pTele + uv_offset + inParams.wide.stride * (inParams.wide.scanline / 2) / 2,
-           inParams.wide.stride * (inParams.wide.scanline / 2) / 2);
+    LOGD("X.");
+    return rc;
+}
 
-    // trace end
+/*===========================================================================
+ * FUNCTION   : fuseFrames
+ *
+ * DESCRIPTION: run the fusion engine on a frame pair
+ *
+ * PARAMETERS :
+ *   @pWide     : wide frame
+ *   @pTele     : tele frame
+ *   @inParams  : frame sizes and per frame state
+ *   @pOut      : output frame with the wide frame layout, may be pWide
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code, pOut is not written
+ *==========================================================================*/
+int32_t QCameraDualFOVPP::fuseFrames(const uint8_t* pWide, const uint8_t* pTele,
+                                     const dualfov_input_params_t &inParams,
+                                     uint8_t* pOut)
+{
+    fusion_frame_t wide, tele;
+    wide.width    = inParams.wide.width;
+    wide.height   = inParams.wide.height;
+    wide.stride   = inParams.wide.stride;
+    wide.scanline = inParams.wide.scanline;
+    tele.width    = inParams.tele.width;
+    tele.height   = inParams.tele.height;
+    tele.stride   = inParams.tele.stride;
+    tele.scanline = inParams.tele.scanline;
+
+    fusion_params_t params = m_fusionParams;
+    if (inParams.af_status != AF_STATUS_VALID) {
+        params.teleWeight = 0;
+    }
+    // user_zoom is the zoom ratio * 4096
+    if (inParams.user_zoom > 4096) {
+        params.fovRatio = params.fovRatio * (float)inParams.user_zoom / 4096.0f;
+        if (params.fovRatio > 1.0f) {
+            params.fovRatio = 1.0f;
+        }
+    }
 
-    LOGW("X.");
-    return NO_ERROR;
+    int32_t rc = m_pFusion->process(pWide, wide, pTele, tele, params, pOut);
+    if (rc != NO_ERROR) {
+        LOGE("Fusion failed, rc = %d, fov ratio %f", rc, params.fovRatio);
+        return rc;
+    }
+
+    fusion_stats_t stats;
+    m_pFusion->getStats(stats);
+    LOGD("fusion: %d threads, %d tiles, frame %lld us, tile avg %lld us max %lld us",
+            stats.threads, stats.tiles, (long long)ns2us(stats.frameNs),
+            (long long)ns2us(stats.tileAvgNs), (long long)ns2us(stats.tileMaxNs));
+
+    return rc;
 }
 
 uint32_t QCameraDualFOVPP::getUserZoomRatio(int32_t zoom_level)
@@ -722,7 +938,8 @@ uint32_t QCameraDualFOVPP::getUserZoomRatio(int32_t zoom_level)
     }
 
     // user_zoom_ratio = qcom_zoom_ratio * 4096 / 100
-    if (m_pCaps != NULL) {
+    if ((m_pCaps != NULL) && ((size_t)zoom_level < m_pCaps->zoom_ratio_tbl_cnt) &&
+            (zoom_level < MAX_ZOOMS_CNT)) {
         zoom_ratio *= m_pCaps->zoom_ratio_tbl[zoom_level];
         zoom_ratio /= 100;
         LOGD("converted zoom ratio:%d", zoom_ratio);
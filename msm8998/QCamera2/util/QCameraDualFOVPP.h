@@ -32,6 +32,7 @@
 
 // Camera dependencies
 #include "QCameraHALPP.h"
+#include "QCameraDualFOVFusion.h"
 
 #define WIDE_TELE_CAMERA_NUMBER 2
 enum halPPInputType {
@@ -69,6 +70,20 @@ typedef struct _dualfov_output_params_t {
 
 namespace qcamera {
 
+/* Frame going through the Dual FOV stages */
+struct dualfov_job_t : public qcamera_hal_pp_job_t {
+    mm_camera_buf_def_t *pWideBuf;
+    mm_camera_buf_def_t *pTeleBuf;
+    mm_camera_buf_def_t *pOutBuf;
+    cam_frame_len_offset_t offset;
+    dualfov_input_params_t inParams;
+
+    dualfov_job_t() : pWideBuf(NULL), pTeleBuf(NULL), pOutBuf(NULL) {
+        memset(&offset, 0, sizeof(offset));
+        memset(&inParams, 0, sizeof(inParams));
+    }
+};
+
 class QCameraDualFOVPP : public QCameraHALPP
 {
 public:
@@ -94,16 +109,25 @@ private:
     int32_t doDualFovPPInit();
     int32_t doDualFovPPProcess(const uint8_t* pWide, const uint8_t* pTele,
             dualfov_input_params_t inParams, uint8_t* pOut);
+    int32_t fuseFrames(const uint8_t* pWide, const uint8_t* pTele,
+            const dualfov_input_params_t &inParams, uint8_t* pOut);
     uint32_t getUserZoomRatio(int32_t zoom_level);
     void dumpYUVtoFile(const uint8_t* pBuf, cam_frame_len_offset_t offset, uint32_t idx,
             const char* name_prefix);
     void dumpInputParams(const dualfov_input_params_t& p);
     void dumpOISData(metadata_buffer_t*  pMetadata);
+    static int32_t fuseStage(void *pData, void *pUserData);
+    static int32_t syncStage(void *pData, void *pUserData);
 
 
 private:
     void *m_dlHandle;
     const cam_capability_t *m_pCaps;
+    QCameraDualFOVFusion *m_pFusion;
+    uint32_t m_fuseStage;
+    uint32_t m_syncStage;
+    fusion_params_t m_fusionParams;
+    bool m_bDumpImg;
 }; // QCameraDualFOVPP class
 }; // namespace qcamera
 
@@ -55,6 +55,12 @@ namespace qcamera {
 QCameraFOVControl::QCameraFOVControl()
 {
     mZoomTranslator = NULL;
+    mUseLut = false;
+    mOverride = false;
+    mSacOutputWideValid = false;
+    mSacOutputTeleValid = false;
+    memset(&mSacOutputWide,    0, sizeof(cam_sac_output_info_t));
+    memset(&mSacOutputTele,    0, sizeof(cam_sac_output_info_t));
     memset(&mDualCamParams,    0, sizeof(dual_cam_params_t));
     memset(&mFovControlConfig, 0, sizeof(fov_control_config_t));
     memset(&mFovControlData,   0, sizeof(fov_control_data_t));
@@ -136,6 +142,10 @@ QCameraFOVControl* QCameraFOVControl::create(
                     pFovControl->mFovControlData.lpmEnabled = true;
                 }
 
+                // Check if zoom and ROI lookup tables are enabled
+                property_get("persist.camera.fovc.lut", prop, "1");
+                pFovControl->mUseLut = (atoi(prop) != 0);
+
                 // Open the external zoom translation library if requested
                 if (FOVC_USE_EXTERNAL_ZOOM_TRANSLATOR) {
                     pFovControl->mZoomTranslator =
@@ -407,6 +417,10 @@ void QCameraFOVControl::resetVars()
 
     // WA for now until the QTI solution is in place writing the spatial alignment ready status
     mFovControlData.spatialAlignResult.readyStatus = 1;
+
+    // Shifts were reset, recalculate them from the next spatial alignment output
+    mSacOutputWideValid = false;
+    mSacOutputTeleValid = false;
 }
 
 /*===========================================================================
@@ -507,9 +521,24 @@ int32_t QCameraFOVControl::updateConfigSettings(
 
             calculateDualCamTransitionParams();
 
+            // Build the zoom and ROI lookup tables for this configuration
+            mMutex.lock();
+            if (mUseLut) {
+                mLut.build(mFovControlData.zoomRatioTable,
+                        mFovControlData.zoomRatioTableCount,
+                        mFovControlData.transitionParams.cutOverFactor,
+                        mFovControlData.transitionParams.cropRatio);
+            } else {
+                mLut.clear();
+            }
+            mMutex.unlock();
+
+            char prop[PROPERTY_VALUE_MAX];
+            property_get("persist.camera.fovc.override", prop, "0");
+            mOverride = (atoi(prop) != 0);
+
             // Set initial camera state
-            float zoom = findZoomRatio(mFovControlData.zoomWide) /
-                    (float)mFovControlData.zoomRatioTable[0];
+            float zoom = userZoomOf(mFovControlData.zoomWide);
             if (zoom > mFovControlData.transitionParams.cutOverWideToTele) {
                 mFovControlResult.camMasterPreview  = mFovControlData.camTele;
                 mFovControlResult.camMaster3A       = mFovControlData.camTele;
@@ -742,44 +771,9 @@ metadata_buffer_t* QCameraFOVControl::processResultMetadata(
         if (metaWide) {
             IF_META_AVAILABLE(cam_sac_output_info_t, spatialAlignOutput,
                 CAM_INTF_META_DC_SAC_OUTPUT_INFO, metaWide) {
-                // Get spatial alignment output shift for wide camera
-
-                if (spatialAlignOutput->is_output_shift_valid) {
-                    // Calculate the spatial alignment shift for the current stream dimensions based
-                    // on the reference resolution used for the output shift.
-                    float horzShiftFactor = (float)mFovControlData.previewSize.width /
-                            spatialAlignOutput->reference_res_for_output_shift.width;
-                    float vertShiftFactor = (float)mFovControlData.previewSize.height /
-                            spatialAlignOutput->reference_res_for_output_shift.height;
-
-                    mFovControlData.spatialAlignResult.shiftWide.shiftHorz =
-                            spatialAlignOutput->output_shift.shift_horz * horzShiftFactor;
-                    mFovControlData.spatialAlignResult.shiftWide.shiftVert =
-                            spatialAlignOutput->output_shift.shift_vert * vertShiftFactor;
-
-                    LOGD("SAC output shift for Wide: x:%d, y:%d",
-                            mFovControlData.spatialAlignResult.shiftWide.shiftHorz,
-                            mFovControlData.spatialAlignResult.shiftWide.shiftVert);
-                }
-
-                // Get the AF roi shift for wide camera
-                if (spatialAlignOutput->is_focus_roi_shift_valid) {
-                    // Calculate the spatial alignment shift for the current stream dimensions based
-                    // on the reference resolution used for the output shift.
-                    float horzShiftFactor = (float)mFovControlData.previewSize.width /
-                            spatialAlignOutput->reference_res_for_focus_roi_shift.width;
-                    float vertShiftFactor = (float)mFovControlData.previewSize.height /
-                            spatialAlignOutput->reference_res_for_focus_roi_shift.height;
-
-                    mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftHorz =
-                            spatialAlignOutput->focus_roi_shift.shift_horz * horzShiftFactor;
-                    mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftVert =
-                            spatialAlignOutput->focus_roi_shift.shift_vert * vertShiftFactor;
-
-                    LOGD("SAC AF ROI shift for Wide: x:%d, y:%d",
-                            mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftHorz,
-                            mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftVert);
-                }
+                updateSpatialAlignShift(*spatialAlignOutput, mSacOutputWide,
+                        mSacOutputWideValid, mFovControlData.spatialAlignResult.shiftWide,
+                        mFovControlData.spatialAlignResult.shiftAfRoiWide, "Wide");
             }
         }
 
@@ -787,44 +781,9 @@ metadata_buffer_t* QCameraFOVControl::processResultMetadata(
         if (metaTele) {
             IF_META_AVAILABLE(cam_sac_output_info_t, spatialAlignOutput,
                 CAM_INTF_META_DC_SAC_OUTPUT_INFO, metaTele) {
-
-                // Get spatial alignment output shift for tele camera
-                if (spatialAlignOutput->is_output_shift_valid) {
-                    // Calculate the spatial alignment shift for the current stream dimensions based
-                    // on the reference resolution used for the output shift.
-                    float horzShiftFactor = (float)mFovControlData.previewSize.width /
-                            spatialAlignOutput->reference_res_for_output_shift.width;
-                    float vertShiftFactor = (float)mFovControlData.previewSize.height /
-                            spatialAlignOutput->reference_res_for_output_shift.height;
-
-                    mFovControlData.spatialAlignResult.shiftTele.shiftHorz =
-                            spatialAlignOutput->output_shift.shift_horz * horzShiftFactor;
-                    mFovControlData.spatialAlignResult.shiftTele.shiftVert =
-                            spatialAlignOutput->output_shift.shift_vert * vertShiftFactor;
-
-                    LOGD("SAC output shift for Tele: x:%d, y:%d",
-                            mFovControlData.spatialAlignResult.shiftTele.shiftHorz,
-                            mFovControlData.spatialAlignResult.shiftTele.shiftVert);
-                }
-
-                // Get the AF roi shift for tele camera
-                if (spatialAlignOutput->is_focus_roi_shift_valid) {
-                    // Calculate the spatial alignment shift for the current stream dimensions based
-                    // on the reference resolution used for the output shift.
-                    float horzShiftFactor = (float)mFovControlData.previewSize.width /
-                            spatialAlignOutput->reference_res_for_focus_roi_shift.width;
-                    float vertShiftFactor = (float)mFovControlData.previewSize.height /
-                            spatialAlignOutput->reference_res_for_focus_roi_shift.height;
-
-                    mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftHorz =
-                            spatialAlignOutput->focus_roi_shift.shift_horz * horzShiftFactor;
-                    mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftVert =
-                            spatialAlignOutput->focus_roi_shift.shift_vert * vertShiftFactor;
-
-                    LOGD("SAC AF ROI shift for Tele: x:%d, y:%d",
-                            mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftHorz,
-                            mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftVert);
-                }
+                updateSpatialAlignShift(*spatialAlignOutput, mSacOutputTele,
+                        mSacOutputTeleValid, mFovControlData.spatialAlignResult.shiftTele,
+                        mFovControlData.spatialAlignResult.shiftAfRoiTele, "Tele");
             }
         }
 
@@ -909,10 +868,13 @@ metadata_buffer_t* QCameraFOVControl::processResultMetadata(
             // Translate face detection ROI from aux camera
             IF_META_AVAILABLE(cam_face_detection_data_t, metaFD,
                     CAM_INTF_META_FACE_DETECTION, metaAux) {
-                cam_face_detection_data_t metaFDTranslated;
-                metaFDTranslated = translateRoiFD(*metaFD, CAM_TYPE_AUX);
-                ADD_SET_PARAM_ENTRY_TO_BATCH(metaAux, CAM_INTF_META_FACE_DETECTION,
-                        metaFDTranslated);
+                // Nothing to translate without faces
+                if (metaFD->num_faces_detected > 0) {
+                    cam_face_detection_data_t metaFDTranslated;
+                    metaFDTranslated = translateRoiFD(*metaFD, CAM_TYPE_AUX);
+                    ADD_SET_PARAM_ENTRY_TO_BATCH(metaAux, CAM_INTF_META_FACE_DETECTION,
+                            metaFDTranslated);
+                }
             }
             metaResult = metaAux;
         }
@@ -920,10 +882,13 @@ metadata_buffer_t* QCameraFOVControl::processResultMetadata(
             // Translate face detection ROI from main camera
             IF_META_AVAILABLE(cam_face_detection_data_t, metaFD,
                     CAM_INTF_META_FACE_DETECTION, metaMain) {
-                cam_face_detection_data_t metaFDTranslated;
-                metaFDTranslated = translateRoiFD(*metaFD, CAM_TYPE_MAIN);
-                ADD_SET_PARAM_ENTRY_TO_BATCH(metaMain, CAM_INTF_META_FACE_DETECTION,
-                        metaFDTranslated);
+                // Nothing to translate without faces
+                if (metaFD->num_faces_detected > 0) {
+                    cam_face_detection_data_t metaFDTranslated;
+                    metaFDTranslated = translateRoiFD(*metaFD, CAM_TYPE_MAIN);
+                    ADD_SET_PARAM_ENTRY_TO_BATCH(metaMain, CAM_INTF_META_FACE_DETECTION,
+                            metaFDTranslated);
+                }
             }
             metaResult = metaMain;
         } else {
@@ -978,6 +943,74 @@ metadata_buffer_t* QCameraFOVControl::processResultMetadata(
 }
 
 
+/*===========================================================================
+ * FUNCTION   : updateSpatialAlignShift
+ *
+ * DESCRIPTION: Update the spatial alignment shifts of a camera from its
+ *              spatial alignment output. The shifts are only recalculated
+ *              when the output differs from the last one seen for the camera.
+ *
+ * PARAMETERS :
+ * @sacOutput          : spatial alignment output from the camera metadata
+ * @sacOutputPrev      : last spatial alignment output seen for the camera
+ * @sacOutputPrevValid : true if sacOutputPrev holds an output
+ * @shift              : output shift to update
+ * @shiftAfRoi         : AF ROI shift to update
+ * @camName            : camera name for logging
+ *
+ * RETURN     : none
+ *
+ *==========================================================================*/
+void QCameraFOVControl::updateSpatialAlignShift(
+        const cam_sac_output_info_t &sacOutput,
+        cam_sac_output_info_t &sacOutputPrev,
+        bool &sacOutputPrevValid,
+        spatial_align_shift_t &shift,
+        spatial_align_shift_t &shiftAfRoi,
+        const char *camName)
+{
+    if (mUseLut && sacOutputPrevValid &&
+            !memcmp(&sacOutput, &sacOutputPrev, sizeof(cam_sac_output_info_t))) {
+        return;
+    }
+
+    // Get spatial alignment output shift for the camera
+    if (sacOutput.is_output_shift_valid) {
+        // Calculate the spatial alignment shift for the current stream dimensions based
+        // on the reference resolution used for the output shift.
+        float horzShiftFactor = (float)mFovControlData.previewSize.width /
+                sacOutput.reference_res_for_output_shift.width;
+        float vertShiftFactor = (float)mFovControlData.previewSize.height /
+                sacOutput.reference_res_for_output_shift.height;
+
+        shift.shiftHorz = sacOutput.output_shift.shift_horz * horzShiftFactor;
+        shift.shiftVert = sacOutput.output_shift.shift_vert * vertShiftFactor;
+
+        LOGD("SAC output shift for %s: x:%d, y:%d", camName,
+                shift.shiftHorz, shift.shiftVert);
+    }
+
+    // Get the AF roi shift for the camera
+    if (sacOutput.is_focus_roi_shift_valid) {
+        // Calculate the spatial alignment shift for the current stream dimensions based
+        // on the reference resolution used for the output shift.
+        float horzShiftFactor = (float)mFovControlData.previewSize.width /
+                sacOutput.reference_res_for_focus_roi_shift.width;
+        float vertShiftFactor = (float)mFovControlData.previewSize.height /
+                sacOutput.reference_res_for_focus_roi_shift.height;
+
+        shiftAfRoi.shiftHorz = sacOutput.focus_roi_shift.shift_horz * horzShiftFactor;
+        shiftAfRoi.shiftVert = sacOutput.focus_roi_shift.shift_vert * vertShiftFactor;
+
+        LOGD("SAC AF ROI shift for %s: x:%d, y:%d", camName,
+                shiftAfRoi.shiftHorz, shiftAfRoi.shiftVert);
+    }
+
+    sacOutputPrev = sacOutput;
+    sacOutputPrevValid = true;
+}
+
+
 /*===========================================================================
  * FUNCTION   : generateFovControlResult
  *
@@ -992,7 +1025,7 @@ void QCameraFOVControl::generateFovControlResult()
 {
     Mutex::Autolock lock(mMutex);
 
-    float zoom = findZoomRatio(mFovControlData.zoomWide) / (float)mFovControlData.zoomRatioTable[0];
+    float zoom = userZoomOf(mFovControlData.zoomWide);
     uint32_t zoomWide     = mFovControlData.zoomWide;
     uint32_t zoomWidePrev = mFovControlData.zoomWidePrev;
 
@@ -1317,16 +1350,12 @@ bool QCameraFOVControl::canSwitchMasterTo(
         cam_type cam)
 {
     bool ret = false;
-    float zoom = findZoomRatio(mFovControlData.zoomWide) / (float)mFovControlData.zoomRatioTable[0];
+    float zoom = userZoomOf(mFovControlData.zoomWide);
     float cutOverWideToTele = mFovControlData.transitionParams.cutOverWideToTele;
     float cutOverTeleToWide = mFovControlData.transitionParams.cutOverTeleToWide;
     af_status afStatusAux   = mFovControlData.status3A.aux.af.status;
 
-    char prop[PROPERTY_VALUE_MAX];
-    int override = 0;
-    property_get("persist.camera.fovc.override", prop, "0");
-    override = atoi(prop);
-    if(override) {
+    if (mOverride) {
         afStatusAux = AF_VALID;
     }
 
@@ -1419,11 +1448,7 @@ bool QCameraFOVControl::isSpatialAlignmentReady()
         }
     }
 
-    char prop[PROPERTY_VALUE_MAX];
-    int override = 0;
-    property_get("persist.camera.fovc.override", prop, "0");
-    override = atoi(prop);
-    if(override) {
+    if (mOverride) {
         ret = true;
     }
 
@@ -1707,14 +1732,8 @@ void QCameraFOVControl::calculateDualCamTransitionParams()
 uint32_t QCameraFOVControl::findZoomValue(
         uint32_t zoomRatio)
 {
-    uint32_t zoom = 0;
-    for (uint32_t i = 0; i < mFovControlData.zoomRatioTableCount; ++i) {
-        if (zoomRatio <= mFovControlData.zoomRatioTable[i]) {
-            zoom = i;
-            break;
-        }
-    }
-    return zoom;
+    return QCameraFOVControlLut::findZoomValue(mFovControlData.zoomRatioTable,
+            mFovControlData.zoomRatioTableCount, zoomRatio);
 }
 
 
@@ -1755,6 +1774,10 @@ uint32_t QCameraFOVControl::readjustZoomForTele(
     uint32_t zoomRatioWide;
     uint32_t zoomRatioTele;
 
+    if (mLut.isValid(zoomWide)) {
+        return mLut.at(zoomWide).zoomTele;
+    }
+
     zoomRatioWide = findZoomRatio(zoomWide);
     zoomRatioTele  = zoomRatioWide / mFovControlData.transitionParams.cutOverFactor;
 
@@ -1780,6 +1803,10 @@ uint32_t QCameraFOVControl::readjustZoomForWide(
     uint32_t zoomRatioWide;
     uint32_t zoomRatioTele;
 
+    if (mLut.isValid(zoomTele)) {
+        return mLut.at(zoomTele).zoomWide;
+    }
+
     zoomRatioTele = findZoomRatio(zoomTele);
     zoomRatioWide = zoomRatioTele * mFovControlData.transitionParams.cutOverFactor;
 
@@ -1787,6 +1814,67 @@ uint32_t QCameraFOVControl::readjustZoomForWide(
 }
 
 
+/*===========================================================================
+ * FUNCTION   : userZoomOf
+ *
+ * DESCRIPTION: Zoom ratio of a wide camera zoom value relative to 1x
+ *
+ * PARAMETERS :
+ * @zoomWide  : Zoom value for wide camera
+ *
+ * RETURN     : Zoom ratio
+ *
+ *==========================================================================*/
+float QCameraFOVControl::userZoomOf(
+        uint32_t zoomWide)
+{
+    if (mLut.isValid(zoomWide)) {
+        return mLut.at(zoomWide).userZoom;
+    }
+    return findZoomRatio(zoomWide) / (float)mFovControlData.zoomRatioTable[0];
+}
+
+
+/*===========================================================================
+ * FUNCTION   : getTeleRoiScale
+ *
+ * DESCRIPTION: Get the scale for translating ROIs from the wide to the tele
+ *              camera, and the scale for the tele AF ROI spatial alignment
+ *              shift, at the current wide and tele zoom values. The lookup
+ *              table is used unless the tele zoom came from the zoom
+ *              translation lib.
+ *
+ * PARAMETERS :
+ * @fovRatio  : ROI scale from wide to tele
+ * @shiftScale: Scale of the tele AF ROI shift
+ *
+ * RETURN     : none
+ *
+ *==========================================================================*/
+void QCameraFOVControl::getTeleRoiScale(
+        float &fovRatio,
+        float &shiftScale)
+{
+    uint32_t zoomWide = mFovControlData.zoomWide;
+    uint32_t zoomTele = mFovControlData.zoomTele;
+
+    if (mLut.isValid(zoomWide)) {
+        const fov_zoom_lut_entry_t &entry = mLut.at(zoomWide);
+        shiftScale = entry.shiftScaleTele;
+        if (entry.zoomTele == zoomTele) {
+            fovRatio = entry.fovRatioTele;
+            return;
+        }
+    } else {
+        shiftScale = mFovControlData.transitionParams.cropRatio / userZoomOf(zoomWide);
+    }
+
+    float zoomRatioWide = findZoomRatio(zoomWide);
+    float zoomRatioTele = findZoomRatio(zoomTele);
+    fovRatio = (zoomRatioTele / zoomRatioWide) * mFovControlData.transitionParams.cropRatio;
+}
+
+
 /*===========================================================================
  * FUNCTION   : convertUserZoomToWideAndTele
  *
@@ -1842,9 +1930,8 @@ cam_roi_info_t QCameraFOVControl::translateFocusAreas(
         cam_roi_info_t  roiAfMain,
         cam_sync_type_t cam)
 {
-    float fovRatio;
-    float zoomWide;
-    float zoomTele;
+    float fovRatio = 1.0f;
+    float shiftScale = 1.0f;
     float AuxDiffRoiLeft;
     float AuxDiffRoiTop;
     float AuxRoiLeft;
@@ -1852,15 +1939,9 @@ cam_roi_info_t QCameraFOVControl::translateFocusAreas(
     cam_roi_info_t roiAfTrans = roiAfMain;
     int32_t shiftHorzAdjusted;
     int32_t shiftVertAdjusted;
-    float zoom = findZoomRatio(mFovControlData.zoomWide) / (float)mFovControlData.zoomRatioTable[0];
-
-    zoomWide = findZoomRatio(mFovControlData.zoomWide);
-    zoomTele = findZoomRatio(mFovControlData.zoomTele);
 
-    if (cam == mFovControlData.camWide) {
-        fovRatio = 1.0f;
-    } else {
-        fovRatio = (zoomTele / zoomWide) * mFovControlData.transitionParams.cropRatio;
+    if (cam != mFovControlData.camWide) {
+        getTeleRoiScale(fovRatio, shiftScale);
     }
 
     // Acquire the mutex in order to read the spatial alignment result which is written
@@ -1870,9 +1951,9 @@ cam_roi_info_t QCameraFOVControl::translateFocusAreas(
         shiftHorzAdjusted = mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftHorz;
         shiftVertAdjusted = mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftVert;
     } else {
-        shiftHorzAdjusted = (mFovControlData.transitionParams.cropRatio / zoom) *
+        shiftHorzAdjusted = shiftScale *
                 mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftHorz;
-        shiftVertAdjusted = (mFovControlData.transitionParams.cropRatio / zoom) *
+        shiftVertAdjusted = shiftScale *
                 mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftVert;
     }
     mMutex.unlock();
@@ -1946,9 +2027,8 @@ cam_set_aec_roi_t QCameraFOVControl::translateMeteringAreas(
         cam_set_aec_roi_t roiAecMain,
         cam_sync_type_t cam)
 {
-    float fovRatio;
-    float zoomWide;
-    float zoomTele;
+    float fovRatio = 1.0f;
+    float shiftScale = 1.0f;
     float AuxDiffRoiX;
     float AuxDiffRoiY;
     float AuxRoiX;
@@ -1956,15 +2036,9 @@ cam_set_aec_roi_t QCameraFOVControl::translateMeteringAreas(
     cam_set_aec_roi_t roiAecTrans = roiAecMain;
     int32_t shiftHorzAdjusted;
     int32_t shiftVertAdjusted;
-    float zoom = findZoomRatio(mFovControlData.zoomWide) / (float)mFovControlData.zoomRatioTable[0];
-
-    zoomWide = findZoomRatio(mFovControlData.zoomWide);
-    zoomTele = findZoomRatio(mFovControlData.zoomTele);
 
-    if (cam == mFovControlData.camWide) {
-        fovRatio = 1.0f;
-    } else {
-        fovRatio = (zoomTele / zoomWide) * mFovControlData.transitionParams.cropRatio;
+    if (cam != mFovControlData.camWide) {
+        getTeleRoiScale(fovRatio, shiftScale);
     }
 
     // Acquire the mutex in order to read the spatial alignment result which is written
@@ -1974,9 +2048,9 @@ cam_set_aec_roi_t QCameraFOVControl::translateMeteringAreas(
         shiftHorzAdjusted = mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftHorz;
         shiftVertAdjusted = mFovControlData.spatialAlignResult.shiftAfRoiWide.shiftVert;
     } else {
-        shiftHorzAdjusted = (mFovControlData.transitionParams.cropRatio / zoom) *
+        shiftHorzAdjusted = shiftScale *
                 mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftHorz;
-        shiftVertAdjusted = (mFovControlData.transitionParams.cropRatio / zoom) *
+        shiftVertAdjusted = shiftScale *
                 mFovControlData.spatialAlignResult.shiftAfRoiTele.shiftVert;
     }
     mMutex.unlock();
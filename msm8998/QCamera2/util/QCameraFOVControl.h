@@ -33,6 +33,7 @@
 #include <utils/Mutex.h>
 #include "cam_intf.h"
 #include "QCameraExtZoomTranslator.h"
+#include "QCameraFOVControlLut.h"
 
 using namespace android;
 
@@ -228,6 +229,12 @@ private:
     uint32_t readjustZoomForWide(uint32_t zoomTele);
     uint32_t findZoomRatio(uint32_t zoom);
     inline uint32_t findZoomValue(uint32_t zoomRatio);
+    float userZoomOf(uint32_t zoomWide);
+    void getTeleRoiScale(float &fovRatio, float &shiftScale);
+    void updateSpatialAlignShift(const cam_sac_output_info_t &sacOutput,
+            cam_sac_output_info_t &sacOutputPrev, bool &sacOutputPrevValid,
+            spatial_align_shift_t &shift, spatial_align_shift_t &shiftAfRoi,
+            const char *camName);
     cam_face_detection_data_t translateRoiFD(cam_face_detection_data_t faceDetectionInfo,
             cam_sync_type_t cam);
     cam_roi_info_t translateFocusAreas(cam_roi_info_t roiAfMain, cam_sync_type_t cam);
@@ -245,6 +252,17 @@ private:
     fov_control_result_t            mFovControlResult;
     dual_cam_params_t               mDualCamParams;
     QCameraExtZoomTranslator       *mZoomTranslator;
+
+    // Lookup table mode, persist.camera.fovc.lut
+    bool                            mUseLut;
+    QCameraFOVControlLut            mLut;
+    // persist.camera.fovc.override, read at configuration
+    bool                            mOverride;
+    // Last spatial alignment output seen for each camera
+    cam_sac_output_info_t           mSacOutputWide;
+    cam_sac_output_info_t           mSacOutputTele;
+    bool                            mSacOutputWideValid;
+    bool                            mSacOutputTeleValid;
 };
 
 }; // namespace qcamera
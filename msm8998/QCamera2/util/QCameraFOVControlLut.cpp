@@ -0,0 +1,108 @@
+/* Copyright (c) 2016-2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#include "QCameraFOVControlLut.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : build
+ *
+ * DESCRIPTION: Build the tables for a zoom ratio table and the transition
+ *              parameters of the current configuration.
+ *
+ * PARAMETERS :
+ * @zoomRatioTable      : zoom ratios indexed by zoom value
+ * @zoomRatioTableCount : number of zoom values
+ * @cutOverFactor       : zoom ratio factor between wide and tele
+ * @cropRatio           : FOV ratio between wide and tele
+ *
+ * RETURN     : None
+ *
+ *==========================================================================*/
+void QCameraFOVControlLut::build(
+        const uint32_t *zoomRatioTable,
+        uint32_t zoomRatioTableCount,
+        float cutOverFactor,
+        float cropRatio)
+{
+    mEntries.clear();
+    if (!zoomRatioTable || !zoomRatioTableCount || !zoomRatioTable[0]) {
+        return;
+    }
+    mEntries.resize(zoomRatioTableCount);
+
+    for (uint32_t i = 0; i < zoomRatioTableCount; ++i) {
+        fov_zoom_lut_entry_t &e = mEntries[i];
+        uint32_t zoomRatio = zoomRatioTable[i];
+
+        // Same conversions as readjustZoomForTele and readjustZoomForWide
+        uint32_t zoomRatioTele = zoomRatio / cutOverFactor;
+        e.zoomTele = findZoomValue(zoomRatioTable, zoomRatioTableCount, zoomRatioTele);
+        uint32_t zoomRatioWide = zoomRatio * cutOverFactor;
+        e.zoomWide = findZoomValue(zoomRatioTable, zoomRatioTableCount, zoomRatioWide);
+
+        // Same float math as the focus and metering area translation
+        float zoomWide = zoomRatio;
+        float zoomTele = zoomRatioTable[e.zoomTele];
+        e.userZoom = zoomRatio / (float)zoomRatioTable[0];
+        e.fovRatioTele = (zoomTele / zoomWide) * cropRatio;
+        e.shiftScaleTele = cropRatio / e.userZoom;
+    }
+}
+
+/*===========================================================================
+ * FUNCTION   : findZoomValue
+ *
+ * DESCRIPTION: For the input zoom ratio, find the zoom value.
+ *
+ * PARAMETERS :
+ * @zoomRatioTable      : zoom ratios indexed by zoom value
+ * @zoomRatioTableCount : number of zoom values
+ * @zoomRatio           : zoom ratio
+ *
+ * RETURN     : Zoom value
+ *
+ *==========================================================================*/
+uint32_t QCameraFOVControlLut::findZoomValue(
+        const uint32_t *zoomRatioTable,
+        uint32_t zoomRatioTableCount,
+        uint32_t zoomRatio)
+{
+    uint32_t zoom = 0;
+    for (uint32_t i = 0; i < zoomRatioTableCount; ++i) {
+        if (zoomRatio <= zoomRatioTable[i]) {
+            zoom = i;
+            break;
+        }
+    }
+    return zoom;
+}
+
+}; // namespace qcamera
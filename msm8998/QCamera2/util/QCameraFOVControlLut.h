@@ -0,0 +1,73 @@
+/* Copyright (c) 2016-2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERAFOVCONTROLLUT_H__
+#define __QCAMERAFOVCONTROLLUT_H__
+
+#include <stdint.h>
+#include <vector>
+
+namespace qcamera {
+
+typedef struct {
+    uint32_t zoomTele;        // Tele zoom value for this wide zoom value
+    uint32_t zoomWide;        // Wide zoom value for this tele zoom value
+    float    userZoom;        // Zoom ratio relative to the first table entry
+    float    fovRatioTele;    // ROI scale from wide to tele at zoomTele
+    float    shiftScaleTele;  // Scale of the tele AF ROI spatial alignment shift
+} fov_zoom_lut_entry_t;
+
+/*
+ * Dense per zoom value tables for FOV-control, built once per configuration
+ * from the zoom ratio table and the transition parameters. Each entry holds
+ * exactly what the per call arithmetic of QCameraFOVControl computes for that
+ * zoom value, so lookups can replace the linear zoom table searches and the
+ * float math on the per frame paths.
+ */
+class QCameraFOVControlLut {
+public:
+    QCameraFOVControlLut() {}
+
+    void build(const uint32_t *zoomRatioTable, uint32_t zoomRatioTableCount,
+            float cutOverFactor, float cropRatio);
+    void clear() { mEntries.clear(); }
+    bool isValid(uint32_t zoom) const { return zoom < mEntries.size(); }
+    const fov_zoom_lut_entry_t &at(uint32_t zoom) const { return mEntries[zoom]; }
+
+    // First zoom value whose ratio is at least zoomRatio, 0 if there is none.
+    static uint32_t findZoomValue(const uint32_t *zoomRatioTable,
+            uint32_t zoomRatioTableCount, uint32_t zoomRatio);
+
+private:
+    std::vector<fov_zoom_lut_entry_t> mEntries;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERAFOVCONTROLLUT_H__ */
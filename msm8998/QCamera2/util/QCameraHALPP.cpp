@@ -54,7 +54,8 @@ QCameraHALPP::QCameraHALPP()
       m_outgoingQ(releaseOngoingDataCb, this),
       m_halPPBufNotifyCB(NULL),
       m_halPPGetOutputCB(NULL),
-      m_pQCameraPostProc(NULL)
+      m_pQCameraPostProc(NULL),
+      m_stageDepth(2)
 {
 }
 
@@ -92,6 +93,13 @@ int32_t QCameraHALPP::init(halPPBufNotify bufNotifyCb, halPPGetOutput getOutputC
     m_halPPBufNotifyCB = bufNotifyCb;
     m_halPPGetOutputCB = getOutputCb;
     m_pQCameraPostProc = (QCameraPostProcessor*)pUserData;
+
+    char prop[PROPERTY_VALUE_MAX];
+    memset(prop, 0, sizeof(prop));
+    property_get("persist.camera.halpp.qdepth", prop, "2");
+    int depth = atoi(prop);
+    m_stageDepth = (depth > 0) ? (uint32_t)depth : 1;
+    rc = m_graph.init(releaseJobCb, this);
     return rc;
 }
 
@@ -109,6 +117,8 @@ int32_t QCameraHALPP::init(halPPBufNotify bufNotifyCb, halPPGetOutput getOutputC
 int32_t QCameraHALPP::deinit()
 {
     int32_t rc = NO_ERROR;
+    // Jobs still in the stages are released while the callbacks are valid
+    m_graph.stop();
     m_halPPBufNotifyCB = NULL;
     m_halPPGetOutputCB = NULL;
     m_pQCameraPostProc = NULL;
@@ -131,6 +141,11 @@ int32_t QCameraHALPP::start()
     int32_t rc = NO_ERROR;
     LOGD("E");
 
+    rc = m_graph.start();
+    if (rc != NO_ERROR) {
+        LOGE("Failed to start HAL PP stages, rc = %d", rc);
+    }
+
     LOGD("X");
     return rc;
 }
@@ -151,6 +166,17 @@ int32_t QCameraHALPP::stop()
     int32_t rc = NO_ERROR;
     LOGD("E");
 
+    m_graph.stop();
+    for (uint32_t i = 0; i < m_graph.getNumStages(); i++) {
+        hal_pp_stage_stats_t stats;
+        m_graph.getStageStats(i, stats);
+        LOGH("stage %d: jobs %llu, drops %llu, busy %lld ms, max %lld ms, "
+                "blocked %lld ms, max depth %d", i,
+                (unsigned long long)stats.jobs, (unsigned long long)stats.drops,
+                (long long)ns2ms(stats.busyNs), (long long)ns2ms(stats.maxNs),
+                (long long)ns2ms(stats.blockedNs), stats.maxDepth);
+    }
+
     LOGD("X");
     return rc;
 }
@@ -158,7 +184,7 @@ int32_t QCameraHALPP::stop()
 /*===========================================================================
  * FUNCTION   : flushQ
  *
- * DESCRIPTION: flush m_iuputQ and m_outgoingQ.
+ * DESCRIPTION: flush the jobs in the stages, m_iuputQ and m_outgoingQ.
  *
  * PARAMETERS : None
  *
@@ -167,6 +193,7 @@ int32_t QCameraHALPP::stop()
 int32_t QCameraHALPP::flushQ()
 {
     int32_t rc = NO_ERROR;
+    m_graph.flush();
     m_iuputQ.flush();
     m_outgoingQ.flush();
     return rc;
@@ -315,6 +342,123 @@ void QCameraHALPP::releaseInputDataCb(void *pData, void *pUserData)
     }
 }
 
+/*===========================================================================
+ * FUNCTION   : addStage
+ *
+ * DESCRIPTION: add a processing stage. Stages run on their own threads and
+ *              are chained with bounded queues of persist.camera.halpp.qdepth
+ *              jobs, so different frames are in different stages at once.
+ *              Stages must be added and linked before start().
+ *
+ * PARAMETERS :
+ *   @name      : stage name
+ *   @func      : stage work, called with the job and this object
+ *   @pId       : filled with the stage id
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraHALPP::addStage(const char *name, halPPStageFunc func, uint32_t *pId)
+{
+    return m_graph.addStage(name, func, this, m_stageDepth, pId);
+}
+
+/*===========================================================================
+ * FUNCTION   : submitJob
+ *
+ * DESCRIPTION: hand a job to a stage, waiting while the stage queue is full.
+ *              On success the job belongs to the stages until onJobDone() or
+ *              onJobDropped(); on failure the caller keeps it.
+ *
+ * PARAMETERS :
+ *   @stage     : stage id
+ *   @pJob      : job
+ *
+ * RETURN     : int32_t type of status
+ *              NO_ERROR  -- success
+ *              none-zero failure code
+ *==========================================================================*/
+int32_t QCameraHALPP::submitJob(uint32_t stage, qcamera_hal_pp_job_t *pJob)
+{
+    return m_graph.submit(stage, (void *)pJob, true);
+}
+
+/*===========================================================================
+ * FUNCTION   : onJobDone
+ *
+ * DESCRIPTION: return the output and then the inputs of a job that went
+ *              through all its stages, and free the job.
+ *
+ * PARAMETERS :
+ *   @pJob      : job
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraHALPP::onJobDone(qcamera_hal_pp_job_t *pJob)
+{
+    if (pJob->pOutput != NULL) {
+        m_halPPBufNotifyCB(pJob->pOutput, m_pQCameraPostProc);
+    }
+    for (uint32_t i = 0; i < pJob->numInputs; i++) {
+        if (pJob->pInputs[i] != NULL) {
+            m_halPPBufNotifyCB(pJob->pInputs[i], m_pQCameraPostProc);
+        }
+    }
+    delete pJob;
+}
+
+/*===========================================================================
+ * FUNCTION   : onJobDropped
+ *
+ * DESCRIPTION: release the buffers of a job dropped by a stage, a flush or a
+ *              stop, and free the job.
+ *
+ * PARAMETERS :
+ *   @pJob      : job
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraHALPP::onJobDropped(qcamera_hal_pp_job_t *pJob)
+{
+    LOGW("drop HAL PP job of frame %d", pJob->frameIndex);
+    if (pJob->pOutput != NULL) {
+        releaseData(pJob->pOutput);
+        free(pJob->pOutput);
+    }
+    for (uint32_t i = 0; i < pJob->numInputs; i++) {
+        if (pJob->pInputs[i] != NULL) {
+            releaseData(pJob->pInputs[i]);
+            free(pJob->pInputs[i]);
+        }
+    }
+    delete pJob;
+}
+
+/*===========================================================================
+ * FUNCTION   : releaseJobCb
+ *
+ * DESCRIPTION: callback function for jobs leaving the stages
+ *
+ * PARAMETERS :
+ *   @pJob      : ptr to the job
+ *   @done      : the job went through all its stages
+ *   @pUserData : user data ptr (QCameraHALPP)
+ *
+ * RETURN     : None
+ *==========================================================================*/
+void QCameraHALPP::releaseJobCb(void *pJob, bool done, void *pUserData)
+{
+    if (pUserData != NULL && pJob != NULL) {
+        QCameraHALPP *pme = (QCameraHALPP *)pUserData;
+        if (done) {
+            pme->onJobDone((qcamera_hal_pp_job_t *)pJob);
+        } else {
+            pme->onJobDropped((qcamera_hal_pp_job_t *)pJob);
+        }
+    }
+}
+
 void QCameraHALPP::dumpYUVtoFile(const uint8_t* pBuf, const char *name, ssize_t buf_len)
 {
     LOGD("E.");
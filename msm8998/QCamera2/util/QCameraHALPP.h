@@ -33,6 +33,7 @@
 // Camera dependencies
 #include "QCamera2HWI.h"
 #include "QCameraPostProc.h"
+#include "QCameraHALPPGraph.h"
 
 // STL dependencies
 #include <unordered_map>
@@ -59,6 +60,27 @@ typedef void (*halPPBufNotify) (qcamera_hal_pp_data_t *pOutput,
 **/
 typedef void (*halPPGetOutput) (uint32_t frameIndex, void *pUserData);
 
+#define HAL_PP_MAX_JOB_INPUTS 4
+
+/** qcamera_hal_pp_job_t: a frame going through the HAL PP stages
+*    @frameIndex: frame index of the inputs
+*    @pOutput   : output data, returned first when the job is done
+*    @pInputs   : input data, returned after the output
+*    @numInputs : number of valid entries in pInputs
+*   HAL PP implementations derive their per frame state from it.
+**/
+struct qcamera_hal_pp_job_t {
+    uint32_t frameIndex;
+    qcamera_hal_pp_data_t *pOutput;
+    qcamera_hal_pp_data_t *pInputs[HAL_PP_MAX_JOB_INPUTS];
+    uint32_t numInputs;
+
+    qcamera_hal_pp_job_t() : frameIndex(0), pOutput(NULL), numInputs(0) {
+        memset(pInputs, 0, sizeof(pInputs));
+    }
+    virtual ~qcamera_hal_pp_job_t() {}
+};
+
 class QCameraHALPP
 {
 public:
@@ -82,6 +104,11 @@ protected:
     static void releaseInputDataCb(void *pData, void *pUserData);
     static void releaseOngoingDataCb(void *pData, void *pUserData);
     void dumpYUVtoFile(const uint8_t* pBuf, const char *name, ssize_t buf_len);
+    int32_t addStage(const char *name, halPPStageFunc func, uint32_t *pId);
+    int32_t submitJob(uint32_t stage, qcamera_hal_pp_job_t *pJob);
+    virtual void onJobDone(qcamera_hal_pp_job_t *pJob);
+    virtual void onJobDropped(qcamera_hal_pp_job_t *pJob);
+    static void releaseJobCb(void *pJob, bool done, void *pUserData);
 
 protected:
     QCameraQueue m_iuputQ;
@@ -93,6 +120,11 @@ protected:
     halPPBufNotify m_halPPBufNotifyCB;
     halPPGetOutput m_halPPGetOutputCB;
     QCameraPostProcessor *m_pQCameraPostProc;
+
+    // Stages run on their own threads; frames are handed over as
+    // qcamera_hal_pp_job_t once their inputs and output are matched.
+    QCameraHALPPGraph m_graph;
+    uint32_t m_stageDepth;
 }; // QCameraHALPP class
 }; // namespace qcamera
 
@@ -0,0 +1,583 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// System dependencies
+#include <stdio.h>
+#include <string.h>
+#include <utils/Errors.h>
+
+// Camera dependencies
+#include "QCameraHALPPGraph.h"
+
+using namespace android;
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraHALPPGraph constructor
+ *
+ * DESCRIPTION: Create an empty graph.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraHALPPGraph::QCameraHALPPGraph() :
+        mReleaseCb(NULL),
+        mUserData(NULL),
+        mNumStages(0),
+        mBusy(0),
+        mFlushing(0),
+        mRunning(false)
+{
+    for (uint32_t i = 0; i < HAL_PP_GRAPH_MAX_STAGES; i++) {
+        stage_t &s = mStages[i];
+        memset(s.name, 0, sizeof(s.name));
+        s.func = NULL;
+        s.pUserData = NULL;
+        s.depth = 0;
+        s.next = -1;
+        s.threadValid = false;
+        memset(&s.stats, 0, sizeof(s.stats));
+        pthread_cond_init(&s.notEmpty, NULL);
+        pthread_cond_init(&s.notFull, NULL);
+        mArgs[i].pGraph = this;
+        mArgs[i].id = i;
+    }
+    pthread_mutex_init(&mLock, NULL);
+    pthread_cond_init(&mIdleCond, NULL);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : QCameraHALPPGraph destructor
+ *
+ * DESCRIPTION: Stop the stage threads. Queued jobs are released.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraHALPPGraph::~QCameraHALPPGraph()
+{
+    stop();
+
+    for (uint32_t i = 0; i < HAL_PP_GRAPH_MAX_STAGES; i++) {
+        pthread_cond_destroy(&mStages[i].notEmpty);
+        pthread_cond_destroy(&mStages[i].notFull);
+    }
+    pthread_cond_destroy(&mIdleCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : init
+ *
+ * DESCRIPTION: Set the callback releasing jobs that leave the graph.
+ *
+ * PARAMETERS :
+ * @releaseCb : job release callback
+ * @pUserData : user data of the callback
+ *
+ * RETURN     : NO_ERROR            on success
+ *              BAD_VALUE           if releaseCb is NULL
+ *              INVALID_OPERATION   if the graph is running
+ *
+ *==========================================================================*/
+int32_t QCameraHALPPGraph::init(halPPJobRelease releaseCb, void *pUserData)
+{
+    if (releaseCb == NULL) {
+        return BAD_VALUE;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (mRunning) {
+        pthread_mutex_unlock(&mLock);
+        return INVALID_OPERATION;
+    }
+    mReleaseCb = releaseCb;
+    mUserData = pUserData;
+    pthread_mutex_unlock(&mLock);
+
+    return NO_ERROR;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : addStage
+ *
+ * DESCRIPTION: Add a stage. The stage is not linked to any other stage.
+ *
+ * PARAMETERS :
+ * @name      : stage name, also used for the thread name
+ * @func      : stage work
+ * @pUserData : user data of func
+ * @depth     : capacity of the stage input queue, at least 1
+ * @pId       : filled with the stage id
+ *
+ * RETURN     : NO_ERROR            on success
+ *              BAD_VALUE           for invalid arguments
+ *              NO_MEMORY           if the graph is full
+ *              INVALID_OPERATION   if the graph is running
+ *
+ *==========================================================================*/
+int32_t QCameraHALPPGraph::addStage(const char *name, halPPStageFunc func,
+        void *pUserData, uint32_t depth, uint32_t *pId)
+{
+    if ((name == NULL) || (func == NULL) || (pId == NULL)) {
+        return BAD_VALUE;
+    }
+
+    pthread_mutex_lock(&mLock);
+    if (mRunning) {
+        pthread_mutex_unlock(&mLock);
+        return INVALID_OPERATION;
+    }
+    if (mNumStages >= HAL_PP_GRAPH_MAX_STAGES) {
+        pthread_mutex_unlock(&mLock);
+        return NO_MEMORY;
+    }
+
+    stage_t &s = mStages[mNumStages];
+    strlcpy(s.name, name, sizeof(s.name));
+    s.func = func;
+    s.pUserData = pUserData;
+    s.depth = (depth > 0) ? depth : 1;
+    s.next = -1;
+    memset(&s.stats, 0, sizeof(s.stats));
+    *pId = mNumStages++;
+    pthread_mutex_unlock(&mLock);
+
+    return NO_ERROR;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : link
+ *
+ * DESCRIPTION: Send the jobs completed by a stage to another stage. Links
+ *              that would close a loop are refused.
+ *
+ * PARAMETERS :
+ * @from      : upstream stage
+ * @to        : downstream stage
+ *
+ * RETURN     : NO_ERROR            on success
+ *              BAD_VALUE           for unknown stages or a loop
+ *              INVALID_OPERATION   if the graph is running
+ *
+ *==========================================================================*/
+int32_t QCameraHALPPGraph::link(uint32_t from, uint32_t to)
+{
+    int32_t rc = NO_ERROR;
+
+    pthread_mutex_lock(&mLock);
+    if (mRunning) {
+        rc = INVALID_OPERATION;
+    } else if ((from >= mNumStages) || (to >= mNumStages)) {
+        rc = BAD_VALUE;
+    } else {
+        for (int32_t i = (int32_t)to; i >= 0; i = mStages[i].next) {
+            if (i == (int32_t)from) {
+                rc = BAD_VALUE;
+                break;
+            }
+        }
+        if (rc == NO_ERROR) {
+            mStages[from].next = (int32_t)to;
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return rc;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : start
+ *
+ * DESCRIPTION: Start one thread per stage.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : NO_ERROR            on success
+ *              NO_INIT             if init() was not called
+ *              UNKNOWN_ERROR       if a thread could not be started
+ *
+ *==========================================================================*/
+int32_t QCameraHALPPGraph::start()
+{
+    pthread_mutex_lock(&mLock);
+    if (mRunning) {
+        pthread_mutex_unlock(&mLock);
+        return NO_ERROR;
+    }
+    if (mReleaseCb == NULL) {
+        pthread_mutex_unlock(&mLock);
+        return NO_INIT;
+    }
+
+    mRunning = true;
+    bool failed = false;
+    for (uint32_t i = 0; i < mNumStages; i++) {
+        stage_t &s = mStages[i];
+        if (pthread_create(&s.thread, NULL, stageRoutine, &mArgs[i]) != 0) {
+            failed = true;
+            break;
+        }
+        char threadName[16];
+        snprintf(threadName, sizeof(threadName), "CAM_PP_%.8s", s.name);
+        pthread_setname_np(s.thread, threadName);
+        s.threadValid = true;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    if (failed) {
+        stop();
+        return UNKNOWN_ERROR;
+    }
+    return NO_ERROR;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : stop
+ *
+ * DESCRIPTION: Stop the stage threads. Jobs being processed finish their
+ *              current stage; those and all queued jobs are released as
+ *              dropped. The graph can be started again.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraHALPPGraph::stop()
+{
+    std::deque<void *> jobs;
+
+    pthread_mutex_lock(&mLock);
+    if (!mRunning) {
+        pthread_mutex_unlock(&mLock);
+        return;
+    }
+    mRunning = false;
+    for (uint32_t i = 0; i < mNumStages; i++) {
+        pthread_cond_signal(&mStages[i].notEmpty);
+        pthread_cond_broadcast(&mStages[i].notFull);
+    }
+    pthread_mutex_unlock(&mLock);
+
+    for (uint32_t i = 0; i < mNumStages; i++) {
+        if (mStages[i].threadValid) {
+            pthread_join(mStages[i].thread, NULL);
+            mStages[i].threadValid = false;
+        }
+    }
+
+    pthread_mutex_lock(&mLock);
+    drainLocked(jobs);
+    pthread_mutex_unlock(&mLock);
+
+    releaseAll(jobs);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : flush
+ *
+ * DESCRIPTION: Drop all queued jobs and wait for the jobs being processed to
+ *              leave the graph. Jobs finishing a stage during the flush are
+ *              dropped too, except after the last stage. Submits made while
+ *              the flush runs fail. Must not be called from a stage or the
+ *              release callback.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraHALPPGraph::flush()
+{
+    std::deque<void *> jobs;
+
+    pthread_mutex_lock(&mLock);
+    mFlushing++;
+    drainLocked(jobs);
+    while (mBusy > 0) {
+        pthread_cond_wait(&mIdleCond, &mLock);
+    }
+    mFlushing--;
+    pthread_mutex_unlock(&mLock);
+
+    releaseAll(jobs);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : submit
+ *
+ * DESCRIPTION: Queue a job to a stage. On success the graph owns the job
+ *              until it is passed to the release callback; on failure the
+ *              caller keeps it.
+ *
+ * PARAMETERS :
+ * @stage     : stage id
+ * @pJob      : job
+ * @wait      : wait for room if the stage queue is full
+ *
+ * RETURN     : NO_ERROR            on success
+ *              BAD_VALUE           for an unknown stage or a NULL job
+ *              NO_INIT             if the graph is not running
+ *              WOULD_BLOCK         if the queue is full and wait is false
+ *              INVALID_OPERATION   if a flush or a stop cut the wait short
+ *
+ *==========================================================================*/
+int32_t QCameraHALPPGraph::submit(uint32_t stage, void *pJob, bool wait)
+{
+    if ((stage >= mNumStages) || (pJob == NULL)) {
+        return BAD_VALUE;
+    }
+
+    pthread_mutex_lock(&mLock);
+    stage_t &s = mStages[stage];
+    if (!mRunning) {
+        pthread_mutex_unlock(&mLock);
+        return NO_INIT;
+    }
+    if (!wait && (s.queue.size() >= s.depth)) {
+        pthread_mutex_unlock(&mLock);
+        return WOULD_BLOCK;
+    }
+    if (!waitForRoomLocked(s, NULL)) {
+        pthread_mutex_unlock(&mLock);
+        return INVALID_OPERATION;
+    }
+    s.queue.push_back(pJob);
+    if (s.queue.size() > s.stats.maxDepth) {
+        s.stats.maxDepth = (uint32_t)s.queue.size();
+    }
+    pthread_cond_signal(&s.notEmpty);
+    pthread_mutex_unlock(&mLock);
+
+    return NO_ERROR;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : getStageStats
+ *
+ * DESCRIPTION: Get the counters of a stage.
+ *
+ * PARAMETERS :
+ * @stage     : stage id
+ * @stats     : filled with the counters, zeroed for an unknown stage
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraHALPPGraph::getStageStats(uint32_t stage,
+        hal_pp_stage_stats_t &stats)
+{
+    memset(&stats, 0, sizeof(stats));
+    pthread_mutex_lock(&mLock);
+    if (stage < mNumStages) {
+        stats = mStages[stage].stats;
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : stageRoutine
+ *
+ * DESCRIPTION: Stage thread entry.
+ *
+ * PARAMETERS :
+ * @data      : stage_arg_t of the stage
+ *
+ * RETURN     : NULL
+ *
+ *==========================================================================*/
+void *QCameraHALPPGraph::stageRoutine(void *data)
+{
+    stage_arg_t *pArg = (stage_arg_t *)data;
+    pArg->pGraph->runStage(pArg->id);
+    return NULL;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : runStage
+ *
+ * DESCRIPTION: Stage loop. Takes jobs from the stage queue, runs the stage
+ *              on them and passes them downstream, waiting while the
+ *              downstream queue is full.
+ *
+ * PARAMETERS :
+ * @id        : stage id
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraHALPPGraph::runStage(uint32_t id)
+{
+    stage_t &s = mStages[id];
+
+    pthread_mutex_lock(&mLock);
+    while (true) {
+        while (mRunning && s.queue.empty()) {
+            pthread_cond_wait(&s.notEmpty, &mLock);
+        }
+        if (!mRunning) {
+            break;
+        }
+        void *pJob = s.queue.front();
+        s.queue.pop_front();
+        pthread_cond_broadcast(&s.notFull);
+        mBusy++;
+        pthread_mutex_unlock(&mLock);
+
+        nsecs_t start = systemTime();
+        int32_t rc = s.func(pJob, s.pUserData);
+        nsecs_t ns = systemTime() - start;
+
+        pthread_mutex_lock(&mLock);
+        s.stats.jobs++;
+        s.stats.busyNs += ns;
+        if (ns > s.stats.maxNs) {
+            s.stats.maxNs = ns;
+        }
+
+        bool done = false;
+        if (rc != NO_ERROR) {
+            s.stats.drops++;
+        } else if (s.next < 0) {
+            done = true;
+        } else {
+            stage_t &n = mStages[s.next];
+            if (waitForRoomLocked(n, &s.stats.blockedNs)) {
+                n.queue.push_back(pJob);
+                if (n.queue.size() > n.stats.maxDepth) {
+                    n.stats.maxDepth = (uint32_t)n.queue.size();
+                }
+                pthread_cond_signal(&n.notEmpty);
+                pJob = NULL;
+            } else {
+                s.stats.drops++;
+            }
+        }
+
+        if (pJob != NULL) {
+            pthread_mutex_unlock(&mLock);
+            mReleaseCb(pJob, done, mUserData);
+            pthread_mutex_lock(&mLock);
+        }
+        mBusy--;
+        pthread_cond_broadcast(&mIdleCond);
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : waitForRoomLocked
+ *
+ * DESCRIPTION: Wait for room in a stage queue. Called with mLock held.
+ *
+ * PARAMETERS :
+ * @s         : stage to queue to
+ * @pBlockedNs: time spent waiting is added here, may be NULL
+ *
+ * RETURN     : true  if the job can be queued
+ *              false if the graph is stopping or flushing
+ *
+ *==========================================================================*/
+bool QCameraHALPPGraph::waitForRoomLocked(stage_t &s, nsecs_t *pBlockedNs)
+{
+    if (mRunning && (mFlushing == 0) && (s.queue.size() >= s.depth)) {
+        nsecs_t start = systemTime();
+        while (mRunning && (mFlushing == 0) && (s.queue.size() >= s.depth)) {
+            pthread_cond_wait(&s.notFull, &mLock);
+        }
+        if (pBlockedNs != NULL) {
+            *pBlockedNs += systemTime() - start;
+        }
+    }
+    return mRunning && (mFlushing == 0);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : drainLocked
+ *
+ * DESCRIPTION: Move all queued jobs out of the stage queues and wake the
+ *              producers waiting for room. Called with mLock held.
+ *
+ * PARAMETERS :
+ * @jobs      : the jobs are appended here
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraHALPPGraph::drainLocked(std::deque<void *> &jobs)
+{
+    for (uint32_t i = 0; i < mNumStages; i++) {
+        stage_t &s = mStages[i];
+        s.stats.drops += s.queue.size();
+        jobs.insert(jobs.end(), s.queue.begin(), s.queue.end());
+        s.queue.clear();
+        pthread_cond_broadcast(&s.notFull);
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : releaseAll
+ *
+ * DESCRIPTION: Release drained jobs as dropped.
+ *
+ * PARAMETERS :
+ * @jobs      : drained jobs
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraHALPPGraph::releaseAll(std::deque<void *> &jobs)
+{
+    for (size_t i = 0; i < jobs.size(); i++) {
+        mReleaseCb(jobs[i], false, mUserData);
+    }
+    jobs.clear();
+}
+
+}; // namespace qcamera
@@ -0,0 +1,125 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERA_HAL_PP_GRAPH_H__
+#define __QCAMERA_HAL_PP_GRAPH_H__
+
+// System dependencies
+#include <deque>
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+#define HAL_PP_GRAPH_MAX_STAGES   8
+#define HAL_PP_GRAPH_NAME_LEN     16
+
+/* Work of a stage on one job. The job is passed by reference and stays
+ * owned by the graph. A non-zero return drops the job. */
+typedef int32_t (*halPPStageFunc) (void *pJob, void *pUserData);
+
+/* Called once for every job leaving the graph: with done set after the last
+ * stage, or with done cleared if the job was dropped by a stage, a flush or
+ * a stop. */
+typedef void (*halPPJobRelease) (void *pJob, bool done, void *pUserData);
+
+typedef struct {
+    uint64_t jobs;            // Jobs processed
+    uint64_t drops;           // Jobs dropped by this stage or while queued
+    nsecs_t  busyNs;          // Time spent in the stage function
+    nsecs_t  maxNs;           // Slowest job
+    nsecs_t  blockedNs;       // Time waiting on a full downstream queue
+    uint32_t maxDepth;        // Highest input queue depth seen
+} hal_pp_stage_stats_t;
+
+/*
+ * QCameraHALPPGraph runs HAL post processing stages, each on its own thread,
+ * linked by bounded queues. A stage has at most one downstream stage, so the
+ * graph is a set of chains that may merge. Jobs are queued by pointer and
+ * never copied, and different jobs are in different stages at the same
+ * time. A full queue blocks its producer, which holds back the submitter.
+ */
+class QCameraHALPPGraph {
+public:
+    QCameraHALPPGraph();
+    virtual ~QCameraHALPPGraph();
+
+    int32_t init(halPPJobRelease releaseCb, void *pUserData);
+    int32_t addStage(const char *name, halPPStageFunc func, void *pUserData,
+            uint32_t depth, uint32_t *pId);
+    int32_t link(uint32_t from, uint32_t to);
+    int32_t start();
+    void stop();
+    void flush();
+    int32_t submit(uint32_t stage, void *pJob, bool wait);
+    uint32_t getNumStages() const { return mNumStages; };
+    void getStageStats(uint32_t stage, hal_pp_stage_stats_t &stats);
+
+private:
+    typedef struct {
+        char name[HAL_PP_GRAPH_NAME_LEN];
+        halPPStageFunc func;
+        void *pUserData;
+        uint32_t depth;
+        int32_t next;                // Downstream stage, -1 for none
+        std::deque<void *> queue;
+        pthread_cond_t notEmpty;
+        pthread_cond_t notFull;
+        pthread_t thread;
+        bool threadValid;
+        hal_pp_stage_stats_t stats;
+    } stage_t;
+
+    typedef struct {
+        QCameraHALPPGraph *pGraph;
+        uint32_t id;
+    } stage_arg_t;
+
+    static void *stageRoutine(void *data);
+    void runStage(uint32_t id);
+    bool waitForRoomLocked(stage_t &s, nsecs_t *pBlockedNs);
+    void drainLocked(std::deque<void *> &jobs);
+    void releaseAll(std::deque<void *> &jobs);
+
+    halPPJobRelease mReleaseCb;
+    void *mUserData;
+    stage_t mStages[HAL_PP_GRAPH_MAX_STAGES];
+    stage_arg_t mArgs[HAL_PP_GRAPH_MAX_STAGES];
+    uint32_t mNumStages;
+    pthread_mutex_t mLock;
+    pthread_cond_t mIdleCond;
+    uint32_t mBusy;                  // Stages holding a job
+    uint32_t mFlushing;              // Flushes in progress
+    bool mRunning;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERA_HAL_PP_GRAPH_H__ */
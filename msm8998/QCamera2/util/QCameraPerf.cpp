@@ -34,6 +34,8 @@
 #include <utils/Errors.h>
 
 // System dependencies
+#include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <utils/Timers.h>
@@ -136,6 +138,15 @@ PerfLockInfo QCameraPerfLock::mPerfLockInfo[] = {
       NULL, 0}
     };
 
+static const char *perfLockNames[PERF_LOCK_COUNT] = {
+    "Open",
+    "Close",
+    "Preview",
+    "Snapshot",
+    "Hint preview",
+    "Hint encode"
+};
+
 Mutex                QCameraPerfLockIntf::mMutex;
 QCameraPerfLockIntf* QCameraPerfLockIntf::mInstance = NULL;
 
@@ -143,7 +154,7 @@ QCameraPerfLockIntf* QCameraPerfLockIntf::mInstance = NULL;
 /*===========================================================================
  * FUNCTION   : QCameraPerfLockMgr constructor
  *
- * DESCRIPTION: Initialize the perf locks
+ * DESCRIPTION: Initialize the perf locks and the scheduler issuing them
  *
  * PARAMETERS : None
  *
@@ -151,7 +162,8 @@ QCameraPerfLockIntf* QCameraPerfLockIntf::mInstance = NULL;
  *
  *==========================================================================*/
 QCameraPerfLockMgr::QCameraPerfLockMgr() :
-    mState(LOCK_MGR_STATE_UNINITIALIZED)
+    mState(LOCK_MGR_STATE_UNINITIALIZED),
+    mScheduler(NULL)
 {
     for (int i = 0; i < PERF_LOCK_COUNT; ++i) {
         mPerfLock[i] = QCameraPerfLock::create((PerfLockEnum)i);
@@ -167,6 +179,15 @@ QCameraPerfLockMgr::QCameraPerfLockMgr() :
             return;
         }
     }
+
+    int32_t holdOffMs = property_get_int32("persist.camera.perflock.holdoff_ms",
+            DEFAULT_PERF_LOCK_HOLD_OFF_MS);
+    perf_lock_backend_t backend;
+    backend.acquire = schedAcquire;
+    backend.release = schedRelease;
+    backend.user = this;
+    mScheduler = new QCameraPerfLockScheduler(backend, PERF_LOCK_COUNT,
+            (holdOffMs > 0) ? (uint32_t)holdOffMs : 0);
     mState = LOCK_MGR_STATE_READY;
 }
 
@@ -183,6 +204,10 @@ QCameraPerfLockMgr::QCameraPerfLockMgr() :
  *==========================================================================*/
 QCameraPerfLockMgr::~QCameraPerfLockMgr()
 {
+    // Releases whatever is still held, so it has to go before the locks.
+    delete mScheduler;
+    mScheduler = NULL;
+
     for (int i = 0; i < PERF_LOCK_COUNT; ++i) {
         if (mPerfLock[i]) {
             delete mPerfLock[i];
@@ -194,7 +219,9 @@ QCameraPerfLockMgr::~QCameraPerfLockMgr()
 /*===========================================================================
  * FUNCTION   : acquirePerfLock
  *
- * DESCRIPTION: Call acquirePerfLock function for the requested perf lock
+ * DESCRIPTION: Take a reference on the requested perf lock. The lock is
+ *              acquired off the caller's thread, or re-acquired if it is
+ *              held but would time out before the requested timer.
  *
  * PARAMETERS :
  * @perfLockType: Perf lock enum
@@ -210,7 +237,7 @@ bool QCameraPerfLockMgr::acquirePerfLock(
     bool ret = false;
     if ((mState == LOCK_MGR_STATE_READY) &&
         isValidPerfLockEnum(perfLockType)) {
-        ret = mPerfLock[perfLockType]->acquirePerfLock(true, timer);
+        ret = mScheduler->acquire(perfLockType, timer, true);
     }
     return ret;
 }
@@ -219,7 +246,8 @@ bool QCameraPerfLockMgr::acquirePerfLock(
 /*===========================================================================
  * FUNCTION   : acquirePerfLockIfExpired
  *
- * DESCRIPTION: Call acquirePerfLock function for the requested perf lock
+ * DESCRIPTION: Take a reference on the requested perf lock. The lock is
+ *              acquired off the caller's thread unless it is already held.
  *
  * PARAMETERS :
  * @perfLockType: Type of perf lock
@@ -235,7 +263,7 @@ bool QCameraPerfLockMgr::acquirePerfLockIfExpired(
     bool ret = false;
     if ((mState == LOCK_MGR_STATE_READY) &&
         isValidPerfLockEnum(perfLockType)) {
-        ret = mPerfLock[perfLockType]->acquirePerfLock(false, timer);
+        ret = mScheduler->acquire(perfLockType, timer, false);
     }
     return ret;
 
@@ -245,7 +273,9 @@ bool QCameraPerfLockMgr::acquirePerfLockIfExpired(
 /*===========================================================================
  * FUNCTION   : releasePerfLock
  *
- * DESCRIPTION: Call releasePerfLock function for the requested perf lock
+ * DESCRIPTION: Drop a reference on the requested perf lock. The lock itself
+ *              is released after the hold-off period unless it is requested
+ *              again in the meantime.
  *
  * PARAMETERS :
  * @perfLockType: Enum of perf lock
@@ -259,7 +289,11 @@ bool QCameraPerfLockMgr::releasePerfLock(
     bool ret = false;
     if ((mState == LOCK_MGR_STATE_READY) &&
         isValidPerfLockEnum(perfLockType)) {
-        ret = mPerfLock[perfLockType]->releasePerfLock();
+        ret = mScheduler->release(perfLockType);
+        if (!ret) {
+            LOGD("Perf lock %d either not acquired or already released",
+                    perfLockType);
+        }
     }
     return ret;
 }
@@ -290,6 +324,95 @@ void QCameraPerfLockMgr::powerHintInternal(
 }
 
 
+/*===========================================================================
+ * FUNCTION   : schedAcquire
+ *
+ * DESCRIPTION: Scheduler backend call taking a perf lock
+ *
+ * PARAMETERS :
+ * @user      : QCameraPerfLockMgr object
+ * @type      : perf lock type
+ * @handle    : handle of the held lock, 0 if not held
+ * @timeoutMs : timer value in ms
+ *
+ * RETURN     : perf lock handle on success
+ *              <= 0 on failure
+ *
+ *==========================================================================*/
+int32_t QCameraPerfLockMgr::schedAcquire(
+        void     *user,
+        uint32_t  type,
+        int32_t   handle,
+        uint32_t  timeoutMs)
+{
+    QCameraPerfLockMgr *mgr = (QCameraPerfLockMgr *)user;
+    return mgr->mPerfLock[type]->acquirePerfLock(handle, timeoutMs);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : schedRelease
+ *
+ * DESCRIPTION: Scheduler backend call releasing a perf lock
+ *
+ * PARAMETERS :
+ * @user      : QCameraPerfLockMgr object
+ * @type      : perf lock type
+ * @handle    : handle of the held lock
+ *
+ * RETURN     : < 0 on failure
+ *
+ *==========================================================================*/
+int32_t QCameraPerfLockMgr::schedRelease(
+        void     *user,
+        uint32_t  type,
+        int32_t   handle)
+{
+    QCameraPerfLockMgr *mgr = (QCameraPerfLockMgr *)user;
+    return mgr->mPerfLock[type]->releasePerfLock(handle);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : dump
+ *
+ * DESCRIPTION: Print perf lock usage in dumpsys format
+ *
+ * PARAMETERS :
+ * @fd        : file descriptor
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraPerfLockMgr::dump(
+        int fd)
+{
+    if (mState != LOCK_MGR_STATE_READY) {
+        dprintf(fd, "\nPerf locks not available\n");
+        return;
+    }
+
+    dprintf(fd, "\nPerf locks (hold-off %u ms)\n", mScheduler->getHoldOffMs());
+    dprintf(fd, "--------------+----------+-----------+----------+----------+----------+-----------+-----------\n");
+    dprintf(fd, " Type         | Requests | Coalesced | Held off | Acquires | Releases | Held (ms) | Saved (us)\n");
+    dprintf(fd, "--------------+----------+-----------+----------+----------+----------+-----------+-----------\n");
+    for (int i = 0; i < PERF_LOCK_COUNT; i++) {
+        perf_lock_stats_t stats;
+        if (!mScheduler->getStats(i, stats)) {
+            continue;
+        }
+        dprintf(fd, " %-12s | %8" PRIu64 " | %9" PRIu64 " | %8" PRIu64
+                " | %8" PRIu64 " | %8" PRIu64 " | %9" PRId64 " | %9" PRId64 "%s\n",
+                perfLockNames[i], stats.requests, stats.coalesced,
+                stats.heldOff, stats.acquireCalls, stats.releaseCalls,
+                ns2ms(stats.heldNs), ns2us(stats.savedNs),
+                stats.held ? " *" : "");
+    }
+    dprintf(fd, "--------------+----------+-----------+----------+----------+----------+-----------+-----------\n");
+    dprintf(fd, " * held now\n");
+}
+
+
 /*===========================================================================
  * FUNCTION   : create
  *
@@ -331,9 +454,6 @@ QCameraPerfLock* QCameraPerfLock::create(
 QCameraPerfLock::QCameraPerfLock(
         PerfLockEnum         perfLockType,
         QCameraPerfLockIntf *perfLockIntf) :
-        mHandle(0),
-        mRefCount(0),
-        mTimeOut(0),
         mPerfLockType(perfLockType),
         mPerfLockIntf(perfLockIntf)
 {
@@ -353,155 +473,83 @@ QCameraPerfLock::QCameraPerfLock(
  *==========================================================================*/
 QCameraPerfLock::~QCameraPerfLock()
 {
-    if (mHandle > 0) {
-        (*mPerfLockIntf->perfLockRel())(mHandle);
-    }
     QCameraPerfLockIntf::deleteInstance();
 }
 
 
-/*===========================================================================
- * FUNCTION   : isTimedOut
- *
- * DESCRIPTION: Check if the perf lock is timed out
- *
- * PARAMETERS : None
- *
- * RETURN     : boolean indicating if the perf lock is timed out
- *
- *==========================================================================*/
-bool QCameraPerfLock::isTimedOut()
-{
-    if (mTimeOut && (systemTime() > mTimeOut)) {
-        return true;
-    }
-    return false;
-}
-
-
-/*===========================================================================
- * FUNCTION   : restartTimer
- *
- * DESCRIPTION: Restart the timer for the duration specified
- *
- * PARAMETERS :
- *  @timer    : timer duration in milliseconds
- *
- * RETURN     : void
- *
- *==========================================================================*/
-void inline QCameraPerfLock::restartTimer(
-        uint32_t timer)
-{
-    if (timer > 0) {
-        mTimeOut = systemTime() + ms2ns(timer);
-    }
-}
-
-
 /*===========================================================================
  * FUNCTION   : acquirePerfLock
  *
- * DESCRIPTION: Acquires the perf lock for the duration specified. Do not acquire
- *              the perf lock is reacquire flag is set to false provided the perf
- *              lock is already acquired.
+ * DESCRIPTION: Acquires the perf lock for the duration specified, or pushes
+ *              out the timeout of the lock with the given handle. Power hint
+ *              types enable their hint instead.
  *
  * PARAMETERS :
- * @forceReaquirePerfLock: Reacquire
+ * @handle    : handle of the held lock, 0 if not held
  * @timer     : Duration of the perf lock
  *
- * RETURN     : true  on success
- *              false on failure
+ * RETURN     : perf lock handle on success
+ *              <= 0 on failure
  *
  *==========================================================================*/
-bool QCameraPerfLock::acquirePerfLock(
-        bool     forceReaquirePerfLock,
+int32_t QCameraPerfLock::acquirePerfLock(
+        int32_t  handle,
         uint32_t timer)
 {
-    bool ret = true;
-    Mutex::Autolock lock(mMutex);
-
     if ((mPerfLockType == PERF_LOCK_POWERHINT_PREVIEW) ||
         (mPerfLockType == PERF_LOCK_POWERHINT_ENCODE)) {
         powerHintInternal(PowerHint::VIDEO_ENCODE, true);
-        return true;
+        return 1;
     }
 
-    if (!mIsPerfdEnabled) return ret;
+    if (!mIsPerfdEnabled) return 1;
 
-    if (isTimedOut()) {
-        mHandle   = 0;
-        mRefCount = 0;
-    }
+    handle = (*mPerfLockIntf->perfLockAcq())(
+        handle, timer,
+        mPerfLockInfo[mPerfLockType].perfLockParams,
+        mPerfLockInfo[mPerfLockType].perfLockParamsCount);
 
-    if ((mRefCount == 0) || forceReaquirePerfLock) {
-        mHandle = (*mPerfLockIntf->perfLockAcq())(
-            mHandle, timer,
-            mPerfLockInfo[mPerfLockType].perfLockParams,
-            mPerfLockInfo[mPerfLockType].perfLockParamsCount);
-
-        if (mHandle > 0) {
-            ++mRefCount;
-            restartTimer(timer);
-            LOGD("perfLockHandle %d, updated refCount: %d, perfLockType: %d",
-                mHandle, mRefCount, mPerfLockType);
-        } else {
-            LOGE("Failed to acquire the perf lock");
-            ret = false;
-        }
+    if (handle > 0) {
+        LOGD("perfLockHandle %d, perfLockType: %d", handle, mPerfLockType);
     } else {
-        LOGD("Perf lock already acquired, not re-aquiring");
+        LOGE("Failed to acquire the perf lock");
     }
 
-    return ret;
+    return handle;
 }
 
 
 /*===========================================================================
  * FUNCTION   : releasePerfLock
  *
- * DESCRIPTION: Releases the perf lock
+ * DESCRIPTION: Releases the perf lock. Power hint types disable their hint
+ *              instead.
  *
- * PARAMETERS : None
+ * PARAMETERS :
+ * @handle    : handle of the held lock
  *
- * RETURN     : true  on success
- *              false on failure
+ * RETURN     : 0  on success
+ *              <0 on failure
  *
  *==========================================================================*/
-bool QCameraPerfLock::releasePerfLock()
+int32_t QCameraPerfLock::releasePerfLock(
+        int32_t handle)
 {
-    bool ret = true;
-    Mutex::Autolock lock(mMutex);
-
     if ((mPerfLockType == PERF_LOCK_POWERHINT_PREVIEW) ||
         (mPerfLockType == PERF_LOCK_POWERHINT_ENCODE)) {
         powerHintInternal(PowerHint::VIDEO_ENCODE, false);
-        return true;
+        return 0;
     }
 
-    if (!mIsPerfdEnabled) return ret;
-
-    if (mHandle > 0) {
-        LOGD("perfLockHandle %d, refCount: %d, perfLockType: %d",
-                    mHandle, mRefCount, mPerfLockType);
-
-        if (isTimedOut()) {
-            mHandle   = 0;
-            mRefCount = 0;
-        } else if (--mRefCount == 0) {
-            int32_t rc = (*mPerfLockIntf->perfLockRel())(mHandle);
-            mHandle = 0;
-            mTimeOut = 0;
-            if (rc < 0) {
-                LOGE("Failed to release the perf lock");
-                ret = false;
-            }
-        }
-    } else {
-        LOGW("Perf lock %d either not acquired or already released", mPerfLockType);
+    if (!mIsPerfdEnabled) return 0;
+
+    LOGD("perfLockHandle %d, perfLockType: %d", handle, mPerfLockType);
+    int32_t rc = (*mPerfLockIntf->perfLockRel())(handle);
+    if (rc < 0) {
+        LOGE("Failed to release the perf lock");
     }
 
-    return ret;
+    return rc;
 }
 
 
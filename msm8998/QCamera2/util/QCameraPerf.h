@@ -35,6 +35,7 @@
 
 // Camera dependencies
 #include <android/hardware/power/1.1/IPower.h>
+#include "QCameraPerfLockScheduler.h"
 
 using namespace android;
 using android::hardware::power::V1_1::IPower;
@@ -45,6 +46,7 @@ using ::android::hardware::Void;
 namespace qcamera {
 
 #define DEFAULT_PERF_LOCK_TIMEOUT_MS 1000
+#define DEFAULT_PERF_LOCK_HOLD_OFF_MS 250
 
 typedef int32_t (*perfLockAcquire)(int, int, int[], int);
 typedef int32_t (*perfLockRelease)(int);
@@ -78,32 +80,27 @@ typedef struct {
 
 class QCameraPerfLockIntf;
 
+/* One perf lock type. Calls go straight to the perf daemon or power HAL;
+ * refcounting and timeouts are left to QCameraPerfLockMgr. */
 class QCameraPerfLock {
 public:
     static QCameraPerfLock* create(PerfLockEnum perfLockType);
     virtual ~QCameraPerfLock();
 
-    bool releasePerfLock();
-    bool acquirePerfLock(bool     forceReacquirePerfLock,
-                         uint32_t timer = DEFAULT_PERF_LOCK_TIMEOUT_MS);
+    int32_t releasePerfLock(int32_t handle);
+    int32_t acquirePerfLock(int32_t  handle,
+                            uint32_t timer = DEFAULT_PERF_LOCK_TIMEOUT_MS);
     void powerHintInternal(PowerHint powerHint, bool enable);
 
 protected:
     QCameraPerfLock(PerfLockEnum perfLockType, QCameraPerfLockIntf *perfLockIntf);
 
 private:
-    Mutex                mMutex;
-    int32_t              mHandle;
-    uint32_t             mRefCount;
-    nsecs_t              mTimeOut;
     PerfLockEnum         mPerfLockType;
     QCameraPerfLockIntf *mPerfLockIntf;
     bool                 mIsPerfdEnabled;
 
     static PerfLockInfo  mPerfLockInfo[PERF_LOCK_COUNT];
-
-    void restartTimer(uint32_t timer);
-    bool isTimedOut();
 };
 
 
@@ -145,11 +142,17 @@ public:
     bool acquirePerfLockIfExpired(PerfLockEnum perfLockRnum,
                                   uint32_t     timer = DEFAULT_PERF_LOCK_TIMEOUT_MS);
     void powerHintInternal(PerfLockEnum perfLockType, PowerHint powerHint, bool enable);
+    void dump(int fd);
 
 private:
     PerfLockMgrStateEnum mState;
     Mutex                mMutex;
     QCameraPerfLock*     mPerfLock[PERF_LOCK_COUNT];
+    QCameraPerfLockScheduler *mScheduler;
+
+    static int32_t schedAcquire(void *user, uint32_t type, int32_t handle,
+                                uint32_t timeoutMs);
+    static int32_t schedRelease(void *user, uint32_t type, int32_t handle);
 
     inline bool isValidPerfLockEnum(PerfLockEnum perfLockType)
                     { return (perfLockType < PERF_LOCK_COUNT); }
@@ -0,0 +1,539 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// System dependencies
+#include <string.h>
+#include <time.h>
+
+// Camera dependencies
+#include "QCameraPerfLockScheduler.h"
+#include "cam_cond.h"
+
+namespace qcamera {
+
+/*===========================================================================
+ * FUNCTION   : QCameraPerfLockScheduler constructor
+ *
+ * DESCRIPTION: Initialize the lock states and start the scheduler thread. If
+ *              the thread cannot be started backend calls are made on the
+ *              caller's thread and releases are not held off.
+ *
+ * PARAMETERS :
+ * @backend   : backend taking and dropping the locks
+ * @numTypes  : number of lock types, at most PERF_LOCK_SCHED_MAX_TYPES
+ * @holdOffMs : time a lock is kept after its last reference goes
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraPerfLockScheduler::QCameraPerfLockScheduler(
+        const perf_lock_backend_t &backend,
+        uint32_t                   numTypes,
+        uint32_t                   holdOffMs) :
+        mBackend(backend),
+        mNumTypes(numTypes),
+        mHoldOffMs(holdOffMs),
+        mIdleGen(0),
+        mExit(false),
+        mThreadValid(false)
+{
+    if (mNumTypes > PERF_LOCK_SCHED_MAX_TYPES) {
+        mNumTypes = PERF_LOCK_SCHED_MAX_TYPES;
+    }
+    memset(mState, 0, sizeof(mState));
+
+    pthread_mutex_init(&mLock, NULL);
+    PTHREAD_COND_INIT(&mCond);
+    pthread_cond_init(&mIdleCond, NULL);
+
+    if (pthread_create(&mThread, NULL, schedRoutine, this) == 0) {
+        pthread_setname_np(mThread, "CAM_PerfLock");
+        mThreadValid = true;
+    } else {
+        mHoldOffMs = 0;
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : QCameraPerfLockScheduler destructor
+ *
+ * DESCRIPTION: Stop the scheduler thread. Locks still held are released.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+QCameraPerfLockScheduler::~QCameraPerfLockScheduler()
+{
+    pthread_mutex_lock(&mLock);
+    mExit = true;
+    pthread_cond_signal(&mCond);
+    pthread_cond_broadcast(&mIdleCond);
+    pthread_mutex_unlock(&mLock);
+
+    if (mThreadValid) {
+        pthread_join(mThread, NULL);
+    } else {
+        for (uint32_t i = 0; i < mNumTypes; i++) {
+            if (mState[i].handle > 0) {
+                mBackend.release(mBackend.user, i, mState[i].handle);
+            }
+        }
+    }
+
+    pthread_cond_destroy(&mIdleCond);
+    pthread_cond_destroy(&mCond);
+    pthread_mutex_destroy(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : acquire
+ *
+ * DESCRIPTION: Take a reference on a lock type. The backend is only called
+ *              if the lock is neither held nor queued, or if 'extend' is set
+ *              and less than half of the requested timeout is left on the
+ *              held lock.
+ *
+ * PARAMETERS :
+ * @type      : lock type
+ * @timeoutMs : lock timeout in ms, 0 for none
+ * @extend    : re-acquire a held lock to push out its timeout
+ *
+ * RETURN     : true  on success
+ *              false for an invalid type
+ *
+ *==========================================================================*/
+bool QCameraPerfLockScheduler::acquire(
+        uint32_t type,
+        uint32_t timeoutMs,
+        bool     extend)
+{
+    if (type >= mNumTypes) {
+        return false;
+    }
+
+    pthread_mutex_lock(&mLock);
+    nsecs_t now = systemTime();
+    lock_state_t &s = mState[type];
+    expireLocked(s, now);
+
+    s.stats.requests++;
+    s.refs++;
+    if (s.releaseAt != 0) {
+        s.releaseAt = 0;
+        s.stats.heldOff++;
+    }
+
+    bool covered = false;
+    if (s.acquirePending) {
+        // Merge into the queued acquire, keeping the longer timeout.
+        if ((timeoutMs == 0) ||
+                ((s.timeoutMs != 0) && (timeoutMs > s.timeoutMs))) {
+            s.timeoutMs = timeoutMs;
+        }
+        covered = true;
+    } else if (s.inFlight) {
+        covered = !extend || (s.timeoutMs == 0) ||
+                ((timeoutMs != 0) && (timeoutMs <= s.timeoutMs));
+    } else if (s.handle > 0) {
+        // Only extend a lock that has used up half of the requested time,
+        // so back to back requests do not re-acquire it every time.
+        covered = !extend || (s.expireAt == 0) || ((timeoutMs != 0) &&
+                (s.expireAt - now >= ms2ns(timeoutMs) / 2));
+    }
+
+    if (covered) {
+        s.stats.coalesced++;
+    } else {
+        s.acquirePending = true;
+        s.timeoutMs = timeoutMs;
+        if (mThreadValid) {
+            pthread_cond_signal(&mCond);
+        } else {
+            serviceLocked(type, now);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return true;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : release
+ *
+ * DESCRIPTION: Drop a reference on a lock type. The backend lock is released
+ *              once no reference has been taken for the hold-off period.
+ *
+ * PARAMETERS :
+ * @type      : lock type
+ *
+ * RETURN     : true  on success
+ *              false if the type is invalid or holds no reference
+ *
+ *==========================================================================*/
+bool QCameraPerfLockScheduler::release(
+        uint32_t type)
+{
+    if (type >= mNumTypes) {
+        return false;
+    }
+
+    pthread_mutex_lock(&mLock);
+    nsecs_t now = systemTime();
+    lock_state_t &s = mState[type];
+    expireLocked(s, now);
+
+    if (s.refs == 0) {
+        pthread_mutex_unlock(&mLock);
+        return false;
+    }
+
+    if (--s.refs == 0) {
+        // A queued acquire that has not been issued yet is no longer needed.
+        s.acquirePending = false;
+        if ((s.handle > 0) || s.inFlight) {
+            s.releaseAt = now + ms2ns(mHoldOffMs);
+            if (mThreadValid) {
+                pthread_cond_signal(&mCond);
+            } else {
+                serviceLocked(type, now);
+            }
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+
+    return true;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : sync
+ *
+ * DESCRIPTION: Wait until the scheduler thread has made all backend calls
+ *              that are due now. Releases still in their hold-off are not
+ *              waited for.
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraPerfLockScheduler::sync()
+{
+    pthread_mutex_lock(&mLock);
+    if (mThreadValid) {
+        uint64_t gen = mIdleGen;
+        pthread_cond_signal(&mCond);
+        while ((mIdleGen == gen) && !mExit) {
+            pthread_cond_wait(&mIdleCond, &mLock);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : getStats
+ *
+ * DESCRIPTION: Get the statistics of a lock type
+ *
+ * PARAMETERS :
+ * @type      : lock type
+ * @stats     : filled with the statistics
+ *
+ * RETURN     : true  on success
+ *              false for an invalid type
+ *
+ *==========================================================================*/
+bool QCameraPerfLockScheduler::getStats(
+        uint32_t           type,
+        perf_lock_stats_t &stats)
+{
+    if (type >= mNumTypes) {
+        return false;
+    }
+
+    pthread_mutex_lock(&mLock);
+    nsecs_t now = systemTime();
+    lock_state_t &s = mState[type];
+    expireLocked(s, now);
+
+    stats = s.stats;
+    stats.held = (s.handle > 0);
+    if (stats.held) {
+        stats.heldNs += now - s.heldSince;
+    }
+    pthread_mutex_unlock(&mLock);
+
+    uint64_t calls = stats.acquireCalls + stats.releaseCalls;
+    stats.savedNs = stats.backendNs;
+    if (calls > 0) {
+        stats.savedNs += (nsecs_t)((stats.coalesced + stats.heldOff) *
+                (uint64_t)(stats.backendNs / (nsecs_t)calls));
+    }
+    return true;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : expireLocked
+ *
+ * DESCRIPTION: Account for a lock dropped by its backend timeout. Its
+ *              references go with it unless a renewal is queued.
+ *
+ * PARAMETERS :
+ * @s         : lock state
+ * @now       : current time
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraPerfLockScheduler::expireLocked(
+        lock_state_t &s,
+        nsecs_t       now)
+{
+    if ((s.handle > 0) && (s.expireAt != 0) && (now >= s.expireAt)) {
+        dropLocked(s, s.expireAt);
+        if (!s.acquirePending && !s.inFlight) {
+            s.refs = 0;
+        }
+    }
+    if ((s.handle <= 0) && !s.inFlight) {
+        s.releaseAt = 0;
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : dropLocked
+ *
+ * DESCRIPTION: Mark a held lock as no longer held
+ *
+ * PARAMETERS :
+ * @s         : lock state
+ * @end       : time the lock stopped being held
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraPerfLockScheduler::dropLocked(
+        lock_state_t &s,
+        nsecs_t       end)
+{
+    if (end > s.heldSince) {
+        s.stats.heldNs += end - s.heldSince;
+    }
+    s.handle = 0;
+    s.expireAt = 0;
+    s.releaseAt = 0;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : serviceLocked
+ *
+ * DESCRIPTION: Make the backend call due for a lock type, if any. mLock is
+ *              dropped around the call.
+ *
+ * PARAMETERS :
+ * @type      : lock type
+ * @now       : current time
+ *
+ * RETURN     : true if a backend call was made
+ *
+ *==========================================================================*/
+bool QCameraPerfLockScheduler::serviceLocked(
+        uint32_t type,
+        nsecs_t  now)
+{
+    lock_state_t &s = mState[type];
+    expireLocked(s, now);
+
+    if (s.acquirePending && !s.inFlight) {
+        int32_t handle = s.handle;
+        uint32_t timeoutMs = s.timeoutMs;
+        s.acquirePending = false;
+        s.inFlight = true;
+
+        pthread_mutex_unlock(&mLock);
+        nsecs_t start = systemTime();
+        int32_t rc = mBackend.acquire(mBackend.user, type, handle, timeoutMs);
+        nsecs_t end = systemTime();
+        pthread_mutex_lock(&mLock);
+
+        s.inFlight = false;
+        s.stats.acquireCalls++;
+        s.stats.backendNs += end - start;
+        if (rc > 0) {
+            if (s.handle <= 0) {
+                s.heldSince = end;
+            }
+            s.handle = rc;
+            s.expireAt = (timeoutMs != 0) ? end + ms2ns(timeoutMs) : 0;
+        } else {
+            s.stats.failures++;
+            if (s.handle > 0) {
+                // A failed extension leaves the lock in an unknown state.
+                dropLocked(s, end);
+            }
+        }
+        return true;
+    }
+
+    if ((s.handle > 0) && (s.refs == 0) && (s.releaseAt != 0) &&
+            (now >= s.releaseAt)) {
+        int32_t handle = s.handle;
+        dropLocked(s, now);
+
+        pthread_mutex_unlock(&mLock);
+        nsecs_t start = systemTime();
+        int32_t rc = mBackend.release(mBackend.user, type, handle);
+        nsecs_t end = systemTime();
+        pthread_mutex_lock(&mLock);
+
+        s.stats.releaseCalls++;
+        s.stats.backendNs += end - start;
+        if (rc < 0) {
+            s.stats.failures++;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+
+/*===========================================================================
+ * FUNCTION   : waitLocked
+ *
+ * DESCRIPTION: Wait for new work or until a deadline
+ *
+ * PARAMETERS :
+ * @deadline  : CLOCK_MONOTONIC time to wake up at, 0 for none
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraPerfLockScheduler::waitLocked(
+        nsecs_t deadline)
+{
+    if (deadline == 0) {
+        pthread_cond_wait(&mCond, &mLock);
+    } else {
+        struct timespec ts;
+        ts.tv_sec = (time_t)(deadline / 1000000000LL);
+        ts.tv_nsec = (long)(deadline % 1000000000LL);
+        pthread_cond_timedwait(&mCond, &mLock, &ts);
+    }
+}
+
+
+/*===========================================================================
+ * FUNCTION   : run
+ *
+ * DESCRIPTION: Scheduler thread main loop
+ *
+ * PARAMETERS : None
+ *
+ * RETURN     : void
+ *
+ *==========================================================================*/
+void QCameraPerfLockScheduler::run()
+{
+    pthread_mutex_lock(&mLock);
+    while (!mExit) {
+        nsecs_t now = systemTime();
+        bool didWork = false;
+        for (uint32_t i = 0; (i < mNumTypes) && !didWork; i++) {
+            didWork = serviceLocked(i, now);
+        }
+        if (didWork) {
+            continue;
+        }
+
+        nsecs_t deadline = 0;
+        for (uint32_t i = 0; i < mNumTypes; i++) {
+            lock_state_t &s = mState[i];
+            if (s.handle <= 0) {
+                continue;
+            }
+            if ((s.refs == 0) && (s.releaseAt != 0) &&
+                    ((deadline == 0) || (s.releaseAt < deadline))) {
+                deadline = s.releaseAt;
+            }
+            if ((s.expireAt != 0) &&
+                    ((deadline == 0) || (s.expireAt < deadline))) {
+                deadline = s.expireAt;
+            }
+        }
+
+        mIdleGen++;
+        pthread_cond_broadcast(&mIdleCond);
+        waitLocked(deadline);
+    }
+
+    for (uint32_t i = 0; i < mNumTypes; i++) {
+        lock_state_t &s = mState[i];
+        expireLocked(s, systemTime());
+        if (s.handle > 0) {
+            int32_t handle = s.handle;
+            dropLocked(s, systemTime());
+            pthread_mutex_unlock(&mLock);
+            mBackend.release(mBackend.user, i, handle);
+            pthread_mutex_lock(&mLock);
+        }
+    }
+    pthread_mutex_unlock(&mLock);
+}
+
+
+/*===========================================================================
+ * FUNCTION   : schedRoutine
+ *
+ * DESCRIPTION: Scheduler thread entry
+ *
+ * PARAMETERS :
+ * @data      : QCameraPerfLockScheduler object
+ *
+ * RETURN     : NULL
+ *
+ *==========================================================================*/
+void *QCameraPerfLockScheduler::schedRoutine(
+        void *data)
+{
+    QCameraPerfLockScheduler *sched = (QCameraPerfLockScheduler *)data;
+    sched->run();
+    return NULL;
+}
+
+}; // namespace qcamera
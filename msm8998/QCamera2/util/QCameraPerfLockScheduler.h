@@ -0,0 +1,128 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef __QCAMERAPERFLOCKSCHEDULER_H__
+#define __QCAMERAPERFLOCKSCHEDULER_H__
+
+// System dependencies
+#include <pthread.h>
+#include <stdint.h>
+#include <utils/Timers.h>
+
+namespace qcamera {
+
+#define PERF_LOCK_SCHED_MAX_TYPES 8
+
+/* Backend that actually takes and drops the locks. Both calls are made only
+ * from the scheduler thread. */
+typedef struct {
+    // Take lock 'type', or extend it if 'handle' is non-zero. A timeout of 0
+    // means no timeout. Returns the handle (> 0), or <= 0 on failure.
+    int32_t (*acquire)(void *user, uint32_t type, int32_t handle,
+            uint32_t timeoutMs);
+    // Drop lock 'type'. Returns < 0 on failure.
+    int32_t (*release)(void *user, uint32_t type, int32_t handle);
+    void *user;
+} perf_lock_backend_t;
+
+typedef struct {
+    uint64_t requests;        // Acquire requests from callers.
+    uint64_t coalesced;       // Requests served by a held or queued lock.
+    uint64_t heldOff;         // Releases cancelled by a request in the hold-off.
+    uint64_t acquireCalls;    // Backend acquire calls.
+    uint64_t releaseCalls;    // Backend release calls.
+    uint64_t failures;        // Backend calls that failed.
+    nsecs_t heldNs;           // Time the lock was held, including now.
+    nsecs_t backendNs;        // Time spent in backend calls.
+    nsecs_t savedNs;          // Backend time kept off callers plus the
+                              // estimated cost of the calls avoided.
+    bool held;                // Lock is held now.
+} perf_lock_stats_t;
+
+/*
+ * QCameraPerfLockScheduler refcounts perf lock requests per lock type and
+ * issues the backend calls on its own thread, so callers never wait on the
+ * perf daemon or power HAL. Overlapping requests share one backend lock. When
+ * the last reference goes the lock is kept for a hold-off period, so back to
+ * back operations reuse it instead of releasing and re-acquiring. A lock whose
+ * backend timeout runs out is dropped together with its references, like the
+ * timed perf locks it wraps.
+ */
+class QCameraPerfLockScheduler {
+public:
+    QCameraPerfLockScheduler(const perf_lock_backend_t &backend,
+            uint32_t numTypes, uint32_t holdOffMs);
+    virtual ~QCameraPerfLockScheduler();
+
+    // Take a reference on 'type'. With 'extend' set a held lock with less
+    // than half of 'timeoutMs' left is re-acquired to push out its timeout.
+    bool acquire(uint32_t type, uint32_t timeoutMs, bool extend);
+    bool release(uint32_t type);
+    // Wait until the scheduler thread has done all work that is due.
+    void sync();
+    bool getStats(uint32_t type, perf_lock_stats_t &stats);
+    uint32_t getHoldOffMs() const { return mHoldOffMs; }
+
+private:
+    typedef struct {
+        uint32_t refs;
+        int32_t handle;        // Backend handle, 0 when not held.
+        bool inFlight;         // Backend acquire running.
+        bool acquirePending;   // Backend acquire needed.
+        uint32_t timeoutMs;    // Timeout of the pending acquire.
+        nsecs_t expireAt;      // Backend timeout of the held lock, 0 for none.
+        nsecs_t heldSince;
+        nsecs_t releaseAt;     // End of the hold-off, 0 when not releasing.
+        perf_lock_stats_t stats;
+    } lock_state_t;
+
+    static void *schedRoutine(void *data);
+    void run();
+    bool serviceLocked(uint32_t type, nsecs_t now);
+    void expireLocked(lock_state_t &s, nsecs_t now);
+    void dropLocked(lock_state_t &s, nsecs_t now);
+    void waitLocked(nsecs_t deadline);
+
+    perf_lock_backend_t mBackend;
+    uint32_t mNumTypes;
+    uint32_t mHoldOffMs;
+    lock_state_t mState[PERF_LOCK_SCHED_MAX_TYPES];
+
+    pthread_mutex_t mLock;
+    pthread_cond_t mCond;      // Work for the scheduler thread.
+    pthread_cond_t mIdleCond;  // Scheduler thread finished an idle pass.
+    uint64_t mIdleGen;
+    bool mExit;
+    bool mThreadValid;
+    pthread_t mThread;
+};
+
+}; // namespace qcamera
+
+#endif /* __QCAMERAPERFLOCKSCHEDULER_H__ */
@@ -28,12 +28,26 @@
 */
 
 // Camera dependencies
+#include <inttypes.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <cutils/properties.h>
 
 #include "QCameraTrace.h"
+#include "mm_camera_log_ring.h"
 
-#define CAMSCOPE_MEMSTORE_SIZE 0x00100000 // 1MB
+// Packets buffered per thread and section, must be a power of two
+#define CAMSCOPE_THREAD_SLOTS      256
+#define CAMSCOPE_MAX_PACKET_SIZE   sizeof(camscope_in_out_timing)
+#define CAMSCOPE_FLUSH_PERIOD_MS   100
+// Flight recorder memory cap on top of the time window
+#define CAMSCOPE_FLIGHT_MAX_BYTES  0x00400000 // 4MB
+// One in this many events per thread is timed for the overhead stats
+#define CAMSCOPE_OVERHEAD_SAMPLING 16
 
 volatile uint32_t kpi_camscope_flags = 0;
 volatile uint32_t kpi_camscope_frame_count = 0;
@@ -44,141 +58,460 @@ static const char * camscope_filenames[CAMSCOPE_SECTION_SIZE] = {
     "/data/misc/camera/camscope_jpeg.bin"
 };
 
-static FILE * camscope_fd[CAMSCOPE_SECTION_SIZE];
-static uint32_t camscope_num_bytes_stored[CAMSCOPE_SECTION_SIZE];
-static char * camscope_memstore[CAMSCOPE_SECTION_SIZE];
-static pthread_mutex_t camscope_mutex[CAMSCOPE_SECTION_SIZE];
+static const char * camscope_flight_filenames[CAMSCOPE_SECTION_SIZE] = {
+    "/data/misc/camera/camscope_mmcamera_flight.bin",
+    "/data/misc/camera/camscope_hal_flight.bin",
+    "/data/misc/camera/camscope_jpeg_flight.bin"
+};
 
-/* camscope_init:
+typedef struct {
+    uint32_t size;
+    char data[CAMSCOPE_MAX_PACKET_SIZE];
+} camscope_slot;
+
+/* Flight recorder chunk, the packets one thread stored since the last pass */
+typedef struct camscope_chunk {
+    struct camscope_chunk *next;
+    uint64_t time_ns;
+    uint32_t size;
+    char data[];
+} camscope_chunk;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_cond_t dump_cond;
+    pthread_t flusher;
+    int active;
+    int stop;
+    FILE *fd;
+    uint64_t flight_ns;
+    cam_thread_ring_set_t rings;
+    camscope_chunk *chunks;
+    camscope_chunk *chunks_tail;
+    uint32_t chunk_bytes;
+    uint32_t dump_req;
+    uint32_t dump_done;
+    uint64_t bytes_out;
+    uint64_t samples;
+    uint64_t sampled_ns;
+} camscope_section_state;
+
+static camscope_section_state camscope_state[CAMSCOPE_SECTION_SIZE] = {
+    { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+      PTHREAD_COND_INITIALIZER, 0, 0, 0, NULL, 0,
+      CAM_THREAD_RING_SET_INITIALIZER(sizeof(camscope_slot),
+              CAMSCOPE_THREAD_SLOTS),
+      NULL, NULL, 0, 0, 0, 0, 0, 0 },
+    { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+      PTHREAD_COND_INITIALIZER, 0, 0, 0, NULL, 0,
+      CAM_THREAD_RING_SET_INITIALIZER(sizeof(camscope_slot),
+              CAMSCOPE_THREAD_SLOTS),
+      NULL, NULL, 0, 0, 0, 0, 0, 0 },
+    { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+      PTHREAD_COND_INITIALIZER, 0, 0, 0, NULL, 0,
+      CAM_THREAD_RING_SET_INITIALIZER(sizeof(camscope_slot),
+              CAMSCOPE_THREAD_SLOTS),
+      NULL, NULL, 0, 0, 0, 0, 0, 0 },
+};
+
+// Events of the calling thread, to pick the ones timed for the stats
+static thread_local uint32_t camscope_event_cnt = 0;
+
+static inline uint64_t camscope_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* camscope_overhead_begin:
+ *
+ *  Starts timing one in CAMSCOPE_OVERHEAD_SAMPLING events of the calling
+ *  thread for the per event overhead stats
+ *
+ *  Return: start time to pass to camscope_store_packet, 0 if not sampled
+ */
+uint64_t camscope_overhead_begin() {
+    if ((camscope_event_cnt++ % CAMSCOPE_OVERHEAD_SAMPLING) != 0) {
+        return 0;
+    }
+    return camscope_now_ns();
+}
+
+/* camscope_store_packet:
  *
  *  @camscope_section: camscope section where this function is occurring
+ *  @data:             packet to store
+ *  @size:             size of the packet
+ *  @start_ns:         value returned by camscope_overhead_begin
  *
- *  Initializes the CameraScope tool functionality
+ *  Appends a packet to the calling thread's buffer. The packet is dropped
+ *  and counted if the flusher has not caught up with this thread.
  *
  *  Return: N/A
  */
-void camscope_init(camscope_section_type camscope_section) {
-    pthread_mutex_init(&(camscope_mutex[camscope_section]), NULL);
-    if (camscope_fd[camscope_section] == NULL) {
-        if(camscope_memstore[camscope_section] == NULL) {
-            camscope_memstore[camscope_section] =
-                (char *)malloc(CAMSCOPE_MEMSTORE_SIZE);
-            if (camscope_memstore[camscope_section] == NULL) {
-              CLOGE(CAM_NO_MODULE, "Failed to allocate camscope memstore"
-                    "with size %d\n", CAMSCOPE_MEMSTORE_SIZE);
-            }
+void camscope_store_packet(camscope_section_type camscope_section,
+                           const void *data, uint32_t size,
+                           uint64_t start_ns) {
+    if ((uint32_t)camscope_section >= CAMSCOPE_SECTION_SIZE ||
+        size > CAMSCOPE_MAX_PACKET_SIZE) {
+        return;
+    }
+    camscope_section_state *s = &camscope_state[camscope_section];
+    if (!__atomic_load_n(&s->active, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+    cam_thread_ring_t *ring = cam_thread_ring_get(&s->rings);
+    if (ring == NULL) {
+        return;
+    }
+    camscope_slot *slot = (camscope_slot *)cam_thread_ring_reserve(ring);
+    if (slot == NULL) {
+        return;
+    }
+
+    slot->size = size;
+    memcpy(slot->data, data, size);
+    if (cam_thread_ring_commit(ring)) {
+        pthread_cond_signal(&s->cond);
+    }
+
+    if (start_ns != 0) {
+        __atomic_fetch_add(&s->sampled_ns, camscope_now_ns() - start_ns,
+                __ATOMIC_RELAXED);
+        __atomic_fetch_add(&s->samples, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/* camscope_output:
+ *
+ *  @s:    section state
+ *  @data: packets to output
+ *  @size: number of bytes
+ *
+ *  Writes packets to the section's file, or keeps them in memory in flight
+ *  recorder mode. Runs on the flusher only.
+ *
+ *  Return: N/A
+ */
+static void camscope_output(camscope_section_state *s, const char *data,
+                            uint32_t size) {
+    if (s->flight_ns == 0) {
+        if (s->fd != NULL) {
+            fwrite(data, sizeof(char), size, s->fd);
+            __atomic_fetch_add(&s->bytes_out, size, __ATOMIC_RELAXED);
         }
-        camscope_fd[camscope_section] =
-            fopen(camscope_filenames[camscope_section], "ab");
+        return;
+    }
+
+    camscope_chunk *chunk =
+        (camscope_chunk *)malloc(sizeof(camscope_chunk) + size);
+    if (chunk == NULL) {
+        return;
+    }
+    chunk->next = NULL;
+    chunk->time_ns = camscope_now_ns();
+    chunk->size = size;
+    memcpy(chunk->data, data, size);
+    if (s->chunks_tail != NULL) {
+        s->chunks_tail->next = chunk;
+    } else {
+        s->chunks = chunk;
     }
+    s->chunks_tail = chunk;
+    s->chunk_bytes += size;
 }
 
-/* camscope_flush:
+/* camscope_drain:
  *
- *  @camscope_section: camscope section where this function is occurring
+ *  @s: section state
  *
- *  Flushes the camscope memstore to the file system
+ *  Moves everything the threads stored so far to the output. Runs on the
+ *  flusher only.
  *
  *  Return: N/A
  */
-static void camscope_flush(camscope_section_type camscope_section) {
-    if (camscope_fd[camscope_section] != NULL &&
-        camscope_memstore[camscope_section] != NULL) {
-        fwrite(camscope_memstore[camscope_section], sizeof(char),
-               camscope_num_bytes_stored[camscope_section],
-               camscope_fd[camscope_section]);
-        camscope_num_bytes_stored[camscope_section] = 0;
+static void camscope_drain(camscope_section_state *s) {
+    for (cam_thread_ring_t *ring = cam_thread_ring_first(&s->rings);
+            ring != NULL; ring = cam_thread_ring_next(ring)) {
+        camscope_slot *slot;
+        if (s->flight_ns == 0) {
+            while ((slot = (camscope_slot *)cam_thread_ring_peek(ring))
+                    != NULL) {
+                camscope_output(s, slot->data, slot->size);
+                cam_thread_ring_consume(ring);
+            }
+            continue;
+        }
+
+        /* one chunk per thread and pass so eviction drops whole packets */
+        char tmp[CAMSCOPE_THREAD_SLOTS * CAMSCOPE_MAX_PACKET_SIZE];
+        uint32_t size = 0;
+        for (uint32_t i = 0; i < CAMSCOPE_THREAD_SLOTS &&
+                (slot = (camscope_slot *)cam_thread_ring_peek(ring))
+                != NULL; i++) {
+            memcpy(&tmp[size], slot->data, slot->size);
+            size += slot->size;
+            cam_thread_ring_consume(ring);
+        }
+        if (size != 0) {
+            camscope_output(s, tmp, size);
+        }
     }
 }
 
-/* camscope_destroy:
+/* camscope_free_chunks:
+ *
+ *  @s:      section state
+ *  @before: free chunks stored before this time, 0 for all
+ *
+ *  Return: N/A
+ */
+static void camscope_free_chunks(camscope_section_state *s, uint64_t before) {
+    while (s->chunks != NULL &&
+           (before == 0 || s->chunks->time_ns < before ||
+            s->chunk_bytes > CAMSCOPE_FLIGHT_MAX_BYTES)) {
+        camscope_chunk *chunk = s->chunks;
+        s->chunks = chunk->next;
+        s->chunk_bytes -= chunk->size;
+        free(chunk);
+    }
+    if (s->chunks == NULL) {
+        s->chunks_tail = NULL;
+    }
+}
+
+/* camscope_write_flight:
  *
  *  @camscope_section: camscope section where this function is occurring
  *
- *  Flushes any remaining data to the file system and cleans up CameraScope
+ *  Appends the flight recorder contents to the section's flight file and
+ *  releases them. Runs on the flusher only.
  *
  *  Return: N/A
  */
-void camscope_destroy(camscope_section_type camscope_section) {
-    if (camscope_fd[camscope_section] != NULL) {
-        pthread_mutex_lock(&(camscope_mutex[camscope_section]));
-        if(camscope_memstore[camscope_section] != NULL) {
-            camscope_flush(camscope_section);
-            free(camscope_memstore[camscope_section]);
-            camscope_memstore[camscope_section] = NULL;
+static void camscope_write_flight(camscope_section_type camscope_section) {
+    camscope_section_state *s = &camscope_state[camscope_section];
+    FILE *fd = fopen(camscope_flight_filenames[camscope_section], "ab");
+    if (fd == NULL) {
+        CLOGE(CAM_NO_MODULE, "Failed to open %s",
+              camscope_flight_filenames[camscope_section]);
+    } else {
+        for (camscope_chunk *chunk = s->chunks; chunk != NULL;
+             chunk = chunk->next) {
+            fwrite(chunk->data, sizeof(char), chunk->size, fd);
+            __atomic_fetch_add(&s->bytes_out, chunk->size, __ATOMIC_RELAXED);
         }
-        fclose(camscope_fd[camscope_section]);
-        camscope_fd[camscope_section] = NULL;
-        pthread_mutex_unlock(&(camscope_mutex[camscope_section]));
+        fclose(fd);
     }
-    pthread_mutex_destroy(&(camscope_mutex[camscope_section]));
+    camscope_free_chunks(s, 0);
 }
 
-/* camscope_reserve:
+/* camscope_flusher:
  *
- *  @camscope_section:     camscope section where this function is occurring
- *  @num_bytes_to_reserve: number in bytes to reserve on the memstore
+ *  @data: camscope section handled by this thread
  *
- *  Reserves a number of bytes on the memstore flushing to the
- *  file system if remaining space is insufficient
+ *  Drains the thread buffers of a section every CAMSCOPE_FLUSH_PERIOD_MS,
+ *  or earlier when a buffer fills up or a dump is requested
  *
- *  Return: number of bytes successfully reserved on the memstore
+ *  Return: NULL
  */
-uint32_t camscope_reserve(camscope_section_type camscope_section,
-                                 uint32_t num_bytes_to_reserve) {
-    uint32_t bytes_reserved = 0;
-    if (camscope_fd[camscope_section] != NULL &&
-        num_bytes_to_reserve <= CAMSCOPE_MEMSTORE_SIZE) {
-        int32_t size = CAMSCOPE_MEMSTORE_SIZE -
-               camscope_num_bytes_stored[camscope_section] -
-               num_bytes_to_reserve;
-        if (size < 0) {
-            camscope_flush(camscope_section);
+static void *camscope_flusher(void *data) {
+    camscope_section_type camscope_section =
+        (camscope_section_type)(intptr_t)data;
+    camscope_section_state *s = &camscope_state[camscope_section];
+
+    prctl(PR_SET_NAME, (unsigned long)"CAM_ScopeFlush", 0, 0, 0);
+
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        uint32_t dump_req = s->dump_req;
+        int stop = s->stop;
+        pthread_mutex_unlock(&s->lock);
+
+        camscope_drain(s);
+        if (s->flight_ns != 0) {
+            uint64_t now = camscope_now_ns();
+            camscope_free_chunks(s,
+                    (now > s->flight_ns) ? (now - s->flight_ns) : 1);
+            if (dump_req != s->dump_done) {
+                camscope_write_flight(camscope_section);
+            }
+        }
+
+        cam_thread_ring_reap(&s->rings);
+
+        pthread_mutex_lock(&s->lock);
+        if (dump_req != s->dump_done) {
+            s->dump_done = dump_req;
+            pthread_cond_broadcast(&s->dump_cond);
+        }
+        if (stop) {
+            break;
+        }
+        if (!s->stop && s->dump_req == dump_req) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += CAMSCOPE_FLUSH_PERIOD_MS * 1000000L;
+            if (ts.tv_nsec >= 1000000000L) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&s->cond, &s->lock, &ts);
         }
-        bytes_reserved = num_bytes_to_reserve;
     }
-    return bytes_reserved;
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
 }
 
-/* camscope_store_data:
+/* camscope_init:
  *
  *  @camscope_section: camscope section where this function is occurring
- *  @data:             data to be stored
- *  @size:             size of data to be stored
  *
- *  Store the data to the memstore and calculate remaining space
+ *  Initializes the CameraScope tool functionality. Packets are streamed to
+ *  the section's file, or with persist.camera.kpi.camscope_flight set to N
+ *  only the last N seconds are kept in memory until camscope_dump.
  *
  *  Return: N/A
  */
-void camscope_store_data(camscope_section_type camscope_section,
-                       void* data, uint32_t size) {
-    if(camscope_memstore[camscope_section] != NULL) {
-        memcpy(camscope_memstore[camscope_section] +
-               camscope_num_bytes_stored[camscope_section], (char*)data, size);
-        camscope_num_bytes_stored[camscope_section] += size;
+void camscope_init(camscope_section_type camscope_section) {
+    camscope_section_state *s = &camscope_state[camscope_section];
+    char prop[PROPERTY_VALUE_MAX];
+
+    pthread_mutex_lock(&s->lock);
+    if (s->active) {
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+
+    property_get("persist.camera.kpi.camscope_flight", prop, "0");
+    s->flight_ns = (uint64_t)atoi(prop) * 1000000000ULL;
+    if (s->flight_ns == 0) {
+        s->fd = fopen(camscope_filenames[camscope_section], "ab");
+        if (s->fd == NULL) {
+            CLOGE(CAM_NO_MODULE, "Failed to open %s",
+                  camscope_filenames[camscope_section]);
+            pthread_mutex_unlock(&s->lock);
+            return;
+        }
     }
+
+    s->stop = 0;
+    if (pthread_create(&s->flusher, NULL, camscope_flusher,
+            (void *)(intptr_t)camscope_section) != 0) {
+        CLOGE(CAM_NO_MODULE, "Failed to start camscope flusher");
+        if (s->fd != NULL) {
+            fclose(s->fd);
+            s->fd = NULL;
+        }
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    __atomic_store_n(&s->active, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&s->lock);
+}
+
+/* camscope_get_stats:
+ *
+ *  @camscope_section: camscope section where this function is occurring
+ *  @stats:            counters of all threads, filled on return
+ *
+ *  Return: N/A
+ */
+void camscope_get_stats(camscope_section_type camscope_section,
+                        camscope_stats_t *stats) {
+    camscope_section_state *s = &camscope_state[camscope_section];
+    cam_thread_ring_stats_t ring_stats;
+
+    cam_thread_ring_get_stats(&s->rings, &ring_stats);
+    uint64_t samples = __atomic_load_n(&s->samples, __ATOMIC_RELAXED);
+    uint64_t sampled_ns = __atomic_load_n(&s->sampled_ns, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&s->lock);
+    stats->events = ring_stats.written;
+    stats->dropped = ring_stats.dropped;
+    stats->bytes_out = __atomic_load_n(&s->bytes_out, __ATOMIC_RELAXED);
+    stats->avg_event_ns = (samples != 0) ? (uint32_t)(sampled_ns / samples) : 0;
+    stats->flight_sec = (uint32_t)(s->flight_ns / 1000000000ULL);
+    stats->active = s->active;
+    pthread_mutex_unlock(&s->lock);
 }
 
-/* camscope_mutex_lock:
+/* camscope_destroy:
  *
  *  @camscope_section: camscope section where this function is occurring
  *
- *  Lock the camscope mutex lock for the given camscope section
+ *  Flushes any remaining data to the file system and cleans up CameraScope
  *
  *  Return: N/A
  */
-void camscope_mutex_lock(camscope_section_type camscope_section) {
-    pthread_mutex_lock(&(camscope_mutex[camscope_section]));
+void camscope_destroy(camscope_section_type camscope_section) {
+    camscope_section_state *s = &camscope_state[camscope_section];
+    camscope_stats_t stats;
+
+    pthread_mutex_lock(&s->lock);
+    if (!s->active) {
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+    __atomic_store_n(&s->active, 0, __ATOMIC_RELEASE);
+    s->stop = 1;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+    pthread_join(s->flusher, NULL);
+
+    pthread_mutex_lock(&s->lock);
+    if (s->fd != NULL) {
+        fclose(s->fd);
+        s->fd = NULL;
+    }
+    camscope_free_chunks(s, 0);
+    /* release dump requests the flusher did not get to */
+    pthread_cond_broadcast(&s->dump_cond);
+    pthread_mutex_unlock(&s->lock);
+
+    camscope_get_stats(camscope_section, &stats);
+    CLOGH(CAM_NO_MODULE, "camscope %s: %" PRIu64 " events, %" PRIu64
+          " dropped, %" PRIu64 " bytes written, avg %u ns/event",
+          stats.flight_sec ? camscope_flight_filenames[camscope_section] :
+          camscope_filenames[camscope_section], stats.events,
+          stats.dropped, stats.bytes_out, stats.avg_event_ns);
 }
 
-/* camscope_mutex_unlock:
+/* camscope_dump:
  *
  *  @camscope_section: camscope section where this function is occurring
+ *  @fd:               file descriptor to print the stats to, -1 for none
  *
- *  Unlock the camscope mutex lock for the given camscope section
+ *  Prints the tracing stats and, in flight recorder mode, writes out what
+ *  is kept in memory
  *
  *  Return: N/A
  */
-void camscope_mutex_unlock(camscope_section_type camscope_section) {
-    pthread_mutex_unlock(&(camscope_mutex[camscope_section]));
+void camscope_dump(camscope_section_type camscope_section, int fd) {
+    camscope_section_state *s = &camscope_state[camscope_section];
+    camscope_stats_t stats;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->active && s->flight_ns != 0) {
+        uint32_t seq = ++s->dump_req;
+        pthread_cond_signal(&s->cond);
+        while (s->active && (int32_t)(s->dump_done - seq) < 0) {
+            pthread_cond_wait(&s->dump_cond, &s->lock);
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+
+    camscope_get_stats(camscope_section, &stats);
+    if (fd >= 0) {
+        dprintf(fd, "\nCamscope: %s, %s\n", stats.active ? "on" : "off",
+                stats.flight_sec ?
+                camscope_flight_filenames[camscope_section] :
+                camscope_filenames[camscope_section]);
+        dprintf(fd, " Events: %" PRIu64 " Dropped: %" PRIu64
+                " Bytes written: %" PRIu64 " Avg: %u ns/event"
+                " Flight window: %u s\n",
+                stats.events, stats.dropped, stats.bytes_out,
+                stats.avg_event_ns, stats.flight_sec);
+    }
 }
@@ -108,20 +108,29 @@ void camscope_init(camscope_section_type camscope_section);
 /* Cleans up CameraScope tool */
 void camscope_destroy(camscope_section_type camscope_section);
 
-/* Reserves a number of bytes on the memstore flushing to the
- * file system if remaining space is insufficient */
-uint32_t camscope_reserve(camscope_section_type camscope_section,
-                                 uint32_t num_bytes_to_reserve);
-
-/* Store the data to the memstore and calculate remaining space */
-void camscope_store_data(camscope_section_type camscope_section,
-                       void* data, uint32_t size);
-
-/* Lock the camscope mutex lock for the given camscope section */
-void camscope_mutex_lock(camscope_section_type camscope_section);
-
-/* Unlock the camscope mutex lock for the given camscope section */
-void camscope_mutex_unlock(camscope_section_type camscope_section);
+typedef struct {
+    uint64_t events;       /* packets stored by all threads */
+    uint64_t dropped;      /* packets lost because a thread buffer was full */
+    uint64_t bytes_out;    /* bytes written to the camscope files */
+    uint32_t avg_event_ns; /* sampled cost of one logging call */
+    uint32_t flight_sec;   /* flight recorder window, 0 when streaming */
+    int active;
+} camscope_stats_t;
+
+/* Starts timing the calling thread's next event if it is sampled */
+uint64_t camscope_overhead_begin();
+
+/* Appends a packet to the calling thread's buffer without blocking */
+void camscope_store_packet(camscope_section_type camscope_section,
+                           const void *data, uint32_t size,
+                           uint64_t start_ns);
+
+/* Returns the tracing counters of a section */
+void camscope_get_stats(camscope_section_type camscope_section,
+                        camscope_stats_t *stats);
+
+/* Prints the tracing counters and writes out the flight recorder */
+void camscope_dump(camscope_section_type camscope_section, int fd);
 
 #define CAMSCOPE_SYSTRACE_TIME_MARKER() { \
     if (kpi_camscope_frame_count != 0) { \
@@ -336,19 +336,14 @@ void camscope_base_log(uint32_t camscope_section,
                        uint32_t camscope_enable_mask, uint32_t packet_type) {
     if (kpi_camscope_frame_count != 0) {
         if (kpi_camscope_flags & camscope_enable_mask) {
+            uint64_t start_ns = camscope_overhead_begin();
             struct timeval timestamp;
             gettimeofday(&timestamp, NULL);
-            camscope_mutex_lock((camscope_section_type)camscope_section);
             camscope_base scope_struct;
             uint32_t size = sizeof(scope_struct);
-            uint32_t total_size =
-              camscope_reserve((camscope_section_type)camscope_section, size);
-            if (size == total_size) {
-                fill_camscope_base(&scope_struct, packet_type, size);
-                camscope_store_data((camscope_section_type)camscope_section,
-                                    &scope_struct, size);
-            }
-            camscope_mutex_unlock((camscope_section_type)camscope_section);
+            fill_camscope_base(&scope_struct, packet_type, size);
+            camscope_store_packet((camscope_section_type)camscope_section,
+                                  &scope_struct, size, start_ns);
         }
     }
 }
@@ -372,21 +367,16 @@ void camscope_sw_base_log(uint32_t camscope_section,
                           uint32_t packet_type, uint32_t event_name) {
     if (kpi_camscope_frame_count != 0) {
         if (kpi_camscope_flags & camscope_enable_mask) {
+            uint64_t start_ns = camscope_overhead_begin();
             struct timeval timestamp;
             gettimeofday(&timestamp, NULL);
-            camscope_mutex_lock((camscope_section_type)camscope_section);
             camscope_sw_base scope_struct;
             uint32_t size = sizeof(scope_struct);
             int32_t thread_id = (int32_t)get_thread_id();
-            uint32_t total_size =
-              camscope_reserve((camscope_section_type)camscope_section, size);
-            if (size == total_size) {
-                fill_camscope_sw_base(&scope_struct, packet_type, size,
-                                      timestamp, thread_id, event_name);
-                camscope_store_data((camscope_section_type)camscope_section,
-                                    &scope_struct, size);
-            }
-            camscope_mutex_unlock((camscope_section_type)camscope_section);
+            fill_camscope_sw_base(&scope_struct, packet_type, size,
+                                  timestamp, thread_id, event_name);
+            camscope_store_packet((camscope_section_type)camscope_section,
+                                  &scope_struct, size, start_ns);
         }
     }
 }
@@ -412,22 +402,17 @@ void camscope_timing_log(uint32_t camscope_section,
                          uint32_t event_name, uint32_t frame_id) {
     if (kpi_camscope_frame_count != 0) {
         if (kpi_camscope_flags & camscope_enable_mask) {
+            uint64_t start_ns = camscope_overhead_begin();
             struct timeval timestamp;
             gettimeofday(&timestamp, NULL);
-            camscope_mutex_lock((camscope_section_type)camscope_section);
             camscope_timing scope_struct;
             uint32_t size = sizeof(scope_struct);
             int32_t thread_id = (int32_t)get_thread_id();
-            uint32_t total_size =
-              camscope_reserve((camscope_section_type)camscope_section, size);
-            if (size == total_size) {
-                fill_camscope_timing(&scope_struct, packet_type, size,
-                                     timestamp, thread_id, event_name,
-                                     frame_id);
-                camscope_store_data((camscope_section_type)camscope_section,
-                                    &scope_struct, size);
-            }
-            camscope_mutex_unlock((camscope_section_type)camscope_section);
+            fill_camscope_timing(&scope_struct, packet_type, size,
+                                 timestamp, thread_id, event_name,
+                                 frame_id);
+            camscope_store_packet((camscope_section_type)camscope_section,
+                                  &scope_struct, size, start_ns);
         }
     }
 }
@@ -455,23 +440,18 @@ void camscope_in_out_timing_log(uint32_t camscope_section,
                                 uint32_t frame_id) {
     if (kpi_camscope_frame_count != 0) {
         if (kpi_camscope_flags & camscope_enable_mask) {
+            uint64_t start_ns = camscope_overhead_begin();
             struct timeval timestamp;
             gettimeofday(&timestamp, NULL);
-            camscope_mutex_lock((camscope_section_type)camscope_section);
             camscope_in_out_timing scope_struct;
             uint32_t size = sizeof(scope_struct);
             int32_t thread_id = (int32_t)get_thread_id();
-            uint32_t total_size =
-              camscope_reserve((camscope_section_type)camscope_section, size);
-            if (size == total_size) {
-                fill_camscope_in_out_timing(&scope_struct, packet_type, size,
-                                            timestamp, thread_id, event_name,
-                                            in_timestamp, out_timestamp,
-                                            frame_id);
-                camscope_store_data((camscope_section_type)camscope_section,
-                                    &scope_struct, size);
-            }
-            camscope_mutex_unlock((camscope_section_type)camscope_section);
+            fill_camscope_in_out_timing(&scope_struct, packet_type, size,
+                                        timestamp, thread_id, event_name,
+                                        in_timestamp, out_timestamp,
+                                        frame_id);
+            camscope_store_packet((camscope_section_type)camscope_section,
+                                  &scope_struct, size, start_ns);
         }
     }
 }
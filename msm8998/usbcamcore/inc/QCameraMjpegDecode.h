@@ -33,6 +33,7 @@ typedef int MJPEGD_ERR;
 #define MJPEGD_NO_ERROR          0
 #define MJPEGD_ERROR            -1
 #define MJPEGD_INSUFFICIENT_MEM -2
+#define MJPEGD_UNSUPPORTED      -3
 
 MJPEGD_ERR mjpegDecoderInit(void**);
 
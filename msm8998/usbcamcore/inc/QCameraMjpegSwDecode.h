@@ -0,0 +1,56 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __QCAMERA_MJPEG_SW_DECODE_H
+#define __QCAMERA_MJPEG_SW_DECODE_H
+
+#include <stdint.h>
+
+/* Maximum number of threads (including the caller) a frame is split across */
+#define MJPEG_SW_MAX_THREADS    4
+
+/* Software baseline MJPEG decoder writing semi planar 4:2:0 output. Frames
+ * with a restart interval are split at the restart markers and the
+ * segments are decoded in parallel. Huffman tables are cached across
+ * frames; frames without DHT use the standard tables. */
+
+int mjpegSwDecoderInit(void **handle, int numThreads);
+
+int mjpegSwDecoderDestroy(void *handle);
+
+/* Returns MJPEGD_NO_ERROR, MJPEGD_ERROR for a corrupt frame or
+ * MJPEGD_UNSUPPORTED for streams this decoder does not handle */
+int mjpegSwDecode(void *handle, const uint8_t *src, int srcLen,
+                  uint8_t *dstY, int dstYStride,
+                  uint8_t *dstUV, int dstUVStride, int crFirst);
+
+/* Dimensions of the last successfully parsed frame */
+void mjpegSwGetDimension(void *handle, int *width, int *height);
+
+#endif /* __QCAMERA_MJPEG_SW_DECODE_H */
@@ -0,0 +1,65 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QCAMERA_USB_COLOR_CONVERT_H
+#define __QCAMERA_USB_COLOR_CONVERT_H
+
+#include <stdint.h>
+
+/* Maximum number of threads (including the caller) a conversion is split
+ * across */
+#define YUYV_CONV_MAX_THREADS   4
+
+/* Minimum rows per band. Frames with fewer than twice this many rows are
+ * always converted on the caller. */
+#define YUYV_CONV_MIN_BAND_ROWS 64
+
+/* One YUYV to semi planar 4:2:0 (VU interleaved) conversion. Strides are in
+ * bytes. The destination planes may be a display buffer with padded rows. */
+typedef struct {
+    const uint8_t   *src;
+    int             srcStride;
+    uint8_t         *dstY;
+    int             dstYStride;
+    uint8_t         *dstVU;
+    int             dstVUStride;
+    int             width;
+    int             height;
+} yuyv_conv_job_t;
+
+int yuyvConvInit(void **handle, int numThreads);
+
+int yuyvConvDestroy(void *handle);
+
+int yuyvConvToNV21(void *handle, const yuyv_conv_job_t *job);
+
+/* Convert rows [startRow, endRow) on the calling thread. startRow must be
+ * even. */
+void yuyvConvRows(const yuyv_conv_job_t *job, int startRow, int endRow);
+
+#endif /* __QCAMERA_USB_COLOR_CONVERT_H */
@@ -40,6 +40,16 @@ namespace android {
 /* Number of V4L2 capture  buffers. */
 #define PRVW_CAP_BUF_CNT    4
 
+/* Depth of the capture to decode queue in pipelined preview */
+#define USB_CAM_PIPE_DEPTH      2
+
+/* Maximum number of frames any pipelined preview queue can hold */
+#define USB_CAM_PIPE_MAX_FRAMES 16
+
+/* Staging buffers for copied MJPEG frames: one per capture queue slot, one */
+/* being filled by the capture stage and one being decoded                 */
+#define USB_CAM_PIPE_STAGING_CNT (USB_CAM_PIPE_DEPTH + 2)
+
 /* Maximum buffer size for JPEG output in number of bytes */
 #define MAX_JPEG_BUFFER_SIZE    (1024 * 1024)
 
@@ -127,6 +137,29 @@ struct bufObj {
     int     len;
 };
 
+/* Frame passed between the pipelined preview stages */
+typedef struct {
+    /* V4L2 buffer index still held by the frame, -1 if none */
+    int     capIdx;
+    /* Staging buffer holding a copy of the frame, -1 if none */
+    int     stagingIdx;
+    int     bytesused;
+    /* Display buffer filled by the decode stage, -1 if none */
+    int     dispIdx;
+} usb_cam_frame_t;
+
+/* Bounded frame queue. Puts never block; a full queue drops its oldest */
+/* frame and hands it back to the caller for release                   */
+typedef struct {
+    usb_cam_frame_t     frames[USB_CAM_PIPE_MAX_FRAMES];
+    int                 size;
+    int                 head;
+    int                 count;
+    int                 abort;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+} usb_cam_frame_queue_t;
+
 typedef struct {
     camera_device                       hw_dev;
     Mutex                               lock;
@@ -170,6 +203,29 @@ typedef struct {
     /* MJPEG decoder object */
     void*                               mjpegd;
 
+    /* Pipelined preview related members */
+    int                                 pipelineEnabled;
+    volatile int                        pipeStop;
+    pthread_t                           captureThread;
+    pthread_t                           decodeThread;
+    usb_cam_frame_queue_t               capQueue;
+    usb_cam_frame_queue_t               presentQueue;
+    usb_cam_frame_queue_t               stagingFreeQueue;
+    struct bufObj                       staging[USB_CAM_PIPE_STAGING_CNT];
+    int                                 pipeDropCnt;
+    /* Set while the preview thread owns a running pipeline. A window */
+    /* change is then done by the preview thread with the pipeline     */
+    /* stopped, see usbcam_set_preview_window                          */
+    int                                 pipeActive;
+    int                                 windowChangePending;
+    int                                 windowChangeRc;
+    preview_stream_ops*                 pendingWindow;
+    Condition                           windowChangeCond;
+
+    /* YUYV color conversion related members */
+    /* YUYV to YCrCb 4:2:0 converter object */
+    void*                               yuyvConv;
+
     /* JPEG picture and thumbnail related members */
     int                                 pictFormat;
     int                                 pictWidth;
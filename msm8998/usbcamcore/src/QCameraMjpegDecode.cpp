@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <cutils/properties.h>
 
 extern "C" {
 #include "jpeg_buffer.h"
@@ -42,6 +43,7 @@ extern "C" {
 }
 
 #include "QCameraMjpegDecode.h"
+#include "QCameraMjpegSwDecode.h"
 
 /* TBDJ: Can be removed */
 #define MIN(a,b)  (((a) < (b)) ? (a) : (b))
@@ -95,6 +97,9 @@ typedef struct
     char*       outputYptr;
     char*       outputUVptr;
 
+    /* Parallel restart interval decoder, NULL if disabled */
+    void*       swDecoder;
+
 } test_args_t;
 
 typedef struct
@@ -161,6 +166,19 @@ MJPEGD_ERR mjpegDecoderInit(void** mjpegd_obj)
     mjpegd->height                = 480;
     mjpegd->abort_time            = 0;
 
+    /* Number of threads for the software restart interval decoder. */
+    /* 0 keeps decoding through jpegd only.                          */
+    {
+        char value[PROPERTY_VALUE_MAX];
+        int  threads;
+
+        property_get("persist.camera.usb.swjpegd", value, "0");
+        threads = atoi(value);
+        if(threads > 0 &&
+           MJPEGD_NO_ERROR != mjpegSwDecoderInit(&mjpegd->swDecoder, threads))
+            ALOGE("%s: mjpegSwDecoderInit failed, using jpegd", __func__);
+    }
+
     *mjpegd_obj = (void *)mjpegd;
 
     ALOGD("%s: X", __func__);
@@ -188,6 +206,22 @@ MJPEGD_ERR mjpegDecode(
     mjpegd->outputUVptr             = outputUVptr;
     mjpegd->format                  = outputFormat;
 
+    /* Streams the software decoder does not handle fall back to jpegd */
+    if(mjpegd->swDecoder &&
+       ((outputFormat == YCRCBLP_H2V2) || (outputFormat == YCBCRLP_H2V2))) {
+        rc = mjpegSwDecode(mjpegd->swDecoder,
+                           (const uint8_t *)inputMjpegBuffer,
+                           inputMjpegBufferSize,
+                           (uint8_t *)outputYptr, 0,
+                           (uint8_t *)outputUVptr, 0,
+                           (outputFormat == YCRCBLP_H2V2));
+        if(rc != MJPEGD_UNSUPPORTED) {
+            ALOGD("%s: X sw rc: %d", __func__, rc);
+            return rc;
+        }
+        ALOGD("%s: stream not supported by sw decoder", __func__);
+    }
+
     /* TBDJ: can be removed */
     memcpy(&test_args, mjpegd, sizeof(test_args_t));
 
@@ -225,6 +259,25 @@ MJPEGD_ERR mjpegDecode(
     return rc;
 }
 
+/*
+ * This function destroys the mjpeg decoder object
+ */
+MJPEGD_ERR mjpegDecoderDestroy(void* mjpegd_obj)
+{
+    test_args_t* mjpegd = (test_args_t*) mjpegd_obj;
+
+    ALOGD("%s: E", __func__);
+    if(!mjpegd)
+        return MJPEGD_ERROR;
+
+    if(mjpegd->swDecoder)
+        mjpegSwDecoderDestroy(mjpegd->swDecoder);
+    free(mjpegd);
+
+    ALOGD("%s: X", __func__);
+    return MJPEGD_NO_ERROR;
+}
+
 OS_THREAD_FUNC_RET_T OS_THREAD_FUNC_MODIFIER decoder_test(OS_THREAD_FUNC_ARG_T arg)
 {
     int rc, i;
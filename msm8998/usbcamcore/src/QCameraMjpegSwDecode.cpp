@@ -0,0 +1,1260 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+//#define ALOG_NDEBUG 0
+#define ALOG_NIDEBUG 0
+#define LOG_TAG "QCameraMjpegSwDecode"
+#include <utils/Log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "QCameraMjpegDecode.h"
+#include "QCameraMjpegSwDecode.h"
+
+/* Code lengths resolved with a single table lookup */
+#define HUFF_LOOKAHEAD          9
+
+#define MAX_COMPONENTS          3
+
+/* JPEG markers */
+#define M_SOF0                  0xC0
+#define M_SOF1                  0xC1
+#define M_DHT                   0xC4
+#define M_RST0                  0xD0
+#define M_RST7                  0xD7
+#define M_SOI                   0xD8
+#define M_EOI                   0xD9
+#define M_SOS                   0xDA
+#define M_DQT                   0xDB
+#define M_DRI                   0xDD
+
+/* Islow IDCT constants, as in the IJG reference decoder */
+#define CONST_BITS              13
+#define PASS1_BITS              2
+#define FIX_0_298631336         ((int32_t)2446)
+#define FIX_0_390180644         ((int32_t)3196)
+#define FIX_0_541196100         ((int32_t)4433)
+#define FIX_0_765366865         ((int32_t)6270)
+#define FIX_0_899976223         ((int32_t)7373)
+#define FIX_1_175875602         ((int32_t)9633)
+#define FIX_1_501321110         ((int32_t)12299)
+#define FIX_1_847759065         ((int32_t)15137)
+#define FIX_1_961570560         ((int32_t)16069)
+#define FIX_2_053119869         ((int32_t)16819)
+#define FIX_2_562915447         ((int32_t)20995)
+#define FIX_3_072711026         ((int32_t)25172)
+#define DESCALE(x, n)           (((x) + (1 << ((n) - 1))) >> (n))
+/* Left shift that is defined for negative values */
+#define SCALEUP(x, n)           ((x) * (1 << (n)))
+
+/* Baseline DC differences have at most 11 bits */
+#define MAX_DC_BITS             11
+/* Limits of predictors and dequantized coefficients */
+#define COEF_MIN                (-32768)
+#define COEF_MAX                32767
+
+typedef struct {
+    uint8_t     bits[17];
+    uint8_t     huffval[256];
+} huff_spec_t;
+
+typedef struct {
+    huff_spec_t spec;
+    int32_t     maxcode[18];
+    int32_t     valoffset[18];
+    /* (code length << 8) | symbol, 0 for codes longer than the lookahead */
+    uint16_t    lookup[1 << HUFF_LOOKAHEAD];
+    int         valid;
+} huff_tbl_t;
+
+typedef struct {
+    int         id;
+    int         h;
+    int         v;
+    int         tq;
+    int         td;
+    int         ta;
+} mjpeg_comp_t;
+
+/* Entropy coded data between two restart markers */
+typedef struct {
+    const uint8_t   *start;
+    const uint8_t   *end;
+} mjpeg_segment_t;
+
+typedef struct {
+    const uint8_t   *ptr;
+    const uint8_t   *end;
+    uint64_t        buf;
+    int             cnt;
+} bit_reader_t;
+
+typedef struct {
+    void        *dec;
+    int         index;
+} mjpeg_worker_t;
+
+typedef struct {
+    /* Worker pool */
+    int                 numThreads;
+    pthread_t           threads[MJPEG_SW_MAX_THREADS - 1];
+    mjpeg_worker_t      workers[MJPEG_SW_MAX_THREADS - 1];
+    pthread_mutex_t     lock;
+    pthread_cond_t      startCond;
+    pthread_cond_t      doneCond;
+    uint32_t            generation;
+    int                 pending;
+    int                 exit;
+    int                 numGroups;
+    int                 groupError[MJPEG_SW_MAX_THREADS];
+
+    /* Tables. Standard Huffman tables are built once; DHT defined tables
+     * are cached per class and id and only rebuilt when they change. */
+    uint16_t            qt[4][64];
+    huff_tbl_t          stdTbl[2][2];
+    huff_tbl_t          dhtTbl[2][4];
+    const huff_tbl_t    *dcTbl[4];
+    const huff_tbl_t    *acTbl[4];
+    uint32_t            dhtHits;
+    uint32_t            dhtBuilds;
+
+    /* Current frame */
+    int                 width;
+    int                 height;
+    int                 numComp;
+    mjpeg_comp_t        comp[MAX_COMPONENTS];
+    int                 hmax;
+    int                 vmax;
+    int                 mcusX;
+    int                 mcusY;
+    int                 restartInterval;
+    mjpeg_segment_t     *segs;
+    int                 numSegs;
+    int                 segCap;
+    uint8_t             *dstY;
+    uint8_t             *dstUV;
+    int                 dstYStride;
+    int                 dstUVStride;
+    int                 crFirst;
+} mjpeg_sw_t;
+
+static const uint8_t natural_order[64 + 16] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63,
+    /* Extra entries absorb run lengths past the end of a corrupt block */
+    63, 63, 63, 63, 63, 63, 63, 63,
+    63, 63, 63, 63, 63, 63, 63, 63
+};
+
+/* Standard Huffman tables (ITU T.81 Annex K.3) used by MJPEG frames that
+ * carry no DHT segment */
+static const uint8_t std_dc_luma_bits[17] =
+    { 0, 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t std_dc_chroma_bits[17] =
+    { 0, 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t std_dc_vals[12] =
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const uint8_t std_ac_luma_bits[17] =
+    { 0, 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t std_ac_luma_vals[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12,
+    0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16,
+    0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79,
+    0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98,
+    0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4,
+    0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+static const uint8_t std_ac_chroma_bits[17] =
+    { 0, 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t std_ac_chroma_vals[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21,
+    0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34,
+    0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78,
+    0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96,
+    0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2,
+    0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9,
+    0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+/******************************************************************************
+ * Function: buildHuffTable
+ * Description: Builds the decoding tables for a Huffman table specification
+ *
+ * Input parameters:
+ *   tbl                 - table with tbl->spec filled in
+ *
+ * Return values:
+ *      0   Success
+ *      -1  Invalid table
+ *
+ * Notes: none
+ *****************************************************************************/
+static int buildHuffTable(huff_tbl_t *tbl)
+{
+    uint8_t     huffsize[257];
+    uint32_t    huffcode[257];
+    uint32_t    code;
+    int         p, l, i, si, numVals;
+
+    tbl->valid = 0;
+    for(p = 0, l = 1; l <= 16; l++) {
+        for(i = 0; i < tbl->spec.bits[l]; i++) {
+            if(p >= 256)
+                return -1;
+            huffsize[p++] = (uint8_t)l;
+        }
+    }
+    huffsize[p] = 0;
+    numVals = p;
+
+    code = 0;
+    si = huffsize[0];
+    p = 0;
+    while(huffsize[p]) {
+        while(huffsize[p] == si) {
+            huffcode[p++] = code++;
+        }
+        if(code >= (1u << si))
+            return -1;
+        code <<= 1;
+        si++;
+    }
+
+    for(p = 0, l = 1; l <= 16; l++) {
+        if(tbl->spec.bits[l]) {
+            tbl->valoffset[l] = p - (int32_t)huffcode[p];
+            p += tbl->spec.bits[l];
+            tbl->maxcode[l] = huffcode[p - 1];
+        }else{
+            tbl->maxcode[l] = -1;
+        }
+    }
+    tbl->maxcode[17] = 0xFFFFF;
+
+    memset(tbl->lookup, 0, sizeof(tbl->lookup));
+    for(p = 0, l = 1; l <= HUFF_LOOKAHEAD; l++) {
+        for(i = 0; i < tbl->spec.bits[l]; i++, p++) {
+            uint32_t look = huffcode[p] << (HUFF_LOOKAHEAD - l);
+            uint32_t cnt = 1u << (HUFF_LOOKAHEAD - l);
+            while(cnt--)
+                tbl->lookup[look++] = (uint16_t)((l << 8) | tbl->spec.huffval[p]);
+        }
+    }
+
+    tbl->valid = (numVals > 0);
+    return tbl->valid ? 0 : -1;
+}
+
+/******************************************************************************
+ * Function: initStdHuffTable
+ * Description: Builds one of the standard Huffman tables
+ *
+ * Input parameters:
+ *   tbl                 - table to be built
+ *   bits                - code length counts
+ *   vals                - symbols
+ *   numVals             - number of symbols
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void initStdHuffTable(huff_tbl_t *tbl, const uint8_t *bits,
+                             const uint8_t *vals, int numVals)
+{
+    memset(&tbl->spec, 0, sizeof(tbl->spec));
+    memcpy(tbl->spec.bits, bits, sizeof(tbl->spec.bits));
+    memcpy(tbl->spec.huffval, vals, numVals);
+    buildHuffTable(tbl);
+}
+
+static inline void brFill(bit_reader_t *br)
+{
+    while(br->cnt <= 56) {
+        uint32_t c = 0;
+        if(br->ptr < br->end) {
+            c = *br->ptr++;
+            if(c == 0xFF) {
+                if((br->ptr < br->end) && (*br->ptr == 0x00)) {
+                    br->ptr++;
+                }else{
+                    /* Marker: feed zeros from here on */
+                    br->ptr = br->end;
+                    c = 0;
+                }
+            }
+        }
+        br->buf |= (uint64_t)c << (56 - br->cnt);
+        br->cnt += 8;
+    }
+}
+
+static inline uint32_t brGet(bit_reader_t *br, int n)
+{
+    uint32_t v = (uint32_t)(br->buf >> (64 - n));
+    br->buf <<= n;
+    br->cnt -= n;
+    return v;
+}
+
+static inline int huffDecode(bit_reader_t *br, const huff_tbl_t *tbl)
+{
+    uint32_t    code;
+    uint16_t    entry;
+    int         l;
+
+    if(br->cnt < 16)
+        brFill(br);
+
+    entry = tbl->lookup[br->buf >> (64 - HUFF_LOOKAHEAD)];
+    if(entry) {
+        brGet(br, entry >> 8);
+        return entry & 0xFF;
+    }
+
+    for(l = HUFF_LOOKAHEAD + 1; l <= 16; l++) {
+        code = (uint32_t)(br->buf >> (64 - l));
+        if((int32_t)code <= tbl->maxcode[l]) {
+            brGet(br, l);
+            return tbl->spec.huffval[(tbl->valoffset[l] + code) & 0xFF];
+        }
+    }
+    /* Corrupt code; skip a bit so decode always progresses */
+    brGet(br, 1);
+    return -1;
+}
+
+static inline int32_t receiveExtend(bit_reader_t *br, int s)
+{
+    uint32_t v;
+
+    if(br->cnt < s)
+        brFill(br);
+    v = brGet(br, s);
+    if(v < (1u << (s - 1)))
+        return (int32_t)v - (1 << s) + 1;
+    return (int32_t)v;
+}
+
+/******************************************************************************
+ * Function: clampCoef
+ * Description: Limits a DC predictor or dequantized coefficient to the 16 bit
+ *              range. Valid 8 bit streams stay well inside it; corrupt ones
+ *              are kept from overflowing the IDCT.
+ *
+ * Input parameters:
+ *   v                   - value to limit
+ *
+ * Return values:
+ *      limited value
+ *
+ * Notes: none
+ *****************************************************************************/
+static inline int32_t clampCoef(int64_t v)
+{
+    return (int32_t)((v < COEF_MIN) ? COEF_MIN : ((v > COEF_MAX) ? COEF_MAX : v));
+}
+
+/******************************************************************************
+ * Function: decodeBlock
+ * Description: Huffman decodes and dequantizes one 8x8 block
+ *
+ * Input parameters:
+ *   br                  - bit reader
+ *   dc, ac              - Huffman tables
+ *   qt                  - quantization table in natural order
+ *   pred                - DC predictor of the component
+ *   coef                - output coefficients in natural order
+ *
+ * Return values:
+ *      1   Block has non zero AC coefficients
+ *      0   DC only block
+ *      -1  Corrupt data
+ *
+ * Notes: none
+ *****************************************************************************/
+static inline int decodeBlock(bit_reader_t *br, const huff_tbl_t *dc,
+                              const huff_tbl_t *ac, const uint16_t *qt,
+                              int *pred, int32_t *coef)
+{
+    int s, r, k, rs, hasAc = 0;
+
+    memset(coef, 0, 64 * sizeof(int32_t));
+
+    s = huffDecode(br, dc);
+    if((s < 0) || (s > MAX_DC_BITS))
+        return -1;
+    if(s) {
+        *pred += receiveExtend(br, s);
+        *pred = (int)clampCoef(*pred);
+    }
+    coef[0] = clampCoef((int64_t)*pred * qt[0]);
+
+    for(k = 1; k < 64; k++) {
+        rs = huffDecode(br, ac);
+        if(rs < 0)
+            return -1;
+        r = rs >> 4;
+        s = rs & 15;
+        if(s) {
+            k += r;
+            coef[natural_order[k]] = clampCoef(
+                (int64_t)receiveExtend(br, s) * qt[natural_order[k]]);
+            hasAc = 1;
+        }else{
+            if(r != 15)
+                break;
+            k += 15;
+        }
+    }
+    return hasAc;
+}
+
+static inline uint8_t clampSample(int64_t v)
+{
+    v += 128;
+    return (uint8_t)((v < 0) ? 0 : ((v > 255) ? 255 : v));
+}
+
+/******************************************************************************
+ * Function: idctIslow
+ * Description: Accurate integer inverse DCT of one dequantized block, the
+ *              same algorithm as the IJG islow IDCT
+ *
+ * Input parameters:
+ *   coef                - dequantized coefficients in natural order
+ *   hasAc               - 0 if all AC coefficients are zero
+ *   out                 - 8x8 output samples
+ *   stride              - output row stride
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: Coefficients are limited to 16 bits by decodeBlock. Products are
+ *        computed in 64 bits so that corrupt data cannot overflow them;
+ *        valid data gives the same results as the 32 bit IJG code.
+ *****************************************************************************/
+static void idctIslow(const int32_t *coef, int hasAc, uint8_t *out,
+                      int stride)
+{
+    int64_t tmp0, tmp1, tmp2, tmp3, tmp10, tmp11, tmp12, tmp13;
+    int64_t z1, z2, z3, z4, z5;
+    int32_t ws[64];
+    const int32_t *in;
+    int32_t *w;
+    int ctr;
+
+    if(!hasAc) {
+        uint8_t dc = clampSample(DESCALE(SCALEUP(coef[0], PASS1_BITS),
+                                         PASS1_BITS + 3));
+        for(ctr = 0; ctr < 8; ctr++)
+            memset(out + ctr * stride, dc, 8);
+        return;
+    }
+
+    /* Pass 1: columns into the work array */
+    for(ctr = 0, in = coef, w = ws; ctr < 8; ctr++, in++, w++) {
+        if(!(in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56])) {
+            int32_t dcval = SCALEUP(in[0], PASS1_BITS);
+            w[0] = w[8] = w[16] = w[24] = w[32] = w[40] = w[48] = w[56] = dcval;
+            continue;
+        }
+
+        z2 = in[16];
+        z3 = in[48];
+        z1 = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 + z3 * (-FIX_1_847759065);
+        tmp3 = z1 + z2 * FIX_0_765366865;
+
+        z2 = in[0];
+        z3 = in[32];
+        tmp0 = SCALEUP(z2 + z3, CONST_BITS);
+        tmp1 = SCALEUP(z2 - z3, CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        tmp0 = in[56];
+        tmp1 = in[40];
+        tmp2 = in[24];
+        tmp3 = in[8];
+
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp0 = tmp0 * FIX_0_298631336;
+        tmp1 = tmp1 * FIX_2_053119869;
+        tmp2 = tmp2 * FIX_3_072711026;
+        tmp3 = tmp3 * FIX_1_501321110;
+        z1 = z1 * (-FIX_0_899976223);
+        z2 = z2 * (-FIX_2_562915447);
+        z3 = z3 * (-FIX_1_961570560);
+        z4 = z4 * (-FIX_0_390180644);
+
+        z3 += z5;
+        z4 += z5;
+
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        w[0]  = (int32_t)DESCALE(tmp10 + tmp3, CONST_BITS - PASS1_BITS);
+        w[56] = (int32_t)DESCALE(tmp10 - tmp3, CONST_BITS - PASS1_BITS);
+        w[8]  = (int32_t)DESCALE(tmp11 + tmp2, CONST_BITS - PASS1_BITS);
+        w[48] = (int32_t)DESCALE(tmp11 - tmp2, CONST_BITS - PASS1_BITS);
+        w[16] = (int32_t)DESCALE(tmp12 + tmp1, CONST_BITS - PASS1_BITS);
+        w[40] = (int32_t)DESCALE(tmp12 - tmp1, CONST_BITS - PASS1_BITS);
+        w[24] = (int32_t)DESCALE(tmp13 + tmp0, CONST_BITS - PASS1_BITS);
+        w[32] = (int32_t)DESCALE(tmp13 - tmp0, CONST_BITS - PASS1_BITS);
+    }
+
+    /* Pass 2: rows from the work array into the output */
+    for(ctr = 0, w = ws; ctr < 8; ctr++, w += 8, out += stride) {
+        if(!(w[1] | w[2] | w[3] | w[4] | w[5] | w[6] | w[7])) {
+            uint8_t dc = clampSample(DESCALE(w[0], PASS1_BITS + 3));
+            memset(out, dc, 8);
+            continue;
+        }
+
+        z2 = w[2];
+        z3 = w[6];
+        z1 = (z2 + z3) * FIX_0_541196100;
+        tmp2 = z1 + z3 * (-FIX_1_847759065);
+        tmp3 = z1 + z2 * FIX_0_765366865;
+
+        tmp0 = SCALEUP((int64_t)w[0] + w[4], CONST_BITS);
+        tmp1 = SCALEUP((int64_t)w[0] - w[4], CONST_BITS);
+
+        tmp10 = tmp0 + tmp3;
+        tmp13 = tmp0 - tmp3;
+        tmp11 = tmp1 + tmp2;
+        tmp12 = tmp1 - tmp2;
+
+        tmp0 = w[7];
+        tmp1 = w[5];
+        tmp2 = w[3];
+        tmp3 = w[1];
+
+        z1 = tmp0 + tmp3;
+        z2 = tmp1 + tmp2;
+        z3 = tmp0 + tmp2;
+        z4 = tmp1 + tmp3;
+        z5 = (z3 + z4) * FIX_1_175875602;
+
+        tmp0 = tmp0 * FIX_0_298631336;
+        tmp1 = tmp1 * FIX_2_053119869;
+        tmp2 = tmp2 * FIX_3_072711026;
+        tmp3 = tmp3 * FIX_1_501321110;
+        z1 = z1 * (-FIX_0_899976223);
+        z2 = z2 * (-FIX_2_562915447);
+        z3 = z3 * (-FIX_1_961570560);
+        z4 = z4 * (-FIX_0_390180644);
+
+        z3 += z5;
+        z4 += z5;
+
+        tmp0 += z1 + z3;
+        tmp1 += z2 + z4;
+        tmp2 += z2 + z3;
+        tmp3 += z1 + z4;
+
+        out[0] = clampSample(DESCALE(tmp10 + tmp3, CONST_BITS + PASS1_BITS + 3));
+        out[7] = clampSample(DESCALE(tmp10 - tmp3, CONST_BITS + PASS1_BITS + 3));
+        out[1] = clampSample(DESCALE(tmp11 + tmp2, CONST_BITS + PASS1_BITS + 3));
+        out[6] = clampSample(DESCALE(tmp11 - tmp2, CONST_BITS + PASS1_BITS + 3));
+        out[2] = clampSample(DESCALE(tmp12 + tmp1, CONST_BITS + PASS1_BITS + 3));
+        out[5] = clampSample(DESCALE(tmp12 - tmp1, CONST_BITS + PASS1_BITS + 3));
+        out[3] = clampSample(DESCALE(tmp13 + tmp0, CONST_BITS + PASS1_BITS + 3));
+        out[4] = clampSample(DESCALE(tmp13 - tmp0, CONST_BITS + PASS1_BITS + 3));
+    }
+}
+
+/******************************************************************************
+ * Function: writeMcu
+ * Description: Copies a decoded MCU to the output planes. Chroma is
+ *              subsampled to 4:2:0 by averaging when the stream carries more
+ *              chroma resolution.
+ *
+ * Input parameters:
+ *   dec                 - decoder object
+ *   mx, my              - MCU position
+ *   yblk                - luma samples, stride 16
+ *   cb, cr              - chroma samples, stride 8
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void writeMcu(mjpeg_sw_t *dec, int mx, int my, const uint8_t *yblk,
+                     const uint8_t *cb, const uint8_t *cr)
+{
+    int mcuW = dec->hmax * 8, mcuH = dec->vmax * 8;
+    int x0 = mx * mcuW, y0 = my * mcuH;
+    int w = dec->width - x0, h = dec->height - y0;
+    int cx0 = x0 / 2, cy0 = y0 / 2;
+    int cw = (dec->width + 1) / 2 - cx0, ch = (dec->height + 1) / 2 - cy0;
+    int r, c, u, v, i;
+    uint8_t *dst;
+
+    if(w > mcuW)
+        w = mcuW;
+    if(h > mcuH)
+        h = mcuH;
+    for(r = 0; r < h; r++)
+        memcpy(dec->dstY + (y0 + r) * dec->dstYStride + x0, yblk + r * 16, w);
+
+    if(cw > mcuW / 2)
+        cw = mcuW / 2;
+    if(ch > mcuH / 2)
+        ch = mcuH / 2;
+    for(r = 0; r < ch; r++) {
+        dst = dec->dstUV + (cy0 + r) * dec->dstUVStride + cx0 * 2;
+        for(c = 0; c < cw; c++) {
+            if(dec->numComp == 1) {
+                u = v = 128;
+            }else if(dec->vmax == 2) {
+                /* H2V2: chroma already at 4:2:0 resolution */
+                i = r * 8 + c;
+                u = cb[i];
+                v = cr[i];
+            }else if(dec->hmax == 2) {
+                /* H2V1: average vertically */
+                i = r * 16 + c;
+                u = (cb[i] + cb[i + 8] + 1) >> 1;
+                v = (cr[i] + cr[i + 8] + 1) >> 1;
+            }else{
+                /* H1V1: average 2x2 */
+                i = r * 16 + c * 2;
+                u = (cb[i] + cb[i + 1] + cb[i + 8] + cb[i + 9] + 2) >> 2;
+                v = (cr[i] + cr[i + 1] + cr[i + 8] + cr[i + 9] + 2) >> 2;
+            }
+            dst[c * 2]      = (uint8_t)(dec->crFirst ? v : u);
+            dst[c * 2 + 1]  = (uint8_t)(dec->crFirst ? u : v);
+        }
+    }
+}
+
+/******************************************************************************
+ * Function: decodeSegment
+ * Description: Decodes the MCUs of one restart segment
+ *
+ * Input parameters:
+ *   dec                 - decoder object
+ *   segIdx              - segment index
+ *
+ * Return values:
+ *      0   Success
+ *      -1  Corrupt data
+ *
+ * Notes: Segments are independent: DC predictors restart at 0 and each
+ *        segment writes its own MCUs only
+ *****************************************************************************/
+static int decodeSegment(mjpeg_sw_t *dec, int segIdx)
+{
+    bit_reader_t    br;
+    int32_t         coef[64];
+    uint8_t         yblk[16 * 16];
+    uint8_t         cblk[2][64];
+    int             pred[MAX_COMPONENTS] = { 0, 0, 0 };
+    int             total = dec->mcusX * dec->mcusY;
+    int             first, last, m, ci, bx, by, hasAc, rc = 0;
+
+    if(dec->restartInterval) {
+        first = segIdx * dec->restartInterval;
+        last  = first + dec->restartInterval;
+        if(last > total)
+            last = total;
+    }else{
+        first = 0;
+        last  = total;
+    }
+
+    br.ptr = dec->segs[segIdx].start;
+    br.end = dec->segs[segIdx].end;
+    br.buf = 0;
+    br.cnt = 0;
+
+    for(m = first; m < last; m++) {
+        for(ci = 0; ci < dec->numComp; ci++) {
+            const mjpeg_comp_t *comp = &dec->comp[ci];
+            int h = (dec->numComp == 1) ? 1 : comp->h;
+            int v = (dec->numComp == 1) ? 1 : comp->v;
+
+            for(by = 0; by < v; by++) {
+                for(bx = 0; bx < h; bx++) {
+                    hasAc = decodeBlock(&br, dec->dcTbl[comp->td],
+                        dec->acTbl[comp->ta], dec->qt[comp->tq],
+                        &pred[ci], coef);
+                    if(hasAc < 0) {
+                        rc = -1;
+                        hasAc = 1;
+                    }
+                    if(ci == 0)
+                        idctIslow(coef, hasAc, yblk + by * 8 * 16 + bx * 8, 16);
+                    else
+                        idctIslow(coef, hasAc, cblk[ci - 1], 8);
+                }
+            }
+        }
+        writeMcu(dec, m % dec->mcusX, m / dec->mcusX, yblk,
+                 cblk[0], cblk[1]);
+    }
+    return rc;
+}
+
+/******************************************************************************
+ * Function: decodeGroup
+ * Description: Decodes the share of restart segments of one thread
+ *
+ * Input parameters:
+ *   dec                 - decoder object
+ *   group               - group index, 0 .. numGroups - 1
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void decodeGroup(mjpeg_sw_t *dec, int group)
+{
+    int first = group * dec->numSegs / dec->numGroups;
+    int last  = (group + 1) * dec->numSegs / dec->numGroups;
+    int i;
+
+    dec->groupError[group] = 0;
+    for(i = first; i < last; i++) {
+        if(decodeSegment(dec, i))
+            dec->groupError[group] = 1;
+    }
+}
+
+static void *mjpegSwWorker(void *arg)
+{
+    mjpeg_worker_t  *worker = (mjpeg_worker_t *)arg;
+    mjpeg_sw_t      *dec = (mjpeg_sw_t *)worker->dec;
+    uint32_t        seen = 0;
+
+    pthread_mutex_lock(&dec->lock);
+    while(1) {
+        while(!dec->exit && (seen == dec->generation))
+            pthread_cond_wait(&dec->startCond, &dec->lock);
+        if(dec->exit)
+            break;
+        seen = dec->generation;
+        pthread_mutex_unlock(&dec->lock);
+
+        /* The caller decodes group 0 */
+        if(worker->index + 1 < dec->numGroups)
+            decodeGroup(dec, worker->index + 1);
+
+        pthread_mutex_lock(&dec->lock);
+        if(--dec->pending == 0)
+            pthread_cond_signal(&dec->doneCond);
+    }
+    pthread_mutex_unlock(&dec->lock);
+    return NULL;
+}
+
+static inline int read16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+/******************************************************************************
+ * Function: parseDht
+ * Description: Parses a DHT segment. Tables identical to the cached ones for
+ *              the same class and id are not rebuilt.
+ *
+ * Input parameters:
+ *   dec                 - decoder object
+ *   p                   - segment payload
+ *   len                 - payload length
+ *
+ * Return values:
+ *      0   Success
+ *      -1  Invalid segment
+ *
+ * Notes: none
+ *****************************************************************************/
+static int parseDht(mjpeg_sw_t *dec, const uint8_t *p, int len)
+{
+    huff_spec_t spec;
+    int         tc, th, i, count;
+
+    while(len > 17) {
+        tc = p[0] >> 4;
+        th = p[0] & 15;
+        if((tc > 1) || (th > 3))
+            return -1;
+
+        memset(&spec, 0, sizeof(spec));
+        for(count = 0, i = 1; i <= 16; i++) {
+            spec.bits[i] = p[i];
+            count += p[i];
+        }
+        if((count > 256) || (17 + count > len))
+            return -1;
+        memcpy(spec.huffval, p + 17, count);
+
+        huff_tbl_t *tbl = &dec->dhtTbl[tc][th];
+        if(tbl->valid && !memcmp(&tbl->spec, &spec, sizeof(spec))) {
+            dec->dhtHits++;
+        }else{
+            tbl->spec = spec;
+            if(buildHuffTable(tbl))
+                return -1;
+            dec->dhtBuilds++;
+        }
+        if(tc == 0)
+            dec->dcTbl[th] = tbl;
+        else
+            dec->acTbl[th] = tbl;
+
+        p   += 17 + count;
+        len -= 17 + count;
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * Function: parseHeaders
+ * Description: Parses the frame headers up to the start of scan and splits
+ *              the entropy coded data at the restart markers
+ *
+ * Input parameters:
+ *   dec                 - decoder object
+ *   src                 - frame data
+ *   len                 - frame length
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR, MJPEGD_ERROR or MJPEGD_UNSUPPORTED
+ *
+ * Notes: none
+ *****************************************************************************/
+static int parseHeaders(mjpeg_sw_t *dec, const uint8_t *src, int len)
+{
+    const uint8_t   *p = src, *end = src + len, *seg;
+    int             marker, segLen, i, j, n, haveSof = 0;
+
+    if((len < 4) || (p[0] != 0xFF) || (p[1] != M_SOI))
+        return MJPEGD_ERROR;
+    p += 2;
+
+    /* Frames without DHT use the standard tables */
+    memset(dec->dcTbl, 0, sizeof(dec->dcTbl));
+    memset(dec->acTbl, 0, sizeof(dec->acTbl));
+    dec->dcTbl[0] = &dec->stdTbl[0][0];
+    dec->dcTbl[1] = &dec->stdTbl[0][1];
+    dec->acTbl[0] = &dec->stdTbl[1][0];
+    dec->acTbl[1] = &dec->stdTbl[1][1];
+    dec->restartInterval = 0;
+
+    while(1) {
+        /* Skip fill bytes */
+        while((p < end) && (*p != 0xFF))
+            p++;
+        while((p < end) && (*p == 0xFF))
+            p++;
+        if(p + 2 >= end)
+            return MJPEGD_ERROR;
+        marker = *p++;
+        segLen = read16(p);
+        if((segLen < 2) || (p + segLen > end))
+            return MJPEGD_ERROR;
+        seg = p + 2;
+        segLen -= 2;
+
+        switch(marker) {
+        case M_SOF0:
+        case M_SOF1:
+            if((segLen < 6) || (seg[0] != 8))
+                return MJPEGD_UNSUPPORTED;
+            dec->height  = read16(seg + 1);
+            dec->width   = read16(seg + 3);
+            dec->numComp = seg[5];
+            if(((dec->numComp != 1) && (dec->numComp != 3)) ||
+               (segLen < 6 + dec->numComp * 3) ||
+               (dec->width <= 0) || (dec->height <= 0))
+                return MJPEGD_UNSUPPORTED;
+            for(i = 0; i < dec->numComp; i++) {
+                dec->comp[i].id = seg[6 + i * 3];
+                dec->comp[i].h  = seg[7 + i * 3] >> 4;
+                dec->comp[i].v  = seg[7 + i * 3] & 15;
+                dec->comp[i].tq = seg[8 + i * 3] & 3;
+            }
+            if(dec->numComp == 1) {
+                dec->hmax = dec->vmax = 1;
+            }else{
+                dec->hmax = dec->comp[0].h;
+                dec->vmax = dec->comp[0].v;
+                if((dec->comp[1].h != 1) || (dec->comp[1].v != 1) ||
+                   (dec->comp[2].h != 1) || (dec->comp[2].v != 1) ||
+                   !(((dec->hmax == 2) && (dec->vmax == 2)) ||
+                     ((dec->hmax == 2) && (dec->vmax == 1)) ||
+                     ((dec->hmax == 1) && (dec->vmax == 1))))
+                    return MJPEGD_UNSUPPORTED;
+            }
+            dec->mcusX = (dec->width + dec->hmax * 8 - 1) / (dec->hmax * 8);
+            dec->mcusY = (dec->height + dec->vmax * 8 - 1) / (dec->vmax * 8);
+            haveSof = 1;
+            break;
+
+        case M_DHT:
+            if(parseDht(dec, seg, segLen))
+                return MJPEGD_ERROR;
+            break;
+
+        case M_DQT:
+            while(segLen > 0) {
+                int pq = seg[0] >> 4, tq = seg[0] & 3;
+                int size = 1 + 64 * (pq ? 2 : 1);
+                if(segLen < size)
+                    return MJPEGD_ERROR;
+                for(i = 0; i < 64; i++)
+                    dec->qt[tq][natural_order[i]] =
+                        pq ? read16(seg + 1 + i * 2) : seg[1 + i];
+                seg    += size;
+                segLen -= size;
+            }
+            break;
+
+        case M_DRI:
+            if(segLen < 2)
+                return MJPEGD_ERROR;
+            dec->restartInterval = read16(seg);
+            break;
+
+        case M_SOS:
+            if(!haveSof || (segLen < 1) || (seg[0] != dec->numComp) ||
+               (segLen < 1 + seg[0] * 2 + 3))
+                return MJPEGD_UNSUPPORTED;
+            for(i = 0; i < seg[0]; i++) {
+                for(j = 0; j < dec->numComp; j++) {
+                    if(dec->comp[j].id == seg[1 + i * 2])
+                        break;
+                }
+                if(j != i)
+                    return MJPEGD_UNSUPPORTED;
+                dec->comp[j].td = seg[2 + i * 2] >> 4;
+                dec->comp[j].ta = seg[2 + i * 2] & 15;
+                if((dec->comp[j].td > 3) || (dec->comp[j].ta > 3) ||
+                   !dec->dcTbl[dec->comp[j].td] ||
+                   !dec->acTbl[dec->comp[j].ta])
+                    return MJPEGD_ERROR;
+            }
+            p = seg + segLen;
+            goto entropy;
+
+        case M_SOI:
+        case M_EOI:
+            return MJPEGD_ERROR;
+
+        default:
+            /* Progressive, lossless and arithmetic coded frames */
+            if((marker >= 0xC2) && (marker <= 0xCF) && (marker != M_DHT))
+                return MJPEGD_UNSUPPORTED;
+            /* APPn, COM and others are skipped */
+            break;
+        }
+        p = seg + segLen;
+    }
+
+entropy:
+    /* Split the entropy coded data at the restart markers */
+    n = 1;
+    if(dec->restartInterval) {
+        n = (dec->mcusX * dec->mcusY + dec->restartInterval - 1) /
+            dec->restartInterval;
+    }
+    if(n > dec->segCap) {
+        free(dec->segs);
+        dec->segs = (mjpeg_segment_t *)malloc(n * sizeof(mjpeg_segment_t));
+        dec->segCap = dec->segs ? n : 0;
+        if(!dec->segs)
+            return MJPEGD_INSUFFICIENT_MEM;
+    }
+
+    dec->numSegs = 0;
+    dec->segs[0].start = p;
+    while(p + 1 < end) {
+        p = (const uint8_t *)memchr(p, 0xFF, end - p - 1);
+        if(!p)
+            break;
+        marker = p[1];
+        if(marker == 0x00) {
+            p += 2;
+        }else if(marker == 0xFF) {
+            p++;
+        }else if((marker >= M_RST0) && (marker <= M_RST7) &&
+                 (dec->numSegs + 1 < n)) {
+            dec->segs[dec->numSegs++].end = p;
+            p += 2;
+            dec->segs[dec->numSegs].start = p;
+        }else{
+            /* EOI or an unexpected marker ends the scan */
+            break;
+        }
+    }
+    dec->segs[dec->numSegs++].end = p ? p : end;
+
+    if(dec->numSegs != n) {
+        ALOGE("%s: found %d restart segments, expected %d", __func__,
+              dec->numSegs, n);
+        return MJPEGD_ERROR;
+    }
+    return MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: mjpegSwDecoderInit
+ * Description: Creates a software MJPEG decoder and its worker threads
+ *
+ * Input parameters:
+ *   handle              - returned decoder handle
+ *   numThreads          - threads a frame is split across, including the
+ *                         caller
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR or MJPEGD_INSUFFICIENT_MEM
+ *
+ * Notes: none
+ *****************************************************************************/
+int mjpegSwDecoderInit(void **handle, int numThreads)
+{
+    mjpeg_sw_t  *dec;
+    int         i;
+
+    *handle = NULL;
+    dec = (mjpeg_sw_t *)calloc(1, sizeof(mjpeg_sw_t));
+    if(!dec)
+        return MJPEGD_INSUFFICIENT_MEM;
+
+    initStdHuffTable(&dec->stdTbl[0][0], std_dc_luma_bits, std_dc_vals,
+                     sizeof(std_dc_vals));
+    initStdHuffTable(&dec->stdTbl[0][1], std_dc_chroma_bits, std_dc_vals,
+                     sizeof(std_dc_vals));
+    initStdHuffTable(&dec->stdTbl[1][0], std_ac_luma_bits, std_ac_luma_vals,
+                     sizeof(std_ac_luma_vals));
+    initStdHuffTable(&dec->stdTbl[1][1], std_ac_chroma_bits,
+                     std_ac_chroma_vals, sizeof(std_ac_chroma_vals));
+
+    if(numThreads < 1)
+        numThreads = 1;
+    if(numThreads > MJPEG_SW_MAX_THREADS)
+        numThreads = MJPEG_SW_MAX_THREADS;
+
+    pthread_mutex_init(&dec->lock, NULL);
+    pthread_cond_init(&dec->startCond, NULL);
+    pthread_cond_init(&dec->doneCond, NULL);
+
+    dec->numThreads = 1;
+    for(i = 0; i < numThreads - 1; i++) {
+        dec->workers[i].dec   = dec;
+        dec->workers[i].index = i;
+        if(pthread_create(&dec->threads[i], NULL, mjpegSwWorker,
+                          &dec->workers[i])) {
+            ALOGE("%s: worker %d creation failed", __func__, i);
+            break;
+        }
+        dec->numThreads++;
+    }
+
+    ALOGD("%s: threads: %d", __func__, dec->numThreads);
+    *handle = dec;
+    return MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: mjpegSwDecoderDestroy
+ * Description: Stops the worker threads and frees the decoder
+ *
+ * Input parameters:
+ *   handle              - decoder handle
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR or MJPEGD_ERROR
+ *
+ * Notes: none
+ *****************************************************************************/
+int mjpegSwDecoderDestroy(void *handle)
+{
+    mjpeg_sw_t  *dec = (mjpeg_sw_t *)handle;
+    int         i;
+
+    if(!dec)
+        return MJPEGD_ERROR;
+
+    pthread_mutex_lock(&dec->lock);
+    dec->exit = 1;
+    pthread_cond_broadcast(&dec->startCond);
+    pthread_mutex_unlock(&dec->lock);
+
+    for(i = 0; i < dec->numThreads - 1; i++)
+        pthread_join(dec->threads[i], NULL);
+
+    ALOGD("%s: DHT cache hits: %u, builds: %u", __func__,
+          dec->dhtHits, dec->dhtBuilds);
+
+    pthread_cond_destroy(&dec->doneCond);
+    pthread_cond_destroy(&dec->startCond);
+    pthread_mutex_destroy(&dec->lock);
+    free(dec->segs);
+    free(dec);
+    return MJPEGD_NO_ERROR;
+}
+
+/******************************************************************************
+ * Function: mjpegSwDecode
+ * Description: Decodes one MJPEG frame into semi planar 4:2:0 planes
+ *
+ * Input parameters:
+ *   handle              - decoder handle
+ *   src, srcLen         - MJPEG frame
+ *   dstY, dstYStride    - luma plane and its stride in bytes
+ *   dstUV, dstUVStride  - chroma plane and its stride in bytes
+ *   crFirst             - 1 for VU (NV21) chroma order, 0 for UV (NV12)
+ *
+ * Return values:
+ *   MJPEGD_NO_ERROR, MJPEGD_ERROR or MJPEGD_UNSUPPORTED
+ *
+ * Notes: Strides of 0 select the image width. Restart segments are spread
+ *        over the worker threads; the caller decodes the first group.
+ *****************************************************************************/
+int mjpegSwDecode(void *handle, const uint8_t *src, int srcLen,
+                  uint8_t *dstY, int dstYStride,
+                  uint8_t *dstUV, int dstUVStride, int crFirst)
+{
+    mjpeg_sw_t  *dec = (mjpeg_sw_t *)handle;
+    int         rc, i;
+
+    if(!dec || !src || !dstY || !dstUV)
+        return MJPEGD_ERROR;
+
+    rc = parseHeaders(dec, src, srcLen);
+    if(rc != MJPEGD_NO_ERROR)
+        return rc;
+
+    dec->dstY        = dstY;
+    dec->dstUV       = dstUV;
+    dec->dstYStride  = dstYStride ? dstYStride : dec->width;
+    dec->dstUVStride = dstUVStride ? dstUVStride : ((dec->width + 1) & ~1);
+    dec->crFirst     = crFirst;
+
+    dec->numGroups = (dec->numSegs < dec->numThreads) ?
+                     dec->numSegs : dec->numThreads;
+    if(dec->numGroups > 1) {
+        pthread_mutex_lock(&dec->lock);
+        dec->pending = dec->numThreads - 1;
+        dec->generation++;
+        pthread_cond_broadcast(&dec->startCond);
+        pthread_mutex_unlock(&dec->lock);
+    }
+
+    decodeGroup(dec, 0);
+
+    if(dec->numGroups > 1) {
+        pthread_mutex_lock(&dec->lock);
+        while(dec->pending)
+            pthread_cond_wait(&dec->doneCond, &dec->lock);
+        pthread_mutex_unlock(&dec->lock);
+    }
+
+    rc = MJPEGD_NO_ERROR;
+    for(i = 0; i < dec->numGroups; i++) {
+        if(dec->groupError[i])
+            rc = MJPEGD_ERROR;
+    }
+    return rc;
+}
+
+/******************************************************************************
+ * Function: mjpegSwGetDimension
+ * Description: Returns the dimension of the last parsed frame
+ *
+ * Input parameters:
+ *   handle              - decoder handle
+ *   width, height       - returned dimension
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+void mjpegSwGetDimension(void *handle, int *width, int *height)
+{
+    mjpeg_sw_t *dec = (mjpeg_sw_t *)handle;
+
+    *width  = dec ? dec->width : 0;
+    *height = dec ? dec->height : 0;
+}
@@ -0,0 +1,444 @@
+/* Copyright (c) 2017, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above
+ *       copyright notice, this list of conditions and the following
+ *       disclaimer in the documentation and/or other materials provided
+ *       with the distribution.
+ *     * Neither the name of The Linux Foundation nor the names of its
+ *       contributors may be used to endorse or promote products derived
+ *       from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+//#define ALOG_NDEBUG 0
+#define ALOG_NIDEBUG 0
+#define LOG_TAG "QCameraUsbColorConvert"
+#include <utils/Log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define YUYV_CONV_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define YUYV_CONV_SSE2 1
+#endif
+
+#include "QCameraUsbColorConvert.h"
+
+/* Pixels converted per iteration of the vector kernels */
+#define YUYV_CONV_VEC_PIXELS    32
+
+typedef struct {
+    void        *conv;
+    int         index;
+} yuyv_conv_worker_t;
+
+typedef struct {
+    int                 numThreads;
+    pthread_t           threads[YUYV_CONV_MAX_THREADS - 1];
+    yuyv_conv_worker_t  workers[YUYV_CONV_MAX_THREADS - 1];
+    pthread_mutex_t     lock;
+    pthread_cond_t      startCond;
+    pthread_cond_t      doneCond;
+    /* Current job, valid while pending is non zero */
+    yuyv_conv_job_t     job;
+    int                 numBands;
+    int                 bandRows;
+    uint32_t            generation;
+    int                 pending;
+    int                 exit;
+} yuyv_conv_t;
+
+/******************************************************************************
+ * Function: convertRowY
+ * Description: Extracts the luma samples of one YUYV row
+ *
+ * Input parameters:
+ *   src                 - YUYV row
+ *   dstY                - luma row
+ *   width               - number of pixels
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static inline void convertRowY(const uint8_t *src, uint8_t *dstY, int width)
+{
+    int x = 0;
+
+#if YUYV_CONV_NEON
+    for(; x + YUYV_CONV_VEC_PIXELS <= width; x += YUYV_CONV_VEC_PIXELS) {
+        uint8x16x4_t in = vld4q_u8(src + x * 2);
+        uint8x16x2_t y;
+        y.val[0] = in.val[0];
+        y.val[1] = in.val[2];
+        vst2q_u8(dstY + x, y);
+    }
+#elif YUYV_CONV_SSE2
+    const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+    for(; x + YUYV_CONV_VEC_PIXELS <= width; x += YUYV_CONV_VEC_PIXELS) {
+        const __m128i *in = (const __m128i *)(src + x * 2);
+        __m128i s0 = _mm_loadu_si128(in);
+        __m128i s1 = _mm_loadu_si128(in + 1);
+        __m128i s2 = _mm_loadu_si128(in + 2);
+        __m128i s3 = _mm_loadu_si128(in + 3);
+        _mm_storeu_si128((__m128i *)(dstY + x),
+            _mm_packus_epi16(_mm_and_si128(s0, lumaMask),
+                             _mm_and_si128(s1, lumaMask)));
+        _mm_storeu_si128((__m128i *)(dstY + x + 16),
+            _mm_packus_epi16(_mm_and_si128(s2, lumaMask),
+                             _mm_and_si128(s3, lumaMask)));
+    }
+#endif
+
+    for(; x < width; x++)
+        dstY[x] = src[x * 2];
+}
+
+/******************************************************************************
+ * Function: convertRowYVU
+ * Description: Extracts the luma samples of one YUYV row and writes its
+ *              chroma samples as one VU interleaved row
+ *
+ * Input parameters:
+ *   src                 - YUYV row
+ *   dstY                - luma row
+ *   dstVU               - chroma row
+ *   dstVUStride         - chroma row stride in bytes
+ *   width               - number of pixels
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: With an odd width the last pixel has no V sample in the row. It
+ *        takes the V of the previous pair (128 for a 1 pixel row), and its
+ *        U is only written if the chroma row has room for it, so a packed
+ *        odd stride never writes into the next chroma row.
+ *****************************************************************************/
+static inline void convertRowYVU(const uint8_t *src, uint8_t *dstY,
+                                 uint8_t *dstVU, int dstVUStride, int width)
+{
+    int x = 0, col;
+
+#if YUYV_CONV_NEON
+    for(; x + YUYV_CONV_VEC_PIXELS <= width; x += YUYV_CONV_VEC_PIXELS) {
+        uint8x16x4_t in = vld4q_u8(src + x * 2);
+        uint8x16x2_t y, vu;
+        y.val[0] = in.val[0];
+        y.val[1] = in.val[2];
+        vu.val[0] = in.val[3];
+        vu.val[1] = in.val[1];
+        vst2q_u8(dstY + x, y);
+        vst2q_u8(dstVU + x, vu);
+    }
+#elif YUYV_CONV_SSE2
+    const __m128i lumaMask = _mm_set1_epi16(0x00FF);
+    for(; x + YUYV_CONV_VEC_PIXELS <= width; x += YUYV_CONV_VEC_PIXELS) {
+        const __m128i *in = (const __m128i *)(src + x * 2);
+        __m128i s0 = _mm_loadu_si128(in);
+        __m128i s1 = _mm_loadu_si128(in + 1);
+        __m128i s2 = _mm_loadu_si128(in + 2);
+        __m128i s3 = _mm_loadu_si128(in + 3);
+        _mm_storeu_si128((__m128i *)(dstY + x),
+            _mm_packus_epi16(_mm_and_si128(s0, lumaMask),
+                             _mm_and_si128(s1, lumaMask)));
+        _mm_storeu_si128((__m128i *)(dstY + x + 16),
+            _mm_packus_epi16(_mm_and_si128(s2, lumaMask),
+                             _mm_and_si128(s3, lumaMask)));
+        /* UV pairs in source order, then swapped to VU */
+        __m128i uv0 = _mm_packus_epi16(_mm_srli_epi16(s0, 8),
+                                       _mm_srli_epi16(s1, 8));
+        __m128i uv1 = _mm_packus_epi16(_mm_srli_epi16(s2, 8),
+                                       _mm_srli_epi16(s3, 8));
+        _mm_storeu_si128((__m128i *)(dstVU + x),
+            _mm_or_si128(_mm_slli_epi16(uv0, 8), _mm_srli_epi16(uv0, 8)));
+        _mm_storeu_si128((__m128i *)(dstVU + x + 16),
+            _mm_or_si128(_mm_slli_epi16(uv1, 8), _mm_srli_epi16(uv1, 8)));
+    }
+#endif
+
+    for(col = x * 2; col < width * 2; col += 2)
+        dstY[col / 2] = src[col];
+    for(col = x * 2 + 1; col + 2 < width * 2; col += 4) {
+        dstVU[col / 2]      = src[col + 2];
+        dstVU[col / 2 + 1]  = src[col];
+    }
+    if(width & 1) {
+        dstVU[col / 2] = (col > 2) ? src[col - 2] : 128;
+        if(col / 2 + 1 < dstVUStride)
+            dstVU[col / 2 + 1] = src[col];
+    }
+}
+
+/******************************************************************************
+ * Function: yuyvConvRows
+ * Description: Converts a band of YUYV rows on the calling thread. Luma is
+ *              taken from every row and chroma from the even rows.
+ *
+ * Input parameters:
+ *   job                 - conversion description
+ *   startRow            - first row of the band, must be even
+ *   endRow              - row after the last row of the band
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+void yuyvConvRows(const yuyv_conv_job_t *job, int startRow, int endRow)
+{
+    int row;
+
+    for(row = startRow; row < endRow; row++) {
+        const uint8_t *src = job->src + row * job->srcStride;
+        uint8_t *dstY = job->dstY + row * job->dstYStride;
+
+        if(row & 1)
+            convertRowY(src, dstY, job->width);
+        else
+            convertRowYVU(src, dstY,
+                job->dstVU + (row / 2) * job->dstVUStride, job->dstVUStride,
+                job->width);
+    }
+}
+
+/******************************************************************************
+ * Function: convertBand
+ * Description: Converts band 'index' of the current job
+ *
+ * Input parameters:
+ *   conv                - converter object
+ *   index               - band index
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void convertBand(yuyv_conv_t *conv, int index)
+{
+    int startRow = index * conv->bandRows;
+    int endRow   = startRow + conv->bandRows;
+
+    if(endRow > conv->job.height)
+        endRow = conv->job.height;
+    if(startRow < endRow)
+        yuyvConvRows(&conv->job, startRow, endRow);
+}
+
+/******************************************************************************
+ * Function: yuyvConvWorker
+ * Description: Worker thread. Waits for a new job and converts its band.
+ *
+ * Input parameters:
+ *   arg                 - worker descriptor
+ *
+ * Return values:
+ *      NULL
+ *
+ * Notes: none
+ *****************************************************************************/
+static void *yuyvConvWorker(void *arg)
+{
+    yuyv_conv_worker_t  *worker = (yuyv_conv_worker_t *)arg;
+    yuyv_conv_t         *conv = (yuyv_conv_t *)worker->conv;
+    uint32_t            seen = 0;
+
+    pthread_mutex_lock(&conv->lock);
+    while(1) {
+        while(!conv->exit && (seen == conv->generation))
+            pthread_cond_wait(&conv->startCond, &conv->lock);
+        if(conv->exit)
+            break;
+        seen = conv->generation;
+        pthread_mutex_unlock(&conv->lock);
+
+        /* The caller converts band 0 */
+        if(worker->index + 1 < conv->numBands)
+            convertBand(conv, worker->index + 1);
+
+        pthread_mutex_lock(&conv->lock);
+        if(--conv->pending == 0)
+            pthread_cond_signal(&conv->doneCond);
+    }
+    pthread_mutex_unlock(&conv->lock);
+
+    return NULL;
+}
+
+/******************************************************************************
+ * Function: yuyvConvInit
+ * Description: Creates a converter and its worker threads
+ *
+ * Input parameters:
+ *   handle              - returned converter handle
+ *   numThreads          - threads a frame is split across, including the
+ *                         caller. Values <= 1 convert on the caller only.
+ *
+ * Return values:
+ *      0   Success
+ *      -1  Error
+ *
+ * Notes: none
+ *****************************************************************************/
+int yuyvConvInit(void **handle, int numThreads)
+{
+    yuyv_conv_t *conv;
+    int         i;
+
+    if(NULL == handle)
+        return -1;
+    *handle = NULL;
+
+    conv = (yuyv_conv_t *)calloc(1, sizeof(yuyv_conv_t));
+    if(NULL == conv) {
+        ALOGE("%s: no memory", __func__);
+        return -1;
+    }
+
+    if(numThreads < 1)
+        numThreads = 1;
+    if(numThreads > YUYV_CONV_MAX_THREADS)
+        numThreads = YUYV_CONV_MAX_THREADS;
+
+    pthread_mutex_init(&conv->lock, NULL);
+    pthread_cond_init(&conv->startCond, NULL);
+    pthread_cond_init(&conv->doneCond, NULL);
+
+    conv->numThreads = 1;
+    for(i = 0; i < numThreads - 1; i++) {
+        conv->workers[i].conv  = conv;
+        conv->workers[i].index = i;
+        if(pthread_create(&conv->threads[i], NULL, yuyvConvWorker,
+                          &conv->workers[i])) {
+            ALOGE("%s: worker %d creation failed", __func__, i);
+            break;
+        }
+        conv->numThreads++;
+    }
+
+    ALOGD("%s: threads: %d", __func__, conv->numThreads);
+    *handle = conv;
+    return 0;
+}
+
+/******************************************************************************
+ * Function: yuyvConvDestroy
+ * Description: Stops the worker threads and frees the converter
+ *
+ * Input parameters:
+ *   handle              - converter handle
+ *
+ * Return values:
+ *      0   Success
+ *      -1  Error
+ *
+ * Notes: none
+ *****************************************************************************/
+int yuyvConvDestroy(void *handle)
+{
+    yuyv_conv_t *conv = (yuyv_conv_t *)handle;
+    int         i;
+
+    if(NULL == conv)
+        return -1;
+
+    pthread_mutex_lock(&conv->lock);
+    conv->exit = 1;
+    pthread_cond_broadcast(&conv->startCond);
+    pthread_mutex_unlock(&conv->lock);
+
+    for(i = 0; i < conv->numThreads - 1; i++)
+        pthread_join(conv->threads[i], NULL);
+
+    pthread_cond_destroy(&conv->doneCond);
+    pthread_cond_destroy(&conv->startCond);
+    pthread_mutex_destroy(&conv->lock);
+    free(conv);
+    return 0;
+}
+
+/******************************************************************************
+ * Function: yuyvConvToNV21
+ * Description: Converts one YUYV frame to semi planar 4:2:0 with VU
+ *              interleaved chroma, writing directly into the destination
+ *              planes. Large frames are split into row bands across the
+ *              worker threads; the caller converts the first band.
+ *
+ * Input parameters:
+ *   handle              - converter handle, NULL converts on the caller
+ *   job                 - conversion description
+ *
+ * Return values:
+ *      0   Success
+ *      -1  Error
+ *
+ * Notes: Output is bit exact with the scalar conversion regardless of the
+ *        kernel and band split used. Bands own whole chroma rows and no row
+ *        is written past its stride, so bands never touch each other.
+ *****************************************************************************/
+int yuyvConvToNV21(void *handle, const yuyv_conv_job_t *job)
+{
+    yuyv_conv_t *conv = (yuyv_conv_t *)handle;
+    int         numBands, pairs;
+
+    if((NULL == job) || (NULL == job->src) || (NULL == job->dstY) ||
+       (NULL == job->dstVU) || (job->width <= 0) || (job->height <= 0) ||
+       (job->srcStride < job->width * 2) || (job->dstYStride < job->width) ||
+       (job->dstVUStride < job->width)) {
+        ALOGE("%s: invalid job", __func__);
+        return -1;
+    }
+
+    numBands = 1;
+    if(conv)
+        numBands = job->height / YUYV_CONV_MIN_BAND_ROWS;
+    if((NULL == conv) || (numBands <= 1) || (conv->numThreads == 1)) {
+        yuyvConvRows(job, 0, job->height);
+        return 0;
+    }
+    if(numBands > conv->numThreads)
+        numBands = conv->numThreads;
+
+    /* Bands start on even rows so each owns whole chroma rows */
+    pairs = (job->height + 1) / 2;
+
+    pthread_mutex_lock(&conv->lock);
+    conv->job       = *job;
+    conv->numBands  = numBands;
+    conv->bandRows  = ((pairs + numBands - 1) / numBands) * 2;
+    conv->pending   = conv->numThreads - 1;
+    conv->generation++;
+    pthread_cond_broadcast(&conv->startCond);
+    pthread_mutex_unlock(&conv->lock);
+
+    convertBand(conv, 0);
+
+    pthread_mutex_lock(&conv->lock);
+    while(conv->pending)
+        pthread_cond_wait(&conv->doneCond, &conv->lock);
+    pthread_mutex_unlock(&conv->lock);
+
+    return 0;
+}
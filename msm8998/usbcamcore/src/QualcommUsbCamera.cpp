@@ -32,6 +32,7 @@
 
 #include <utils/Log.h>
 #include <utils/threads.h>
+#include <cutils/properties.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -45,6 +46,7 @@
 #include "QualcommUsbCamera.h"
 #include "QCameraUsbPriv.h"
 #include "QCameraMjpegDecode.h"
+#include "QCameraUsbColorConvert.h"
 #include "QCameraUsbParm.h"
 #include <gralloc_priv.h>
 #include <genlock.h>
@@ -107,16 +109,25 @@ static int launch_preview_thread(       camera_hardware_t *camHal);
 static int launchTakePictureThread(     camera_hardware_t *camHal);
 static int initDisplayBuffers(          camera_hardware_t *camHal);
 static int deInitDisplayBuffers(        camera_hardware_t *camHal);
+static int change_preview_window(       camera_hardware_t *camHal);
+static void service_window_change(      camera_hardware_t *camHal);
 static int stopPreviewInternal(         camera_hardware_t *camHal);
 static int get_buf_from_cam(            camera_hardware_t *camHal);
 static int put_buf_to_cam(              camera_hardware_t *camHal);
 static int prvwThreadTakePictureInternal(camera_hardware_t *camHal);
 static int get_buf_from_display( camera_hardware_t *camHal, int *buffer_id);
 static int put_buf_to_display(   camera_hardware_t *camHal, int buffer_id);
-static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id);
+static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id,
+                                        char *camData, int camDataLen);
 static void * previewloop(void *);
+static void * pipelined_previewloop(camera_hardware_t *camHal);
+static void * captureloop(void *);
+static void * decodeloop(void *);
+static void send_preview_callback(camera_hardware_t *camHal, int buffer_id);
 static void * takePictureThread(void *);
-static int convert_YUYV_to_420_NV12(char *in_buf, char *out_buf, int wd, int ht);
+static int convert_YUYV_to_420_NV12(camera_hardware_t *camHal, char *in_buf,
+                                    char *out_buf, int out_stride,
+                                    int wd, int ht);
 static int get_uvc_device(char *devname);
 static int getPreviewCaptureFmt(camera_hardware_t *camHal);
 static int allocate_ion_memory(QCameraHalMemInfo_t *mem_info, int ion_type);
@@ -248,6 +259,14 @@ extern "C"  int usbcam_close_camera_device( hw_device_t *hw_dev)
                 ALOGE("%s: close failed ", __func__);
             }
             camHal->fd = 0;
+            if(camHal->yuyvConv) {
+                yuyvConvDestroy(camHal->yuyvConv);
+                camHal->yuyvConv = NULL;
+            }
+            if(camHal->mjpegd) {
+                mjpegDecoderDestroy(camHal->mjpegd);
+                camHal->mjpegd = NULL;
+            }
             delete camHal;
         }else{
                 ALOGE("%s: camHal is NULL pointer ", __func__);
@@ -267,21 +286,21 @@ int usbcam_set_preview_window(struct camera_device * device,
     VALIDATE_DEVICE_HDL(camHal, device, -1);
     Mutex::Autolock autoLock(camHal->lock);
 
-    /* if window is already set, then de-init previous buffers */
-    if(camHal->window){
-        rc = deInitDisplayBuffers(camHal);
-        if(rc < 0) {
-            ALOGE("%s: deInitDisplayBuffers returned error", __func__);
-        }
+    /* The pipeline stages hold display buffers of the current window. */
+    /* Let the preview thread stop the pipeline, swap the window and   */
+    /* restart it.                                                     */
+    if(camHal->pipeActive){
+        camHal->pendingWindow       = window;
+        camHal->windowChangePending = 1;
+        while(camHal->windowChangePending)
+            camHal->windowChangeCond.wait(camHal->lock);
+        rc = camHal->windowChangeRc;
+        ALOGI("%s: X. rc = %d", __func__, rc);
+        return rc;
     }
-    camHal->window = window;
 
-    if(camHal->window){
-        rc = initDisplayBuffers(camHal);
-        if(rc < 0) {
-            ALOGE("%s: initDisplayBuffers returned error", __func__);
-        }
-    }
+    camHal->pendingWindow = window;
+    rc = change_preview_window(camHal);
     ALOGI("%s: X. rc = %d", __func__, rc);
     return rc;
 }
@@ -715,31 +734,97 @@ int usbcam_dump(struct camera_device * device, int fd)
 /************************** VUVU            19 17 23 21            ************/
 /******************************************************************************/
 
-static int convert_YUYV_to_420_NV12(char *in_buf, char *out_buf, int wd, int ht)
+/* out_stride is the row stride of the output buffer; chroma starts at       */
+/* out_stride * ht. Rows are converted straight into the output buffer,     */
+/* split across the converter threads when camHal->yuyvConv is set.        */
+/******************************************************************************/
+
+static int convert_YUYV_to_420_NV12(camera_hardware_t *camHal, char *in_buf,
+                                    char *out_buf, int out_stride,
+                                    int wd, int ht)
 {
     int rc =0;
-    int row, col, uv_row;
+    yuyv_conv_job_t job;
 
     ALOGD("%s: E", __func__);
-    /* Arrange Y */
-    for(row = 0; row < ht; row++)
-        for(col = 0; col < wd * 2; col += 2)
-        {
-            out_buf[row * wd + col / 2] = in_buf[row * wd * 2 + col];
-        }
+    if(out_stride < wd)
+        out_stride = wd;
 
-    /* Arrange UV */
-    for(row = 0, uv_row = ht; row < ht; row += 2, uv_row++)
-        for(col = 1; col < wd * 2; col += 4)
-        {
-            out_buf[uv_row * wd + col / 2]= in_buf[row * wd * 2 + col + 2];
-            out_buf[uv_row * wd + col / 2 + 1]  = in_buf[row * wd * 2 + col];
-        }
+    job.src         = (const uint8_t *)in_buf;
+    job.srcStride   = wd * 2;
+    job.dstY        = (uint8_t *)out_buf;
+    job.dstYStride  = out_stride;
+    job.dstVU       = (uint8_t *)out_buf + out_stride * ht;
+    job.dstVUStride = out_stride;
+    job.width       = wd;
+    job.height      = ht;
+
+    rc = yuyvConvToNV21(camHal ? camHal->yuyvConv : NULL, &job);
 
     ALOGD("%s: X", __func__);
     return rc;
 }
 
+/******************************************************************************
+ * Function: change_preview_window
+ * Description: This function releases the display buffers of the current
+ *              preview window and sets up the ones of camHal->pendingWindow
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: Called with camHal->lock held and no pipeline stage running
+ *****************************************************************************/
+static int change_preview_window(camera_hardware_t *camHal)
+{
+    int rc = 0;
+
+    /* if window is already set, then de-init previous buffers */
+    if(camHal->window){
+        rc = deInitDisplayBuffers(camHal);
+        if(rc < 0) {
+            ALOGE("%s: deInitDisplayBuffers returned error", __func__);
+        }
+    }
+    camHal->window = camHal->pendingWindow;
+
+    if(camHal->window){
+        rc = initDisplayBuffers(camHal);
+        if(rc < 0) {
+            ALOGE("%s: initDisplayBuffers returned error", __func__);
+        }
+    }
+    return rc;
+}
+
+/******************************************************************************
+ * Function: service_window_change
+ * Description: This function completes a window change requested by
+ *              usbcam_set_preview_window, if any, and wakes up the caller
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: Called on the preview thread with camHal->lock held and the
+ *        pipeline stopped
+ *****************************************************************************/
+static void service_window_change(camera_hardware_t *camHal)
+{
+    if(!camHal->windowChangePending)
+        return;
+
+    camHal->windowChangeRc      = change_preview_window(camHal);
+    camHal->windowChangePending = 0;
+    camHal->windowChangeCond.broadcast();
+}
+
 /******************************************************************************
  * Function: initDisplayBuffers
  * Description: This function initializes the preview buffers
@@ -1822,6 +1907,7 @@ static int get_buf_from_display(camera_hardware_t *camHal, int *buffer_id)
             if(private_buffer_handle->fd ==
                camHal->previewMem.private_buffer_handle[cnt]->fd) {
                 *buffer_id = cnt;
+                camHal->previewMem.stride[cnt] = stride;
                 ALOGD("%s: deQueued fd = %d, index: %d",
                      __func__, private_buffer_handle->fd, cnt);
                 break;
@@ -1910,14 +1996,17 @@ static int put_buf_to_display(camera_hardware_t *camHal, int buffer_id)
  * Input parameters:
  *  camHal                  - camera HAL handle
  *  buffer_id               - id of the buffer that needs to be enqueued
+ *  camData                 - captured frame data
+ *  camDataLen              - number of valid bytes in camData
  *
  * Return values:
  *   0      No error
  *   -1     Error
  *
- * Notes: none
+ * Notes: camData is either a V4L2 capture buffer or a staging copy of it
  *****************************************************************************/
-static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id)
+static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id,
+                                        char *camData, int camDataLen)
 {
     int rc = -1;
 
@@ -1930,14 +2019,21 @@ static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id
     if( (V4L2_PIX_FMT_YUYV == camHal->captureFormat) &&
         (HAL_PIXEL_FORMAT_YCrCb_420_SP == camHal->dispFormat))
     {
-        convert_YUYV_to_420_NV12(
-            (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
+        if(NULL == camHal->yuyvConv)
+        {
+            char value[PROPERTY_VALUE_MAX];
+            property_get("persist.camera.usb.cc_threads", value, "1");
+            if(yuyvConvInit(&camHal->yuyvConv, atoi(value)) < 0)
+                ALOGE("%s: yuyvConvInit Error", __func__);
+        }
+        convert_YUYV_to_420_NV12(camHal,
+            camData,
             (char *)camHal->previewMem.camera_memory[buffer_id]->data,
+            camHal->previewMem.stride[buffer_id],
             camHal->prevWidth,
             camHal->prevHeight);
-        ALOGD("%s: Copied %d bytes from camera buffer %d to display buffer: %d",
-             __func__, camHal->curCaptureBuf.bytesused,
-             camHal->curCaptureBuf.index, buffer_id);
+        ALOGD("%s: Copied %d bytes from camera to display buffer: %d",
+             __func__, camDataLen, buffer_id);
         rc = 0;
     }
 
@@ -1954,8 +2050,8 @@ static int convert_data_frm_cam_to_disp(camera_hardware_t *camHal, int buffer_id
         {
             rc = mjpegDecode(
                 (void*)camHal->mjpegd,
-                (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
-                camHal->curCaptureBuf.bytesused,
+                camData,
+                camDataLen,
                 (char *)camHal->previewMem.camera_memory[buffer_id]->data,
                 (char *)camHal->previewMem.camera_memory[buffer_id]->data +
                     camHal->prevWidth * camHal->prevHeight,
@@ -1990,6 +2086,17 @@ static int launch_preview_thread(camera_hardware_t *camHal)
         return -1;
     }
 
+    /* Pipelined mode runs capture, decode and present on separate threads */
+    camHal->pipelineEnabled = 0;
+#if CAPTURE && DISPLAY
+    {
+        char value[PROPERTY_VALUE_MAX];
+        property_get("persist.camera.usb.pipeline", value, "0");
+        camHal->pipelineEnabled = atoi(value) ? 1 : 0;
+    }
+#endif
+    ALOGI("%s: pipelined preview: %d", __func__, camHal->pipelineEnabled);
+
     pthread_attr_t attr;
     pthread_attr_init(&attr);
     pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
@@ -2018,10 +2125,6 @@ static void * previewloop(void *hcamHal)
     int                 buffer_id   = 0;
     pid_t               tid         = 0;
     camera_hardware_t   *camHal     = NULL;
-    int                 msgType     = 0;
-    camera_memory_t     *data       = NULL;
-    camera_frame_metadata_t *metadata= NULL;
-    camera_memory_t     *previewMem = NULL;
 
     camHal = (camera_hardware_t *)hcamHal;
     ALOGD("%s: E", __func__);
@@ -2036,6 +2139,9 @@ static void * previewloop(void *hcamHal)
     androidSetThreadPriority(tid, ANDROID_PRIORITY_NORMAL);
     prctl(PR_SET_NAME, (unsigned long)"Camera HAL preview thread", 0, 0, 0);
 
+    if(camHal->pipelineEnabled)
+        return pipelined_previewloop(camHal);
+
     /************************************************************************/
     /* - Time wait (select) on camera fd for input read buffer              */
     /* - Check if any preview thread commands are set. If set, process      */
@@ -2159,7 +2265,9 @@ static void * previewloop(void *hcamHal)
         memset(camHal->previewMem.camera_memory[buffer_id]->data,
                color, camHal->dispWidth * camHal->dispHeight * 1.5 + 2 * 1024);
 #else
-        convert_data_frm_cam_to_disp(camHal, buffer_id);
+        convert_data_frm_cam_to_disp(camHal, buffer_id,
+            (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
+            camHal->curCaptureBuf.bytesused);
         ALOGD("%s: Copied data to buffer_id: %d", __func__, buffer_id);
 #endif
 
@@ -2202,53 +2310,703 @@ static void * previewloop(void *hcamHal)
     /************************************************************************/
     /* - If preview frames callback is requested, callback with prvw buffers*/
     /************************************************************************/
-        /* TBD: change the 1.5 hardcoding to Bytes Per Pixel */
-        int previewBufSize = camHal->prevWidth * camHal->prevHeight * 1.5;
-
-        msgType |=  CAMERA_MSG_PREVIEW_FRAME;
-
-        if(previewBufSize !=
-            camHal->previewMem.private_buffer_handle[buffer_id]->size) {
-
-            previewMem = camHal->get_memory(
-                camHal->previewMem.private_buffer_handle[buffer_id]->fd,
-                previewBufSize,
-                1,
-                camHal->cb_ctxt);
-
-              if (!previewMem || !previewMem->data) {
-                  ALOGE("%s: get_memory failed.\n", __func__);
-              }
-              else {
-                  data = previewMem;
-                  ALOGD("%s: GetMemory successful. data = %p",
-                            __func__, data);
-                  ALOGD("%s: previewBufSize = %d, priv_buf_size: %d",
-                    __func__, previewBufSize,
-                    camHal->previewMem.private_buffer_handle[buffer_id]->size);
-              }
+        send_preview_callback(camHal, buffer_id);
+#endif
+
+    }//while(1)
+    ALOGD("%s: X", __func__);
+    return (void *)0;
+}
+
+/******************************************************************************
+ * Function: send_preview_callback
+ * Description: This function sends the preview frame callback for a display
+ *              buffer, if preview frame messages are enabled
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *  buffer_id               - id of the display buffer
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: Called with camHal->lock held. The lock is released around the
+ *        callback.
+ *****************************************************************************/
+static void send_preview_callback(camera_hardware_t *camHal, int buffer_id)
+{
+    int                     msgType     = CAMERA_MSG_PREVIEW_FRAME;
+    camera_memory_t         *data       = NULL;
+    camera_frame_metadata_t *metadata   = NULL;
+    camera_memory_t         *previewMem = NULL;
+
+    /* TBD: change the 1.5 hardcoding to Bytes Per Pixel */
+    int previewBufSize = camHal->prevWidth * camHal->prevHeight * 1.5;
+
+    if(previewBufSize !=
+        camHal->previewMem.private_buffer_handle[buffer_id]->size) {
+
+        previewMem = camHal->get_memory(
+            camHal->previewMem.private_buffer_handle[buffer_id]->fd,
+            previewBufSize,
+            1,
+            camHal->cb_ctxt);
+
+          if (!previewMem || !previewMem->data) {
+              ALOGE("%s: get_memory failed.\n", __func__);
+          }
+          else {
+              data = previewMem;
+              ALOGD("%s: GetMemory successful. data = %p",
+                        __func__, data);
+              ALOGD("%s: previewBufSize = %d, priv_buf_size: %d",
+                __func__, previewBufSize,
+                camHal->previewMem.private_buffer_handle[buffer_id]->size);
+          }
+    }
+    else{
+        data =   camHal->previewMem.camera_memory[buffer_id];
+        ALOGD("%s: No GetMemory, no invalid fmt. data = %p, idx=%d",
+            __func__, data, buffer_id);
+    }
+    /* Unlock and lock around the callback. */
+    /* Sometimes 'disable_msg' is issued in the callback context, */
+    /* leading to deadlock */
+    camHal->lock.unlock();
+    if((camHal->msgEnabledFlag & CAMERA_MSG_PREVIEW_FRAME) &&
+        camHal->data_cb){
+        ALOGD("%s: before data callback", __func__);
+        camHal->data_cb(msgType, data, 0,metadata, camHal->cb_ctxt);
+        ALOGD("%s: after data callback: %p", __func__, camHal->data_cb);
+    }
+    camHal->lock.lock();
+    if (previewMem)
+        previewMem->release(previewMem);
+}
+
+/******************************************************************************
+ * Function: frameQueueInit
+ * Description: This function initializes a bounded frame queue
+ *
+ * Input parameters:
+ *  queue                   - frame queue
+ *  size                    - maximum number of queued frames
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void frameQueueInit(usb_cam_frame_queue_t *queue, int size)
+{
+    if(size > USB_CAM_PIPE_MAX_FRAMES)
+        size = USB_CAM_PIPE_MAX_FRAMES;
+    queue->size     = size;
+    queue->head     = 0;
+    queue->count    = 0;
+    queue->abort    = 0;
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+}
+
+/******************************************************************************
+ * Function: frameQueueDeinit
+ * Description: This function releases the resources of a frame queue
+ *
+ * Input parameters:
+ *  queue                   - frame queue
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void frameQueueDeinit(usb_cam_frame_queue_t *queue)
+{
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+/******************************************************************************
+ * Function: frameQueuePut
+ * Description: This function appends a frame to a queue without blocking.
+ *              If the queue is full, its oldest frame is removed.
+ *
+ * Input parameters:
+ *  queue                   - frame queue
+ *  frame                   - frame to be queued
+ *  dropped                 - receives the removed frame, if any
+ *
+ * Return values:
+ *   0      Frame queued
+ *   1      Frame queued, oldest frame returned in dropped
+ *
+ * Notes: none
+ *****************************************************************************/
+static int frameQueuePut(usb_cam_frame_queue_t *queue,
+                         const usb_cam_frame_t *frame,
+                         usb_cam_frame_t *dropped)
+{
+    int rc = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    if(queue->count == queue->size) {
+        *dropped = queue->frames[queue->head];
+        queue->head = (queue->head + 1) % queue->size;
+        queue->count--;
+        rc = 1;
+    }
+    queue->frames[(queue->head + queue->count) % queue->size] = *frame;
+    queue->count++;
+    pthread_cond_signal(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+    return rc;
+}
+
+/******************************************************************************
+ * Function: frameQueueGet
+ * Description: This function removes the oldest frame from a queue, waiting
+ *              for one if the queue is empty
+ *
+ * Input parameters:
+ *  queue                   - frame queue
+ *  frame                   - receives the frame
+ *  timeoutMs               - maximum wait in ms, -1 waits until a frame is
+ *                            queued or the queue is aborted
+ *
+ * Return values:
+ *   0      Frame returned
+ *   -1     Timeout or queue aborted
+ *
+ * Notes: none
+ *****************************************************************************/
+static int frameQueueGet(usb_cam_frame_queue_t *queue,
+                         usb_cam_frame_t *frame, int timeoutMs)
+{
+    int             rc = 0;
+    struct timespec ts;
+
+    if(timeoutMs > 0) {
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec  += timeoutMs / 1000;
+        ts.tv_nsec += (timeoutMs % 1000) * 1000000;
+        if(ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    while(!queue->abort && (0 == queue->count) && (0 == rc)) {
+        if(timeoutMs < 0)
+            pthread_cond_wait(&queue->cond, &queue->lock);
+        else if(0 == timeoutMs)
+            rc = ETIMEDOUT;
+        else
+            rc = pthread_cond_timedwait(&queue->cond, &queue->lock, &ts);
+    }
+    if(queue->abort || (0 == queue->count)) {
+        rc = -1;
+    }else{
+        *frame = queue->frames[queue->head];
+        queue->head = (queue->head + 1) % queue->size;
+        queue->count--;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return rc;
+}
+
+/******************************************************************************
+ * Function: frameQueueAbort
+ * Description: This function wakes up and fails all waiters on a queue.
+ *              Queued frames are kept so that they can be drained.
+ *
+ * Input parameters:
+ *  queue                   - frame queue
+ *  abort                   - 1 to abort, 0 to resume normal operation
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void frameQueueAbort(usb_cam_frame_queue_t *queue, int abort)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->abort = abort;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/******************************************************************************
+ * Function: frameQueuePop
+ * Description: This function removes the oldest frame from a queue without
+ *              waiting, even if the queue is aborted
+ *
+ * Input parameters:
+ *  queue                   - frame queue
+ *  frame                   - receives the frame
+ *
+ * Return values:
+ *   0      Frame returned
+ *   -1     Queue empty
+ *
+ * Notes: Used to drain the queues once the pipeline threads have exited
+ *****************************************************************************/
+static int frameQueuePop(usb_cam_frame_queue_t *queue, usb_cam_frame_t *frame)
+{
+    int rc = -1;
+
+    pthread_mutex_lock(&queue->lock);
+    if(queue->count) {
+        *frame = queue->frames[queue->head];
+        queue->head = (queue->head + 1) % queue->size;
+        queue->count--;
+        rc = 0;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return rc;
+}
+
+/******************************************************************************
+ * Function: requeue_cam_buf
+ * Description: This funtion puts the capture buffer with the given index
+ *              back to the camera driver
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *   index               - V4L2 buffer index
+ *
+ * Return values:
+ *   0      No error
+ *   1      Error
+ *
+ * Notes: Unlike put_buf_to_cam, does not use camHal->curCaptureBuf and is
+ *        safe to call from any pipeline stage
+ *****************************************************************************/
+static int requeue_cam_buf(camera_hardware_t *camHal, int index)
+{
+    struct v4l2_buffer buf;
+
+    memset(&buf, 0, sizeof(buf));
+    buf.type    = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory  = V4L2_MEMORY_MMAP;
+    buf.index   = index;
+
+    if (-1 == ioctlLoop(camHal->fd, VIDIOC_QBUF, &buf))
+    {
+        ALOGE("%s: VIDIOC_QBUF failed for %d", __func__, index);
+        return 1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+ * Function: release_pipe_frame
+ * Description: This function returns the capture side resources of a frame:
+ *              the V4L2 buffer goes back to the driver and the staging buffer
+ *              back to the free list
+ *
+ * Input parameters:
+ *   camHal              - camera HAL handle
+ *   frame               - frame to be released
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: none
+ *****************************************************************************/
+static void release_pipe_frame(camera_hardware_t *camHal,
+                               usb_cam_frame_t *frame)
+{
+    usb_cam_frame_t dropped;
+
+    if(frame->capIdx >= 0) {
+        requeue_cam_buf(camHal, frame->capIdx);
+        frame->capIdx = -1;
+    }
+    if(frame->stagingIdx >= 0) {
+        frameQueuePut(&camHal->stagingFreeQueue, frame, &dropped);
+        frame->stagingIdx = -1;
+    }
+}
+
+/******************************************************************************
+ * Function: captureloop
+ * Description: This is the capture stage of the pipelined preview. It
+ *              dequeues V4L2 buffers and passes them to the decode stage.
+ *              MJPEG frames are copied to a staging buffer so the V4L2
+ *              buffer can be requeued right away.
+ *
+ * Input parameters:
+ *  hcamHal                 - camera HAL handle
+ *
+ * Return values:
+ *      NULL
+ *
+ * Notes: Runs without camHal->lock. Only the fd and the capture buffers,
+ *        which stay valid until the pipeline is stopped, are used.
+ *****************************************************************************/
+static void * captureloop(void *hcamHal)
+{
+    camera_hardware_t   *camHal = (camera_hardware_t *)hcamHal;
+    usb_cam_frame_t     frame, staging, dropped;
+    struct v4l2_buffer  buf;
+
+    ALOGD("%s: E", __func__);
+    androidSetThreadPriority(gettid(), ANDROID_PRIORITY_URGENT_DISPLAY);
+    prctl(PR_SET_NAME, (unsigned long)"Camera HAL capture thread", 0, 0, 0);
+
+    while(!camHal->pipeStop) {
+        fd_set fds;
+        struct timeval tv;
+        int r;
+
+        FD_ZERO(&fds);
+        FD_SET(camHal->fd, &fds);
+
+        /* Short timeout so that pipeline stop is noticed quickly */
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        r = select(camHal->fd + 1, &fds, NULL, NULL, &tv);
+        if(r <= 0) {
+            if((-1 == r) && (EINTR != errno))
+                ALOGE("%s: FDSelect error: %d", __func__, errno);
+            continue;
+        }
+
+        memset(&buf, 0, sizeof(buf));
+        buf.type    = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory  = V4L2_MEMORY_MMAP;
+        if (-1 == ioctlLoop(camHal->fd, VIDIOC_DQBUF, &buf)) {
+            if(EAGAIN != errno)
+                ALOGE("%s: VIDIOC_DQBUF error", __func__);
+            continue;
+        }
+
+        frame.capIdx        = buf.index;
+        frame.stagingIdx    = -1;
+        frame.bytesused     = buf.bytesused;
+        frame.dispIdx       = -1;
+
+        /* Copy compressed frames out so the driver gets its buffer back */
+        /* while this frame waits for and goes through decode            */
+        if((V4L2_PIX_FMT_MJPEG == camHal->captureFormat) &&
+           (0 == frameQueueGet(&camHal->stagingFreeQueue, &staging, 0))) {
+            struct bufObj *stage = &camHal->staging[staging.stagingIdx];
+
+            if(stage->len < (int)buf.bytesused) {
+                free(stage->data);
+                stage->data = malloc(buf.bytesused);
+                stage->len  = stage->data ? buf.bytesused : 0;
+            }
+            if(stage->data) {
+                memcpy(stage->data, camHal->buffers[buf.index].data,
+                       buf.bytesused);
+                requeue_cam_buf(camHal, frame.capIdx);
+                frame.capIdx        = -1;
+                frame.stagingIdx    = staging.stagingIdx;
+            }else{
+                ALOGE("%s: staging alloc failed, holding V4L2 buffer",
+                      __func__);
+                frameQueuePut(&camHal->stagingFreeQueue, &staging, &dropped);
+            }
         }
-        else{
-            data =   camHal->previewMem.camera_memory[buffer_id];
-            ALOGD("%s: No GetMemory, no invalid fmt. data = %p, idx=%d",
-                __func__, data, buffer_id);
+
+        if(frameQueuePut(&camHal->capQueue, &frame, &dropped)) {
+            /* Decode is behind; drop the oldest frame to bound latency */
+            camHal->pipeDropCnt++;
+            ALOGD("%s: dropped frame, total drops: %d",
+                  __func__, camHal->pipeDropCnt);
+            release_pipe_frame(camHal, &dropped);
         }
-        /* Unlock and lock around the callback. */
-        /* Sometimes 'disable_msg' is issued in the callback context, */
-        /* leading to deadlock */
+    }
+
+    ALOGD("%s: X", __func__);
+    return NULL;
+}
+
+/******************************************************************************
+ * Function: decodeloop
+ * Description: This is the decode stage of the pipelined preview. It
+ *              converts or decodes each captured frame into a display buffer,
+ *              returns the capture resources and passes the display buffer to
+ *              the present stage.
+ *
+ * Input parameters:
+ *  hcamHal                 - camera HAL handle
+ *
+ * Return values:
+ *      NULL
+ *
+ * Notes: none
+ *****************************************************************************/
+static void * decodeloop(void *hcamHal)
+{
+    camera_hardware_t   *camHal = (camera_hardware_t *)hcamHal;
+    usb_cam_frame_t     frame, dropped;
+    int                 buffer_id = 0;
+    char                *camData;
+
+    ALOGD("%s: E", __func__);
+    androidSetThreadPriority(gettid(), ANDROID_PRIORITY_NORMAL);
+    prctl(PR_SET_NAME, (unsigned long)"Camera HAL decode thread", 0, 0, 0);
+
+    while(0 == frameQueueGet(&camHal->capQueue, &frame, -1)) {
+        camHal->lock.lock();
+        if(!camHal->window) {
+            camHal->lock.unlock();
+            release_pipe_frame(camHal, &frame);
+            continue;
+        }
+        if(get_buf_from_display(camHal, &buffer_id)) {
+            ALOGE("%s: get_buf_from_display failed. Dropping frame",
+                 __func__);
+            camHal->lock.unlock();
+            release_pipe_frame(camHal, &frame);
+            continue;
+        }
+
+        if(frame.stagingIdx >= 0)
+            camData = (char *)camHal->staging[frame.stagingIdx].data;
+        else
+            camData = (char *)camHal->buffers[frame.capIdx].data;
+        convert_data_frm_cam_to_disp(camHal, buffer_id,
+                                     camData, frame.bytesused);
         camHal->lock.unlock();
-        if((camHal->msgEnabledFlag & CAMERA_MSG_PREVIEW_FRAME) &&
-            camHal->data_cb){
-            ALOGD("%s: before data callback", __func__);
-            camHal->data_cb(msgType, data, 0,metadata, camHal->cb_ctxt);
-            ALOGD("%s: after data callback: %p", __func__, camHal->data_cb);
+
+        /* Frame data is consumed; return it before waiting on display */
+        release_pipe_frame(camHal, &frame);
+
+        frame.dispIdx = buffer_id;
+        if(frameQueuePut(&camHal->presentQueue, &frame, &dropped)) {
+            camHal->lock.lock();
+            put_buf_to_display(camHal, dropped.dispIdx);
+            camHal->lock.unlock();
         }
+    }
+
+    ALOGD("%s: X", __func__);
+    return NULL;
+}
+
+/******************************************************************************
+ * Function: start_preview_pipeline
+ * Description: This function starts the capture and decode stages of the
+ *              pipelined preview
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *
+ * Return values:
+ *   0      No error
+ *   -1     Error
+ *
+ * Notes: Called without camHal->lock held
+ *****************************************************************************/
+static int start_preview_pipeline(camera_hardware_t *camHal)
+{
+    usb_cam_frame_t frame, dropped;
+    int             i;
+
+    ALOGD("%s: E", __func__);
+    frameQueueInit(&camHal->capQueue, USB_CAM_PIPE_DEPTH);
+    frameQueueInit(&camHal->presentQueue, USB_CAM_PIPE_MAX_FRAMES);
+    frameQueueInit(&camHal->stagingFreeQueue, USB_CAM_PIPE_STAGING_CNT);
+
+    memset(&frame, 0, sizeof(frame));
+    frame.capIdx    = -1;
+    frame.dispIdx   = -1;
+    for(i = 0; i < USB_CAM_PIPE_STAGING_CNT; i++) {
+        frame.stagingIdx = i;
+        frameQueuePut(&camHal->stagingFreeQueue, &frame, &dropped);
+    }
+
+    camHal->pipeStop = 0;
+    if(pthread_create(&camHal->decodeThread, NULL, decodeloop, camHal)) {
+        ALOGE("%s: decode thread creation failed", __func__);
+        goto err_deinit;
+    }
+    if(pthread_create(&camHal->captureThread, NULL, captureloop, camHal)) {
+        ALOGE("%s: capture thread creation failed", __func__);
+        frameQueueAbort(&camHal->capQueue, 1);
+        pthread_join(camHal->decodeThread, NULL);
+        goto err_deinit;
+    }
+
+    ALOGD("%s: X", __func__);
+    return 0;
+
+err_deinit:
+    /* no frame entered the pipeline, only the queues need to go */
+    frameQueueDeinit(&camHal->stagingFreeQueue);
+    frameQueueDeinit(&camHal->presentQueue);
+    frameQueueDeinit(&camHal->capQueue);
+    return -1;
+}
+
+/******************************************************************************
+ * Function: stop_preview_pipeline
+ * Description: This function stops the capture and decode stages of the
+ *              pipelined preview and drains the queues. Held V4L2 buffers are
+ *              requeued and decoded frames are sent to the display.
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *
+ * Return values:
+ *      none
+ *
+ * Notes: Called without camHal->lock held
+ *****************************************************************************/
+static void stop_preview_pipeline(camera_hardware_t *camHal)
+{
+    usb_cam_frame_t frame;
+    int             i;
+
+    ALOGD("%s: E", __func__);
+
+    /* Stop the producer first so the decode stage sees no new frames */
+    camHal->pipeStop = 1;
+    pthread_join(camHal->captureThread, NULL);
+    frameQueueAbort(&camHal->capQueue, 1);
+    pthread_join(camHal->decodeThread, NULL);
+
+    while(0 == frameQueuePop(&camHal->capQueue, &frame))
+        release_pipe_frame(camHal, &frame);
+
+    camHal->lock.lock();
+    while(0 == frameQueuePop(&camHal->presentQueue, &frame))
+        put_buf_to_display(camHal, frame.dispIdx);
+    camHal->lock.unlock();
+
+    for(i = 0; i < USB_CAM_PIPE_STAGING_CNT; i++) {
+        free(camHal->staging[i].data);
+        camHal->staging[i].data = NULL;
+        camHal->staging[i].len  = 0;
+    }
+    frameQueueDeinit(&camHal->stagingFreeQueue);
+    frameQueueDeinit(&camHal->presentQueue);
+    frameQueueDeinit(&camHal->capQueue);
+
+    ALOGD("%s: X, dropped frames: %d", __func__, camHal->pipeDropCnt);
+}
+
+/******************************************************************************
+ * Function: pipelined_previewloop
+ * Description: This is the present stage of the pipelined preview. It runs
+ *              on the preview thread, sends decoded frames to the display and
+ *              the preview callback, and services preview thread commands.
+ *
+ * Input parameters:
+ *  camHal                  - camera HAL handle
+ *
+ * Return values:
+ *      NULL
+ *
+ * Notes: Capture of frame N+1 and decode of frame N overlap with the
+ *        presentation of frame N-1
+ *****************************************************************************/
+static void * pipelined_previewloop(camera_hardware_t *camHal)
+{
+    usb_cam_frame_t frame;
+    int             rc, haveFrame;
+
+    ALOGD("%s: E", __func__);
+
+    camHal->pipeDropCnt = 0;
+    if(start_preview_pipeline(camHal)) {
+        ALOGE("%s: start_preview_pipeline failed", __func__);
+        return (void *)-1;
+    }
+    camHal->lock.lock();
+    camHal->pipeActive = 1;
+    camHal->lock.unlock();
+
+    while(1) {
+        haveFrame = (0 == frameQueueGet(&camHal->presentQueue, &frame, 500));
+
         camHal->lock.lock();
-        if (previewMem)
-            previewMem->release(previewMem);
+        if(camHal->windowChangePending) {
+            /* decoded frames belong to the old window */
+            if(haveFrame)
+                put_buf_to_display(camHal, frame.dispIdx);
+            haveFrame = 0;
+
+            camHal->lock.unlock();
+            stop_preview_pipeline(camHal);
+            camHal->lock.lock();
+
+            service_window_change(camHal);
+
+            camHal->lock.unlock();
+            rc = start_preview_pipeline(camHal);
+            camHal->lock.lock();
+            if(rc) {
+                camHal->pipeActive = 0;
+                camHal->lock.unlock();
+                ALOGE("%s: start_preview_pipeline failed", __func__);
+                return (void *)-1;
+            }
+        }
+        if(camHal->prvwCmdPending)
+        {
+            /* command is serviced. Hence command pending = 0  */
+            camHal->prvwCmdPending--;
+            if((USB_CAM_PREVIEW_EXIT == camHal->prvwCmd) ||
+               (USB_CAM_PREVIEW_TAKEPIC == camHal->prvwCmd)) {
+                if(haveFrame)
+                    put_buf_to_display(camHal, frame.dispIdx);
+                haveFrame = 0;
+
+                /* yield lock while the pipeline threads exit */
+                camHal->lock.unlock();
+                stop_preview_pipeline(camHal);
+                camHal->lock.lock();
+
+                /* a window change that came in meanwhile needs no restart */
+                service_window_change(camHal);
+
+                if(USB_CAM_PREVIEW_EXIT == camHal->prvwCmd){
+                    camHal->pipeActive = 0;
+                    camHal->lock.unlock();
+                    ALOGI("%s: Exiting coz USB_CAM_PREVIEW_EXIT", __func__);
+                    return (void *)0;
+                }
+
+                rc = prvwThreadTakePictureInternal(camHal);
+                if(rc)
+                    ALOGE("%s: prvwThreadTakePictureInternal returned error",
+                    __func__);
+
+                camHal->lock.unlock();
+                rc = start_preview_pipeline(camHal);
+                camHal->lock.lock();
+                if(rc) {
+                    camHal->pipeActive = 0;
+                    camHal->lock.unlock();
+                    ALOGE("%s: start_preview_pipeline failed", __func__);
+                    return (void *)-1;
+                }
+            }
+        }
+
+        if(haveFrame) {
+#if DISPLAY
+            if(0 == put_buf_to_display(camHal, frame.dispIdx))
+                ALOGD("%s: put_buf_to_display success: %d",
+                     __func__, frame.dispIdx);
+            else
+                ALOGE("%s: put_buf_to_display error", __func__);
 #endif
+#if CALL_BACK
+            send_preview_callback(camHal, frame.dispIdx);
+#endif
+        }
+        camHal->lock.unlock();
+    }
 
-    }//while(1)
     ALOGD("%s: X", __func__);
     return (void *)0;
 }
@@ -2827,9 +3585,10 @@ int encodeJpeg(camera_hardware_t *camHal)
         return -1;
     }
 
-    rc = convert_YUYV_to_420_NV12(
+    rc = convert_YUYV_to_420_NV12(camHal,
         (char *)camHal->buffers[camHal->curCaptureBuf.index].data,
-        (char *)jpegInMem->data, camHal->pictWidth, camHal->pictHeight);
+        (char *)jpegInMem->data, camHal->pictWidth,
+        camHal->pictWidth, camHal->pictHeight);
     ERROR_CHECK_EXIT(rc, "convert_YUYV_to_420_NV12");
     /************************************************************************/
     /* - Populate JPEG encoding parameters from the camHal context          */